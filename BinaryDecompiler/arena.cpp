@@ -0,0 +1,103 @@
+#include "internal_includes/arena.h"
+#include "stdlib.h"
+
+// Big enough that typical vertex and pixel shaders fit in the first chunk.
+// Declarations carry an inline immediate constant buffer, so are ~16KB each:
+static const size_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+
+DecodeArena::DecodeArena() :
+	ui64ChunkAllocations(0),
+	uHighWaterMark(0),
+	psChunks(NULL),
+	pcPos(NULL),
+	pcEnd(NULL),
+	uUsedInFullChunks(0)
+{
+}
+
+DecodeArena::~DecodeArena()
+{
+	FreeChunks();
+}
+
+void DecodeArena::FreeChunks()
+{
+	Chunk *psChunk, *psNext;
+
+	for (psChunk = psChunks; psChunk; psChunk = psNext) {
+		psNext = psChunk->psNext;
+		free(psChunk);
+	}
+
+	psChunks = NULL;
+	pcPos = NULL;
+	pcEnd = NULL;
+	uUsedInFullChunks = 0;
+}
+
+void DecodeArena::NewChunk(size_t uMinSize)
+{
+	size_t uSize = DEFAULT_CHUNK_SIZE;
+	Chunk *psChunk;
+
+	// Grow geometrically so a huge shader still only needs a handful of
+	// chunks the first time through:
+	if (psChunks && psChunks->uSize > uSize / 2)
+		uSize = psChunks->uSize * 2;
+	if (uSize < uMinSize + sizeof(Chunk))
+		uSize = uMinSize + sizeof(Chunk);
+
+	psChunk = (Chunk*)malloc(uSize);
+	if (!psChunk)
+		throw std::bad_alloc();
+	ui64ChunkAllocations++;
+
+	if (psChunks)
+		uUsedInFullChunks += pcPos - ((char*)psChunks + sizeof(Chunk));
+
+	psChunk->psNext = psChunks;
+	psChunk->uSize = uSize;
+	psChunks = psChunk;
+	pcPos = (char*)psChunk + sizeof(Chunk);
+	pcEnd = (char*)psChunk + uSize;
+}
+
+void* DecodeArena::Allocate(size_t size, size_t align)
+{
+	char *pcAligned;
+
+	if (size == 0)
+		size = 1;
+
+	pcAligned = (char*)(((uintptr_t)pcPos + align - 1) & ~(uintptr_t)(align - 1));
+	if (!pcPos || pcAligned + size > pcEnd) {
+		NewChunk(size + align);
+		pcAligned = (char*)(((uintptr_t)pcPos + align - 1) & ~(uintptr_t)(align - 1));
+	}
+
+	pcPos = pcAligned + size;
+	return pcAligned;
+}
+
+void DecodeArena::Reset()
+{
+	size_t uUsed;
+
+	if (!psChunks)
+		return;
+
+	uUsed = uUsedInFullChunks + (pcPos - ((char*)psChunks + sizeof(Chunk)));
+	if (uUsed > uHighWaterMark)
+		uHighWaterMark = uUsed;
+
+	// If the last shader spilled into more than one chunk, replace them
+	// with a single chunk that would have held it all, so the next shader
+	// of a similar size doesn't need to touch the heap:
+	if (psChunks->psNext) {
+		FreeChunks();
+		NewChunk(uUsed);
+	}
+
+	pcPos = (char*)psChunks + sizeof(Chunk);
+	uUsedInFullChunks = 0;
+}
@@ -37,8 +37,10 @@ typedef struct DXBCChunkHeaderTAG
 } DXBCChunkHeader;
 
 #ifdef _DEBUG
-static uint64_t operandID = 0;
-static uint64_t instructionID = 0;
+#include <atomic>
+// Atomic since cmd_Decompiler's batch mode decodes shaders on several threads:
+static std::atomic<uint64_t> operandID(0);
+static std::atomic<uint64_t> instructionID(0);
 #endif
 
 #if defined(_WIN32)
@@ -50,6 +52,15 @@ static uint64_t instructionID = 0;
 // VS2013 BUG WORKAROUND: Make sure this class has a unique type name!
 class DecompileError: public std::exception {} decompileError;
 
+// Sub-operands are only referenced from their parent operand and were
+// never freed, so they go in the arena when there is one:
+static Operand* NewSubOperand(Shader* psShader)
+{
+	if (psShader->psArena)
+		return psShader->psArena->New<Operand>();
+	return new Operand();
+}
+
 void DecodeNameToken(const uint32_t* pui32NameToken, Operand* psOperand)
 {
     psOperand->eSpecialName = DecodeOperandSpecialName(*pui32NameToken);
@@ -143,7 +154,7 @@ void DecodeNameToken(const uint32_t* pui32NameToken, Operand* psOperand)
 
 // Find the declaration of the texture described by psTextureOperand and
 // mark it as a shadow type. (e.g. accessed via sampler2DShadow rather than sampler2D)
-void MarkTextureAsShadow(ShaderInfo* psShaderInfo, std::vector<Declaration> &psDeclList, const Operand* psTextureOperand)
+void MarkTextureAsShadow(ShaderInfo* psShaderInfo, DeclarationList &psDeclList, const Operand* psTextureOperand)
 {
     ResourceBinding* psBinding = 0;
 	int found;
@@ -154,7 +165,7 @@ void MarkTextureAsShadow(ShaderInfo* psShaderInfo, std::vector<Declaration> &psD
 
 	if(found)
 	{
-		for (std::vector<Declaration>::iterator psDecl = psDeclList.begin(); psDecl != psDeclList.end(); ++psDecl)
+		for (DeclarationList::iterator psDecl = psDeclList.begin(); psDecl != psDeclList.end(); ++psDecl)
 		{
 			if(psDecl->eOpcode == OPCODE_DCL_RESOURCE)
 			{
@@ -169,7 +180,7 @@ void MarkTextureAsShadow(ShaderInfo* psShaderInfo, std::vector<Declaration> &psD
 	}
 }
 
-uint32_t DecodeOperand (const uint32_t *pui32Tokens, Operand* psOperand)
+uint32_t DecodeOperand (Shader* psShader, const uint32_t *pui32Tokens, Operand* psOperand)
 {
     int i;
 	uint32_t ui32NumTokens = 1;
@@ -191,6 +202,7 @@ uint32_t DecodeOperand (const uint32_t *pui32Tokens, Operand* psOperand)
 
 
     psOperand->eModifier = OPERAND_MODIFIER_NONE;
+    psOperand->eMinPrecision = OPERAND_MIN_PRECISION_DEFAULT;
     psOperand->psSubOperand[0] = 0;
     psOperand->psSubOperand[1] = 0;
     psOperand->psSubOperand[2] = 0;
@@ -312,8 +324,8 @@ uint32_t DecodeOperand (const uint32_t *pui32Tokens, Operand* psOperand)
             }
             case OPERAND_INDEX_RELATIVE:
             {
-                psOperand->psSubOperand[i] = new Operand();
-                    DecodeOperand(pui32Tokens+ui32NumTokens, psOperand->psSubOperand[i]);
+                psOperand->psSubOperand[i] = NewSubOperand(psShader);
+                    DecodeOperand(psShader, pui32Tokens+ui32NumTokens, psOperand->psSubOperand[i]);
 
                     ui32NumTokens++;
                 break;
@@ -325,8 +337,8 @@ uint32_t DecodeOperand (const uint32_t *pui32Tokens, Operand* psOperand)
 
                 ui32NumTokens++;
 
-                psOperand->psSubOperand[i] = new Operand();
-                    DecodeOperand(pui32Tokens+ui32NumTokens, psOperand->psSubOperand[i]);
+                psOperand->psSubOperand[i] = NewSubOperand(psShader);
+                    DecodeOperand(psShader, pui32Tokens+ui32NumTokens, psOperand->psSubOperand[i]);
 
 				ui32NumTokens++;
 				break;
@@ -368,13 +380,13 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
         {
             psDecl->value.eResourceDimension = DecodeResourceDimension(*pui32Token);
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             break;
         }
         case OPCODE_DCL_CONSTANT_BUFFER: // custom operand formats.
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             break;
         }
         case OPCODE_DCL_SAMPLER:
@@ -384,7 +396,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
         case OPCODE_DCL_INDEX_RANGE:
         {
             psDecl->ui32NumOperands = 1;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             psDecl->value.ui32IndexRange = pui32Token[ui32OperandOffset];
 
             if(psDecl->asOperands[0].eType == OPERAND_TYPE_INPUT)
@@ -451,13 +463,13 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
         case OPCODE_DCL_INPUT:
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             break;
         }
         case OPCODE_DCL_INPUT_SIV:
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             if(psShader->eShaderType == PIXEL_SHADER)
             {
                 psDecl->value.eInterpolation = DecodeInterpolationMode(*pui32Token);
@@ -469,14 +481,14 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
         {
             psDecl->ui32NumOperands = 1;
             psDecl->value.eInterpolation = DecodeInterpolationMode(*pui32Token);
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             break;
         }
         case OPCODE_DCL_INPUT_SGV:
         case OPCODE_DCL_INPUT_PS_SGV:
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             DecodeNameToken(pui32Token + 3, &psDecl->asOperands[0]);
             break;
         }
@@ -488,7 +500,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
         case OPCODE_DCL_OUTPUT:
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             break;
         }
         case OPCODE_DCL_OUTPUT_SGV:
@@ -498,7 +510,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
         case OPCODE_DCL_OUTPUT_SIV:
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             DecodeNameToken(pui32Token + 3, &psDecl->asOperands[0]);
             break;
         }
@@ -549,7 +561,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
         case OPCODE_DCL_FUNCTION_BODY:
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             break;
         }
         case OPCODE_DCL_FUNCTION_TABLE:
@@ -644,7 +656,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
             psDecl->sUAV.ui32GloballyCoherentAccess = DecodeAccessCoherencyFlags(*pui32Token);
 			psDecl->sUAV.bCounter = 0;
 			psDecl->sUAV.ui32BufferSize = 0;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
 			psDecl->sUAV.Type = DecodeResourceReturnType(0, pui32Token[ui32OperandOffset]);
             break;
         }
@@ -657,7 +669,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
             psDecl->sUAV.ui32GloballyCoherentAccess = DecodeAccessCoherencyFlags(*pui32Token);
 			psDecl->sUAV.bCounter = 0;
 			psDecl->sUAV.ui32BufferSize = 0;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
 			//This should be a RTYPE_UAV_RWBYTEADDRESS buffer. It is memory backed by
 			//a shader storage buffer whose is unknown at compile time.
 			psDecl->sUAV.ui32BufferSize = 0;
@@ -672,7 +684,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
             psDecl->sUAV.ui32GloballyCoherentAccess = DecodeAccessCoherencyFlags(*pui32Token);
 			psDecl->sUAV.bCounter = 0;
 			psDecl->sUAV.ui32BufferSize = 0;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
 			
             // Upstream dropped the 'if' here when they reworked
             // StructuredBuffers, leading to a NULL pointer dereference on
@@ -702,13 +714,13 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
         case OPCODE_DCL_RESOURCE_STRUCTURED:
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             break;
         }
         case OPCODE_DCL_RESOURCE_RAW:
         {
             psDecl->ui32NumOperands = 1;
-            DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
             break;
         }
         case OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_STRUCTURED:
@@ -719,7 +731,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
             psDecl->ui32NumOperands = 1;
             psDecl->sUAV.ui32GloballyCoherentAccess = 0;
 
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
 
             psDecl->sTGSM.ui32Stride = pui32Token[ui32OperandOffset++];
             psDecl->sTGSM.ui32Count = pui32Token[ui32OperandOffset++];
@@ -733,7 +745,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
             psDecl->ui32NumOperands = 1;
             psDecl->sUAV.ui32GloballyCoherentAccess = 0;
 
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
 
             psDecl->sTGSM.ui32Stride = 4;
             psDecl->sTGSM.ui32Count = pui32Token[ui32OperandOffset++];
@@ -742,7 +754,7 @@ const uint32_t* DecodeDeclaration(Shader* psShader, const uint32_t* pui32Token,
 		case OPCODE_DCL_STREAM:
 		{
 			psDecl->ui32NumOperands = 1;
-			DecodeOperand(pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
+			DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psDecl->asOperands[0]);
 			break;
 		}
 		case OPCODE_DCL_GS_INSTANCE_COUNT:
@@ -856,7 +868,7 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_LABEL:
         {
             psInst->ui32NumOperands = 1;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
 
 			if(eOpcode == OPCODE_CASE)
 			{
@@ -870,7 +882,7 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
             psInst->ui32NumOperands = 1;
             psInst->ui32FuncIndexWithinInterface = pui32Token[ui32OperandOffset];
             ui32OperandOffset++;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
             
             break;
         }
@@ -881,8 +893,8 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_MOV:
         {
             psInst->ui32NumOperands = 2;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
 
             //Mov with an integer dest. If src is an immediate then it must be encoded as an integer.
             if(psInst->asOperands[0].eMinPrecision == OPERAND_MIN_PRECISION_SINT_16 ||
@@ -929,8 +941,8 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_NOT:
         {
             psInst->ui32NumOperands = 2;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
             break;
         }
 
@@ -987,9 +999,9 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
 		case OPCODE_SAMPLE_POS:		// bo3b: added for WatchDogs
         {
             psInst->ui32NumOperands = 3;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
             break;
         }
         //Instructions with four operands go here
@@ -1017,10 +1029,10 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_DFMA:
 		{
             psInst->ui32NumOperands = 4;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
             break;
 		}
         case OPCODE_GATHER4_PO:
@@ -1030,11 +1042,11 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_IMM_ATOMIC_CMP_EXCH:
         {
             psInst->ui32NumOperands = 5;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[4]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[4]);
             break;
         }
         case OPCODE_GATHER4_C:
@@ -1043,11 +1055,11 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_SAMPLE_B:
 		{
             psInst->ui32NumOperands = 5;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[4]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[4]);
 
 			/* sample_b is not a shadow sampler, others need flagging */
 			if (eOpcode != OPCODE_SAMPLE_B)
@@ -1063,12 +1075,12 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_SAMPLE_D:
         {
             psInst->ui32NumOperands = 6;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[4]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[5]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[4]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[5]);
 
 			/* sample_d is not a shadow sampler, others need flagging */
 			if (eOpcode != OPCODE_SAMPLE_D)
@@ -1088,8 +1100,8 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         {
             psInst->eBooleanTestType = DecodeInstrTestBool(*pui32Token);
             psInst->ui32NumOperands = 2;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
             break;
         }
 		case OPCODE_CUSTOMDATA:
@@ -1101,17 +1113,17 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_EVAL_CENTROID:
         {
             psInst->ui32NumOperands = 2;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
             break;
         }
         case OPCODE_EVAL_SAMPLE_INDEX:
         case OPCODE_EVAL_SNAPPED:
         {
             psInst->ui32NumOperands = 3;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
             break;
         }
         case OPCODE_STORE_UAV_TYPED:
@@ -1120,19 +1132,19 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
         case OPCODE_STORE_RAW:
         {
             psInst->ui32NumOperands = 3;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
             break;
         }
         case OPCODE_STORE_STRUCTURED:
         case OPCODE_LD_STRUCTURED:
         {
             psInst->ui32NumOperands = 4;
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[3]);
             break;
         }
 		case OPCODE_RESINFO:
@@ -1141,9 +1153,9 @@ const uint32_t* DeocdeInstruction(const uint32_t* pui32Token, Instruction* psIns
 
 			psInst->eResInfoReturnType = DecodeResInfoReturnType(pui32Token[0]);
 
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
-            ui32OperandOffset += DecodeOperand(pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[0]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[1]);
+            ui32OperandOffset += DecodeOperand(psShader, pui32Token+ui32OperandOffset, &psInst->asOperands[2]);
             break;
         }
         case OPCODE_MSAD:
@@ -1188,6 +1200,37 @@ void UpdateOperandReferences(Shader* psShader, Instruction* psInst)
     }
 }
 
+// 3DMIGOTO ADDITION: Counts the instructions up to the end of the current
+// phase so the instruction list can be sized up front rather than growing
+// (and leaving discarded copies behind in the arena) as it is decoded.
+static uint32_t CountPhaseInstructions(const uint32_t* pui32Tokens, Shader* psShader)
+{
+	const uint32_t* pui32CurrentToken = pui32Tokens;
+	const uint32_t* pui32End = psShader->pui32FirstToken + psShader->ui32ShaderLength;
+	uint32_t ui32Count = 0;
+
+	while (pui32CurrentToken < pui32End)
+	{
+		uint32_t ui32TokenLength = DecodeInstructionLength(*pui32CurrentToken);
+		const OPCODE_TYPE eOpcode = DecodeOpcodeType(*pui32CurrentToken);
+
+		if(eOpcode == OPCODE_HS_FORK_PHASE || eOpcode == OPCODE_HS_JOIN_PHASE)
+			break;
+
+		if(eOpcode == OPCODE_CUSTOMDATA)
+			ui32TokenLength = pui32CurrentToken[1];
+
+		// Malformed, let the decoder deal with it:
+		if(ui32TokenLength == 0)
+			break;
+
+		pui32CurrentToken += ui32TokenLength;
+		ui32Count++;
+	}
+
+	return ui32Count;
+}
+
 const uint32_t* DecodeShaderPhase(const uint32_t* pui32Tokens,
 										  Shader* psShader,
 										  const uint32_t ui32Phase)
@@ -1197,19 +1240,20 @@ const uint32_t* DecodeShaderPhase(const uint32_t* pui32Tokens,
 	const uint32_t ui32InstanceIndex = psShader->asPhase[ui32Phase].ui32InstanceCount;
 
 	//Declarations
-	std::vector<Declaration> &psDecl = psShader->asPhase[ui32Phase].ppsDecl[ui32InstanceIndex];
+	DeclarationList &psDecl = psShader->asPhase[ui32Phase].ppsDecl[ui32InstanceIndex];
 
 	psShader->asPhase[ui32Phase].ui32InstanceCount++;
 
     while(1) //Keep going until we reach the first non-declaration token, or the end of the shader.
     {
-		Declaration decl;
-        const uint32_t* pui32Result = DecodeDeclaration(psShader, pui32CurrentToken, &decl);
+		// 3DMIGOTO: Decode in place - Declaration is ~16KB with its
+		// inline immediate constant buffer, so avoid copying it:
+		psDecl.emplace_back();
+        const uint32_t* pui32Result = DecodeDeclaration(psShader, pui32CurrentToken, &psDecl.back());
 
         if(pui32Result)
         {
             pui32CurrentToken = pui32Result;
-			psDecl.push_back(decl);
 
             if(pui32CurrentToken >= (psShader->pui32FirstToken + ui32ShaderLength))
             {
@@ -1218,38 +1262,43 @@ const uint32_t* DecodeShaderPhase(const uint32_t* pui32Tokens,
         }
         else
         {
+			psDecl.pop_back();
             break;
         }
     }
 
 
 	//Instructions
-	std::vector<Instruction> &psInst = psShader->asPhase[ui32Phase].ppsInst[ui32InstanceIndex];
+	InstructionList &psInst = psShader->asPhase[ui32Phase].ppsInst[ui32InstanceIndex];
+
+	psInst.reserve(CountPhaseInstructions(pui32CurrentToken, psShader));
 
     while (pui32CurrentToken < (psShader->pui32FirstToken + ui32ShaderLength))
     {
-		Instruction inst;
+		psInst.emplace_back();
+		Instruction &inst = psInst.back();
         const uint32_t* nextInstr = DeocdeInstruction(pui32CurrentToken, &inst, psShader);
 
 #ifdef _DEBUG
         if(nextInstr == pui32CurrentToken)
         {
             ASSERT(0);
+			psInst.pop_back();
             break;
         }
 #endif
 
 		if(inst.eOpcode == OPCODE_HS_FORK_PHASE)
 		{
+			psInst.pop_back();
 			return pui32CurrentToken;
 		}
 		else if(inst.eOpcode == OPCODE_HS_JOIN_PHASE)
 		{
+			psInst.pop_back();
 			return pui32CurrentToken;
 		}
         pui32CurrentToken = nextInstr;
-
-        psInst.push_back(inst);
     }
 
 	return pui32CurrentToken;
@@ -1290,9 +1339,7 @@ const void AllocateHullPhaseArrays(const uint32_t* pui32Tokens,
 
 	if(ui32InstanceCount)
 	{
-		psShader->asPhase[ui32Phase].ppsDecl.resize(ui32InstanceCount);
-
-		psShader->asPhase[ui32Phase].ppsInst.resize(ui32InstanceCount);
+		psShader->asPhase[ui32Phase].ResizeInstances(ui32InstanceCount);
 	}
 }
 
@@ -1301,7 +1348,7 @@ const uint32_t* DecodeHullShader(const uint32_t* pui32Tokens, Shader* psShader)
 	const uint32_t* pui32CurrentToken = pui32Tokens;
 	const uint32_t ui32ShaderLength = psShader->ui32ShaderLength;
 
-	std::vector<Declaration> &psDecl = psShader->asPhase[HS_GLOBAL_DECL].ppsDecl[0];
+	DeclarationList &psDecl = psShader->asPhase[HS_GLOBAL_DECL].ppsDecl[0];
 	psShader->asPhase[HS_GLOBAL_DECL].ui32InstanceCount = 1;
 
 	AllocateHullPhaseArrays(pui32Tokens, psShader, HS_CTRL_POINT_PHASE, OPCODE_HS_CONTROL_POINT_PHASE);
@@ -1375,7 +1422,7 @@ void Decode(const uint32_t* pui32Tokens, Shader* psShader)
 	DecodeShaderPhase(pui32CurrentToken, psShader, MAIN_PHASE);
 }
 
-Shader* DecodeDXBC(uint32_t* data)
+Shader* DecodeDXBC(uint32_t* data, DecodeArena* psArena)
 {
     Shader* psShader;
 	DXBCContainerHeader* header = (DXBCContainerHeader*)data;
@@ -1477,7 +1524,7 @@ Shader* DecodeDXBC(uint32_t* data)
         uint32_t ui32MajorVersion;
         uint32_t ui32MinorVersion;
 
-	psShader = new Shader();
+	psShader = new Shader(psArena);
 
         ui32MajorVersion = DecodeProgramMajorVersion(*shaderChunk);
         ui32MinorVersion = DecodeProgramMinorVersion(*shaderChunk);
@@ -0,0 +1,2275 @@
+// 3DMIGOTO ADDITION: Native SM4/SM5 disassembler. See disassemble.h.
+//
+// This walks the container and the token stream itself rather than going via
+// the Shader structure DecodeHLSL() builds, since that is designed for the
+// decompiler and drops details the disassembly needs (operand modifiers on
+// relative indices, extended resource return types, the RDEF creator string
+// and variable flags, etc). The token decoding helpers from tokens.h are
+// shared with the decoder.
+
+#include "internal_includes/disassemble.h"
+#include "internal_includes/tokens.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#define FOURCC(a, b, c, d) ((uint32_t)(uint8_t)(a) | ((uint32_t)(uint8_t)(b) << 8) | ((uint32_t)(uint8_t)(c) << 16) | ((uint32_t)(uint8_t)(d) << 24 ))
+enum {FOURCC_DXBC = FOURCC('D', 'X', 'B', 'C')}; //DirectX byte code
+enum {FOURCC_SHDR = FOURCC('S', 'H', 'D', 'R')}; //Shader model 4 code
+enum {FOURCC_SHEX = FOURCC('S', 'H', 'E', 'X')}; //Shader model 5 code
+enum {FOURCC_RDEF = FOURCC('R', 'D', 'E', 'F')}; //Resource definition (e.g. constant buffers)
+enum {FOURCC_ISGN = FOURCC('I', 'S', 'G', 'N')}; //Input signature
+enum {FOURCC_OSGN = FOURCC('O', 'S', 'G', 'N')}; //Output signature
+enum {FOURCC_PCSG = FOURCC('P', 'C', 'S', 'G')}; //Patch-constant signature
+enum {FOURCC_ISG1 = FOURCC('I', 'S', 'G', '1')}; //Input signature with Stream and MinPrecision
+enum {FOURCC_OSG1 = FOURCC('O', 'S', 'G', '1')}; //Output signature with Stream and MinPrecision
+enum {FOURCC_OSG5 = FOURCC('O', 'S', 'G', '5')}; //Output signature with Stream
+enum {FOURCC_PSG1 = FOURCC('P', 'S', 'G', '1')}; //Patch-constant signature with MinPrecision
+enum {FOURCC_SFI0 = FOURCC('S', 'F', 'I', '0')}; //Subshader feature info
+enum {FOURCC_STAT = FOURCC('S', 'T', 'A', 'T')}; //Statistics
+
+typedef struct DXBCContainerHeaderTAG
+{
+	unsigned fourcc;
+	uint32_t unk[4];
+	uint32_t one;
+	uint32_t totalSize;
+	uint32_t chunkCount;
+} DXBCContainerHeader;
+
+typedef struct DXBCChunkHeaderTAG
+{
+	unsigned fourcc;
+	unsigned size;
+} DXBCChunkHeader;
+
+typedef struct ChunkTAG
+{
+	const uint8_t* pui8Data;
+	uint32_t ui32Size;
+	uint32_t ui32EntrySize; // Signatures only
+} Chunk;
+
+typedef struct OperandTextTAG
+{
+	std::string sText;
+	uint32_t ui32Modifier;
+	uint32_t ui32MinPrecision;
+	bool bValue; // Something that can carry a min precision tag
+} OperandText;
+
+typedef struct DisassemblerTAG
+{
+	std::string* psText;
+	bool bFailed;
+
+	Chunk sRDEF;
+	Chunk sISGN;
+	Chunk sOSGN;
+	Chunk sPCSG;
+	Chunk sSFI0;
+	Chunk sSHDR;
+	Chunk sSTAT;
+
+	const uint32_t* pui32Code;
+	uint32_t ui32CodeLength;
+	SHADER_TYPE eShaderType;
+	uint32_t ui32GlobalFlags;
+	bool bSampleFrequency;
+
+	OperandText asOperands[8];
+} Disassembler;
+
+// Literal types per operand of an instruction, used to pick how immediate
+// values are printed:
+//   'f' float, 'i' integer, 'd' double, 'x' untyped (guess from the bits).
+// Operands past the end of the string are untyped.
+static const char* LiteralTypes(OPCODE_TYPE eOpcode)
+{
+	switch (eOpcode)
+	{
+		case OPCODE_ADD: case OPCODE_DERIV_RTX: case OPCODE_DERIV_RTY: case OPCODE_DIV:
+		case OPCODE_DP2: case OPCODE_DP3: case OPCODE_DP4: case OPCODE_EQ: case OPCODE_EXP:
+		case OPCODE_FRC: case OPCODE_GE: case OPCODE_LOG: case OPCODE_LT: case OPCODE_MAD:
+		case OPCODE_MIN: case OPCODE_MAX: case OPCODE_MUL: case OPCODE_NE:
+		case OPCODE_ROUND_NE: case OPCODE_ROUND_NI: case OPCODE_ROUND_PI: case OPCODE_ROUND_Z:
+		case OPCODE_RSQ: case OPCODE_SQRT: case OPCODE_SINCOS: case OPCODE_RCP:
+		case OPCODE_DERIV_RTX_COARSE: case OPCODE_DERIV_RTX_FINE:
+		case OPCODE_DERIV_RTY_COARSE: case OPCODE_DERIV_RTY_FINE:
+		case OPCODE_DCL_HS_MAX_TESSFACTOR:
+			return "fffff";
+		case OPCODE_AND: case OPCODE_IADD: case OPCODE_IEQ: case OPCODE_IGE: case OPCODE_ILT:
+		case OPCODE_IMAD: case OPCODE_IMAX: case OPCODE_IMIN: case OPCODE_IMUL: case OPCODE_INE:
+		case OPCODE_INEG: case OPCODE_ISHL: case OPCODE_ISHR: case OPCODE_NOT: case OPCODE_OR:
+		case OPCODE_XOR: case OPCODE_UDIV: case OPCODE_ULT: case OPCODE_UGE: case OPCODE_UMUL:
+		case OPCODE_UMAD: case OPCODE_UMAX: case OPCODE_UMIN: case OPCODE_USHR:
+		case OPCODE_COUNTBITS: case OPCODE_FIRSTBIT_HI: case OPCODE_FIRSTBIT_LO:
+		case OPCODE_FIRSTBIT_SHI: case OPCODE_UBFE: case OPCODE_IBFE: case OPCODE_BFI:
+		case OPCODE_BFREV: case OPCODE_UADDC: case OPCODE_USUBB: case OPCODE_MSAD:
+		case OPCODE_CASE: case OPCODE_SWITCH:
+			return "iiiii";
+		case OPCODE_FTOI: case OPCODE_FTOU: case OPCODE_F32TOF16:
+			return "if";
+		case OPCODE_ITOF: case OPCODE_UTOF: case OPCODE_F16TOF32:
+			return "fi";
+		case OPCODE_DADD: case OPCODE_DMAX: case OPCODE_DMIN: case OPCODE_DMUL: case OPCODE_DMOV:
+		case OPCODE_DDIV: case OPCODE_DFMA: case OPCODE_DRCP:
+			return "dddd";
+		case OPCODE_DEQ: case OPCODE_DGE: case OPCODE_DLT: case OPCODE_DNE:
+			return "xdd";
+		case OPCODE_DMOVC:
+			return "dxdd";
+		case OPCODE_DTOF:
+			return "fd";
+		case OPCODE_FTOD:
+			return "df";
+		case OPCODE_DTOI: case OPCODE_DTOU:
+			return "id";
+		case OPCODE_ITOD: case OPCODE_UTOD:
+			return "di";
+		case OPCODE_LD: case OPCODE_RESINFO: case OPCODE_LD_RAW: case OPCODE_LD_UAV_TYPED:
+			return "xi-";
+		case OPCODE_LD_MS:
+			return "xi-i";
+		case OPCODE_LD_STRUCTURED:
+			return "xii-";
+		case OPCODE_SAMPLE: case OPCODE_GATHER4: case OPCODE_LOD:
+			return "xf--";
+		case OPCODE_SAMPLE_C: case OPCODE_SAMPLE_C_LZ: case OPCODE_SAMPLE_L: case OPCODE_SAMPLE_B:
+		case OPCODE_GATHER4_C:
+			return "xf--f";
+		case OPCODE_SAMPLE_D:
+			return "xf--ff";
+		case OPCODE_GATHER4_PO:
+			return "xfi--";
+		case OPCODE_GATHER4_PO_C:
+			return "xfi--f";
+		case OPCODE_SAMPLE_POS: case OPCODE_EVAL_SNAPPED: case OPCODE_EVAL_SAMPLE_INDEX:
+			return "x-i";
+		case OPCODE_STORE_RAW: case OPCODE_STORE_UAV_TYPED:
+			return "-ix";
+		case OPCODE_STORE_STRUCTURED:
+			return "-iix";
+		case OPCODE_ATOMIC_AND: case OPCODE_ATOMIC_OR: case OPCODE_ATOMIC_XOR:
+		case OPCODE_ATOMIC_IADD: case OPCODE_ATOMIC_IMAX: case OPCODE_ATOMIC_IMIN:
+		case OPCODE_ATOMIC_UMAX: case OPCODE_ATOMIC_UMIN:
+			return "-ii";
+		case OPCODE_ATOMIC_CMP_STORE:
+			return "-iii";
+		case OPCODE_IMM_ATOMIC_IADD: case OPCODE_IMM_ATOMIC_AND: case OPCODE_IMM_ATOMIC_OR:
+		case OPCODE_IMM_ATOMIC_XOR: case OPCODE_IMM_ATOMIC_EXCH: case OPCODE_IMM_ATOMIC_IMAX:
+		case OPCODE_IMM_ATOMIC_IMIN: case OPCODE_IMM_ATOMIC_UMAX: case OPCODE_IMM_ATOMIC_UMIN:
+			return "x-ii";
+		case OPCODE_IMM_ATOMIC_CMP_EXCH:
+			return "x-iii";
+	}
+	return "";
+}
+
+// Mnemonics for the instructions that are rendered as the name followed by
+// their operands. Declarations and anything else with a custom layout are
+// handled separately in DisassembleInstruction():
+static const char* InstructionName(OPCODE_TYPE eOpcode)
+{
+	switch (eOpcode)
+	{
+		case OPCODE_ADD: return "add";
+		case OPCODE_AND: return "and";
+		case OPCODE_BREAK: return "break";
+		case OPCODE_BREAKC: return "breakc";
+		case OPCODE_CALL: return "call";
+		case OPCODE_CALLC: return "callc";
+		case OPCODE_CASE: return "case";
+		case OPCODE_CONTINUE: return "continue";
+		case OPCODE_CONTINUEC: return "continuec";
+		case OPCODE_CUT: return "cut";
+		case OPCODE_DEFAULT: return "default";
+		case OPCODE_DERIV_RTX: return "deriv_rtx";
+		case OPCODE_DERIV_RTY: return "deriv_rty";
+		case OPCODE_DISCARD: return "discard";
+		case OPCODE_DIV: return "div";
+		case OPCODE_DP2: return "dp2";
+		case OPCODE_DP3: return "dp3";
+		case OPCODE_DP4: return "dp4";
+		case OPCODE_ELSE: return "else";
+		case OPCODE_EMIT: return "emit";
+		case OPCODE_EMITTHENCUT: return "emit_then_cut";
+		case OPCODE_ENDIF: return "endif";
+		case OPCODE_ENDLOOP: return "endloop";
+		case OPCODE_ENDSWITCH: return "endswitch";
+		case OPCODE_EQ: return "eq";
+		case OPCODE_EXP: return "exp";
+		case OPCODE_FRC: return "frc";
+		case OPCODE_FTOI: return "ftoi";
+		case OPCODE_FTOU: return "ftou";
+		case OPCODE_GE: return "ge";
+		case OPCODE_IADD: return "iadd";
+		case OPCODE_IF: return "if";
+		case OPCODE_IEQ: return "ieq";
+		case OPCODE_IGE: return "ige";
+		case OPCODE_ILT: return "ilt";
+		case OPCODE_IMAD: return "imad";
+		case OPCODE_IMAX: return "imax";
+		case OPCODE_IMIN: return "imin";
+		case OPCODE_IMUL: return "imul";
+		case OPCODE_INE: return "ine";
+		case OPCODE_INEG: return "ineg";
+		case OPCODE_ISHL: return "ishl";
+		case OPCODE_ISHR: return "ishr";
+		case OPCODE_ITOF: return "itof";
+		case OPCODE_LABEL: return "label";
+		case OPCODE_LD: return "ld";
+		case OPCODE_LD_MS: return "ldms";
+		case OPCODE_LOG: return "log";
+		case OPCODE_LOOP: return "loop";
+		case OPCODE_LT: return "lt";
+		case OPCODE_MAD: return "mad";
+		case OPCODE_MIN: return "min";
+		case OPCODE_MAX: return "max";
+		case OPCODE_MOV: return "mov";
+		case OPCODE_MOVC: return "movc";
+		case OPCODE_MUL: return "mul";
+		case OPCODE_NE: return "ne";
+		case OPCODE_NOP: return "nop";
+		case OPCODE_NOT: return "not";
+		case OPCODE_OR: return "or";
+		case OPCODE_RESINFO: return "resinfo";
+		case OPCODE_RET: return "ret";
+		case OPCODE_RETC: return "retc";
+		case OPCODE_ROUND_NE: return "round_ne";
+		case OPCODE_ROUND_NI: return "round_ni";
+		case OPCODE_ROUND_PI: return "round_pi";
+		case OPCODE_ROUND_Z: return "round_z";
+		case OPCODE_RSQ: return "rsq";
+		case OPCODE_SAMPLE: return "sample";
+		case OPCODE_SAMPLE_C: return "sample_c";
+		case OPCODE_SAMPLE_C_LZ: return "sample_c_lz";
+		case OPCODE_SAMPLE_L: return "sample_l";
+		case OPCODE_SAMPLE_D: return "sample_d";
+		case OPCODE_SAMPLE_B: return "sample_b";
+		case OPCODE_SQRT: return "sqrt";
+		case OPCODE_SWITCH: return "switch";
+		case OPCODE_SINCOS: return "sincos";
+		case OPCODE_UDIV: return "udiv";
+		case OPCODE_ULT: return "ult";
+		case OPCODE_UGE: return "uge";
+		case OPCODE_UMUL: return "umul";
+		case OPCODE_UMAD: return "umad";
+		case OPCODE_UMAX: return "umax";
+		case OPCODE_UMIN: return "umin";
+		case OPCODE_USHR: return "ushr";
+		case OPCODE_UTOF: return "utof";
+		case OPCODE_XOR: return "xor";
+		case OPCODE_LOD: return "lod";
+		case OPCODE_GATHER4: return "gather4";
+		case OPCODE_SAMPLE_POS: return "samplepos";
+		case OPCODE_SAMPLE_INFO: return "sampleinfo";
+		case OPCODE_HS_DECLS: return "hs_decls";
+		case OPCODE_HS_CONTROL_POINT_PHASE: return "hs_control_point_phase";
+		case OPCODE_HS_FORK_PHASE: return "hs_fork_phase";
+		case OPCODE_HS_JOIN_PHASE: return "hs_join_phase";
+		case OPCODE_EMIT_STREAM: return "emit_stream";
+		case OPCODE_CUT_STREAM: return "cut_stream";
+		case OPCODE_EMITTHENCUT_STREAM: return "emit_then_cut_stream";
+		case OPCODE_BUFINFO: return "bufinfo";
+		case OPCODE_DERIV_RTX_COARSE: return "deriv_rtx_coarse";
+		case OPCODE_DERIV_RTX_FINE: return "deriv_rtx_fine";
+		case OPCODE_DERIV_RTY_COARSE: return "deriv_rty_coarse";
+		case OPCODE_DERIV_RTY_FINE: return "deriv_rty_fine";
+		case OPCODE_GATHER4_C: return "gather4_c";
+		case OPCODE_GATHER4_PO: return "gather4_po";
+		case OPCODE_GATHER4_PO_C: return "gather4_po_c";
+		case OPCODE_RCP: return "rcp";
+		case OPCODE_F32TOF16: return "f32tof16";
+		case OPCODE_F16TOF32: return "f16tof32";
+		case OPCODE_UADDC: return "uaddc";
+		case OPCODE_USUBB: return "usubb";
+		case OPCODE_COUNTBITS: return "countbits";
+		case OPCODE_FIRSTBIT_HI: return "firstbit_hi";
+		case OPCODE_FIRSTBIT_LO: return "firstbit_lo";
+		case OPCODE_FIRSTBIT_SHI: return "firstbit_shi";
+		case OPCODE_UBFE: return "ubfe";
+		case OPCODE_IBFE: return "ibfe";
+		case OPCODE_BFI: return "bfi";
+		case OPCODE_BFREV: return "bfrev";
+		case OPCODE_SWAPC: return "swapc";
+		case OPCODE_DCL_STREAM: return "dcl_stream";
+		case OPCODE_LD_UAV_TYPED: return "ld_uav_typed";
+		case OPCODE_STORE_UAV_TYPED: return "store_uav_typed";
+		case OPCODE_LD_RAW: return "ld_raw";
+		case OPCODE_STORE_RAW: return "store_raw";
+		case OPCODE_LD_STRUCTURED: return "ld_structured";
+		case OPCODE_STORE_STRUCTURED: return "store_structured";
+		case OPCODE_ATOMIC_AND: return "atomic_and";
+		case OPCODE_ATOMIC_OR: return "atomic_or";
+		case OPCODE_ATOMIC_XOR: return "atomic_xor";
+		case OPCODE_ATOMIC_CMP_STORE: return "atomic_cmp_store";
+		case OPCODE_ATOMIC_IADD: return "atomic_iadd";
+		case OPCODE_ATOMIC_IMAX: return "atomic_imax";
+		case OPCODE_ATOMIC_IMIN: return "atomic_imin";
+		case OPCODE_ATOMIC_UMAX: return "atomic_umax";
+		case OPCODE_ATOMIC_UMIN: return "atomic_umin";
+		case OPCODE_IMM_ATOMIC_ALLOC: return "imm_atomic_alloc";
+		case OPCODE_IMM_ATOMIC_CONSUME: return "imm_atomic_consume";
+		case OPCODE_IMM_ATOMIC_IADD: return "imm_atomic_iadd";
+		case OPCODE_IMM_ATOMIC_AND: return "imm_atomic_and";
+		case OPCODE_IMM_ATOMIC_OR: return "imm_atomic_or";
+		case OPCODE_IMM_ATOMIC_XOR: return "imm_atomic_xor";
+		case OPCODE_IMM_ATOMIC_EXCH: return "imm_atomic_exch";
+		case OPCODE_IMM_ATOMIC_CMP_EXCH: return "imm_atomic_cmp_exch";
+		case OPCODE_IMM_ATOMIC_IMAX: return "imm_atomic_imax";
+		case OPCODE_IMM_ATOMIC_IMIN: return "imm_atomic_imin";
+		case OPCODE_IMM_ATOMIC_UMAX: return "imm_atomic_umax";
+		case OPCODE_IMM_ATOMIC_UMIN: return "imm_atomic_umin";
+		case OPCODE_DADD: return "dadd";
+		case OPCODE_DMAX: return "dmax";
+		case OPCODE_DMIN: return "dmin";
+		case OPCODE_DMUL: return "dmul";
+		case OPCODE_DEQ: return "deq";
+		case OPCODE_DGE: return "dge";
+		case OPCODE_DLT: return "dlt";
+		case OPCODE_DNE: return "dne";
+		case OPCODE_DMOV: return "dmov";
+		case OPCODE_DMOVC: return "dmovc";
+		case OPCODE_DTOF: return "dtof";
+		case OPCODE_FTOD: return "ftod";
+		case OPCODE_EVAL_SNAPPED: return "eval_snapped";
+		case OPCODE_EVAL_SAMPLE_INDEX: return "eval_sample_index";
+		case OPCODE_EVAL_CENTROID: return "eval_centroid";
+		case OPCODE_ABORT: return "abort";
+		case OPCODE_DEBUG_BREAK: return "debug_break";
+		case OPCODE_DDIV: return "ddiv";
+		case OPCODE_DFMA: return "dfma";
+		case OPCODE_DRCP: return "drcp";
+		case OPCODE_MSAD: return "msad";
+		case OPCODE_DTOI: return "dtoi";
+		case OPCODE_DTOU: return "dtou";
+		case OPCODE_ITOD: return "itod";
+		case OPCODE_UTOD: return "utod";
+	}
+	return NULL;
+}
+
+static void Appendf(std::string* psText, const char* pszFormat, ...)
+{
+	char szBuf[512];
+	va_list args;
+	int iLen;
+
+	va_start(args, pszFormat);
+	iLen = vsnprintf(szBuf, sizeof(szBuf), pszFormat, args);
+	va_end(args);
+
+	if (iLen < 0)
+		return;
+	if ((size_t)iLen < sizeof(szBuf)) {
+		psText->append(szBuf, iLen);
+		return;
+	}
+
+	std::vector<char> vBuf(iLen + 1);
+	va_start(args, pszFormat);
+	vsnprintf(vBuf.data(), vBuf.size(), pszFormat, args);
+	va_end(args);
+	psText->append(vBuf.data(), iLen);
+}
+
+// Pads the current line out to the given column, used to line up the
+// comments in the RDEF block:
+static void PadLine(std::string* psText, size_t uLineStart, size_t uColumn)
+{
+	size_t uLen = psText->size() - uLineStart;
+
+	if (uLen < uColumn)
+		psText->append(uColumn - uLen, ' ');
+}
+
+static uint32_t ReadU32(Disassembler* psDisasm, const Chunk* psChunk, uint32_t ui32Offset)
+{
+	uint32_t ui32Value;
+
+	if (psChunk->ui32Size < 4 || ui32Offset > psChunk->ui32Size - 4) {
+		psDisasm->bFailed = true;
+		return 0;
+	}
+	memcpy(&ui32Value, psChunk->pui8Data + ui32Offset, 4);
+	return ui32Value;
+}
+
+static uint16_t ReadU16(Disassembler* psDisasm, const Chunk* psChunk, uint32_t ui32Offset)
+{
+	uint16_t ui16Value;
+
+	if (psChunk->ui32Size < 2 || ui32Offset > psChunk->ui32Size - 2) {
+		psDisasm->bFailed = true;
+		return 0;
+	}
+	memcpy(&ui16Value, psChunk->pui8Data + ui32Offset, 2);
+	return ui16Value;
+}
+
+static const char* ReadString(Disassembler* psDisasm, const Chunk* psChunk, uint32_t ui32Offset)
+{
+	const char* pszString = (const char*)psChunk->pui8Data + ui32Offset;
+
+	if (ui32Offset >= psChunk->ui32Size || !memchr(pszString, 0, psChunk->ui32Size - ui32Offset)) {
+		psDisasm->bFailed = true;
+		return "";
+	}
+	return pszString;
+}
+
+// ---------------------------------------------------------------------------
+// Literals
+// ---------------------------------------------------------------------------
+
+// Formats a value the way the Microsoft disassembler's %f does, which only
+// has 17 significant digits to work with before it rounds to 6 decimal
+// places. The digits are generated here rather than relying on printf's %f,
+// which varies between C runtimes.
+static void FormatFixed(double dValue, std::string* psText)
+{
+	char szDigits[32];
+	char acDigits[400];
+	int iExp, iKeep, iIntDigits, i;
+	char* pszExp;
+
+	if (signbit(dValue))
+		psText->push_back('-');
+
+	snprintf(szDigits, sizeof(szDigits), "%.16e", fabs(dValue));
+	pszExp = strchr(szDigits, 'e');
+	if (!pszExp)
+		return;
+	iExp = atoi(pszExp + 1);
+
+	// Scale up to 17 digits: D.DDDDDDDDDDDDDDDD * 10^iExp
+	acDigits[0] = szDigits[0];
+	memcpy(acDigits + 1, szDigits + 2, 16);
+	iKeep = iExp + 1 + 6; // Digits left of the rounding point
+	if (iKeep > (int)sizeof(acDigits) - 2)
+		return;
+	for (i = 17; i < iKeep + 1; i++)
+		acDigits[i] = '0';
+
+	if (iKeep < 0) {
+		psText->append("0.000000");
+		return;
+	}
+
+	if (iKeep < 17 && acDigits[iKeep] >= '5') {
+		for (i = iKeep - 1; i >= 0; i--) {
+			if (acDigits[i] != '9') {
+				acDigits[i]++;
+				break;
+			}
+			acDigits[i] = '0';
+		}
+		if (i < 0) {
+			memmove(acDigits + 1, acDigits, iKeep);
+			acDigits[0] = '1';
+			iExp++;
+			iKeep++;
+		}
+	}
+
+	iIntDigits = iExp + 1;
+	if (iIntDigits > 0)
+		psText->append(acDigits, iIntDigits);
+	else
+		psText->push_back('0');
+	psText->push_back('.');
+	for (i = iIntDigits; i < iIntDigits + 6; i++)
+		psText->push_back(i < 0 ? '0' : acDigits[i]);
+}
+
+// Same as convertF() in the assembler, used when %f would not round trip:
+static void FormatFloatPrecise(uint32_t ui32Bits, std::string* psText)
+{
+	char szBuf[80];
+	char szScientific[80];
+	char* pszExp;
+	float fValue;
+	int iExp;
+
+	memcpy(&fValue, &ui32Bits, 4);
+	snprintf(szScientific, sizeof(szScientific), "%.9E", fValue);
+	pszExp = strstr(szScientific, "E");
+	if (!pszExp) {
+		Appendf(psText, "0x%08x", ui32Bits);
+		return;
+	}
+
+	iExp = atoi(pszExp + 1);
+	if (iExp <= 0 && iExp >= -6)
+		snprintf(szBuf, sizeof(szBuf), "%.*f", 8 - iExp, fValue);
+	else if (iExp < 0)
+		snprintf(szBuf, sizeof(szBuf), "%.9E", fValue);
+	else
+		snprintf(szBuf, sizeof(szBuf), "%.8f", fValue);
+	psText->append(szBuf);
+}
+
+static void FormatInt(uint32_t ui32Bits, std::string* psText)
+{
+	int32_t i32Value = (int32_t)ui32Bits;
+
+	if (i32Value >= -10000 && i32Value <= 10000)
+		Appendf(psText, "%d", i32Value);
+	else
+		Appendf(psText, "0x%08x", ui32Bits);
+}
+
+static void FormatFloat(uint32_t ui32Bits, std::string* psText)
+{
+	size_t uStart = psText->size();
+	uint32_t ui32Parsed;
+	float fValue;
+
+	if (ui32Bits == 0x7f800000) {
+		psText->append("1.#INF00");
+		return;
+	}
+	if ((ui32Bits & 0x7f800000) == 0x7f800000) {
+		Appendf(psText, "0x%08x", ui32Bits);
+		return;
+	}
+
+	memcpy(&fValue, &ui32Bits, 4);
+	FormatFixed(fValue, psText);
+
+	// Same parse the assembler uses:
+	fValue = (float)atof(psText->c_str() + uStart);
+	memcpy(&ui32Parsed, &fValue, 4);
+	if (ui32Parsed != ui32Bits) {
+		psText->resize(uStart);
+		FormatFloatPrecise(ui32Bits, psText);
+	}
+}
+
+// Untyped values (mov, ICB, etc) are guessed from the bits - anything that
+// would be a normal float is shown as one:
+static void FormatUntyped(uint32_t ui32Bits, std::string* psText)
+{
+	uint32_t ui32Exp = ui32Bits & 0x7f800000;
+
+	if ((ui32Exp != 0 && ui32Exp != 0x7f800000) || ui32Bits == 0x80000000)
+		FormatFloat(ui32Bits, psText);
+	else
+		FormatInt(ui32Bits, psText);
+}
+
+static void FormatLiteral(char cType, uint32_t ui32Bits, std::string* psText)
+{
+	switch (cType) {
+		case 'f':
+			FormatFloat(ui32Bits, psText);
+			return;
+		case 'i':
+			FormatInt(ui32Bits, psText);
+			return;
+	}
+	FormatUntyped(ui32Bits, psText);
+}
+
+static void FormatDouble(uint32_t ui32Lo, uint32_t ui32Hi, std::string* psText)
+{
+	uint64_t ui64Bits = (uint64_t)ui32Lo | ((uint64_t)ui32Hi << 32);
+	size_t uStart = psText->size();
+	uint64_t ui64Parsed;
+	double dValue;
+
+	memcpy(&dValue, &ui64Bits, 8);
+	if (isnan(dValue) || isinf(dValue)) {
+		Appendf(psText, "0x%08x, 0x%08x", ui32Lo, ui32Hi);
+		return;
+	}
+
+	FormatFixed(dValue, psText);
+	dValue = atof(psText->c_str() + uStart);
+	memcpy(&ui64Parsed, &dValue, 8);
+	if (ui64Parsed != ui64Bits) {
+		psText->resize(uStart);
+		memcpy(&dValue, &ui64Bits, 8);
+		Appendf(psText, "%#.17g", dValue);
+	}
+	psText->push_back('l');
+}
+
+// ---------------------------------------------------------------------------
+// Operands
+// ---------------------------------------------------------------------------
+
+static const char* MinPrecisionName(uint32_t ui32MinPrecision)
+{
+	switch (ui32MinPrecision) {
+		case 0: return "def32";
+		case 1: return "min16f";
+		case 2: return "min2_8f";
+		case 4: return "min16i";
+		case 5: return "min16u";
+	}
+	return "unknown";
+}
+
+static const char* RegisterName(OPERAND_TYPE eType)
+{
+	switch (eType) {
+		case OPERAND_TYPE_TEMP: return "r";
+		case OPERAND_TYPE_INPUT: return "v";
+		case OPERAND_TYPE_OUTPUT: return "o";
+		case OPERAND_TYPE_INDEXABLE_TEMP: return "x";
+		case OPERAND_TYPE_SAMPLER: return "s";
+		case OPERAND_TYPE_RESOURCE: return "t";
+		case OPERAND_TYPE_CONSTANT_BUFFER: return "cb";
+		case OPERAND_TYPE_IMMEDIATE_CONSTANT_BUFFER: return "icb";
+		case OPERAND_TYPE_LABEL: return "l";
+		case OPERAND_TYPE_INPUT_PRIMITIVEID: return "vPrim";
+		case OPERAND_TYPE_OUTPUT_DEPTH: return "oDepth";
+		case OPERAND_TYPE_NULL: return "null";
+		case OPERAND_TYPE_RASTERIZER: return "rasterizer";
+		case OPERAND_TYPE_OUTPUT_COVERAGE_MASK: return "oMask";
+		case OPERAND_TYPE_STREAM: return "m";
+		case OPERAND_TYPE_FUNCTION_BODY: return "fb";
+		case OPERAND_TYPE_FUNCTION_TABLE: return "ft";
+		case OPERAND_TYPE_INTERFACE: return "fp";
+		case OPERAND_TYPE_OUTPUT_CONTROL_POINT_ID: return "vOutputControlPointID";
+		case OPERAND_TYPE_INPUT_FORK_INSTANCE_ID: return "vForkInstanceID";
+		case OPERAND_TYPE_INPUT_JOIN_INSTANCE_ID: return "vJoinInstanceID";
+		case OPERAND_TYPE_INPUT_CONTROL_POINT: return "vicp";
+		case OPERAND_TYPE_OUTPUT_CONTROL_POINT: return "vocp";
+		case OPERAND_TYPE_INPUT_PATCH_CONSTANT: return "vpc";
+		case OPERAND_TYPE_INPUT_DOMAIN_POINT: return "vDomain";
+		case OPERAND_TYPE_THIS_POINTER: return "this";
+		case OPERAND_TYPE_UNORDERED_ACCESS_VIEW: return "u";
+		case OPERAND_TYPE_THREAD_GROUP_SHARED_MEMORY: return "g";
+		case OPERAND_TYPE_INPUT_THREAD_ID: return "vThreadID";
+		case OPERAND_TYPE_INPUT_THREAD_GROUP_ID: return "vThreadGroupID";
+		case OPERAND_TYPE_INPUT_THREAD_ID_IN_GROUP: return "vThreadIDInGroup";
+		case OPERAND_TYPE_INPUT_COVERAGE_MASK: return "vCoverage";
+		case OPERAND_TYPE_INPUT_THREAD_ID_IN_GROUP_FLATTENED: return "vThreadIDInGroupFlattened";
+		case OPERAND_TYPE_INPUT_GS_INSTANCE_ID: return "vGSInstanceID";
+		case OPERAND_TYPE_OUTPUT_DEPTH_GREATER_EQUAL: return "oDepthGE";
+		case OPERAND_TYPE_OUTPUT_DEPTH_LESS_EQUAL: return "oDepthLE";
+		case OPERAND_TYPE_CYCLE_COUNTER: return "vCycleCounter";
+	}
+	return NULL;
+}
+
+static const char acComponentNames[] = "xyzw";
+
+static const uint32_t* RenderOperand(Disassembler* psDisasm, const uint32_t* pui32Token,
+		const uint32_t* pui32End, char cLiteralType, OperandText* psOperand);
+
+// Renders the operand indices, which are either immediate, relative to
+// another (nested) operand, or both:
+static const uint32_t* RenderIndex(Disassembler* psDisasm, const uint32_t* pui32Token,
+		const uint32_t* pui32End, OPERAND_INDEX_REPRESENTATION eRep, bool bBrackets,
+		std::string* psText)
+{
+	OperandText sRelative;
+	uint32_t ui32Offset = 0;
+
+	switch (eRep) {
+		case OPERAND_INDEX_IMMEDIATE32:
+		case OPERAND_INDEX_IMMEDIATE32_PLUS_RELATIVE:
+			if (pui32Token >= pui32End)
+				goto err;
+			ui32Offset = *pui32Token++;
+			break;
+		case OPERAND_INDEX_IMMEDIATE64:
+		case OPERAND_INDEX_IMMEDIATE64_PLUS_RELATIVE:
+			if (pui32End - pui32Token < 2)
+				goto err;
+			ui32Offset = pui32Token[1] ? 0xffffffff : pui32Token[0];
+			pui32Token += 2;
+			break;
+		case OPERAND_INDEX_RELATIVE:
+			break;
+		default:
+			goto err;
+	}
+
+	if (eRep == OPERAND_INDEX_IMMEDIATE32 || eRep == OPERAND_INDEX_IMMEDIATE64) {
+		if (bBrackets)
+			Appendf(psText, "[%u]", ui32Offset);
+		else
+			Appendf(psText, "%u", ui32Offset);
+		return pui32Token;
+	}
+
+	pui32Token = RenderOperand(psDisasm, pui32Token, pui32End, 'i', &sRelative);
+	if (!pui32Token)
+		return NULL;
+	psText->push_back('[');
+	if (sRelative.ui32Modifier & 1)
+		psText->push_back('-');
+	if (sRelative.ui32Modifier & 2)
+		psText->push_back('|');
+	psText->append(sRelative.sText);
+	if (sRelative.ui32Modifier & 2)
+		psText->push_back('|');
+	Appendf(psText, " + %u]", ui32Offset);
+	return pui32Token;
+err:
+	psDisasm->bFailed = true;
+	return NULL;
+}
+
+static const uint32_t* RenderOperand(Disassembler* psDisasm, const uint32_t* pui32Token,
+		const uint32_t* pui32End, char cLiteralType, OperandText* psOperand)
+{
+	uint32_t ui32Token, ui32Extended, ui32Dimension, i;
+	OPERAND_NUM_COMPONENTS eComponents;
+	OPERAND_TYPE eType;
+	std::string* psText = &psOperand->sText;
+	const char* pszName;
+	bool bAllBrackets;
+
+	psText->clear();
+	psOperand->ui32Modifier = 0;
+	psOperand->ui32MinPrecision = 0;
+	psOperand->bValue = true;
+
+	if (pui32Token >= pui32End)
+		goto err;
+	ui32Token = *pui32Token++;
+
+	// Extended operand tokens carry the modifiers and min precision:
+	ui32Extended = ui32Token;
+	while (DecodeIsOperandExtended(ui32Extended)) {
+		if (pui32Token >= pui32End)
+			goto err;
+		ui32Extended = *pui32Token++;
+		if (DecodeExtendedOperandType(ui32Extended) == EXTENDED_OPERAND_MODIFIER) {
+			psOperand->ui32Modifier = DecodeExtendedOperandModifier(ui32Extended);
+			psOperand->ui32MinPrecision = (ui32Extended >> 14) & 0x7;
+		}
+	}
+
+	eType = DecodeOperandType(ui32Token);
+	eComponents = DecodeOperandNumComponents(ui32Token);
+	ui32Dimension = DecodeOperandIndexDimension(ui32Token);
+
+	if (eType == OPERAND_TYPE_IMMEDIATE32) {
+		uint32_t ui32Count = eComponents == OPERAND_4_COMPONENT ? 4 : 1;
+		bool bTyped = cLiteralType == 'f' || cLiteralType == 'i';
+
+		if ((uint32_t)(pui32End - pui32Token) < ui32Count)
+			goto err;
+		psText->append("l(");
+		for (i = 0; i < ui32Count; i++) {
+			if (i)
+				psText->append(bTyped ? ", " : ",");
+			FormatLiteral(cLiteralType, *pui32Token++, psText);
+		}
+		psText->push_back(')');
+		return pui32Token;
+	}
+
+	if (eType == OPERAND_TYPE_IMMEDIATE64) {
+		uint32_t ui32Count = eComponents == OPERAND_4_COMPONENT ? 2 : 1;
+
+		if ((uint32_t)(pui32End - pui32Token) < ui32Count * 2)
+			goto err;
+		psText->append("d(");
+		for (i = 0; i < ui32Count; i++) {
+			if (i)
+				psText->append(", ");
+			FormatDouble(pui32Token[0], pui32Token[1], psText);
+			pui32Token += 2;
+		}
+		psText->push_back(')');
+		return pui32Token;
+	}
+
+	pszName = RegisterName(eType);
+	if (!pszName)
+		goto err;
+	psText->append(pszName);
+
+	switch (eType) {
+		case OPERAND_TYPE_SAMPLER:
+		case OPERAND_TYPE_RESOURCE:
+		case OPERAND_TYPE_UNORDERED_ACCESS_VIEW:
+		case OPERAND_TYPE_NULL:
+		case OPERAND_TYPE_LABEL:
+		case OPERAND_TYPE_STREAM:
+		case OPERAND_TYPE_RASTERIZER:
+		case OPERAND_TYPE_FUNCTION_BODY:
+		case OPERAND_TYPE_FUNCTION_TABLE:
+		case OPERAND_TYPE_INTERFACE:
+		case OPERAND_TYPE_THIS_POINTER:
+			psOperand->bValue = false;
+			break;
+	}
+
+	// Most registers have their first index shown as part of the name (r0,
+	// cb0[1], x0[1]). Inputs and outputs only do if that is their only
+	// index and it is not relative, and control points and the ICB always
+	// use brackets:
+	switch (eType) {
+		case OPERAND_TYPE_INPUT:
+		case OPERAND_TYPE_OUTPUT:
+		case OPERAND_TYPE_INPUT_PATCH_CONSTANT:
+			bAllBrackets = ui32Dimension != 1 || DecodeOperandIndexRepresentation(0, ui32Token) != OPERAND_INDEX_IMMEDIATE32;
+			break;
+		case OPERAND_TYPE_IMMEDIATE_CONSTANT_BUFFER:
+		case OPERAND_TYPE_INPUT_CONTROL_POINT:
+		case OPERAND_TYPE_OUTPUT_CONTROL_POINT:
+		case OPERAND_TYPE_THIS_POINTER:
+			bAllBrackets = true;
+			break;
+		default:
+			bAllBrackets = false;
+			break;
+	}
+
+	for (i = 0; i < ui32Dimension; i++) {
+		OPERAND_INDEX_REPRESENTATION eRep = DecodeOperandIndexRepresentation(i, ui32Token);
+		bool bBrackets = bAllBrackets || i > 0
+			|| (eRep != OPERAND_INDEX_IMMEDIATE32 && eRep != OPERAND_INDEX_IMMEDIATE64);
+
+		pui32Token = RenderIndex(psDisasm, pui32Token, pui32End, eRep, bBrackets, psText);
+		if (!pui32Token)
+			return NULL;
+	}
+
+	if (eComponents == OPERAND_4_COMPONENT) {
+		switch (DecodeOperand4CompSelMode(ui32Token)) {
+			case OPERAND_4_COMPONENT_MASK_MODE: {
+				uint32_t ui32Mask = DecodeOperand4CompMask(ui32Token);
+				if (ui32Mask)
+					psText->push_back('.');
+				for (i = 0; i < 4; i++) {
+					if (ui32Mask & (1 << i))
+						psText->push_back(acComponentNames[i]);
+				}
+				break;
+			}
+			case OPERAND_4_COMPONENT_SWIZZLE_MODE:
+				psText->push_back('.');
+				for (i = 0; i < 4; i++)
+					psText->push_back(acComponentNames[DecodeOperand4CompSwizzleSource(ui32Token, i)]);
+				break;
+			case OPERAND_4_COMPONENT_SELECT_1_MODE:
+				psText->push_back('.');
+				psText->push_back(acComponentNames[DecodeOperand4CompSel1(ui32Token)]);
+				break;
+			default:
+				goto err;
+		}
+	} else if (eComponents == OPERAND_N_COMPONENT) {
+		goto err;
+	}
+
+	return pui32Token;
+err:
+	psDisasm->bFailed = true;
+	return NULL;
+}
+
+// Appends the operand with its modifiers and, if the instruction uses
+// minimum precision, its precision tag. Source operands that don't match the
+// precision of the destination are shown as a cast, e.g. {def32 as min16f}:
+static void AppendOperand(const OperandText* psOperand, bool bTags, uint32_t ui32DestPrecision,
+		bool bDest, std::string* psText)
+{
+	if (psOperand->ui32Modifier & 1)
+		psText->push_back('-');
+	if (psOperand->ui32Modifier & 2)
+		psText->push_back('|');
+	psText->append(psOperand->sText);
+	if (bTags && psOperand->bValue) {
+		if (!bDest && psOperand->ui32MinPrecision != ui32DestPrecision) {
+			Appendf(psText, " {%s as %s}", MinPrecisionName(psOperand->ui32MinPrecision),
+					MinPrecisionName(ui32DestPrecision));
+		} else if (psOperand->ui32MinPrecision) {
+			Appendf(psText, " {%s}", MinPrecisionName(psOperand->ui32MinPrecision));
+		}
+	}
+	if (psOperand->ui32Modifier & 2)
+		psText->push_back('|');
+}
+
+// Renders the remaining tokens of an instruction as a comma separated
+// operand list. The first operand is treated as the destination for the
+// purpose of min precision tags.
+static bool AppendOperands(Disassembler* psDisasm, const uint32_t* pui32Token,
+		const uint32_t* pui32End, OPCODE_TYPE eOpcode, std::string* psText)
+{
+	const char* pszTypes = LiteralTypes(eOpcode);
+	size_t uTypes = strlen(pszTypes);
+	uint32_t ui32Count = 0, i;
+	bool bTags = false;
+
+	while (pui32Token < pui32End) {
+		if (ui32Count == sizeof(psDisasm->asOperands) / sizeof(psDisasm->asOperands[0]))
+			return false;
+
+		// samplepos has a trailing zero token after its operands:
+		if (eOpcode == OPCODE_SAMPLE_POS && ui32Count == 3)
+			break;
+
+		pui32Token = RenderOperand(psDisasm, pui32Token, pui32End,
+				ui32Count < uTypes ? pszTypes[ui32Count] : 'x',
+				&psDisasm->asOperands[ui32Count]);
+		if (!pui32Token)
+			return false;
+		if (psDisasm->asOperands[ui32Count].ui32MinPrecision)
+			bTags = true;
+		ui32Count++;
+	}
+
+	for (i = 0; i < ui32Count; i++) {
+		psText->append(i ? ", " : " ");
+		AppendOperand(&psDisasm->asOperands[i], bTags, psDisasm->asOperands[0].ui32MinPrecision, i == 0, psText);
+	}
+	return true;
+}
+
+// Renders a single operand for a declaration, which only has a precision
+// tag if it is declared with a minimum precision:
+static const uint32_t* AppendDeclOperand(Disassembler* psDisasm, const uint32_t* pui32Token,
+		const uint32_t* pui32End, std::string* psText)
+{
+	OperandText* psOperand = &psDisasm->asOperands[0];
+
+	pui32Token = RenderOperand(psDisasm, pui32Token, pui32End, 'x', psOperand);
+	if (pui32Token)
+		AppendOperand(psOperand, psOperand->ui32MinPrecision != 0, psOperand->ui32MinPrecision, true, psText);
+	return pui32Token;
+}
+
+// ---------------------------------------------------------------------------
+// Instructions
+// ---------------------------------------------------------------------------
+
+static const char* ResourceDimensionName(uint32_t ui32Dimension)
+{
+	switch (ui32Dimension) {
+		case RESOURCE_DIMENSION_BUFFER: return "buffer";
+		case RESOURCE_DIMENSION_TEXTURE1D: return "texture1d";
+		case RESOURCE_DIMENSION_TEXTURE2D: return "texture2d";
+		case RESOURCE_DIMENSION_TEXTURE2DMS: return "texture2dms";
+		case RESOURCE_DIMENSION_TEXTURE3D: return "texture3d";
+		case RESOURCE_DIMENSION_TEXTURECUBE: return "texturecube";
+		case RESOURCE_DIMENSION_TEXTURE1DARRAY: return "texture1darray";
+		case RESOURCE_DIMENSION_TEXTURE2DARRAY: return "texture2darray";
+		case RESOURCE_DIMENSION_TEXTURE2DMSARRAY: return "texture2dmsarray";
+		case RESOURCE_DIMENSION_TEXTURECUBEARRAY: return "texturecubearray";
+		case RESOURCE_DIMENSION_RAW_BUFFER: return "raw_buffer";
+		case RESOURCE_DIMENSION_STRUCTURED_BUFFER: return "structured_buffer";
+	}
+	return NULL;
+}
+
+static const char* ReturnTypeName(uint32_t ui32ReturnType)
+{
+	switch (ui32ReturnType) {
+		case RETURN_TYPE_UNORM: return "unorm";
+		case RETURN_TYPE_SNORM: return "snorm";
+		case RETURN_TYPE_SINT: return "sint";
+		case RETURN_TYPE_UINT: return "uint";
+		case RETURN_TYPE_FLOAT: return "float";
+		case RETURN_TYPE_MIXED: return "mixed";
+		case RETURN_TYPE_DOUBLE: return "double";
+		case RETURN_TYPE_CONTINUED: return "<continued>";
+		case RETURN_TYPE_UNUSED: return "<unused>";
+	}
+	return NULL;
+}
+
+static bool AppendReturnTypes(uint32_t ui32Token, uint32_t ui32Shift, std::string* psText)
+{
+	const char* pszType;
+	uint32_t i;
+
+	psText->push_back('(');
+	for (i = 0; i < 4; i++) {
+		pszType = ReturnTypeName((ui32Token >> (ui32Shift + i * 4)) & 0xf);
+		if (!pszType)
+			return false;
+		if (i)
+			psText->push_back(',');
+		psText->append(pszType);
+	}
+	psText->push_back(')');
+	return true;
+}
+
+static const char* SystemValueName(uint32_t ui32Name)
+{
+	switch (ui32Name) {
+		case NAME_POSITION: return "position";
+		case NAME_CLIP_DISTANCE: return "clip_distance";
+		case NAME_CULL_DISTANCE: return "cull_distance";
+		case NAME_RENDER_TARGET_ARRAY_INDEX: return "rendertarget_array_index";
+		case NAME_VIEWPORT_ARRAY_INDEX: return "viewport_array_index";
+		case NAME_VERTEX_ID: return "vertex_id";
+		case NAME_PRIMITIVE_ID: return "primitive_id";
+		case NAME_INSTANCE_ID: return "instance_id";
+		case NAME_IS_FRONT_FACE: return "is_front_face";
+		case NAME_SAMPLE_INDEX: return "sampleIndex";
+		case NAME_FINAL_QUAD_U_EQ_0_EDGE_TESSFACTOR: return "finalQuadUeq0EdgeTessFactor";
+		case NAME_FINAL_QUAD_V_EQ_0_EDGE_TESSFACTOR: return "finalQuadVeq0EdgeTessFactor";
+		case NAME_FINAL_QUAD_U_EQ_1_EDGE_TESSFACTOR: return "finalQuadUeq1EdgeTessFactor";
+		case NAME_FINAL_QUAD_V_EQ_1_EDGE_TESSFACTOR: return "finalQuadVeq1EdgeTessFactor";
+		case NAME_FINAL_QUAD_U_INSIDE_TESSFACTOR: return "finalQuadUInsideTessFactor";
+		case NAME_FINAL_QUAD_V_INSIDE_TESSFACTOR: return "finalQuadVInsideTessFactor";
+		case NAME_FINAL_TRI_U_EQ_0_EDGE_TESSFACTOR: return "finalTriUeq0EdgeTessFactor";
+		case NAME_FINAL_TRI_V_EQ_0_EDGE_TESSFACTOR: return "finalTriVeq0EdgeTessFactor";
+		case NAME_FINAL_TRI_W_EQ_0_EDGE_TESSFACTOR: return "finalTriWeq0EdgeTessFactor";
+		case NAME_FINAL_TRI_INSIDE_TESSFACTOR: return "finalTriInsideTessFactor";
+		case NAME_FINAL_LINE_DETAIL_TESSFACTOR: return "finalLineDetailTessFactor";
+		case NAME_FINAL_LINE_DENSITY_TESSFACTOR: return "finalLineDensityTessFactor";
+	}
+	return NULL;
+}
+
+static const char* InterpolationModeName(uint32_t ui32Mode)
+{
+	switch (ui32Mode) {
+		case INTERPOLATION_CONSTANT: return "constant";
+		case INTERPOLATION_LINEAR: return "linear";
+		case INTERPOLATION_LINEAR_CENTROID: return "linear centroid";
+		case INTERPOLATION_LINEAR_NOPERSPECTIVE: return "linear noperspective";
+		case INTERPOLATION_LINEAR_NOPERSPECTIVE_CENTROID: return "linear noperspective centroid";
+		case INTERPOLATION_LINEAR_SAMPLE: return "linear sample";
+		case INTERPOLATION_LINEAR_NOPERSPECTIVE_SAMPLE: return "linear noperspective sample";
+	}
+	return NULL;
+}
+
+// The immediate constant buffer is one line per four values, continuation
+// lines lined up under the first:
+static bool AppendImmediateConstantBuffer(const uint32_t* pui32Data, uint32_t ui32Count, std::string* psText)
+{
+	uint32_t i;
+
+	if (!ui32Count || ui32Count % 4)
+		return false;
+
+	psText->append("dcl_immediateConstantBuffer { ");
+	for (i = 0; i < ui32Count; i++) {
+		switch (i % 4) {
+			case 0:
+				if (i)
+					psText->append(",\n                              ");
+				psText->append("{ ");
+				break;
+			default:
+				psText->append(", ");
+				break;
+		}
+		FormatUntyped(pui32Data[i], psText);
+		if (i % 4 == 3)
+			psText->push_back('}');
+	}
+	psText->append(" }");
+	return true;
+}
+
+static void AppendPrintfString(const char* pcMessage, uint32_t ui32Length, std::string* psText)
+{
+	uint32_t i;
+	char c;
+
+	psText->push_back('"');
+	for (i = 0; i < ui32Length; i++) {
+		c = pcMessage[i];
+		switch (c) {
+			case '\n': psText->append("\\n"); break;
+			case '\r': psText->append("\\r"); break;
+			case '\t': psText->append("\\t"); break;
+			case '\b': psText->append("\\b"); break;
+			case '\\': psText->append("\\\\"); break;
+			default:
+				psText->push_back(c >= 0x20 && c < 0x7f ? c : '.');
+				break;
+		}
+	}
+	psText->push_back('"');
+}
+
+// Custom data blocks: the immediate constant buffer, printf/errorf from the
+// debug layer, and anything else we show the same way Microsoft's
+// disassembler does so that the assembler knows to skip it:
+static bool DisassembleCustomData(Disassembler* psDisasm, const uint32_t* pui32Token,
+		uint32_t ui32Length, std::string* psText)
+{
+	const uint32_t* pui32End = pui32Token + ui32Length;
+	uint32_t ui32Class = pui32Token[0] >> 11;
+	uint32_t ui32MessageLength, ui32NumOperands, i;
+	const uint32_t* pui32Operand;
+
+	if (ui32Class == 3)
+		return AppendImmediateConstantBuffer(pui32Token + 2, ui32Length - 2, psText);
+
+	if (ui32Class == 4 && ui32Length >= 7 && (pui32Token[2] == 0x00200102 || pui32Token[2] == 0x00200103)) {
+		ui32MessageLength = pui32Token[4];
+		ui32NumOperands = pui32Token[5];
+
+		psText->append(pui32Token[2] == 0x00200103 ? "errorf " : "printf ");
+		pui32Operand = pui32Token + 7;
+		std::string sOperands;
+		for (i = 0; i < ui32NumOperands; i++) {
+			pui32Operand = RenderOperand(psDisasm, pui32Operand, pui32End, 'x', &psDisasm->asOperands[0]);
+			if (!pui32Operand)
+				return false;
+			sOperands.append(", ");
+			AppendOperand(&psDisasm->asOperands[0], false, 0, true, &sOperands);
+		}
+		if ((size_t)(pui32End - pui32Operand) * 4 < ui32MessageLength)
+			return false;
+		AppendPrintfString((const char*)pui32Operand, ui32MessageLength, psText);
+		psText->append(sOperands);
+		return true;
+	}
+
+	psText->append("undecipherable custom data");
+	return true;
+}
+
+static bool DisassembleDeclaration(Disassembler* psDisasm, const uint32_t* pui32Token,
+		const uint32_t* pui32End, OPCODE_TYPE eOpcode, std::string* psText)
+{
+	uint32_t ui32Token = pui32Token[0];
+	uint32_t ui32Control = (ui32Token >> 11) & 0x1fff;
+	const char* pszName;
+	size_t uStart;
+
+	pui32Token++;
+
+	switch (eOpcode) {
+		case OPCODE_DCL_RESOURCE: {
+			uint32_t ui32Dimension = DecodeResourceDimension(ui32Token);
+			pszName = ResourceDimensionName(ui32Dimension);
+			if (!pszName)
+				return false;
+			Appendf(psText, "dcl_resource_%s", pszName);
+			if (ui32Dimension == RESOURCE_DIMENSION_TEXTURE2DMS || ui32Dimension == RESOURCE_DIMENSION_TEXTURE2DMSARRAY)
+				Appendf(psText, "(%u)", (ui32Token >> 16) & 0x7f);
+			psText->push_back(' ');
+			std::string sOperand;
+			pui32Token = AppendDeclOperand(psDisasm, pui32Token, pui32End, &sOperand);
+			if (!pui32Token || pui32Token >= pui32End)
+				return false;
+			if (!AppendReturnTypes(*pui32Token, 0, psText))
+				return false;
+			psText->push_back(' ');
+			psText->append(sOperand);
+			return true;
+		}
+		case OPCODE_DCL_CONSTANT_BUFFER:
+			psText->append("dcl_constantbuffer ");
+			uStart = psText->size();
+			if (!AppendDeclOperand(psDisasm, pui32Token, pui32End, psText))
+				return false;
+			// d3dcompiler_47 shows the register in upper case here, and
+			// without the swizzle:
+			(*psText)[uStart] = 'C';
+			(*psText)[uStart + 1] = 'B';
+			uStart = psText->find('.', uStart);
+			if (uStart != std::string::npos)
+				psText->resize(uStart);
+			psText->append(ui32Control & 1 ? ", dynamicIndexed" : ", immediateIndexed");
+			return true;
+		case OPCODE_DCL_SAMPLER:
+			psText->append("dcl_sampler ");
+			if (!AppendDeclOperand(psDisasm, pui32Token, pui32End, psText))
+				return false;
+			switch (ui32Control & 0xf) {
+				case 0: psText->append(", mode_default"); return true;
+				case 1: psText->append(", mode_comparison"); return true;
+				case 2: psText->append(", mode_mono"); return true;
+			}
+			return false;
+		case OPCODE_DCL_INDEX_RANGE:
+			psText->append("dcl_indexrange ");
+			pui32Token = AppendDeclOperand(psDisasm, pui32Token, pui32End, psText);
+			if (!pui32Token || pui32Token >= pui32End)
+				return false;
+			Appendf(psText, " %u", *pui32Token);
+			return true;
+		case OPCODE_DCL_GS_OUTPUT_PRIMITIVE_TOPOLOGY:
+			switch (ui32Control & 0x3f) {
+				case 1: psText->append("dcl_outputtopology pointlist "); return true;
+				case 2: psText->append("dcl_outputtopology linelist "); return true;
+				case 3: psText->append("dcl_outputtopology linestrip "); return true;
+				case 4: psText->append("dcl_outputtopology trianglelist "); return true;
+				case 5: psText->append("dcl_outputtopology trianglestrip "); return true;
+			}
+			return false;
+		case OPCODE_DCL_GS_INPUT_PRIMITIVE:
+			switch (ui32Control & 0x3f) {
+				case 1: psText->append("dcl_inputprimitive point "); return true;
+				case 2: psText->append("dcl_inputprimitive line "); return true;
+				case 3: psText->append("dcl_inputprimitive triangle "); return true;
+				case 6: psText->append("dcl_inputprimitive lineadj "); return true;
+				case 7: psText->append("dcl_inputprimitive triangleadj "); return true;
+			}
+			return false;
+		case OPCODE_DCL_MAX_OUTPUT_VERTEX_COUNT:
+			if (pui32Token >= pui32End)
+				return false;
+			Appendf(psText, "dcl_maxout %u", *pui32Token);
+			return true;
+		case OPCODE_DCL_INPUT:
+		case OPCODE_DCL_INPUT_SGV:
+		case OPCODE_DCL_INPUT_SIV:
+		case OPCODE_DCL_INPUT_PS:
+		case OPCODE_DCL_INPUT_PS_SGV:
+		case OPCODE_DCL_INPUT_PS_SIV:
+		case OPCODE_DCL_OUTPUT:
+		case OPCODE_DCL_OUTPUT_SGV:
+		case OPCODE_DCL_OUTPUT_SIV: {
+			static const char* const apszNames[] = {
+				"dcl_input", "dcl_input_sgv", "dcl_input_siv",
+				"dcl_input_ps", "dcl_input_ps_sgv", "dcl_input_ps_siv",
+				"dcl_output", "dcl_output_sgv", "dcl_output_siv",
+			};
+			psText->append(apszNames[eOpcode - OPCODE_DCL_INPUT]);
+			psText->push_back(' ');
+			if (eOpcode == OPCODE_DCL_INPUT_PS || eOpcode == OPCODE_DCL_INPUT_PS_SGV || eOpcode == OPCODE_DCL_INPUT_PS_SIV) {
+				pszName = InterpolationModeName(DecodeInterpolationMode(ui32Token));
+				if (pszName) {
+					psText->append(pszName);
+					psText->push_back(' ');
+				}
+			}
+			pui32Token = AppendDeclOperand(psDisasm, pui32Token, pui32End, psText);
+			if (!pui32Token)
+				return false;
+			if (eOpcode == OPCODE_DCL_INPUT || eOpcode == OPCODE_DCL_INPUT_PS || eOpcode == OPCODE_DCL_OUTPUT)
+				return true;
+			if (pui32Token >= pui32End)
+				return false;
+			pszName = SystemValueName(*pui32Token);
+			if (!pszName)
+				return false;
+			Appendf(psText, ", %s", pszName);
+			return true;
+		}
+		case OPCODE_DCL_TEMPS:
+			if (pui32Token >= pui32End)
+				return false;
+			Appendf(psText, "dcl_temps %u", *pui32Token);
+			return true;
+		case OPCODE_DCL_INDEXABLE_TEMP:
+			if (pui32End - pui32Token < 3)
+				return false;
+			Appendf(psText, "dcl_indexableTemp x%u[%u], %u", pui32Token[0], pui32Token[1], pui32Token[2]);
+			return true;
+		case OPCODE_DCL_GLOBAL_FLAGS: {
+			static const char* const apszFlags[] = {
+				"refactoringAllowed", "enableDoublePrecisionFloatOps",
+				"forceEarlyDepthStencil", "enableRawAndStructuredBuffers",
+				"skipOptimization", "enableMinimumPrecision",
+				"enable11_1DoubleExtensions", "enable11_1ShaderExtensions",
+			};
+			const char* pszSeparator = " ";
+			uint32_t i;
+
+			psText->append("dcl_globalFlags");
+			for (i = 0; i < 8; i++) {
+				if (ui32Control & (1 << i)) {
+					Appendf(psText, "%s%s", pszSeparator, apszFlags[i]);
+					pszSeparator = " | ";
+				}
+			}
+			return !(ui32Control & ~0xff);
+		}
+		case OPCODE_DCL_INPUT_CONTROL_POINT_COUNT:
+			Appendf(psText, "dcl_input_control_point_count %u", ui32Control & 0x3f);
+			return true;
+		case OPCODE_DCL_OUTPUT_CONTROL_POINT_COUNT:
+			Appendf(psText, "dcl_output_control_point_count %u", ui32Control & 0x3f);
+			return true;
+		case OPCODE_DCL_TESS_DOMAIN:
+			switch (ui32Control & 0x3) {
+				case 1: psText->append("dcl_tessellator_domain domain_isoline"); return true;
+				case 2: psText->append("dcl_tessellator_domain domain_tri"); return true;
+				case 3: psText->append("dcl_tessellator_domain domain_quad"); return true;
+			}
+			return false;
+		case OPCODE_DCL_TESS_PARTITIONING:
+			switch (ui32Control & 0x7) {
+				case 1: psText->append("dcl_tessellator_partitioning partitioning_integer"); return true;
+				case 2: psText->append("dcl_tessellator_partitioning partitioning_pow2"); return true;
+				case 3: psText->append("dcl_tessellator_partitioning partitioning_fractional_odd"); return true;
+				case 4: psText->append("dcl_tessellator_partitioning partitioning_fractional_even"); return true;
+			}
+			return false;
+		case OPCODE_DCL_TESS_OUTPUT_PRIMITIVE:
+			switch (ui32Control & 0x7) {
+				case 1: psText->append("dcl_tessellator_output_primitive output_point"); return true;
+				case 2: psText->append("dcl_tessellator_output_primitive output_line"); return true;
+				case 3: psText->append("dcl_tessellator_output_primitive output_triangle_cw"); return true;
+				case 4: psText->append("dcl_tessellator_output_primitive output_triangle_ccw"); return true;
+			}
+			return false;
+		case OPCODE_DCL_HS_MAX_TESSFACTOR:
+			if (pui32Token >= pui32End)
+				return false;
+			psText->append("dcl_hs_max_tessfactor l(");
+			FormatFloat(*pui32Token, psText);
+			psText->push_back(')');
+			return true;
+		case OPCODE_DCL_HS_FORK_PHASE_INSTANCE_COUNT:
+			if (pui32Token >= pui32End)
+				return false;
+			Appendf(psText, "dcl_hs_fork_phase_instance_count %u", *pui32Token);
+			return true;
+		case OPCODE_DCL_HS_JOIN_PHASE_INSTANCE_COUNT:
+			if (pui32Token >= pui32End)
+				return false;
+			Appendf(psText, "dcl_hs_join_phase_instance_count %u", *pui32Token);
+			return true;
+		case OPCODE_DCL_THREAD_GROUP:
+			if (pui32End - pui32Token < 3)
+				return false;
+			Appendf(psText, "dcl_thread_group %u, %u, %u", pui32Token[0], pui32Token[1], pui32Token[2]);
+			return true;
+		case OPCODE_DCL_UNORDERED_ACCESS_VIEW_TYPED: {
+			pszName = ResourceDimensionName(DecodeResourceDimension(ui32Token));
+			if (!pszName)
+				return false;
+			Appendf(psText, "dcl_uav_typed_%s%s ", pszName, ui32Control & 0x20 ? "_glc" : "");
+			std::string sOperand;
+			pui32Token = AppendDeclOperand(psDisasm, pui32Token, pui32End, &sOperand);
+			if (!pui32Token || pui32Token >= pui32End)
+				return false;
+			if (!AppendReturnTypes(*pui32Token, 0, psText))
+				return false;
+			psText->push_back(' ');
+			psText->append(sOperand);
+			return true;
+		}
+		case OPCODE_DCL_UNORDERED_ACCESS_VIEW_RAW:
+			Appendf(psText, "dcl_uav_raw%s ", ui32Control & 0x20 ? "_glc" : "");
+			return AppendDeclOperand(psDisasm, pui32Token, pui32End, psText) != NULL;
+		case OPCODE_DCL_UNORDERED_ACCESS_VIEW_STRUCTURED:
+			Appendf(psText, "dcl_uav_structured%s%s ", ui32Control & 0x20 ? "_glc" : "", ui32Control & 0x1000 ? "_opc" : "");
+			pui32Token = AppendDeclOperand(psDisasm, pui32Token, pui32End, psText);
+			if (!pui32Token || pui32Token >= pui32End)
+				return false;
+			Appendf(psText, ", %u", *pui32Token);
+			return true;
+		case OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_RAW:
+			psText->append("dcl_tgsm_raw ");
+			pui32Token = AppendDeclOperand(psDisasm, pui32Token, pui32End, psText);
+			if (!pui32Token || pui32Token >= pui32End)
+				return false;
+			Appendf(psText, ", %u", *pui32Token);
+			return true;
+		case OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_STRUCTURED:
+			psText->append("dcl_tgsm_structured ");
+			pui32Token = AppendDeclOperand(psDisasm, pui32Token, pui32End, psText);
+			if (!pui32Token || pui32End - pui32Token < 2)
+				return false;
+			Appendf(psText, ", %u, %u", pui32Token[0], pui32Token[1]);
+			return true;
+		case OPCODE_DCL_RESOURCE_RAW:
+			psText->append("dcl_resource_raw ");
+			return AppendDeclOperand(psDisasm, pui32Token, pui32End, psText) != NULL;
+		case OPCODE_DCL_RESOURCE_STRUCTURED:
+			psText->append("dcl_resource_structured ");
+			pui32Token = AppendDeclOperand(psDisasm, pui32Token, pui32End, psText);
+			if (!pui32Token || pui32Token >= pui32End)
+				return false;
+			Appendf(psText, ", %u ", *pui32Token);
+			return true;
+		case OPCODE_DCL_GS_INSTANCE_COUNT:
+			if (pui32Token >= pui32End)
+				return false;
+			Appendf(psText, "dcl_gsinstances %u", *pui32Token);
+			return true;
+	}
+
+	return false;
+}
+
+static bool IsDeclaration(OPCODE_TYPE eOpcode)
+{
+	switch (eOpcode) {
+		case OPCODE_DCL_RESOURCE:
+		case OPCODE_DCL_CONSTANT_BUFFER:
+		case OPCODE_DCL_SAMPLER:
+		case OPCODE_DCL_INDEX_RANGE:
+		case OPCODE_DCL_GS_OUTPUT_PRIMITIVE_TOPOLOGY:
+		case OPCODE_DCL_GS_INPUT_PRIMITIVE:
+		case OPCODE_DCL_MAX_OUTPUT_VERTEX_COUNT:
+		case OPCODE_DCL_INPUT:
+		case OPCODE_DCL_INPUT_SGV:
+		case OPCODE_DCL_INPUT_SIV:
+		case OPCODE_DCL_INPUT_PS:
+		case OPCODE_DCL_INPUT_PS_SGV:
+		case OPCODE_DCL_INPUT_PS_SIV:
+		case OPCODE_DCL_OUTPUT:
+		case OPCODE_DCL_OUTPUT_SGV:
+		case OPCODE_DCL_OUTPUT_SIV:
+		case OPCODE_DCL_TEMPS:
+		case OPCODE_DCL_INDEXABLE_TEMP:
+		case OPCODE_DCL_GLOBAL_FLAGS:
+		case OPCODE_DCL_INPUT_CONTROL_POINT_COUNT:
+		case OPCODE_DCL_OUTPUT_CONTROL_POINT_COUNT:
+		case OPCODE_DCL_TESS_DOMAIN:
+		case OPCODE_DCL_TESS_PARTITIONING:
+		case OPCODE_DCL_TESS_OUTPUT_PRIMITIVE:
+		case OPCODE_DCL_HS_MAX_TESSFACTOR:
+		case OPCODE_DCL_HS_FORK_PHASE_INSTANCE_COUNT:
+		case OPCODE_DCL_HS_JOIN_PHASE_INSTANCE_COUNT:
+		case OPCODE_DCL_THREAD_GROUP:
+		case OPCODE_DCL_UNORDERED_ACCESS_VIEW_TYPED:
+		case OPCODE_DCL_UNORDERED_ACCESS_VIEW_RAW:
+		case OPCODE_DCL_UNORDERED_ACCESS_VIEW_STRUCTURED:
+		case OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_RAW:
+		case OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_STRUCTURED:
+		case OPCODE_DCL_RESOURCE_RAW:
+		case OPCODE_DCL_RESOURCE_STRUCTURED:
+		case OPCODE_DCL_GS_INSTANCE_COUNT:
+			return true;
+	}
+	return false;
+}
+
+// Appends the modifiers that are part of the mnemonic:
+static bool AppendInstructionName(const uint32_t* pui32Token, const uint32_t* pui32End,
+		OPCODE_TYPE eOpcode, const char* pszName, std::string* psText)
+{
+	uint32_t ui32Token = pui32Token[0];
+	uint32_t ui32Control = (ui32Token >> 11) & 0x1fff;
+	uint32_t ui32Extended = ui32Token;
+	std::string sOffsets, sDimension, sReturnTypes;
+	bool bIndexable = false;
+
+	psText->append(pszName);
+
+	switch (eOpcode) {
+		case OPCODE_BREAKC:
+		case OPCODE_CALLC:
+		case OPCODE_CONTINUEC:
+		case OPCODE_DISCARD:
+		case OPCODE_IF:
+		case OPCODE_RETC:
+			psText->append(DecodeInstrTestBool(ui32Token) == INSTRUCTION_TEST_NONZERO ? "_nz" : "_z");
+			break;
+		case OPCODE_SYNC:
+			return false;
+	}
+
+	while (DecodeIsOpcodeExtended(ui32Extended)) {
+		if (++pui32Token >= pui32End)
+			return false;
+		ui32Extended = *pui32Token;
+		switch (DecodeExtendedOpcodeType(ui32Extended)) {
+			case EXTENDED_OPCODE_SAMPLE_CONTROLS: {
+				int iU = ((int32_t)(ui32Extended << 19)) >> 28;
+				int iV = ((int32_t)(ui32Extended << 15)) >> 28;
+				int iW = ((int32_t)(ui32Extended << 11)) >> 28;
+				Appendf(&sOffsets, "(%d,%d,%d)", iU, iV, iW);
+				break;
+			}
+			case EXTENDED_OPCODE_RESOURCE_DIM: {
+				uint32_t ui32Dimension = DecodeExtendedResourceDimension(ui32Extended);
+				const char* pszDimension = ResourceDimensionName(ui32Dimension);
+				if (!pszDimension)
+					return false;
+				if (ui32Dimension == RESOURCE_DIMENSION_STRUCTURED_BUFFER)
+					Appendf(&sDimension, "(%s, stride=%u)", pszDimension, (ui32Extended >> 11) & 0xfff);
+				else
+					Appendf(&sDimension, "(%s)", pszDimension);
+				bIndexable = true;
+				break;
+			}
+			case EXTENDED_OPCODE_RESOURCE_RETURN_TYPE:
+				if (!AppendReturnTypes(ui32Extended, 6, &sReturnTypes))
+					return false;
+				bIndexable = true;
+				break;
+			default:
+				return false;
+		}
+	}
+
+	if (ui32Control & 0x4)
+		psText->append("_sat");
+	if (!sOffsets.empty())
+		psText->append("_aoffimmi");
+	if (bIndexable)
+		psText->append("_indexable");
+	psText->append(sOffsets);
+	psText->append(sDimension);
+	psText->append(sReturnTypes);
+
+	switch (eOpcode) {
+		case OPCODE_RESINFO:
+			if ((ui32Control & 0x3) == 1)
+				psText->append("_rcpfloat");
+			else if ((ui32Control & 0x3) == 2)
+				psText->append("_uint");
+			break;
+		case OPCODE_SAMPLE_INFO:
+			if (ui32Control & 0x1)
+				psText->append("_uint");
+			break;
+	}
+
+	if (ui32Control & 0xf00) {
+		psText->append(" [precise(");
+		for (uint32_t i = 0; i < 4; i++) {
+			if (ui32Control & (0x100 << i))
+				psText->push_back(acComponentNames[i]);
+		}
+		psText->append(")]");
+	}
+
+	return true;
+}
+
+// Returns the length of the instruction, or 0 on error:
+static uint32_t DisassembleInstruction(Disassembler* psDisasm, const uint32_t* pui32Token,
+		const uint32_t* pui32End, std::string* psText)
+{
+	uint32_t ui32Token = pui32Token[0];
+	OPCODE_TYPE eOpcode = DecodeOpcodeType(ui32Token);
+	uint32_t ui32Length = DecodeInstructionLength(ui32Token);
+	const uint32_t* pui32InsEnd;
+	const uint32_t* pui32Operands;
+	const char* pszName;
+
+	if (eOpcode == OPCODE_CUSTOMDATA) {
+		if (pui32End - pui32Token < 2)
+			return 0;
+		ui32Length = pui32Token[1];
+		if (ui32Length < 2 || ui32Length > (uint32_t)(pui32End - pui32Token))
+			return 0;
+		if (!DisassembleCustomData(psDisasm, pui32Token, ui32Length, psText))
+			return 0;
+		return ui32Length;
+	}
+
+	if (!ui32Length || ui32Length > (uint32_t)(pui32End - pui32Token))
+		return 0;
+	pui32InsEnd = pui32Token + ui32Length;
+
+	if (IsDeclaration(eOpcode)) {
+		if (!DisassembleDeclaration(psDisasm, pui32Token, pui32InsEnd, eOpcode, psText))
+			return 0;
+		return ui32Length;
+	}
+
+	if (eOpcode == OPCODE_SYNC) {
+		uint32_t ui32Flags = (ui32Token >> 11) & 0xf;
+		psText->append("sync");
+		if ((ui32Flags & 0xc) == 0xc)
+			psText->append("_sat_uglobal");
+		else if (ui32Flags & 0x8)
+			psText->append("_uglobal");
+		else if (ui32Flags & 0x4)
+			psText->append("_sat_ugroup");
+		if (ui32Flags & 0x2)
+			psText->append("_g");
+		if (ui32Flags & 0x1)
+			psText->append("_t");
+		return ui32Length;
+	}
+
+	pszName = InstructionName(eOpcode);
+	if (!pszName)
+		return 0;
+	if (!AppendInstructionName(pui32Token, pui32InsEnd, eOpcode, pszName, psText))
+		return 0;
+
+	// Skip the extended opcode tokens to find the operands:
+	pui32Operands = pui32Token;
+	while (DecodeIsOpcodeExtended(*pui32Operands++)) {}
+
+	if (pui32Operands >= pui32InsEnd) {
+		// Operand-less instructions still get the separator:
+		psText->push_back(' ');
+		return ui32Length;
+	}
+
+	if (!AppendOperands(psDisasm, pui32Operands, pui32InsEnd, eOpcode, psText))
+		return 0;
+	return ui32Length;
+}
+
+static bool DisassembleCode(Disassembler* psDisasm)
+{
+	const uint32_t* pui32Token = psDisasm->pui32Code + 2;
+	const uint32_t* pui32End = psDisasm->pui32Code + psDisasm->ui32CodeLength;
+	std::string* psText = psDisasm->psText;
+	uint32_t ui32Version = psDisasm->pui32Code[0];
+	uint32_t ui32Length;
+	int iIndent = 0;
+	OPCODE_TYPE eOpcode;
+
+	switch (psDisasm->eShaderType) {
+		case PIXEL_SHADER: psText->append("ps"); break;
+		case VERTEX_SHADER: psText->append("vs"); break;
+		case GEOMETRY_SHADER: psText->append("gs"); break;
+		case HULL_SHADER: psText->append("hs"); break;
+		case DOMAIN_SHADER: psText->append("ds"); break;
+		case COMPUTE_SHADER: psText->append("cs"); break;
+		default: return false;
+	}
+	Appendf(psText, "_%u_%u\n", DecodeProgramMajorVersion(ui32Version), DecodeProgramMinorVersion(ui32Version));
+
+	while (pui32Token < pui32End) {
+		eOpcode = DecodeOpcodeType(*pui32Token);
+
+		switch (eOpcode) {
+			case OPCODE_ELSE:
+			case OPCODE_ENDIF:
+			case OPCODE_ENDLOOP:
+			case OPCODE_ENDSWITCH:
+				if (iIndent)
+					iIndent--;
+				break;
+		}
+		psText->append(iIndent * 2, ' ');
+
+		ui32Length = DisassembleInstruction(psDisasm, pui32Token, pui32End, psText);
+		if (!ui32Length || psDisasm->bFailed)
+			return false;
+		psText->push_back('\n');
+		pui32Token += ui32Length;
+
+		switch (eOpcode) {
+			case OPCODE_IF:
+			case OPCODE_ELSE:
+			case OPCODE_LOOP:
+			case OPCODE_SWITCH:
+				iIndent++;
+				break;
+		}
+	}
+
+	return true;
+}
+
+// Scans the declarations ahead of rendering the code for the things that are
+// mentioned in the comment header - early depth-stencil and whether a pixel
+// shader runs at sample frequency:
+static void ScanDeclarations(Disassembler* psDisasm)
+{
+	const uint32_t* pui32Token = psDisasm->pui32Code + 2;
+	const uint32_t* pui32End = psDisasm->pui32Code + psDisasm->ui32CodeLength;
+	uint32_t ui32Length, ui32Mode;
+	OPCODE_TYPE eOpcode;
+
+	while (pui32Token < pui32End) {
+		eOpcode = DecodeOpcodeType(*pui32Token);
+		if (eOpcode == OPCODE_CUSTOMDATA) {
+			if (pui32End - pui32Token < 2)
+				return;
+			ui32Length = pui32Token[1];
+		} else {
+			if (!IsDeclaration(eOpcode))
+				return;
+			ui32Length = DecodeInstructionLength(*pui32Token);
+		}
+		if (!ui32Length || ui32Length > (uint32_t)(pui32End - pui32Token))
+			return;
+
+		switch (eOpcode) {
+			case OPCODE_DCL_GLOBAL_FLAGS:
+				psDisasm->ui32GlobalFlags = DecodeGlobalFlags(*pui32Token);
+				break;
+			case OPCODE_DCL_INPUT_PS_SGV:
+			case OPCODE_DCL_INPUT_PS_SIV:
+				if (pui32Token[ui32Length - 1] == NAME_SAMPLE_INDEX)
+					psDisasm->bSampleFrequency = true;
+				// Fall through
+			case OPCODE_DCL_INPUT_PS:
+				ui32Mode = DecodeInterpolationMode(*pui32Token);
+				if (ui32Mode == INTERPOLATION_LINEAR_SAMPLE || ui32Mode == INTERPOLATION_LINEAR_NOPERSPECTIVE_SAMPLE)
+					psDisasm->bSampleFrequency = true;
+				break;
+		}
+		pui32Token += ui32Length;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// Comment blocks
+// ---------------------------------------------------------------------------
+
+static void DisassembleFeatureInfo(Disassembler* psDisasm)
+{
+	static const char* const apszFeatures[] = {
+		"Double-precision floating point",
+		NULL, // Raw and Structured buffers, not shown
+		"UAVs at every shader stage",
+		"64 UAV slots",
+		"Minimum-precision data types",
+		"Double-precision extensions for 11.1",
+		"Shader extensions for 11.1",
+		"Comparison filtering for feature level 9",
+		"Tiled resources",
+		"PS Output Stencil Ref",
+		"PS Inner Coverage",
+		"Typed UAV Load Additional Formats",
+		"Raster Ordered UAVs",
+		"SV_RenderTargetArrayIndex or SV_ViewportArrayIndex from any shader feeding rasterizer",
+	};
+	std::string* psText = psDisasm->psText;
+	uint32_t ui32Flags = 0, i;
+	bool bEarlyDepth;
+	size_t uStart;
+
+	if (psDisasm->sSFI0.pui8Data)
+		ui32Flags = ReadU32(psDisasm, &psDisasm->sSFI0, 0);
+	bEarlyDepth = (psDisasm->ui32GlobalFlags & GLOBAL_FLAG_FORCE_EARLY_DEPTH_STENCIL) != 0;
+
+	uStart = psText->size();
+	psText->append("//\n// Note: shader requires additional functionality:\n");
+	for (i = 0; i < sizeof(apszFeatures) / sizeof(apszFeatures[0]); i++) {
+		if (ui32Flags & (1 << i) && apszFeatures[i])
+			Appendf(psText, "//       %s\n", apszFeatures[i]);
+		if (i == 0 && bEarlyDepth)
+			psText->append("//       Early depth-stencil\n");
+	}
+	if (psText->size() - uStart == 54) {
+		// Nothing to note
+		psText->resize(uStart);
+		return;
+	}
+	psText->append("//\n");
+}
+
+static const char* VariableTypeName(uint32_t ui32Type)
+{
+	switch (ui32Type) {
+		case SVT_VOID: return "void";
+		case SVT_BOOL: return "bool";
+		case SVT_INT: return "int";
+		case SVT_FLOAT: return "float";
+		case SVT_STRING: return "string";
+		case SVT_TEXTURE: return "texture";
+		case SVT_TEXTURE1D: return "Texture1D";
+		case SVT_TEXTURE2D: return "Texture2D";
+		case SVT_TEXTURE3D: return "Texture3D";
+		case SVT_TEXTURECUBE: return "TextureCube";
+		case SVT_SAMPLER: return "sampler";
+		case SVT_UINT: return "uint";
+		case SVT_UINT8: return "uint8";
+		case SVT_DOUBLE: return "double";
+		// Minimum precision types, not in SHADER_VARIABLE_TYPE:
+		case 57: return "min8float";
+		case 58: return "min10float";
+		case 59: return "min16float";
+		case 60: return "min12int";
+		case 61: return "min16int";
+		case 62: return "min16uint";
+	}
+	return NULL;
+}
+
+// A variable or struct member. Structs recurse into their members, which
+// show only their absolute offset:
+static void DisassembleVariable(Disassembler* psDisasm, uint32_t ui32TypeOffset, const char* pszName,
+		uint32_t ui32Offset, int iDepth, const uint32_t* pui32Size, uint32_t ui32Flags)
+{
+	const Chunk* psRDEF = &psDisasm->sRDEF;
+	std::string* psText = psDisasm->psText;
+	std::string sIndent(3 + 4 * iDepth, ' ');
+	uint16_t ui16Class, ui16Type, ui16Rows, ui16Columns, ui16Elements, ui16Members;
+	const char* pszTypeName = NULL;
+	uint32_t ui32NameOffset, ui32MemberOffset, i;
+	size_t uLineStart;
+
+	ui16Class = ReadU16(psDisasm, psRDEF, ui32TypeOffset);
+	ui16Type = ReadU16(psDisasm, psRDEF, ui32TypeOffset + 2);
+	ui16Rows = ReadU16(psDisasm, psRDEF, ui32TypeOffset + 4);
+	ui16Columns = ReadU16(psDisasm, psRDEF, ui32TypeOffset + 6);
+	ui16Elements = ReadU16(psDisasm, psRDEF, ui32TypeOffset + 8);
+	ui16Members = ReadU16(psDisasm, psRDEF, ui32TypeOffset + 10);
+	ui32MemberOffset = ReadU32(psDisasm, psRDEF, ui32TypeOffset + 12);
+	if (psDisasm->bFailed)
+		return;
+
+	// Shader model 5 has the type name:
+	if (psRDEF->pui8Data[17] >= 5) {
+		ui32NameOffset = ReadU32(psDisasm, psRDEF, ui32TypeOffset + 32);
+		if (ui32NameOffset)
+			pszTypeName = ReadString(psDisasm, psRDEF, ui32NameOffset);
+	}
+
+	if (ui16Class == SVC_STRUCT) {
+		uLineStart = psText->size();
+		Appendf(psText, "//%sstruct", sIndent.c_str());
+		if (pszTypeName && *pszTypeName)
+			Appendf(psText, " %s", pszTypeName);
+		Appendf(psText, "\n//%s{\n//%s    \n", sIndent.c_str(), sIndent.c_str());
+		for (i = 0; i < ui16Members && !psDisasm->bFailed; i++) {
+			uint32_t ui32Member = ui32MemberOffset + i * 12;
+			uint32_t ui32MemberType = ReadU32(psDisasm, psRDEF, ui32Member + 4);
+			if (i && ReadU16(psDisasm, psRDEF, ui32MemberType) == SVC_STRUCT)
+				Appendf(psText, "//%s    \n", sIndent.c_str());
+			DisassembleVariable(psDisasm, ui32MemberType,
+					ReadString(psDisasm, psRDEF, ReadU32(psDisasm, psRDEF, ui32Member)),
+					ui32Offset + ReadU32(psDisasm, psRDEF, ui32Member + 8),
+					iDepth + 1, NULL, 0);
+		}
+		psText->append("//\n");
+		uLineStart = psText->size();
+		Appendf(psText, "//%s} %s", sIndent.c_str(), pszName);
+	} else {
+		uLineStart = psText->size();
+		psText->append("//");
+		psText->append(sIndent);
+		if (ui16Class == SVC_MATRIX_ROWS)
+			psText->append("row_major ");
+		// The stored name is whatever the source spelled it as (e.g. a
+		// typedef or dword), but D3DDisassemble always spells out the
+		// underlying type, so only use it if we don't know that:
+		const char* pszBaseType = VariableTypeName(ui16Type);
+		if (pszBaseType) {
+			psText->append(pszBaseType);
+			if (ui16Class == SVC_VECTOR)
+				Appendf(psText, "%u", ui16Columns);
+			else if (ui16Class == SVC_MATRIX_ROWS || ui16Class == SVC_MATRIX_COLUMNS)
+				Appendf(psText, "%ux%u", ui16Rows, ui16Columns);
+		} else if (pszTypeName && *pszTypeName) {
+			psText->append(pszTypeName);
+		} else {
+			psDisasm->bFailed = true;
+			return;
+		}
+		Appendf(psText, " %s", pszName);
+	}
+	if (ui16Elements)
+		Appendf(psText, "[%u]", ui16Elements);
+	psText->push_back(';');
+	PadLine(psText, uLineStart, 40);
+	Appendf(psText, "// Offset: %4u", ui32Offset);
+	if (pui32Size) {
+		Appendf(psText, " Size: %5u", *pui32Size);
+		if (!(ui32Flags & 2))
+			psText->append(" [unused]");
+	}
+	psText->push_back('\n');
+}
+
+static void DisassembleDefaultValue(Disassembler* psDisasm, uint32_t ui32DefaultOffset, uint32_t ui32Size)
+{
+	std::string* psText = psDisasm->psText;
+	uint32_t i;
+
+	for (i = 0; i < ui32Size / 4 && !psDisasm->bFailed; i++) {
+		if (i == 0)
+			psText->append("//      = ");
+		else if (i % 4 == 0)
+			psText->append("\n//        ");
+		Appendf(psText, "0x%08x ", ReadU32(psDisasm, &psDisasm->sRDEF, ui32DefaultOffset + i * 4));
+	}
+	if (i)
+		psText->push_back('\n');
+}
+
+static void DisassembleBufferDefinitions(Disassembler* psDisasm, uint32_t ui32BufferCount, uint32_t ui32BufferOffset)
+{
+	const Chunk* psRDEF = &psDisasm->sRDEF;
+	std::string* psText = psDisasm->psText;
+	uint32_t ui32VarSize = psRDEF->pui8Data[17] >= 5 ? 40 : 24;
+	uint32_t i, j;
+
+	psText->append("//\n// Buffer Definitions: \n//\n");
+
+	for (i = 0; i < ui32BufferCount && !psDisasm->bFailed; i++) {
+		uint32_t ui32Buffer = ui32BufferOffset + i * 24;
+		const char* pszName = ReadString(psDisasm, psRDEF, ReadU32(psDisasm, psRDEF, ui32Buffer));
+		uint32_t ui32VarCount = ReadU32(psDisasm, psRDEF, ui32Buffer + 4);
+		uint32_t ui32VarOffset = ReadU32(psDisasm, psRDEF, ui32Buffer + 8);
+
+		switch (ReadU32(psDisasm, psRDEF, ui32Buffer + 20)) {
+			case 0: Appendf(psText, "// cbuffer %s\n", pszName); break;
+			case 1: Appendf(psText, "// tbuffer %s\n", pszName); break;
+			case 3: Appendf(psText, "// Resource bind info for %s\n", pszName); break;
+			default:
+				// Interface pointers
+				psDisasm->bFailed = true;
+				return;
+		}
+		psText->append("// {\n//\n");
+
+		for (j = 0; j < ui32VarCount && !psDisasm->bFailed; j++) {
+			uint32_t ui32Var = ui32VarOffset + j * ui32VarSize;
+			uint32_t ui32Size = ReadU32(psDisasm, psRDEF, ui32Var + 8);
+			uint32_t ui32TypeOffset = ReadU32(psDisasm, psRDEF, ui32Var + 16);
+			uint32_t ui32DefaultOffset = ReadU32(psDisasm, psRDEF, ui32Var + 20);
+
+			if (j && ReadU16(psDisasm, psRDEF, ui32TypeOffset) == SVC_STRUCT)
+				psText->append("//   \n");
+			DisassembleVariable(psDisasm, ui32TypeOffset,
+					ReadString(psDisasm, psRDEF, ReadU32(psDisasm, psRDEF, ui32Var)),
+					ReadU32(psDisasm, psRDEF, ui32Var + 4), 0, &ui32Size,
+					ReadU32(psDisasm, psRDEF, ui32Var + 12));
+			if (ui32DefaultOffset)
+				DisassembleDefaultValue(psDisasm, ui32DefaultOffset, ui32Size);
+		}
+
+		psText->append("//\n// }\n//\n");
+	}
+}
+
+static void DisassembleResourceBindings(Disassembler* psDisasm, uint32_t ui32BindCount, uint32_t ui32BindOffset)
+{
+	static const char* const apszDimensions[] = {
+		"NA", "buf", "1d", "1darray", "2d", "2darray", "2dMS", "2dMSarray", "3d", "cube", "cubearray", "r/o",
+	};
+	static const char* const apszReturnTypes[] = {
+		"NA", "unorm", "snorm", "sint", "uint", "float", "mixed", "double",
+	};
+	const Chunk* psRDEF = &psDisasm->sRDEF;
+	std::string* psText = psDisasm->psText;
+	char szFormat[16], szDimension[16], szBind[32];
+	const char *pszType, *pszFormat, *pszDimension, *pszPrefix;
+	uint32_t i;
+
+	psText->append("//\n// Resource Bindings:\n//\n"
+			"// Name                                 Type  Format         Dim      HLSL Bind  Count\n"
+			"// ------------------------------ ---------- ------- ----------- -------------- ------\n");
+
+	for (i = 0; i < ui32BindCount && !psDisasm->bFailed; i++) {
+		uint32_t ui32Bind = ui32BindOffset + i * 32;
+		const char* pszName = ReadString(psDisasm, psRDEF, ReadU32(psDisasm, psRDEF, ui32Bind));
+		uint32_t ui32Type = ReadU32(psDisasm, psRDEF, ui32Bind + 4);
+		uint32_t ui32ReturnType = ReadU32(psDisasm, psRDEF, ui32Bind + 8);
+		uint32_t ui32Dimension = ReadU32(psDisasm, psRDEF, ui32Bind + 12);
+		uint32_t ui32NumSamples = ReadU32(psDisasm, psRDEF, ui32Bind + 16);
+		uint32_t ui32BindPoint = ReadU32(psDisasm, psRDEF, ui32Bind + 20);
+		uint32_t ui32BindCount = ReadU32(psDisasm, psRDEF, ui32Bind + 24);
+		uint32_t ui32Flags = ReadU32(psDisasm, psRDEF, ui32Bind + 28);
+
+		if (ui32Dimension >= sizeof(apszDimensions) / sizeof(apszDimensions[0])
+				|| ui32ReturnType >= sizeof(apszReturnTypes) / sizeof(apszReturnTypes[0])) {
+			psDisasm->bFailed = true;
+			return;
+		}
+
+		pszDimension = apszDimensions[ui32Dimension];
+		pszFormat = apszReturnTypes[ui32ReturnType];
+		if (((ui32Flags >> 2) & 3) && ui32ReturnType) {
+			snprintf(szFormat, sizeof(szFormat), "%s%u", pszFormat, ((ui32Flags >> 2) & 3) + 1);
+			pszFormat = szFormat;
+		}
+		if ((ui32Dimension == 6 || ui32Dimension == 7) && ui32NumSamples && ui32NumSamples != 0xffffffff) {
+			snprintf(szDimension, sizeof(szDimension), "%s%u", pszDimension, ui32NumSamples);
+			pszDimension = szDimension;
+		}
+
+		switch (ui32Type) {
+			case 0: pszType = "cbuffer"; pszPrefix = "cb"; pszFormat = pszDimension = "NA"; break;
+			case 1: pszType = "tbuffer"; pszPrefix = "t"; pszFormat = pszDimension = "NA"; break;
+			case 2: pszType = "texture"; pszPrefix = "t"; break;
+			case 3: pszType = ui32Flags & 2 ? "sampler_c" : "sampler"; pszPrefix = "s"; pszFormat = pszDimension = "NA"; break;
+			case 4: pszType = "UAV"; pszPrefix = "u"; break;
+			case 5: pszType = "texture"; pszPrefix = "t"; pszFormat = "struct"; pszDimension = "r/o"; break;
+			case 6: pszType = "UAV"; pszPrefix = "u"; pszFormat = "struct"; pszDimension = "r/w"; break;
+			case 7: pszType = "texture"; pszPrefix = "t"; pszFormat = "byte"; pszDimension = "r/o"; break;
+			case 8: pszType = "UAV"; pszPrefix = "u"; pszFormat = "byte"; pszDimension = "r/w"; break;
+			case 9: pszType = "UAV"; pszPrefix = "u"; pszFormat = "struct"; pszDimension = "append"; break;
+			case 10: pszType = "UAV"; pszPrefix = "u"; pszFormat = "struct"; pszDimension = "consume"; break;
+			case 11: pszType = "UAV"; pszPrefix = "u"; pszFormat = "struct"; pszDimension = "r/w+cnt"; break;
+			default:
+				psDisasm->bFailed = true;
+				return;
+		}
+
+		snprintf(szBind, sizeof(szBind), "%s%u", pszPrefix, ui32BindPoint);
+		Appendf(psText, "// %-30s %10s %7s %11s %14s %6u \n",
+				pszName, pszType, pszFormat, pszDimension, szBind, ui32BindCount);
+	}
+
+	psText->append("//\n");
+}
+
+static void DisassembleResourceDefinitions(Disassembler* psDisasm)
+{
+	const Chunk* psRDEF = &psDisasm->sRDEF;
+	uint32_t ui32BufferCount, ui32BufferOffset, ui32BindCount, ui32BindOffset;
+
+	if (!psRDEF->pui8Data)
+		return;
+
+	ui32BufferCount = ReadU32(psDisasm, psRDEF, 0);
+	ui32BufferOffset = ReadU32(psDisasm, psRDEF, 4);
+	ui32BindCount = ReadU32(psDisasm, psRDEF, 8);
+	ui32BindOffset = ReadU32(psDisasm, psRDEF, 12);
+	if (psDisasm->bFailed)
+		return;
+
+	if (ui32BufferCount)
+		DisassembleBufferDefinitions(psDisasm, ui32BufferCount, ui32BufferOffset);
+	if (ui32BindCount)
+		DisassembleResourceBindings(psDisasm, ui32BindCount, ui32BindOffset);
+	psDisasm->psText->append("//\n");
+}
+
+// Semantics that use special purpose registers have no register number, and
+// are identified by name or system value:
+static bool SpecialRegister(const char* pszSemantic, uint32_t ui32SystemValue,
+		const char** ppszRegister, const char** ppszSystemValue)
+{
+	static const struct { const char* pszSemantic; const char* pszRegister; const char* pszSystemValue; } asSpecial[] = {
+		{ "SV_Depth",              "oDepth",         "DEPTH" },
+		{ "SV_Coverage",           "oMask",          "COVERAGE" },
+		{ "SV_DepthGreaterEqual",  "oDepthGE",       "DEPTHGE" },
+		{ "SV_DepthLessEqual",     "oDepthLE",       "DEPTHLE" },
+		{ "SV_StencilRef",         "oStencilRef",    "STENCILREF" },
+		{ "SV_InnerCoverage",      "vInnerCoverage", "INNERCOV" },
+	};
+	uint32_t i;
+
+	if (ui32SystemValue == NAME_PRIMITIVE_ID) {
+		*ppszRegister = "primID";
+		*ppszSystemValue = "PRIMID";
+		return true;
+	}
+
+	for (i = 0; i < sizeof(asSpecial) / sizeof(asSpecial[0]); i++) {
+		if (!_stricmp(pszSemantic, asSpecial[i].pszSemantic)) {
+			*ppszRegister = asSpecial[i].pszRegister;
+			*ppszSystemValue = asSpecial[i].pszSystemValue;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void AppendSignatureMask(uint32_t ui32Mask, std::string* psText)
+{
+	uint32_t i;
+
+	for (i = 0; i < 4; i++)
+		psText->push_back(ui32Mask & (1 << i) ? acComponentNames[i] : ' ');
+}
+
+static void DisassembleSignature(Disassembler* psDisasm, const Chunk* psChunk, const char* pszSection, bool bOutput)
+{
+	static const char* const apszSystemValues[] = {
+		"NONE", "POS", "CLIPDST", "CULLDST", "RTINDEX", "VPINDEX", "VERTID", "PRIMID", "INSTID",
+		"FFACE", "SAMPLE", "QUADEDGE", "QUADINT", "TRIEDGE", "TRIINT", "LINEDET", "LINEDEN",
+	};
+	static const char* const apszFormats[] = { "unknown", "uint", "int", "float" };
+	std::string* psText = psDisasm->psText;
+	uint32_t ui32Count, ui32EntrySize, ui32Entry, i;
+	bool bStreams = false;
+
+	if (!psChunk->pui8Data)
+		return;
+
+	ui32Count = ReadU32(psDisasm, psChunk, 0);
+	ui32EntrySize = psChunk->ui32EntrySize;
+
+	// Stream prefixes are only shown if anything is in a stream other than 0:
+	if (ui32EntrySize != 24) {
+		for (i = 0; i < ui32Count && !psDisasm->bFailed; i++) {
+			if (ReadU32(psDisasm, psChunk, 8 + i * ui32EntrySize))
+				bStreams = true;
+		}
+	}
+
+	Appendf(psText, "//\n// %s signature:\n//\n"
+			"// Name                 Index   Mask Register SysValue  Format   Used\n"
+			"// -------------------- ----- ------ -------- -------- ------- ------\n", pszSection);
+
+	if (!ui32Count) {
+		Appendf(psText, "// no %s\n", pszSection);
+		return;
+	}
+
+	for (i = 0; i < ui32Count && !psDisasm->bFailed; i++) {
+		const char *pszSemantic, *pszFormat, *pszSystemValue, *pszRegister = NULL;
+		uint32_t ui32Stream = 0, ui32MinPrecision = 0;
+		uint32_t ui32SemanticIndex, ui32SystemValue, ui32Format, ui32Register, ui32Masks, ui32Used;
+		std::string sName;
+		char szRegister[16];
+
+		ui32Entry = 8 + i * ui32EntrySize;
+		if (ui32EntrySize != 24)
+			ui32Stream = ReadU32(psDisasm, psChunk, ui32Entry);
+		if (ui32EntrySize == 32)
+			ui32MinPrecision = ReadU32(psDisasm, psChunk, ui32Entry + 28);
+		if (ui32EntrySize != 24)
+			ui32Entry += 4;
+
+		pszSemantic = ReadString(psDisasm, psChunk, ReadU32(psDisasm, psChunk, ui32Entry));
+		ui32SemanticIndex = ReadU32(psDisasm, psChunk, ui32Entry + 4);
+		ui32SystemValue = ReadU32(psDisasm, psChunk, ui32Entry + 8);
+		ui32Format = ReadU32(psDisasm, psChunk, ui32Entry + 12);
+		ui32Register = ReadU32(psDisasm, psChunk, ui32Entry + 16);
+		ui32Masks = ReadU32(psDisasm, psChunk, ui32Entry + 20);
+		if (psDisasm->bFailed)
+			return;
+
+		if (bStreams)
+			Appendf(&sName, "m%u:", ui32Stream);
+		sName.append(pszSemantic);
+
+		if (ui32Format >= sizeof(apszFormats) / sizeof(apszFormats[0])) {
+			psDisasm->bFailed = true;
+			return;
+		}
+		pszFormat = apszFormats[ui32Format];
+		switch (ui32MinPrecision) {
+			case 1: pszFormat = "min16f"; break;
+			case 2: pszFormat = "min2_8f"; break;
+			case 4: pszFormat = "min16i"; break;
+			case 5: pszFormat = "min16u"; break;
+		}
+
+		if (ui32SystemValue < sizeof(apszSystemValues) / sizeof(apszSystemValues[0]))
+			pszSystemValue = apszSystemValues[ui32SystemValue];
+		else
+			pszSystemValue = "NONE";
+		if (ui32SystemValue == 0 && !_stricmp(pszSemantic, "SV_Target"))
+			pszSystemValue = "TARGET";
+
+		ui32Used = (ui32Masks >> 8) & 0xf;
+		if (bOutput)
+			ui32Used = ~ui32Used & 0xf;
+
+		if (ui32Register == 0xffffffff) {
+			if (!SpecialRegister(pszSemantic, ui32SystemValue, &pszRegister, &pszSystemValue))
+				pszRegister = "special";
+			Appendf(psText, "// %-20s %5u    N/A %8s %8s %7s %6s\n", sName.c_str(), ui32SemanticIndex,
+					pszRegister, pszSystemValue, pszFormat, ui32Used & 1 ? "YES" : "NO");
+			continue;
+		}
+
+		snprintf(szRegister, sizeof(szRegister), "%u", ui32Register);
+		Appendf(psText, "// %-20s %5u   ", sName.c_str(), ui32SemanticIndex);
+		AppendSignatureMask(ui32Masks & 0xf, psText);
+		Appendf(psText, " %8s %8s %7s   ", szRegister, pszSystemValue, pszFormat);
+		AppendSignatureMask(ui32Used, psText);
+		psText->push_back('\n');
+	}
+
+	psText->append("//\n");
+}
+
+// ---------------------------------------------------------------------------
+
+static bool FindChunks(Disassembler* psDisasm, const uint8_t* pui8Container, size_t uSize)
+{
+	const DXBCContainerHeader* psHeader = (const DXBCContainerHeader*)pui8Container;
+	const DXBCChunkHeader* psChunk;
+	uint32_t ui32ChunkOffset, i;
+	Chunk* psTarget;
+	uint32_t ui32EntrySize;
+
+	if (uSize < sizeof(DXBCContainerHeader) || psHeader->fourcc != FOURCC_DXBC)
+		return false;
+	if (psHeader->chunkCount > (uSize - sizeof(DXBCContainerHeader)) / 4)
+		return false;
+
+	for (i = 0; i < psHeader->chunkCount; i++) {
+		memcpy(&ui32ChunkOffset, pui8Container + sizeof(DXBCContainerHeader) + i * 4, 4);
+		if (ui32ChunkOffset > uSize - sizeof(DXBCChunkHeader) || ui32ChunkOffset & 3)
+			return false;
+		psChunk = (const DXBCChunkHeader*)(pui8Container + ui32ChunkOffset);
+		if (psChunk->size > uSize - ui32ChunkOffset - sizeof(DXBCChunkHeader))
+			return false;
+
+		ui32EntrySize = 0;
+		switch (psChunk->fourcc) {
+			case FOURCC_RDEF: psTarget = &psDisasm->sRDEF; break;
+			case FOURCC_ISGN: psTarget = &psDisasm->sISGN; ui32EntrySize = 24; break;
+			case FOURCC_ISG1: psTarget = &psDisasm->sISGN; ui32EntrySize = 32; break;
+			case FOURCC_OSGN: psTarget = &psDisasm->sOSGN; ui32EntrySize = 24; break;
+			case FOURCC_OSG5: psTarget = &psDisasm->sOSGN; ui32EntrySize = 28; break;
+			case FOURCC_OSG1: psTarget = &psDisasm->sOSGN; ui32EntrySize = 32; break;
+			case FOURCC_PCSG: psTarget = &psDisasm->sPCSG; ui32EntrySize = 24; break;
+			case FOURCC_PSG1: psTarget = &psDisasm->sPCSG; ui32EntrySize = 32; break;
+			case FOURCC_SFI0: psTarget = &psDisasm->sSFI0; break;
+			case FOURCC_SHDR: psTarget = &psDisasm->sSHDR; break;
+			case FOURCC_SHEX: psTarget = &psDisasm->sSHDR; break;
+			case FOURCC_STAT: psTarget = &psDisasm->sSTAT; break;
+			default: continue;
+		}
+		psTarget->pui8Data = (const uint8_t*)(psChunk + 1);
+		psTarget->ui32Size = psChunk->size;
+		psTarget->ui32EntrySize = ui32EntrySize;
+	}
+
+	if (!psDisasm->sSHDR.pui8Data || psDisasm->sSHDR.ui32Size < 8)
+		return false;
+	if (psDisasm->sRDEF.pui8Data && psDisasm->sRDEF.ui32Size < 28)
+		return false;
+
+	psDisasm->pui32Code = (const uint32_t*)psDisasm->sSHDR.pui8Data;
+	psDisasm->ui32CodeLength = psDisasm->pui32Code[1];
+	if (psDisasm->ui32CodeLength < 2 || psDisasm->ui32CodeLength > psDisasm->sSHDR.ui32Size / 4)
+		return false;
+	if ((psDisasm->pui32Code[0] >> 16) > COMPUTE_SHADER)
+		return false;
+	psDisasm->eShaderType = DecodeShaderType(psDisasm->pui32Code[0]);
+
+	return true;
+}
+
+bool DisassembleDXBC(const void* pvBytecode, size_t uSize, const char* pszComment, std::string* psText)
+{
+	Disassembler sDisasm;
+	const char* pszCreator = "Microsoft (R) D3D Shader Disassembler";
+
+	sDisasm.sRDEF = sDisasm.sISGN = sDisasm.sOSGN = sDisasm.sPCSG = Chunk();
+	sDisasm.sSFI0 = sDisasm.sSHDR = sDisasm.sSTAT = Chunk();
+	sDisasm.psText = psText;
+	sDisasm.bFailed = false;
+	sDisasm.ui32GlobalFlags = 0;
+	sDisasm.bSampleFrequency = false;
+
+	psText->clear();
+
+	// Alignment is needed for the token stream:
+	if ((uintptr_t)pvBytecode & 3)
+		return false;
+	if (!FindChunks(&sDisasm, (const uint8_t*)pvBytecode, uSize))
+		return false;
+	ScanDeclarations(&sDisasm);
+
+	psText->reserve(uSize * 4);
+
+	if (sDisasm.sRDEF.pui8Data) {
+		uint32_t ui32CreatorOffset = ReadU32(&sDisasm, &sDisasm.sRDEF, 24);
+		if (ui32CreatorOffset)
+			pszCreator = ReadString(&sDisasm, &sDisasm.sRDEF, ui32CreatorOffset);
+	}
+	Appendf(psText, "//\n// Generated by %s\n//\n", pszCreator);
+	if (pszComment)
+		psText->append(pszComment);
+
+	DisassembleFeatureInfo(&sDisasm);
+	DisassembleResourceDefinitions(&sDisasm);
+
+	DisassembleSignature(&sDisasm, &sDisasm.sISGN, "Input", false);
+	if (sDisasm.eShaderType == DOMAIN_SHADER) {
+		DisassembleSignature(&sDisasm, &sDisasm.sPCSG, "Patch Constant", false);
+		DisassembleSignature(&sDisasm, &sDisasm.sOSGN, "Output", true);
+	} else {
+		DisassembleSignature(&sDisasm, &sDisasm.sOSGN, "Output", true);
+		DisassembleSignature(&sDisasm, &sDisasm.sPCSG, "Patch Constant", true);
+	}
+	if (sDisasm.bSampleFrequency)
+		psText->append("// Pixel Shader runs at sample frequency\n//\n");
+	if (sDisasm.bFailed)
+		return false;
+
+	if (!DisassembleCode(&sDisasm))
+		return false;
+
+	Appendf(psText, "// Approximately %u instruction slots used\n",
+			sDisasm.sSTAT.pui8Data ? ReadU32(&sDisasm, &sDisasm.sSTAT, 0) : 0);
+
+	return !sDisasm.bFailed;
+}
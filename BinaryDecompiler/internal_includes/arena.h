@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <type_traits>
+
+// 3DMIGOTO ADDITION: Bump allocator for the decoder. Decoding a shader used to
+// make a separate heap allocation for every declaration list, instruction
+// list, sub-operand and map node, which adds up to thousands of malloc calls
+// for a large compute shader. Everything belonging to one decoded Shader can
+// instead be carved out of an arena and released in one go with Reset().
+//
+// Reset() keeps a single chunk big enough for everything the arena handed out
+// last time, so an arena that is reused for many shaders (e.g. one per worker
+// thread in cmd_Decompiler's batch mode) settles down to making no further
+// calls to malloc at all.
+//
+// Destructors are not run for objects placed in the arena directly - anything
+// allocated this way must not own heap memory of its own. Containers using
+// ArenaAllocator still destroy their elements as usual, they just don't give
+// the memory back until the arena is reset.
+class DecodeArena
+{
+public:
+	DecodeArena();
+	~DecodeArena();
+
+	void* Allocate(size_t size, size_t align);
+	void Reset();
+
+	template <class T>
+	T* New()
+	{
+		return new (Allocate(sizeof(T), alignof(T))) T();
+	}
+
+	// Statistics for benchmarking:
+	uint64_t ui64ChunkAllocations;
+	size_t uHighWaterMark;
+
+private:
+	struct Chunk
+	{
+		Chunk *psNext;
+		size_t uSize;
+	};
+
+	Chunk *psChunks;
+	char *pcPos;
+	char *pcEnd;
+	size_t uUsedInFullChunks;
+
+	void NewChunk(size_t uMinSize);
+	void FreeChunks();
+
+	// Not copyable - containers hold a pointer to us:
+	DecodeArena(const DecodeArena&);
+	DecodeArena& operator=(const DecodeArena&);
+};
+
+// Standard library allocator drawing from a DecodeArena. A NULL arena falls
+// back to the regular heap, which is what the DX9 decoder and any Shader
+// constructed without an arena gets.
+template <class T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+
+	// Containers adopt the arena of whatever they are assigned from, so
+	// ShaderPhase can swap in arena backed containers after construction:
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	DecodeArena *psArena;
+
+	ArenaAllocator() : psArena(NULL) {}
+	ArenaAllocator(DecodeArena *psArena) : psArena(psArena) {}
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : psArena(other.psArena) {}
+
+	T* allocate(size_t n)
+	{
+		if (!psArena)
+			return (T*)::operator new(n * sizeof(T));
+		return (T*)psArena->Allocate(n * sizeof(T), alignof(T));
+	}
+
+	void deallocate(T *p, size_t)
+	{
+		if (!psArena)
+			::operator delete(p);
+	}
+
+	template <class U>
+	struct rebind { typedef ArenaAllocator<U> other; };
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+	return a.psArena == b.psArena;
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+	return a.psArena != b.psArena;
+}
@@ -3,7 +3,10 @@
 
 #include "structs.h"
 
-Shader* DecodeDXBC(uint32_t* data);
+// If an arena is passed, the decoded Shader's declarations, instructions and
+// operands are allocated from it, and it must not be reset until the Shader
+// has been deleted. The DX9 decoder doesn't use it.
+Shader* DecodeDXBC(uint32_t* data, DecodeArena* psArena = NULL);
 
 //You don't need to call this directly because DecodeDXBC
 //will call DecodeDX9BC if the shader looks
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+// 3DMIGOTO ADDITION: Native disassembler for SM4/SM5 DXBC shaders. Renders
+// the bytecode straight into the same text D3DDisassemble() produces with
+// D3D_DISASM_ENABLE_DEFAULT_VALUE_PRINTS | D3D_DISASM_DISABLE_DEBUG_INFO in
+// the d3dcompiler_47 format, including the RDEF / signature comment blocks.
+// Float literals that %f would not round trip are printed with enough
+// precision that they do, so the result can be reassembled without the
+// fixup pass the assembler needs for Microsoft's output.
+//
+// pszComment (optional) is inserted verbatim after the "Generated by" line,
+// and should consist of complete comment lines.
+//
+// Returns false if the container is malformed, or uses anything this does
+// not know how to render (class linkage, unknown opcodes, etc), in which case
+// the contents of psText are undefined and the caller should fall back to
+// D3DDisassemble().
+bool DisassembleDXBC(const void *pvBytecode, size_t uSize, const char *pszComment, std::string *psText);
@@ -7,6 +7,7 @@
 
 #include "internal_includes/tokens.h"
 #include "internal_includes/reflect.h"
+#include "internal_includes/arena.h"
 
 enum{ MAX_SUB_OPERANDS = 3};
 
@@ -150,22 +151,37 @@ static const uint32_t HS_FORK_PHASE = 3;
 static const uint32_t HS_JOIN_PHASE = 4;
 enum{ NUM_PHASES = 5};
 
+// 3DMIGOTO ADDITION: Containers filled in by the decoder draw from the
+// Shader's DecodeArena (or the heap if it doesn't have one):
+typedef std::vector<Declaration, ArenaAllocator<Declaration>> DeclarationList;
+typedef std::vector<Instruction, ArenaAllocator<Instruction>> InstructionList;
+typedef std::map<int, int, std::less<int>, ArenaAllocator<std::pair<const int, int>>> ArenaIntMap;
+
 struct ShaderPhase
 {
 	//How many instances of this phase type are there?
 	uint32_t ui32InstanceCount;
 
-    std::vector<std::vector<Declaration>> ppsDecl;
+    std::vector<DeclarationList, ArenaAllocator<DeclarationList>> ppsDecl;
 
-    std::vector<std::vector<Instruction>> ppsInst;
+    std::vector<InstructionList, ArenaAllocator<InstructionList>> ppsInst;
 
-    ShaderPhase() :
-        ui32InstanceCount(0)
+    ShaderPhase(DecodeArena *psArena = NULL) :
+        ui32InstanceCount(0),
+        ppsDecl(ArenaAllocator<DeclarationList>(psArena)),
+        ppsInst(ArenaAllocator<InstructionList>(psArena))
     {
 	    // 3DMigoto backport: Ensure we always have at least one "instance"
-	    ppsDecl.resize(1);
-	    ppsInst.resize(1);
+	    ResizeInstances(1);
     }
+
+	// Inner lists are copied from a prototype so they inherit the arena
+	// instead of being default constructed on the heap:
+	void ResizeInstances(uint32_t ui32Count)
+	{
+		ppsDecl.resize(ui32Count, DeclarationList(ppsDecl.get_allocator()));
+		ppsInst.resize(ui32Count, InstructionList(ppsInst.get_allocator()));
+	}
 };
 
 struct Shader
@@ -207,10 +223,10 @@ struct Shader
 
 	std::vector<int> abScalarInput;
 
-    std::map<int, int> aIndexedOutput;
+    ArenaIntMap aIndexedOutput;
 
-    std::map<int, int> aIndexedInput;
-    std::map<int, int> aIndexedInputParents;
+    ArenaIntMap aIndexedInput;
+    ArenaIntMap aIndexedInputParents;
 
     std::vector<RESOURCE_DIMENSION> aeResourceDims;
 
@@ -219,33 +235,37 @@ struct Shader
     std::vector<int> aiOutputDeclared;
 
     //Does not track built-in inputs.
-    std::map<int, int> abInputReferencedByInstruction;
+    ArenaIntMap abInputReferencedByInstruction;
 
 	//int aiOpcodeUsed[NUM_OPCODES];
 
 	bool dx9Shader; // 3DMIGOTO ADDITION
 	uint32_t ui32CurrentVertexOutputStream;
 
-	Shader() :
+	DecodeArena *psArena; // 3DMIGOTO ADDITION, may be NULL
+
+	Shader(DecodeArena *psArena = NULL) :
 		ui32MajorVersion(0),
 		ui32MinorVersion(0),
 		ui32ShaderLength(0),
 		pui32FirstToken(0),
-		asPhase(),
+		asPhase{ShaderPhase(psArena), ShaderPhase(psArena), ShaderPhase(psArena),
+			ShaderPhase(psArena), ShaderPhase(psArena)},
 		aui32FuncTableToFuncPointer(),
 		aui32FuncBodyToFuncTable(),
 		funcTable(),
 		funcPointer(),
 		ui32NextClassFuncName(),
 		abScalarInput(),
-		aIndexedOutput(),
-		aIndexedInput(),
-		aIndexedInputParents(),
+		aIndexedOutput(std::less<int>(), psArena),
+		aIndexedInput(std::less<int>(), psArena),
+		aIndexedInputParents(std::less<int>(), psArena),
 		aeResourceDims(),
 		aiInputDeclaredSize(),
 		aiOutputDeclared(),
-		abInputReferencedByInstruction(),
-		dx9Shader(false)
+		abInputReferencedByInstruction(std::less<int>(), psArena),
+		dx9Shader(false),
+		psArena(psArena)
 	{
 		sInfo = new ShaderInfo();
 	}
@@ -2,11 +2,15 @@
 #include "float.h"
 
 #include <stdexcept>
+#include <mutex>
+#include <algorithm>
 
 #if MIGOTO_DX == 9
 #include <d3dx9shader.h>
 #endif
 
+#include "BinaryDecompiler\internal_includes\disassemble.h"
+
 using namespace std;
 
 // This is defined in the Windows 10 SDK, but seems not in the 8.0 SDK:
@@ -17,7 +21,17 @@ using namespace std;
 // for sscanf_s convinience. Explanation in DecompileHLSL.cpp
 #define UCOUNTOF(...) (unsigned)_countof(__VA_ARGS__)
 
+// Debugging aid recording instructions that failed to round trip, dumped by
+// writeLUT(). Shaders can be assembled from several threads at once (game
+// loader threads, cmd_Decompiler batch mode), so updates must hold the lock:
 static unordered_map<string, vector<DWORD>> codeBin;
+static mutex codeBinLock;
+
+static void recordCodeBin(const string &key, const vector<DWORD> &v)
+{
+	lock_guard<mutex> lock(codeBinLock);
+	codeBin[key] = v;
+}
 
 static DWORD strToDWORD(string s)
 {
@@ -186,6 +200,7 @@ void writeLUT()
 	if (!f)
 		return;
 
+	lock_guard<mutex> lock(codeBinLock);
 	for (unordered_map<string, vector<DWORD>>::iterator it = codeBin.begin(); it != codeBin.end(); ++it) {
 		fputs(it->first.c_str(), f);
 		fputs(":->", f);
@@ -365,7 +380,7 @@ static bool assemble_special_purpose_register(string &s, vector<DWORD> &v, token
 
 static vector<DWORD> assembleOp(string s, bool special = false);
 
-static vector<DWORD> assemble_cbvox_operand(string &s, vector<DWORD> &v, token_operand *tOp, bool special, DWORD num)
+static void assemble_cbvox_operand(string &s, vector<DWORD> &v, token_operand *tOp, bool special, DWORD num)
 {
 	tOp->num_indices = 2;
 	if (s[0] == 'x') { // Indexable temp array
@@ -423,7 +438,7 @@ static vector<DWORD> assemble_cbvox_operand(string &s, vector<DWORD> &v, token_o
 					if (iAdd2) v.push_back(iAdd2);
 					v.push_back(reg2[0]);
 					v.push_back(reg2[1]);
-					return v;
+					return;
 				}
 				string swizzle = s.substr(s.find("].") + 2);
 				handleSwizzle(swizzle, tOp);
@@ -432,7 +447,7 @@ static vector<DWORD> assemble_cbvox_operand(string &s, vector<DWORD> &v, token_o
 				v.push_back(reg[0]);
 				v.push_back(reg[1]);
 				v.push_back(atoi(index1.c_str()));
-				return v;
+				return;
 			}
 			tOp->num_indices = 2;
 			string swizzle = s.substr(s.find('.') + 1);
@@ -440,7 +455,7 @@ static vector<DWORD> assemble_cbvox_operand(string &s, vector<DWORD> &v, token_o
 			v.insert(v.begin(), tOp->op);
 			v.push_back(atoi(index0.c_str()));
 			v.push_back(atoi(index1.c_str()));
-			return v;
+			return;
 		}
 	} else if (s[0] == 'i') { // Immediate Constant Buffer
 		tOp->file = 9;
@@ -495,7 +510,7 @@ static vector<DWORD> assemble_cbvox_operand(string &s, vector<DWORD> &v, token_o
 			handleSwizzle(s.substr(s.find("].") + 2), tOp, special);
 
 			v.insert(v.begin(), tOp->op);
-			return v;
+			return;
 		}
 		DWORD idx = atoi(index.c_str());
 		num = atoi(sNum.c_str());
@@ -508,16 +523,15 @@ static vector<DWORD> assemble_cbvox_operand(string &s, vector<DWORD> &v, token_o
 			tOp->sel = 0xE4;
 		}
 		v.insert(v.begin(), tOp->op);
-		return v;
+		return;
 	}
 	num = atoi(sNum.c_str());
 	v.push_back(num);
 	handleSwizzle(s.substr(s.find('.') + 1), tOp, special);
 	v.insert(v.begin(), tOp->op);
-	return v;
 }
 
-static vector<DWORD> assemble_literal_operand(string &s, vector<DWORD> &v, token_operand *tOp)
+static void assemble_literal_operand(string &s, vector<DWORD> &v, token_operand *tOp)
 {
 	tOp->file = 4;
 	s.erase(s.begin());
@@ -548,10 +562,9 @@ static vector<DWORD> assemble_literal_operand(string &s, vector<DWORD> &v, token
 		v.push_back(strToDWORD(s));
 	}
 	v.insert(v.begin(), tOp->op);
-	return v;
 }
 
-static vector<DWORD> assemble_double_operand(string &s, vector<DWORD> &v, token_operand *tOp)
+static void assemble_double_operand(string &s, vector<DWORD> &v, token_operand *tOp)
 {
 	// Examples of double literals (from RE2):
 	//   d(0.000000l, 766800.000000l)
@@ -613,7 +626,6 @@ static vector<DWORD> assemble_double_operand(string &s, vector<DWORD> &v, token_
 	v.push_back(q1 >> 32);
 	v.push_back(q2 & 0xffffffff);
 	v.push_back(q2 >> 32);
-	return v;
 }
 
 static DWORD encode_min_precision_type(const char *type)
@@ -682,9 +694,10 @@ static void parse_min_precision_tag(string &s, vector<DWORD> &v, token_operand *
 	s.erase(tag - 1, s.find('}', tag + 1) - tag + 2);
 }
 
-static vector<DWORD> assembleOp(string s, bool special)
+// Assembles the operand into v, replacing whatever was there before, which
+// saves allocating a new vector for every operand:
+static void assembleOp(string s, bool special, vector<DWORD> &v)
 {
-	vector<DWORD> v;
 	DWORD op = 0;
 	DWORD ext = 0;
 	DWORD num = 0;
@@ -693,10 +706,11 @@ static vector<DWORD> assembleOp(string s, bool special)
 	token_operand* tOp = (token_operand*)&op;
 	tOp->comps_enum = 2; // 4
 
+	v.clear();
 	num = atoi(s.c_str());
 	if (num != 0) {
 		v.push_back(num);
-		return v;
+		return;
 	}
 	if (s[0] == '-') {
 		s.erase(s.begin());
@@ -715,12 +729,12 @@ static vector<DWORD> assembleOp(string s, bool special)
 	// them since we aren't using Flugan's assembler for DX9? Disabling -DSS
 	if (s == "vCoverage.x") {
 		v.push_back(0x2300A);
-		return v;
+		return;
 
 	}
 	if (s == "rasterizer.x") {
 		v.push_back(0x0000E00A);
-		return v;
+		return;
 
 	}
 #endif
@@ -734,7 +748,7 @@ static vector<DWORD> assembleOp(string s, bool special)
 		v.push_back(ext);
 
 	if (assemble_special_purpose_register(s, v, tOp, special))
-		return v;
+		return;
 
 	if (s[0] == 'i' && s[1] == 'c' && s[2] == 'b'
 	 || s[0] == 'c' && s[1] == 'b'
@@ -742,14 +756,19 @@ static vector<DWORD> assembleOp(string s, bool special)
 	 || s[0] == 'x'
 	 || s[0] == 'o'
 	 || s[0] == 'v') {
-		return assemble_cbvox_operand(s, v, tOp, special, num);
+		assemble_cbvox_operand(s, v, tOp, special, num);
+		return;
 	}
 
-	if (s[0] == 'l')
-		return assemble_literal_operand(s, v, tOp);
+	if (s[0] == 'l') {
+		assemble_literal_operand(s, v, tOp);
+		return;
+	}
 
-	if (s[0] == 'd')
-		return assemble_double_operand(s, v, tOp);
+	if (s[0] == 'd') {
+		assemble_double_operand(s, v, tOp);
+		return;
+	}
 
 	if (s[0] == 'r') {
 		tOp->file = 0;
@@ -776,18 +795,39 @@ static vector<DWORD> assembleOp(string s, bool special)
 		handleSwizzle("", tOp, special);
 	}
 	v.insert(v.begin(), op);
+}
+
+static vector<DWORD> assembleOp(string s, bool special)
+{
+	vector<DWORD> v;
+
+	assembleOp(s, special, v);
 	return v;
 }
 
-static vector<string> strToWords(string s)
+static void setWord(vector<string> &words, size_t i, const string &s, size_t pos, size_t len)
 {
-	vector<string> words;
+	if (i == words.size())
+		words.emplace_back();
+	string &word = words[i];
+
+	word.assign(s, pos, len);
+	// Fixed access before start of array -DarkStarSword
+	if (!word.empty() && word[word.size() - 1] == ',')
+		word.erase(--word.end());
+}
+
+// Splits the instruction into words, reusing the strings already in the
+// vector so they can keep their buffers from one instruction to the next:
+static void strToWords(const string &s, vector<string> &words)
+{
+	size_t n = 0;
 	string::size_type start = 0;
 	while (s[start] == ' ') start++;
 	string::size_type end = start;
 	while (end < s.size() && s[end] != ' ' && s[end] != '(')
 		end++;
-	words.push_back(s.substr(start, end - start));
+	setWord(words, n++, s, start, end - start);
 
 	while (s.size() > end) {
 		if (s[end] == ' ') {
@@ -837,20 +877,13 @@ static vector<string> strToWords(string s)
 		}
 
 		if (end == string::npos) {
-			words.push_back(s.substr(start));
+			setWord(words, n++, s, start, string::npos);
 		} else {
 			string::size_type length = end - start;
-			words.push_back(s.substr(start, length));
+			setWord(words, n++, s, start, length);
 		}
 	}
-	for (size_t i = 0; i < words.size(); i++) {
-		string s2 = words[i];
-		// Fixed access before start of array -DarkStarSword
-		if (!s2.empty() && s2[s2.size() - 1] == ',')
-			s2.erase(--s2.end());
-		words[i] = s2;
-	}
-	return words;
+	words.resize(n);
 }
 
 static DWORD parseAoffimmi(DWORD start, string o)
@@ -871,7 +904,83 @@ static unordered_map<string, vector<DWORD>> hackMap = {
 	{ "dcl_output oMask", { 0x02000065, 0x0000F000 } },
 };
 
-static unordered_map<string, vector<int>> ldMap = {
+// How assembleIns() handles a mnemonic. Those in the instruction and load
+// tables share code, everything else has a case of its own:
+enum class Mnemonic {
+	GENERIC,
+	LOAD,
+	HS_DECLS,
+	HS_FORK_PHASE,
+	HS_JOIN_PHASE,
+	HS_CONTROL_POINT_PHASE,
+	STORE_UAV_TYPED,
+	DCL_INPUT,
+	DCL_OUTPUT,
+	DCL_RESOURCE_RAW,
+	DCL_RESOURCE_BUFFER,
+	DCL_RESOURCE_TEXTURE1D,
+	DCL_RESOURCE_TEXTURE1DARRAY,
+	DCL_UAV_TYPED_TEXTURE1D,
+	DCL_UAV_TYPED_TEXTURE1DARRAY,
+	DCL_RESOURCE_TEXTURE2D,
+	DCL_UAV_TYPED_BUFFER,
+	DCL_RESOURCE_TEXTURE3D,
+	DCL_UAV_TYPED_TEXTURE3D,
+	DCL_RESOURCE_TEXTURECUBE,
+	DCL_RESOURCE_TEXTURECUBEARRAY,
+	DCL_RESOURCE_TEXTURE2DARRAY,
+	DCL_UAV_TYPED_TEXTURE2D,
+	DCL_UAV_TYPED_TEXTURE2DARRAY,
+	DCL_RESOURCE_TEXTURE2DMS,
+	DCL_RESOURCE_TEXTURE2DMSARRAY,
+	DCL_INDEXRANGE,
+	DCL_TEMPS,
+	DCL_RESOURCE_STRUCTURED,
+	DCL_SAMPLER,
+	DCL_GLOBALFLAGS,
+	DCL_CONSTANTBUFFER,
+	DCL_OUTPUT_SGV,
+	DCL_OUTPUT_SIV,
+	DCL_INPUT_SIV,
+	DCL_INPUT_SGV,
+	DCL_INPUT_PS,
+	DCL_INPUT_PS_SGV,
+	DCL_INPUT_PS_SIV,
+	DCL_INDEXABLETEMP,
+	DCL_IMMEDIATECONSTANTBUFFER,
+	DCL_TESSELLATOR_PARTITIONING,
+	DCL_TESSELLATOR_OUTPUT_PRIMITIVE,
+	DCL_TESSELLATOR_DOMAIN,
+	DCL_STREAM,
+	EMIT_STREAM,
+	CUT_STREAM,
+	EMIT_THEN_CUT_STREAM,
+	DCL_OUTPUTTOPOLOGY,
+	DCL_OUTPUT_CONTROL_POINT_COUNT,
+	DCL_INPUT_CONTROL_POINT_COUNT,
+	DCL_MAXOUT,
+	DCL_INPUTPRIMITIVE,
+	DCL_HS_MAX_TESSFACTOR,
+	DCL_HS_FORK_PHASE_INSTANCE_COUNT,
+	SAMPLEPOS,
+	PRINTF,
+	ERRORF,
+	UNDECIPHERABLE,
+};
+
+struct LoadInfo {
+	int numOps;
+	int opcode;
+	int variant; // 1 = _aoffimmi, 2 = _indexable, 3 = both
+};
+
+struct InsInfo {
+	int numOps;
+	int opcode;
+	int numSpecial = 1;
+};
+
+static const struct { const char *name; LoadInfo info; } ldTable[] = {
 	// Hint: Compiling for shader model 5 always uses _indexable variants,
 	//       so use shader model 4 to test vanilla and _aoffimmi (address
 	//       offset immediate) variants. resource_types.hlsl has test cases
@@ -944,7 +1053,7 @@ static unordered_map<string, vector<int>> ldMap = {
 	{ "ld_structured_indexable",        { 4, 0xa7, 2 } },
 };
 
-static unordered_map<string, vector<int>> insMap = {
+static const struct { const char *name; InsInfo info; } insTable[] = {
 	{ "add",                       { 3, 0x00    } },
 	{ "and",                       { 3, 0x01    } },
 	{ "break",                     { 0, 0x02    } },
@@ -1177,6 +1286,218 @@ static unordered_map<string, vector<int>> insMap = {
 	{ "utod",                      { 2, 0xd9    } }, // Added and verified -DarkStarSword
 };
 
+static const struct { const char *name; Mnemonic kind; } specialTable[] = {
+	{ "hs_decls",                          Mnemonic::HS_DECLS },
+	{ "hs_fork_phase",                     Mnemonic::HS_FORK_PHASE },
+	{ "hs_join_phase",                     Mnemonic::HS_JOIN_PHASE },
+	{ "hs_control_point_phase",            Mnemonic::HS_CONTROL_POINT_PHASE },
+	{ "store_uav_typed",                   Mnemonic::STORE_UAV_TYPED },
+	{ "dcl_input",                         Mnemonic::DCL_INPUT },
+	{ "dcl_output",                        Mnemonic::DCL_OUTPUT },
+	{ "dcl_resource_raw",                  Mnemonic::DCL_RESOURCE_RAW },
+	{ "dcl_resource_buffer",               Mnemonic::DCL_RESOURCE_BUFFER },
+	{ "dcl_resource_texture1d",            Mnemonic::DCL_RESOURCE_TEXTURE1D },
+	{ "dcl_resource_texture1darray",       Mnemonic::DCL_RESOURCE_TEXTURE1DARRAY },
+	{ "dcl_uav_typed_texture1d",           Mnemonic::DCL_UAV_TYPED_TEXTURE1D },
+	{ "dcl_uav_typed_texture1darray",      Mnemonic::DCL_UAV_TYPED_TEXTURE1DARRAY },
+	{ "dcl_resource_texture2d",            Mnemonic::DCL_RESOURCE_TEXTURE2D },
+	{ "dcl_uav_typed_buffer",              Mnemonic::DCL_UAV_TYPED_BUFFER },
+	{ "dcl_resource_texture3d",            Mnemonic::DCL_RESOURCE_TEXTURE3D },
+	{ "dcl_uav_typed_texture3d",           Mnemonic::DCL_UAV_TYPED_TEXTURE3D },
+	{ "dcl_resource_texturecube",          Mnemonic::DCL_RESOURCE_TEXTURECUBE },
+	{ "dcl_resource_texturecubearray",     Mnemonic::DCL_RESOURCE_TEXTURECUBEARRAY },
+	{ "dcl_resource_texture2darray",       Mnemonic::DCL_RESOURCE_TEXTURE2DARRAY },
+	{ "dcl_uav_typed_texture2d",           Mnemonic::DCL_UAV_TYPED_TEXTURE2D },
+	{ "dcl_uav_typed_texture2darray",      Mnemonic::DCL_UAV_TYPED_TEXTURE2DARRAY },
+	{ "dcl_resource_texture2dms",          Mnemonic::DCL_RESOURCE_TEXTURE2DMS },
+	{ "dcl_resource_texture2dmsarray",     Mnemonic::DCL_RESOURCE_TEXTURE2DMSARRAY },
+	{ "dcl_indexrange",                    Mnemonic::DCL_INDEXRANGE },
+	{ "dcl_temps",                         Mnemonic::DCL_TEMPS },
+	{ "dcl_resource_structured",           Mnemonic::DCL_RESOURCE_STRUCTURED },
+	{ "dcl_sampler",                       Mnemonic::DCL_SAMPLER },
+	{ "dcl_globalFlags",                   Mnemonic::DCL_GLOBALFLAGS },
+	{ "dcl_constantbuffer",                Mnemonic::DCL_CONSTANTBUFFER },
+	{ "dcl_output_sgv",                    Mnemonic::DCL_OUTPUT_SGV },
+	{ "dcl_output_siv",                    Mnemonic::DCL_OUTPUT_SIV },
+	{ "dcl_input_siv",                     Mnemonic::DCL_INPUT_SIV },
+	{ "dcl_input_sgv",                     Mnemonic::DCL_INPUT_SGV },
+	{ "dcl_input_ps",                      Mnemonic::DCL_INPUT_PS },
+	{ "dcl_input_ps_sgv",                  Mnemonic::DCL_INPUT_PS_SGV },
+	{ "dcl_input_ps_siv",                  Mnemonic::DCL_INPUT_PS_SIV },
+	{ "dcl_indexableTemp",                 Mnemonic::DCL_INDEXABLETEMP },
+	{ "dcl_immediateConstantBuffer",       Mnemonic::DCL_IMMEDIATECONSTANTBUFFER },
+	{ "dcl_tessellator_partitioning",      Mnemonic::DCL_TESSELLATOR_PARTITIONING },
+	{ "dcl_tessellator_output_primitive",  Mnemonic::DCL_TESSELLATOR_OUTPUT_PRIMITIVE },
+	{ "dcl_tessellator_domain",            Mnemonic::DCL_TESSELLATOR_DOMAIN },
+	{ "dcl_stream",                        Mnemonic::DCL_STREAM },
+	{ "emit_stream",                       Mnemonic::EMIT_STREAM },
+	{ "cut_stream",                        Mnemonic::CUT_STREAM },
+	{ "emit_then_cut_stream",              Mnemonic::EMIT_THEN_CUT_STREAM },
+	{ "dcl_outputtopology",                Mnemonic::DCL_OUTPUTTOPOLOGY },
+	{ "dcl_output_control_point_count",    Mnemonic::DCL_OUTPUT_CONTROL_POINT_COUNT },
+	{ "dcl_input_control_point_count",     Mnemonic::DCL_INPUT_CONTROL_POINT_COUNT },
+	{ "dcl_maxout",                        Mnemonic::DCL_MAXOUT },
+	{ "dcl_inputprimitive",                Mnemonic::DCL_INPUTPRIMITIVE },
+	{ "dcl_hs_max_tessfactor",             Mnemonic::DCL_HS_MAX_TESSFACTOR },
+	{ "dcl_hs_fork_phase_instance_count",  Mnemonic::DCL_HS_FORK_PHASE_INSTANCE_COUNT },
+	{ "samplepos",                         Mnemonic::SAMPLEPOS },
+	{ "printf",                            Mnemonic::PRINTF },
+	{ "errorf",                            Mnemonic::ERRORF },
+	{ "undecipherable",                    Mnemonic::UNDECIPHERABLE },
+};
+
+// Every mnemonic from the three tables above goes into one table indexed by
+// a perfect hash, so that identifying an instruction costs one hash of the
+// mnemonic and a single string compare, rather than hashing a copy of it
+// into each map in turn and comparing it against every special case.
+//
+// This uses the hash and displace scheme: the first hash of the mnemonic
+// picks a bucket, and each bucket has a displacement that is chosen while
+// building the table so that the second hash of every mnemonic in that
+// bucket lands in a slot of its own. The table is built the first time an
+// instruction is assembled, which only takes a few microseconds.
+
+#define MNEMONIC_BUCKETS 128
+#define MNEMONIC_SLOTS 512
+
+struct MnemonicDesc {
+	const char *name;
+	size_t len;
+	Mnemonic kind;
+	const InsInfo *ins;  // Mnemonic::GENERIC only
+	const LoadInfo *ld;  // Mnemonic::LOAD only
+};
+
+// FNV-1a
+static uint32_t mnemonicHash(const char *name, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+
+	return hash;
+}
+
+static uint32_t mnemonicSlot(uint32_t hash, uint32_t displacement)
+{
+	hash ^= displacement * 0x9e3779b9u;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+
+	return hash & (MNEMONIC_SLOTS - 1);
+}
+
+class MnemonicHashTable
+{
+public:
+	MnemonicHashTable()
+	{
+		vector<vector<const MnemonicDesc*>> buckets(MNEMONIC_BUCKETS);
+		vector<unsigned> order;
+		uint32_t slot[MNEMONIC_SLOTS];
+		uint32_t displacement;
+		size_t i, j;
+
+		for (auto &entry : insTable)
+			descs.push_back({ entry.name, strlen(entry.name), Mnemonic::GENERIC, &entry.info, NULL });
+		for (auto &entry : ldTable)
+			descs.push_back({ entry.name, strlen(entry.name), Mnemonic::LOAD, NULL, &entry.info });
+		for (auto &entry : specialTable)
+			descs.push_back({ entry.name, strlen(entry.name), entry.kind, NULL, NULL });
+
+		for (auto &desc : descs)
+			buckets[mnemonicHash(desc.name, desc.len) & (MNEMONIC_BUCKETS - 1)].push_back(&desc);
+
+		// Place the fullest buckets first, while there is the most room:
+		for (i = 0; i < MNEMONIC_BUCKETS; i++)
+			order.push_back((unsigned)i);
+		stable_sort(order.begin(), order.end(), [&buckets](unsigned a, unsigned b) {
+			return buckets[a].size() > buckets[b].size();
+		});
+
+		memset(displacements, 0, sizeof(displacements));
+		memset(slots, 0, sizeof(slots));
+
+		for (unsigned bucket : order) {
+			vector<const MnemonicDesc*> &keys = buckets[bucket];
+
+			for (displacement = 0; ; displacement++) {
+				// Two mnemonics with the same name would never fit:
+				if (displacement > 0xffff)
+					throw std::logic_error("assembler: Duplicate mnemonic");
+
+				for (i = 0; i < keys.size(); i++) {
+					slot[i] = mnemonicSlot(mnemonicHash(keys[i]->name, keys[i]->len), displacement);
+					if (slots[slot[i]])
+						break;
+					for (j = 0; j < i && slot[j] != slot[i]; j++) {}
+					if (j < i)
+						break;
+				}
+				if (i == keys.size())
+					break;
+			}
+
+			displacements[bucket] = (uint16_t)displacement;
+			for (i = 0; i < keys.size(); i++)
+				slots[slot[i]] = keys[i];
+		}
+	}
+
+	const MnemonicDesc* find(const char *name, size_t len) const
+	{
+		uint32_t hash = mnemonicHash(name, len);
+		const MnemonicDesc *desc;
+
+		desc = slots[mnemonicSlot(hash, displacements[hash & (MNEMONIC_BUCKETS - 1)])];
+		if (desc && desc->len == len && !memcmp(desc->name, name, len))
+			return desc;
+
+		return NULL;
+	}
+
+private:
+	vector<MnemonicDesc> descs;
+	uint16_t displacements[MNEMONIC_BUCKETS];
+	const MnemonicDesc *slots[MNEMONIC_SLOTS];
+};
+
+// We may be assembling shaders on several threads at once, so the table is
+// built with InitOnceExecuteOnce rather than as a function local static -
+// the thread safe initialisation of those relies on implicit TLS, which we
+// avoid in d3d11.dll (see the comment above struct TLS in globals.h):
+static INIT_ONCE mnemonicTableOnce = INIT_ONCE_STATIC_INIT;
+static MnemonicHashTable *mnemonicTable;
+
+static BOOL CALLBACK buildMnemonicTable(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+	mnemonicTable = new MnemonicHashTable();
+	return TRUE;
+}
+
+static const MnemonicDesc* lookupMnemonic(const char *name, size_t len)
+{
+	InitOnceExecuteOnce(&mnemonicTableOnce, buildMnemonicTable, NULL, NULL);
+
+	return mnemonicTable->find(name, len);
+}
+
+// Equivalent to o.find(modifier) where o = mnemonic.substr(0, len), without
+// the copy. The first match is the only one that can be within len:
+static size_t findModifier(const string &mnemonic, size_t len, const char *modifier)
+{
+	size_t pos = mnemonic.find(modifier);
+
+	if (pos == string::npos || pos + strlen(modifier) > len)
+		return string::npos;
+
+	return pos;
+}
+
 static void assembleResourceDeclarationType(string *type, vector<DWORD> *v)
 {
 	// The resource declarations all use the same format strings and
@@ -1417,7 +1738,7 @@ static string translate_string_operand(string &in)
 
 // Printf/errorf instructions can potentially allow us to extract data from the
 // shader when the debug layer is enabled, potentially making them quite valuable
-static vector<DWORD> assemble_printf(string &s, vector<DWORD> &v, vector<string> &w, bool errorf)
+static void assemble_printf(string &s, vector<DWORD> &v, vector<string> &w, bool errorf)
 {
 	shader_ins ins = {0};
 	ins.opcode = 0x35;
@@ -1452,11 +1773,9 @@ static vector<DWORD> assemble_printf(string &s, vector<DWORD> &v, vector<string>
 	v.resize(insLen);
 	v[1] = insLen;
 	memcpy((char*)v.data() + msgOff, msg.c_str(), msgLen);
-
-	return v;
 }
 
-static vector<DWORD> assemble_undecipherable_custom_data(string &s, vector<DWORD> &v, vector<string> &w)
+static void assemble_undecipherable_custom_data(string &s, vector<DWORD> &v, vector<string> &w)
 {
 	uint32_t numOps, word, i;
 
@@ -1474,18 +1793,25 @@ static vector<DWORD> assemble_undecipherable_custom_data(string &s, vector<DWORD
 		sscanf_s(w[i + 3].c_str(), "%x", &word);
 		v.push_back(word);
 	}
-
-	return v;
 }
 
-static vector<DWORD> assembleIns(string s)
+// Buffers reused from one instruction to the next while assembling a shader,
+// so that they only have to grow to fit the largest instruction rather than
+// being allocated for every line:
+struct AssemblerBuffers {
+	vector<string> words;
+	vector<DWORD> operand;
+	vector<DWORD> operands;
+	vector<DWORD> ins;
+};
+
+// Assembles the instruction into buf->ins. s may be modified.
+static void assembleIns(string &s, AssemblerBuffers *buf)
 {
+	vector<string> &w = buf->words;
+	vector<DWORD> &v = buf->ins;
 	unsigned msaa_samples = 0;
-
-	if (hackMap.find(s) != hackMap.end()) {
-		auto v = hackMap[s];
-		return v;
-	}
+	size_t orig_len = s.size();
 	DWORD op = 0;
 	shader_ins* ins = (shader_ins*)&op;
 	size_t pos = s.find("[precise");
@@ -1530,758 +1856,889 @@ static vector<DWORD> assembleIns(string s)
 		s.erase(pos, 9);
 		ins->_11_23 = 1;
 	}
-	vector<DWORD> v;
-	vector<string> w = strToWords(s);
-	string o = w[0];
-	if (o == "sampleinfo" && ins->_11_23 == 2)
+	v.clear();
+	strToWords(s, w);
+	if (w[0] == "sampleinfo" && ins->_11_23 == 2)
 		ins->_11_23 = 1;
+	// The mnemonic is the first o_len characters of the first word, up to
+	// any _opc, _sat or _glc modifier:
+	size_t o_len = w[0].size();
 	if (s.find("_opc") < s.size()) {
-		o = o.substr(0, o.find("_opc"));
+		pos = w[0].find("_opc");
+		if (pos != string::npos)
+			o_len = pos;
 		ins->_11_23 = 4096;
 	}
-	bool bNZ = o.find("_nz") < o.size();
-	bool bZ = o.find("_z") < o.size();
-	bool bSat = o.find("_sat") < o.size();
-	if (bSat) o = o.substr(0, o.find("_sat"));
-	bool bGlc = o.find("_glc") < o.size(); // Globally coherent UAV declaration
-	if (bGlc) o = o.substr(0, o.find("_glc"));
-
-	if (o == "hs_decls") {
-		check_num_ops(s, w, 0);
-		ins->opcode = 0x71;
-		ins->length = 1;
-		v.push_back(op);
-	} else if (o == "hs_fork_phase") {
-		check_num_ops(s, w, 0);
-		ins->opcode = 0x73;
-		ins->length = 1;
-		v.push_back(op);
-	} else if (o == "hs_join_phase") {
-		check_num_ops(s, w, 0);
-		ins->opcode = 0x74;
-		ins->length = 1;
-		v.push_back(op);
-	} else if (o == "hs_control_point_phase") {
-		check_num_ops(s, w, 0);
-		ins->opcode = 0x72;
-		ins->length = 1;
-		v.push_back(op);
-	} else if (o.substr(0, 3) == "ps_") {
-		check_num_ops(s, w, 0);
-		op = 0x00000;
-		op |= 16 * atoi(o.substr(3, 1).c_str());
-		op |= atoi(o.substr(5, 1).c_str());
-		v.push_back(op);
-	} else if (o.substr(0, 3) == "vs_") {
-		check_num_ops(s, w, 0);
-		op = 0x10000;
-		op |= 16 * atoi(o.substr(3, 1).c_str());
-		op |= atoi(o.substr(5, 1).c_str());
-		v.push_back(op);
-	} else if (o.substr(0, 3) == "gs_") {
-		check_num_ops(s, w, 0);
-		op = 0x20000;
-		op |= 16 * atoi(o.substr(3, 1).c_str());
-		op |= atoi(o.substr(5, 1).c_str());
-		v.push_back(op);
-	} else if (o.substr(0, 3) == "hs_") {
-		check_num_ops(s, w, 0);
-		op = 0x30000;
-		op |= 16 * atoi(o.substr(3, 1).c_str());
-		op |= atoi(o.substr(5, 1).c_str());
-		v.push_back(op);
-	} else if (o.substr(0, 3) == "ds_") {
-		check_num_ops(s, w, 0);
-		op = 0x40000;
-		op |= 16 * atoi(o.substr(3, 1).c_str());
-		op |= atoi(o.substr(5, 1).c_str());
-		v.push_back(op);
-	} else if (o.substr(0, 3) == "cs_") {
-		check_num_ops(s, w, 0);
-		op = 0x50000;
-		op |= 16 * atoi(o.substr(3, 1).c_str());
-		op |= atoi(o.substr(5, 1).c_str());
-		v.push_back(op);
-	} else if (w[0].substr(0, 4) == "sync") {
-		ins->opcode = 0xbe;
-		check_num_ops(s, w, 0);
-		ins->_11_23 = parseSyncFlags(&w[0]);
-		ins->length = 1;
-		v.push_back(op);
-	} else if (w[0] == "store_uav_typed") {
-		ins->opcode = 0x86;
-		int numOps = 3;
-		check_num_ops(s, w, numOps);
-		if (w[1][0] == 'u') {
-			ins->opcode = 0xa4;
-		}
-		vector<vector<DWORD>> Os;
-		int numSpecial = 1;
-		for (int i = 0; i < numOps; i++)
-			Os.push_back(assembleOp(w[i + 1], i < numSpecial));
-		ins->length = 1;
-		for (int i = 0; i < numOps; i++)
-			ins->length += (int)Os[i].size();
-		v.push_back(op);
-		for (int i = 0; i < numOps; i++)
-			v.insert(v.end(), Os[i].begin(), Os[i].end());
-	} else if (insMap.find(o) != insMap.end()) {
-		vector<int> vIns = insMap[o];
-		int numOps = vIns[0];
-		check_num_ops(s, w, numOps);
-		vector<vector<DWORD>> Os;
-		int numSpecial = 1;
-		if (vIns.size() > 2)
-			numSpecial = vIns[2];
-		for (int i = 0; i < numOps; i++)
-			Os.push_back(assembleOp(w[i + 1], i < numSpecial));
-		ins->opcode = vIns[1];
-		if (bSat)
-			ins->_11_23 |= 0x04;
-		if (bNZ)
-			ins->_11_23 |= 0x80;
-		if (bZ)
-			ins->_11_23 |= 0x00;
-		if (bGlc)
-			ins->_11_23 |= 0x20;
-		ins->length = 1;
-		for (int i = 0; i < numOps; i++)
-			ins->length += (int)Os[i].size();
-		v.push_back(op);
-		for (int i = 0; i < numOps; i++)
-			v.insert(v.end(), Os[i].begin(), Os[i].end());
-	} else if (ldMap.find(o) != ldMap.end()) {
-		vector<int> vIns = ldMap[o];
-		int numOps = vIns[0];
-		vector<vector<DWORD>> Os;
-		int startPos = 1 + (vIns[2] & 3);
-		//startPos = w.size() - numOps;
-		check_num_ops(s, w, startPos + numOps - 1);
-		for (int i = 0; i < numOps; i++)
-			Os.push_back(assembleOp(w[i + startPos], i == 0));
-		ins->opcode = vIns[1];
-		ins->length = 1 + (vIns[2] & 3);
-		ins->extended = 1;
-		for (int i = 0; i < numOps; i++)
-			ins->length += (int)Os[i].size();
-		v.push_back(op);
-		if (vIns[2] == 3)
-			v.push_back(parseAoffimmi(0x80000001, w[1]));
-		if (vIns[2] == 1)
-			v.push_back(parseAoffimmi(1, w[1]));
-		if (vIns[2] & 2) {
-			int c = 1;
-			if (vIns[2] == 3)
-				c = 2;
-			if (w[c] == "(texture1d)")
-				v.push_back(0x80000082);
-			if (w[c] == "(texture1darray)")
-				v.push_back(0x800001C2);
-			if (w[c] == "(texture2d)")
-				v.push_back(0x800000C2);
-			if (w[c] == "(texture2dms)")
-				v.push_back(0x80000102);
-			if (w[c] == "(texture2dmsarray)")
-				v.push_back(0x80000242);
-			if (w[c] == "(texture3d)")
-				v.push_back(0x80000142);
-			if (w[c] == "(texture2darray)")
-				v.push_back(0x80000202);
-			if (w[c] == "(texturecube)")
-				v.push_back(0x80000182);
-			if (w[c] == "(texturecubearray)")
-				v.push_back(0x80000282);
-			if (w[c] == "(buffer)")
-				v.push_back(0x80000042);
-			if (w[c] == "(raw_buffer)")
-				v.push_back(0x800002C2);
-			if (w[1].find("stride") != string::npos) {
-				string stride = w[1].substr(27);
-				stride = stride.substr(0, stride.size() - 1);
-				DWORD d = 0x80000302;
-				d += atoi(stride.c_str()) << 11;
-				v.push_back(d);
+	bool bNZ = findModifier(w[0], o_len, "_nz") != string::npos;
+	bool bZ = findModifier(w[0], o_len, "_z") != string::npos;
+	pos = findModifier(w[0], o_len, "_sat");
+	bool bSat = pos != string::npos;
+	if (bSat) o_len = pos;
+	pos = findModifier(w[0], o_len, "_glc");
+	bool bGlc = pos != string::npos; // Globally coherent UAV declaration
+	if (bGlc) o_len = pos;
+	const MnemonicDesc *mnemonic = lookupMnemonic(w[0].c_str(), o_len);
+
+	// The version tokens and sync flags are part of the mnemonic, so these
+	// are matched on their prefix instead:
+	if (!mnemonic) {
+		string o = w[0].substr(0, o_len);
+		if (o.substr(0, 3) == "ps_") {
+			check_num_ops(s, w, 0);
+			op = 0x00000;
+			op |= 16 * atoi(o.substr(3, 1).c_str());
+			op |= atoi(o.substr(5, 1).c_str());
+			v.push_back(op);
+		} else if (o.substr(0, 3) == "vs_") {
+			check_num_ops(s, w, 0);
+			op = 0x10000;
+			op |= 16 * atoi(o.substr(3, 1).c_str());
+			op |= atoi(o.substr(5, 1).c_str());
+			v.push_back(op);
+		} else if (o.substr(0, 3) == "gs_") {
+			check_num_ops(s, w, 0);
+			op = 0x20000;
+			op |= 16 * atoi(o.substr(3, 1).c_str());
+			op |= atoi(o.substr(5, 1).c_str());
+			v.push_back(op);
+		} else if (o.substr(0, 3) == "hs_") {
+			check_num_ops(s, w, 0);
+			op = 0x30000;
+			op |= 16 * atoi(o.substr(3, 1).c_str());
+			op |= atoi(o.substr(5, 1).c_str());
+			v.push_back(op);
+		} else if (o.substr(0, 3) == "ds_") {
+			check_num_ops(s, w, 0);
+			op = 0x40000;
+			op |= 16 * atoi(o.substr(3, 1).c_str());
+			op |= atoi(o.substr(5, 1).c_str());
+			v.push_back(op);
+		} else if (o.substr(0, 3) == "cs_") {
+			check_num_ops(s, w, 0);
+			op = 0x50000;
+			op |= 16 * atoi(o.substr(3, 1).c_str());
+			op |= atoi(o.substr(5, 1).c_str());
+			v.push_back(op);
+		} else if (w[0].substr(0, 4) == "sync") {
+			ins->opcode = 0xbe;
+			check_num_ops(s, w, 0);
+			ins->_11_23 = parseSyncFlags(&w[0]);
+			ins->length = 1;
+			v.push_back(op);
+		} else {
+			throw AssemblerParseError(s, "Unrecognised instruction");
+		}
+		return;
+	}
+
+	switch (mnemonic->kind) {
+		case Mnemonic::HS_DECLS:
+			check_num_ops(s, w, 0);
+			ins->opcode = 0x71;
+			ins->length = 1;
+			v.push_back(op);
+			break;
+		case Mnemonic::HS_FORK_PHASE:
+			check_num_ops(s, w, 0);
+			ins->opcode = 0x73;
+			ins->length = 1;
+			v.push_back(op);
+			break;
+		case Mnemonic::HS_JOIN_PHASE:
+			check_num_ops(s, w, 0);
+			ins->opcode = 0x74;
+			ins->length = 1;
+			v.push_back(op);
+			break;
+		case Mnemonic::HS_CONTROL_POINT_PHASE:
+			check_num_ops(s, w, 0);
+			ins->opcode = 0x72;
+			ins->length = 1;
+			v.push_back(op);
+			break;
+		case Mnemonic::STORE_UAV_TYPED: {
+			// Only recognised without modifiers:
+			if (o_len != w[0].size())
+				throw AssemblerParseError(s, "Unrecognised instruction");
+			ins->opcode = 0x86;
+			int numOps = 3;
+			check_num_ops(s, w, numOps);
+			if (w[1][0] == 'u') {
+				ins->opcode = 0xa4;
 			}
-			if (w[startPos - 1] == "(float,float,float,float)")
-				v.push_back(0x00155543);
-			if (w[startPos - 1] == "(uint,uint,uint,uint)")
-				v.push_back(0x00111103);
-			if (w[startPos - 1] == "(sint,sint,sint,sint)")
-				v.push_back(0x000CCCC3);
-			if (w[startPos - 1] == "(mixed,mixed,mixed,mixed)")
-				v.push_back(0x00199983);
-			if (w[startPos - 1] == "(unorm,unorm,unorm,unorm)")
-				v.push_back(0x00044443);
-			// Added snorm and double types -DarkStarSword
-			if (w[startPos - 1] == "(snorm,snorm,snorm,snorm)")
-				v.push_back(0x00088883);
-			if (w[startPos - 1] == "(double,<continued>,<unused>,<unused>)")
-				v.push_back(0x002661c3);
-			if (w[startPos - 1] == "(double,<continued>,double,<continued>)")
-				v.push_back(0x0021e1c3);
-		}
-		for (int i = 0; i < numOps; i++)
-			v.insert(v.end(), Os[i].begin(), Os[i].end());
-	} else if (o == "dcl_input") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1], 1);
-		ins->opcode = 0x5f;
-		ins->length = 1 + os.size();
-		// Should sort special value for text constants.
-		if ((os[0] & 0xFF0) == 0)
-			os[0] -= 1;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_output") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1], 1);
-		ins->opcode = 0x65;
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_resource_raw") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0xa1;
-		ins->length = 3;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_resource_buffer") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x58;
-		ins->_11_23 = 1;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_resource_texture1d") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x58;
-		ins->_11_23 = 2;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_resource_texture1darray") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x58;
-		ins->_11_23 = 7;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_uav_typed_texture1d") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x9c;
-		ins->_11_23 = 2;
-		if (bGlc)
-			ins->_11_23 |= 0x20;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_uav_typed_texture1darray") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x9c;
-		ins->_11_23 = 7;
-		if (bGlc)
-			ins->_11_23 |= 0x20;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_resource_texture2d") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x58;
-		ins->_11_23 = 3;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_uav_typed_buffer") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x9c;
-		ins->_11_23 = 1;
-		if (bGlc)
-			ins->_11_23 |= 0x20;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_resource_texture3d") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x58;
-		ins->_11_23 = 5;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_uav_typed_texture3d") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x9c;
-		ins->_11_23 = 5;
-		if (bGlc)
-			ins->_11_23 |= 0x20;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_resource_texturecube") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x58;
-		ins->_11_23 = 6;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_resource_texturecubearray") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x58;
-		ins->_11_23 = 10;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_resource_texture2darray") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x58;
-		ins->_11_23 = 8;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_uav_typed_texture2d") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x9c;
-		ins->_11_23 = 3;
-		if (bGlc)
-			ins->_11_23 |= 0x20;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_uav_typed_texture2darray") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[2]);
-		ins->opcode = 0x9c;
-		ins->_11_23 = 8;
-		if (bGlc)
-			ins->_11_23 |= 0x20;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[1], &v);
-	} else if (o == "dcl_resource_texture2dms") {
-		check_num_ops(s, w, 3);
-		vector<DWORD> os = assembleOp(w[3]);
-		ins->opcode = 0x58;
-		// Changed this to calculate the value rather than hard coding
-		// a small handful of values that we've seen. -DarkStarSword
-		sscanf_s(w[1].c_str(), "(%d)", &msaa_samples);
-		ins->_11_23 = (msaa_samples << 5) | 4;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[2], &v);
-	} else if (o == "dcl_resource_texture2dmsarray") {
-		check_num_ops(s, w, 3);
-		vector<DWORD> os = assembleOp(w[3]);
-		ins->opcode = 0x58;
-		// Changed this to calculate the value rather than hard coding
-		// a small handful of values that we've seen. -DarkStarSword
-		sscanf_s(w[1].c_str(), "(%d)", &msaa_samples);
-		ins->_11_23 = (msaa_samples << 5) | 9;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		assembleResourceDeclarationType(&w[2], &v);
-	} else if (o == "dcl_indexrange") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[1], true);
-		ins->opcode = 0x5b;
-		ins->length = 2 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		v.push_back(atoi(w[2].c_str()));
-	} else if (o == "dcl_temps") {
-		ins->opcode = 0x68;
-		ins->length = 2;
-		v.push_back(op);
-		check_num_ops(s, w, 1);
-		v.push_back(atoi(w[1].c_str()));
-	} else if (o == "dcl_resource_structured") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0xa2;
-		ins->length = 4;
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-		v.push_back(atoi(w[2].c_str()));
-	} else if (o == "dcl_sampler") {
-		check_num_ops(s, w, 1, 2);
-		vector<DWORD> os = assembleOp(w[1]);
-		os[0] = 0x106000;
-		ins->opcode = 0x5a;
-		if (w.size() > 2) {
-			if (w[2] == "mode_default") {
-				ins->_11_23 = 0;
-			} else if (w[2] == "mode_comparison") {
-				ins->_11_23 = 1;
+			int numSpecial = 1;
+			v.push_back(0); // Filled in below
+			for (int i = 0; i < numOps; i++) {
+				assembleOp(w[i + 1], i < numSpecial, buf->operand);
+				v.insert(v.end(), buf->operand.begin(), buf->operand.end());
 			}
+			ins->length = (int)v.size();
+			v[0] = op;
+			break;
 		}
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_globalFlags") {
-		ins->opcode = 0x6a;
-		ins->length = 1;
-		ins->_11_23 = 0;
-		for (unsigned i = 1; i < w.size(); i += 2) {
-			// Changed this to use a loop rather than parsing a
-			// fixed number of arguments. Added double precision,
-			// minimum precision, skipOptimization and 11.1 shader
-			// extension flags.
-			// FIXME: Missing D3D_SHADER_REQUIRES_UAVS_AT_EVERY_STAGE
-			// FIXME: Missing D3D_SHADER_REQUIRES_64_UAVS
-			// FIXME: Missing D3D_SHADER_REQUIRES_LEVEL_9_COMPARISON_FILTERING
-			// FIXME: Missing D3D_SHADER_REQUIRES_TILED_RESOURCES
-			//   - https://docs.microsoft.com/en-gb/windows/desktop/api/d3d11shader/nf-d3d11shader-id3d11shaderreflection-getrequiresflags
-			//   -DarkStarSword
-			string s = w[i];
-			if (s == "refactoringAllowed")
-				ins->_11_23 |= 0x01;
-			if (s == "enableDoublePrecisionFloatOps")
-				ins->_11_23 |= 0x02;
-			if (s == "forceEarlyDepthStencil")
+		case Mnemonic::GENERIC: {
+			const InsInfo *vIns = mnemonic->ins;
+			int numOps = vIns->numOps;
+			check_num_ops(s, w, numOps);
+			int numSpecial = vIns->numSpecial;
+			v.push_back(0); // Filled in below
+			for (int i = 0; i < numOps; i++) {
+				assembleOp(w[i + 1], i < numSpecial, buf->operand);
+				v.insert(v.end(), buf->operand.begin(), buf->operand.end());
+			}
+			ins->opcode = vIns->opcode;
+			if (bSat)
 				ins->_11_23 |= 0x04;
-			if (s == "enableRawAndStructuredBuffers")
-				ins->_11_23 |= 0x08;
-			if (s == "skipOptimization")
-				ins->_11_23 |= 0x10;
-			if (s == "enableMinimumPrecision")
-				ins->_11_23 |= 0x20;
-			if (s == "enable11_1DoubleExtensions")
-				ins->_11_23 |= 0x40;
-			if (s == "enable11_1ShaderExtensions")
+			if (bNZ)
 				ins->_11_23 |= 0x80;
+			if (bZ)
+				ins->_11_23 |= 0x00;
+			if (bGlc)
+				ins->_11_23 |= 0x20;
+			ins->length = (int)v.size();
+			v[0] = op;
+			break;
 		}
-		v.push_back(op);
-	} else if (o == "dcl_constantbuffer") {
-		check_num_ops(s, w, 1, 2);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x59;
-		if (w.size() > 2) {
-			if (w[2] == "dynamicIndexed")
-				ins->_11_23 = 1;
-			else if (w[2] == "immediateIndexed")
-				ins->_11_23 = 0;
+		case Mnemonic::LOAD: {
+			const LoadInfo *vIns = mnemonic->ld;
+			int numOps = vIns->numOps;
+			vector<DWORD> &Os = buf->operands;
+			int startPos = 1 + (vIns->variant & 3);
+			//startPos = w.size() - numOps;
+			check_num_ops(s, w, startPos + numOps - 1);
+			Os.clear();
+			for (int i = 0; i < numOps; i++) {
+				assembleOp(w[i + startPos], i == 0, buf->operand);
+				Os.insert(Os.end(), buf->operand.begin(), buf->operand.end());
+			}
+			ins->opcode = vIns->opcode;
+			ins->length = 1 + (vIns->variant & 3) + (int)Os.size();
+			ins->extended = 1;
+			v.push_back(op);
+			if (vIns->variant == 3)
+				v.push_back(parseAoffimmi(0x80000001, w[1]));
+			if (vIns->variant == 1)
+				v.push_back(parseAoffimmi(1, w[1]));
+			if (vIns->variant & 2) {
+				int c = 1;
+				if (vIns->variant == 3)
+					c = 2;
+				if (w[c] == "(texture1d)")
+					v.push_back(0x80000082);
+				if (w[c] == "(texture1darray)")
+					v.push_back(0x800001C2);
+				if (w[c] == "(texture2d)")
+					v.push_back(0x800000C2);
+				if (w[c] == "(texture2dms)")
+					v.push_back(0x80000102);
+				if (w[c] == "(texture2dmsarray)")
+					v.push_back(0x80000242);
+				if (w[c] == "(texture3d)")
+					v.push_back(0x80000142);
+				if (w[c] == "(texture2darray)")
+					v.push_back(0x80000202);
+				if (w[c] == "(texturecube)")
+					v.push_back(0x80000182);
+				if (w[c] == "(texturecubearray)")
+					v.push_back(0x80000282);
+				if (w[c] == "(buffer)")
+					v.push_back(0x80000042);
+				if (w[c] == "(raw_buffer)")
+					v.push_back(0x800002C2);
+				if (w[1].find("stride") != string::npos) {
+					string stride = w[1].substr(27);
+					stride = stride.substr(0, stride.size() - 1);
+					DWORD d = 0x80000302;
+					d += atoi(stride.c_str()) << 11;
+					v.push_back(d);
+				}
+				if (w[startPos - 1] == "(float,float,float,float)")
+					v.push_back(0x00155543);
+				if (w[startPos - 1] == "(uint,uint,uint,uint)")
+					v.push_back(0x00111103);
+				if (w[startPos - 1] == "(sint,sint,sint,sint)")
+					v.push_back(0x000CCCC3);
+				if (w[startPos - 1] == "(mixed,mixed,mixed,mixed)")
+					v.push_back(0x00199983);
+				if (w[startPos - 1] == "(unorm,unorm,unorm,unorm)")
+					v.push_back(0x00044443);
+				// Added snorm and double types -DarkStarSword
+				if (w[startPos - 1] == "(snorm,snorm,snorm,snorm)")
+					v.push_back(0x00088883);
+				if (w[startPos - 1] == "(double,<continued>,<unused>,<unused>)")
+					v.push_back(0x002661c3);
+				if (w[startPos - 1] == "(double,<continued>,double,<continued>)")
+					v.push_back(0x0021e1c3);
+			}
+			v.insert(v.end(), Os.begin(), Os.end());
+			break;
 		}
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_output_sgv") {
-		// Added and verified. Used when writing to SV_IsFrontFace in a
-		// geometry shader. -DarkStarSword
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[1], true);
-		ins->opcode = 0x66;
-		assembleSystemValue(&w[2], &os);
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_output_siv") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[1], true);
-		ins->opcode = 0x67;
-		assembleSystemValue(&w[2], &os);
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_input_siv") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[1], true);
-		ins->opcode = 0x61;
-		assembleSystemValue(&w[2], &os);
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_input_sgv") {
-		check_num_ops(s, w, 2);
-		vector<DWORD> os = assembleOp(w[1], true);
-		ins->opcode = 0x60;
-		assembleSystemValue(&w[2], &os);
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_input_ps") {
-		vector<DWORD> os;
-		ins->opcode = 0x62;
-		// Switched to use common interpolation mode parsing to catch
-		// more variants -DarkStarSword
-		ins->_11_23 = interpolationMode(w, 0); // FIXME: Default?
-		os = assembleOp(w[w.size() - 1], true);
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_input_ps_sgv") {
-		// Fixed for d3dcompiler_47 disassembly that includes an
-		// interpolationMode missing from d3dcompiler_46 disassembly
-		// e.g.
-		// d3dcompiler_46: dcl_input_ps_sgv v6.x, is_front_face
-		// d3dcompiler_47: dcl_input_ps_sgv constant v6.x, is_front_face
-		//   -DarkStarSword
-		check_num_ops(s, w, 2, 5);
-		vector<DWORD> os = assembleOp(w[w.size() - 2], true);
-		ins->opcode = 0x63;
-		ins->_11_23 = interpolationMode(w, 1);
-		if (w.size() > 2)
-			assembleSystemValue(&w[w.size() - 1], &os);
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_input_ps_siv") {
-		vector<DWORD> os;
-		ins->opcode = 0x64;
-		// Switched to use common interpolation mode parsing (fixes
-		// missing linear noperspective sample case in WATCH_DOGS2) and
-		// system value parsing (fixes missing viewport_array_index)
-		//   -DarkStarSword
-		check_num_ops(s, w, 2, 5);
-		ins->_11_23 = interpolationMode(w, 0); // FIXME: Default?
-		os = assembleOp(w[w.size() - 2], true);
-		assembleSystemValue(&w[w.size() - 1], &os);
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_indexableTemp") {
-		check_num_ops(s, w, 2);
-		string s1 = w[1].erase(0, 1);
-		string s2 = s1.substr(0, s1.find('['));
-		string s3 = s1.substr(s1.find('[') + 1);
-		s3.erase(s3.end() - 1, s3.end());
-		ins->opcode = 0x69;
-		ins->length = 4;
-		v.push_back(op);
-		v.push_back(atoi(s2.c_str()));
-		v.push_back(atoi(s3.c_str()));
-		v.push_back(atoi(w[2].c_str()));
-	} else if (o == "dcl_immediateConstantBuffer") {
-		vector<DWORD> os;
-		ins->opcode = 0x35;
-		ins->_11_23 = 3;
-		ins->length = 0;
-		DWORD length = 2;
-		DWORD offset = 3;
-		// The modulus here is by 5, matching the below offset += 5
-		if ((w.size() - offset) % 5 != 0)
-			throw AssemblerParseError(s, "Immediate Constant Buffer must have a multiple of four values");
-		while (offset < w.size()) {
-			string s1 = w[offset + 0];
-			s1 = s1.substr(0, s1.find(','));
-			string s2 = w[offset + 1];
-			s2 = s2.substr(0, s2.find(','));
-			string s3 = w[offset + 2];
-			s3 = s3.substr(0, s3.find(','));
-			string s4 = w[offset + 3];
-			s4 = s4.substr(0, s4.find('}'));
-			os.push_back(strToDWORD(s1));
-			os.push_back(strToDWORD(s2));
-			os.push_back(strToDWORD(s3));
-			os.push_back(strToDWORD(s4));
-			length += 4;
-			offset += 5;
-		}
-		v.push_back(op);
-		v.push_back(length);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_tessellator_partitioning") {
-		ins->opcode = 0x96;
-		ins->length = 1;
-		check_num_ops(s, w, 1);
-		if (w[1] == "partitioning_integer")
-			ins->_11_23 = 1;
-		else if (w[1] == "partitioning_pow2")
-			ins->_11_23 = 2;
-		else if (w[1] == "partitioning_fractional_odd")
-			ins->_11_23 = 3;
-		else if (w[1] == "partitioning_fractional_even")
-			ins->_11_23 = 4;
-		// Added pow2 -DarkStarSword
-		// https://msdn.microsoft.com/en-us/library/windows/desktop/ff471446(v=vs.85).aspx
-		v.push_back(op);
-	} else if (o == "dcl_tessellator_output_primitive") {
-		ins->opcode = 0x97;
-		ins->length = 1;
-		check_num_ops(s, w, 1);
-		if (w[1] == "output_point")
+		case Mnemonic::DCL_INPUT: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1], 1);
+			ins->opcode = 0x5f;
+			ins->length = 1 + os.size();
+			// Should sort special value for text constants.
+			if ((os[0] & 0xFF0) == 0)
+				os[0] -= 1;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_OUTPUT: {
+			// Only if none of the modifiers above were erased from s:
+			if (s.size() == orig_len) {
+				auto hack = hackMap.find(s);
+				if (hack != hackMap.end()) {
+					v = hack->second;
+					return;
+				}
+			}
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1], 1);
+			ins->opcode = 0x65;
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_RAW: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0xa1;
+			ins->length = 3;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_BUFFER: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x58;
 			ins->_11_23 = 1;
-		else if (w[1] == "output_line")
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURE1D: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x58;
 			ins->_11_23 = 2;
-		else if (w[1] == "output_triangle_cw")
-			ins->_11_23 = 3;
-		else if (w[1] == "output_triangle_ccw")
-			ins->_11_23 = 4;
-		// Added output_point -DarkStarSword
-		// https://msdn.microsoft.com/en-us/library/windows/desktop/ff471445(v=vs.85).aspx
-		v.push_back(op);
-	} else if (o == "dcl_tessellator_domain") {
-		ins->opcode = 0x95;
-		ins->length = 1;
-		check_num_ops(s, w, 1);
-		if (w[1] == "domain_isoline")
-			ins->_11_23 = 1;
-		else if (w[1] == "domain_tri")
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURE1DARRAY: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x58;
+			ins->_11_23 = 7;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_UAV_TYPED_TEXTURE1D: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x9c;
 			ins->_11_23 = 2;
-		else if (w[1] == "domain_quad")
+			if (bGlc)
+				ins->_11_23 |= 0x20;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_UAV_TYPED_TEXTURE1DARRAY: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x9c;
+			ins->_11_23 = 7;
+			if (bGlc)
+				ins->_11_23 |= 0x20;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURE2D: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x58;
 			ins->_11_23 = 3;
-		v.push_back(op);
-	} else if (o == "dcl_stream") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x8f;
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "emit_stream") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x75;
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "cut_stream") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x76;
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "emit_then_cut_stream") {
-		// Partially verified - assembled & disassembled OK, but did not
-		// check against compiled shader as fxc never generates this
-		//   -DarkStarSword
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x77;
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_outputtopology") {
-		ins->opcode = 0x5c;
-		ins->length = 1;
-		check_num_ops(s, w, 1);
-		if (w[1] == "pointlist")
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_UAV_TYPED_BUFFER: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x9c;
 			ins->_11_23 = 1;
-		else if (w[1] == "trianglestrip")
+			if (bGlc)
+				ins->_11_23 |= 0x20;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURE3D: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x58;
+			ins->_11_23 = 5;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_UAV_TYPED_TEXTURE3D: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x9c;
 			ins->_11_23 = 5;
-		else if (w[1] == "linestrip")
+			if (bGlc)
+				ins->_11_23 |= 0x20;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURECUBE: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x58;
+			ins->_11_23 = 6;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURECUBEARRAY: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x58;
+			ins->_11_23 = 10;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURE2DARRAY: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x58;
+			ins->_11_23 = 8;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_UAV_TYPED_TEXTURE2D: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x9c;
 			ins->_11_23 = 3;
-		// Added point list -DarkStarSword
-		// https://msdn.microsoft.com/en-us/library/windows/desktop/bb509661(v=vs.85).aspx
-		v.push_back(op);
-	} else if (o == "dcl_output_control_point_count") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x94;
-		ins->_11_23 = os[0];
-		ins->length = 1;
-		v.push_back(op);
-	} else if (o == "dcl_input_control_point_count") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x93;
-		ins->_11_23 = os[0];
-		ins->length = 1;
-		v.push_back(op);
-	} else if (o == "dcl_maxout") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x5e;
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "dcl_inputprimitive") {
-		ins->opcode = 0x5d;
-		ins->length = 1;
-		check_num_ops(s, w, 1);
-		if (w[1] == "point")
-			ins->_11_23 = 1;
-		else if (w[1] == "line")
-			ins->_11_23 = 2;
-		else if (w[1] == "triangle")
+			if (bGlc)
+				ins->_11_23 |= 0x20;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_UAV_TYPED_TEXTURE2DARRAY: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[2]);
+			ins->opcode = 0x9c;
+			ins->_11_23 = 8;
+			if (bGlc)
+				ins->_11_23 |= 0x20;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[1], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURE2DMS: {
+			check_num_ops(s, w, 3);
+			vector<DWORD> os = assembleOp(w[3]);
+			ins->opcode = 0x58;
+			// Changed this to calculate the value rather than hard coding
+			// a small handful of values that we've seen. -DarkStarSword
+			sscanf_s(w[1].c_str(), "(%d)", &msaa_samples);
+			ins->_11_23 = (msaa_samples << 5) | 4;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[2], &v);
+			break;
+		}
+		case Mnemonic::DCL_RESOURCE_TEXTURE2DMSARRAY: {
+			check_num_ops(s, w, 3);
+			vector<DWORD> os = assembleOp(w[3]);
+			ins->opcode = 0x58;
+			// Changed this to calculate the value rather than hard coding
+			// a small handful of values that we've seen. -DarkStarSword
+			sscanf_s(w[1].c_str(), "(%d)", &msaa_samples);
+			ins->_11_23 = (msaa_samples << 5) | 9;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			assembleResourceDeclarationType(&w[2], &v);
+			break;
+		}
+		case Mnemonic::DCL_INDEXRANGE: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[1], true);
+			ins->opcode = 0x5b;
+			ins->length = 2 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			v.push_back(atoi(w[2].c_str()));
+			break;
+		}
+		case Mnemonic::DCL_TEMPS:
+			ins->opcode = 0x68;
+			ins->length = 2;
+			v.push_back(op);
+			check_num_ops(s, w, 1);
+			v.push_back(atoi(w[1].c_str()));
+			break;
+		case Mnemonic::DCL_RESOURCE_STRUCTURED: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0xa2;
+			ins->length = 4;
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			v.push_back(atoi(w[2].c_str()));
+			break;
+		}
+		case Mnemonic::DCL_SAMPLER: {
+			check_num_ops(s, w, 1, 2);
+			vector<DWORD> os = assembleOp(w[1]);
+			os[0] = 0x106000;
+			ins->opcode = 0x5a;
+			if (w.size() > 2) {
+				if (w[2] == "mode_default") {
+					ins->_11_23 = 0;
+				} else if (w[2] == "mode_comparison") {
+					ins->_11_23 = 1;
+				}
+			}
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_GLOBALFLAGS:
+			ins->opcode = 0x6a;
+			ins->length = 1;
+			ins->_11_23 = 0;
+			for (unsigned i = 1; i < w.size(); i += 2) {
+				// Changed this to use a loop rather than parsing a
+				// fixed number of arguments. Added double precision,
+				// minimum precision, skipOptimization and 11.1 shader
+				// extension flags.
+				// FIXME: Missing D3D_SHADER_REQUIRES_UAVS_AT_EVERY_STAGE
+				// FIXME: Missing D3D_SHADER_REQUIRES_64_UAVS
+				// FIXME: Missing D3D_SHADER_REQUIRES_LEVEL_9_COMPARISON_FILTERING
+				// FIXME: Missing D3D_SHADER_REQUIRES_TILED_RESOURCES
+				//   - https://docs.microsoft.com/en-gb/windows/desktop/api/d3d11shader/nf-d3d11shader-id3d11shaderreflection-getrequiresflags
+				//   -DarkStarSword
+				string s = w[i];
+				if (s == "refactoringAllowed")
+					ins->_11_23 |= 0x01;
+				if (s == "enableDoublePrecisionFloatOps")
+					ins->_11_23 |= 0x02;
+				if (s == "forceEarlyDepthStencil")
+					ins->_11_23 |= 0x04;
+				if (s == "enableRawAndStructuredBuffers")
+					ins->_11_23 |= 0x08;
+				if (s == "skipOptimization")
+					ins->_11_23 |= 0x10;
+				if (s == "enableMinimumPrecision")
+					ins->_11_23 |= 0x20;
+				if (s == "enable11_1DoubleExtensions")
+					ins->_11_23 |= 0x40;
+				if (s == "enable11_1ShaderExtensions")
+					ins->_11_23 |= 0x80;
+			}
+			v.push_back(op);
+			break;
+		case Mnemonic::DCL_CONSTANTBUFFER: {
+			check_num_ops(s, w, 1, 2);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x59;
+			if (w.size() > 2) {
+				if (w[2] == "dynamicIndexed")
+					ins->_11_23 = 1;
+				else if (w[2] == "immediateIndexed")
+					ins->_11_23 = 0;
+			}
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_OUTPUT_SGV: {
+			// Added and verified. Used when writing to SV_IsFrontFace in a
+			// geometry shader. -DarkStarSword
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[1], true);
+			ins->opcode = 0x66;
+			assembleSystemValue(&w[2], &os);
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_OUTPUT_SIV: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[1], true);
+			ins->opcode = 0x67;
+			assembleSystemValue(&w[2], &os);
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_INPUT_SIV: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[1], true);
+			ins->opcode = 0x61;
+			assembleSystemValue(&w[2], &os);
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_INPUT_SGV: {
+			check_num_ops(s, w, 2);
+			vector<DWORD> os = assembleOp(w[1], true);
+			ins->opcode = 0x60;
+			assembleSystemValue(&w[2], &os);
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_INPUT_PS: {
+			vector<DWORD> os;
+			ins->opcode = 0x62;
+			// Switched to use common interpolation mode parsing to catch
+			// more variants -DarkStarSword
+			ins->_11_23 = interpolationMode(w, 0); // FIXME: Default?
+			os = assembleOp(w[w.size() - 1], true);
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_INPUT_PS_SGV: {
+			// Fixed for d3dcompiler_47 disassembly that includes an
+			// interpolationMode missing from d3dcompiler_46 disassembly
+			// e.g.
+			// d3dcompiler_46: dcl_input_ps_sgv v6.x, is_front_face
+			// d3dcompiler_47: dcl_input_ps_sgv constant v6.x, is_front_face
+			//   -DarkStarSword
+			check_num_ops(s, w, 2, 5);
+			vector<DWORD> os = assembleOp(w[w.size() - 2], true);
+			ins->opcode = 0x63;
+			ins->_11_23 = interpolationMode(w, 1);
+			if (w.size() > 2)
+				assembleSystemValue(&w[w.size() - 1], &os);
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_INPUT_PS_SIV: {
+			vector<DWORD> os;
+			ins->opcode = 0x64;
+			// Switched to use common interpolation mode parsing (fixes
+			// missing linear noperspective sample case in WATCH_DOGS2) and
+			// system value parsing (fixes missing viewport_array_index)
+			//   -DarkStarSword
+			check_num_ops(s, w, 2, 5);
+			ins->_11_23 = interpolationMode(w, 0); // FIXME: Default?
+			os = assembleOp(w[w.size() - 2], true);
+			assembleSystemValue(&w[w.size() - 1], &os);
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_INDEXABLETEMP: {
+			check_num_ops(s, w, 2);
+			string s1 = w[1].erase(0, 1);
+			string s2 = s1.substr(0, s1.find('['));
+			string s3 = s1.substr(s1.find('[') + 1);
+			s3.erase(s3.end() - 1, s3.end());
+			ins->opcode = 0x69;
+			ins->length = 4;
+			v.push_back(op);
+			v.push_back(atoi(s2.c_str()));
+			v.push_back(atoi(s3.c_str()));
+			v.push_back(atoi(w[2].c_str()));
+			break;
+		}
+		case Mnemonic::DCL_IMMEDIATECONSTANTBUFFER: {
+			vector<DWORD> os;
+			ins->opcode = 0x35;
 			ins->_11_23 = 3;
-		else if (w[1] == "lineadj")
-			ins->_11_23 = 6;
-		else if (w[1] == "triangleadj")
-			ins->_11_23 = 7;
-		// Added "lineadj" -DarkStarSword
-		// https://msdn.microsoft.com/en-us/library/windows/desktop/bb509609(v=vs.85).aspx
-		v.push_back(op);
-	} else if (o == "dcl_hs_max_tessfactor") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x98;
-		ins->length = 1 + os.size() - 1;
-		v.push_back(op);
-		v.insert(v.end(), os.begin() + 1, os.end());
-	} else if (o == "dcl_hs_fork_phase_instance_count") {
-		check_num_ops(s, w, 1);
-		vector<DWORD> os = assembleOp(w[1]);
-		ins->opcode = 0x99;
-		ins->length = 1 + os.size();
-		v.push_back(op);
-		v.insert(v.end(), os.begin(), os.end());
-	} else if (o == "samplepos") {
-		// samplepos can either be used with a texture register, or the
-		// rasterizer. In the former case it has an extra 0 appended.
-		vector<vector<DWORD>> os;
-		ins->opcode = 0x6e;
-		int numOps = 3;
-		check_num_ops(s, w, numOps);
-		for (int i = 0; i < numOps; i++)
-			os.push_back(assembleOp(w[i + 1], i < 1));
-
-		// When the instruction operates on a texture register
-		// (GetSamplerPosition) there is an extra 0 inserted that is
-		// not present when used on the rasterizer register
-		// (GetRenderTargetSamplePosition). It's not clear if there are
-		// any cases where this should be non-zero:
-		if (w[2][0] == 't') {
-			numOps++;
-			os.push_back(vector<DWORD>{0});
-		}
-
-		ins->length = 1;
-		for (int i = 0; i < numOps; i++)
-			ins->length += (int)os[i].size();
-
-		v.push_back(op);
-		for (int i = 0; i < numOps; i++)
-			v.insert(v.end(), os[i].begin(), os[i].end());
-	} else if (o == "printf") {
-		return assemble_printf(s, v, w, false);
-	} else if (o == "errorf") {
-		return assemble_printf(s, v, w, true);
-	} else if (o == "undecipherable") {
-		return assemble_undecipherable_custom_data(s, v, w);
-	} else {
-		throw AssemblerParseError(s, "Unrecognised instruction");
+			ins->length = 0;
+			DWORD length = 2;
+			DWORD offset = 3;
+			// The modulus here is by 5, matching the below offset += 5
+			if ((w.size() - offset) % 5 != 0)
+				throw AssemblerParseError(s, "Immediate Constant Buffer must have a multiple of four values");
+			while (offset < w.size()) {
+				string s1 = w[offset + 0];
+				s1 = s1.substr(0, s1.find(','));
+				string s2 = w[offset + 1];
+				s2 = s2.substr(0, s2.find(','));
+				string s3 = w[offset + 2];
+				s3 = s3.substr(0, s3.find(','));
+				string s4 = w[offset + 3];
+				s4 = s4.substr(0, s4.find('}'));
+				os.push_back(strToDWORD(s1));
+				os.push_back(strToDWORD(s2));
+				os.push_back(strToDWORD(s3));
+				os.push_back(strToDWORD(s4));
+				length += 4;
+				offset += 5;
+			}
+			v.push_back(op);
+			v.push_back(length);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_TESSELLATOR_PARTITIONING:
+			ins->opcode = 0x96;
+			ins->length = 1;
+			check_num_ops(s, w, 1);
+			if (w[1] == "partitioning_integer")
+				ins->_11_23 = 1;
+			else if (w[1] == "partitioning_pow2")
+				ins->_11_23 = 2;
+			else if (w[1] == "partitioning_fractional_odd")
+				ins->_11_23 = 3;
+			else if (w[1] == "partitioning_fractional_even")
+				ins->_11_23 = 4;
+			// Added pow2 -DarkStarSword
+			// https://msdn.microsoft.com/en-us/library/windows/desktop/ff471446(v=vs.85).aspx
+			v.push_back(op);
+			break;
+		case Mnemonic::DCL_TESSELLATOR_OUTPUT_PRIMITIVE:
+			ins->opcode = 0x97;
+			ins->length = 1;
+			check_num_ops(s, w, 1);
+			if (w[1] == "output_point")
+				ins->_11_23 = 1;
+			else if (w[1] == "output_line")
+				ins->_11_23 = 2;
+			else if (w[1] == "output_triangle_cw")
+				ins->_11_23 = 3;
+			else if (w[1] == "output_triangle_ccw")
+				ins->_11_23 = 4;
+			// Added output_point -DarkStarSword
+			// https://msdn.microsoft.com/en-us/library/windows/desktop/ff471445(v=vs.85).aspx
+			v.push_back(op);
+			break;
+		case Mnemonic::DCL_TESSELLATOR_DOMAIN:
+			ins->opcode = 0x95;
+			ins->length = 1;
+			check_num_ops(s, w, 1);
+			if (w[1] == "domain_isoline")
+				ins->_11_23 = 1;
+			else if (w[1] == "domain_tri")
+				ins->_11_23 = 2;
+			else if (w[1] == "domain_quad")
+				ins->_11_23 = 3;
+			v.push_back(op);
+			break;
+		case Mnemonic::DCL_STREAM: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x8f;
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::EMIT_STREAM: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x75;
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::CUT_STREAM: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x76;
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::EMIT_THEN_CUT_STREAM: {
+			// Partially verified - assembled & disassembled OK, but did not
+			// check against compiled shader as fxc never generates this
+			//   -DarkStarSword
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x77;
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_OUTPUTTOPOLOGY:
+			ins->opcode = 0x5c;
+			ins->length = 1;
+			check_num_ops(s, w, 1);
+			if (w[1] == "pointlist")
+				ins->_11_23 = 1;
+			else if (w[1] == "trianglestrip")
+				ins->_11_23 = 5;
+			else if (w[1] == "linestrip")
+				ins->_11_23 = 3;
+			// Added point list -DarkStarSword
+			// https://msdn.microsoft.com/en-us/library/windows/desktop/bb509661(v=vs.85).aspx
+			v.push_back(op);
+			break;
+		case Mnemonic::DCL_OUTPUT_CONTROL_POINT_COUNT: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x94;
+			ins->_11_23 = os[0];
+			ins->length = 1;
+			v.push_back(op);
+			break;
+		}
+		case Mnemonic::DCL_INPUT_CONTROL_POINT_COUNT: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x93;
+			ins->_11_23 = os[0];
+			ins->length = 1;
+			v.push_back(op);
+			break;
+		}
+		case Mnemonic::DCL_MAXOUT: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x5e;
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::DCL_INPUTPRIMITIVE:
+			ins->opcode = 0x5d;
+			ins->length = 1;
+			check_num_ops(s, w, 1);
+			if (w[1] == "point")
+				ins->_11_23 = 1;
+			else if (w[1] == "line")
+				ins->_11_23 = 2;
+			else if (w[1] == "triangle")
+				ins->_11_23 = 3;
+			else if (w[1] == "lineadj")
+				ins->_11_23 = 6;
+			else if (w[1] == "triangleadj")
+				ins->_11_23 = 7;
+			// Added "lineadj" -DarkStarSword
+			// https://msdn.microsoft.com/en-us/library/windows/desktop/bb509609(v=vs.85).aspx
+			v.push_back(op);
+			break;
+		case Mnemonic::DCL_HS_MAX_TESSFACTOR: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x98;
+			ins->length = 1 + os.size() - 1;
+			v.push_back(op);
+			v.insert(v.end(), os.begin() + 1, os.end());
+			break;
+		}
+		case Mnemonic::DCL_HS_FORK_PHASE_INSTANCE_COUNT: {
+			check_num_ops(s, w, 1);
+			vector<DWORD> os = assembleOp(w[1]);
+			ins->opcode = 0x99;
+			ins->length = 1 + os.size();
+			v.push_back(op);
+			v.insert(v.end(), os.begin(), os.end());
+			break;
+		}
+		case Mnemonic::SAMPLEPOS: {
+			// samplepos can either be used with a texture register, or the
+			// rasterizer. In the former case it has an extra 0 appended.
+			vector<vector<DWORD>> os;
+			ins->opcode = 0x6e;
+			int numOps = 3;
+			check_num_ops(s, w, numOps);
+			for (int i = 0; i < numOps; i++)
+				os.push_back(assembleOp(w[i + 1], i < 1));
+
+			// When the instruction operates on a texture register
+			// (GetSamplerPosition) there is an extra 0 inserted that is
+			// not present when used on the rasterizer register
+			// (GetRenderTargetSamplePosition). It's not clear if there are
+			// any cases where this should be non-zero:
+			if (w[2][0] == 't') {
+				numOps++;
+				os.push_back(vector<DWORD>{0});
+			}
+
+			ins->length = 1;
+			for (int i = 0; i < numOps; i++)
+				ins->length += (int)os[i].size();
+
+			v.push_back(op);
+			for (int i = 0; i < numOps; i++)
+				v.insert(v.end(), os[i].begin(), os[i].end());
+			break;
+		}
+		case Mnemonic::PRINTF:
+			assemble_printf(s, v, w, false);
+			break;
+		case Mnemonic::ERRORF:
+			assemble_printf(s, v, w, true);
+			break;
+		case Mnemonic::UNDECIPHERABLE:
+			assemble_undecipherable_custom_data(s, v, w);
+			break;
 	}
+}
 
-	return v;
+static vector<DWORD> assembleIns(string s)
+{
+	AssemblerBuffers buf;
+
+	assembleIns(s, &buf);
+	return buf.ins;
 }
 
 static string assembleAndCompare(string s, vector<DWORD> v)
@@ -2501,17 +2958,17 @@ static string assembleAndCompare(string s, vector<DWORD> v)
 			} else {
 				s2 = s;
 				s2.append(" orig");
-				codeBin[s2] = v;
+				recordCodeBin(s2, v);
 				s2 = s;
 				s2.append(" fail");
-				codeBin[s2] = v2;
+				recordCodeBin(s2, v2);
 			}
 		}
 	} else {
 		if (s != "undecipherable custom data") {
 			s2 = "!missing ";
 			s2.append(s);
-			codeBin[s2] = v;
+			recordCodeBin(s2, v);
 		}
 	}
 	string ret = "";
@@ -2522,12 +2979,23 @@ static string assembleAndCompare(string s, vector<DWORD> v)
 	return ret;
 }
 
-vector<string> stringToLines(const char* start, size_t size)
+// A line of assembly, pointing into the buffer it came from:
+struct AsmLine {
+	const char *start;
+	size_t size;
+};
+
+// Splits the buffer into lines without copying them. The lines point into the
+// buffer and do not include the newline, or any carriage return or spaces
+// from the end of the line.
+static void splitLines(const char* start, size_t size, vector<AsmLine> *lines)
 {
-	vector<string> lines;
 	const char* pStart = start;
 	const char* pEnd = pStart;
 	const char* pRealEnd = pStart + size;
+	AsmLine line;
+
+	lines->clear();
 	while (true) {
 		while (*pEnd != '\n' && pEnd < pRealEnd) {
 			pEnd++;
@@ -2535,20 +3003,15 @@ vector<string> stringToLines(const char* start, size_t size)
 		if (*pStart == 0) {
 			break;
 		}
-		string s(pStart, pEnd++);
+		line.start = pStart;
+		line.size = pEnd++ - pStart;
 		pStart = pEnd;
-		lines.push_back(s);
-		if (pStart >= pRealEnd) {
-			break;
-		}
-	}
-	for (unsigned int i = 0; i < lines.size(); i++) {
-		string s = lines[i];
+
 		// Bug fixed: This would not strip carriage returns from DOS
 		// style newlines if they were the only character on the line,
 		// corrupting the resulting shader binary. -DarkStarSword
-		if (s.size() >= 1 && s[s.size() - 1] == '\r')
-			s.erase(--s.end());
+		if (line.size >= 1 && line.start[line.size - 1] == '\r')
+			line.size--;
 
 		// Strip whitespace from the end of each line. This isn't
 		// strictly necessary, but the MS disassembler inserts an extra
@@ -2558,11 +3021,26 @@ vector<string> stringToLines(const char* start, size_t size)
 		// understand why the pattern isn't matching. By removing
 		// excess spaces from the end of each line now we can make this
 		// gotcha go away.
-		while (s.size() >= 1 && s[s.size() - 1] == ' ')
-			s.erase(--s.end());
+		while (line.size >= 1 && line.start[line.size - 1] == ' ')
+			line.size--;
 
-		lines[i] = s;
+		lines->push_back(line);
+		if (pStart >= pRealEnd) {
+			break;
+		}
 	}
+}
+
+vector<string> stringToLines(const char* start, size_t size)
+{
+	vector<AsmLine> spans;
+	vector<string> lines;
+
+	splitLines(start, size, &spans);
+	lines.reserve(spans.size());
+	for (AsmLine &line : spans)
+		lines.emplace_back(line.start, line.size);
+
 	return lines;
 }
 static vector<string> stringToLinesDX9(const char* start, size_t size) {
@@ -2879,9 +3357,7 @@ HRESULT disassemblerDX9(vector<byte> *buffer, vector<byte> *ret, const char *com
 	vector<string> lines = stringToLinesDX9(asmBuffer, asmSize);
 	ret->clear();
 	for (size_t i = 0; i < lines.size(); i++) {
-		for (size_t j = 0; j < lines[i].size(); j++) {
-			ret->insert(ret->end(), lines[i][j]);
-		}
+		ret->insert(ret->end(), lines[i].begin(), lines[i].end());
 		ret->insert(ret->end(), '\n');
 	}
 	if (pDissassembly)
@@ -2924,22 +3400,34 @@ HRESULT disassembler(vector<byte> *buffer, vector<byte> *ret, const char *commen
 	chunkOffsets.resize(numChunks);
 	std::memcpy(chunkOffsets.data(), pPosition, 4 * numChunks);
 
-	char* asmBuffer;
+	const char* asmBuffer;
 	size_t asmSize;
 	vector<byte> asmBuf;
 	ID3DBlob* pDissassembly = NULL;
+	string nativeAsm;
+
+	// Use our own disassembler where possible. It is much faster than
+	// going via d3dcompiler, and already prints literals in a form that
+	// will round trip, so the output does not need to be checked against
+	// the assembler. Anything it does not understand (class linkage, etc)
+	// falls back to Microsoft's disassembler:
+	bool native = DisassembleDXBC(buffer->data(), buffer->size(), comment, &nativeAsm);
+	if (native) {
+		asmBuffer = nativeAsm.data();
+		asmSize = nativeAsm.size();
+	} else {
+		// We disable debug info in the disassembler as it interferes with our
+		// ability to match assembly lines with bytecode below
+		HRESULT ok = D3DDisassemble(buffer->data(), buffer->size(),
+				D3D_DISASM_ENABLE_DEFAULT_VALUE_PRINTS |
+				D3D_DISASM_DISABLE_DEBUG_INFO,
+				comment, &pDissassembly);
+		if (FAILED(ok))
+			return ok;
 
-	// We disable debug info in the disassembler as it interferes with our
-	// ability to match assembly lines with bytecode below
-	HRESULT ok = D3DDisassemble(buffer->data(), buffer->size(),
-			D3D_DISASM_ENABLE_DEFAULT_VALUE_PRINTS |
-			D3D_DISASM_DISABLE_DEBUG_INFO,
-			comment, &pDissassembly);
-	if (FAILED(ok))
-		return ok;
-
-	asmBuffer = (char*)pDissassembly->GetBufferPointer();
-	asmSize = pDissassembly->GetBufferSize();
+		asmBuffer = (char*)pDissassembly->GetBufferPointer();
+		asmSize = pDissassembly->GetBufferSize();
+	}
 
 	byte* codeByteStart;
 	int codeChunk = 0;
@@ -2975,8 +3463,10 @@ HRESULT disassembler(vector<byte> *buffer, vector<byte> *ret, const char *commen
 				codeStarted = true;
 				v.push_back(*codeStart);
 				codeStart += 2;
-				s = assembleAndCompare(s, v);
-				lines[i] = s;
+				if (!native) {
+					s = assembleAndCompare(s, v);
+					lines[i] = s;
+				}
 			}
 		} else if (s.find("{ {") < s.size()) {
 			s2 = s;
@@ -2998,11 +3488,13 @@ HRESULT disassembler(vector<byte> *buffer, vector<byte> *ret, const char *commen
 				v.push_back(*codeStart);
 				codeStart++;
 			}
-			s = assembleAndCompare(s, v);
-			auto sLines = stringToLines(s.c_str(), s.size());
-			size_t startLine = i - sLines.size() + 1;
-			for (size_t j = 0; j < sLines.size(); j++) {
-				lines[startLine + j] = sLines[j];
+			if (!native) {
+				s = assembleAndCompare(s, v);
+				auto sLines = stringToLines(s.c_str(), s.size());
+				size_t startLine = i - sLines.size() + 1;
+				for (size_t j = 0; j < sLines.size(); j++) {
+					lines[startLine + j] = sLines[j];
+				}
 			}
 			//lines[i] = s;
 		} else if (multiLine) {
@@ -3040,8 +3532,9 @@ HRESULT disassembler(vector<byte> *buffer, vector<byte> *ret, const char *commen
 				v.push_back(*(codeStart)++);
 				for (uint32_t j = 1; j < len - 1; j++)
 					v.push_back(*(codeStart)++);
-				s = assembleAndCompare(s, v);
-			} else {
+				if (!native)
+					s = assembleAndCompare(s, v);
+			} else if (!native) {
 				s = assembleAndCompare(s, v);
 			}
 			lines[i] = s;
@@ -3052,13 +3545,12 @@ HRESULT disassembler(vector<byte> *buffer, vector<byte> *ret, const char *commen
 	}
 	ret->clear();
 	for (size_t i = 0; i < lines.size(); i++) {
-		for (size_t j = 0; j < lines[i].size(); j++) {
-			ret->insert(ret->end(), lines[i][j]);
-		}
+		ret->insert(ret->end(), lines[i].begin(), lines[i].end());
 		ret->insert(ret->end(), '\n');
 	}
 
-	pDissassembly->Release();
+	if (pDissassembly)
+		pDissassembly->Release();
 
 	return S_OK;
 }
@@ -3264,21 +3756,23 @@ vector<byte> assembler(vector<char> *asmFile, vector<byte> origBytecode,
 			break;
 	}
 	// FIXME: If neither SHEX or SHDR was found in the shader, codeByteStart will be garbage
-	vector<string> lines = stringToLines(asmBuffer, asmSize);
+	vector<AsmLine> lines;
+	splitLines(asmBuffer, asmSize, &lines);
 	DWORD* codeStart = (DWORD*)(codeByteStart + 8);
 	bool codeStarted = false;
 	bool multiLine = false;
-	string s2;
+	string s, s2;
+	AssemblerBuffers buf;
+	vector<DWORD> &ins = buf.ins;
 	vector<DWORD> o;
 	for (DWORD i = 0; i < lines.size(); i++) {
 		try {
-			string s = lines[i];
+			s.assign(lines[i].start, lines[i].size);
 			preprocessLine(s);
-			vector<DWORD> v;
 			if (!codeStarted) {
 				if (s.size() > 0 && s[0] != ' ') {
 					codeStarted = true;
-					vector<DWORD> ins = assembleIns(s);
+					assembleIns(s, &buf);
 					o.insert(o.end(), ins.begin(), ins.end());
 					o.push_back(0);
 				}
@@ -3290,13 +3784,13 @@ vector<byte> assembler(vector<char> *asmFile, vector<byte> origBytecode,
 				s2.append(s);
 				s = s2;
 				multiLine = false;
-				vector<DWORD> ins = assembleIns(s);
+				assembleIns(s, &buf);
 				o.insert(o.end(), ins.begin(), ins.end());
 			} else if (multiLine) {
 				s2.append("\n");
 				s2.append(s);
 			} else if (s.find_first_not_of(" ") != string::npos) {
-				vector<DWORD> ins = assembleIns(s);
+				assembleIns(s, &buf);
 				o.insert(o.end(), ins.begin(), ins.end());
 			}
 		} catch (AssemblerParseError &e) {
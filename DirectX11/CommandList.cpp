@@ -30,6 +30,11 @@ std::unordered_set<CommandList*> command_lists_profiling;
 std::unordered_set<CommandListCommand*> command_lists_cmd_profiling;
 std::vector<std::shared_ptr<CommandList>> dynamically_allocated_command_lists;
 
+// Variables the optimiser has proven will always hold the same value by the
+// time any command list reads them, keyed by the address operands read them
+// through. Only populated while optimise_command_lists() is running:
+static std::unordered_map<float*, float> constant_variables;
+
 
 // Adds consistent "3DMigoto" prefix to frame analysis log with appropriate
 // level of indentation for the current recursion level. Using a
@@ -121,6 +126,11 @@ static inline void profile_command_list_cmd_end(CommandListCommand *cmd, Command
 	}
 }
 
+static bool use_command_list_program(CommandList *command_list, CommandListState *state);
+static void compile_command_list(CommandList *command_list, bool post, CommandListProgram *program);
+static float run_command_list_program(const CommandListProgram *program,
+		CommandListState *state, HackerDevice *device);
+
 static void _RunCommandList(CommandList *command_list, CommandListState *state, bool recursive=true)
 {
 	CommandList::Commands::iterator i;
@@ -139,15 +149,19 @@ static void _RunCommandList(CommandList *command_list, CommandListState *state,
 		state->recursion++;
 	}
 
-	profile_command_list_start(command_list, state, &profiling_state);
+	if (use_command_list_program(command_list, state)) {
+		run_command_list_program(&command_list->program, state, NULL);
+	} else {
+		profile_command_list_start(command_list, state, &profiling_state);
 
-	for (i = command_list->commands.begin(); i < command_list->commands.end() && !state->aborted; i++) {
-		profile_command_list_cmd_start(i->get(), &profiling_state);
-		(*i)->run(state);
-		profile_command_list_cmd_end(i->get(), state, &profiling_state);
-	}
+		for (i = command_list->commands.begin(); i < command_list->commands.end() && !state->aborted; i++) {
+			profile_command_list_cmd_start(i->get(), &profiling_state);
+			(*i)->run(state);
+			profile_command_list_cmd_end(i->get(), state, &profiling_state);
+		}
 
-	profile_command_list_end(command_list, state, &profiling_state);
+		profile_command_list_end(command_list, state, &profiling_state);
+	}
 
 	if (recursive) {
 		state->recursion--;
@@ -238,23 +252,242 @@ void RunViewCommandList(HackerDevice *mHackerDevice,
 		res->Release();
 }
 
+typedef std::unordered_map<CommandList*, unsigned> CommandListRemovedCounts;
+
+// Explicit command lists up to this size consisting only of assignments are
+// copied into the command lists that run them:
+#define INLINE_COMMAND_LIST_MAX_COMMANDS 4
+
+static bool expression_reads_variable(CommandListEvaluatable *evaluatable, CommandListVariable *var)
+{
+	CommandListOperator *op;
+	CommandListOperand *operand;
+
+	operand = dynamic_cast<CommandListOperand*>(evaluatable);
+	if (operand)
+		return operand->type == ParamOverrideType::VARIABLE && operand->var_ftarget == &var->fval;
+
+	op = dynamic_cast<CommandListOperator*>(evaluatable);
+	if (!op)
+		return true; // Shouldn't happen, but err on the side of caution
+
+	if (op->lhs && expression_reads_variable(op->lhs.get(), var))
+		return true;
+	return op->rhs && expression_reads_variable(op->rhs.get(), var);
+}
+
+static bool is_simple_assignment(CommandListCommand *command)
+{
+	return dynamic_cast<VariableAssignment*>(command) || dynamic_cast<ParamOverride*>(command);
+}
+
+// Checks if the only thing that can ever change the variable is a statically
+// evaluatable assignment in the top level of [Constants] that nothing earlier
+// in [Constants] reads. [Constants] runs before any other command list, so
+// from then on the variable is constant.
+static bool constants_assignment_is_final(CommandListVariable *var, float *val)
+{
+	CommandList *constants = &G->constants_command_list;
+	VariableAssignment *assignment;
+	AssignmentCommand *earlier;
+	size_t i;
+
+	for (i = 0; i < constants->commands.size(); i++) {
+		assignment = dynamic_cast<VariableAssignment*>(constants->commands[i].get());
+		if (assignment && assignment->var == var)
+			return assignment->expression.static_evaluate(val);
+
+		// Anything more complicated could run another command list
+		// that reads the variable before it has been assigned:
+		if (!is_simple_assignment(constants->commands[i].get()))
+			return false;
+
+		earlier = dynamic_cast<AssignmentCommand*>(constants->commands[i].get());
+		if (expression_reads_variable(earlier->expression.evaluatable.get(), var))
+			return false;
+	}
+
+	return false;
+}
+
+static void check_constant_variable(CommandListVariable *var,
+		std::unordered_map<CommandListVariable*, unsigned> &assignments,
+		bool *making_progress)
+{
+	unsigned count = 0;
+	float val;
+
+	if (constant_variables.count(&var->fval))
+		return;
+
+	if (var->overridden || (var->flags & VariableFlags::PERSIST))
+		return;
+
+	auto found = assignments.find(var);
+	if (found != assignments.end())
+		count = found->second;
+
+	if (count == 0)
+		val = var->fval;
+	else if (count > 1 || !constants_assignment_is_final(var, &val))
+		return;
+
+	LogInfo("Propagating constant %S = %f\n", var->name.c_str(), val);
+	constant_variables[&var->fval] = val;
+	*making_progress = true;
+}
+
+// Finds variables that are never assigned, or only assigned once in
+// [Constants], so that expressions reading them can be statically evaluated.
+// Note that every place a variable is assigned is counted, even if the same
+// command has been inlined or spliced into more than one command list.
+static bool propagate_constant_variables()
+{
+	std::unordered_map<CommandListVariable*, unsigned> assignments;
+	VariableAssignment *assignment;
+	bool making_progress = false;
+
+	for (CommandList *command_list : registered_command_lists) {
+		for (auto &command : command_list->commands) {
+			assignment = dynamic_cast<VariableAssignment*>(command.get());
+			if (assignment)
+				assignments[assignment->var]++;
+		}
+	}
+
+	for (auto &global : command_list_globals)
+		check_constant_variable(&global.second, assignments, &making_progress);
+
+	for (CommandList *command_list : registered_command_lists) {
+		for (CommandListVariable &local : command_list->static_vars)
+			check_constant_variable(&local, assignments, &making_progress);
+	}
+
+	return making_progress;
+}
+
+// Replaces if blocks that have a statically known condition with the commands
+// from whichever branch would have been taken. The branch command lists are
+// emptied afterwards - nothing else can reach them, and leaving the commands
+// in them as well would count as extra assignments.
+static bool prune_static_if_commands(CommandList *command_list, CommandListRemovedCounts *removed)
+{
+	std::shared_ptr<CommandListCommand> command;
+	IfCommand *if_command;
+	CommandList *taken, *not_taken;
+	bool making_progress = false;
+	float static_val;
+	size_t i;
+
+	for (i = 0; i < command_list->commands.size(); ) {
+		command = command_list->commands[i];
+		if_command = dynamic_cast<IfCommand*>(command.get());
+		if (!if_command
+		 || (command_list->post && !if_command->post_finalised)
+		 || (!command_list->post && !if_command->pre_finalised)
+		 || !if_command->expression.static_evaluate(&static_val)) {
+			i++;
+			continue;
+		}
+
+		if (command_list->post) {
+			taken = static_val ? if_command->true_commands_post.get() : if_command->false_commands_post.get();
+			not_taken = static_val ? if_command->false_commands_post.get() : if_command->true_commands_post.get();
+		} else {
+			taken = static_val ? if_command->true_commands_pre.get() : if_command->false_commands_pre.get();
+			not_taken = static_val ? if_command->false_commands_pre.get() : if_command->true_commands_pre.get();
+		}
+
+		LogInfo("Pruned %s %S, always %s\n",
+				command_list->post ? "post" : "pre",
+				if_command->ini_line.c_str(),
+				static_val ? "true" : "false");
+
+		command_list->commands.erase(command_list->commands.begin() + i);
+		command_list->commands.insert(command_list->commands.begin() + i,
+				taken->commands.begin(), taken->commands.end());
+		i += taken->commands.size();
+		taken->clear();
+		not_taken->clear();
+
+		(*removed)[command_list]++;
+		making_progress = true;
+	}
+
+	return making_progress;
+}
+
+static bool inline_explicit_command_lists(CommandList *command_list, CommandListRemovedCounts *removed)
+{
+	RunExplicitCommandList *run;
+	CommandList::Commands inlined;
+	CommandList *target;
+	bool making_progress = false;
+	size_t i;
+
+	for (i = 0; i < command_list->commands.size(); ) {
+		run = dynamic_cast<RunExplicitCommandList*>(command_list->commands[i].get());
+		if (!run || run->run_pre_and_post_together) {
+			i++;
+			continue;
+		}
+
+		if (command_list->post)
+			target = &run->command_list_section->post_command_list;
+		else
+			target = &run->command_list_section->command_list;
+
+		if (target == command_list
+		 || target->commands.empty()
+		 || target->commands.size() > INLINE_COMMAND_LIST_MAX_COMMANDS
+		 || !std::all_of(target->commands.begin(), target->commands.end(),
+				[](std::shared_ptr<CommandListCommand> &c) { return is_simple_assignment(c.get()); })) {
+			i++;
+			continue;
+		}
+
+		LogInfo("Inlined %s %S\n",
+				command_list->post ? "post" : "pre",
+				run->ini_line.c_str());
+
+		inlined = target->commands;
+		command_list->commands.erase(command_list->commands.begin() + i);
+		command_list->commands.insert(command_list->commands.begin() + i,
+				inlined.begin(), inlined.end());
+		i += inlined.size();
+
+		(*removed)[command_list]++;
+		making_progress = true;
+	}
+
+	return making_progress;
+}
+
 void optimise_command_lists(HackerDevice *device)
 {
-	bool making_progress;
+	bool making_progress, reoptimise = true;
 	bool ignore_cto_pre, ignore_cto_post;
-	size_t i;
+	size_t i, instructions = 0;
 	CommandList::Commands::iterator new_end;
+	CommandListRemovedCounts removed;
+	unsigned total_removed = 0;
 	DWORD start;
 
 	LogInfo("Optimising command lists...\n");
 	start = GetTickCount();
 
-	for (CommandList *command_list : registered_command_lists) {
-		for (i = 0; i < command_list->commands.size(); i++)
-			command_list->commands[i]->optimise(device);
-	}
-
 	do {
+		// Statically evaluate what we can in each command. This is
+		// repeated whenever more variables have been found to be
+		// constant, since more expressions may now be static:
+		if (reoptimise) {
+			for (CommandList *command_list : registered_command_lists) {
+				for (i = 0; i < command_list->commands.size(); i++)
+					command_list->commands[i]->optimise(device);
+			}
+			reoptimise = false;
+		}
+
 		making_progress = false;
 		ignore_cto_pre = true;
 		ignore_cto_post = true;
@@ -292,6 +525,7 @@ void optimise_command_lists(HackerDevice *device)
 							command_list->post ? "post" : "pre",
 							command_list->commands[i]->ini_line.c_str());
 					command_list->commands.erase(command_list->commands.begin() + i);
+					removed[command_list]++;
 					making_progress = true;
 					continue;
 				}
@@ -299,6 +533,19 @@ void optimise_command_lists(HackerDevice *device)
 			}
 		}
 
+		// Look across whole command lists for if blocks that always
+		// go the same way and explicit command lists small enough to
+		// be worth copying into their callers:
+		for (CommandList *command_list : registered_command_lists) {
+			making_progress = prune_static_if_commands(command_list, &removed) || making_progress;
+			making_progress = inline_explicit_command_lists(command_list, &removed) || making_progress;
+		}
+
+		if (propagate_constant_variables()) {
+			reoptimise = true;
+			making_progress = true;
+		}
+
 		// TODO: Merge adjacent commands if possible, e.g. all the
 		// commands in BuiltInCommandListUnbindAllRenderTargets would
 		// be good candidates to merge into a single command. We could
@@ -307,6 +554,28 @@ void optimise_command_lists(HackerDevice *device)
 	} while (making_progress);
 
 	Profiling::update_cto_warning(!ignore_cto_post);
+	constant_variables.clear();
+
+	for (CommandList *command_list : registered_command_lists) {
+		auto count = removed.find(command_list);
+		if (count == removed.end())
+			continue;
+		LogInfo("  [%S] %s: %u commands removed, %Iu remaining\n",
+				command_list->ini_section.c_str(),
+				command_list->post ? "post" : "pre",
+				count->second, command_list->commands.size());
+		total_removed += count->second;
+	}
+	LogInfo("Removed %u commands from %Iu command lists\n", total_removed, removed.size());
+
+	// Now that nothing else is going to be removed, flatten each command
+	// list into its bytecode form:
+	for (CommandList *command_list : registered_command_lists) {
+		command_list->program.clear();
+		compile_command_list(command_list, command_list->post, &command_list->program);
+		instructions += command_list->program.size();
+	}
+	LogInfo("Compiled %Iu command lists into %Iu instructions\n", registered_command_lists.size(), instructions);
 
 	LogInfo("Command List Optimiser finished after %ums\n", GetTickCount() - start);
 	registered_command_lists.clear();
@@ -1763,7 +2032,8 @@ CustomShader::CustomShader() :
 	executions_this_frame(0),
 	sampler_override(0),
 	sampler_state(nullptr),
-	compile_flags(D3DCompileFlags::OPTIMIZATION_LEVEL3)
+	compile_flags(D3DCompileFlags::OPTIMIZATION_LEVEL3),
+	reload_fingerprint(0)
 {
 	int i;
 
@@ -1811,6 +2081,55 @@ CustomShader::~CustomShader()
 		sampler_state->Release();
 }
 
+bool get_file_dependency(const wchar_t *path, FileDependency *dep)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+	if (!GetFileAttributesEx(path, GetFileExInfoStandard, &attributes))
+		return false;
+
+	dep->path = path;
+	dep->timestamp = attributes.ftLastWriteTime;
+	return true;
+}
+
+bool file_dependencies_unchanged(const std::vector<FileDependency> *deps)
+{
+	FileDependency current;
+
+	for (const FileDependency &dep : *deps) {
+		if (!get_file_dependency(dep.path.c_str(), &current))
+			return false;
+		if (CompareFileTime(&dep.timestamp, &current.timestamp))
+			return false;
+	}
+
+	return true;
+}
+
+// Takes over the compiled shaders from a CustomShader section of an earlier
+// config that the ini parser has determined to be identical. The render
+// states are not taken since they are cheap to recreate, and need to be in
+// case the old section was never substantiated.
+void CustomShader::adopt_shaders(CustomShader *old)
+{
+	vs_override = old->vs_override; vs = old->vs; vs_bytecode = old->vs_bytecode;
+	hs_override = old->hs_override; hs = old->hs; hs_bytecode = old->hs_bytecode;
+	ds_override = old->ds_override; ds = old->ds; ds_bytecode = old->ds_bytecode;
+	gs_override = old->gs_override; gs = old->gs; gs_bytecode = old->gs_bytecode;
+	ps_override = old->ps_override; ps = old->ps; ps_bytecode = old->ps_bytecode;
+	cs_override = old->cs_override; cs = old->cs; cs_bytecode = old->cs_bytecode;
+
+	old->vs = NULL; old->vs_bytecode = NULL;
+	old->hs = NULL; old->hs_bytecode = NULL;
+	old->ds = NULL; old->ds_bytecode = NULL;
+	old->gs = NULL; old->gs_bytecode = NULL;
+	old->ps = NULL; old->ps_bytecode = NULL;
+	old->cs = NULL; old->cs_bytecode = NULL;
+
+	dependencies.swap(old->dependencies);
+}
+
 static bool load_cached_shader(FILETIME hlsl_timestamp, wchar_t *cache_path, ID3DBlob **ppBytecode)
 {
 	FILETIME cache_timestamp;
@@ -1959,6 +2278,7 @@ bool CustomShader::compile(char type, wchar_t *filename, const wstring *wname, c
 		swprintf_s(cache_path, MAX_PATH, L"%s.%S.%x.bin", wpath, shaderModel, (UINT)compile_flags);
 
 	GetFileTime(f, NULL, NULL, &timestamp);
+	dependencies.push_back(FileDependency{wpath, timestamp});
 	if (load_cached_shader(timestamp, cache_path, ppBytecode)) {
 		CloseHandle(f);
 		return false;
@@ -1988,6 +2308,12 @@ bool CustomShader::compile(char type, wchar_t *filename, const wstring *wname, c
 		hr = D3DCompile(srcData.data(), srcDataSize, apath, macros,
 			G->recursive_include == -1 ? D3D_COMPILE_STANDARD_FILE_INCLUDE : &include_handler,
 			"main", shaderModel, (UINT)compile_flags, 0, ppBytecode, &pErrorMsgs);
+
+		for (wstring &include : include_handler.included_files) {
+			FileDependency dep;
+			if (get_file_dependency(include.c_str(), &dep))
+				dependencies.push_back(dep);
+		}
 	}
 
 	if (pErrorMsgs) {
@@ -2443,6 +2769,7 @@ LinkCommandLists(CommandList *dst, CommandList *link, const wstring *ini_line)
 	operation->ini_line = *ini_line;
 	std::shared_ptr<RunLinkedCommandList> p(operation);
 	dst->commands.push_back(p);
+	recompile_command_list(dst);
 	return p;
 }
 
@@ -2586,12 +2913,12 @@ float CommandListOperand::process_shader_filter(CommandListState *state)
 		return 0.0;
 
 	// Positive zero means shader bound with no ShaderOverride
-	ShaderOverrideMap::iterator override = lookup_shaderoverride(shader_it->second);
-	if (override == G->mShaderOverrideMap.end())
+	ShaderOverride *override = lookup_shaderoverride(shader_it->second);
+	if (!override)
 		return 0.0;
 
-	if (override->second.filter_index != FLT_MAX)
-		return override->second.filter_index;
+	if (override->filter_index != FLT_MAX)
+		return override->filter_index;
 
 	// Matched ShaderOverride / ShaderRegex, but no filter_index:
 	return 1.0;
@@ -2600,6 +2927,7 @@ float CommandListOperand::process_shader_filter(CommandListState *state)
 void CommandList::clear()
 {
 	commands.clear();
+	program.clear();
 	static_vars.clear();
 }
 
@@ -3135,6 +3463,14 @@ bool CommandListOperand::static_evaluate(float *ret, HackerDevice *device)
 		case ParamOverrideType::VALUE:
 			*ret = val;
 			return true;
+		case ParamOverrideType::VARIABLE: {
+			auto constant = constant_variables.find(var_ftarget);
+			if (constant != constant_variables.end()) {
+				*ret = constant->second;
+				return true;
+			}
+			break;
+		}
 		case ParamOverrideType::RAW_SEPARATION:
 		case ParamOverrideType::CONVERGENCE:
 		case ParamOverrideType::EYE_SEPARATION:
@@ -3176,8 +3512,12 @@ bool CommandListOperand::optimise(HackerDevice *device, std::shared_ptr<CommandL
 	if (!static_evaluate(&val, device))
 		return false;
 
-	LogInfo("Statically evaluated %S as %f\n",
-		lookup_enum_name(ParamOverrideTypeNames, type), val);
+	if (type == ParamOverrideType::VARIABLE) {
+		LogInfo("Statically evaluated %S as %f\n", token.c_str(), val);
+	} else {
+		LogInfo("Statically evaluated %S as %f\n",
+			lookup_enum_name(ParamOverrideTypeNames, type), val);
+	}
 
 	type = ParamOverrideType::VALUE;
 	return true;
@@ -3367,8 +3707,9 @@ static void group_parenthesis(CommandListSyntaxTree *tree)
 	}
 }
 
-// Expression operator definitions:
-#define DEFINE_OPERATOR(name, operator_pattern, fn) \
+// Expression operator definitions. The operation and opcode come from
+// CommandListOperators.h, shared with the bytecode interpreter:
+#define DEFINE_OPERATOR(name, operator_pattern) \
 class name##T : public CommandListOperator { \
 public: \
 	name##T( \
@@ -3378,31 +3719,32 @@ public: \
 		) : CommandListOperator(lhs, t, rhs) \
 	{} \
 	static const wchar_t* pattern() { return L##operator_pattern; } \
-	float evaluate(float lhs, float rhs) override { return (fn); } \
+	float evaluate(float lhs, float rhs) override { return name##_fn(lhs, rhs); } \
+	CommandListOpcode opcode() override { return name##_opcode; } \
 }; \
 static CommandListOperatorFactory<name##T> name;
 
 // Highest level of precedence, allows for negative numbers
-DEFINE_OPERATOR(unary_not_operator,     "!",  (!rhs));
-DEFINE_OPERATOR(unary_plus_operator,    "+",  (+rhs));
-DEFINE_OPERATOR(unary_negate_operator,  "-",  (-rhs));
+DEFINE_OPERATOR(unary_not_operator,     "!");
+DEFINE_OPERATOR(unary_plus_operator,    "+");
+DEFINE_OPERATOR(unary_negate_operator,  "-");
 
 // High level of precedence, right-associative. Lower than unary operators, so
 // that 4**-2 works for square root
-DEFINE_OPERATOR(exponent_operator,      "**", (pow(lhs, rhs)));
+DEFINE_OPERATOR(exponent_operator,      "**");
 
-DEFINE_OPERATOR(multiplication_operator,"*",  (lhs * rhs));
-DEFINE_OPERATOR(division_operator,      "/",  (lhs / rhs));
-DEFINE_OPERATOR(floor_division_operator,"//", (floor(lhs / rhs)));
-DEFINE_OPERATOR(modulus_operator,       "%",  (fmod(lhs, rhs)));
+DEFINE_OPERATOR(multiplication_operator,"*");
+DEFINE_OPERATOR(division_operator,      "/");
+DEFINE_OPERATOR(floor_division_operator,"//");
+DEFINE_OPERATOR(modulus_operator,       "%");
 
-DEFINE_OPERATOR(addition_operator,      "+",  (lhs + rhs));
-DEFINE_OPERATOR(subtraction_operator,   "-",  (lhs - rhs));
+DEFINE_OPERATOR(addition_operator,      "+");
+DEFINE_OPERATOR(subtraction_operator,   "-");
 
-DEFINE_OPERATOR(less_operator,          "<",  (lhs < rhs));
-DEFINE_OPERATOR(less_equal_operator,    "<=", (lhs <= rhs));
-DEFINE_OPERATOR(greater_operator,       ">",  (lhs > rhs));
-DEFINE_OPERATOR(greater_equal_operator, ">=", (lhs >= rhs));
+DEFINE_OPERATOR(less_operator,          "<");
+DEFINE_OPERATOR(less_equal_operator,    "<=");
+DEFINE_OPERATOR(greater_operator,       ">");
+DEFINE_OPERATOR(greater_equal_operator, ">=");
 
 // The triple equals operator tests for binary equivalence - in particular,
 // this allows us to test for negative zero, used in texture filtering to
@@ -3410,14 +3752,14 @@ DEFINE_OPERATOR(greater_equal_operator, ">=", (lhs >= rhs));
 // tested for using the regular equals operator, since -0.0 == +0.0. This
 // operator could also test for specific cases of NAN (though, without the
 // vs2015 toolchain "nan" won't parse as such).
-DEFINE_OPERATOR(equality_operator,      "==", (lhs == rhs));
-DEFINE_OPERATOR(inequality_operator,    "!=", (lhs != rhs));
-DEFINE_OPERATOR(identical_operator,     "===",(*(uint32_t*)&lhs == *(uint32_t*)&rhs));
-DEFINE_OPERATOR(not_identical_operator, "!==",(*(uint32_t*)&lhs != *(uint32_t*)&rhs));
+DEFINE_OPERATOR(equality_operator,      "==");
+DEFINE_OPERATOR(inequality_operator,    "!=");
+DEFINE_OPERATOR(identical_operator,     "===");
+DEFINE_OPERATOR(not_identical_operator, "!==");
 
-DEFINE_OPERATOR(and_operator,           "&&", (lhs && rhs));
+DEFINE_OPERATOR(and_operator,           "&&");
 
-DEFINE_OPERATOR(or_operator,            "||", (lhs || rhs));
+DEFINE_OPERATOR(or_operator,            "||");
 
 // TODO: Ternary if operator
 
@@ -3671,6 +4013,8 @@ bool CommandListExpression::parse(const wstring *expression, const wstring *ini_
 
 float CommandListExpression::evaluate(CommandListState *state, HackerDevice *device)
 {
+	if (!program.empty())
+		return run_command_list_program(&program, state, device);
 	return evaluatable->evaluate(state, device);
 }
 
@@ -3695,6 +4039,8 @@ bool CommandListExpression::optimise(HackerDevice *device)
 	if (replacement)
 		evaluatable = replacement;
 
+	compile();
+
 	return ret;
 }
 
@@ -3909,6 +4255,241 @@ bool AssignmentCommand::optimise(HackerDevice *device)
 	return expression.optimise(device);
 }
 
+// Command list bytecode. See the comment above CommandListOpcode for the
+// overview - the tree is the reference implementation and everything here must
+// produce exactly the same results, just without the pointer chasing. The
+// expression compiler and operators are shared with cmd_DirectX11Tests
+// --verify-command-list-expressions, which checks exactly that.
+
+// How compile_command_list_expression() takes our syntax tree apart:
+struct EvaluatableCompileTraits {
+	static bool push(CommandListEvaluatable *evaluatable, CommandListProgram *program)
+	{
+		CommandListOperand *operand;
+		CommandListInstruction inst = {};
+
+		operand = dynamic_cast<CommandListOperand*>(evaluatable);
+		if (!operand)
+			return false;
+
+		switch (operand->type) {
+			case ParamOverrideType::VALUE:
+				inst.op = CommandListOpcode::PUSH_CONSTANT;
+				inst.val = operand->val;
+				break;
+			case ParamOverrideType::VARIABLE:
+				inst.op = CommandListOpcode::PUSH_VARIABLE;
+				inst.ftarget = operand->var_ftarget;
+				break;
+			case ParamOverrideType::INI_PARAM:
+				inst.op = CommandListOpcode::PUSH_INI_PARAM;
+				inst.param.idx = operand->param_idx;
+				inst.param.component = operand->param_component;
+				break;
+			default:
+				inst.op = CommandListOpcode::PUSH_OPERAND;
+				inst.operand = operand;
+				break;
+		}
+		program->push_back(inst);
+		return true;
+	}
+
+	static bool split(CommandListEvaluatable *evaluatable, CommandListEvaluatable **lhs,
+			CommandListOpcode *opcode, CommandListEvaluatable **rhs)
+	{
+		CommandListOperator *op;
+
+		op = dynamic_cast<CommandListOperator*>(evaluatable);
+		if (!op)
+			return false;
+
+		*lhs = op->lhs.get();
+		*opcode = op->opcode();
+		*rhs = op->rhs.get();
+		return true;
+	}
+
+	static void emit(CommandListOpcode opcode, CommandListProgram *program)
+	{
+		CommandListInstruction inst = {};
+
+		inst.op = opcode;
+		program->push_back(inst);
+	}
+};
+
+// Runs either a whole command list or a single expression. In the latter case
+// the result is left on the stack and returned.
+static float run_command_list_program(const CommandListProgram *program,
+		CommandListState *state, HackerDevice *device)
+{
+	const CommandListInstruction *code = program->data();
+	const CommandListInstruction *inst;
+	size_t pc = 0, end = program->size();
+	float stack[COMMAND_LIST_STACK_SIZE];
+	float *sp = stack;
+	float *dest, orig;
+
+	while (pc < end) {
+		inst = &code[pc++];
+
+		switch (inst->op) {
+		case CommandListOpcode::PUSH_CONSTANT:
+			*sp++ = inst->val;
+			break;
+		case CommandListOpcode::PUSH_VARIABLE:
+			*sp++ = *inst->ftarget;
+			break;
+		case CommandListOpcode::PUSH_INI_PARAM:
+			*sp++ = G->iniParams[inst->param.idx].*inst->param.component;
+			break;
+		case CommandListOpcode::PUSH_OPERAND:
+			*sp++ = inst->operand->evaluate(state, device);
+			break;
+
+		COMMAND_LIST_OPERATOR_CASES
+
+		case CommandListOpcode::STORE_VARIABLE:
+			inst->var->fval = *--sp;
+			break;
+		case CommandListOpcode::STORE_PERSISTENT_VARIABLE:
+			orig = inst->var->fval;
+			inst->var->fval = *--sp;
+			G->user_config_dirty |= (inst->var->fval != orig);
+			break;
+		case CommandListOpcode::STORE_INI_PARAM:
+			dest = &(G->iniParams[inst->param.idx].*inst->param.component);
+			orig = *dest;
+			*dest = *--sp;
+			state->update_params |= (*dest != orig);
+			break;
+		case CommandListOpcode::JUMP_IF_FALSE:
+			if (!*--sp)
+				pc = inst->target;
+			break;
+		case CommandListOpcode::JUMP:
+			pc = inst->target;
+			break;
+		case CommandListOpcode::RUN_COMMAND:
+			inst->command->run(state);
+			if (state->aborted)
+				return 0;
+			break;
+		}
+	}
+
+	if (sp == stack)
+		return 0;
+	return sp[-1];
+}
+
+bool CommandListExpression::compile()
+{
+	int depth = 0, max_depth = 0;
+
+	program.clear();
+
+	if (!evaluatable)
+		return false;
+
+	if (!compile_command_list_expression<EvaluatableCompileTraits>(evaluatable.get(), &program, &depth, &max_depth)
+			|| depth != 1 || max_depth > COMMAND_LIST_STACK_SIZE) {
+		program.clear();
+		return false;
+	}
+
+	return true;
+}
+
+static void compile_command_list(CommandList *command_list, bool post, CommandListProgram *program)
+{
+	VariableAssignment *assignment;
+	ParamOverride *param_override;
+	IfCommand *if_command;
+	CommandList *false_commands;
+	size_t jump_if_false, jump;
+
+	for (auto &command : command_list->commands) {
+		CommandListInstruction inst = {};
+
+		assignment = dynamic_cast<VariableAssignment*>(command.get());
+		param_override = dynamic_cast<ParamOverride*>(command.get());
+		if_command = dynamic_cast<IfCommand*>(command.get());
+
+		if (assignment && !assignment->expression.program.empty()) {
+			program->insert(program->end(), assignment->expression.program.begin(), assignment->expression.program.end());
+			if (assignment->var->flags & VariableFlags::PERSIST)
+				inst.op = CommandListOpcode::STORE_PERSISTENT_VARIABLE;
+			else
+				inst.op = CommandListOpcode::STORE_VARIABLE;
+			inst.var = assignment->var;
+			program->push_back(inst);
+		} else if (param_override && !param_override->expression.program.empty()) {
+			program->insert(program->end(), param_override->expression.program.begin(), param_override->expression.program.end());
+			inst.op = CommandListOpcode::STORE_INI_PARAM;
+			inst.param.idx = param_override->param_idx;
+			inst.param.component = param_override->param_component;
+			program->push_back(inst);
+		} else if (if_command && !if_command->expression.program.empty()) {
+			// The branches are inlined, which is what saves us from
+			// recursing into _RunCommandList for every if block:
+			program->insert(program->end(), if_command->expression.program.begin(), if_command->expression.program.end());
+			jump_if_false = program->size();
+			inst.op = CommandListOpcode::JUMP_IF_FALSE;
+			program->push_back(inst);
+
+			if (post) {
+				compile_command_list(if_command->true_commands_post.get(), post, program);
+				false_commands = if_command->false_commands_post.get();
+			} else {
+				compile_command_list(if_command->true_commands_pre.get(), post, program);
+				false_commands = if_command->false_commands_pre.get();
+			}
+
+			if (false_commands->commands.empty()) {
+				(*program)[jump_if_false].target = program->size();
+			} else {
+				jump = program->size();
+				inst.op = CommandListOpcode::JUMP;
+				program->push_back(inst);
+				(*program)[jump_if_false].target = program->size();
+				compile_command_list(false_commands, post, program);
+				(*program)[jump].target = program->size();
+			}
+		} else {
+			inst.op = CommandListOpcode::RUN_COMMAND;
+			inst.command = command.get();
+			program->push_back(inst);
+		}
+	}
+}
+
+// For command lists modified after the optimiser has run, which at the moment
+// is only ShaderRegex linking its command lists into a ShaderOverride. The
+// program holds raw pointers to the commands, so must be rebuilt any time a
+// command is added or removed:
+void recompile_command_list(CommandList *command_list)
+{
+	command_list->program.clear();
+	compile_command_list(command_list, command_list->post, &command_list->program);
+}
+
+// The program skips the frame analysis log and the per command profiling, so
+// the tree is used whenever either of those want to see what is going on:
+static bool use_command_list_program(CommandList *command_list, CommandListState *state)
+{
+	if (command_list->program.empty() || state->post != command_list->post)
+		return false;
+
+	if (G->analyse_frame || gLogDebug)
+		return false;
+
+	return (Profiling::mode != Profiling::Mode::SUMMARY)
+		&& (Profiling::mode != Profiling::Mode::TOP_COMMAND_LISTS)
+		&& (Profiling::mode != Profiling::Mode::TOP_COMMANDS);
+}
+
 static bool operand_allowed_in_context(ParamOverrideType type, CommandListScope *scope)
 {
 	if (scope)
@@ -4312,8 +4893,16 @@ CustomResource::CustomResource() :
 	width_multiply(1.0f),
 	height_multiply(1.0f),
 	initial_data(NULL),
-	initial_data_size(0)
-{}
+	initial_data_size(0),
+	reload_fingerprint(0),
+	written(false),
+	reload_resource(NULL),
+	reload_device(NULL),
+	reload_bind_flags((D3D11_BIND_FLAG)0),
+	reload_misc_flags((D3D11_RESOURCE_MISC_FLAG)0)
+{
+	file_timestamp.dwLowDateTime = file_timestamp.dwHighDateTime = 0;
+}
 
 CustomResource::~CustomResource()
 {
@@ -4321,9 +4910,41 @@ CustomResource::~CustomResource()
 		resource->Release();
 	if (view)
 		view->Release();
+	if (reload_resource)
+		reload_resource->Release();
 	free(initial_data);
 }
 
+// True if this holds a texture exactly as it was loaded from its file, that
+// the file hasn't changed since, and that nothing could have written to it -
+// neither a command list assignment nor the GPU through a writable binding.
+bool CustomResource::can_pass_on_file_resource()
+{
+	FileDependency current;
+
+	if (!substantiated || written || !resource || filename.empty())
+		return false;
+
+	if (bind_flags & (D3D11_BIND_RENDER_TARGET | D3D11_BIND_DEPTH_STENCIL |
+			  D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_STREAM_OUTPUT))
+		return false;
+
+	if (!get_file_dependency(filename.c_str(), &current))
+		return false;
+
+	return !CompareFileTime(&file_timestamp, &current.timestamp);
+}
+
+void CustomResource::pass_on_file_resource(CustomResource *to)
+{
+	to->reload_resource = resource;
+	to->reload_device = device;
+	to->reload_bind_flags = bind_flags;
+	to->reload_misc_flags = misc_flags;
+	to->file_timestamp = file_timestamp;
+	resource = NULL;
+}
+
 bool CustomResource::OverrideSurfaceCreationMode(StereoHandle mStereoHandle, NVAPI_STEREO_SURFACECREATEMODE *orig_mode)
 {
 
@@ -4454,6 +5075,7 @@ out_close:
 
 void CustomResource::LoadFromFile(ID3D11Device *mOrigDevice1)
 {
+	FileDependency load_timestamp = {};
 	wstring ext;
 	HRESULT hr;
 
@@ -4474,6 +5096,21 @@ void CustomResource::LoadFromFile(ID3D11Device *mOrigDevice1)
 	if (override_misc_flags != ResourceMiscFlags::INVALID)
 		misc_flags = (D3D11_RESOURCE_MISC_FLAG)override_misc_flags;
 
+	if (reload_resource) {
+		if (reload_device == mOrigDevice1 &&
+		    reload_bind_flags == bind_flags &&
+		    reload_misc_flags == misc_flags) {
+			LogInfoW(L"Reusing custom resource %s from before config reload\n", filename.c_str());
+			resource = reload_resource;
+			reload_resource = NULL;
+			device = mOrigDevice1;
+			is_null = false;
+			return;
+		}
+		reload_resource->Release();
+		reload_resource = NULL;
+	}
+
 	// XXX: We are not creating a view with DirecXTK because
 	// 1) it assumes we want a shader resource view, which is an
 	//    assumption that doesn't fit with the goal of this code to
@@ -4487,6 +5124,10 @@ void CustomResource::LoadFromFile(ID3D11Device *mOrigDevice1)
 	// could do something smart here, like only using it if the
 	// bind_flags indicate it will be used as a shader resource.
 
+	// Taken before loading so that if the file is modified while we are
+	// loading it we err on the side of loading it again next time:
+	get_file_dependency(filename.c_str(), &load_timestamp);
+
 	ext = filename.substr(filename.rfind(L"."));
 	if (!_wcsicmp(ext.c_str(), L".dds")) {
 		LogInfoW(L"Loading custom resource %s as DDS, bind_flags=0x%03x\n", filename.c_str(), bind_flags);
@@ -4504,6 +5145,7 @@ void CustomResource::LoadFromFile(ID3D11Device *mOrigDevice1)
 	if (SUCCEEDED(hr)) {
 		device = mOrigDevice1;
 		is_null = false;
+		file_timestamp = load_timestamp.timestamp;
 		// TODO:
 		// format = ...
 	} else
@@ -6145,6 +6787,10 @@ void ResourceCopyTarget::SetResource(
 				custom_resource->view->AddRef();
 		}
 
+		// Also covers copies into the existing resource, which pass
+		// it back in here:
+		custom_resource->written = true;
+
 		if (custom_resource->resource != res) {
 			if (custom_resource->resource)
 				custom_resource->resource->Release();
@@ -6241,7 +6887,6 @@ D3D11_BIND_FLAG ResourceCopyTarget::BindFlags(CommandListState *state, D3D11_RES
 
 void ResourceCopyTarget::FindTextureOverrides(CommandListState *state, bool *resource_found, TextureOverrideMatches *matches)
 {
-	TextureOverrideMap::iterator i;
 	ID3D11Resource *resource = NULL;
 	ID3D11View *view = NULL;
 	uint32_t hash = 0;
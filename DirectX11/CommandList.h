@@ -11,6 +11,7 @@
 
 #include "DrawCallInfo.h"
 #include "ResourceHash.h"
+#include "CommandListOperators.h"
 
 // Used to prevent typos leading to infinite recursion (or at least overflowing
 // the real stack) due to a section running itself or a circular reference. 64
@@ -113,8 +114,12 @@ public:
 	float fval;
 	VariableFlags flags;
 
+	// Set if a [Key] or [Preset] section can change this variable, which
+	// rules it out of constant propagation:
+	bool overridden;
+
 	CommandListVariable(wstring name, float fval, VariableFlags flags) :
-		name(name), fval(fval), flags(flags)
+		name(name), fval(fval), flags(flags), overridden(false)
 	{}
 };
 
@@ -122,6 +127,28 @@ typedef std::unordered_map<std::wstring, class CommandListVariable> CommandListV
 extern CommandListVariables command_list_globals;
 extern std::vector<CommandListVariable*> persistent_variables;
 
+class CommandListOperand;
+
+// One instruction of a compiled command list. See CommandListOpcode in
+// CommandListOperators.h for the overview:
+struct CommandListInstruction {
+	CommandListOpcode op;
+	union {
+		float val;
+		float *ftarget;
+		CommandListVariable *var;
+		CommandListOperand *operand;
+		CommandListCommand *command;
+		size_t target;       // Instruction index for jumps
+		struct {
+			int idx;
+			float DirectX::XMFLOAT4::*component;
+		} param;
+	};
+};
+
+typedef std::vector<CommandListInstruction> CommandListProgram;
+
 // The scope object is used to declare local variables in a command list. The
 // multiple levels are to isolate variables declared inside if blocks from
 // being accessed in a parent or sibling scope, while allowing variables
@@ -150,6 +177,10 @@ public:
 	std::forward_list<CommandListVariable> static_vars;
 	CommandListScope *scope;
 
+	// Flattened form of the commands, built once optimisation is complete
+	// and only valid to run for the same pre/post as the command list:
+	CommandListProgram program;
+
 	// For performance metrics:
 	wstring ini_section;
 	bool post;
@@ -280,6 +311,17 @@ static EnumName_t<const wchar_t *, D3DCompileFlags> D3DCompileFlagNames[] = {
 	{NULL, D3DCompileFlags::INVALID} // End of list marker
 };
 
+// A file something was built from and its last write time at the time, so
+// that a config reload can tell whether it is safe to reuse the result:
+struct FileDependency
+{
+	wstring path;
+	FILETIME timestamp;
+};
+
+bool get_file_dependency(const wchar_t *path, FileDependency *dep);
+bool file_dependencies_unchanged(const std::vector<FileDependency> *deps);
+
 class CustomShader
 {
 public:
@@ -328,10 +370,16 @@ public:
 	unsigned frame_no;
 	int executions_this_frame;
 
+	// Set by the ini parser if every shader in this section compiled, in
+	// which case dependencies lists every file that went into them:
+	uint32_t reload_fingerprint;
+	std::vector<FileDependency> dependencies;
+
 	CustomShader();
 	~CustomShader();
 
 	bool compile(char type, wchar_t *filename, const wstring *wname, const wstring *mod_namespace);
+	void adopt_shaders(CustomShader *old);
 	void substantiate(ID3D11Device *mOrigDevice);
 
 	void merge_blend_states(ID3D11BlendState *state, FLOAT blend_factor[4], UINT sample_mask, ID3D11Device *mOrigDevice);
@@ -534,6 +582,17 @@ public:
 	void *initial_data;
 	size_t initial_data_size;
 
+	// For reusing a texture loaded from a file over a config reload. A
+	// texture is only passed on if nothing could have written to it, and
+	// is only used if it would have been loaded with the same flags:
+	uint32_t reload_fingerprint;
+	FILETIME file_timestamp;
+	bool written;
+	ID3D11Resource *reload_resource;
+	ID3D11Device *reload_device;
+	D3D11_BIND_FLAG reload_bind_flags;
+	D3D11_RESOURCE_MISC_FLAG reload_misc_flags;
+
 	CustomResource();
 	~CustomResource();
 
@@ -545,6 +604,8 @@ public:
 	void OverrideTexDesc(D3D11_TEXTURE3D_DESC *desc);
 	void OverrideOutOfBandInfo(DXGI_FORMAT *format, UINT *stride);
 	void expire(ID3D11Device *mOrigDevice1, ID3D11DeviceContext *mOrigContext1);
+	bool can_pass_on_file_resource();
+	void pass_on_file_resource(CustomResource *to);
 
 private:
 	void LoadFromFile(ID3D11Device *mOrigDevice);
@@ -817,6 +878,7 @@ public:
 
 	static const wchar_t* pattern() { return L"<IMPLEMENT ME>"; }
 	virtual float evaluate(float lhs, float rhs) = 0;
+	virtual CommandListOpcode opcode() = 0;
 };
 
 // Abstract base factory class for defining operators. Statically instantiate
@@ -1000,10 +1062,15 @@ class CommandListExpression {
 public:
 	std::shared_ptr<CommandListEvaluatable> evaluatable;
 
+	// Postfix form of the evaluatable, built by optimise(). Empty if the
+	// expression could not be compiled, in which case the tree is used:
+	CommandListProgram program;
+
 	bool parse(const wstring *expression, const wstring *ini_namespace, CommandListScope *scope);
 	float evaluate(CommandListState *state, HackerDevice *device=NULL);
 	bool static_evaluate(float *ret, HackerDevice *device=NULL);
 	bool optimise(HackerDevice *device);
+	bool compile();
 };
 
 class AssignmentCommand : public CommandListCommand {
@@ -1304,5 +1371,6 @@ bool ParseCommandListFlowControl(const wchar_t *section, const wstring *line,
 std::shared_ptr<RunLinkedCommandList>
 		LinkCommandLists(CommandList *dst, CommandList *link, const wstring *ini_line);
 void optimise_command_lists(HackerDevice *device);
+void recompile_command_list(CommandList *command_list);
 bool parse_command_list_var_name(const wstring &name, const wstring *ini_namespace, CommandListVariable **target);
 bool valid_variable_name(const wstring &name);
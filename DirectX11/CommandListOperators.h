@@ -0,0 +1,164 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <limits>
+
+// The arithmetic behind the command list expression operators, and the parts
+// of the bytecode compiler and interpreter that deal with them. This has no
+// dependencies on the rest of the DX11 wrapper so that cmd_DirectX11Tests can
+// check the compiled form of random expressions against the tree evaluation
+// without a device or any live state - see --verify-command-list-expressions.
+
+// Command lists and expressions are lowered into a flat array of these
+// instructions once the optimiser has finished with them, so that running a
+// command list that consists mostly of variable assignments, ini param
+// overrides and if blocks is a tight loop over a vector rather than a chain
+// of virtual calls through shared_ptrs. Expression operands are pushed onto a
+// small stack and operators work on the top of it, so an expression becomes
+// its postfix form. Anything that does not have a dedicated opcode is run
+// through its regular virtual function, and the tree is always kept around
+// as a fallback for when frame analysis, debug logging or profiling needs to
+// see each command individually.
+enum class CommandListOpcode : unsigned char {
+	// Push a value onto the stack:
+	PUSH_CONSTANT,
+	PUSH_VARIABLE,
+	PUSH_INI_PARAM,
+	PUSH_OPERAND,        // Anything needing CommandListOperand::evaluate()
+
+	// Replace the top value on the stack:
+	NOT,
+	PLUS,
+	NEGATE,
+
+	// Replace the top two values on the stack:
+	EXPONENT,
+	MULTIPLY,
+	DIVIDE,
+	FLOOR_DIVIDE,
+	MODULUS,
+	ADD,
+	SUBTRACT,
+	LESS,
+	LESS_EQUAL,
+	GREATER,
+	GREATER_EQUAL,
+	EQUAL,
+	NOT_EQUAL,
+	IDENTICAL,
+	NOT_IDENTICAL,
+	AND,
+	OR,
+
+	// Pop the top value from the stack:
+	STORE_VARIABLE,
+	STORE_PERSISTENT_VARIABLE,
+	STORE_INI_PARAM,
+	JUMP_IF_FALSE,
+
+	JUMP,
+	RUN_COMMAND,         // Anything else, via CommandListCommand::run()
+};
+
+// Deep enough for any expression anyone is likely to write - an expression
+// needing more than this is left as a tree:
+#define COMMAND_LIST_STACK_SIZE 32
+
+// X(name, opcode, operands, operation) for every expression operator. Unary
+// operators only have a right hand side, and get NAN for the left. The
+// operation is pulled out into a function so that the bytecode interpreter is
+// guaranteed to do exactly the same thing as the tree. The parser side of each
+// operator (pattern, precedence) is DEFINE_OPERATOR in CommandList.cpp.
+#define COMMAND_LIST_OPERATORS(X) \
+	X(unary_not_operator,      NOT,           1, (!rhs)) \
+	X(unary_plus_operator,     PLUS,          1, (+rhs)) \
+	X(unary_negate_operator,   NEGATE,        1, (-rhs)) \
+	X(exponent_operator,       EXPONENT,      2, (pow(lhs, rhs))) \
+	X(multiplication_operator, MULTIPLY,      2, (lhs * rhs)) \
+	X(division_operator,       DIVIDE,        2, (lhs / rhs)) \
+	X(floor_division_operator, FLOOR_DIVIDE,  2, (floor(lhs / rhs))) \
+	X(modulus_operator,        MODULUS,       2, (fmod(lhs, rhs))) \
+	X(addition_operator,       ADD,           2, (lhs + rhs)) \
+	X(subtraction_operator,    SUBTRACT,      2, (lhs - rhs)) \
+	X(less_operator,           LESS,          2, (lhs < rhs)) \
+	X(less_equal_operator,     LESS_EQUAL,    2, (lhs <= rhs)) \
+	X(greater_operator,        GREATER,       2, (lhs > rhs)) \
+	X(greater_equal_operator,  GREATER_EQUAL, 2, (lhs >= rhs)) \
+	X(equality_operator,       EQUAL,         2, (lhs == rhs)) \
+	X(inequality_operator,     NOT_EQUAL,     2, (lhs != rhs)) \
+	X(identical_operator,      IDENTICAL,     2, (*(uint32_t*)&lhs == *(uint32_t*)&rhs)) \
+	X(not_identical_operator,  NOT_IDENTICAL, 2, (*(uint32_t*)&lhs != *(uint32_t*)&rhs)) \
+	X(and_operator,            AND,           2, (lhs && rhs)) \
+	X(or_operator,             OR,            2, (lhs || rhs))
+
+#define COMMAND_LIST_OPERATOR_FN(name, op, operands, fn) \
+	static inline float name##_fn(float lhs, float rhs) { return (fn); } \
+	static const CommandListOpcode name##_opcode = CommandListOpcode::op;
+COMMAND_LIST_OPERATORS(COMMAND_LIST_OPERATOR_FN)
+#undef COMMAND_LIST_OPERATOR_FN
+
+// Switch cases for an interpreter loop, applying an operator opcode to the top
+// of the stack at sp (which points one past the top value):
+#define COMMAND_LIST_OPERATOR_CASE(name, op, operands, fn) \
+	case CommandListOpcode::op: \
+		sp -= (operands) - 1; \
+		sp[-1] = name##_fn((operands) == 1 ? std::numeric_limits<float>::quiet_NaN() : sp[-1], \
+				sp[(operands) - 2]); \
+		break;
+#define COMMAND_LIST_OPERATOR_CASES COMMAND_LIST_OPERATORS(COMMAND_LIST_OPERATOR_CASE)
+
+// Returns the function implementing an operator opcode, for anything that
+// needs to evaluate an expression the way the tree does:
+typedef float (*CommandListOperatorFn)(float lhs, float rhs);
+static inline CommandListOperatorFn command_list_operator_fn(CommandListOpcode opcode)
+{
+	switch (opcode) {
+#define COMMAND_LIST_OPERATOR_FN_CASE(name, op, operands, fn) \
+	case CommandListOpcode::op: return name##_fn;
+	COMMAND_LIST_OPERATORS(COMMAND_LIST_OPERATOR_FN_CASE)
+#undef COMMAND_LIST_OPERATOR_FN_CASE
+	default: return NULL;
+	}
+}
+
+// Appends the postfix form of an expression tree to a program. Traits tells us
+// how to take the tree apart:
+//
+//   bool Traits::push(Node*, Program*)
+//     If the node is an operand, append the instruction pushing it and return
+//     true, otherwise return false.
+//   bool Traits::split(Node*, Node **lhs, CommandListOpcode*, Node **rhs)
+//     Fill in the operands (lhs is NULL for unary operators) and opcode of an
+//     operator. Return false if the node is neither an operand nor operator.
+//   void Traits::emit(CommandListOpcode, Program*)
+//     Append an operator instruction.
+//
+// depth tracks the number of values on the stack, which must end up as one,
+// and max_depth the most there will ever be, which must fit in
+// COMMAND_LIST_STACK_SIZE - it is up to the caller to check both.
+template <class Traits, class Node, class Program>
+static bool compile_command_list_expression(Node *node, Program *program, int *depth, int *max_depth)
+{
+	CommandListOpcode op;
+	Node *lhs, *rhs;
+
+	if (Traits::push(node, program)) {
+		if (++*depth > *max_depth)
+			*max_depth = *depth;
+		return true;
+	}
+
+	if (!Traits::split(node, &lhs, &op, &rhs) || !rhs)
+		return false;
+
+	if (lhs && !compile_command_list_expression<Traits>(lhs, program, depth, max_depth))
+		return false;
+	if (!compile_command_list_expression<Traits>(rhs, program, depth, max_depth))
+		return false;
+
+	Traits::emit(op, program);
+	if (lhs)
+		--*depth;
+	return true;
+}
@@ -6,6 +6,7 @@
 #include "HookedDXGI.h"
 
 #include "nvprofile.h"
+#include "ShaderRegex.h"
 
 //#include <Shlobj.h>
 //#include <Winuser.h>
@@ -439,6 +440,9 @@ void InitD311()
 	InitializeCriticalSectionPretty(&G->mCriticalSection);
 	InitializeCriticalSectionPretty(&G->mResourcesLock);
 	InitializeCriticalSectionPretty(&resource_creation_mode_lock);
+	G->frame_analysis_archive.init();
+	G->frame_analysis_writer.init();
+	shader_regex_workers.init();
 
 	InitializeDLL();
 	
@@ -216,11 +216,12 @@ static bool verify_intended_target(HINSTANCE our_dll)
 	// also don't want to blanket pass rundll32 since the injector approach
 	// could get us into unrelated rundlls the same as anything else.
 	// For this case we will check if the command line contains our profile
-	// helper entry point. We won't bother with any further checks if it
-	// doesn't match, because the profile helper is the only reason we
-	// would ever want to be running inside rundll.
+	// helper or draw call benchmark entry point. We won't bother with any
+	// further checks if it doesn't match, because these are the only
+	// reasons we would ever want to be running inside rundll.
 	if (!_wcsicmp(exe_basename, L"rundll32.exe"))
-		return !!wcsstr(GetCommandLine(), L",Install3DMigotoDriverProfile ");
+		return !!wcsstr(GetCommandLine(), L",Install3DMigotoDriverProfile ")
+			|| !!wcsstr(GetCommandLine(), L",RunDrawBenchmark");
 
 	// Otherwise we are being loaded into some random task, and we need to
 	// filter ourselves out of any tasks that are not the intended target
@@ -358,7 +359,7 @@ BOOL WINAPI DllMain(
 				// for now just release the TLS structure from
 				// the current thread (if allocated) and
 				// release the TLS index allocated for the DLL.
-				delete TlsGetValue(tls_idx);
+				delete (TLS*)TlsGetValue(tls_idx);
 				TlsFree(tls_idx);
 			}
 			DestroyDLL();
@@ -376,7 +377,7 @@ BOOL WINAPI DllMain(
 
 		case DLL_THREAD_DETACH:
 			// Do thread-specific cleanup.
-			delete TlsGetValue(tls_idx);
+			delete (TLS*)TlsGetValue(tls_idx);
 			break;
 	}
 
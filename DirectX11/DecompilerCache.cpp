@@ -0,0 +1,158 @@
+#include "DecompilerCache.h"
+#include "MappedCache.h"
+
+#include "globals.h"
+#include "log.h"
+#include "util.h"
+#include "version.h"
+
+#include <algorithm>
+
+// Bump this if the layout of the cached blobs changes:
+#define DECOMPILER_CACHE_FORMAT 1
+
+// Blob flags:
+#define DECOMPILER_CACHE_PATCHED 0x1
+
+static MappedCache decompiler_cache("3DMDECMP", DECOMPILER_CACHE_FORMAT);
+static UINT64 decompiler_settings_hash;
+static UINT64 decompiler_version_hash;
+
+static void hash_setting(std::string *buf, const std::string &val)
+{
+	// Include the length so adjacent settings can't alias each other:
+	buf->append((char*)&val.size(), sizeof(size_t));
+	buf->append(val);
+}
+
+static void hash_setting(std::string *buf, const std::vector<std::string> &vals)
+{
+	size_t count = vals.size();
+
+	buf->append((char*)&count, sizeof(size_t));
+	for (const std::string &val : vals)
+		hash_setting(buf, val);
+}
+
+// Everything in DecompilerSettings can change the decompiler output, so all of
+// it has to be part of the key. Remember to update this if adding a setting.
+static UINT64 hash_decompiler_settings(DecompilerSettings *d)
+{
+	std::string buf;
+
+	buf.append((char*)&d->StereoParamsReg, sizeof(d->StereoParamsReg));
+	buf.append((char*)&d->IniParamsReg, sizeof(d->IniParamsReg));
+	buf.append((char*)&d->fixSvPosition, sizeof(d->fixSvPosition));
+	buf.append((char*)&d->recompileVs, sizeof(d->recompileVs));
+	buf.append((char*)&d->ZRepair_DepthTextureReg1, sizeof(d->ZRepair_DepthTextureReg1));
+	buf.append((char*)&d->ZRepair_DepthTextureReg2, sizeof(d->ZRepair_DepthTextureReg2));
+	buf.append((char*)&d->ZRepair_DepthBuffer, sizeof(d->ZRepair_DepthBuffer));
+	hash_setting(&buf, d->ZRepair_DepthTexture1);
+	hash_setting(&buf, d->ZRepair_DepthTexture2);
+	hash_setting(&buf, d->ZRepair_Dependencies1);
+	hash_setting(&buf, d->ZRepair_Dependencies2);
+	hash_setting(&buf, d->ZRepair_ZPosCalc1);
+	hash_setting(&buf, d->ZRepair_ZPosCalc2);
+	hash_setting(&buf, d->ZRepair_PositionTexture);
+	hash_setting(&buf, d->InvTransforms);
+	hash_setting(&buf, d->ZRepair_WorldPosCalc);
+	hash_setting(&buf, d->BackProject_Vector1);
+	hash_setting(&buf, d->BackProject_Vector2);
+	hash_setting(&buf, d->ObjectPos_ID1);
+	hash_setting(&buf, d->ObjectPos_ID2);
+	hash_setting(&buf, d->ObjectPos_MUL1);
+	hash_setting(&buf, d->ObjectPos_MUL2);
+	hash_setting(&buf, d->MatrixPos_ID1);
+	hash_setting(&buf, d->MatrixPos_MUL1);
+
+	return xxhash64_buf(buf.data(), buf.size());
+}
+
+// Called after the [Rendering] section has been parsed, including on config
+// reload. The cache is only opened if something is going to use the
+// decompiler, so nothing is created in ShaderCache for regular users.
+void configure_decompiler_cache()
+{
+	static const struct {
+		int decompiler;
+		char release[sizeof(VER_FILE_VERSION_STR)];
+	} version = { DECOMPILER_CACHE_VERSION, VER_FILE_VERSION_STR };
+
+	decompiler_settings_hash = hash_decompiler_settings(&G->decompiler_settings);
+	decompiler_version_hash = xxhash64_buf(&version, sizeof(version));
+
+	if (!G->decompiler_cache || !G->SHADER_CACHE_PATH[0]) {
+		close_decompiler_cache();
+		return;
+	}
+
+	if (!G->EXPORT_HLSL && !G->decompiler_settings.fixSvPosition &&
+	    !G->decompiler_settings.recompileVs && !G->hunting)
+		return;
+
+	decompiler_cache.open(G->SHADER_CACHE_PATH, L"DecompilerCache");
+}
+
+void close_decompiler_cache()
+{
+	decompiler_cache.close();
+}
+
+static void decompiler_cache_key(const void *bytecode, SIZE_T length, MappedCacheKey *key)
+{
+	// The 3DMigoto shader hash depends on the shader_hash setting and
+	// doesn't necessarily cover the whole shader, so use our own. A second
+	// independent hash of the whole bytecode keeps the chance of a
+	// collision returning the wrong shader's HLSL negligible:
+	key->hash = xxhash64_buf(bytecode, length);
+	key->qualifier1 = (UINT64)crc32c_hw(0, bytecode, length) << 32 | (uint32_t)length;
+	key->qualifier2 = decompiler_settings_hash ^ decompiler_version_hash;
+}
+
+bool load_decompiler_cache(const void *bytecode, SIZE_T length,
+		std::string *hlsl, std::string *shader_model, bool *patched)
+{
+	std::vector<byte> blob;
+	MappedCacheKey key;
+	uint32_t flags;
+	size_t sep;
+
+	if (!decompiler_cache.is_open())
+		return false;
+
+	decompiler_cache_key(bytecode, length, &key);
+	if (!decompiler_cache.lookup(&key, &blob, &flags))
+		return false;
+
+	// Blob is the shader model, a NULL separator, then the HLSL:
+	sep = std::find(blob.begin(), blob.end(), 0) - blob.begin();
+	if (sep == blob.size())
+		return false;
+
+	shader_model->assign((char*)blob.data(), sep);
+	hlsl->assign((char*)blob.data() + sep + 1, blob.size() - sep - 1);
+	*patched = !!(flags & DECOMPILER_CACHE_PATCHED);
+
+	LogInfo("    using cached HLSL representation.\n");
+	return true;
+}
+
+void save_decompiler_cache(const void *bytecode, SIZE_T length,
+		const std::string *hlsl, const std::string *shader_model, bool patched)
+{
+	std::string blob;
+	MappedCacheKey key;
+
+	if (!decompiler_cache.is_open())
+		return;
+
+	decompiler_cache_key(bytecode, length, &key);
+
+	blob.reserve(shader_model->size() + 1 + hlsl->size());
+	blob.append(*shader_model);
+	blob.push_back('\0');
+	blob.append(*hlsl);
+
+	decompiler_cache.store(&key, blob.data(), (uint32_t)blob.size(),
+			patched ? DECOMPILER_CACHE_PATCHED : 0);
+}
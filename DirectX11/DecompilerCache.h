@@ -0,0 +1,17 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+
+// Persistent cache of the HLSL decompiler's output, keyed by the shader's
+// bytecode, the decompiler settings in the d3dx.ini, DECOMPILER_CACHE_VERSION
+// and the 3DMigoto version. Stored in the ShaderCache directory
+// so that repeat launches with export_hlsl or the auto-fix options enabled can
+// skip the decompiler for any shader they have already seen.
+
+void configure_decompiler_cache();
+void close_decompiler_cache();
+bool load_decompiler_cache(const void *bytecode, SIZE_T length,
+		std::string *hlsl, std::string *shader_model, bool *patched);
+void save_decompiler_cache(const void *bytecode, SIZE_T length,
+		const std::string *hlsl, const std::string *shader_model, bool patched);
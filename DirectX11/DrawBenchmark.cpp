@@ -0,0 +1,410 @@
+// Headless benchmark of the per-draw overhead of 3DMigoto's hooking layer -
+// HackerContext's SetShader / SetShaderResources wrappers, BeforeDraw and
+// AfterDraw, the ShaderOverride and TextureOverride lookups and command list
+// execution. The Profiling overlay can only measure these in a running game,
+// which makes it hard to compare two builds, so this drives the real
+// HackerDevice and HackerContext against the stand in device and context from
+// DrawBenchmarkStubs.h with a synthetic d3dx.ini and draw stream, and reports
+// the time per draw call. Everything below the stubs is the same code the
+// game would run.
+//
+// Run it from a console with rundll32, which finds the W entry point itself:
+//
+//   rundll32 d3d11.dll,RunDrawBenchmark shader_overrides=200 commands=16
+//
+// Options (all optional, key=value):
+//   draws=N              Draw calls per measurement (default 2000000)
+//   shaders=N            Vertex and pixel shaders each (default 1000)
+//   shader_overrides=N   [ShaderOverride] sections, split between the
+//                        vertex and pixel shaders (default 100)
+//   textures=N           Textures bound to ps-t0 (default 1000)
+//   texture_overrides=N  [TextureOverride] sections (default 100)
+//   commands=N           Commands in each override's command list. If there
+//                        are any TextureOverrides, one of each
+//                        ShaderOverride's commands is checktextureoverride
+//                        (default 8)
+//   hunting=N            Hunting mode, which also swaps in the
+//                        FrameAnalysisContext (default 0)
+//   dump_usage=N         Collect the ShaderUsage.txt stats while hunting.
+//                        There is no present, so they are consolidated
+//                        whenever the context's ring fills up (default 0)
+//
+// The results are printed to the console rundll32 was started from and saved
+// in d3d11_benchmark_log.txt next to the DLL. Each run reports the stubs on
+// their own (the cost of the virtual calls), then through HackerContext with
+// an empty config and with the synthetic config - the difference is what we
+// add to every draw call in a game.
+
+#include <string>
+#include <vector>
+#include <set>
+#include <stdio.h>
+#include <stdarg.h>
+#include <share.h>
+
+#include "DrawBenchmarkStubs.h"
+#include "HackerDevice.h"
+#include "HackerContext.h"
+#include "IniHandler.h"
+#include "CommandList.h"
+#include "globals.h"
+#include "log.h"
+#include "lock.h"
+#include "version.h"
+
+// Draws are replayed from a stream of this many, roughly a frame's worth:
+#define DRAW_BENCHMARK_FRAME_DRAWS 4096
+
+// Global variables the synthetic command lists assign to:
+#define DRAW_BENCHMARK_VARIABLES 8
+
+struct DrawBenchmarkOptions {
+	unsigned draws;
+	unsigned shaders;
+	unsigned shader_overrides;
+	unsigned textures;
+	unsigned texture_overrides;
+	unsigned commands;
+	unsigned hunting;
+	unsigned dump_usage;
+
+	DrawBenchmarkOptions() :
+		draws(2000000),
+		shaders(1000),
+		shader_overrides(100),
+		textures(1000),
+		texture_overrides(100),
+		commands(8),
+		hunting(0),
+		dump_usage(0)
+	{}
+};
+
+struct DrawBenchmarkDraw {
+	ID3D11VertexShader *vs;
+	ID3D11PixelShader *ps;
+	ID3D11ShaderResourceView *srv;
+};
+
+static bool benchmark_console;
+
+static void benchmark_printf(char *fmt, ...)
+{
+	va_list ap;
+
+	if (benchmark_console) {
+		va_start(ap, fmt);
+		vprintf(fmt, ap);
+		va_end(ap);
+		fflush(stdout);
+	}
+
+	va_start(ap, fmt);
+	vLogInfo(fmt, ap);
+	va_end(ap);
+}
+
+static void ini_printf(std::string *ini, char *fmt, ...)
+{
+	char buf[256];
+	va_list ap;
+
+	va_start(ap, fmt);
+	_vsnprintf_s(buf, sizeof(buf), _TRUNCATE, fmt, ap);
+	va_end(ap);
+
+	ini->append(buf);
+}
+
+static uint64_t benchmark_rand(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static bool parse_benchmark_options(LPWSTR cmdline, DrawBenchmarkOptions *opts)
+{
+	wchar_t *token, *val, *next = NULL;
+	unsigned *opt;
+
+	for (token = wcstok_s(cmdline, L" \t", &next); token; token = wcstok_s(NULL, L" \t", &next)) {
+		val = wcschr(token, L'=');
+		if (!val) {
+			benchmark_printf("Malformed option: %S\n", token);
+			return false;
+		}
+		*(val++) = L'\0';
+
+		if (!_wcsicmp(token, L"draws"))
+			opt = &opts->draws;
+		else if (!_wcsicmp(token, L"shaders"))
+			opt = &opts->shaders;
+		else if (!_wcsicmp(token, L"shader_overrides"))
+			opt = &opts->shader_overrides;
+		else if (!_wcsicmp(token, L"textures"))
+			opt = &opts->textures;
+		else if (!_wcsicmp(token, L"texture_overrides"))
+			opt = &opts->texture_overrides;
+		else if (!_wcsicmp(token, L"commands"))
+			opt = &opts->commands;
+		else if (!_wcsicmp(token, L"hunting"))
+			opt = &opts->hunting;
+		else if (!_wcsicmp(token, L"dump_usage"))
+			opt = &opts->dump_usage;
+		else {
+			benchmark_printf("Unknown option: %S\n", token);
+			return false;
+		}
+
+		*opt = wcstoul(val, NULL, 0);
+	}
+
+	if (!opts->draws || !opts->shaders || !opts->textures) {
+		benchmark_printf("draws, shaders and textures must not be zero\n");
+		return false;
+	}
+	if (opts->shader_overrides > opts->shaders * 2) {
+		benchmark_printf("shader_overrides cannot exceed twice the number of shaders\n");
+		return false;
+	}
+	if (opts->texture_overrides > opts->textures) {
+		benchmark_printf("texture_overrides cannot exceed the number of textures\n");
+		return false;
+	}
+
+	return true;
+}
+
+// Override i applies to vertex shader i/2 if i is even, otherwise pixel
+// shader i/2, so both get their share whatever the count:
+static std::string generate_benchmark_ini(DrawBenchmarkOptions *opts,
+		std::vector<UINT64> *vs_hashes, std::vector<UINT64> *ps_hashes,
+		std::vector<uint32_t> *texture_hashes)
+{
+	std::string ini;
+	unsigned i, j, first;
+	UINT64 hash;
+
+	ini_printf(&ini, "[Constants]\n");
+	for (i = 0; i < DRAW_BENCHMARK_VARIABLES; i++)
+		ini_printf(&ini, "global $bench%u = 0\n", i);
+
+	for (i = 0; i < opts->shader_overrides; i++) {
+		hash = (i & 1) ? (*ps_hashes)[i / 2] : (*vs_hashes)[i / 2];
+		ini_printf(&ini, "[ShaderOverrideBench%u]\nhash = %016llx\n", i, hash);
+
+		first = 0;
+		if (opts->texture_overrides && opts->commands) {
+			ini_printf(&ini, "checktextureoverride = ps-t0\n");
+			first = 1;
+		}
+		for (j = first; j < opts->commands; j++) {
+			ini_printf(&ini, "%s$bench%u = $bench%u + 1\n", (j & 1) ? "post " : "",
+					j % DRAW_BENCHMARK_VARIABLES, j % DRAW_BENCHMARK_VARIABLES);
+		}
+	}
+
+	for (i = 0; i < opts->texture_overrides; i++) {
+		ini_printf(&ini, "[TextureOverrideBench%u]\nhash = %08x\n", i, (*texture_hashes)[i]);
+		for (j = 0; j < opts->commands; j++) {
+			ini_printf(&ini, "%s$bench%u = $bench%u * 0.5\n", (j & 1) ? "post " : "",
+					j % DRAW_BENCHMARK_VARIABLES, j % DRAW_BENCHMARK_VARIABLES);
+		}
+	}
+
+	return ini;
+}
+
+static double time_draws(ID3D11DeviceContext *context, std::vector<DrawBenchmarkDraw> *frame, unsigned draws)
+{
+	LARGE_INTEGER freq, start, end;
+	DrawBenchmarkDraw *draw;
+	unsigned i;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&start);
+
+	for (i = 0; i < draws; i++) {
+		draw = &(*frame)[i % frame->size()];
+		context->VSSetShader(draw->vs, NULL, 0);
+		context->PSSetShader(draw->ps, NULL, 0);
+		context->PSSetShaderResources(0, 1, &draw->srv);
+		context->DrawIndexed(3, 0, 0);
+	}
+
+	QueryPerformanceCounter(&end);
+
+	return (double)(end.QuadPart - start.QuadPart) * 1000000000.0 / freq.QuadPart / draws;
+}
+
+static double run_draws(char *name, ID3D11DeviceContext *context, BenchmarkContext *stub_context,
+		std::vector<DrawBenchmarkDraw> *frame, unsigned draws)
+{
+	UINT64 draw_calls;
+	double ns;
+
+	// One frame to warm up the caches and let any lazily created state
+	// get created before we start timing:
+	time_draws(context, frame, (unsigned)frame->size());
+
+	draw_calls = stub_context->draw_calls;
+	ns = time_draws(context, frame, draws);
+	draw_calls = stub_context->draw_calls - draw_calls;
+
+	benchmark_printf("  %-32s %8.1f ns/draw", name, ns);
+	if (draw_calls != draws)
+		benchmark_printf(" (%llu draws skipped)", draws - draw_calls);
+	benchmark_printf("\n");
+
+	return ns;
+}
+
+static void open_benchmark_log()
+{
+	wchar_t path[MAX_PATH];
+
+	if (!GetModuleFileName(migoto_handle, path, MAX_PATH))
+		return;
+	wcsrchr(path, L'\\')[1] = 0;
+	wcscat_s(path, MAX_PATH, L"d3d11_benchmark_log.txt");
+
+	LogFile = _wfsopen(path, L"w", _SH_DENYNO);
+}
+
+// rundll entry point. Like the profile helper this runs in its own process and
+// follows its own init path - no nvapi, no hooks on the device and no real
+// d3d11.dll, so it only sets up the parts of the globals the draw path uses.
+void CALLBACK RunDrawBenchmarkW(HWND hwnd, HINSTANCE hinst, LPWSTR lpszCmdLine, int nCmdShow)
+{
+	DrawBenchmarkOptions opts;
+	BenchmarkDevice device;
+	BenchmarkContext context(&device);
+	HackerDevice *hacker_device;
+	HackerContext *hacker_context;
+	std::vector<BenchmarkDeviceChild<ID3D11VertexShader>*> vertex_shaders;
+	std::vector<BenchmarkDeviceChild<ID3D11PixelShader>*> pixel_shaders;
+	std::vector<BenchmarkShaderResourceView*> srvs;
+	std::vector<UINT64> vs_hashes, ps_hashes;
+	std::vector<uint32_t> texture_hashes;
+	std::set<UINT64> used_shader_hashes;
+	std::set<uint32_t> used_texture_hashes;
+	std::vector<DrawBenchmarkDraw> frame;
+	D3D11_TEXTURE2D_DESC tex_desc = {};
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	BenchmarkTexture2D *texture;
+	ResourceHandleInfo *handle_info;
+	DrawBenchmarkDraw draw;
+	uint64_t rand_state = 0x2545f4914f6cdd1dULL;
+	unsigned i, vs_idx, ps_idx, tex_idx, so_hits = 0, to_hits = 0;
+	double stub_ns, empty_ns, config_ns;
+	std::string ini;
+	UINT64 hash;
+	FILE *f;
+
+	if (AttachConsole(ATTACH_PARENT_PROCESS) && !freopen_s(&f, "CONOUT$", "w", stdout))
+		benchmark_console = true;
+	open_benchmark_log();
+
+	if (!parse_benchmark_options(lpszCmdLine, &opts))
+		return;
+
+	G->gInitialized = true;
+	G->hunting = opts.hunting ? HUNTING_MODE_ENABLED : HUNTING_MODE_DISABLED;
+	G->DumpUsage = !!opts.dump_usage;
+	InitializeCriticalSectionPretty(&G->mCriticalSection);
+	InitializeCriticalSectionPretty(&G->mResourcesLock);
+
+	device.context = &context;
+
+	// The shaders and textures are registered the same way HackerDevice
+	// does when the game creates them, minus the hashing:
+	for (i = 0; i < opts.shaders; i++) {
+		do {
+			hash = benchmark_rand(&rand_state);
+		} while (!used_shader_hashes.insert(hash).second);
+		vertex_shaders.push_back(new BenchmarkDeviceChild<ID3D11VertexShader>(&device));
+		vs_hashes.push_back(hash);
+		G->mShaders[vertex_shaders.back()] = hash;
+
+		do {
+			hash = benchmark_rand(&rand_state);
+		} while (!used_shader_hashes.insert(hash).second);
+		pixel_shaders.push_back(new BenchmarkDeviceChild<ID3D11PixelShader>(&device));
+		ps_hashes.push_back(hash);
+		G->mShaders[pixel_shaders.back()] = hash;
+	}
+
+	tex_desc.Width = tex_desc.Height = 256;
+	tex_desc.MipLevels = tex_desc.ArraySize = 1;
+	tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	tex_desc.SampleDesc.Count = 1;
+	tex_desc.Usage = D3D11_USAGE_DEFAULT;
+	tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	srv_desc.Format = tex_desc.Format;
+	srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Texture2D.MipLevels = 1;
+
+	for (i = 0; i < opts.textures; i++) {
+		do {
+			hash = benchmark_rand(&rand_state) >> 32;
+		} while (!used_texture_hashes.insert((uint32_t)hash).second);
+		texture = new BenchmarkTexture2D(&device, &tex_desc);
+		srvs.push_back(new BenchmarkShaderResourceView(&device, texture, &srv_desc));
+		texture_hashes.push_back((uint32_t)hash);
+
+		EnterCriticalSectionPretty(&G->mResourcesLock);
+			handle_info = G->mResources.insert(texture);
+			handle_info->type = D3D11_RESOURCE_DIMENSION_TEXTURE2D;
+			handle_info->hash = (uint32_t)hash;
+			handle_info->orig_hash = (uint32_t)hash;
+			handle_info->desc2D = tex_desc;
+		LeaveCriticalSection(&G->mResourcesLock);
+	}
+
+	for (i = 0; i < DRAW_BENCHMARK_FRAME_DRAWS; i++) {
+		vs_idx = (unsigned)(benchmark_rand(&rand_state) % opts.shaders);
+		ps_idx = (unsigned)(benchmark_rand(&rand_state) % opts.shaders);
+		tex_idx = (unsigned)(benchmark_rand(&rand_state) % opts.textures);
+		draw.vs = vertex_shaders[vs_idx];
+		draw.ps = pixel_shaders[ps_idx];
+		draw.srv = srvs[tex_idx];
+		frame.push_back(draw);
+
+		if (vs_idx * 2 < opts.shader_overrides || ps_idx * 2 + 1 < opts.shader_overrides) {
+			so_hits++;
+			if (tex_idx < opts.texture_overrides)
+				to_hits++;
+		}
+	}
+
+	hacker_device = new HackerDevice(&device, &context);
+	hacker_context = HackerContextFactory(&device, &context);
+	hacker_context->SetHackerDevice(hacker_device);
+	hacker_device->SetHackerContext(hacker_context);
+
+	benchmark_printf("\n3DMigoto draw call benchmark - v %s\n", VER_FILE_VERSION_STR);
+	benchmark_printf("  %u draws, %u vertex + %u pixel shaders, %u ShaderOverrides, %u textures,\n"
+			"  %u TextureOverrides, %u commands per override, hunting=%u, dump_usage=%u\n",
+			opts.draws, opts.shaders, opts.shaders, opts.shader_overrides, opts.textures,
+			opts.texture_overrides, opts.commands, opts.hunting, opts.dump_usage);
+	benchmark_printf("  %.1f%% of draws run a ShaderOverride, %.1f%% also a TextureOverride\n\n",
+			so_hits * 100.0 / frame.size(), to_hits * 100.0 / frame.size());
+
+	stub_ns = run_draws("stub device only", &context, &context, &frame, opts.draws);
+
+	LoadBenchmarkConfig("");
+	optimise_command_lists(hacker_device);
+	empty_ns = run_draws("HackerContext, empty config", hacker_context, &context, &frame, opts.draws);
+
+	ini = generate_benchmark_ini(&opts, &vs_hashes, &ps_hashes, &texture_hashes);
+	LoadBenchmarkConfig(ini.c_str());
+	optimise_command_lists(hacker_device);
+	config_ns = run_draws("HackerContext, synthetic config", hacker_context, &context, &frame, opts.draws);
+
+	benchmark_printf("\n  Overhead per draw: %.1f ns with an empty config, %.1f ns with the synthetic config\n",
+			empty_ns - stub_ns, config_ns - stub_ns);
+
+	// Nothing is freed - the process exits as soon as we return
+}
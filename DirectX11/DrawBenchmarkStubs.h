@@ -0,0 +1,724 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <string.h>
+
+// Stand ins for the real device and context, so that the draw call benchmark
+// (DrawBenchmark.cpp) can drive HackerDevice and HackerContext without a GPU,
+// a window or the real d3d11.dll. Nothing here renders or creates anything -
+// every Create* fails with E_NOTIMPL, and the context only remembers the
+// shaders and shader resource views bound to it so that command lists and the
+// legacy filters read back whatever the draw stream set. Every other Get*
+// returns NULL. All of these objects are owned by the benchmark and are never
+// freed, the refcounts are only kept so the callers behave as they would with
+// the real thing.
+
+template <class Interface>
+class BenchmarkDeviceChild : public Interface
+{
+protected:
+	volatile LONG refs;
+	ID3D11Device *device;
+
+public:
+	BenchmarkDeviceChild(ID3D11Device *device) :
+		refs(1),
+		device(device)
+	{}
+
+	/*** IUnknown methods ***/
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppvObject)
+	{
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(ID3D11DeviceChild) || riid == __uuidof(Interface)) {
+			AddRef();
+			*ppvObject = this;
+			return S_OK;
+		}
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() { return InterlockedIncrement(&refs); }
+	ULONG STDMETHODCALLTYPE Release() { return InterlockedDecrement(&refs); }
+
+	/** ID3D11DeviceChild **/
+
+	void STDMETHODCALLTYPE GetDevice(ID3D11Device **ppDevice) { device->AddRef(); *ppDevice = device; }
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID guid, UINT *pDataSize, void *pData)
+		{ return DXGI_ERROR_NOT_FOUND; }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID guid, UINT DataSize, const void *pData)
+		{ return S_OK; }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID guid, const IUnknown *pData)
+		{ return S_OK; }
+};
+
+// Shaders have no methods of their own, so BenchmarkDeviceChild<ID3D11PixelShader>
+// etc. are used as is.
+
+class BenchmarkTexture2D : public BenchmarkDeviceChild<ID3D11Texture2D>
+{
+public:
+	D3D11_TEXTURE2D_DESC desc;
+
+	BenchmarkTexture2D(ID3D11Device *device, const D3D11_TEXTURE2D_DESC *desc) :
+		BenchmarkDeviceChild(device),
+		desc(*desc)
+	{}
+
+	void STDMETHODCALLTYPE GetType(D3D11_RESOURCE_DIMENSION *pResourceDimension)
+		{ *pResourceDimension = D3D11_RESOURCE_DIMENSION_TEXTURE2D; }
+	void STDMETHODCALLTYPE SetEvictionPriority(UINT EvictionPriority) {}
+	UINT STDMETHODCALLTYPE GetEvictionPriority() { return 0; }
+	void STDMETHODCALLTYPE GetDesc(D3D11_TEXTURE2D_DESC *pDesc) { *pDesc = desc; }
+};
+
+class BenchmarkShaderResourceView : public BenchmarkDeviceChild<ID3D11ShaderResourceView>
+{
+public:
+	ID3D11Resource *resource;
+	D3D11_SHADER_RESOURCE_VIEW_DESC desc;
+
+	BenchmarkShaderResourceView(ID3D11Device *device, ID3D11Resource *resource,
+			const D3D11_SHADER_RESOURCE_VIEW_DESC *desc) :
+		BenchmarkDeviceChild(device),
+		resource(resource),
+		desc(*desc)
+	{}
+
+	void STDMETHODCALLTYPE GetResource(ID3D11Resource **ppResource) { resource->AddRef(); *ppResource = resource; }
+	void STDMETHODCALLTYPE GetDesc(D3D11_SHADER_RESOURCE_VIEW_DESC *pDesc) { *pDesc = desc; }
+};
+
+class BenchmarkContext : public ID3D11DeviceContext1
+{
+private:
+	enum Stage { STAGE_VS, STAGE_HS, STAGE_DS, STAGE_GS, STAGE_PS, STAGE_CS, NUM_STAGES };
+
+	volatile LONG refs;
+	ID3D11Device1 *device;
+	ID3D11DeviceChild *shaders[NUM_STAGES];
+	ID3D11ShaderResourceView *srvs[NUM_STAGES][D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+
+	void set_shader(Stage stage, ID3D11DeviceChild *shader)
+	{
+		shaders[stage] = shader;
+	}
+
+	void get_shader(Stage stage, ID3D11DeviceChild **ppShader, UINT *pNumClassInstances)
+	{
+		if (ppShader) {
+			*ppShader = shaders[stage];
+			if (*ppShader)
+				(*ppShader)->AddRef();
+		}
+		if (pNumClassInstances)
+			*pNumClassInstances = 0;
+	}
+
+	void set_srvs(Stage stage, UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
+	{
+		UINT i;
+
+		for (i = 0; i < NumViews && StartSlot + i < D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT; i++)
+			srvs[stage][StartSlot + i] = ppShaderResourceViews ? ppShaderResourceViews[i] : NULL;
+	}
+
+	void get_srvs(Stage stage, UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView **ppShaderResourceViews)
+	{
+		UINT i;
+
+		for (i = 0; i < NumViews; i++) {
+			ppShaderResourceViews[i] = NULL;
+			if (StartSlot + i < D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT)
+				ppShaderResourceViews[i] = srvs[stage][StartSlot + i];
+			if (ppShaderResourceViews[i])
+				ppShaderResourceViews[i]->AddRef();
+		}
+	}
+
+	template <class T>
+	void get_nothing(UINT num, T **pp)
+	{
+		if (pp)
+			memset(pp, 0, sizeof(T*) * num);
+	}
+
+public:
+	// Draw calls that made it through to the "driver", so the benchmark
+	// can tell if any were skipped:
+	UINT64 draw_calls;
+
+	BenchmarkContext(ID3D11Device1 *device) :
+		refs(1),
+		device(device),
+		draw_calls(0)
+	{
+		memset(shaders, 0, sizeof(shaders));
+		memset(srvs, 0, sizeof(srvs));
+	}
+
+	/*** IUnknown methods ***/
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppvObject)
+	{
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(ID3D11DeviceChild) ||
+		    riid == __uuidof(ID3D11DeviceContext) || riid == __uuidof(ID3D11DeviceContext1)) {
+			AddRef();
+			*ppvObject = this;
+			return S_OK;
+		}
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() { return InterlockedIncrement(&refs); }
+	ULONG STDMETHODCALLTYPE Release() { return InterlockedDecrement(&refs); }
+
+	/** ID3D11DeviceChild **/
+
+	void STDMETHODCALLTYPE GetDevice(ID3D11Device **ppDevice)
+		{ device->AddRef(); *ppDevice = device; }
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID guid, UINT *pDataSize, void *pData)
+		{ return DXGI_ERROR_NOT_FOUND; }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID guid, UINT DataSize, const void *pData)
+		{ return S_OK; }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID guid, const IUnknown *pData)
+		{ return S_OK; }
+
+	/** ID3D11DeviceContext **/
+
+	void STDMETHODCALLTYPE VSSetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers)
+		{}
+	void STDMETHODCALLTYPE PSSetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView *const *ppShaderResourceViews)
+		{ set_srvs(STAGE_PS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE PSSetShader(ID3D11PixelShader *pPixelShader,
+			ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances)
+		{ set_shader(STAGE_PS, pPixelShader); }
+	void STDMETHODCALLTYPE PSSetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState *const *ppSamplers)
+		{}
+	void STDMETHODCALLTYPE VSSetShader(ID3D11VertexShader *pVertexShader,
+			ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances)
+		{ set_shader(STAGE_VS, pVertexShader); }
+	void STDMETHODCALLTYPE DrawIndexed(UINT IndexCount, UINT StartIndexLocation,
+			INT BaseVertexLocation)
+		{ draw_calls++; }
+	void STDMETHODCALLTYPE Draw(UINT VertexCount, UINT StartVertexLocation) { draw_calls++; }
+	HRESULT STDMETHODCALLTYPE Map(ID3D11Resource *pResource, UINT Subresource, D3D11_MAP MapType,
+			UINT MapFlags, D3D11_MAPPED_SUBRESOURCE *pMappedResource)
+		{ return E_NOTIMPL; }
+	void STDMETHODCALLTYPE Unmap(ID3D11Resource *pResource, UINT Subresource) {}
+	void STDMETHODCALLTYPE PSSetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers)
+		{}
+	void STDMETHODCALLTYPE IASetInputLayout(ID3D11InputLayout *pInputLayout) {}
+	void STDMETHODCALLTYPE IASetVertexBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppVertexBuffers, const UINT *pStrides,
+			const UINT *pOffsets)
+		{}
+	void STDMETHODCALLTYPE IASetIndexBuffer(ID3D11Buffer *pIndexBuffer, DXGI_FORMAT Format,
+			UINT Offset)
+		{}
+	void STDMETHODCALLTYPE DrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount,
+			UINT StartIndexLocation, INT BaseVertexLocation, UINT StartInstanceLocation)
+		{ draw_calls++; }
+	void STDMETHODCALLTYPE DrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount,
+			UINT StartVertexLocation, UINT StartInstanceLocation)
+		{ draw_calls++; }
+	void STDMETHODCALLTYPE GSSetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers)
+		{}
+	void STDMETHODCALLTYPE GSSetShader(ID3D11GeometryShader *pShader,
+			ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances)
+		{ set_shader(STAGE_GS, pShader); }
+	void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) {}
+	void STDMETHODCALLTYPE VSSetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView *const *ppShaderResourceViews)
+		{ set_srvs(STAGE_VS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE VSSetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState *const *ppSamplers)
+		{}
+	void STDMETHODCALLTYPE Begin(ID3D11Asynchronous *pAsync) {}
+	void STDMETHODCALLTYPE End(ID3D11Asynchronous *pAsync) {}
+	HRESULT STDMETHODCALLTYPE GetData(ID3D11Asynchronous *pAsync, void *pData, UINT DataSize,
+			UINT GetDataFlags)
+		{ return S_FALSE; }
+	void STDMETHODCALLTYPE SetPredication(ID3D11Predicate *pPredicate, BOOL PredicateValue) {}
+	void STDMETHODCALLTYPE GSSetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView *const *ppShaderResourceViews)
+		{ set_srvs(STAGE_GS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE GSSetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState *const *ppSamplers)
+		{}
+	void STDMETHODCALLTYPE OMSetRenderTargets(UINT NumViews,
+			ID3D11RenderTargetView *const *ppRenderTargetViews,
+			ID3D11DepthStencilView *pDepthStencilView)
+		{}
+	void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews(UINT NumRTVs,
+			ID3D11RenderTargetView *const *ppRenderTargetViews,
+			ID3D11DepthStencilView *pDepthStencilView, UINT UAVStartSlot, UINT NumUAVs,
+			ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+			const UINT *pUAVInitialCounts)
+		{}
+	void STDMETHODCALLTYPE OMSetBlendState(ID3D11BlendState *pBlendState,
+			const FLOAT BlendFactor[4], UINT SampleMask)
+		{}
+	void STDMETHODCALLTYPE OMSetDepthStencilState(ID3D11DepthStencilState *pDepthStencilState,
+			UINT StencilRef)
+		{}
+	void STDMETHODCALLTYPE SOSetTargets(UINT NumBuffers, ID3D11Buffer *const *ppSOTargets,
+			const UINT *pOffsets)
+		{}
+	void STDMETHODCALLTYPE DrawAuto() { draw_calls++; }
+	void STDMETHODCALLTYPE DrawIndexedInstancedIndirect(ID3D11Buffer *pBufferForArgs,
+			UINT AlignedByteOffsetForArgs)
+		{ draw_calls++; }
+	void STDMETHODCALLTYPE DrawInstancedIndirect(ID3D11Buffer *pBufferForArgs,
+			UINT AlignedByteOffsetForArgs)
+		{ draw_calls++; }
+	void STDMETHODCALLTYPE Dispatch(UINT ThreadGroupCountX, UINT ThreadGroupCountY,
+			UINT ThreadGroupCountZ)
+		{}
+	void STDMETHODCALLTYPE DispatchIndirect(ID3D11Buffer *pBufferForArgs,
+			UINT AlignedByteOffsetForArgs)
+		{}
+	void STDMETHODCALLTYPE RSSetState(ID3D11RasterizerState *pRasterizerState) {}
+	void STDMETHODCALLTYPE RSSetViewports(UINT NumViewports, const D3D11_VIEWPORT *pViewports)
+		{}
+	void STDMETHODCALLTYPE RSSetScissorRects(UINT NumRects, const D3D11_RECT *pRects) {}
+	void STDMETHODCALLTYPE CopySubresourceRegion(ID3D11Resource *pDstResource,
+			UINT DstSubresource, UINT DstX, UINT DstY, UINT DstZ,
+			ID3D11Resource *pSrcResource, UINT SrcSubresource, const D3D11_BOX *pSrcBox)
+		{}
+	void STDMETHODCALLTYPE CopyResource(ID3D11Resource *pDstResource,
+			ID3D11Resource *pSrcResource)
+		{}
+	void STDMETHODCALLTYPE UpdateSubresource(ID3D11Resource *pDstResource, UINT DstSubresource,
+			const D3D11_BOX *pDstBox, const void *pSrcData, UINT SrcRowPitch,
+			UINT SrcDepthPitch)
+		{}
+	void STDMETHODCALLTYPE CopyStructureCount(ID3D11Buffer *pDstBuffer,
+			UINT DstAlignedByteOffset, ID3D11UnorderedAccessView *pSrcView)
+		{}
+	void STDMETHODCALLTYPE ClearRenderTargetView(ID3D11RenderTargetView *pRenderTargetView,
+			const FLOAT ColorRGBA[4])
+		{}
+	void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView *pUnorderedAccessView,
+			const UINT Values[4])
+		{}
+	void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(ID3D11UnorderedAccessView *pUnorderedAccessView,
+			const FLOAT Values[4])
+		{}
+	void STDMETHODCALLTYPE ClearDepthStencilView(ID3D11DepthStencilView *pDepthStencilView,
+			UINT ClearFlags, FLOAT Depth, UINT8 Stencil)
+		{}
+	void STDMETHODCALLTYPE GenerateMips(ID3D11ShaderResourceView *pShaderResourceView) {}
+	void STDMETHODCALLTYPE SetResourceMinLOD(ID3D11Resource *pResource, FLOAT MinLOD) {}
+	FLOAT STDMETHODCALLTYPE GetResourceMinLOD(ID3D11Resource *pResource) { return 0.0f; }
+	void STDMETHODCALLTYPE ResolveSubresource(ID3D11Resource *pDstResource, UINT DstSubresource,
+			ID3D11Resource *pSrcResource, UINT SrcSubresource, DXGI_FORMAT Format)
+		{}
+	void STDMETHODCALLTYPE ExecuteCommandList(ID3D11CommandList *pCommandList,
+			BOOL RestoreContextState)
+		{}
+	void STDMETHODCALLTYPE HSSetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView *const *ppShaderResourceViews)
+		{ set_srvs(STAGE_HS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE HSSetShader(ID3D11HullShader *pHullShader,
+			ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances)
+		{ set_shader(STAGE_HS, pHullShader); }
+	void STDMETHODCALLTYPE HSSetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState *const *ppSamplers)
+		{}
+	void STDMETHODCALLTYPE HSSetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers)
+		{}
+	void STDMETHODCALLTYPE DSSetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView *const *ppShaderResourceViews)
+		{ set_srvs(STAGE_DS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE DSSetShader(ID3D11DomainShader *pDomainShader,
+			ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances)
+		{ set_shader(STAGE_DS, pDomainShader); }
+	void STDMETHODCALLTYPE DSSetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState *const *ppSamplers)
+		{}
+	void STDMETHODCALLTYPE DSSetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers)
+		{}
+	void STDMETHODCALLTYPE CSSetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView *const *ppShaderResourceViews)
+		{ set_srvs(STAGE_CS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE CSSetUnorderedAccessViews(UINT StartSlot, UINT NumUAVs,
+			ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+			const UINT *pUAVInitialCounts)
+		{}
+	void STDMETHODCALLTYPE CSSetShader(ID3D11ComputeShader *pComputeShader,
+			ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances)
+		{ set_shader(STAGE_CS, pComputeShader); }
+	void STDMETHODCALLTYPE CSSetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState *const *ppSamplers)
+		{}
+	void STDMETHODCALLTYPE CSSetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers)
+		{}
+	void STDMETHODCALLTYPE VSGetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE PSGetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView **ppShaderResourceViews)
+		{ get_srvs(STAGE_PS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE PSGetShader(ID3D11PixelShader **ppPixelShader,
+			ID3D11ClassInstance **ppClassInstances, UINT *pNumClassInstances)
+		{ get_shader(STAGE_PS, (ID3D11DeviceChild**)ppPixelShader, pNumClassInstances); }
+	void STDMETHODCALLTYPE PSGetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState **ppSamplers)
+		{ get_nothing(NumSamplers, ppSamplers); }
+	void STDMETHODCALLTYPE VSGetShader(ID3D11VertexShader **ppVertexShader,
+			ID3D11ClassInstance **ppClassInstances, UINT *pNumClassInstances)
+		{ get_shader(STAGE_VS, (ID3D11DeviceChild**)ppVertexShader, pNumClassInstances); }
+	void STDMETHODCALLTYPE PSGetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE IAGetInputLayout(ID3D11InputLayout **ppInputLayout)
+		{ get_nothing(1, ppInputLayout); }
+	void STDMETHODCALLTYPE IAGetVertexBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppVertexBuffers, UINT *pStrides, UINT *pOffsets)
+		{ get_nothing(NumBuffers, ppVertexBuffers); }
+	void STDMETHODCALLTYPE IAGetIndexBuffer(ID3D11Buffer **pIndexBuffer, DXGI_FORMAT *Format,
+			UINT *Offset)
+		{ get_nothing(1, pIndexBuffer); if (Format) *Format = DXGI_FORMAT_UNKNOWN; if (Offset) *Offset = 0; }
+	void STDMETHODCALLTYPE GSGetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE GSGetShader(ID3D11GeometryShader **ppGeometryShader,
+			ID3D11ClassInstance **ppClassInstances, UINT *pNumClassInstances)
+		{ get_shader(STAGE_GS, (ID3D11DeviceChild**)ppGeometryShader, pNumClassInstances); }
+	void STDMETHODCALLTYPE IAGetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY *pTopology)
+		{ *pTopology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED; }
+	void STDMETHODCALLTYPE VSGetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView **ppShaderResourceViews)
+		{ get_srvs(STAGE_VS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE VSGetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState **ppSamplers)
+		{ get_nothing(NumSamplers, ppSamplers); }
+	void STDMETHODCALLTYPE GetPredication(ID3D11Predicate **ppPredicate, BOOL *pPredicateValue)
+		{ get_nothing(1, ppPredicate); }
+	void STDMETHODCALLTYPE GSGetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView **ppShaderResourceViews)
+		{ get_srvs(STAGE_GS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE GSGetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState **ppSamplers)
+		{ get_nothing(NumSamplers, ppSamplers); }
+	void STDMETHODCALLTYPE OMGetRenderTargets(UINT NumViews,
+			ID3D11RenderTargetView **ppRenderTargetViews,
+			ID3D11DepthStencilView **ppDepthStencilView)
+		{ get_nothing(NumViews, ppRenderTargetViews); get_nothing(1, ppDepthStencilView); }
+	void STDMETHODCALLTYPE OMGetRenderTargetsAndUnorderedAccessViews(UINT NumRTVs,
+			ID3D11RenderTargetView **ppRenderTargetViews,
+			ID3D11DepthStencilView **ppDepthStencilView, UINT UAVStartSlot, UINT NumUAVs,
+			ID3D11UnorderedAccessView **ppUnorderedAccessViews)
+		{ get_nothing(NumRTVs, ppRenderTargetViews); get_nothing(1, ppDepthStencilView); get_nothing(NumUAVs, ppUnorderedAccessViews); }
+	void STDMETHODCALLTYPE OMGetBlendState(ID3D11BlendState **ppBlendState, FLOAT BlendFactor[4],
+			UINT *pSampleMask)
+		{ get_nothing(1, ppBlendState); }
+	void STDMETHODCALLTYPE OMGetDepthStencilState(ID3D11DepthStencilState **ppDepthStencilState,
+			UINT *pStencilRef)
+		{ get_nothing(1, ppDepthStencilState); }
+	void STDMETHODCALLTYPE SOGetTargets(UINT NumBuffers, ID3D11Buffer **ppSOTargets)
+		{ get_nothing(NumBuffers, ppSOTargets); }
+	void STDMETHODCALLTYPE RSGetState(ID3D11RasterizerState **ppRasterizerState)
+		{ get_nothing(1, ppRasterizerState); }
+	void STDMETHODCALLTYPE RSGetViewports(UINT *pNumViewports, D3D11_VIEWPORT *pViewports)
+		{ *pNumViewports = 0; }
+	void STDMETHODCALLTYPE RSGetScissorRects(UINT *pNumRects, D3D11_RECT *pRects)
+		{ *pNumRects = 0; }
+	void STDMETHODCALLTYPE HSGetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView **ppShaderResourceViews)
+		{ get_srvs(STAGE_HS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE HSGetShader(ID3D11HullShader **ppHullShader,
+			ID3D11ClassInstance **ppClassInstances, UINT *pNumClassInstances)
+		{ get_shader(STAGE_HS, (ID3D11DeviceChild**)ppHullShader, pNumClassInstances); }
+	void STDMETHODCALLTYPE HSGetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState **ppSamplers)
+		{ get_nothing(NumSamplers, ppSamplers); }
+	void STDMETHODCALLTYPE HSGetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE DSGetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView **ppShaderResourceViews)
+		{ get_srvs(STAGE_DS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE DSGetShader(ID3D11DomainShader **ppDomainShader,
+			ID3D11ClassInstance **ppClassInstances, UINT *pNumClassInstances)
+		{ get_shader(STAGE_DS, (ID3D11DeviceChild**)ppDomainShader, pNumClassInstances); }
+	void STDMETHODCALLTYPE DSGetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState **ppSamplers)
+		{ get_nothing(NumSamplers, ppSamplers); }
+	void STDMETHODCALLTYPE DSGetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE CSGetShaderResources(UINT StartSlot, UINT NumViews,
+			ID3D11ShaderResourceView **ppShaderResourceViews)
+		{ get_srvs(STAGE_CS, StartSlot, NumViews, ppShaderResourceViews); }
+	void STDMETHODCALLTYPE CSGetUnorderedAccessViews(UINT StartSlot, UINT NumUAVs,
+			ID3D11UnorderedAccessView **ppUnorderedAccessViews)
+		{ get_nothing(NumUAVs, ppUnorderedAccessViews); }
+	void STDMETHODCALLTYPE CSGetShader(ID3D11ComputeShader **ppComputeShader,
+			ID3D11ClassInstance **ppClassInstances, UINT *pNumClassInstances)
+		{ get_shader(STAGE_CS, (ID3D11DeviceChild**)ppComputeShader, pNumClassInstances); }
+	void STDMETHODCALLTYPE CSGetSamplers(UINT StartSlot, UINT NumSamplers,
+			ID3D11SamplerState **ppSamplers)
+		{ get_nothing(NumSamplers, ppSamplers); }
+	void STDMETHODCALLTYPE CSGetConstantBuffers(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE ClearState() {}
+	void STDMETHODCALLTYPE Flush() {}
+	D3D11_DEVICE_CONTEXT_TYPE STDMETHODCALLTYPE GetType()
+		{ return D3D11_DEVICE_CONTEXT_IMMEDIATE; }
+	UINT STDMETHODCALLTYPE GetContextFlags() { return 0; }
+	HRESULT STDMETHODCALLTYPE FinishCommandList(BOOL RestoreDeferredContextState,
+			ID3D11CommandList **ppCommandList)
+		{ return E_NOTIMPL; }
+
+	/** ID3D11DeviceContext1 **/
+
+	void STDMETHODCALLTYPE CopySubresourceRegion1(ID3D11Resource *pDstResource,
+			UINT DstSubresource, UINT DstX, UINT DstY, UINT DstZ,
+			ID3D11Resource *pSrcResource, UINT SrcSubresource, const D3D11_BOX *pSrcBox,
+			UINT CopyFlags)
+		{}
+	void STDMETHODCALLTYPE UpdateSubresource1(ID3D11Resource *pDstResource, UINT DstSubresource,
+			const D3D11_BOX *pDstBox, const void *pSrcData, UINT SrcRowPitch,
+			UINT SrcDepthPitch, UINT CopyFlags)
+		{}
+	void STDMETHODCALLTYPE DiscardResource(ID3D11Resource *pResource) {}
+	void STDMETHODCALLTYPE DiscardView(ID3D11View *pResourceView) {}
+	void STDMETHODCALLTYPE VSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers, const UINT *pFirstConstant,
+			const UINT *pNumConstants)
+		{}
+	void STDMETHODCALLTYPE HSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers, const UINT *pFirstConstant,
+			const UINT *pNumConstants)
+		{}
+	void STDMETHODCALLTYPE DSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers, const UINT *pFirstConstant,
+			const UINT *pNumConstants)
+		{}
+	void STDMETHODCALLTYPE GSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers, const UINT *pFirstConstant,
+			const UINT *pNumConstants)
+		{}
+	void STDMETHODCALLTYPE PSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers, const UINT *pFirstConstant,
+			const UINT *pNumConstants)
+		{}
+	void STDMETHODCALLTYPE CSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer *const *ppConstantBuffers, const UINT *pFirstConstant,
+			const UINT *pNumConstants)
+		{}
+	void STDMETHODCALLTYPE VSGetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers, UINT *pFirstConstant, UINT *pNumConstants)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE HSGetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers, UINT *pFirstConstant, UINT *pNumConstants)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE DSGetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers, UINT *pFirstConstant, UINT *pNumConstants)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE GSGetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers, UINT *pFirstConstant, UINT *pNumConstants)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE PSGetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers, UINT *pFirstConstant, UINT *pNumConstants)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE CSGetConstantBuffers1(UINT StartSlot, UINT NumBuffers,
+			ID3D11Buffer **ppConstantBuffers, UINT *pFirstConstant, UINT *pNumConstants)
+		{ get_nothing(NumBuffers, ppConstantBuffers); }
+	void STDMETHODCALLTYPE SwapDeviceContextState(ID3DDeviceContextState *pState,
+			ID3DDeviceContextState **ppPreviousState)
+		{ get_nothing(1, ppPreviousState); }
+	void STDMETHODCALLTYPE ClearView(ID3D11View *pView, const FLOAT Color[4],
+			const D3D11_RECT *pRect, UINT NumRects)
+		{}
+	void STDMETHODCALLTYPE DiscardView1(ID3D11View *pResourceView, const D3D11_RECT *pRects,
+			UINT NumRects)
+		{}
+};
+
+class BenchmarkDevice : public ID3D11Device1
+{
+private:
+	volatile LONG refs;
+
+public:
+	BenchmarkContext *context;
+
+	BenchmarkDevice() :
+		refs(1),
+		context(NULL)
+	{}
+
+	/*** IUnknown methods ***/
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppvObject)
+	{
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(ID3D11Device) || riid == __uuidof(ID3D11Device1)) {
+			AddRef();
+			*ppvObject = this;
+			return S_OK;
+		}
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() { return InterlockedIncrement(&refs); }
+	ULONG STDMETHODCALLTYPE Release() { return InterlockedDecrement(&refs); }
+
+	/*** ID3D11Device methods ***/
+
+	HRESULT STDMETHODCALLTYPE CreateBuffer(const D3D11_BUFFER_DESC *pDesc,
+			const D3D11_SUBRESOURCE_DATA *pInitialData, ID3D11Buffer **ppBuffer)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateTexture1D(const D3D11_TEXTURE1D_DESC *pDesc,
+			const D3D11_SUBRESOURCE_DATA *pInitialData, ID3D11Texture1D **ppTexture1D)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateTexture2D(const D3D11_TEXTURE2D_DESC *pDesc,
+			const D3D11_SUBRESOURCE_DATA *pInitialData, ID3D11Texture2D **ppTexture2D)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateTexture3D(const D3D11_TEXTURE3D_DESC *pDesc,
+			const D3D11_SUBRESOURCE_DATA *pInitialData, ID3D11Texture3D **ppTexture3D)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateShaderResourceView(ID3D11Resource *pResource,
+			const D3D11_SHADER_RESOURCE_VIEW_DESC *pDesc,
+			ID3D11ShaderResourceView **ppSRView)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateUnorderedAccessView(ID3D11Resource *pResource,
+			const D3D11_UNORDERED_ACCESS_VIEW_DESC *pDesc,
+			ID3D11UnorderedAccessView **ppUAView)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateRenderTargetView(ID3D11Resource *pResource,
+			const D3D11_RENDER_TARGET_VIEW_DESC *pDesc,
+			ID3D11RenderTargetView **ppRTView)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateDepthStencilView(ID3D11Resource *pResource,
+			const D3D11_DEPTH_STENCIL_VIEW_DESC *pDesc,
+			ID3D11DepthStencilView **ppDepthStencilView)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC *pInputElementDescs,
+			UINT NumElements, const void *pShaderBytecodeWithInputSignature,
+			SIZE_T BytecodeLength, ID3D11InputLayout **ppInputLayout)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateVertexShader(const void *pShaderBytecode,
+			SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage,
+			ID3D11VertexShader **ppVertexShader)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateGeometryShader(const void *pShaderBytecode,
+			SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage,
+			ID3D11GeometryShader **ppGeometryShader)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateGeometryShaderWithStreamOutput(const void *pShaderBytecode,
+			SIZE_T BytecodeLength, const D3D11_SO_DECLARATION_ENTRY *pSODeclaration,
+			UINT NumEntries, const UINT *pBufferStrides, UINT NumStrides,
+			UINT RasterizedStream, ID3D11ClassLinkage *pClassLinkage,
+			ID3D11GeometryShader **ppGeometryShader)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreatePixelShader(const void *pShaderBytecode,
+			SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage,
+			ID3D11PixelShader **ppPixelShader)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateHullShader(const void *pShaderBytecode,
+			SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage,
+			ID3D11HullShader **ppHullShader)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateDomainShader(const void *pShaderBytecode,
+			SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage,
+			ID3D11DomainShader **ppDomainShader)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateComputeShader(const void *pShaderBytecode,
+			SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage,
+			ID3D11ComputeShader **ppComputeShader)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateClassLinkage(ID3D11ClassLinkage **ppLinkage)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateBlendState(const D3D11_BLEND_DESC *pBlendStateDesc,
+			ID3D11BlendState **ppBlendState)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC *pDepthStencilDesc,
+			ID3D11DepthStencilState **ppDepthStencilState)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateRasterizerState(const D3D11_RASTERIZER_DESC *pRasterizerDesc,
+			ID3D11RasterizerState **ppRasterizerState)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateSamplerState(const D3D11_SAMPLER_DESC *pSamplerDesc,
+			ID3D11SamplerState **ppSamplerState)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateQuery(const D3D11_QUERY_DESC *pQueryDesc,
+			ID3D11Query **ppQuery)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreatePredicate(const D3D11_QUERY_DESC *pPredicateDesc,
+			ID3D11Predicate **ppPredicate)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateCounter(const D3D11_COUNTER_DESC *pCounterDesc,
+			ID3D11Counter **ppCounter)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateDeferredContext(UINT ContextFlags,
+			ID3D11DeviceContext **ppDeferredContext)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE OpenSharedResource(HANDLE hResource, REFIID ReturnedInterface,
+			void **ppResource)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CheckFormatSupport(DXGI_FORMAT Format, UINT *pFormatSupport)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CheckMultisampleQualityLevels(DXGI_FORMAT Format, UINT SampleCount,
+			UINT *pNumQualityLevels)
+		{ return E_NOTIMPL; }
+	void STDMETHODCALLTYPE CheckCounterInfo(D3D11_COUNTER_INFO *pCounterInfo)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CheckCounter(const D3D11_COUNTER_DESC *pDesc,
+			D3D11_COUNTER_TYPE *pType, UINT *pActiveCounters, LPSTR szName,
+			UINT *pNameLength, LPSTR szUnits, UINT *pUnitsLength, LPSTR szDescription,
+			UINT *pDescriptionLength)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CheckFeatureSupport(D3D11_FEATURE Feature,
+			void *pFeatureSupportData, UINT FeatureSupportDataSize)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID guid, UINT *pDataSize, void *pData)
+		{ return DXGI_ERROR_NOT_FOUND; }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID guid, UINT DataSize, const void *pData)
+		{ return S_OK; }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID guid, const IUnknown *pData)
+		{ return S_OK; }
+	D3D_FEATURE_LEVEL STDMETHODCALLTYPE GetFeatureLevel() { return D3D_FEATURE_LEVEL_11_0; }
+	UINT STDMETHODCALLTYPE GetCreationFlags() { return 0; }
+	HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() { return S_OK; }
+	void STDMETHODCALLTYPE GetImmediateContext(ID3D11DeviceContext **ppImmediateContext)
+		{ context->AddRef(); *ppImmediateContext = context; }
+	HRESULT STDMETHODCALLTYPE SetExceptionMode(UINT RaiseFlags) { return S_OK; }
+	UINT STDMETHODCALLTYPE GetExceptionMode() { return 0; }
+
+	/** ID3D11Device1 methods **/
+
+	void STDMETHODCALLTYPE GetImmediateContext1(ID3D11DeviceContext1 **ppImmediateContext)
+		{ context->AddRef(); *ppImmediateContext = context; }
+	HRESULT STDMETHODCALLTYPE CreateDeferredContext1(UINT ContextFlags,
+			ID3D11DeviceContext1 **ppDeferredContext)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateBlendState1(const D3D11_BLEND_DESC1 *pBlendStateDesc,
+			ID3D11BlendState1 **ppBlendState)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateRasterizerState1(const D3D11_RASTERIZER_DESC1 *pRasterizerDesc,
+			ID3D11RasterizerState1 **ppRasterizerState)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE CreateDeviceContextState(UINT Flags,
+			const D3D_FEATURE_LEVEL *pFeatureLevels, UINT FeatureLevels, UINT SDKVersion,
+			REFIID EmulatedInterface, D3D_FEATURE_LEVEL *pChosenFeatureLevel,
+			ID3DDeviceContextState **ppContextState)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE OpenSharedResource1(HANDLE hResource, REFIID returnedInterface,
+			void **ppResource)
+		{ return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE OpenSharedResourceByName(LPCWSTR lpName, DWORD dwDesiredAccess,
+			REFIID returnedInterface, void **ppResource)
+		{ return E_NOTIMPL; }
+};
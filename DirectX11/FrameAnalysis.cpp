@@ -6,8 +6,8 @@
 #include "FrameAnalysis.h"
 #include "Globals.h"
 #include "input.h"
+#include "VertexBufferText.h"
 
-#include <ScreenGrab.h>
 #include <wincodec.h>
 #include <Strsafe.h>
 #include <stdarg.h>
@@ -115,6 +115,12 @@ void FrameAnalysisContext::FrameAnalysisLog(char *fmt, ...)
 	FrameAnalysisLog("3DMigoto " fmt, __VA_ARGS__); \
 } while (0)
 
+// Dump jobs may be running on a writer thread while the context is logging
+// later calls, so they can't use the frame analysis log. Errors still go to
+// the main log, and the rest only with debug logging enabled:
+#define FAJobLogInfo(fmt, ...) LogDebug("Frame Analysis: " fmt, __VA_ARGS__)
+#define FAJobLogErr(fmt, ...) LogInfo("Frame Analysis: " fmt, __VA_ARGS__)
+
 
 static void FrameAnalysisLogSlot(FILE *frame_analysis_log, int slot, char *slot_name)
 {
@@ -153,6 +159,7 @@ void FrameAnalysisContext::FrameAnalysisLogShaderHash(ID3D11Shader *shader)
 
 void FrameAnalysisContext::FrameAnalysisLogResourceHash(ID3D11Resource *resource)
 {
+	ResourceHandleInfo *handle_info;
 	uint32_t hash, orig_hash;
 	struct ResourceHashInfo *info;
 
@@ -167,12 +174,17 @@ void FrameAnalysisContext::FrameAnalysisLogResourceHash(ID3D11Resource *resource
 		return;
 	}
 
+	handle_info = GetResourceHandleInfo(resource);
+	if (!handle_info) {
+		fprintf(frame_analysis_log, "\n");
+		return;
+	}
+
 	EnterCriticalSectionPretty(&G->mCriticalSection);
-	EnterCriticalSectionPretty(&G->mResourcesLock);
 
 	try {
-		hash = G->mResources.at(resource).hash;
-		orig_hash = G->mResources.at(resource).orig_hash;
+		hash = handle_info->hash;
+		orig_hash = handle_info->orig_hash;
 		if (hash)
 			fprintf(frame_analysis_log, " hash=%08x", hash);
 		if (orig_hash != hash)
@@ -193,7 +205,6 @@ void FrameAnalysisContext::FrameAnalysisLogResourceHash(ID3D11Resource *resource
 	} catch (std::out_of_range) {
 	}
 
-	LeaveCriticalSection(&G->mResourcesLock);
 	LeaveCriticalSection(&G->mCriticalSection);
 
 	fprintf(frame_analysis_log, "\n");
@@ -411,23 +422,326 @@ ID3D11DeviceContext* FrameAnalysisContext::GetDumpingContext()
 void FrameAnalysisContext::Dump2DResourceImmediateCtx(ID3D11Texture2D *staging,
 		wstring filename, bool stereo, D3D11_TEXTURE2D_DESC *orig_desc, DXGI_FORMAT format)
 {
-	HRESULT hr = S_OK, dont_care;
+	FrameAnalysisDumpTex2DJob *job;
+	D3D11_TEXTURE2D_DESC staging_desc;
+	D3D11_MAPPED_SUBRESOURCE map;
+	wchar_t dedupe_dir[MAX_PATH];
+	size_t row_bytes = 0, row_count = 0, row;
+	char *dst;
+	HRESULT hr;
+
+	// Only the top level is dumped, the same as DirectXTK used to:
+	staging->GetDesc(&staging_desc);
+	hr = GetTextureSurfaceInfo(staging_desc.Width, staging_desc.Height, staging_desc.Format, &row_bytes, &row_count);
+	if (FAILED(hr) || !row_bytes || !row_count) {
+		FALogErr("Dump2DResource: Cannot dump format %s\n", TexFormatStr(staging_desc.Format));
+		return;
+	}
+
+	get_deduped_dir(dedupe_dir, MAX_PATH);
+	job = new FrameAnalysisDumpTex2DJob(analyse_options, filename.c_str(), dedupe_dir,
+			stereo, orig_desc, &staging_desc, format, row_bytes, row_count);
+
+	// May block if the writers are behind, so do this before mapping:
+	job->data = G->frame_analysis_writer.alloc_buffer(row_bytes * row_count);
+
+	hr = GetDumpingContext()->Map(staging, 0, D3D11_MAP_READ, 0, &map);
+	if (FAILED(hr)) {
+		FALogErr("Dump2DResource failed to map staging resource: 0x%x\n", hr);
+		G->frame_analysis_writer.release_buffer(job->data);
+		delete job;
+		return;
+	}
+
+	// Everything else happens on a writer thread, so all we do here is
+	// copy the data out, dropping any padding at the end of each row:
+	dst = job->data->data();
+	for (row = 0; row < row_count; row++)
+		memcpy(dst + row * row_bytes, (char*)map.pData + row * map.RowPitch, row_bytes);
+
+	GetDumpingContext()->Unmap(staging, 0);
+
+	FALogInfo("Dumping Texture2D %S\n", filename.c_str());
+	G->frame_analysis_writer.submit(job);
+}
+
+// The render thread hands us a copy of the data rather than the staging
+// resource, so we can no longer use DirectXTK's ScreenGrab to save textures
+// (it needs the context to map the resource itself). These are the parts of
+// it we used, working from memory instead. As before, only the top level of
+// the texture is saved.
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_FOURCC 0x00000004
+#define DDS_RGB 0x00000040
+#define DDS_RGBA 0x00000041
+#define DDS_LUMINANCE 0x00020000
+#define DDS_ALPHA 0x00000002
+#define DDS_HEADER_FLAGS_TEXTURE 0x00001007 // CAPS | HEIGHT | WIDTH | PIXELFORMAT
+#define DDS_HEADER_FLAGS_MIPMAP 0x00020000
+#define DDS_HEADER_FLAGS_PITCH 0x00000008
+#define DDS_HEADER_FLAGS_LINEARSIZE 0x00080000
+#define DDS_SURFACE_FLAGS_TEXTURE 0x00001000
+
+struct DDS_PIXELFORMAT {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t RGBBitCount;
+	uint32_t RBitMask;
+	uint32_t GBitMask;
+	uint32_t BBitMask;
+	uint32_t ABitMask;
+};
+
+struct DDS_HEADER {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DDS_PIXELFORMAT ddspf;
+	uint32_t caps;
+	uint32_t caps2;
+	uint32_t caps3;
+	uint32_t caps4;
+	uint32_t reserved2;
+};
+
+struct DDS_HEADER_DXT10 {
+	DXGI_FORMAT dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+// Formats that older tools can read without the DX10 extension header. Same
+// choices as ScreenGrab, so the files we save are unchanged:
+static struct {
+	DXGI_FORMAT format;
+	DDS_PIXELFORMAT ddspf;
+} legacy_dds_formats[] = {
+	{DXGI_FORMAT_R8G8B8A8_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_RGBA, 0, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000}},
+	{DXGI_FORMAT_R16G16_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_RGB, 0, 32, 0x0000ffff, 0xffff0000, 0, 0}},
+	{DXGI_FORMAT_R16_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_LUMINANCE, 0, 16, 0xffff, 0, 0, 0}},
+	{DXGI_FORMAT_R8_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_LUMINANCE, 0, 8, 0xff, 0, 0, 0}},
+	{DXGI_FORMAT_A8_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_ALPHA, 0, 8, 0, 0, 0, 0xff}},
+	{DXGI_FORMAT_BC1_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, MAKEFOURCC('D', 'X', 'T', '1'), 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_BC2_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, MAKEFOURCC('D', 'X', 'T', '3'), 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_BC3_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, MAKEFOURCC('D', 'X', 'T', '5'), 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_BC4_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, MAKEFOURCC('B', 'C', '4', 'U'), 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_BC4_SNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, MAKEFOURCC('B', 'C', '4', 'S'), 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_BC5_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, MAKEFOURCC('B', 'C', '5', 'U'), 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_BC5_SNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, MAKEFOURCC('B', 'C', '5', 'S'), 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_B5G6R5_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_RGB, 0, 16, 0xf800, 0x07e0, 0x001f, 0}},
+	{DXGI_FORMAT_B5G5R5A1_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_RGBA, 0, 16, 0x7c00, 0x03e0, 0x001f, 0x8000}},
+	{DXGI_FORMAT_B8G8R8A8_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_RGBA, 0, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000}},
+	{DXGI_FORMAT_B8G8R8X8_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_RGB, 0, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0}},
+	// D3DFMT values in place of a FourCC:
+	{DXGI_FORMAT_R16G16B16A16_UNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, 36, 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_R16G16B16A16_SNORM, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, 110, 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_R16_FLOAT, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, 111, 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_R16G16_FLOAT, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, 112, 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_R16G16B16A16_FLOAT, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, 113, 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_R32_FLOAT, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, 114, 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_R32G32_FLOAT, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, 115, 0, 0, 0, 0, 0}},
+	{DXGI_FORMAT_R32G32B32A32_FLOAT, {sizeof(DDS_PIXELFORMAT), DDS_FOURCC, 116, 0, 0, 0, 0, 0}},
+};
+
+static bool is_block_compressed(DXGI_FORMAT format)
+{
+	return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM)
+	    || (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+HRESULT FrameAnalysisDumpTex2DJob::save_dds(const wchar_t *path)
+{
+	DDS_HEADER header = {};
+	DDS_HEADER_DXT10 header10 = {};
+	uint32_t magic = DDS_MAGIC;
+	size_t data_size = data->size();
+	std::vector<char> dds;
+	char *pos;
+	size_t i;
+
+	header.size = sizeof(DDS_HEADER);
+	header.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP;
+	header.height = staging_desc.Height;
+	header.width = staging_desc.Width;
+	header.mipMapCount = 1;
+	header.caps = DDS_SURFACE_FLAGS_TEXTURE;
+
+	if (is_block_compressed(staging_desc.Format)) {
+		header.flags |= DDS_HEADER_FLAGS_LINEARSIZE;
+		header.pitchOrLinearSize = (uint32_t)data_size;
+	} else {
+		header.flags |= DDS_HEADER_FLAGS_PITCH;
+		header.pitchOrLinearSize = (uint32_t)row_bytes;
+	}
+
+	for (i = 0; i < ARRAYSIZE(legacy_dds_formats); i++) {
+		if (legacy_dds_formats[i].format == staging_desc.Format) {
+			header.ddspf = legacy_dds_formats[i].ddspf;
+			break;
+		}
+	}
+	if (i == ARRAYSIZE(legacy_dds_formats)) {
+		header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+		header.ddspf.flags = DDS_FOURCC;
+		header.ddspf.fourCC = MAKEFOURCC('D', 'X', '1', '0');
+		header10.dxgiFormat = staging_desc.Format;
+		header10.resourceDimension = D3D11_RESOURCE_DIMENSION_TEXTURE2D;
+		header10.arraySize = 1;
+	}
+
+	dds.resize(sizeof(magic) + sizeof(header) + (header10.arraySize ? sizeof(header10) : 0) + data_size);
+	pos = dds.data();
+	memcpy(pos, &magic, sizeof(magic));
+	pos += sizeof(magic);
+	memcpy(pos, &header, sizeof(header));
+	pos += sizeof(header);
+	if (header10.arraySize) {
+		memcpy(pos, &header10, sizeof(header10));
+		pos += sizeof(header10);
+	}
+	memcpy(pos, data->data(), data_size);
+
+	if (!write_deduped_file(path, dds.data(), dds.size()))
+		return E_FAIL;
+	return S_OK;
+}
+
+static bool wic_pixel_format(DXGI_FORMAT format, WICPixelFormatGUID *guid)
+{
+	switch (format) {
+		case DXGI_FORMAT_R32G32B32A32_FLOAT: *guid = GUID_WICPixelFormat128bppRGBAFloat; return true;
+		case DXGI_FORMAT_R16G16B16A16_FLOAT: *guid = GUID_WICPixelFormat64bppRGBAHalf; return true;
+		case DXGI_FORMAT_R16G16B16A16_UNORM: *guid = GUID_WICPixelFormat64bppRGBA; return true;
+		case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM: *guid = GUID_WICPixelFormat32bppRGBA1010102XR; return true;
+		case DXGI_FORMAT_R10G10B10A2_UNORM: *guid = GUID_WICPixelFormat32bppRGBA1010102; return true;
+		case DXGI_FORMAT_B5G5R5A1_UNORM: *guid = GUID_WICPixelFormat16bppBGRA5551; return true;
+		case DXGI_FORMAT_B5G6R5_UNORM: *guid = GUID_WICPixelFormat16bppBGR565; return true;
+		case DXGI_FORMAT_R32_FLOAT: *guid = GUID_WICPixelFormat32bppGrayFloat; return true;
+		case DXGI_FORMAT_R16_FLOAT: *guid = GUID_WICPixelFormat16bppGrayHalf; return true;
+		case DXGI_FORMAT_R16_UNORM: *guid = GUID_WICPixelFormat16bppGray; return true;
+		case DXGI_FORMAT_R8_UNORM: *guid = GUID_WICPixelFormat8bppGray; return true;
+		case DXGI_FORMAT_A8_UNORM: *guid = GUID_WICPixelFormat8bppAlpha; return true;
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: *guid = GUID_WICPixelFormat32bppRGBA; return true;
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB: *guid = GUID_WICPixelFormat32bppBGRA; return true;
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB: *guid = GUID_WICPixelFormat32bppBGR; return true;
+	}
+	return false;
+}
+
+// JPEG is always written to a file, since that is what WIC wants. In archive
+// mode link_deduplicated_files() picks it up from there.
+HRESULT FrameAnalysisDumpTex2DJob::save_jpeg(const wchar_t *path)
+{
+	Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+	Microsoft::WRL::ComPtr<IWICStream> stream;
+	Microsoft::WRL::ComPtr<IWICBitmapEncoder> encoder;
+	Microsoft::WRL::ComPtr<IWICBitmapFrameEncode> frame;
+	Microsoft::WRL::ComPtr<IPropertyBag2> props;
+	Microsoft::WRL::ComPtr<IWICBitmap> bitmap;
+	Microsoft::WRL::ComPtr<IWICFormatConverter> converter;
+	WICPixelFormatGUID src_format, target_format = GUID_WICPixelFormat24bppBGR;
+	HRESULT hr;
+
+	// Not an error as such - the auto format falls back to DDS for these:
+	if (!wic_pixel_format(staging_desc.Format, &src_format))
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+	hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()));
+	if (FAILED(hr))
+		return hr;
+
+	hr = factory->CreateStream(&stream);
+	if (FAILED(hr))
+		return hr;
+
+	hr = stream->InitializeFromFilename(path, GENERIC_WRITE);
+	if (FAILED(hr))
+		return hr;
+
+	hr = factory->CreateEncoder(GUID_ContainerFormatJpeg, NULL, &encoder);
+	if (FAILED(hr))
+		goto err;
+	hr = encoder->Initialize(stream.Get(), WICBitmapEncoderNoCache);
+	if (FAILED(hr))
+		goto err;
+	hr = encoder->CreateNewFrame(&frame, &props);
+	if (FAILED(hr))
+		goto err;
+	hr = frame->Initialize(props.Get());
+	if (FAILED(hr))
+		goto err;
+	hr = frame->SetSize(staging_desc.Width, staging_desc.Height);
+	if (FAILED(hr))
+		goto err;
+	hr = frame->SetPixelFormat(&target_format);
+	if (FAILED(hr))
+		goto err;
+
+	hr = factory->CreateBitmapFromMemory(staging_desc.Width, staging_desc.Height, src_format,
+			(UINT)row_bytes, (UINT)data->size(), (BYTE*)data->data(), &bitmap);
+	if (FAILED(hr))
+		goto err;
+	hr = factory->CreateFormatConverter(&converter);
+	if (FAILED(hr))
+		goto err;
+	hr = converter->Initialize(bitmap.Get(), target_format, WICBitmapDitherTypeNone,
+			NULL, 0.0, WICBitmapPaletteTypeMedianCut);
+	if (FAILED(hr))
+		goto err;
+
+	hr = frame->WriteSource(converter.Get(), NULL);
+	if (FAILED(hr))
+		goto err;
+	hr = frame->Commit();
+	if (FAILED(hr))
+		goto err;
+	hr = encoder->Commit();
+	if (FAILED(hr))
+		goto err;
+
+	return S_OK;
+err:
+	// Don't leave a partial file behind for anything to link to:
+	encoder.Reset();
+	stream.Reset();
+	DeleteFile(path);
+	return hr;
+}
+
+void FrameAnalysisDumpTex2DJob::run()
+{
+	HRESULT hr = S_OK, co_init;
 	wchar_t dedupe_filename[MAX_PATH];
 	wstring save_filename;
 	wchar_t *wic_ext = (stereo ? L".jps" : L".jpg");
 	size_t ext, save_ext;
 
-	save_filename = dedupe_tex2d_filename(staging, orig_desc, dedupe_filename, MAX_PATH, filename.c_str(), format);
+	dedupe_tex2d_filename(dedupe_filename, MAX_PATH);
+	save_filename = dedupe_filename;
 
 	ext = filename.find_last_of(L'.');
 	save_ext = save_filename.find_last_of(L'.');
 	if (ext == wstring::npos || save_ext == wstring::npos) {
-		FALogErr("Dump2DResource: Filename missing extension\n");
+		FAJobLogErr("Dump2DResource: Filename missing extension\n");
 		return;
 	}
 
-	// Needs to be called at some point before SaveXXXTextureToFile:
-	dont_care = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+	G->frame_analysis_writer.claim_name(dedupe_filename);
+
+	// Needs to be called at some point before using WIC:
+	co_init = CoInitializeEx(NULL, COINIT_MULTITHREADED);
 
 	if ((analyse_options & FrameAnalysisOptions::FMT_2D_JPS) ||
 	    (analyse_options & FrameAnalysisOptions::FMT_2D_AUTO)) {
@@ -440,11 +754,11 @@ void FrameAnalysisContext::Dump2DResourceImmediateCtx(ID3D11Texture2D *staging,
 		// will dump out DDS files for those instead.
 		filename.replace(ext, wstring::npos, wic_ext);
 		save_filename.replace(save_ext, wstring::npos, wic_ext);
-		FALogInfo("Dumping Texture2D %S -> %S\n", filename.c_str(), save_filename.c_str());
+		FAJobLogInfo("Dumping Texture2D %S -> %S\n", filename.c_str(), save_filename.c_str());
 
 		hr = S_OK;
-		if (GetFileAttributes(save_filename.c_str()) == INVALID_FILE_ATTRIBUTES)
-			hr = DirectX::SaveWICTextureToFile(GetDumpingContext(), staging, GUID_ContainerFormatJpeg, save_filename.c_str());
+		if (!deduped_file_exists(save_filename.c_str()))
+			hr = save_jpeg(save_filename.c_str());
 		link_deduplicated_files(filename.c_str(), save_filename.c_str());
 	}
 
@@ -453,28 +767,33 @@ void FrameAnalysisContext::Dump2DResourceImmediateCtx(ID3D11Texture2D *staging,
 	   ((analyse_options & FrameAnalysisOptions::FMT_2D_AUTO) && FAILED(hr))) {
 		filename.replace(ext, wstring::npos, L".dds");
 		save_filename.replace(save_ext, wstring::npos, L".dds");
-		FALogInfo("Dumping Texture2D %S -> %S\n", filename.c_str(), save_filename.c_str());
+		FAJobLogInfo("Dumping Texture2D %S -> %S\n", filename.c_str(), save_filename.c_str());
 
 		hr = S_OK;
-		if (GetFileAttributes(save_filename.c_str()) == INVALID_FILE_ATTRIBUTES)
-			hr = DirectX::SaveDDSTextureToFile(GetDumpingContext(), staging, save_filename.c_str());
+		if (!deduped_file_exists(save_filename.c_str()))
+			hr = save_dds(save_filename.c_str());
 		link_deduplicated_files(filename.c_str(), save_filename.c_str());
 	}
 
 	if (FAILED(hr))
-		FALogErr("Failed to dump Texture2D %S -> %S: 0x%x\n", filename.c_str(), save_filename.c_str(), hr);
+		FAJobLogErr("Failed to dump Texture2D %S -> %S: 0x%x\n", filename.c_str(), save_filename.c_str(), hr);
 
 	if (analyse_options & FrameAnalysisOptions::FMT_DESC) {
 		filename.replace(ext, wstring::npos, L".dsc");
 		save_filename.replace(save_ext, wstring::npos, L".dsc");
-		FALogInfo("Dumping Texture2D %S -> %S\n", filename.c_str(), save_filename.c_str());
+		FAJobLogInfo("Dumping Texture2D %S -> %S\n", filename.c_str(), save_filename.c_str());
 
-		if (GetFileAttributes(save_filename.c_str()) == INVALID_FILE_ATTRIBUTES)
-			DumpDesc(orig_desc, save_filename.c_str());
+		if (!deduped_file_exists(save_filename.c_str()))
+			DumpDesc(&orig_desc, save_filename.c_str());
 		link_deduplicated_files(filename.c_str(), save_filename.c_str());
 	}
 
-	CoUninitialize();
+	// May fail if the game already set up COM on this thread differently,
+	// in which case it is not ours to uninitialise:
+	if (SUCCEEDED(co_init))
+		CoUninitialize();
+
+	G->frame_analysis_writer.release_name(dedupe_filename);
 }
 
 void FrameAnalysisContext::Dump2DResource(ID3D11Texture2D *resource, wchar_t
@@ -729,7 +1048,7 @@ static void copy_until_extension(wchar_t *txt_filename, const wchar_t *bin_filen
 	StringCchPrintfExW(txt_filename, size, pos, rem, NULL, L"%.*s", ext_pos, bin_filename);
 }
 
-void FrameAnalysisContext::dedupe_buf_filename_txt(const wchar_t *bin_filename,
+void FrameAnalysisDumpBufferJob::dedupe_buf_filename_txt(const wchar_t *bin_filename,
 		wchar_t *txt_filename, size_t size, char type, int idx,
 		UINT stride, UINT offset)
 {
@@ -748,7 +1067,7 @@ void FrameAnalysisContext::dedupe_buf_filename_txt(const wchar_t *bin_filename,
 		StringCchPrintfExW(pos, rem, &pos, &rem, NULL, L"-stride=%u", stride);
 
 	if (FAILED(StringCchPrintfW(pos, rem, L".txt")))
-		FALogErr("Failed to create buffer filename\n");
+		FAJobLogErr("Failed to create buffer filename\n");
 }
 
 /*
@@ -756,7 +1075,7 @@ void FrameAnalysisContext::dedupe_buf_filename_txt(const wchar_t *bin_filename,
  * try to use the reflection information in the shaders to add names and
  * correct types.
  */
-void FrameAnalysisContext::DumpBufferTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
+void FrameAnalysisDumpBufferJob::DumpBufferTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
 		UINT size, char type, int idx, UINT stride, UINT offset)
 {
 	FILE *fd = NULL;
@@ -767,7 +1086,7 @@ void FrameAnalysisContext::DumpBufferTxt(wchar_t *filename, D3D11_MAPPED_SUBRESO
 
 	err = wfopen_ensuring_access(&fd, filename, L"w");
 	if (!fd) {
-		FALogErr("Unable to create %S: %u\n", filename, err);
+		FAJobLogErr("Unable to create %S: %u\n", filename, err);
 		return;
 	}
 
@@ -837,7 +1156,7 @@ static const char* TopologyStr(D3D11_PRIMITIVE_TOPOLOGY topology)
 	return "invalid";
 }
 
-void FrameAnalysisContext::dedupe_buf_filename_vb_txt(const wchar_t *bin_filename,
+void FrameAnalysisDumpBufferJob::dedupe_buf_filename_vb_txt(const wchar_t *bin_filename,
 		wchar_t *txt_filename, size_t size, int idx, UINT stride,
 		UINT offset, UINT first, UINT count, ID3DBlob *layout,
 		D3D11_PRIMITIVE_TOPOLOGY topology, DrawCallInfo *call_info)
@@ -877,7 +1196,7 @@ void FrameAnalysisContext::dedupe_buf_filename_vb_txt(const wchar_t *bin_filenam
 		StringCchPrintfExW(pos, rem, &pos, &rem, NULL, L"-inst_count=%u", call_info->InstanceCount);
 
 	if (FAILED(StringCchPrintfW(pos, rem, L".txt")))
-		FALogErr("Failed to create vertex buffer filename\n");
+		FAJobLogErr("Failed to create vertex buffer filename\n");
 }
 
 static void dump_ia_layout(FILE *fd, D3D11_INPUT_ELEMENT_DESC *layout_desc, size_t layout_elements, int slot, bool *per_vert, bool *per_inst)
@@ -942,402 +1261,12 @@ static void dump_vb_unknown_layout(FILE *fd, D3D11_MAPPED_SUBRESOURCE *map,
 	}
 }
 
-static UINT dxgi_format_alignment(DXGI_FORMAT format)
-{
-	// I'm not positive what the alignment constraints actually are - MSDN
-	// mentions they exist, but I don't think they go so far as being
-	// aligned to the size of the full format (I'm seeing vertex buffers
-	// that clearly are not). For now I'm going with the assumption that
-	// the alignment must match the individual components, and skipping
-	// those with variable sized components or unusual formats.
-	switch (format) {
-		case DXGI_FORMAT_R32G32B32A32_TYPELESS:
-		case DXGI_FORMAT_R32G32B32A32_FLOAT:
-		case DXGI_FORMAT_R32G32B32A32_UINT:
-		case DXGI_FORMAT_R32G32B32A32_SINT:
-		case DXGI_FORMAT_R32G32B32_TYPELESS:
-		case DXGI_FORMAT_R32G32B32_FLOAT:
-		case DXGI_FORMAT_R32G32B32_UINT:
-		case DXGI_FORMAT_R32G32B32_SINT:
-		case DXGI_FORMAT_R32G32_TYPELESS:
-		case DXGI_FORMAT_R32G32_FLOAT:
-		case DXGI_FORMAT_R32G32_UINT:
-		case DXGI_FORMAT_R32G32_SINT:
-		case DXGI_FORMAT_R32_TYPELESS:
-		case DXGI_FORMAT_D32_FLOAT:
-		case DXGI_FORMAT_R32_FLOAT:
-		case DXGI_FORMAT_R32_UINT:
-		case DXGI_FORMAT_R32_SINT:
-			return 4;
-		case DXGI_FORMAT_R16G16B16A16_TYPELESS:
-		case DXGI_FORMAT_R16G16B16A16_FLOAT:
-		case DXGI_FORMAT_R16G16B16A16_UNORM:
-		case DXGI_FORMAT_R16G16B16A16_UINT:
-		case DXGI_FORMAT_R16G16B16A16_SNORM:
-		case DXGI_FORMAT_R16G16B16A16_SINT:
-		case DXGI_FORMAT_R16G16_TYPELESS:
-		case DXGI_FORMAT_R16G16_FLOAT:
-		case DXGI_FORMAT_R16G16_UNORM:
-		case DXGI_FORMAT_R16G16_UINT:
-		case DXGI_FORMAT_R16G16_SNORM:
-		case DXGI_FORMAT_R16G16_SINT:
-		case DXGI_FORMAT_R16_TYPELESS:
-		case DXGI_FORMAT_R16_FLOAT:
-		case DXGI_FORMAT_D16_UNORM:
-		case DXGI_FORMAT_R16_UNORM:
-		case DXGI_FORMAT_R16_UINT:
-		case DXGI_FORMAT_R16_SNORM:
-		case DXGI_FORMAT_R16_SINT:
-			return 2;
-		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
-		case DXGI_FORMAT_R8G8B8A8_UNORM:
-		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
-		case DXGI_FORMAT_R8G8B8A8_UINT:
-		case DXGI_FORMAT_R8G8B8A8_SNORM:
-		case DXGI_FORMAT_R8G8B8A8_SINT:
-		case DXGI_FORMAT_R8G8_TYPELESS:
-		case DXGI_FORMAT_R8G8_UNORM:
-		case DXGI_FORMAT_R8G8_UINT:
-		case DXGI_FORMAT_R8G8_SNORM:
-		case DXGI_FORMAT_R8G8_SINT:
-		case DXGI_FORMAT_R8_TYPELESS:
-		case DXGI_FORMAT_R8_UNORM:
-		case DXGI_FORMAT_R8_UINT:
-		case DXGI_FORMAT_R8_SNORM:
-		case DXGI_FORMAT_R8_SINT:
-		case DXGI_FORMAT_A8_UNORM:
-		case DXGI_FORMAT_B8G8R8A8_UNORM:
-		case DXGI_FORMAT_B8G8R8X8_UNORM:
-		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
-		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
-		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
-		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
-			return 1;
-	}
-	return 0;
-}
-
-static float float16(uint16_t f16)
-{
-	// Shift sign and mantissa to new positions:
-	uint32_t f32 = ((f16 & 0x8000) << 16) | ((f16 & 0x3ff) << 13);
-	// Need to check special cases of the biased exponent:
-	int biased_exponent = (f16 & 0x7c00) >> 10;
-
-	if (biased_exponent == 0) {
-		// Zero / subnormal: New biased exponent remains zero
-	} else if (biased_exponent == 0x1f) {
-		// Infinity / NaN: New biased exponent is filled with 1s
-		f32 |= 0x7f800000;
-	} else {
-		// Normal number: Adjust the exponent bias:
-		biased_exponent = biased_exponent - 15 + 127;
-		f32 |= biased_exponent << 23;
-	}
-
-	return *(float*)&f32;
-}
-
-static float unorm24(uint32_t val)
-{
-	return (float)val / (float)0xffffff;
-}
-
-static float unorm16(uint16_t val)
-{
-	return (float)val / (float)0xffff;
-}
-
-static float snorm16(int16_t val)
-{
-	return (float)val / (float)0x7fff;
-}
-
-static float unorm8(uint8_t val)
-{
-	return (float)val / (float)0xff;
-}
-
-static float snorm8(int8_t val)
-{
-	return (float)val / (float)0x7f;
-}
-
-static int fprint_dxgi_format(FILE *fd, DXGI_FORMAT format, uint8_t *buf)
-{
-	float *f = (float*)buf;
-	uint32_t *u32 = (uint32_t*)buf;
-	int32_t *s32 = (int32_t*)buf;
-	uint16_t *u16 = (uint16_t*)buf;
-	int16_t *s16 = (int16_t*)buf;
-	uint8_t *u8 = (uint8_t*)buf;
-	int8_t *s8 = (int8_t*)buf;
-	unsigned i;
-
-	switch (format) {
-		// --- 32-bit ---
-		case DXGI_FORMAT_R32G32B32A32_TYPELESS:
-			return fprintf(fd, "%08x, %08x, %08x, %08x", u32[0], u32[1], u32[2], u32[3]);
-		case DXGI_FORMAT_R32G32B32_TYPELESS:
-			return fprintf(fd, "%08x, %08x, %08x", u32[0], u32[1], u32[2]);
-		case DXGI_FORMAT_R32G32_TYPELESS:
-			return fprintf(fd, "%08x, %08x", u32[0], u32[1]);
-		case DXGI_FORMAT_R32_TYPELESS:
-			return fprintf(fd, "%08x", u32[0]);
-
-		case DXGI_FORMAT_R32G32B32A32_FLOAT:
-			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", f[0], f[1], f[2], f[3]);
-		case DXGI_FORMAT_R32G32B32_FLOAT:
-			return fprintf(fd, "%.9g, %.9g, %.9g", f[0], f[1], f[2]);
-		case DXGI_FORMAT_R32G32_FLOAT:
-			return fprintf(fd, "%.9g, %.9g", f[0], f[1]);
-		case DXGI_FORMAT_D32_FLOAT:
-		case DXGI_FORMAT_R32_FLOAT:
-			return fprintf(fd, "%.9g", f[0]);
-
-		case DXGI_FORMAT_R32G32B32A32_UINT:
-			return fprintf(fd, "%u, %u, %u, %u", u32[0], u32[1], u32[2], u32[3]);
-		case DXGI_FORMAT_R32G32B32_UINT:
-			return fprintf(fd, "%u, %u, %u", u32[0], u32[1], u32[2]);
-		case DXGI_FORMAT_R32G32_UINT:
-			return fprintf(fd, "%u, %u", u32[0], u32[1]);
-		case DXGI_FORMAT_R32_UINT:
-			return fprintf(fd, "%u", u32[0]);
-
-		case DXGI_FORMAT_R32G32B32A32_SINT:
-			return fprintf(fd, "%d, %d, %d, %d", s32[0], s32[1], s32[2], s32[3]);
-		case DXGI_FORMAT_R32G32B32_SINT:
-			return fprintf(fd, "%d, %d, %d", s32[0], s32[1], s32[2]);
-		case DXGI_FORMAT_R32G32_SINT:
-			return fprintf(fd, "%d, %d", s32[0], s32[1]);
-		case DXGI_FORMAT_R32_SINT:
-			return fprintf(fd, "%d", s32[0]);
-
-		// --- 16-bit ---
-		case DXGI_FORMAT_R16G16B16A16_TYPELESS:
-			return fprintf(fd, "%04x, %04x, %04x, %04x", u16[0], u16[1], u16[2], u16[3]);
-		case DXGI_FORMAT_R16G16_TYPELESS:
-			return fprintf(fd, "%04x, %04x", u16[0], u16[1]);
-		case DXGI_FORMAT_R16_TYPELESS:
-			return fprintf(fd, "%04x", u16[0]);
-
-		// %.9g is probably excessive, but I haven't calculated or
-		// verified the actual decimal precision needed to ensure
-		// 16-bit floats can be reproduced exactly, and I know that
-		// %.9g is enough for 32-bit floats so it is safer for now:
-		case DXGI_FORMAT_R16G16B16A16_FLOAT:
-			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", float16(u16[0]), float16(u16[1]), float16(u16[2]), float16(u16[3]));
-		case DXGI_FORMAT_R16G16_FLOAT:
-			return fprintf(fd, "%.9g, %.9g", float16(u16[0]), float16(u16[1]));
-		case DXGI_FORMAT_R16_FLOAT:
-			return fprintf(fd, "%.9g", float16(u16[0]));
-
-		// And of course, if we were to work out a better decimal
-		// precision value, remember that a 16-bit UNORM has 16 bits of
-		// precision, while a 16-bit FLOAT only has 11.
-		case DXGI_FORMAT_R16G16B16A16_UNORM:
-			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", unorm16(u16[0]), unorm16(u16[1]), unorm16(u16[2]), unorm16(u16[3]));
-		case DXGI_FORMAT_R16G16_UNORM:
-			return fprintf(fd, "%.9g, %.9g", unorm16(u16[0]), unorm16(u16[1]));
-		case DXGI_FORMAT_D16_UNORM:
-		case DXGI_FORMAT_R16_UNORM:
-			return fprintf(fd, "%.9g", unorm16(u16[0]));
-
-		case DXGI_FORMAT_R16G16B16A16_SNORM:
-			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", snorm16(s16[0]), snorm16(s16[1]), snorm16(s16[2]), snorm16(s16[3]));
-		case DXGI_FORMAT_R16G16_SNORM:
-			return fprintf(fd, "%.9g, %.9g", snorm16(s16[0]), snorm16(s16[1]));
-		case DXGI_FORMAT_R16_SNORM:
-			return fprintf(fd, "%.9g", snorm16(s16[0]));
-
-		case DXGI_FORMAT_R16G16B16A16_UINT:
-			return fprintf(fd, "%u, %u, %u, %u", u16[0], u16[1], u16[2], u16[3]);
-		case DXGI_FORMAT_R16G16_UINT:
-			return fprintf(fd, "%u, %u", u16[0], u16[1]);
-		case DXGI_FORMAT_R16_UINT:
-			return fprintf(fd, "%u", u16[0]);
-
-		case DXGI_FORMAT_R16G16B16A16_SINT:
-			return fprintf(fd, "%d, %d, %d, %d", s16[0], s16[1], s16[2], s16[3]);
-		case DXGI_FORMAT_R16G16_SINT:
-			return fprintf(fd, "%d, %d", s16[0], s16[1]);
-		case DXGI_FORMAT_R16_SINT:
-			return fprintf(fd, "%d", s16[0]);
-
-		// --- 8-bit ---
-		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
-		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
-			return fprintf(fd, "%02x, %02x, %02x, %02x", u8[0], u8[1], u8[2], u8[3]);
-		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
-			return fprintf(fd, "%02x, %02x, %02x", u8[0], u8[1], u8[2]);
-		case DXGI_FORMAT_R8G8_TYPELESS:
-			return fprintf(fd, "%02x, %02x", u8[0], u8[1]);
-		case DXGI_FORMAT_R8_TYPELESS:
-			return fprintf(fd, "%02x", u8[0]);
-
-		case DXGI_FORMAT_R8G8B8A8_UNORM:
-		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
-		case DXGI_FORMAT_B8G8R8A8_UNORM:
-		case DXGI_FORMAT_B8G8R8X8_UNORM:
-		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
-		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
-		case DXGI_FORMAT_R8G8_B8G8_UNORM:
-		case DXGI_FORMAT_G8R8_G8B8_UNORM:
-			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", unorm8(u8[0]), unorm8(u8[1]), unorm8(u8[2]), unorm8(u8[3]));
-		case DXGI_FORMAT_R8G8_UNORM:
-			return fprintf(fd, "%.9g, %.9g", unorm8(u8[0]), unorm8(u8[1]));
-		case DXGI_FORMAT_R8_UNORM:
-			return fprintf(fd, "%.9g", unorm8(u8[0]));
-
-		case DXGI_FORMAT_R8G8B8A8_SNORM:
-			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", snorm8(s8[0]), snorm8(s8[1]), snorm8(s8[2]), snorm8(s8[3]));
-		case DXGI_FORMAT_R8G8_SNORM:
-			return fprintf(fd, "%.9g, %.9g", snorm8(s8[0]), snorm8(s8[1]));
-		case DXGI_FORMAT_R8_SNORM:
-		case DXGI_FORMAT_A8_UNORM:
-			return fprintf(fd, "%.9g", snorm8(s8[0]));
-
-		case DXGI_FORMAT_R8G8B8A8_UINT:
-			return fprintf(fd, "%u, %u, %u, %u", u8[0], u8[1], u8[2], u8[3]);
-		case DXGI_FORMAT_R8G8_UINT:
-			return fprintf(fd, "%u, %u", u8[0], u8[1]);
-		case DXGI_FORMAT_R8_UINT:
-			return fprintf(fd, "%u", u8[0]);
-
-		case DXGI_FORMAT_R8G8B8A8_SINT:
-			return fprintf(fd, "%d, %d, %d, %d", s8[0], s8[1], s8[2], s8[3]);
-		case DXGI_FORMAT_R8G8_SINT:
-			return fprintf(fd, "%d, %d", s8[0], s8[1]);
-		case DXGI_FORMAT_R8_SINT:
-			return fprintf(fd, "%d", s8[0]);
-
-		case DXGI_FORMAT_R32G8X24_TYPELESS:
-		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
-		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
-		case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
-			return fprintf(fd, "%.9g, %d", f[0], u8[4]);
-
-		case DXGI_FORMAT_R24G8_TYPELESS:
-		case DXGI_FORMAT_D24_UNORM_S8_UINT:
-		case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
-		case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
-			return fprintf(fd, "%.9g, %d", unorm24(u32[0] & 0xffffff), u8[3]);
-
-		// TODO: Unusual field sizes:
-		// case DXGI_FORMAT_R10G10B10A2_TYPELESS:
-		// case DXGI_FORMAT_R10G10B10A2_UNORM:
-		// case DXGI_FORMAT_R10G10B10A2_UINT:
-		// case DXGI_FORMAT_R11G11B10_FLOAT:
-		// case DXGI_FORMAT_R1_UNORM:
-		// case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
-		// case DXGI_FORMAT_B5G6R5_UNORM:
-		// case DXGI_FORMAT_B5G5R5A1_UNORM:
-		// case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
-	}
-
-	for (i = 0; i < dxgi_format_size(format); i++)
-		fprintf(fd, "%02x", buf[i]);
-	return i * 2;
-}
-
-
-static void dump_vb_elem(FILE *fd, uint8_t *buf,
-		D3D11_INPUT_ELEMENT_DESC *layout_desc, size_t layout_elements,
-		int slot, UINT vb_idx, UINT elem, UINT stride)
-{
-	UINT offset = 0, alignment, size;
-
-	if (layout_desc[elem].InputSlot != slot)
-		return;
-
-	if (layout_desc[elem].AlignedByteOffset != D3D11_APPEND_ALIGNED_ELEMENT) {
-		offset = layout_desc[elem].AlignedByteOffset;
-	} else {
-		alignment = dxgi_format_alignment(layout_desc[elem].Format);
-		if (!alignment) {
-			fprintf(fd, "# WARNING: Unknown format alignment, vertex buffer may be decoded incorrectly\n");
-		} else if (offset % alignment) {
-			fprintf(fd, "# WARNING: Untested alignment code in use, please report incorrectly decoded vertex buffers\n");
-			// XXX: Also, what if the entire vertex is misaligned in the buffer?
-			offset += alignment - (offset % alignment);
-		}
-	}
-
-	fprintf(fd, "vb%i[%u]+%03u %s", slot, vb_idx, offset, layout_desc[elem].SemanticName);
-	if (layout_desc[elem].SemanticIndex)
-		fprintf(fd, "%u", layout_desc[elem].SemanticIndex);
-	fprintf(fd, ": ");
-
-	fprint_dxgi_format(fd, layout_desc[elem].Format, buf + offset);
-	fprintf(fd, "\n");
-
-	size = dxgi_format_size(layout_desc[elem].Format);
-	if (!size)
-		fprintf(fd, "# WARNING: Unknown format size, vertex buffer may be decoded incorrectly\n");
-	offset += size;
-	if (offset > stride)
-		fprintf(fd, "# WARNING: Offset exceeded stride, vertex buffer may be decoded incorrectly\n");
-}
-
-static void dump_vb_known_layout(FILE *fd, D3D11_MAPPED_SUBRESOURCE *map,
-		D3D11_INPUT_ELEMENT_DESC *layout_desc, size_t layout_elements,
-		UINT size, int slot, UINT offset, UINT first, UINT count, UINT stride)
-{
-	UINT vertex, elem, start, end;
-
-	start = offset / stride + first;
-	end = size / stride;
-	if (count)
-		end = min(end, start + count);
-
-	for (vertex = start; vertex < end; vertex++) {
-		fprintf(fd, "\n");
-		for (elem = 0; elem < layout_elements; elem++) {
-			if (layout_desc[elem].InputSlotClass != D3D11_INPUT_PER_VERTEX_DATA)
-				continue;
-
-			dump_vb_elem(fd, (uint8_t*)map->pData + stride*vertex,
-					layout_desc, layout_elements, slot,
-					vertex - start, elem, stride);
-		}
-	}
-}
-
-static void dump_vb_instance_data(FILE *fd, D3D11_MAPPED_SUBRESOURCE *map,
-		D3D11_INPUT_ELEMENT_DESC *layout_desc, size_t layout_elements,
-		UINT size, int slot, UINT offset, UINT first, UINT count, UINT stride)
-{
-	UINT instance, idx, elem, start, end;
-
-	start = offset / stride + first;
-	end = size / stride;
-	if (count)
-		end = min(end, start + count);
-
-	for (instance = start; instance < end; instance++) {
-		fprintf(fd, "\n");
-		for (elem = 0; elem < layout_elements; elem++) {
-			if (layout_desc[elem].InputSlotClass != D3D11_INPUT_PER_INSTANCE_DATA)
-				continue;
-
-			if (layout_desc[elem].InstanceDataStepRate)
-				idx = (instance-start) / layout_desc[elem].InstanceDataStepRate + start;
-			else
-				idx = instance;
-
-			dump_vb_elem(fd, (uint8_t*)map->pData + stride*idx,
-					layout_desc, layout_elements, slot,
-					idx - start, elem, stride);
-		}
-	}
-}
-
 /*
  * Dumps the vertex buffer in several formats.
  * FIXME: We should wrap the input layout object to get the correct format (and
  * other info like the semantic).
  */
-void FrameAnalysisContext::DumpVBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
+void FrameAnalysisDumpBufferJob::DumpVBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
 		UINT size, int slot, UINT stride, UINT offset, UINT first, UINT count, ID3DBlob *layout,
 		D3D11_PRIMITIVE_TOPOLOGY topology, DrawCallInfo *call_info)
 {
@@ -1346,10 +1275,11 @@ void FrameAnalysisContext::DumpVBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE
 	D3D11_INPUT_ELEMENT_DESC *layout_desc = NULL;
 	size_t layout_elements;
 	bool per_vert = false, per_inst = false;
+	std::string text;
 
 	err = wfopen_ensuring_access(&fd, filename, L"w");
 	if (!fd) {
-		FALogErr("Unable to create %S: %u\n", filename, err);
+		FAJobLogErr("Unable to create %S: %u\n", filename, err);
 		return;
 	}
 
@@ -1372,21 +1302,23 @@ void FrameAnalysisContext::DumpVBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE
 		dump_ia_layout(fd, layout_desc, layout_elements, slot, &per_vert, &per_inst);
 	}
 	if (!stride) {
-		FALogErr("Cannot dump vertex buffer with stride=0\n");
+		FAJobLogErr("Cannot dump vertex buffer with stride=0\n");
 		goto out_close;
 	}
 
 	if (layout_desc) {
 		if (per_vert) {
 			fprintf(fd, "\nvertex-data:\n");
-			dump_vb_known_layout(fd, map, layout_desc, layout_elements,
-					size, slot, offset, first, count, stride);
+			VertexBufferTextFormatter(layout_desc, layout_elements, slot,
+					D3D11_INPUT_PER_VERTEX_DATA).format(&text, fd,
+					(uint8_t*)map->pData, size, offset, first, count, stride);
 		}
 
 		if (per_inst && call_info) {
 			fprintf(fd, "\ninstance-data:\n");
-			dump_vb_instance_data(fd, map, layout_desc,
-					layout_elements, size, slot, offset,
+			VertexBufferTextFormatter(layout_desc, layout_elements, slot,
+					D3D11_INPUT_PER_INSTANCE_DATA).format(&text, fd,
+					(uint8_t*)map->pData, size, offset,
 					call_info->FirstInstance,
 					call_info->InstanceCount, stride);
 		}
@@ -1398,7 +1330,7 @@ out_close:
 	fclose(fd);
 }
 
-void FrameAnalysisContext::dedupe_buf_filename_ib_txt(const wchar_t *bin_filename,
+void FrameAnalysisDumpBufferJob::dedupe_buf_filename_ib_txt(const wchar_t *bin_filename,
 		wchar_t *txt_filename, size_t size, DXGI_FORMAT ib_fmt,
 		UINT offset, UINT first, UINT count, D3D11_PRIMITIVE_TOPOLOGY topology)
 {
@@ -1425,10 +1357,10 @@ void FrameAnalysisContext::dedupe_buf_filename_ib_txt(const wchar_t *bin_filenam
 		StringCchPrintfExW(pos, rem, &pos, &rem, NULL, L"-count=%u", count);
 
 	if (FAILED(StringCchPrintfW(pos, rem, L".txt")))
-		FALogErr("Failed to create index buffer filename\n");
+		FAJobLogErr("Failed to create index buffer filename\n");
 }
 
-void FrameAnalysisContext::DumpIBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
+void FrameAnalysisDumpBufferJob::DumpIBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
 		UINT size, DXGI_FORMAT format, UINT offset, UINT first, UINT count,
 		D3D11_PRIMITIVE_TOPOLOGY topology)
 {
@@ -1441,7 +1373,7 @@ void FrameAnalysisContext::DumpIBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE
 
 	err = wfopen_ensuring_access(&fd, filename, L"w");
 	if (!fd) {
-		FALogErr("Unable to create %S: %u\n", filename, err);
+		FAJobLogErr("Unable to create %S: %u\n", filename, err);
 		return;
 	}
 
@@ -1508,7 +1440,7 @@ void FrameAnalysisContext::DumpIBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE
 }
 
 template <typename DescType>
-void FrameAnalysisContext::DumpDesc(DescType *desc, const wchar_t *filename)
+void FrameAnalysisDumpJob::DumpDesc(DescType *desc, const wchar_t *filename)
 {
 	FILE *fd = NULL;
 	char buf[256];
@@ -1518,7 +1450,7 @@ void FrameAnalysisContext::DumpDesc(DescType *desc, const wchar_t *filename)
 
 	err = wfopen_ensuring_access(&fd, filename, L"w");
 	if (!fd) {
-		FALogErr("Unable to create %S: %u\n", filename, err);
+		FAJobLogErr("Unable to create %S: %u\n", filename, err);
 		return;
 	}
 	fwrite(buf, 1, strlen(buf), fd);
@@ -1711,43 +1643,76 @@ void FrameAnalysisContext::DumpBufferImmediateCtx(ID3D11Buffer *staging, D3D11_B
 		D3D11_PRIMITIVE_TOPOLOGY topology, DrawCallInfo *call_info,
 		ID3D11Buffer *staged_ib_for_vb, UINT ib_off_for_vb)
 {
-	wchar_t bin_filename[MAX_PATH], txt_filename[MAX_PATH];
+	FrameAnalysisDumpBufferJob *job;
 	D3D11_MAPPED_SUBRESOURCE map;
+	wchar_t dedupe_dir[MAX_PATH];
 	HRESULT hr;
-	FILE *fd = NULL;
-	wchar_t *bin_ext;
-	size_t ext;
-	errno_t err;
+
+	// Needs the staged index buffer, so must be done before handing the
+	// rest of the dump off to a writer thread:
+	if ((analyse_options & FrameAnalysisOptions::FMT_BUF_TXT) &&
+	   !(buf_type_mask & FrameAnalysisOptions::DUMP_CB) &&
+	    (buf_type_mask & FrameAnalysisOptions::DUMP_VB)) {
+		determine_vb_count(&count, staged_ib_for_vb, call_info, ib_off_for_vb, ib_fmt);
+	}
+
+	get_deduped_dir(dedupe_dir, MAX_PATH);
+	job = new FrameAnalysisDumpBufferJob(analyse_options, filename.c_str(), dedupe_dir,
+			orig_desc, buf_type_mask, idx, ib_fmt, stride, offset, first,
+			count, layout, topology, call_info);
+
+	// May block if the writers are behind, so do this before mapping:
+	job->data = G->frame_analysis_writer.alloc_buffer(orig_desc->ByteWidth);
 
 	hr = GetDumpingContext()->Map(staging, 0, D3D11_MAP_READ, 0, &map);
 	if (FAILED(hr)) {
 		FALogErr("DumpBuffer failed to map staging resource: 0x%x\n", hr);
+		G->frame_analysis_writer.release_buffer(job->data);
+		delete job;
 		return;
 	}
 
-	dedupe_buf_filename(staging, orig_desc, &map, bin_filename, MAX_PATH);
+	memcpy(job->data->data(), map.pData, orig_desc->ByteWidth);
+
+	GetDumpingContext()->Unmap(staging, 0);
+
+	FALogInfo("Dumping Buffer %S\n", filename.c_str());
+	G->frame_analysis_writer.submit(job);
+}
+
+void FrameAnalysisDumpBufferJob::run()
+{
+	wchar_t bin_filename[MAX_PATH], txt_filename[MAX_PATH];
+	D3D11_MAPPED_SUBRESOURCE map;
+	wstring dedupe_name;
+	wchar_t *bin_ext;
+	size_t ext;
+
+	// The text dumping routines were written to work on the mapped
+	// staging buffer, which our copy stands in for:
+	map.pData = data->data();
+	map.RowPitch = orig_desc.ByteWidth;
+	map.DepthPitch = orig_desc.ByteWidth;
+
+	dedupe_buf_filename(&map, bin_filename, MAX_PATH);
 
 	ext = filename.find_last_of(L'.');
 	bin_ext = wcsrchr(bin_filename, L'.');
 	if (ext == wstring::npos || !bin_ext) {
-		FALogErr("DumpBuffer: Filename missing extension\n");
-		goto out_unmap;
+		FAJobLogErr("DumpBuffer: Filename missing extension\n");
+		return;
 	}
 
+	dedupe_name = bin_filename;
+	G->frame_analysis_writer.claim_name(dedupe_name);
+
 	if (analyse_options & FrameAnalysisOptions::FMT_BUF_BIN) {
 		filename.replace(ext, wstring::npos, L".buf");
 		wcscpy_s(bin_ext, MAX_PATH + bin_filename - bin_ext, L".buf");
-		FALogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), bin_filename);
+		FAJobLogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), bin_filename);
 
-		if (GetFileAttributes(bin_filename) == INVALID_FILE_ATTRIBUTES) {
-			err = wfopen_ensuring_access(&fd, bin_filename, L"wb");
-			if (!fd) {
-				FALogErr("Unable to create %S: %u\n", bin_filename, err);
-				goto out_unmap;
-			}
-			fwrite(map.pData, 1, orig_desc->ByteWidth, fd);
-			fclose(fd);
-		}
+		if (!deduped_file_exists(bin_filename))
+			write_deduped_file(bin_filename, map.pData, orig_desc.ByteWidth);
 		link_deduplicated_files(filename.c_str(), bin_filename);
 	}
 
@@ -1756,31 +1721,30 @@ void FrameAnalysisContext::DumpBufferImmediateCtx(ID3D11Buffer *staging, D3D11_B
 
 		if (buf_type_mask & FrameAnalysisOptions::DUMP_CB) {
 			dedupe_buf_filename_txt(bin_filename, txt_filename, MAX_PATH, 'c', idx, stride, offset);
-			FALogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), txt_filename);
-			if (GetFileAttributes(txt_filename) == INVALID_FILE_ATTRIBUTES) {
-				DumpBufferTxt(txt_filename, &map, orig_desc->ByteWidth, 'c', idx, stride, offset);
+			FAJobLogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), txt_filename);
+			if (!deduped_file_exists(txt_filename)) {
+				DumpBufferTxt(txt_filename, &map, orig_desc.ByteWidth, 'c', idx, stride, offset);
 			}
 		} else if (buf_type_mask & FrameAnalysisOptions::DUMP_VB) {
-			determine_vb_count(&count, staged_ib_for_vb, call_info, ib_off_for_vb, ib_fmt);
-			dedupe_buf_filename_vb_txt(bin_filename, txt_filename, MAX_PATH, idx, stride, offset, first, count, layout, topology, call_info);
-			FALogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), txt_filename);
-			if (GetFileAttributes(txt_filename) == INVALID_FILE_ATTRIBUTES) {
-				DumpVBTxt(txt_filename, &map, orig_desc->ByteWidth, idx, stride, offset, first, count, layout, topology, call_info);
+			dedupe_buf_filename_vb_txt(bin_filename, txt_filename, MAX_PATH, idx, stride, offset, first, count, layout.Get(), topology, has_call_info ? &call_info : NULL);
+			FAJobLogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), txt_filename);
+			if (!deduped_file_exists(txt_filename)) {
+				DumpVBTxt(txt_filename, &map, orig_desc.ByteWidth, idx, stride, offset, first, count, layout.Get(), topology, has_call_info ? &call_info : NULL);
 			}
 		} else if (buf_type_mask & FrameAnalysisOptions::DUMP_IB) {
 			dedupe_buf_filename_ib_txt(bin_filename, txt_filename, MAX_PATH, ib_fmt, offset, first, count, topology);
-			FALogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), txt_filename);
-			if (GetFileAttributes(txt_filename) == INVALID_FILE_ATTRIBUTES) {
-				DumpIBTxt(txt_filename, &map, orig_desc->ByteWidth, ib_fmt, offset, first, count, topology);
+			FAJobLogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), txt_filename);
+			if (!deduped_file_exists(txt_filename)) {
+				DumpIBTxt(txt_filename, &map, orig_desc.ByteWidth, ib_fmt, offset, first, count, topology);
 			}
 		} else {
 			// We don't know what kind of buffer this is, so just
 			// use the generic dump routine:
 
 			dedupe_buf_filename_txt(bin_filename, txt_filename, MAX_PATH, '?', idx, stride, offset);
-			FALogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), txt_filename);
-			if (GetFileAttributes(txt_filename) == INVALID_FILE_ATTRIBUTES) {
-				DumpBufferTxt(txt_filename, &map, orig_desc->ByteWidth, '?', idx, stride, offset);
+			FAJobLogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), txt_filename);
+			if (!deduped_file_exists(txt_filename)) {
+				DumpBufferTxt(txt_filename, &map, orig_desc.ByteWidth, '?', idx, stride, offset);
 			}
 		}
 		link_deduplicated_files(filename.c_str(), txt_filename);
@@ -1791,15 +1755,14 @@ void FrameAnalysisContext::DumpBufferImmediateCtx(ID3D11Buffer *staging, D3D11_B
 	if (analyse_options & FrameAnalysisOptions::FMT_DESC) {
 		filename.replace(ext, wstring::npos, L".dsc");
 		wcscpy_s(bin_ext, MAX_PATH + bin_filename - bin_ext, L".dsc");
-		FALogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), bin_filename);
+		FAJobLogInfo("Dumping Buffer %S -> %S\n", filename.c_str(), bin_filename);
 
-		if (GetFileAttributes(bin_filename) == INVALID_FILE_ATTRIBUTES)
-			DumpDesc(orig_desc, bin_filename);
+		if (!deduped_file_exists(bin_filename))
+			DumpDesc(&orig_desc, bin_filename);
 		link_deduplicated_files(filename.c_str(), bin_filename);
 	}
 
-out_unmap:
-	GetDumpingContext()->Unmap(staging, 0);
+	G->frame_analysis_writer.release_name(dedupe_name);
 }
 
 void FrameAnalysisContext::DumpBuffer(ID3D11Buffer *buffer, wchar_t *filename,
@@ -1912,7 +1875,11 @@ static BOOL CreateDeferredFADirectory(LPCWSTR path)
 
 void FrameAnalysisContext::get_deduped_dir(wchar_t *path, size_t size)
 {
-	if (analyse_options & FrameAnalysisOptions::SHARE_DEDUPED) {
+	// The archive is per frame analysis directory, and the deduped
+	// directory only holds files in transit to it, so share_dupes does
+	// not apply in archive mode:
+	if ((analyse_options & FrameAnalysisOptions::SHARE_DEDUPED) &&
+	   !(analyse_options & FrameAnalysisOptions::ARCHIVE)) {
 		if (!GetModuleFileName(migoto_handle, path, (DWORD)size))
 			return;
 		wcsrchr(path, L'\\')[1] = 0;
@@ -1964,14 +1931,8 @@ HRESULT FrameAnalysisContext::FrameAnalysisFilename(wchar_t *filename, size_t si
 		StringCchPrintfExW(pos, rem, &pos, &rem, NULL, L"%06i", draw_call);
 	}
 
-	EnterCriticalSectionPretty(&G->mResourcesLock);
-	try {
-		hash = G->mResources.at(handle).hash;
-		orig_hash = G->mResources.at(handle).orig_hash;
-	} catch (std::out_of_range) {
-		hash = orig_hash = 0;
-	}
-	LeaveCriticalSection(&G->mResourcesLock);
+	hash = GetResourceHash(handle);
+	orig_hash = GetOrigResourceHash(handle);
 
 	if (hash) {
 		try {
@@ -2046,14 +2007,8 @@ HRESULT FrameAnalysisContext::FrameAnalysisFilenameResource(wchar_t *filename, s
 
 	StringCchPrintfExW(pos, rem, &pos, &rem, NULL, L"%s", type);
 
-	EnterCriticalSectionPretty(&G->mResourcesLock);
-	try {
-		hash = G->mResources.at(handle).hash;
-		orig_hash = G->mResources.at(handle).orig_hash;
-	} catch (std::out_of_range) {
-		hash = orig_hash = 0;
-	}
-	LeaveCriticalSection(&G->mResourcesLock);
+	hash = GetResourceHash(handle);
+	orig_hash = GetOrigResourceHash(handle);
 
 	if (hash) {
 		try {
@@ -2089,14 +2044,13 @@ HRESULT FrameAnalysisContext::FrameAnalysisFilenameResource(wchar_t *filename, s
 	return hr;
 }
 
-const wchar_t* FrameAnalysisContext::dedupe_tex2d_filename(ID3D11Texture2D *resource,
-		D3D11_TEXTURE2D_DESC *orig_desc, wchar_t *dedupe_filename,
-		size_t size, const wchar_t *traditional_filename, DXGI_FORMAT format)
+void FrameAnalysisDumpTex2DJob::dedupe_tex2d_filename(wchar_t *dedupe_filename, size_t size)
 {
-	D3D11_MAPPED_SUBRESOURCE map;
-	HRESULT hr;
+	D3D11_TEXTURE2D_DESC *hash_desc = &orig_desc;
+	D3D11_SUBRESOURCE_DATA subresource;
+	size_t orig_row_count = 0;
+	DXGI_FORMAT fmt = format;
 	uint32_t hash;
-	wchar_t dedupe_dir[MAX_PATH];
 
 	// Many of the files dumped with frame analysis are identical, and this
 	// can take a very long time and waste a lot of disk space to dump them
@@ -2117,43 +2071,36 @@ const wchar_t* FrameAnalysisContext::dedupe_tex2d_filename(ID3D11Texture2D *reso
 	// be reasons it won't if the description retrieved from DirectX
 	// doesn't match the description used to create it (e.g. mip-maps being
 	// generated after creation I guess).
-
-	hr = GetDumpingContext()->Map(resource, 0, D3D11_MAP_READ, 0, &map);
-	if (FAILED(hr)) {
-		FALogErr("Frame Analysis filename deduplication failed to map resource: 0x%x\n", hr);
-		goto err;
-	};
-
-	// CalcTexture2DDataHash takes a D3D11_SUBRESOURCE_DATA*, which happens
-	// to be binary identical to a D3D11_MAPPED_SUBRESOURCE (though it is
-	// not an array), so we can safely cast it.
 	//
 	// Now using CalcTexture2DDataHashAccurate to take the full texture
 	// into consideration when generating the hash - necessary as our
 	// legacy texture hash is very broken (passable for texture filtering,
 	// but not for this) and doesn't hash anywhere near the full image, so
 	// changes in the mid to lower half of the image won't affect the hash.
-	hash = CalcTexture2DDataHashAccurate(orig_desc, (D3D11_SUBRESOURCE_DATA*)&map);
-	hash = CalcTexture2DDescHash(hash, orig_desc);
-
-	GetDumpingContext()->Unmap(resource, 0);
-
-	if (format == DXGI_FORMAT_UNKNOWN)
-		format = orig_desc->Format;
-
-	get_deduped_dir(dedupe_dir, MAX_PATH);
-	_snwprintf_s(dedupe_filename, size, size, L"%ls\\%08x-%S.XXX", dedupe_dir, hash, TexFormatStr(format));
-
-	return dedupe_filename;
-err:
-	return traditional_filename;
-}
-
-void FrameAnalysisContext::dedupe_buf_filename(ID3D11Buffer *resource,
-		D3D11_BUFFER_DESC *orig_desc, D3D11_MAPPED_SUBRESOURCE *map,
+	//
+	// The hash skips the padding at the end of each row, so hashing our
+	// copy with the padding already removed gives the same result as
+	// hashing the mapped staging resource did. Should the original
+	// description call for more rows than we copied (it's not one we
+	// created) use the staging description rather than read past the end.
+	subresource.pSysMem = data->data();
+	subresource.SysMemPitch = (UINT)row_bytes;
+	subresource.SysMemSlicePitch = (UINT)data->size();
+	if (FAILED(GetTextureSurfaceInfo(orig_desc.Width, orig_desc.Height, orig_desc.Format, NULL, &orig_row_count))
+			|| orig_row_count > row_count)
+		hash_desc = &staging_desc;
+	hash = CalcTexture2DDataHashAccurate(hash_desc, &subresource);
+	hash = CalcTexture2DDescHash(hash, &orig_desc);
+
+	if (fmt == DXGI_FORMAT_UNKNOWN)
+		fmt = orig_desc.Format;
+
+	_snwprintf_s(dedupe_filename, size, size, L"%ls\\%08x-%S.XXX", dedupe_dir.c_str(), hash, TexFormatStr(fmt));
+}
+
+void FrameAnalysisDumpBufferJob::dedupe_buf_filename(D3D11_MAPPED_SUBRESOURCE *map,
 		wchar_t *dedupe_filename, size_t size)
 {
-	wchar_t dedupe_dir[MAX_PATH];
 	uint32_t hash;
 
 	// Many of the files dumped with frame analysis are identical, and this
@@ -2176,14 +2123,13 @@ void FrameAnalysisContext::dedupe_buf_filename(ID3D11Buffer *resource,
 	// doesn't match the description used to create it (e.g. unused fields
 	// for a given buffer type being zeroed out).
 
-	hash = crc32c_hw(0, map->pData, orig_desc->ByteWidth);
-	hash = crc32c_hw(hash, orig_desc, sizeof(D3D11_BUFFER_DESC));
+	hash = crc32c_hw(0, map->pData, orig_desc.ByteWidth);
+	hash = crc32c_hw(hash, &orig_desc, sizeof(D3D11_BUFFER_DESC));
 
-	get_deduped_dir(dedupe_dir, MAX_PATH);
-	_snwprintf_s(dedupe_filename, size, size, L"%ls\\%08x.XXX", dedupe_dir, hash);
+	_snwprintf_s(dedupe_filename, size, size, L"%ls\\%08x.XXX", dedupe_dir.c_str(), hash);
 }
 
-void FrameAnalysisContext::rotate_deduped_file(const wchar_t *dedupe_filename)
+void FrameAnalysisDumpJob::rotate_deduped_file(const wchar_t *dedupe_filename)
 {
 	wchar_t rotated_filename[MAX_PATH];
 	unsigned rotate;
@@ -2212,7 +2158,7 @@ void FrameAnalysisContext::rotate_deduped_file(const wchar_t *dedupe_filename)
 			// xxxxxxx.1.xxx - max 1023 hard links
 			// xxxxxxx.2.xxx - max 1023 hard links
 			// etc.
-			FALogInfo("Max hard links exceeded, rotating deduped file: %S\n", rotated_filename);
+			FAJobLogInfo("Max hard links exceeded, rotating deduped file: %S\n", rotated_filename);
 			MoveFile(dedupe_filename, rotated_filename);
 			CopyFile(rotated_filename, dedupe_filename, TRUE);
 			return;
@@ -2220,7 +2166,7 @@ void FrameAnalysisContext::rotate_deduped_file(const wchar_t *dedupe_filename)
 	}
 }
 
-void FrameAnalysisContext::rotate_when_nearing_hard_link_limit(const wchar_t *dedupe_filename)
+void FrameAnalysisDumpJob::rotate_when_nearing_hard_link_limit(const wchar_t *dedupe_filename)
 {
 	HANDLE f;
 	BY_HANDLE_FILE_INFORMATION info;
@@ -2276,10 +2222,71 @@ static bool create_shortcut(const wchar_t *filename, const wchar_t *dedupe_filen
 	return SUCCEEDED(hr);
 }
 
-void FrameAnalysisContext::link_deduplicated_files(const wchar_t *filename, const wchar_t *dedupe_filename)
+// Writes out a unique file, or in archive mode adds it straight to the pack
+// without it ever touching the disk as a file of its own:
+bool FrameAnalysisDumpJob::write_deduped_file(const wchar_t *dedupe_filename, const void *buf, size_t size)
+{
+	FILE *fd = NULL;
+	errno_t err;
+	bool ret;
+
+	if (analyse_options & FrameAnalysisOptions::ARCHIVE) {
+		if (G->frame_analysis_archive.add_blob(dedupe_filename, buf, size))
+			return true;
+		FAJobLogErr("Failed to archive %S\n", dedupe_filename);
+		return false;
+	}
+
+	err = wfopen_ensuring_access(&fd, dedupe_filename, L"wb");
+	if (!fd) {
+		FAJobLogErr("Unable to create %S: %u\n", dedupe_filename, err);
+		return false;
+	}
+	ret = fwrite(buf, 1, size, fd) == size;
+	fclose(fd);
+
+	return ret;
+}
+
+bool FrameAnalysisDumpJob::deduped_file_exists(const wchar_t *dedupe_filename)
+{
+	if (analyse_options & FrameAnalysisOptions::ARCHIVE)
+		return G->frame_analysis_archive.contains(dedupe_filename);
+
+	return GetFileAttributes(dedupe_filename) != INVALID_FILE_ATTRIBUTES;
+}
+
+void FrameAnalysisDumpJob::archive_deduplicated_file(const wchar_t *filename, const wchar_t *dedupe_filename)
+{
+	// In archive mode the deduped file is only a staging area for data
+	// that was written out by WIC or our text dumping routines, and is
+	// removed again as soon as it has been added to the pack. Buffers and
+	// DDS files go straight into the pack and won't have a file at all.
+	if (!G->frame_analysis_archive.contains(dedupe_filename)) {
+		// Bail if source didn't get created:
+		if (GetFileAttributes(dedupe_filename) == INVALID_FILE_ATTRIBUTES)
+			return;
+
+		// Another context may have archived the same blob since we
+		// checked, in which case it will have removed the file:
+		if (!G->frame_analysis_archive.add_file(dedupe_filename)
+		 && !G->frame_analysis_archive.contains(dedupe_filename)) {
+			FAJobLogErr("Failed to archive %S\n", dedupe_filename);
+			return;
+		}
+	}
+
+	if (!G->frame_analysis_archive.link(filename, dedupe_filename))
+		FAJobLogErr("Failed to add %S to frame analysis archive\n", filename);
+}
+
+void FrameAnalysisDumpJob::link_deduplicated_files(const wchar_t *filename, const wchar_t *dedupe_filename)
 {
 	wchar_t relative_path[MAX_PATH] = {0};
 
+	if (analyse_options & FrameAnalysisOptions::ARCHIVE)
+		return archive_deduplicated_file(filename, dedupe_filename);
+
 	// Bail if source didn't get created:
 	if (GetFileAttributes(dedupe_filename) == INVALID_FILE_ATTRIBUTES)
 		return;
@@ -2295,7 +2302,7 @@ void FrameAnalysisContext::link_deduplicated_files(const wchar_t *filename, cons
 		}
 
 		// May fail if developer mode is not enabled on Windows 10:
-		FALogErr("Symlinking %S -> %S failed (0x%u), trying hard link\n",
+		FAJobLogErr("Symlinking %S -> %S failed (0x%u), trying hard link\n",
 				filename, relative_path, GetLastError());
 	}
 
@@ -2321,7 +2328,7 @@ void FrameAnalysisContext::link_deduplicated_files(const wchar_t *filename, cons
 	if (MoveFile(dedupe_filename, filename))
 		return;
 
-	FALogErr("All attempts to link deduplicated file failed, giving up: %S -> %S\n",
+	FAJobLogErr("All attempts to link deduplicated file failed, giving up: %S -> %S\n",
 			filename, dedupe_filename);
 }
 
@@ -2,6 +2,7 @@
 
 #include <d3d11_1.h>
 #include "HackerContext.h"
+#include "FrameAnalysisWriter.h"
 
 // {2AEE5B3A-68ED-44E9-AA4D-9EAA6315D72B}
 DEFINE_GUID(IID_FrameAnalysisContext,
@@ -81,6 +82,120 @@ typedef std::unique_ptr<FrameAnalysisDeferredBuffers> FrameAnalysisDeferredBuffe
 typedef vector<FrameAnalysisDeferredDumpTex2DArgs> FrameAnalysisDeferredTex2D;
 typedef std::unique_ptr<FrameAnalysisDeferredTex2D> FrameAnalysisDeferredTex2DPtr;
 
+// The part of a dump that comes after the render thread has copied the data
+// out of the staging resource - hashing it to find the deduplicated filename,
+// formatting it and writing it out. These are handed off to the
+// FrameAnalysisWriter and may run after the context has moved on to later
+// draw calls, so they carry a copy of everything they need.
+class FrameAnalysisDumpJob : public FrameAnalysisWriterJob
+{
+public:
+	FrameAnalysisDumpJob(FrameAnalysisOptions analyse_options,
+			const wchar_t *filename, const wchar_t *dedupe_dir) :
+		analyse_options(analyse_options), filename(filename),
+		dedupe_dir(dedupe_dir)
+	{}
+
+protected:
+	FrameAnalysisOptions analyse_options;
+	wstring filename;
+	wstring dedupe_dir;
+
+	template <typename DescType>
+	void DumpDesc(DescType *desc, const wchar_t *filename);
+	bool write_deduped_file(const wchar_t *dedupe_filename, const void *buf, size_t size);
+	void link_deduplicated_files(const wchar_t *filename, const wchar_t *dedupe_filename);
+	void archive_deduplicated_file(const wchar_t *filename, const wchar_t *dedupe_filename);
+	bool deduped_file_exists(const wchar_t *dedupe_filename);
+	void rotate_when_nearing_hard_link_limit(const wchar_t *dedupe_filename);
+	void rotate_deduped_file(const wchar_t *dedupe_filename);
+};
+
+class FrameAnalysisDumpBufferJob : public FrameAnalysisDumpJob
+{
+public:
+	FrameAnalysisDumpBufferJob(FrameAnalysisOptions analyse_options,
+			const wchar_t *filename, const wchar_t *dedupe_dir,
+			D3D11_BUFFER_DESC *orig_desc, FrameAnalysisOptions buf_type_mask,
+			int idx, DXGI_FORMAT ib_fmt, UINT stride, UINT offset,
+			UINT first, UINT count, ID3DBlob *layout,
+			D3D11_PRIMITIVE_TOPOLOGY topology, DrawCallInfo *call_info) :
+		FrameAnalysisDumpJob(analyse_options, filename, dedupe_dir),
+		orig_desc(*orig_desc), buf_type_mask(buf_type_mask), idx(idx),
+		ib_fmt(ib_fmt), stride(stride), offset(offset), first(first),
+		count(count), layout(layout), topology(topology),
+		call_info(call_info ? *call_info : DrawCallInfo()),
+		has_call_info(!!call_info)
+	{}
+
+	void run() override;
+
+private:
+	D3D11_BUFFER_DESC orig_desc;
+	FrameAnalysisOptions buf_type_mask;
+	int idx;
+	DXGI_FORMAT ib_fmt;
+	UINT stride;
+	UINT offset;
+	UINT first;
+	UINT count;
+	Microsoft::WRL::ComPtr<ID3DBlob> layout;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	DrawCallInfo call_info; // Only the counts - indirect_buffer is not ours to use
+	bool has_call_info;
+
+	void dedupe_buf_filename(D3D11_MAPPED_SUBRESOURCE *map,
+			wchar_t *dedupe_filename, size_t size);
+	void dedupe_buf_filename_txt(const wchar_t *bin_filename,
+			wchar_t *txt_filename, size_t size, char type, int idx,
+			UINT stride, UINT offset);
+	void dedupe_buf_filename_vb_txt(const wchar_t *bin_filename,
+			wchar_t *txt_filename, size_t size, int idx,
+			UINT stride, UINT offset, UINT first, UINT count, ID3DBlob *layout,
+			D3D11_PRIMITIVE_TOPOLOGY topology, DrawCallInfo *call_info);
+	void dedupe_buf_filename_ib_txt(const wchar_t *bin_filename,
+			wchar_t *txt_filename, size_t size, DXGI_FORMAT ib_fmt,
+			UINT offset, UINT first, UINT count, D3D11_PRIMITIVE_TOPOLOGY topology);
+	void DumpBufferTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
+			UINT size, char type, int idx, UINT stride, UINT offset);
+	void DumpVBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
+			UINT size, int idx, UINT stride, UINT offset,
+			UINT first, UINT count, ID3DBlob *layout,
+			D3D11_PRIMITIVE_TOPOLOGY topology, DrawCallInfo *call_info);
+	void DumpIBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
+			UINT size, DXGI_FORMAT ib_fmt, UINT offset,
+			UINT first, UINT count, D3D11_PRIMITIVE_TOPOLOGY topology);
+};
+
+// The data of a Texture2D job is the top level of the staging resource with
+// the padding at the end of each row removed, so rows are row_bytes apart.
+class FrameAnalysisDumpTex2DJob : public FrameAnalysisDumpJob
+{
+public:
+	FrameAnalysisDumpTex2DJob(FrameAnalysisOptions analyse_options,
+			const wchar_t *filename, const wchar_t *dedupe_dir, bool stereo,
+			D3D11_TEXTURE2D_DESC *orig_desc, D3D11_TEXTURE2D_DESC *staging_desc,
+			DXGI_FORMAT format, size_t row_bytes, size_t row_count) :
+		FrameAnalysisDumpJob(analyse_options, filename, dedupe_dir),
+		stereo(stereo), orig_desc(*orig_desc), staging_desc(*staging_desc),
+		format(format), row_bytes(row_bytes), row_count(row_count)
+	{}
+
+	void run() override;
+
+private:
+	bool stereo;
+	D3D11_TEXTURE2D_DESC orig_desc;
+	D3D11_TEXTURE2D_DESC staging_desc;
+	DXGI_FORMAT format;
+	size_t row_bytes;
+	size_t row_count;
+
+	void dedupe_tex2d_filename(wchar_t *dedupe_filename, size_t size);
+	HRESULT save_dds(const wchar_t *path);
+	HRESULT save_jpeg(const wchar_t *path);
+};
+
 // We make the frame analysis context directly implement ID3D11DeviceContext1 -
 // no funky implementation inheritance or alternate versions here, just a
 // straight forward object implementing an interface. Accessing it as
@@ -123,15 +238,6 @@ private:
 		D3D11_TEXTURE2D_DESC desc, bool stereo, bool msaa, DXGI_FORMAT format);
 
 	void DumpStereoResource(ID3D11Texture2D *resource, wchar_t *filename, DXGI_FORMAT format);
-	void DumpBufferTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
-			UINT size, char type, int idx, UINT stride, UINT offset);
-	void DumpVBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
-			UINT size, int idx, UINT stride, UINT offset,
-			UINT first, UINT count, ID3DBlob *layout,
-			D3D11_PRIMITIVE_TOPOLOGY topology, DrawCallInfo *call_info);
-	void DumpIBTxt(wchar_t *filename, D3D11_MAPPED_SUBRESOURCE *map,
-			UINT size, DXGI_FORMAT ib_fmt, UINT offset,
-			UINT first, UINT count, D3D11_PRIMITIVE_TOPOLOGY topology);
 
 	void DumpBuffer(ID3D11Buffer *buffer, wchar_t *filename,
 			FrameAnalysisOptions buf_type_mask, int idx, DXGI_FORMAT ib_fmt,
@@ -166,8 +272,6 @@ private:
 	void DumpRenderTargets();
 	void DumpDepthStencilTargets();
 	void DumpUAVs(bool compute);
-	template <typename DescType>
-	void DumpDesc(DescType *desc, const wchar_t *filename);
 
 	void dump_deferred_resources(ID3D11CommandList *command_list);
 	void finish_deferred_resources(ID3D11CommandList *command_list);
@@ -176,26 +280,6 @@ private:
 			wchar_t *reg, char shader_type, int idx, ID3D11Resource *handle);
 	HRESULT FrameAnalysisFilenameResource(wchar_t *filename, size_t size, const wchar_t *type,
 			ID3D11Resource *handle, bool force_filename_handle);
-	const wchar_t* dedupe_tex2d_filename(ID3D11Texture2D *resource,
-			D3D11_TEXTURE2D_DESC *desc, wchar_t *dedupe_filename,
-			size_t size, const wchar_t *traditional_filename, DXGI_FORMAT format);
-	void dedupe_buf_filename(ID3D11Buffer *resource,
-			D3D11_BUFFER_DESC *orig_desc,
-			D3D11_MAPPED_SUBRESOURCE *map,
-			wchar_t *dedupe_filename, size_t size);
-	void dedupe_buf_filename_txt(const wchar_t *bin_filename,
-			wchar_t *txt_filename, size_t size, char type, int idx,
-			UINT stride, UINT offset);
-	void dedupe_buf_filename_vb_txt(const wchar_t *bin_filename,
-			wchar_t *txt_filename, size_t size, int idx,
-			UINT stride, UINT offset, UINT first, UINT count, ID3DBlob *layout,
-			D3D11_PRIMITIVE_TOPOLOGY topology, DrawCallInfo *call_info);
-	void dedupe_buf_filename_ib_txt(const wchar_t *bin_filename,
-			wchar_t *txt_filename, size_t size, DXGI_FORMAT ib_fmt,
-			UINT offset, UINT first, UINT count, D3D11_PRIMITIVE_TOPOLOGY topology);
-	void link_deduplicated_files(const wchar_t *filename, const wchar_t *dedupe_filename);
-	void rotate_when_nearing_hard_link_limit(const wchar_t *dedupe_filename);
-	void rotate_deduped_file(const wchar_t *dedupe_filename);
 	void get_deduped_dir(wchar_t *path, size_t size);
 
 	void determine_vb_count(UINT *count, ID3D11Buffer *staged_ib_for_vb,
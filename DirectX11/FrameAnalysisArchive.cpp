@@ -0,0 +1,290 @@
+#include "FrameAnalysisArchive.h"
+
+#include "globals.h"
+#include "log.h"
+#include "lock.h"
+
+// Index records are batched up to this size before being written out:
+#define FA_ARCHIVE_RECORD_FLUSH_SIZE (64 * 1024)
+
+FrameAnalysisArchive::FrameAnalysisArchive() :
+	pack_file(INVALID_HANDLE_VALUE),
+	index_file(INVALID_HANDLE_VALUE),
+	pack_size(0)
+{
+	dir[0] = 0;
+}
+
+FrameAnalysisArchive::~FrameAnalysisArchive()
+{
+	close_locked();
+}
+
+void FrameAnalysisArchive::init()
+{
+	InitializeCriticalSectionPretty(&lock);
+}
+
+static bool write_all(HANDLE file, const void *data, DWORD size)
+{
+	DWORD written;
+
+	return WriteFile(file, data, size, &written, NULL) && written == size;
+}
+
+static HANDLE open_archive_file(const wchar_t *dir, const wchar_t *name, const char *magic, UINT64 *size)
+{
+	FrameAnalysisArchiveHeader header = {};
+	wchar_t path[MAX_PATH];
+	LARGE_INTEGER pos, zero = {};
+	HANDLE file;
+
+	swprintf_s(path, MAX_PATH, L"%ls\\%ls", dir, name);
+
+	// Opened for append so that if a deferred context dumps something
+	// after the archive was closed we carry on from where we left off:
+	file = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		LogInfo("Frame analysis archive: Unable to open %S: %u\n", path, GetLastError());
+		return INVALID_HANDLE_VALUE;
+	}
+
+	if (!SetFilePointerEx(file, zero, &pos, FILE_END))
+		goto err;
+
+	if (!pos.QuadPart) {
+		memcpy(header.magic, magic, sizeof(header.magic));
+		header.version = FA_ARCHIVE_VERSION;
+		if (!write_all(file, &header, sizeof(header)))
+			goto err;
+		pos.QuadPart = sizeof(header);
+	}
+
+	*size = pos.QuadPart;
+	return file;
+err:
+	LogInfo("Frame analysis archive: Error initialising %S: %u\n", path, GetLastError());
+	CloseHandle(file);
+	return INVALID_HANDLE_VALUE;
+}
+
+bool FrameAnalysisArchive::open_locked()
+{
+	UINT64 index_size;
+
+	// Each frame analysis directory gets its own archive:
+	if (_wcsicmp(dir, G->ANALYSIS_PATH)) {
+		close_locked();
+		blobs.clear();
+		wcscpy_s(dir, MAX_PATH, G->ANALYSIS_PATH);
+	}
+
+	if (pack_file != INVALID_HANDLE_VALUE)
+		return true;
+
+	pack_file = open_archive_file(dir, FA_ARCHIVE_PACK_NAME, FA_ARCHIVE_PACK_MAGIC, &pack_size);
+	if (pack_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	index_file = open_archive_file(dir, FA_ARCHIVE_INDEX_NAME, FA_ARCHIVE_INDEX_MAGIC, &index_size);
+	if (index_file == INVALID_HANDLE_VALUE) {
+		CloseHandle(pack_file);
+		pack_file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	LogInfo("Frame analysis archive: Writing to %S\\%S\n", dir, FA_ARCHIVE_PACK_NAME);
+	return true;
+}
+
+bool FrameAnalysisArchive::flush_records_locked()
+{
+	bool ret = true;
+
+	if (pending_records.empty())
+		return true;
+
+	if (!write_all(index_file, pending_records.data(), (DWORD)pending_records.size())) {
+		LogInfo("Frame analysis archive: Error writing index: %u\n", GetLastError());
+		ret = false;
+	}
+
+	pending_records.clear();
+	return ret;
+}
+
+void FrameAnalysisArchive::close_locked()
+{
+	if (index_file != INVALID_HANDLE_VALUE) {
+		flush_records_locked();
+		CloseHandle(index_file);
+	}
+	if (pack_file != INVALID_HANDLE_VALUE)
+		CloseHandle(pack_file);
+	index_file = INVALID_HANDLE_VALUE;
+	pack_file = INVALID_HANDLE_VALUE;
+	pending_records.clear();
+}
+
+void FrameAnalysisArchive::close()
+{
+	EnterCriticalSectionPretty(&lock);
+	close_locked();
+	LeaveCriticalSection(&lock);
+}
+
+const wchar_t* FrameAnalysisArchive::relative_path(const wchar_t *path)
+{
+	size_t len = wcslen(dir);
+
+	if (_wcsnicmp(path, dir, len) || path[len] != L'\\')
+		return NULL;
+
+	return path + len + 1;
+}
+
+void FrameAnalysisArchive::add_record_locked(FrameAnalysisArchiveRecordType type, Blob *blob, const wchar_t *name)
+{
+	FrameAnalysisArchiveRecord record;
+	size_t pos = pending_records.size();
+	size_t name_bytes;
+
+	record.offset = blob->offset;
+	record.size = blob->size;
+	record.type = (uint16_t)type;
+	record.name_len = (uint16_t)wcsnlen(name, MAX_PATH);
+	name_bytes = record.name_len * sizeof(wchar_t);
+
+	pending_records.resize(pos + sizeof(record) + name_bytes);
+	memcpy(&pending_records[pos], &record, sizeof(record));
+	memcpy(&pending_records[pos + sizeof(record)], name, name_bytes);
+
+	if (pending_records.size() >= FA_ARCHIVE_RECORD_FLUSH_SIZE)
+		flush_records_locked();
+}
+
+bool FrameAnalysisArchive::contains(const wchar_t *blob_path)
+{
+	const wchar_t *name;
+	bool ret = false;
+
+	EnterCriticalSectionPretty(&lock);
+
+	if (!open_locked())
+		goto out;
+
+	name = relative_path(blob_path);
+	if (name)
+		ret = !!blobs.count(name);
+out:
+	LeaveCriticalSection(&lock);
+	return ret;
+}
+
+bool FrameAnalysisArchive::add_blob(const wchar_t *blob_path, const void *data, size_t size)
+{
+	LARGE_INTEGER pos, zero = {};
+	const wchar_t *name;
+	Blob blob;
+	bool ret = false;
+
+	if (size > UINT32_MAX) {
+		LogInfo("Frame analysis archive: %S is too large to archive\n", blob_path);
+		return false;
+	}
+
+	EnterCriticalSectionPretty(&lock);
+
+	if (!open_locked())
+		goto out;
+
+	name = relative_path(blob_path);
+	if (!name) {
+		LogInfo("Frame analysis archive: %S is outside of %S\n", blob_path, dir);
+		goto out;
+	}
+
+	// Content addressed - the deduped filename is derived from a hash of
+	// the contents, so if we already have it there is nothing to do:
+	if (blobs.count(name)) {
+		ret = true;
+		goto out;
+	}
+
+	if (!write_all(pack_file, data, (DWORD)size)) {
+		LogInfo("Frame analysis archive: Error writing %S: %u\n", name, GetLastError());
+		// Resync in case of a partial write so later offsets are right:
+		if (SetFilePointerEx(pack_file, zero, &pos, FILE_END))
+			pack_size = pos.QuadPart;
+		goto out;
+	}
+
+	blob.offset = pack_size;
+	blob.size = (uint32_t)size;
+	pack_size += size;
+
+	blobs[name] = blob;
+	add_record_locked(FrameAnalysisArchiveRecordType::BLOB, &blob, name);
+	ret = true;
+out:
+	LeaveCriticalSection(&lock);
+	return ret;
+}
+
+// For blobs that were dumped to a file by something we don't control, such as
+// a WIC encoder. The file is removed once it is archived.
+bool FrameAnalysisArchive::add_file(const wchar_t *blob_path)
+{
+	std::vector<char> data;
+	LARGE_INTEGER size;
+	DWORD read;
+	HANDLE f;
+	bool ret = false;
+
+	f = CreateFile(blob_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (!GetFileSizeEx(f, &size) || size.QuadPart > UINT32_MAX)
+		goto out_close;
+
+	data.resize((size_t)size.QuadPart);
+	if (!data.empty()) {
+		if (!ReadFile(f, data.data(), (DWORD)data.size(), &read, NULL) || read != data.size())
+			goto out_close;
+	}
+
+	ret = add_blob(blob_path, data.data(), data.size());
+out_close:
+	CloseHandle(f);
+	if (ret)
+		DeleteFile(blob_path);
+	return ret;
+}
+
+bool FrameAnalysisArchive::link(const wchar_t *path, const wchar_t *blob_path)
+{
+	std::unordered_map<std::wstring, Blob>::iterator i;
+	const wchar_t *name, *blob_name;
+	bool ret = false;
+
+	EnterCriticalSectionPretty(&lock);
+
+	if (!open_locked())
+		goto out;
+
+	name = relative_path(path);
+	blob_name = relative_path(blob_path);
+	if (!name || !blob_name)
+		goto out;
+
+	i = blobs.find(blob_name);
+	if (i == blobs.end())
+		goto out;
+
+	add_record_locked(FrameAnalysisArchiveRecordType::LINK, &i->second, name);
+	ret = true;
+out:
+	LeaveCriticalSection(&lock);
+	return ret;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// On disk format of the frame analysis archive, used with analyse_options =
+// archive. Rather than writing each unique resource out to the deduped
+// directory and hard linking it to every name it was dumped under, the unique
+// blobs are appended to a single pack file and an index records which names
+// refer to which blob. A full frame analysis of a modern game can otherwise
+// produce tens of thousands of files and spend most of its time creating
+// links. cmd_FrameAnalysisArchive can list the contents of an archive, or
+// extract it back out to the traditional directory layout.
+//
+// Both files are append only. Blobs are written to the pack as soon as they
+// are dumped while index records are buffered and flushed periodically, so
+// an archive from a game that crashed mid-dump is readable up to the last
+// flush.
+
+#define FA_ARCHIVE_PACK_NAME L"FrameAnalysis.pack"
+#define FA_ARCHIVE_INDEX_NAME L"FrameAnalysis.idx"
+#define FA_ARCHIVE_PACK_MAGIC "3DMFAPAK"
+#define FA_ARCHIVE_INDEX_MAGIC "3DMFAIDX"
+#define FA_ARCHIVE_VERSION 1
+
+struct FrameAnalysisArchiveHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+enum class FrameAnalysisArchiveRecordType : uint16_t {
+	BLOB = 1, // A unique blob in the pack, named after its deduped file
+	LINK = 2, // A traditional frame analysis filename referring to a blob
+};
+
+// Each index record is followed by name_len UTF-16 characters (not NUL
+// terminated) of a filename relative to the frame analysis directory:
+struct FrameAnalysisArchiveRecord
+{
+	UINT64 offset;
+	uint32_t size;
+	uint16_t type;
+	uint16_t name_len;
+};
+
+// Writer side, owned by Globals. Safe to call from multiple contexts at once.
+// The archive is opened in G->ANALYSIS_PATH on first use, and paths passed in
+// are full paths that must be inside that directory.
+class FrameAnalysisArchive
+{
+public:
+	FrameAnalysisArchive();
+	~FrameAnalysisArchive();
+
+	void init();
+	void close();
+
+	bool contains(const wchar_t *blob_path);
+	bool add_blob(const wchar_t *blob_path, const void *data, size_t size);
+	bool add_file(const wchar_t *blob_path);
+	bool link(const wchar_t *path, const wchar_t *blob_path);
+
+private:
+	struct Blob {
+		UINT64 offset;
+		uint32_t size;
+	};
+
+	CRITICAL_SECTION lock;
+	wchar_t dir[MAX_PATH];
+	HANDLE pack_file;
+	HANDLE index_file;
+	UINT64 pack_size;
+	std::unordered_map<std::wstring, Blob> blobs;
+	std::vector<char> pending_records;
+
+	bool open_locked();
+	void close_locked();
+	bool flush_records_locked();
+	void add_record_locked(FrameAnalysisArchiveRecordType type, Blob *blob, const wchar_t *name);
+	const wchar_t* relative_path(const wchar_t *path);
+};
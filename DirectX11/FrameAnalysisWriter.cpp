@@ -0,0 +1,263 @@
+#include "FrameAnalysisWriter.h"
+
+#include "globals.h"
+#include "log.h"
+#include "lock.h"
+#include "Overlay.h"
+
+// Most dumps in a frame are similar in size, so a handful of idle buffers is
+// enough to avoid going back to the heap for each one:
+#define FA_WRITER_MAX_FREE_BUFFERS 32
+
+FrameAnalysisWriter::FrameAnalysisWriter() :
+	pool(NULL),
+	pool_threads(0),
+	free_bytes(0),
+	outstanding_bytes(0),
+	outstanding_jobs(0),
+	total_jobs(0),
+	total_bytes(0),
+	peak_bytes(0)
+{
+	start_time.QuadPart = 0;
+	stall_time.QuadPart = 0;
+}
+
+FrameAnalysisWriter::~FrameAnalysisWriter()
+{
+	// The thread pool is deliberately leaked - by the time we are being
+	// destroyed the process is exiting and its threads may already be
+	// gone. Every job will have been finished when frame analysis stopped.
+	for (std::vector<char> *buf : free_buffers)
+		delete buf;
+}
+
+void FrameAnalysisWriter::init()
+{
+	InitializeCriticalSectionPretty(&lock);
+	InitializeConditionVariable(&cond);
+}
+
+static size_t memory_budget()
+{
+	return (size_t)max(G->analyse_writer_memory, 0) * 1024 * 1024;
+}
+
+static void CALLBACK writer_callback(PTP_CALLBACK_INSTANCE instance, void *context)
+{
+	G->frame_analysis_writer.run_job((FrameAnalysisWriterJob*)context);
+}
+
+bool FrameAnalysisWriter::start_pool_locked()
+{
+	int threads = G->analyse_writer_threads;
+
+	if (threads <= 0 || pool_threads < 0)
+		return false;
+
+	if (!pool) {
+		pool = CreateThreadpool(NULL);
+		if (!pool) {
+			LogInfo("Frame analysis writer: Unable to create thread pool, writing from the render thread: %u\n", GetLastError());
+			pool_threads = -1;
+			return false;
+		}
+		InitializeThreadpoolEnvironment(&env);
+		SetThreadpoolCallbackPool(&env, pool);
+		// Keeps us loaded until any callbacks still running are done:
+		SetThreadpoolCallbackLibrary(&env, migoto_handle);
+	}
+
+	// May have been changed by a config reload:
+	if (threads != pool_threads) {
+		SetThreadpoolThreadMaximum(pool, threads);
+		pool_threads = threads;
+	}
+
+	return true;
+}
+
+std::vector<char>* FrameAnalysisWriter::alloc_buffer(size_t size)
+{
+	size_t budget = memory_budget();
+	std::vector<char> *buf = NULL;
+	LARGE_INTEGER before, after;
+	size_t i, best;
+
+	EnterCriticalSectionPretty(&lock);
+
+	if (!start_time.QuadPart)
+		QueryPerformanceCounter(&start_time);
+
+	// Backpressure - wait for the writers to catch up rather than
+	// queueing up more than the budget allows:
+	if (outstanding_bytes && outstanding_bytes + size > budget) {
+		QueryPerformanceCounter(&before);
+		while (outstanding_bytes && outstanding_bytes + size > budget)
+			SleepConditionVariableCS(&cond, &lock, INFINITE);
+		QueryPerformanceCounter(&after);
+		stall_time.QuadPart += after.QuadPart - before.QuadPart;
+	}
+
+	// Smallest idle buffer that will fit:
+	best = free_buffers.size();
+	for (i = 0; i < free_buffers.size(); i++) {
+		if (free_buffers[i]->capacity() < size)
+			continue;
+		if (best == free_buffers.size() || free_buffers[i]->capacity() < free_buffers[best]->capacity())
+			best = i;
+	}
+	if (best < free_buffers.size()) {
+		buf = free_buffers[best];
+		free_buffers[best] = free_buffers.back();
+		free_buffers.pop_back();
+		free_bytes -= buf->capacity();
+	}
+
+	outstanding_bytes += size;
+	peak_bytes = max(peak_bytes, outstanding_bytes);
+
+	LeaveCriticalSection(&lock);
+
+	// Outside of the lock, since this may go to the heap:
+	if (!buf)
+		buf = new std::vector<char>();
+	buf->resize(size);
+
+	return buf;
+}
+
+void FrameAnalysisWriter::release_buffer_locked(std::vector<char> *buf)
+{
+	outstanding_bytes -= buf->size();
+
+	// Idle buffers count against the budget as well, so that memory use
+	// stays within it whether the writers are busy or not:
+	if (free_buffers.size() < FA_WRITER_MAX_FREE_BUFFERS &&
+	    outstanding_bytes + free_bytes + buf->capacity() <= memory_budget()) {
+		free_buffers.push_back(buf);
+		free_bytes += buf->capacity();
+		return;
+	}
+
+	delete buf;
+}
+
+// For a buffer that never made it into a job, e.g. if mapping the staging
+// resource failed:
+void FrameAnalysisWriter::release_buffer(std::vector<char> *buf)
+{
+	EnterCriticalSectionPretty(&lock);
+	release_buffer_locked(buf);
+	LeaveCriticalSection(&lock);
+
+	WakeAllConditionVariable(&cond);
+}
+
+void FrameAnalysisWriter::trim_buffers_locked(size_t keep_bytes)
+{
+	std::vector<char> *buf;
+
+	while (!free_buffers.empty() && free_bytes > keep_bytes) {
+		buf = free_buffers.back();
+		free_buffers.pop_back();
+		free_bytes -= buf->capacity();
+		delete buf;
+	}
+}
+
+void FrameAnalysisWriter::submit(FrameAnalysisWriterJob *job)
+{
+	bool queued = false;
+
+	EnterCriticalSectionPretty(&lock);
+
+	outstanding_jobs++;
+	total_jobs++;
+	if (job->data)
+		total_bytes += job->data->size();
+
+	if (start_pool_locked())
+		queued = !!TrySubmitThreadpoolCallback(writer_callback, job, &env);
+
+	LeaveCriticalSection(&lock);
+
+	if (!queued)
+		run_job(job);
+}
+
+void FrameAnalysisWriter::run_job(FrameAnalysisWriterJob *job)
+{
+	job->run();
+
+	EnterCriticalSectionPretty(&lock);
+	if (job->data)
+		release_buffer_locked(job->data);
+	outstanding_jobs--;
+	LeaveCriticalSection(&lock);
+
+	WakeAllConditionVariable(&cond);
+
+	delete job;
+}
+
+void FrameAnalysisWriter::claim_name(const std::wstring &name)
+{
+	EnterCriticalSectionPretty(&lock);
+	while (busy_names.count(name))
+		SleepConditionVariableCS(&cond, &lock, INFINITE);
+	busy_names.insert(name);
+	LeaveCriticalSection(&lock);
+}
+
+void FrameAnalysisWriter::release_name(const std::wstring &name)
+{
+	EnterCriticalSectionPretty(&lock);
+	busy_names.erase(name);
+	LeaveCriticalSection(&lock);
+
+	WakeAllConditionVariable(&cond);
+}
+
+void FrameAnalysisWriter::finish()
+{
+	LARGE_INTEGER now, freq;
+	double elapsed, stalled, mb, peak_mb;
+	UINT64 jobs;
+	int threads;
+
+	EnterCriticalSectionPretty(&lock);
+
+	while (outstanding_jobs)
+		SleepConditionVariableCS(&cond, &lock, INFINITE);
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	jobs = total_jobs;
+	elapsed = start_time.QuadPart ? (double)(now.QuadPart - start_time.QuadPart) / freq.QuadPart : 0;
+	stalled = (double)stall_time.QuadPart / freq.QuadPart;
+	mb = total_bytes / (1024.0 * 1024.0);
+	peak_mb = peak_bytes / (1024.0 * 1024.0);
+	threads = max(pool_threads, 0);
+
+	// Ready for the next capture. The idle buffers would otherwise sit
+	// around until then, which could be never:
+	start_time.QuadPart = 0;
+	stall_time.QuadPart = 0;
+	total_jobs = 0;
+	total_bytes = 0;
+	peak_bytes = 0;
+	trim_buffers_locked(0);
+
+	LeaveCriticalSection(&lock);
+
+	if (!jobs)
+		return;
+
+	LogInfo("Frame analysis writer: %llu dumps, %.1f MB in %.2f s (%.1f MB/s) with %i writer threads\n",
+			jobs, mb, elapsed, elapsed ? mb / elapsed : 0, threads);
+	LogInfo("Frame analysis writer: Render thread stalled %.2f s on backpressure, peak %.1f MB of %i MB queued\n",
+			stalled, peak_mb, G->analyse_writer_memory);
+	LogOverlay(LOG_INFO, "Frame analysis wrote %.1f MB at %.1f MB/s, stalled %.2f s\n",
+			mb, elapsed ? mb / elapsed : 0, stalled);
+}
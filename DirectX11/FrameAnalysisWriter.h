@@ -0,0 +1,91 @@
+#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+// Frame analysis used to hash, format and write out every resource from the
+// thread that was rendering, so a full dump of a modern game would sit there
+// for minutes with the game stalled waiting on the disk. The render thread
+// now only copies the data out of the staging resource into a buffer from
+// this pool, and hands everything else off as a job to a private thread pool
+// of writers (analyse_writer_threads in the d3dx.ini).
+//
+// Buffers count against a memory budget (analyse_writer_memory). Once it has
+// been used up the render thread blocks until the writers have caught up -
+// there is no point queueing up more than the disk can keep up with, and we
+// can't just drop dumps on the floor. A single buffer larger than the entire
+// budget is still let through once everything else has drained.
+//
+// With analyse_writer_threads = 0 jobs run on the submitting thread as they
+// are submitted, which is the old behaviour.
+
+class FrameAnalysisWriterJob
+{
+public:
+	FrameAnalysisWriterJob() :
+		data(NULL)
+	{}
+	virtual ~FrameAnalysisWriterJob() {}
+
+	// Called on a writer thread after the context that submitted the job
+	// has moved on, so must not touch any DirectX objects or the context.
+	virtual void run() = 0;
+
+	// From FrameAnalysisWriter::alloc_buffer(), returned to the pool once
+	// the job has run:
+	std::vector<char> *data;
+};
+
+class FrameAnalysisWriter
+{
+public:
+	FrameAnalysisWriter();
+	~FrameAnalysisWriter();
+
+	void init();
+
+	std::vector<char>* alloc_buffer(size_t size);
+	void release_buffer(std::vector<char> *buf);
+	void submit(FrameAnalysisWriterJob *job);
+
+	// Blocks until every job submitted so far has been written out, then
+	// logs how the writers kept up. Called when frame analysis stops.
+	void finish();
+
+	// Jobs writing the same deduped file must not do so at the same time,
+	// which is only known once they have hashed their data, so they claim
+	// the name for as long as they are writing it:
+	void claim_name(const std::wstring &name);
+	void release_name(const std::wstring &name);
+
+	// Runs and retires a job, from the thread pool callback:
+	void run_job(FrameAnalysisWriterJob *job);
+
+private:
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE cond; // Buffer freed, job done, or name released
+
+	PTP_POOL pool;
+	TP_CALLBACK_ENVIRON env;
+	int pool_threads;
+
+	std::vector<std::vector<char>*> free_buffers;
+	size_t free_bytes;
+	size_t outstanding_bytes;
+	unsigned outstanding_jobs;
+	std::unordered_set<std::wstring> busy_names;
+
+	// Throughput report for the current capture:
+	LARGE_INTEGER start_time;
+	LARGE_INTEGER stall_time;
+	UINT64 total_jobs;
+	UINT64 total_bytes;
+	size_t peak_bytes;
+
+	bool start_pool_locked();
+	void release_buffer_locked(std::vector<char> *buf);
+	void trim_buffers_locked(size_t keep_bytes);
+};
@@ -84,9 +84,11 @@ HackerContext::HackerContext(ID3D11Device1 *pDevice1, ID3D11DeviceContext1 *pCon
 	mCurrentDomainShaderHandle = NULL;
 	mCurrentHullShader = 0;
 	mCurrentHullShaderHandle = NULL;
+	UpdateCurrentShaderOverrides();
 	mCurrentDepthTarget = NULL;
 	mCurrentPSUAVStartSlot = 0;
 	mCurrentPSNumUAVs = 0;
+	mShaderUsage = NULL;
 }
 
 
@@ -136,169 +138,112 @@ void HackerContext::HookContext()
 // -----------------------------------------------------------------------------
 
 
-// Records the hash of this shader resource view for later lookup. Returns the
-// handle to the resource, but be aware that it no longer has a reference and
-// should only be used for map lookups.
-ID3D11Resource* HackerContext::RecordResourceViewStats(ID3D11View *view, std::set<uint32_t> *resource_info)
+// The ring is created the first time this context records anything while
+// hunting, so contexts that are never used for hunting don't register one:
+ShaderUsageRing* HackerContext::GetShaderUsageRing()
 {
-	ID3D11Resource *resource = NULL;
-	uint32_t orig_hash = 0;
-
-	if (!view)
-		return NULL;
-
-	view->GetResource(&resource);
-	if (!resource)
-		return NULL;
-
-	EnterCriticalSectionPretty(&G->mCriticalSection);
-
-		// We are using the original resource hash for stat collection - things
-		// get tricky otherwise
-		orig_hash = GetOrigResourceHash(resource);
-
-		resource->Release();
-
-		if (orig_hash)
-			resource_info->insert(orig_hash);
-
-	LeaveCriticalSection(&G->mCriticalSection);
-
-	return resource;
-}
+	if (!mShaderUsage)
+		mShaderUsage = NewShaderUsageRing();
 
-static ResourceSnapshot SnapshotResource(ID3D11Resource *handle)
-{
-	uint32_t hash = 0, orig_hash = 0;
-
-	ResourceHandleInfo *info = GetResourceHandleInfo(handle);
-	if (info) {
-		hash = info->hash;
-		orig_hash = info->orig_hash;
-	}
-
-	return ResourceSnapshot(handle, hash, orig_hash);
+	return mShaderUsage;
 }
 
-void HackerContext::_RecordShaderResourceUsage(ShaderInfoData *shader_info, ID3D11ShaderResourceView *views[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT])
+// Records the resource of each bound view and releases the views, which the
+// caller got from one of the Get*ShaderResources / Get*UnorderedAccessViews
+// calls. The records only keep the resource handle for map lookups and
+// ShaderUsage.txt, so they don't hold a reference to it.
+void HackerContext::RecordViewUsage(ShaderUsageRecordType type, ShaderUsageStage stage,
+		UINT start_slot, UINT num_views, ID3D11View **views)
 {
+	ShaderUsageRing *ring = GetShaderUsageRing();
 	ID3D11Resource *resource;
-	int i;
-
-	for (i = 0; i < D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT; i++) {
-		if (views[i]) {
-			resource = RecordResourceViewStats(views[i], &G->mShaderResourceInfo);
-			if (resource)
-				shader_info->ResourceRegisters[i].insert(SnapshotResource(resource));
-			views[i]->Release();
-		}
-	}
-}
-
-void HackerContext::RecordPeerShaders(std::set<UINT64> *PeerShaders, UINT64 this_shader_hash)
-{
-	if (mCurrentVertexShader && mCurrentVertexShader != this_shader_hash)
-		PeerShaders->insert(mCurrentVertexShader);
-
-	if (mCurrentHullShader && mCurrentHullShader != this_shader_hash)
-		PeerShaders->insert(mCurrentHullShader);
+	UINT i;
 
-	if (mCurrentDomainShader && mCurrentDomainShader != this_shader_hash)
-		PeerShaders->insert(mCurrentDomainShader);
+	for (i = 0; i < num_views; i++) {
+		if (!views[i])
+			continue;
 
-	if (mCurrentGeometryShader && mCurrentGeometryShader != this_shader_hash)
-		PeerShaders->insert(mCurrentGeometryShader);
+		resource = NULL;
+		views[i]->GetResource(&resource);
+		if (resource) {
+			ring->record_resource(type, stage, start_slot + i, resource);
+			resource->Release();
+		}
 
-	if (mCurrentPixelShader && mCurrentPixelShader != this_shader_hash)
-		PeerShaders->insert(mCurrentPixelShader);
+		views[i]->Release();
+	}
 }
 
-
 template <void (__stdcall ID3D11DeviceContext::*GetShaderResources)(THIS_
 		UINT StartSlot,
 		UINT NumViews,
 		ID3D11ShaderResourceView **ppShaderResourceViews)>
-void HackerContext::RecordShaderResourceUsage(std::map<UINT64, ShaderInfoData> &ShaderInfo, UINT64 currentShader)
+void HackerContext::RecordShaderResourceUsage(ShaderUsageStage stage)
 {
 	ID3D11ShaderResourceView *views[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
-	ShaderInfoData *info;
 
 	(mOrigContext1->*GetShaderResources)(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, views);
 
-	EnterCriticalSectionPretty(&G->mCriticalSection);
-
-		info = &ShaderInfo[currentShader];
-		_RecordShaderResourceUsage(info, views);
-		RecordPeerShaders(&info->PeerShaders, currentShader);
-
-	LeaveCriticalSection(&G->mCriticalSection);
+	RecordViewUsage(ShaderUsageRecordType::REGISTER, stage,
+			0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, (ID3D11View**)views);
 }
 
+// None of the stat collection takes G->mCriticalSection any more - it is
+// recorded in this context's ring and consolidated into the maps in Globals
+// by FlushShaderUsage(). See ShaderUsage.h for details.
 void HackerContext::RecordGraphicsShaderStats()
 {
 	ID3D11UnorderedAccessView *uavs[D3D11_1_UAV_SLOT_COUNT]; // DX11: 8, DX11.1: 64
+	UINT64 shaders[(int)ShaderUsageStage::COUNT] = {
+		mCurrentVertexShader,
+		mCurrentHullShader,
+		mCurrentDomainShader,
+		mCurrentGeometryShader,
+		mCurrentPixelShader,
+		0,
+	};
+	ShaderUsageRing *ring = GetShaderUsageRing();
 	UINT selectedRenderTargetPos;
-	ShaderInfoData *info;
-	ID3D11Resource *resource;
-	UINT i;
 	Profiling::State profiling_state;
 
 	if (Profiling::mode == Profiling::Mode::SUMMARY)
 		Profiling::start(&profiling_state);
 
-	if (mCurrentVertexShader) {
-		RecordShaderResourceUsage<&ID3D11DeviceContext::VSGetShaderResources>
-			(G->mVertexShaderInfo, mCurrentVertexShader);
-	}
+	// Records the peer shaders, and which shaders the resources recorded
+	// below belong to:
+	ring->record_shaders(shaders);
 
-	if (mCurrentHullShader) {
-		RecordShaderResourceUsage<&ID3D11DeviceContext::HSGetShaderResources>
-			(G->mHullShaderInfo, mCurrentHullShader);
-	}
+	if (mCurrentVertexShader)
+		RecordShaderResourceUsage<&ID3D11DeviceContext::VSGetShaderResources>(ShaderUsageStage::VS);
 
-	if (mCurrentDomainShader) {
-		RecordShaderResourceUsage<&ID3D11DeviceContext::DSGetShaderResources>
-			(G->mDomainShaderInfo, mCurrentDomainShader);
-	}
+	if (mCurrentHullShader)
+		RecordShaderResourceUsage<&ID3D11DeviceContext::HSGetShaderResources>(ShaderUsageStage::HS);
 
-	if (mCurrentGeometryShader) {
-		RecordShaderResourceUsage<&ID3D11DeviceContext::GSGetShaderResources>
-			(G->mGeometryShaderInfo, mCurrentGeometryShader);
-	}
+	if (mCurrentDomainShader)
+		RecordShaderResourceUsage<&ID3D11DeviceContext::DSGetShaderResources>(ShaderUsageStage::DS);
+
+	if (mCurrentGeometryShader)
+		RecordShaderResourceUsage<&ID3D11DeviceContext::GSGetShaderResources>(ShaderUsageStage::GS);
 
 	if (mCurrentPixelShader) {
 		// This API is poorly designed, because we have to know the
 		// current UAV start slot.
 		OMGetRenderTargetsAndUnorderedAccessViews(0, NULL, NULL, mCurrentPSUAVStartSlot, mCurrentPSNumUAVs, uavs);
 
-		RecordShaderResourceUsage<&ID3D11DeviceContext::PSGetShaderResources>
-			(G->mPixelShaderInfo, mCurrentPixelShader);
-
-		EnterCriticalSectionPretty(&G->mCriticalSection);
-			info = &G->mPixelShaderInfo[mCurrentPixelShader];
-
-			for (selectedRenderTargetPos = 0; selectedRenderTargetPos < mCurrentRenderTargets.size(); ++selectedRenderTargetPos) {
-				if (selectedRenderTargetPos >= info->RenderTargets.size())
-					info->RenderTargets.push_back(std::set<ResourceSnapshot>());
-
-				info->RenderTargets[selectedRenderTargetPos].insert(SnapshotResource(mCurrentRenderTargets[selectedRenderTargetPos]));
-			}
+		RecordShaderResourceUsage<&ID3D11DeviceContext::PSGetShaderResources>(ShaderUsageStage::PS);
 
-			if (mCurrentDepthTarget)
-				info->DepthTargets.insert(SnapshotResource(mCurrentDepthTarget));
+		for (selectedRenderTargetPos = 0; selectedRenderTargetPos < mCurrentRenderTargets.size(); ++selectedRenderTargetPos) {
+			ring->record_resource(ShaderUsageRecordType::RENDER_TARGET, ShaderUsageStage::PS,
+					selectedRenderTargetPos, mCurrentRenderTargets[selectedRenderTargetPos]);
+		}
 
-			if (mCurrentPSNumUAVs) {
-				for (i = 0; i < mCurrentPSNumUAVs; i++) {
-					if (uavs[i]) {
-						resource = RecordResourceViewStats(uavs[i], &G->mUnorderedAccessInfo);
-						if (resource)
-							info->UAVs[i + mCurrentPSUAVStartSlot].insert(SnapshotResource(resource));
+		if (mCurrentDepthTarget)
+			ring->record_resource(ShaderUsageRecordType::DEPTH_TARGET, ShaderUsageStage::PS, 0, mCurrentDepthTarget);
 
-						uavs[i]->Release();
-					}
-				}
-			}
-		LeaveCriticalSection(&G->mCriticalSection);
+		if (mCurrentPSNumUAVs) {
+			RecordViewUsage(ShaderUsageRecordType::UAV, ShaderUsageStage::PS,
+					mCurrentPSUAVStartSlot, mCurrentPSNumUAVs, (ID3D11View**)uavs);
+		}
 	}
 
 	if (Profiling::mode == Profiling::Mode::SUMMARY)
@@ -309,11 +254,9 @@ void HackerContext::RecordComputeShaderStats()
 {
 	ID3D11ShaderResourceView *srvs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
 	ID3D11UnorderedAccessView *uavs[D3D11_1_UAV_SLOT_COUNT]; // DX11: 8, DX11.1: 64
-	ShaderInfoData *info;
+	UINT64 shaders[(int)ShaderUsageStage::COUNT] = { 0, 0, 0, 0, 0, mCurrentComputeShader };
 	D3D_FEATURE_LEVEL level = mOrigDevice1->GetFeatureLevel();
 	UINT num_uavs = (level >= D3D_FEATURE_LEVEL_11_1 ? D3D11_1_UAV_SLOT_COUNT : D3D11_PS_CS_UAV_REGISTER_COUNT);
-	ID3D11Resource *resource;
-	UINT i;
 	Profiling::State profiling_state;
 
 	if (Profiling::mode == Profiling::Mode::SUMMARY)
@@ -322,32 +265,20 @@ void HackerContext::RecordComputeShaderStats()
 	mOrigContext1->CSGetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, srvs);
 	mOrigContext1->CSGetUnorderedAccessViews(0, num_uavs, uavs);
 
-	EnterCriticalSectionPretty(&G->mCriticalSection);
+	GetShaderUsageRing()->record_shaders(shaders);
+	RecordViewUsage(ShaderUsageRecordType::REGISTER, ShaderUsageStage::CS,
+			0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, (ID3D11View**)srvs);
+	RecordViewUsage(ShaderUsageRecordType::UAV, ShaderUsageStage::CS,
+			0, num_uavs, (ID3D11View**)uavs);
 
-		info = &G->mComputeShaderInfo[mCurrentComputeShader];
-		_RecordShaderResourceUsage(info, srvs);
-
-		for (i = 0; i < num_uavs; i++) {
-			if (uavs[i]) {
-				resource = RecordResourceViewStats(uavs[i], &G->mUnorderedAccessInfo);
-				if (resource)
-					info->UAVs[i].insert(SnapshotResource(resource));
-
-				uavs[i]->Release();
-			}
-		}
-
-		if (Profiling::mode == Profiling::Mode::SUMMARY)
-			Profiling::end(&profiling_state, &Profiling::stat_overhead);
-
-	LeaveCriticalSection(&G->mCriticalSection);
+	if (Profiling::mode == Profiling::Mode::SUMMARY)
+		Profiling::end(&profiling_state, &Profiling::stat_overhead);
 }
 
 void HackerContext::RecordRenderTargetInfo(ID3D11RenderTargetView *target, UINT view_num)
 {
 	D3D11_RENDER_TARGET_VIEW_DESC desc;
 	ID3D11Resource *resource = NULL;
-	uint32_t orig_hash = 0;
 
 	target->GetDesc(&desc);
 
@@ -358,30 +289,19 @@ void HackerContext::RecordRenderTargetInfo(ID3D11RenderTargetView *target, UINT
 	if (!resource)
 		return;
 
-	EnterCriticalSectionPretty(&G->mCriticalSection);
-
-		// We are using the original resource hash for stat collection - things
-		// get tricky otherwise
-		orig_hash = GetOrigResourceHash((ID3D11Texture2D *)resource);
-
-		resource->Release();
-
-		if (!resource)
-			goto out_unlock;
+	// The original resource hash is used for stat collection - things get
+	// tricky otherwise. The ring looks that up before we drop the reference:
+	GetShaderUsageRing()->record_resource(ShaderUsageRecordType::VISITED_RENDER_TARGET,
+			ShaderUsageStage::PS, view_num, resource);
 
-		mCurrentRenderTargets.push_back(resource);
-		G->mVisitedRenderTargets.insert(resource);
-		G->mRenderTargetInfo.insert(orig_hash);
+	resource->Release();
 
-out_unlock:
-	LeaveCriticalSection(&G->mCriticalSection);
+	mCurrentRenderTargets.push_back(resource);
 }
 
 void HackerContext::RecordDepthStencil(ID3D11DepthStencilView *target)
 {
-	D3D11_DEPTH_STENCIL_VIEW_DESC desc;
 	ID3D11Resource *resource = NULL;
-	uint32_t orig_hash = 0;
 
 	if (!target)
 		return;
@@ -390,20 +310,12 @@ void HackerContext::RecordDepthStencil(ID3D11DepthStencilView *target)
 	if (!resource)
 		return;
 
-	target->GetDesc(&desc);
+	GetShaderUsageRing()->record_resource(ShaderUsageRecordType::VISITED_DEPTH_TARGET,
+			ShaderUsageStage::PS, 0, resource);
 
-	EnterCriticalSectionPretty(&G->mCriticalSection);
+	resource->Release();
 
-		// We are using the original resource hash for stat collection - things
-		// get tricky otherwise
-		orig_hash = GetOrigResourceHash(resource);
-
-		resource->Release();
-
-		mCurrentDepthTarget = resource;
-		G->mDepthTargetInfo.insert(orig_hash);
-
-	LeaveCriticalSection(&G->mCriticalSection);
+	mCurrentDepthTarget = resource;
 }
 
 ID3D11VertexShader* HackerContext::SwitchVSShader(ID3D11VertexShader *shader)
@@ -513,9 +425,9 @@ void HackerContext::ProcessShaderOverride(ShaderOverride *shaderOverride, bool i
 // slightly unusual place to run this, but the reason is because of another
 // upcoming feature that may decide to patch shaders at the last possible
 // moment once the pipeline state is known, and this is the best point to do
-// that. Later we can look into running the ShaderRegex engine earlier (at
-// least on initial load when not hunting), but for now to keep things simpler
-// we will do all the auto patching from one place.
+// that. The expensive part (disassembling, patching and reassembling) is
+// started on a worker thread when the shader is created (see ShaderRegexJob),
+// so usually all that is left to do here is apply the result.
 //
 // We do want to avoid replacing a shader that has already been replaced from
 // ShaderFixes, either at shader creation time, or dynamically by the
@@ -532,14 +444,10 @@ void HackerContext::DeferredShaderReplacement(ID3D11DeviceChild *shader, UINT64
 	ID3D11ClassInstance *class_instances[256];
 	ShaderReloadMap::iterator orig_info_i;
 	OriginalShaderInfo *orig_info = NULL;
+	std::shared_ptr<ShaderRegexJob> job;
 	UINT num_instances = 0;
-	string asm_text;
-	bool patch_regex = false;
 	HRESULT hr;
 	unsigned i;
-	wstring tagline(L"//");
-	vector<byte> patched_bytecode;
-	vector<char> asm_vector;
 
 	EnterCriticalSectionPretty(&G->mCriticalSection);
 
@@ -556,68 +464,19 @@ void HackerContext::DeferredShaderReplacement(ID3D11DeviceChild *shader, UINT64
 	// (until config reload) regardless of whether we patch it or not:
 	orig_info->deferred_replacement_processed = true;
 
-	switch (load_shader_regex_cache(hash, shader_type, &patched_bytecode, &tagline)) {
-	case ShaderRegexCache::NO_MATCH:
-		LogInfo("%S %016I64x has cached ShaderRegex miss\n", shader_type, hash);
-		goto out_drop;
-	case ShaderRegexCache::MATCH:
-		LogInfo("Loaded %S %016I64x command list from ShaderRegex cache\n", shader_type, hash);
-		goto out_drop;
-	case ShaderRegexCache::PATCH:
-		LogInfo("Loaded %S %016I64x bytecode from ShaderRegex cache\n", shader_type, hash);
-		break;
-	case ShaderRegexCache::NO_CACHE:
-		LogInfo("Performing deferred shader analysis on %S %016I64x...\n", shader_type, hash);
-
-		asm_text = BinaryToAsmText(orig_info->byteCode->GetBufferPointer(),
-				orig_info->byteCode->GetBufferSize(),
-				G->patch_cb_offsets,
-				G->disassemble_undecipherable_custom_data);
-		if (asm_text.empty())
-			goto out_drop;
-
-		try {
-			patch_regex = apply_shader_regex_groups(&asm_text, shader_type, &orig_info->shaderModel, hash, &tagline);
-		} catch (...) {
-			LogInfo("    *** Exception while patching shader\n");
-			goto out_drop;
-		}
-
-		if (!patch_regex) {
-			LogInfo("Patch did not apply\n");
-			goto out_drop;
-		}
-
-		// No longer logging this since we can output to ShaderFixes
-		// via hunting if marking_actions = regex, or it could be
-		// disassembled from the regex cache with cmd_Decompiler
-		// LogInfo("Patched Shader:\n%s\n", asm_text.c_str());
+	// Usually queued when the shader was created and done by now. If it
+	// wasn't (shader_regex_threads = 0, or a shader reverted by hunting)
+	// this runs it here and now:
+	job.swap(orig_info->regex_job);
+	if (!job)
+		job = std::make_shared<ShaderRegexJob>(hash, shader_type, &orig_info->shaderModel, orig_info->byteCode);
+	shader_regex_workers.wait(job.get());
+	orig_info->shaderModel = job->shader_model;
 
-		asm_vector.assign(asm_text.begin(), asm_text.end());
-
-		try {
-			vector<AssemblerParseError> parse_errors;
-			hr = AssembleFluganWithSignatureParsing(&asm_vector, &patched_bytecode, &parse_errors);
-			if (FAILED(hr)) {
-				LogInfo("    *** Assembling patched shader failed\n");
-				goto out_drop;
-			}
-			// Parse errors are currently being treated as non-fatal on
-			// creation time replacement and ShaderRegex for backwards
-			// compatibility (live shader reload is fatal).
-			for (auto &parse_error : parse_errors)
-				LogOverlay(LOG_NOTICE, "%016I64x-%S %S: %s\n",
-						hash, shader_type, tagline.c_str(), parse_error.what());
-		} catch (const exception &e) {
-			LogOverlay(LOG_WARNING, "Error assembling ShaderRegex patched %016I64x-%S\n%S\n%s\n",
-					hash, shader_type, tagline.c_str(), e.what());
-			goto out_drop;
-		}
-
-		save_shader_regex_cache_bin(hash, shader_type, &patched_bytecode);
-	}
+	if (!job->finish())
+		goto out_drop;
 
-	hr = (mOrigDevice1->*CreateShader)(patched_bytecode.data(), patched_bytecode.size(),
+	hr = (mOrigDevice1->*CreateShader)(job->patched_bytecode.data(), job->patched_bytecode.size(),
 			orig_info->linkage, &patched_shader);
 	CleanupShaderMaps(patched_shader);
 	if (FAILED(hr)) {
@@ -631,7 +490,7 @@ void HackerContext::DeferredShaderReplacement(ID3D11DeviceChild *shader, UINT64
 	if (orig_info->replacement)
 		orig_info->replacement->Release();
 	orig_info->replacement = patched_shader;
-	orig_info->infoText = tagline;
+	orig_info->infoText = job->tagline;
 
 	// Now that we've finished updating our data structures we can drop the
 	// critical section before calling into DirectX to bind the replacement
@@ -725,6 +584,23 @@ void HackerContext::DeferredShaderReplacementBeforeDispatch()
 }
 
 
+// Called when the ShaderOverrides have changed since the ones for the bound
+// shaders were looked up, which happens on config reload or when ShaderRegex
+// adds a ShaderOverride for a shader it matched:
+void HackerContext::UpdateCurrentShaderOverrides()
+{
+	// Read before the lookups - if the index changes again while we are
+	// looking them up we will just do this again on the next draw call:
+	mShaderOverrideGeneration = G->mShaderOverrideIndex.generation();
+
+	mCurrentVertexShaderOverride = mCurrentVertexShader ? lookup_shaderoverride(mCurrentVertexShader) : NULL;
+	mCurrentHullShaderOverride = mCurrentHullShader ? lookup_shaderoverride(mCurrentHullShader) : NULL;
+	mCurrentDomainShaderOverride = mCurrentDomainShader ? lookup_shaderoverride(mCurrentDomainShader) : NULL;
+	mCurrentGeometryShaderOverride = mCurrentGeometryShader ? lookup_shaderoverride(mCurrentGeometryShader) : NULL;
+	mCurrentPixelShaderOverride = mCurrentPixelShader ? lookup_shaderoverride(mCurrentPixelShader) : NULL;
+	mCurrentComputeShaderOverride = mCurrentComputeShader ? lookup_shaderoverride(mCurrentComputeShader) : NULL;
+}
+
 void HackerContext::BeforeDraw(DrawContext &data)
 {
 	Profiling::State profiling_state;
@@ -745,7 +621,9 @@ void HackerContext::BeforeDraw(DrawContext &data)
 		if (G->DumpUsage)
 			RecordGraphicsShaderStats();
 
-		EnterCriticalSectionPretty(&G->mCriticalSection);
+		// The selection only compares against state in this context, so
+		// this doesn't take the lock unless the draw call matches - that
+		// would otherwise serialise every draw call from every thread:
 		{
 			// Selection
 			for (selectedVertexBufferPos = 0; selectedVertexBufferPos < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; ++selectedVertexBufferPos) {
@@ -768,6 +646,8 @@ void HackerContext::BeforeDraw(DrawContext &data)
 				LogDebug("  Skipping selected operation. CurrentIndexBuffer = %08lx, CurrentVertexShader = %016I64x, CurrentPixelShader = %016I64x\n",
 					mCurrentIndexBuffer, mCurrentVertexShader, mCurrentPixelShader);
 
+				EnterCriticalSectionPretty(&G->mCriticalSection);
+
 				// Snapshot render target list.
 				if (G->mSelectedRenderTargetSnapshot != G->mSelectedRenderTarget)
 				{
@@ -803,6 +683,9 @@ void HackerContext::BeforeDraw(DrawContext &data)
 					if (mCurrentIndexBuffer)
 						G->mSelectedPixelShader_IndexBuffer.insert(mCurrentIndexBuffer);
 				}
+
+				LeaveCriticalSection(&G->mCriticalSection);
+
 				if (G->marking_mode == MarkingMode::MONO && mHackerDevice->mStereoHandle)
 				{
 					LogDebug("  setting separation=0 for hunting\n");
@@ -832,7 +715,6 @@ void HackerContext::BeforeDraw(DrawContext &data)
 				}
 			}
 		}
-		LeaveCriticalSection(&G->mCriticalSection);
 	}
 
 	if (!G->fix_enabled)
@@ -840,44 +722,35 @@ void HackerContext::BeforeDraw(DrawContext &data)
 
 	DeferredShaderReplacementBeforeDraw();
 
-	// Override settings?
+	// Override settings? These were looked up when the shaders were set,
+	// unless the ShaderOverrides have changed since then:
 	if (!G->mShaderOverrideMap.empty()) {
-		ShaderOverrideMap::iterator i;
+		if (mShaderOverrideGeneration != G->mShaderOverrideIndex.generation())
+			UpdateCurrentShaderOverrides();
 
-		i = lookup_shaderoverride(mCurrentVertexShader);
-		if (i != G->mShaderOverrideMap.end()) {
-			data.post_commands[0] = &i->second.post_command_list;
-			ProcessShaderOverride(&i->second, false, &data);
+		if (mCurrentVertexShaderOverride) {
+			data.post_commands[0] = &mCurrentVertexShaderOverride->post_command_list;
+			ProcessShaderOverride(mCurrentVertexShaderOverride, false, &data);
 		}
 
-		if (mCurrentHullShader) {
-			i = lookup_shaderoverride(mCurrentHullShader);
-			if (i != G->mShaderOverrideMap.end()) {
-				data.post_commands[1] = &i->second.post_command_list;
-				ProcessShaderOverride(&i->second, false, &data);
-			}
+		if (mCurrentHullShaderOverride) {
+			data.post_commands[1] = &mCurrentHullShaderOverride->post_command_list;
+			ProcessShaderOverride(mCurrentHullShaderOverride, false, &data);
 		}
 
-		if (mCurrentDomainShader) {
-			i = lookup_shaderoverride(mCurrentDomainShader);
-			if (i != G->mShaderOverrideMap.end()) {
-				data.post_commands[2] = &i->second.post_command_list;
-				ProcessShaderOverride(&i->second, false, &data);
-			}
+		if (mCurrentDomainShaderOverride) {
+			data.post_commands[2] = &mCurrentDomainShaderOverride->post_command_list;
+			ProcessShaderOverride(mCurrentDomainShaderOverride, false, &data);
 		}
 
-		if (mCurrentGeometryShader) {
-			i = lookup_shaderoverride(mCurrentGeometryShader);
-			if (i != G->mShaderOverrideMap.end()) {
-				data.post_commands[3] = &i->second.post_command_list;
-				ProcessShaderOverride(&i->second, false, &data);
-			}
+		if (mCurrentGeometryShaderOverride) {
+			data.post_commands[3] = &mCurrentGeometryShaderOverride->post_command_list;
+			ProcessShaderOverride(mCurrentGeometryShaderOverride, false, &data);
 		}
 
-		i = lookup_shaderoverride(mCurrentPixelShader);
-		if (i != G->mShaderOverrideMap.end()) {
-			data.post_commands[4] = &i->second.post_command_list;
-			ProcessShaderOverride(&i->second, true, &data);
+		if (mCurrentPixelShaderOverride) {
+			data.post_commands[4] = &mCurrentPixelShaderOverride->post_command_list;
+			ProcessShaderOverride(mCurrentPixelShaderOverride, true, &data);
 		}
 	}
 
@@ -956,6 +829,9 @@ STDMETHODIMP_(ULONG) HackerContext::Release(THIS)
 		} else
 			LogInfo("HackerContext::Release - mHackerDevice is NULL\n");
 
+		if (mShaderUsage)
+			FreeShaderUsageRing(mShaderUsage);
+
 		delete this;
 		return 0L;
 	}
@@ -1122,7 +998,7 @@ bool HackerContext::MapDenyCPURead(
 	D3D11_MAPPED_SUBRESOURCE *pMappedResource)
 {
 	uint32_t hash;
-	TextureOverrideMap::iterator i;
+	TextureOverrideList *overrides;
 
 	// Currently only replacing first subresource to simplify map type, and
 	// only on read access as it is unclear how to handle a read/write access.
@@ -1136,11 +1012,11 @@ bool HackerContext::MapDenyCPURead(
 		hash = GetResourceHash(pResource);
 	LeaveCriticalSection(&G->mCriticalSection);
 
-	i = lookup_textureoverride(hash);
-	if (i == G->mTextureOverrideMap.end())
+	overrides = lookup_textureoverride(hash);
+	if (!overrides)
 		return false;
 
-	return i->second.begin()->deny_cpu_read;
+	return overrides->begin()->deny_cpu_read;
 }
 
 void HackerContext::TrackAndDivertMap(HRESULT map_hr, ID3D11Resource *pResource,
@@ -1388,7 +1264,8 @@ STDMETHODIMP_(void) HackerContext::GSSetShader(THIS_
 		 &G->mVisitedGeometryShaders,
 		 G->mSelectedGeometryShader,
 		 &mCurrentGeometryShader,
-		 &mCurrentGeometryShaderHandle);
+		 &mCurrentGeometryShaderHandle,
+		 &mCurrentGeometryShaderOverride);
 }
 
 STDMETHODIMP_(void) HackerContext::IASetPrimitiveTopology(THIS_
@@ -1528,16 +1405,16 @@ bool HackerContext::BeforeDispatch(DispatchContext *context)
 
 	// Override settings?
 	if (!G->mShaderOverrideMap.empty()) {
-		ShaderOverrideMap::iterator i;
+		if (mShaderOverrideGeneration != G->mShaderOverrideIndex.generation())
+			UpdateCurrentShaderOverrides();
 
-		i = lookup_shaderoverride(mCurrentComputeShader);
-		if (i != G->mShaderOverrideMap.end()) {
-			context->post_commands = &i->second.post_command_list;
+		if (mCurrentComputeShaderOverride) {
+			context->post_commands = &mCurrentComputeShaderOverride->post_command_list;
 			// XXX: Not using ProcessShaderOverride() as a
 			// lot of it's logic doesn't really apply to
 			// compute shaders. The main thing we care
 			// about is the command list, so just run that:
-			RunCommandList(mHackerDevice, this, &i->second.command_list, &context->call_info, false);
+			RunCommandList(mHackerDevice, this, &mCurrentComputeShaderOverride->command_list, &context->call_info, false);
 			return !context->call_info.skip;
 		}
 	}
@@ -1624,7 +1501,7 @@ bool HackerContext::ExpandRegionCopy(ID3D11Resource *pDstResource, UINT DstX,
 	D3D11_TEXTURE2D_DESC srcDesc, dstDesc;
 	D3D11_RESOURCE_DIMENSION srcDim, dstDim;
 	uint32_t srcHash, dstHash;
-	TextureOverrideMap::iterator i;
+	TextureOverrideList *overrides;
 
 	if (!pSrcResource || !pDstResource || !pSrcBox)
 		return false;
@@ -1645,11 +1522,11 @@ bool HackerContext::ExpandRegionCopy(ID3D11Resource *pDstResource, UINT DstX,
 			srcHash, pSrcBox->left, pSrcBox->right, pSrcBox->top, pSrcBox->bottom, srcDesc.Width, srcDesc.Height, 
 			dstHash, DstX, DstY, dstDesc.Width, dstDesc.Height);
 
-	i = lookup_textureoverride(dstHash);
-	if (i == G->mTextureOverrideMap.end())
+	overrides = lookup_textureoverride(dstHash);
+	if (!overrides)
 		return false;
 
-	if (!i->second.begin()->expand_region_copy)
+	if (!overrides->begin()->expand_region_copy)
 		return false;
 
 	memcpy(replaceBox, pSrcBox, sizeof(D3D11_BOX));
@@ -1875,7 +1752,8 @@ STDMETHODIMP_(void) HackerContext::HSSetShader(THIS_
 		 &G->mVisitedHullShaders,
 		 G->mSelectedHullShader,
 		 &mCurrentHullShader,
-		 &mCurrentHullShaderHandle);
+		 &mCurrentHullShaderHandle,
+		 &mCurrentHullShaderOverride);
 }
 
 STDMETHODIMP_(void) HackerContext::HSSetSamplers(THIS_
@@ -1923,7 +1801,8 @@ STDMETHODIMP_(void) HackerContext::DSSetShader(THIS_
 		 &G->mVisitedDomainShaders,
 		 G->mSelectedDomainShader,
 		 &mCurrentDomainShader,
-		 &mCurrentDomainShaderHandle);
+		 &mCurrentDomainShaderHandle,
+		 &mCurrentDomainShaderOverride);
 }
 
 STDMETHODIMP_(void) HackerContext::DSSetSamplers(THIS_
@@ -1998,7 +1877,8 @@ STDMETHODIMP_(void) HackerContext::SetShader(THIS_
 	std::set<UINT64> *visitedShaders,
 	UINT64 selectedShader,
 	UINT64 *currentShaderHash,
-	ID3D11Shader **currentShaderHandle)
+	ID3D11Shader **currentShaderHandle,
+	ShaderOverride **currentShaderOverride)
 {
 	ID3D11Shader *repl_shader = pShader;
 
@@ -2068,6 +1948,11 @@ STDMETHODIMP_(void) HackerContext::SetShader(THIS_
 		*currentShaderHash = 0;
 	}
 
+	// Look up the ShaderOverride here rather than on every draw call. If
+	// the ShaderOverrides change before the next draw call it will look
+	// up all the bound shaders again, so no need to check that here:
+	*currentShaderOverride = *currentShaderHash ? lookup_shaderoverride(*currentShaderHash) : NULL;
+
 	// Call through to original XXSetShader, but pShader may have been replaced.
 	(mOrigContext1->*OrigSetShader)(repl_shader, ppClassInstances, NumClassInstances);
 }
@@ -2084,7 +1969,8 @@ STDMETHODIMP_(void) HackerContext::CSSetShader(THIS_
 		 &G->mVisitedComputeShaders,
 		 G->mSelectedComputeShader,
 		 &mCurrentComputeShader,
-		 &mCurrentComputeShaderHandle);
+		 &mCurrentComputeShaderHandle,
+		 &mCurrentComputeShaderOverride);
 }
 
 STDMETHODIMP_(void) HackerContext::CSSetSamplers(THIS_
@@ -2742,7 +2628,8 @@ STDMETHODIMP_(void) HackerContext::VSSetShader(THIS_
 		 &G->mVisitedVertexShaders,
 		 G->mSelectedVertexShader,
 		 &mCurrentVertexShader,
-		 &mCurrentVertexShaderHandle);
+		 &mCurrentVertexShaderHandle,
+		 &mCurrentVertexShaderOverride);
 }
 
 STDMETHODIMP_(void) HackerContext::PSSetShaderResources(THIS_
@@ -2768,7 +2655,8 @@ STDMETHODIMP_(void) HackerContext::PSSetShader(THIS_
 		 &G->mVisitedPixelShaders,
 		 G->mSelectedPixelShader,
 		 &mCurrentPixelShader,
-		 &mCurrentPixelShaderHandle);
+		 &mCurrentPixelShaderHandle,
+		 &mCurrentPixelShaderOverride);
 
 	if (pPixelShader) {
 		// Set custom depth texture.
@@ -10,6 +10,7 @@
 #include "HackerDevice.h"
 //#include "ResourceHash.h"
 #include "Globals.h"
+#include "ShaderUsage.h"
 
 // {A3046B1E-336B-4D90-9FD6-234BC09B8687}
 DEFINE_GUID(IID_HackerContext,
@@ -128,6 +129,10 @@ private:
 	typedef std::unordered_map<ID3D11Resource*, MappedResourceInfo> MappedResources;
 	MappedResources mMappedResources;
 
+	// Hunting stats recorded by this context, NULL until it first records
+	// something:
+	ShaderUsageRing *mShaderUsage;
+
 	// These private methods are utility routines for HackerContext.
 	void BeforeDraw(DrawContext &data);
 	void AfterDraw(DrawContext &data);
@@ -141,6 +146,7 @@ private:
 	void DeferredShaderReplacement(ID3D11DeviceChild *shader, UINT64 hash, wchar_t *shader_type);
 	void DeferredShaderReplacementBeforeDraw();
 	void DeferredShaderReplacementBeforeDispatch();
+	void UpdateCurrentShaderOverrides();
 	bool ExpandRegionCopy(ID3D11Resource *pDstResource, UINT DstX,
 		UINT DstY, ID3D11Resource *pSrcResource, const D3D11_BOX *pSrcBox,
 		UINT *replaceDstX, D3D11_BOX *replaceBox);
@@ -159,14 +165,13 @@ private:
 		UINT StartSlot,
 		UINT NumViews,
 		ID3D11ShaderResourceView **ppShaderResourceViews)>
-	void RecordShaderResourceUsage(std::map<UINT64, ShaderInfoData> &ShaderInfo, UINT64 currentShader);
-	void _RecordShaderResourceUsage(ShaderInfoData *shader_info,
-			ID3D11ShaderResourceView *views[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT]);
+	void RecordShaderResourceUsage(ShaderUsageStage stage);
+	void RecordViewUsage(ShaderUsageRecordType type, ShaderUsageStage stage,
+			UINT start_slot, UINT num_views, ID3D11View **views);
 	void RecordGraphicsShaderStats();
 	void RecordComputeShaderStats();
-	void RecordPeerShaders(std::set<UINT64> *PeerShaders, UINT64 this_shader_hash);
 	void RecordRenderTargetInfo(ID3D11RenderTargetView *target, UINT view_num);
-	ID3D11Resource* RecordResourceViewStats(ID3D11View *view, std::set<uint32_t> *resource_info);
+	ShaderUsageRing* GetShaderUsageRing();
 
 	// Templates to reduce duplicated code:
 	template <class ID3D11Shader,
@@ -184,7 +189,8 @@ private:
 		std::set<UINT64> *visitedShaders,
 		UINT64 selectedShader,
 		UINT64 *currentShaderHash,
-		ID3D11Shader **currentShaderHandle);
+		ID3D11Shader **currentShaderHandle,
+		ShaderOverride **currentShaderOverride);
 	template <void (__stdcall ID3D11DeviceContext::*OrigSetShaderResources)(THIS_
 			UINT StartSlot,
 			UINT NumViews,
@@ -208,6 +214,19 @@ protected:
 	UINT64 mCurrentPixelShader;
 	UINT64 mCurrentComputeShader;
 
+	// The ShaderOverride of each of the above (NULL if none), looked up
+	// when the shader is set instead of on every draw call. These are only
+	// valid while mShaderOverrideGeneration matches the generation of
+	// G->mShaderOverrideIndex - once that changes (config reload, or
+	// ShaderRegex adding a ShaderOverride) they are looked up again:
+	ShaderOverride *mCurrentVertexShaderOverride;
+	ShaderOverride *mCurrentHullShaderOverride;
+	ShaderOverride *mCurrentDomainShaderOverride;
+	ShaderOverride *mCurrentGeometryShaderOverride;
+	ShaderOverride *mCurrentPixelShaderOverride;
+	ShaderOverride *mCurrentComputeShaderOverride;
+	unsigned mShaderOverrideGeneration;
+
 public:
 	HackerContext(ID3D11Device1 *pDevice1, ID3D11DeviceContext1 *pContext1);
 
@@ -70,6 +70,7 @@
 #include "IniHandler.h"
 #include "CommandList.h"
 #include "profiling.h"
+#include "ShaderUsage.h"
 #include "cursor.h" // For InstallHookLate
 
 
@@ -232,6 +233,11 @@ void HackerSwapChain::RunFrameActions()
 	// so that the most lost will be one frame worth.  Tradeoff of performance to accuracy
 	if (LogFile) fflush(LogFile);
 
+	// Fold the hunting stats recorded by each context during this frame
+	// into Globals, before anything below looks at them:
+	if (G->hunting == HUNTING_MODE_ENABLED)
+		FlushShaderUsage();
+
 	// Run the command list here, before drawing the overlay so that a
 	// custom shader on the present call won't remove the overlay. Also,
 	// run this before most frame actions so that this can be considered as
@@ -251,6 +257,8 @@ void HackerSwapChain::RunFrameActions()
 			G->analyse_frame_no++;
 		} else {
 			G->analyse_frame = false;
+			G->frame_analysis_writer.finish();
+			G->frame_analysis_archive.close();
 			if (G->DumpUsage)
 				DumpUsage(G->ANALYSIS_PATH);
 			LogOverlay(LOG_INFO, "Frame analysis saved to %S\n", G->ANALYSIS_PATH);
@@ -32,6 +32,7 @@
 #include "D3D_Shaders\stdafx.h"
 #include "ResourceHash.h"
 #include "ShaderRegex.h"
+#include "DecompilerCache.h"
 #include "CommandList.h"
 #include "Hunting.h"
 
@@ -577,6 +578,9 @@ static void RegisterForReload(ID3D11DeviceChild* ppShader, UINT64 hash, wstring
 	G->mReloadedShaders[ppShader].infoText = text;
 	G->mReloadedShaders[ppShader].deferred_replacement_candidate = deferred_replacement_candidate;
 	G->mReloadedShaders[ppShader].deferred_replacement_processed = false;
+
+	// Candidates for ShaderRegex get a head start on a worker thread:
+	queue_shader_regex_job(&G->mReloadedShaders[ppShader]);
 }
 
 
@@ -1028,27 +1032,41 @@ static bool DecompileAndPossiblyPatchShader(__in UINT64 hash,
 	if (GetFileAttributes(val) != INVALID_FILE_ATTRIBUTES)
 		return NULL;
 
+	// If we have decompiled this exact shader with the same settings on a
+	// previous run we can skip the decompiler, and we only need the
+	// disassembly if it is going into the exported file:
+	string decompiledCode;
+	bool cached = load_decompiler_cache(pShaderBytecode, BytecodeLength,
+			&decompiledCode, &shaderModel, &patched);
+
 	// Disassemble old shader for fixing.
-	asmText = BinaryToAsmText(pShaderBytecode, BytecodeLength, false);
-	if (asmText.empty()) {
-		LogInfo("    disassembly of original shader failed.\n");
-		return NULL;
+	if (!cached || G->EXPORT_HLSL >= 2) {
+		asmText = BinaryToAsmText(pShaderBytecode, BytecodeLength, false);
+		if (asmText.empty()) {
+			LogInfo("    disassembly of original shader failed.\n");
+			return NULL;
+		}
 	}
 
-	// Decompile code.
-	LogInfo("    creating HLSL representation.\n");
+	if (!cached) {
+		// Decompile code.
+		LogInfo("    creating HLSL representation.\n");
 
-	ParseParameters p;
-	p.bytecode = pShaderBytecode;
-	p.decompiled = asmText.c_str();
-	p.decompiledSize = asmText.size();
-	p.ZeroOutput = false;
-	p.G = &G->decompiler_settings;
-	const string decompiledCode = DecompileBinaryHLSL(p, patched, shaderModel, errorOccurred);
-	if (!decompiledCode.size() || errorOccurred)
-	{
-		LogInfo("    error while decompiling.\n");
-		return NULL;
+		ParseParameters p;
+		p.bytecode = pShaderBytecode;
+		p.decompiled = asmText.c_str();
+		p.decompiledSize = asmText.size();
+		p.ZeroOutput = false;
+		p.G = &G->decompiler_settings;
+		decompiledCode = DecompileBinaryHLSL(p, patched, shaderModel, errorOccurred);
+		if (!decompiledCode.size() || errorOccurred)
+		{
+			LogInfo("    error while decompiling.\n");
+			return NULL;
+		}
+
+		save_decompiler_cache(pShaderBytecode, BytecodeLength,
+				&decompiledCode, &shaderModel, patched);
 	}
 
 	if ((G->EXPORT_HLSL >= 1) || (G->EXPORT_FIXED && patched))
@@ -1274,7 +1292,7 @@ HRESULT HackerDevice::ReplaceShaderFromShaderFixes(UINT64 hash,
 		ID3D11ClassLinkage *pClassLinkage, ID3D11Shader **ppShader,
 		wchar_t *shaderType)
 {
-	ShaderOverrideMap::iterator override;
+	ShaderOverride *override;
 	const char *overrideShaderModel = NULL;
 	SIZE_T replaceShaderSize;
 	string shaderModel;
@@ -1284,9 +1302,9 @@ HRESULT HackerDevice::ReplaceShaderFromShaderFixes(UINT64 hash,
 
 	// Check if the user has overridden the shader model:
 	override = lookup_shaderoverride(hash);
-	if (override != G->mShaderOverrideMap.end()) {
-		if (override->second.model[0])
-			overrideShaderModel = override->second.model;
+	if (override) {
+		if (override->model[0])
+			overrideShaderModel = override->model;
 	}
 
 	char *replaceShader = _ReplaceShaderFromShaderFixes(hash, shaderType,
@@ -1368,8 +1386,8 @@ HRESULT HackerDevice::ProcessShaderNotFoundInShaderFixes(UINT64 hash,
 
 	// When in hunting mode, make a copy of the original binary, regardless.  This can be replaced, but we'll at least
 	// have a copy for every shader seen. If we are performing any sort of deferred shader replacement, such as pipline
-	// state analysis we always need to keep a copy of the original bytecode for later analysis. For now the shader
-	// regex engine counts as deferred, though that may change with optimisations in the future.
+	// state analysis we always need to keep a copy of the original bytecode for later analysis. The shader regex
+	// engine counts as deferred - it gets started on a worker from here, but is only applied when first drawn.
 	if (G->hunting || !shader_regex_groups.empty()) {
 		EnterCriticalSectionPretty(&G->mCriticalSection);
 			ID3DBlob* blob;
@@ -1400,15 +1418,13 @@ HRESULT HackerDevice::ProcessShaderNotFoundInShaderFixes(UINT64 hash,
 bool HackerDevice::NeedOriginalShader(UINT64 hash)
 {
 	ShaderOverride *shaderOverride;
-	ShaderOverrideMap::iterator i;
 
 	if (G->hunting && (G->marking_mode == MarkingMode::ORIGINAL || G->config_reloadable || G->show_original_enabled))
 		return true;
 
-	i = lookup_shaderoverride(hash);
-	if (i == G->mShaderOverrideMap.end())
+	shaderOverride = lookup_shaderoverride(hash);
+	if (!shaderOverride)
 		return false;
-	shaderOverride = &i->second;
 
 	if ((shaderOverride->depth_filter == DepthBufferFilter::DEPTH_ACTIVE) ||
 		(shaderOverride->depth_filter == DepthBufferFilter::DEPTH_INACTIVE)) {
@@ -2041,12 +2057,16 @@ static void override_resource_desc(D3D11_TEXTURE3D_DESC *desc, TextureOverride *
 	override_resource_desc_common_2d_3d(desc, textureOverride);
 }
 
+// hash_pending is set when the data hash is still being calculated by
+// async_texture_hash, in which case only fuzzy matches are considered. That is
+// only permitted when no match by hash could have changed the outcome.
 template <typename DescType>
 static const DescType* process_texture_override(uint32_t hash,
 		StereoHandle mStereoHandle,
 		const DescType *origDesc,
 		DescType *newDesc,
-		NVAPI_STEREO_SURFACECREATEMODE *oldMode)
+		NVAPI_STEREO_SURFACECREATEMODE *oldMode,
+		bool hash_pending = false)
 {
 	NVAPI_STEREO_SURFACECREATEMODE newMode = (NVAPI_STEREO_SURFACECREATEMODE) -1;
 	TextureOverrideMatches matches;
@@ -2063,7 +2083,10 @@ static const DescType* process_texture_override(uint32_t hash,
 	if (is_square_surface(origDesc))
 		newMode = (NVAPI_STEREO_SURFACECREATEMODE) G->gSurfaceSquareCreateMode;
 
-	find_texture_overrides(hash, origDesc, &matches, NULL);
+	if (hash_pending)
+		find_texture_overrides_for_desc(origDesc, &matches, NULL);
+	else
+		find_texture_overrides(hash, origDesc, &matches, NULL);
 
 	if (origDesc && !matches.empty()) {
 		// There is at least one matching texture override, which means
@@ -2083,8 +2106,13 @@ static const DescType* process_texture_override(uint32_t hash,
 			if (LogFile) {
 				char buf[256];
 				StrResourceDesc(buf, 256, origDesc);
-				LogInfo("  %S matched resource with hash=%08x %s\n",
-						textureOverride->ini_section.c_str(), hash, buf);
+				if (hash_pending) {
+					LogInfo("  %S matched resource with pending hash %s\n",
+							textureOverride->ini_section.c_str(), buf);
+				} else {
+					LogInfo("  %S matched resource with hash=%08x %s\n",
+							textureOverride->ini_section.c_str(), hash, buf);
+				}
 			}
 
 			if (!check_texture_override_iteration(textureOverride))
@@ -2153,7 +2181,7 @@ STDMETHODIMP HackerDevice::CreateBuffer(THIS_
 	if (hr == S_OK && ppBuffer && *ppBuffer)
 	{
 		EnterCriticalSectionPretty(&G->mResourcesLock);
-			ResourceHandleInfo *handle_info = &G->mResources[*ppBuffer];
+			ResourceHandleInfo *handle_info = G->mResources.insert(*ppBuffer);
 			new ResourceReleaseTracker(*ppBuffer);
 			handle_info->type = D3D11_RESOURCE_DIMENSION_BUFFER;
 			handle_info->hash = hash;
@@ -2209,7 +2237,7 @@ STDMETHODIMP HackerDevice::CreateTexture1D(THIS_
 	if (hr == S_OK && ppTexture1D && *ppTexture1D)
 	{
 		EnterCriticalSectionPretty(&G->mResourcesLock);
-			ResourceHandleInfo *handle_info = &G->mResources[*ppTexture1D];
+			ResourceHandleInfo *handle_info = G->mResources.insert(*ppTexture1D);
 			new ResourceReleaseTracker(*ppTexture1D);
 			handle_info->type = D3D11_RESOURCE_DIMENSION_TEXTURE1D;
 			handle_info->hash = hash;
@@ -2306,25 +2334,36 @@ STDMETHODIMP HackerDevice::CreateTexture2D(THIS_
 	// We also see the handle itself get reused. That suggests that maybe we ought
 	// to be tracking Release operations as well, and removing them from the map.
 
-	uint32_t data_hash, hash;
-	hash = data_hash = CalcTexture2DDataHash(pDesc, pInitialData);
-	if (pDesc)
-		hash = CalcTexture2DDescHash(hash, pDesc);
-	LogDebug("  InitialData = %p, hash = %08lx\n", pInitialData, hash);
+	uint32_t data_hash = 0, hash = 0;
+	AsyncTexture2DDataHash *async_hash = BeginTexture2DDataHash(pDesc, pInitialData);
+	if (!async_hash) {
+		hash = data_hash = CalcTexture2DDataHash(pDesc, pInitialData);
+		if (pDesc)
+			hash = CalcTexture2DDescHash(hash, pDesc);
+		LogDebug("  InitialData = %p, hash = %08lx\n", pInitialData, hash);
+	}
 
 	// Override custom settings?
-	pNewDesc = process_texture_override(hash, mStereoHandle, pDesc, &newDesc, &oldMode);
+	pNewDesc = process_texture_override(hash, mStereoHandle, pDesc, &newDesc, &oldMode, !!async_hash);
 
 	// Actual creation:
 	HRESULT hr = mOrigDevice1->CreateTexture2D(pNewDesc, pInitialData, ppTexture2D);
 	restore_old_surface_create_mode(oldMode, mStereoHandle);
 	if (ppTexture2D) LogDebug("  returns result = %x, handle = %p\n", hr, *ppTexture2D);
 
+	// Must be collected even if the creation failed, since the worker may
+	// still be reading from the game's buffer:
+	if (async_hash) {
+		hash = data_hash = FinishTexture2DDataHash(async_hash);
+		hash = CalcTexture2DDescHash(hash, pDesc);
+		LogDebug("  InitialData = %p, hash = %08lx (async)\n", pInitialData, hash);
+	}
+
 	// Register texture. Every one seen.
 	if (hr == S_OK && ppTexture2D)
 	{
 		EnterCriticalSectionPretty(&G->mResourcesLock);
-			ResourceHandleInfo *handle_info = &G->mResources[*ppTexture2D];
+			ResourceHandleInfo *handle_info = G->mResources.insert(*ppTexture2D);
 			new ResourceReleaseTracker(*ppTexture2D);
 			handle_info->type = D3D11_RESOURCE_DIMENSION_TEXTURE2D;
 			handle_info->hash = hash;
@@ -2394,7 +2433,7 @@ STDMETHODIMP HackerDevice::CreateTexture3D(THIS_
 	if (hr == S_OK && ppTexture3D)
 	{
 		EnterCriticalSectionPretty(&G->mResourcesLock);
-			ResourceHandleInfo *handle_info = &G->mResources[*ppTexture3D];
+			ResourceHandleInfo *handle_info = G->mResources.insert(*ppTexture3D);
 			new ResourceReleaseTracker(*ppTexture3D);
 			handle_info->type = D3D11_RESOURCE_DIMENSION_TEXTURE3D;
 			handle_info->hash = hash;
@@ -2431,15 +2470,13 @@ STDMETHODIMP HackerDevice::CreateShaderResourceView(THIS_
 	// Check for depth buffer view.
 	if (hr == S_OK && G->ZBufferHashToInject && ppSRView)
 	{
-		EnterCriticalSectionPretty(&G->mResourcesLock);
-		unordered_map<ID3D11Resource *, ResourceHandleInfo>::iterator i = lookup_resource_handle_info(pResource);
-		if (i != G->mResources.end() && i->second.hash == G->ZBufferHashToInject)
+		ResourceHandleInfo *info = lookup_resource_handle_info(pResource);
+		if (info && info->hash == G->ZBufferHashToInject)
 		{
-			LogInfo("  resource view of z buffer found: handle = %p, hash = %08lx\n", *ppSRView, i->second.hash);
+			LogInfo("  resource view of z buffer found: handle = %p, hash = %08lx\n", *ppSRView, info->hash);
 
 			mZBufferResourceView = *ppSRView;
 		}
-		LeaveCriticalSection(&G->mResourcesLock);
 	}
 
 	LogDebug("  returns result = %x\n", hr);
@@ -2533,6 +2570,11 @@ fnv:
 				goto fnv;
 			LogInfo("  Bytecode hash = %016I64x\n", hash);
 			break;
+
+		case ShaderHashType::XXHASH64:
+			hash = xxhash64_buf(pShaderBytecode, BytecodeLength);
+			LogInfo("  XXH64 hash = %016I64x\n", hash);
+			break;
 	}
 
 	return hash;
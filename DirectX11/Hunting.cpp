@@ -20,6 +20,8 @@
 #include "profiling.h"
 #include "FrameAnalysis.h"
 #include "ShaderRegex.h"
+#include "DecompilerCache.h"
+#include "ShaderUsage.h"
 
 // bo3b: For this routine, we have a lot of warnings in x64, from converting a size_t result into the needed
 //  DWORD type for the Write calls.  These are writing 256 byte strings, so there is never a chance that it 
@@ -242,6 +244,9 @@ static void DumpShaderUsageInfo(HANDLE f, std::map<UINT64, ShaderInfoData> *info
 void DumpUsage(wchar_t *dir)
 {
 	wchar_t path[MAX_PATH];
+
+	FlushShaderUsage();
+
 	if (dir) {
 		wcscpy(path, dir);
 		wcscat(path, L"\\");
@@ -424,11 +429,16 @@ static void MarkingScreenShots(HackerDevice *device, HashType hash, char *short_
 
 static string Decompile(ID3DBlob *pShaderByteCode, string *asmText)
 {
-	LogInfo("    creating HLSL representation.\n");
-
 	bool patched = false;
 	string shaderModel;
 	bool errorOccurred = false;
+	string decompiledCode;
+
+	if (load_decompiler_cache(pShaderByteCode->GetBufferPointer(), pShaderByteCode->GetBufferSize(),
+			&decompiledCode, &shaderModel, &patched))
+		return decompiledCode;
+
+	LogInfo("    creating HLSL representation.\n");
 
 	ParseParameters p;
 	p.bytecode = pShaderByteCode->GetBufferPointer();
@@ -436,12 +446,17 @@ static string Decompile(ID3DBlob *pShaderByteCode, string *asmText)
 	p.decompiledSize = asmText->size();
 	p.ZeroOutput = false;
 	p.G = &G->decompiler_settings;
-	const string decompiledCode = DecompileBinaryHLSL(p, patched, shaderModel, errorOccurred);
+	decompiledCode = DecompileBinaryHLSL(p, patched, shaderModel, errorOccurred);
 
 	if (!decompiledCode.size())
 	{
 		LogInfo("    error while decompiling.\n");
 	}
+	else if (!errorOccurred)
+	{
+		save_decompiler_cache(pShaderByteCode->GetBufferPointer(), pShaderByteCode->GetBufferSize(),
+				&decompiledCode, &shaderModel, patched);
+	}
 
 	return decompiledCode;
 }
@@ -564,6 +579,7 @@ STDMETHODIMP MigotoIncludeHandler::Open(D3D_INCLUDE_TYPE IncludeType, LPCSTR pFi
 	*pBytes = size;
 	*ppData = buf;
 	push_dir(apath.c_str());
+	included_files.push_back(wpath);
 	LogDebug("       -> %p\n", buf);
 
 	return S_OK;
@@ -773,7 +789,6 @@ static bool RegenerateShader(wchar_t *shaderFixPath, wchar_t *fileName, const ch
 static bool ReloadShader(wchar_t *shaderPath, wchar_t *fileName, HackerDevice *device, string *errText)
 {
 	UINT64 hash;
-	ShaderOverrideMap::iterator override;
 	ID3D11DeviceChild* oldShader = NULL;
 	ID3D11DeviceChild* replacement = NULL;
 	ID3D11ClassLinkage* classLinkage;
@@ -827,10 +842,10 @@ static bool ReloadShader(wchar_t *shaderPath, wchar_t *fileName, HackerDevice *d
 			G->mReloadedShaders[oldShader].found = true;
 
 			// Check if the user has overridden the shader model:
-			ShaderOverrideMap::iterator override = lookup_shaderoverride(hash);
-			if (override != G->mShaderOverrideMap.end()) {
-				if (override->second.model[0])
-					shaderModel = override->second.model;
+			ShaderOverride *override = lookup_shaderoverride(hash);
+			if (override) {
+				if (override->model[0])
+					shaderModel = override->model;
 			}
 
 			// If shaderModel is "bin", that means the original was loaded as a binary object, and thus shaderModel is unknown.
@@ -1320,6 +1335,8 @@ static void EnableFix(HackerDevice *device, void *private_data)
 static void _AnalyseFrameStop()
 {
 	G->analyse_frame = false;
+	G->frame_analysis_writer.finish();
+	G->frame_analysis_archive.close();
 	if (G->DumpUsage) {
 		EnterCriticalSectionPretty(&G->mCriticalSection);
 			DumpUsage(G->ANALYSIS_PATH);
@@ -1736,6 +1753,10 @@ static bool MarkShaderBegin(char *type, UINT64 selected)
 
 	EnterCriticalSectionPretty(&G->mCriticalSection);
 
+	// The marking actions look at the peer shaders, so make sure they are
+	// up to date with the current frame:
+	FlushShaderUsage();
+
 	LogInfo(">>>> %s marked: %s hash = %016I64x\n", type, type, selected);
 
 	return true;
@@ -1849,10 +1870,8 @@ static uint32_t LogRenderTarget(ID3D11Resource *target, char *log_prefix)
 		return 0;
 	}
 
-	EnterCriticalSectionPretty(&G->mResourcesLock);
-	uint32_t hash = G->mResources[target].hash;
-	uint32_t orig_hash = G->mResources[target].orig_hash;
-	LeaveCriticalSection(&G->mResourcesLock);
+	uint32_t hash = GetResourceHash(target);
+	uint32_t orig_hash = GetOrigResourceHash(target);
 	struct ResourceHashInfo &info = G->mResourceInfo[orig_hash];
 	StrResourceDesc(buf, 256, info);
 	LogInfo("%srender target handle = %p, hash = %08lx, orig_hash = %08lx, %s\n",
@@ -2090,6 +2109,8 @@ void ParseHuntingSection()
 			(FrameAnalysisOptionNames, buf, NULL);
 	} else
 		G->def_analyse_options = FrameAnalysisOptions::INVALID;
+	G->analyse_writer_threads = GetIniInt(L"Hunting", L"analyse_writer_threads", 2, NULL);
+	G->analyse_writer_memory = GetIniInt(L"Hunting", L"analyse_writer_memory", 512, NULL);
 
 	// Quick hacks to see if DX11 features that we only have limited support for are responsible for anything important:
 	RegisterIniKeyBinding(L"Hunting", L"kill_deferred", DisableDeferred, EnableDeferred, noRepeat, NULL);
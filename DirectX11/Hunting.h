@@ -13,6 +13,9 @@ class MigotoIncludeHandler : public ID3DInclude
 public:
 	MigotoIncludeHandler(const char *path);
 
+	// Every file successfully included, in the order they were opened:
+	std::vector<std::wstring> included_files;
+
 	STDMETHOD(Open)(D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID *ppData, UINT *pBytes);
 	STDMETHOD(Close)(LPCVOID pData);
 };
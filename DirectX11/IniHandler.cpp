@@ -16,6 +16,7 @@
 #include "Hunting.h"
 #include "nvprofile.h"
 #include "ShaderRegex.h"
+#include "DecompilerCache.h"
 #include "cursor.h"
 
 #include "shellscalingapi.h"
@@ -1742,6 +1743,54 @@ static void ParseResourceInitialData(CustomResource *custom_resource, const wcha
 	}
 }
 
+// Used to recognise a section that is unchanged since the last time the config
+// was loaded, regardless of which file it came from or whether that file was
+// touched:
+static uint32_t fingerprint_ini_section(const wstring *sname)
+{
+	IniSectionVector *svec = NULL;
+	IniSectionVector::iterator entry;
+	uint32_t hash;
+
+	hash = crc32c_hw(0, sname->c_str(), sname->size() * sizeof(wchar_t));
+
+	GetIniSection(&svec, sname->c_str());
+	for (entry = svec->begin(); entry < svec->end(); entry++)
+		hash = crc32c_hw(hash, entry->raw_line.c_str(), (entry->raw_line.size() + 1) * sizeof(wchar_t));
+
+	return hash;
+}
+
+// Textures loaded from files are passed on from the previous config to any
+// identical section in the new config, to save loading them all over again.
+// Everything else about the section is parsed again as usual - it's cheap,
+// and everything that refers to a CustomResource is about to be re-parsed
+// anyway. Sections are compared by content rather than file timestamps, so
+// touching or re-saving a file without changing the section is free.
+static void reuse_custom_resources(CustomResources *previous)
+{
+	CustomResources::iterator old;
+	unsigned reused = 0;
+
+	for (auto &kv : customResources) {
+		old = previous->find(kv.first);
+		if (old == previous->end())
+			continue;
+		if (old->second.reload_fingerprint != kv.second.reload_fingerprint)
+			continue;
+		if (old->second.filename != kv.second.filename)
+			continue;
+		if (!old->second.can_pass_on_file_resource())
+			continue;
+
+		old->second.pass_on_file_resource(&kv.second);
+		reused++;
+	}
+
+	if (reused)
+		LogInfo("Reusing %u custom resource textures from previous config\n", reused);
+}
+
 static void ParseResourceSections()
 {
 	IniSections::iterator lower, upper, i;
@@ -1750,8 +1799,11 @@ static void ParseResourceSections()
 	wchar_t setting[MAX_PATH], path[MAX_PATH];
 	wstring namespace_path;
 	bool found;
+	CustomResources previous;
 
-	customResources.clear();
+	// Command lists from the previous config are still referring to these
+	// until they are re-parsed, but nothing can be running them:
+	previous.swap(customResources);
 
 	lower = ini_sections.lower_bound(wstring(L"Resource"));
 	upper = prefix_upper_bound(ini_sections, wstring(L"Resource"));
@@ -1831,7 +1883,11 @@ static void ParseResourceSections()
 		}
 
 		ParseResourceInitialData(custom_resource, i->first.c_str());
+
+		custom_resource->reload_fingerprint = fingerprint_ini_section(&i->first);
 	}
+
+	reuse_custom_resources(&previous);
 }
 
 static bool ParseCommandListLine(const wchar_t *ini_section,
@@ -2259,6 +2315,7 @@ static void ParseShaderOverrideSections()
 	//  We actually already lock the entire config reload, so this is redundant -DSS
 	EnterCriticalSectionPretty(&G->mCriticalSection);
 
+	G->mShaderOverrideIndex.clear();
 	G->mShaderOverrideMap.clear();
 
 	lower = ini_sections.lower_bound(wstring(L"ShaderOverride"));
@@ -2315,6 +2372,9 @@ static void ParseShaderOverrideSections()
 
 		warn_deprecated_shaderoverride_options(id, override);
 	}
+
+	G->mShaderOverrideIndex.build(&G->mShaderOverrideMap);
+
 	LeaveCriticalSection(&G->mCriticalSection);
 }
 
@@ -2548,6 +2608,7 @@ static void ParseShaderRegexSections()
 	size_t namespace_endpos = 0;
 	uint32_t hash = 0;
 
+	shader_regex_rules.clear();
 	shader_regex_group_index.clear();
 	shader_regex_groups.clear();
 
@@ -2627,8 +2688,12 @@ static void ParseShaderRegexSections()
 	// up directly without iterating over the map:
 	shader_regex_hash = hash;
 	LogInfo("ShaderRegex hash: %08x\n", shader_regex_hash);
-	for (j = shader_regex_groups.begin(); j != shader_regex_groups.end(); j++)
+	for (j = shader_regex_groups.begin(); j != shader_regex_groups.end(); j++) {
 		shader_regex_group_index.push_back(&j->second);
+		shader_regex_rules.rules.push_back(&j->second);
+	}
+
+	shader_regex_rules.compile();
 }
 
 // For fuzzy matching instead of using hash. Using terms consistent
@@ -3079,7 +3144,9 @@ static void warn_if_duplicate_texture_hash(TextureOverride *override, uint32_t h
 	if (override->has_draw_context_match || override->has_match_priority)
 		return;
 
-	i = lookup_textureoverride(hash);
+	// Not using lookup_textureoverride(), as the index is only built once
+	// we have finished parsing:
+	i = G->mTextureOverrideMap.find(hash);
 	if (i == G->mTextureOverrideMap.end())
 		return;
 
@@ -3102,6 +3169,49 @@ static void warn_if_duplicate_texture_hash(TextureOverride *override, uint32_t h
 	}
 }
 
+static bool texture_override_affects_creation(TextureOverride *override)
+{
+	return override->stereoMode != -1 ||
+		override->format != -1 ||
+		override->width != -1 ||
+		override->height != -1 ||
+		override->width_multiply != 1.0f ||
+		override->height_multiply != 1.0f ||
+		!override->iterations.empty();
+}
+
+// async_texture_hash creates textures before their data hash is known, which
+// is only safe if matching by hash can't change how they are created. That
+// is the case unless a TextureOverride matched by hash affects creation, or
+// one matched by description does and could be masked by a match by hash.
+static void check_texture_hash_affects_creation()
+{
+	G->texture_hash_affects_creation = false;
+
+	for (auto &tolkv : G->mTextureOverrideMap) {
+		for (TextureOverride &to : tolkv.second) {
+			if (texture_override_affects_creation(&to)) {
+				LogInfo("[%S] alters resource creation, textures will be hashed synchronously\n",
+						to.ini_section.c_str());
+				G->texture_hash_affects_creation = true;
+				return;
+			}
+		}
+	}
+
+	if (G->mTextureOverrideMap.empty())
+		return;
+
+	for (auto &fuzzy : G->mFuzzyTextureOverrides) {
+		if (texture_override_affects_creation(fuzzy->texture_override)) {
+			LogInfo("[%S] alters resource creation, textures will be hashed synchronously\n",
+					fuzzy->texture_override->ini_section.c_str());
+			G->texture_hash_affects_creation = true;
+			return;
+		}
+	}
+}
+
 static void ParseTextureOverrideSections()
 {
 	IniSections::iterator lower, upper, i;
@@ -3115,6 +3225,7 @@ static void ParseTextureOverrideSections()
 	//  We actually already lock the entire config reload, so this is redundant -DSS
 	EnterCriticalSectionPretty(&G->mCriticalSection);
 
+	G->mTextureOverrideIndex.clear();
 	G->mTextureOverrideMap.clear();
 	G->mFuzzyTextureOverrides.clear();
 
@@ -3180,6 +3291,11 @@ static void ParseTextureOverrideSections()
 		}
 	}
 
+	G->mTextureOverrideIndex.build(&G->mTextureOverrideMap);
+
+	if (G->async_texture_hash)
+		check_texture_hash_affects_creation();
+
 	LeaveCriticalSection(&G->mCriticalSection);
 }
 
@@ -3816,11 +3932,17 @@ static void _EnumerateCustomShaderSections(IniSections::iterator lower, IniSecti
 		customShaders[shader_id];
 	}
 }
+// CustomShaders from the previous config, so that any that are unchanged can
+// skip being compiled again. Held from EnumerateCustomShaderSections() until
+// the end of ParseCustomShaderSections():
+static CustomShaders previous_custom_shaders;
+
 static void EnumerateCustomShaderSections()
 {
 	IniSections::iterator lower, upper;
 
-	customShaders.clear();
+	previous_custom_shaders.clear();
+	previous_custom_shaders.swap(customShaders);
 
 	lower = ini_sections.lower_bound(wstring(L"BuiltInCustomShader"));
 	upper = prefix_upper_bound(ini_sections, wstring(L"BuiltInCustomShader"));
@@ -3830,6 +3952,33 @@ static void EnumerateCustomShaderSections()
 	upper = prefix_upper_bound(ini_sections, wstring(L"CustomShader"));
 	_EnumerateCustomShaderSections(lower, upper);
 }
+// Compiling the shaders is by far the most expensive part of a reload, so if
+// the section is identical to the last config and none of the HLSL files it
+// was compiled from (including anything they #included) have been modified,
+// take the previously compiled shaders instead. Not attempted if using the
+// standard include handler, since we have no way to know what it included.
+static bool reuse_custom_shader(const wstring *shader_id, CustomShader *custom_shader)
+{
+	CustomShaders::iterator old;
+
+	if (G->recursive_include == -1)
+		return false;
+
+	old = previous_custom_shaders.find(*shader_id);
+	if (old == previous_custom_shaders.end())
+		return false;
+
+	if (!old->second.reload_fingerprint || old->second.reload_fingerprint != custom_shader->reload_fingerprint)
+		return false;
+
+	if (!file_dependencies_unchanged(&old->second.dependencies))
+		return false;
+
+	LogInfo("  Reusing shaders compiled for previous config\n");
+	custom_shader->adopt_shaders(&old->second);
+	return true;
+}
+
 static void ParseCustomShaderSections()
 {
 	CustomShaders::iterator i;
@@ -3838,6 +3987,7 @@ static void ParseCustomShaderSections()
 	wchar_t setting[MAX_PATH];
 	bool failed;
 	wstring namespace_path;
+	uint32_t fingerprint;
 
 	for (i = customShaders.begin(); i != customShaders.end(); i++) {
 		shader_id = &i->first;
@@ -3849,6 +3999,14 @@ static void ParseCustomShaderSections()
 
 		failed = false;
 
+		// The namespace path decides where relative filenames are
+		// looked up, and recursive_include how #includes are found:
+		get_namespaced_section_path(i->first.c_str(), &namespace_path);
+		fingerprint = fingerprint_ini_section(shader_id);
+		fingerprint = crc32c_hw(fingerprint, namespace_path.c_str(), namespace_path.size() * sizeof(wchar_t));
+		fingerprint = crc32c_hw(fingerprint, &G->recursive_include, sizeof(G->recursive_include));
+		custom_shader->reload_fingerprint = fingerprint;
+
 		// Flags is currently just applied to every shader in the chain
 		// because it's so rarely needed and it doesn't really matter.
 		// We can add vs_flags and so on later if we really need to.
@@ -3857,22 +4015,24 @@ static void ParseCustomShaderSections()
 				(D3DCompileFlagNames, setting, NULL);
 		}
 
-		get_namespaced_section_path(i->first.c_str(), &namespace_path);
-
-		if (GetIniString(shader_id->c_str(), L"vs", 0, setting, MAX_PATH))
-			failed |= custom_shader->compile('v', setting, shader_id, &namespace_path);
-		if (GetIniString(shader_id->c_str(), L"hs", 0, setting, MAX_PATH))
-			failed |= custom_shader->compile('h', setting, shader_id, &namespace_path);
-		if (GetIniString(shader_id->c_str(), L"ds", 0, setting, MAX_PATH))
-			failed |= custom_shader->compile('d', setting, shader_id, &namespace_path);
-		if (GetIniString(shader_id->c_str(), L"gs", 0, setting, MAX_PATH))
-			failed |= custom_shader->compile('g', setting, shader_id, &namespace_path);
-		if (GetIniString(shader_id->c_str(), L"ps", 0, setting, MAX_PATH))
-			failed |= custom_shader->compile('p', setting, shader_id, &namespace_path);
-		if (GetIniString(shader_id->c_str(), L"cs", 0, setting, MAX_PATH))
-			failed |= custom_shader->compile('c', setting, shader_id, &namespace_path);
+		if (!reuse_custom_shader(shader_id, custom_shader)) {
+			if (GetIniString(shader_id->c_str(), L"vs", 0, setting, MAX_PATH))
+				failed |= custom_shader->compile('v', setting, shader_id, &namespace_path);
+			if (GetIniString(shader_id->c_str(), L"hs", 0, setting, MAX_PATH))
+				failed |= custom_shader->compile('h', setting, shader_id, &namespace_path);
+			if (GetIniString(shader_id->c_str(), L"ds", 0, setting, MAX_PATH))
+				failed |= custom_shader->compile('d', setting, shader_id, &namespace_path);
+			if (GetIniString(shader_id->c_str(), L"gs", 0, setting, MAX_PATH))
+				failed |= custom_shader->compile('g', setting, shader_id, &namespace_path);
+			if (GetIniString(shader_id->c_str(), L"ps", 0, setting, MAX_PATH))
+				failed |= custom_shader->compile('p', setting, shader_id, &namespace_path);
+			if (GetIniString(shader_id->c_str(), L"cs", 0, setting, MAX_PATH))
+				failed |= custom_shader->compile('c', setting, shader_id, &namespace_path);
+		}
 
 		if (failed) {
+			custom_shader->reload_fingerprint = 0;
+
 			// Don't want to allow a shader to be run if it had an
 			// error since we are likely to call Draw or Dispatch.
 			// We used to erase this from the customShaders map, but
@@ -3896,6 +4056,8 @@ static void ParseCustomShaderSections()
 
 		ParseCommandList(shader_id->c_str(), &custom_shader->command_list, &custom_shader->post_command_list, CustomShaderIniKeys);
 	}
+
+	previous_custom_shaders.clear();
 }
 
 // "Explicit" means that this parses command lists sections that are
@@ -4197,6 +4359,7 @@ void LoadConfigFile()
 
 	G->shader_hash_type = GetIniEnumClass(L"Rendering", L"shader_hash", ShaderHashType::FNV, NULL, ShaderHashNames);
 	G->texture_hash_version = GetIniInt(L"Rendering", L"texture_hash", 0, NULL);
+	G->async_texture_hash = GetIniBool(L"Rendering", L"async_texture_hash", false, NULL);
 
 	if (GetIniStringAndLog(L"Rendering", L"override_directory", 0, G->SHADER_PATH, MAX_PATH))
 	{
@@ -4228,11 +4391,13 @@ void LoadConfigFile()
 	}
 
 	G->CACHE_SHADERS = GetIniBool(L"Rendering", L"cache_shaders", false, NULL);
+	G->decompiler_cache = GetIniBool(L"Rendering", L"decompiler_cache", true, NULL);
 	G->SCISSOR_DISABLE = GetIniBool(L"Rendering", L"rasterizer_disable_scissor", false, NULL);
 	G->track_texture_updates = GetIniBoolOrInt(L"Rendering", L"track_texture_updates", 0, NULL);
 	G->assemble_signature_comments = GetIniBool(L"Rendering", L"assemble_signature_comments", false, NULL);
 	G->disassemble_undecipherable_custom_data = GetIniBool(L"Rendering", L"disassemble_undecipherable_custom_data", false, NULL);
 	G->patch_cb_offsets = GetIniBool(L"Rendering", L"patch_assembly_cb_offsets", false, NULL);
+	G->shader_regex_threads = GetIniInt(L"Rendering", L"shader_regex_threads", 4, NULL);
 	G->recursive_include = GetIniBoolOrInt(L"Rendering", L"recursive_include", false, NULL);
 
 	G->EXPORT_FIXED = GetIniBool(L"Rendering", L"export_fixed", false, NULL);
@@ -4347,6 +4512,10 @@ void LoadConfigFile()
 	// [Hunting]
 	ParseHuntingSection();
 
+	// Must be done after the decompiler settings and hunting mode are known
+	// since they determine whether the cache is needed and its key:
+	configure_decompiler_cache();
+
 	// Must be done prior to parsing any command list sections, as every
 	// section registered in this set will be a candidate for optimisation:
 	registered_command_lists.clear();
@@ -4389,6 +4558,7 @@ void LoadConfigFile()
 
 	ParseShaderOverrideSections();
 	ParseShaderRegexSections();
+	configure_shader_regex_cache();
 	ParseTextureOverrideSections();
 
 	LogInfo("[Present]\n");
@@ -4474,6 +4644,33 @@ void LoadProfileManagerConfig(const wchar_t *config_dir)
 	LogInfo("\n");
 }
 
+// This variant is called by the draw call benchmark with a d3dx.ini it
+// generated itself. It only parses the sections that are used on the draw
+// path, and doesn't touch the log, the file system or the hooks.
+void LoadBenchmarkConfig(const char *ini_text)
+{
+	G->gInitialized = true;
+
+	ini_sections.clear();
+	ParseIniExcerpt(ini_text);
+	InsertBuiltInIniSections();
+
+	registered_command_lists.clear();
+	G->implicit_post_checktextureoverride_used = false;
+
+	// Same order as LoadConfigFile():
+	EnumerateCustomShaderSections();
+	EnumerateExplicitCommandListSections();
+	EnumeratePresetOverrideSections();
+	ParseResourceSections();
+	ParseConstantsSection();
+	ParsePresetOverrideSections();
+	ParseCustomShaderSections();
+	ParseExplicitCommandListSections();
+	ParseShaderOverrideSections();
+	ParseTextureOverrideSections();
+}
+
 void SavePersistentSettings()
 {
 	FILE *f;
@@ -4529,6 +4726,9 @@ static void MarkAllShadersDeferredUnprocessed()
 		// shaders that have been removed from disk, and removed from
 		// any that are loaded from disk:
 		i->second.deferred_replacement_processed = false;
+
+		// And get started on them in the background:
+		queue_shader_regex_job(&i->second);
 	}
 
 	// TODO: If ShaderRegex hash is unchanged leave these shaders in place
@@ -4577,11 +4777,16 @@ void ReloadConfig(HackerDevice *device)
 	// Reset the counters on the global parameter save area:
 	OverrideSave.Reset(device);
 
+	// The ShaderRegex workers read the groups we are about to replace:
+	shader_regex_workers.pause();
+
 	LoadConfigFile();
 	optimise_command_lists(device);
 
 	MarkAllShadersDeferredUnprocessed();
 
+	shader_regex_workers.resume();
+
 	LeaveCriticalSection(&G->mCriticalSection);
 
 	// Execute the [Constants] command list in the immediate context to
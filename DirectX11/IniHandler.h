@@ -5,6 +5,7 @@ void FlagConfigReload(HackerDevice *device, void *private_data);
 void LoadConfigFile();
 void ReloadConfig(HackerDevice *device);
 void LoadProfileManagerConfig(const wchar_t *config_dir);
+void LoadBenchmarkConfig(const char *ini_text);
 void SavePersistentSettings();
 
 struct IniLine {
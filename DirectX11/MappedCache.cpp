@@ -0,0 +1,547 @@
+#include "MappedCache.h"
+
+#include "log.h"
+#include "lock.h"
+
+// Starting sizes, both files grow by doubling as needed:
+#define MAPPED_CACHE_INITIAL_CAPACITY 4096
+#define MAPPED_CACHE_INITIAL_HEAP (1024 * 1024)
+// Don't bother compacting until there is a meaningful amount to reclaim:
+#define MAPPED_CACHE_COMPACT_THRESHOLD (16 * 1024 * 1024)
+
+MappedCache::MappedCache(const char *magic, UINT64 format_version) :
+	format_version(format_version),
+	lock_initialised(false),
+	idx_file(INVALID_HANDLE_VALUE),
+	idx_mapping(NULL),
+	dat_file(INVALID_HANDLE_VALUE),
+	dat_mapping(NULL),
+	index(NULL),
+	entries(NULL),
+	heap(NULL),
+	idx_mapped_size(0),
+	dat_mapped_size(0)
+{
+	strncpy_s(this->magic, sizeof(this->magic), magic, _TRUNCATE);
+	idx_path[0] = 0;
+	dat_path[0] = 0;
+}
+
+MappedCache::~MappedCache()
+{
+	close();
+	if (lock_initialised)
+		DeleteCriticalSection(&lock);
+}
+
+bool MappedCache::map(HANDLE file, HANDLE *mapping, void **view, UINT64 size)
+{
+	// CreateFileMapping extends the file to the requested size, and the
+	// new region is guaranteed to read back as zeroes:
+	*mapping = CreateFileMapping(file, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, NULL);
+	if (!*mapping) {
+		LogInfo("MappedCache: CreateFileMapping failed: %u\n", GetLastError());
+		return false;
+	}
+
+	*view = MapViewOfFile(*mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+	if (!*view) {
+		LogInfo("MappedCache: MapViewOfFile failed: %u\n", GetLastError());
+		CloseHandle(*mapping);
+		*mapping = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void MappedCache::unmap(HANDLE *mapping, void **view)
+{
+	if (*view)
+		UnmapViewOfFile(*view);
+	if (*mapping)
+		CloseHandle(*mapping);
+	*view = NULL;
+	*mapping = NULL;
+}
+
+bool MappedCache::map_index(UINT64 size)
+{
+	void *view = index;
+
+	unmap(&idx_mapping, &view);
+	index = NULL;
+	entries = NULL;
+	idx_mapped_size = 0;
+
+	if (!map(idx_file, &idx_mapping, &view, size))
+		return false;
+
+	index = (MappedCacheIndexHeader*)view;
+	entries = (MappedCacheEntry*)(index + 1);
+	idx_mapped_size = size;
+	return true;
+}
+
+bool MappedCache::map_heap(UINT64 size)
+{
+	void *view = heap;
+
+	unmap(&dat_mapping, &view);
+	heap = NULL;
+	dat_mapped_size = 0;
+
+	if (!map(dat_file, &dat_mapping, &view, size))
+		return false;
+
+	heap = (byte*)view;
+	dat_mapped_size = size;
+	return true;
+}
+
+static UINT64 file_size(HANDLE file)
+{
+	LARGE_INTEGER size;
+
+	if (!GetFileSizeEx(file, &size))
+		return 0;
+	return size.QuadPart;
+}
+
+static bool truncate_file(HANDLE file)
+{
+	LARGE_INTEGER zero = {};
+
+	return SetFilePointerEx(file, zero, NULL, FILE_BEGIN) && SetEndOfFile(file);
+}
+
+bool MappedCache::validate()
+{
+	MappedCacheHeapHeader *heap_header = (MappedCacheHeapHeader*)heap;
+
+	if (memcmp(index->magic, magic, sizeof(magic)) || memcmp(heap_header->magic, magic, sizeof(magic)))
+		return false;
+
+	if (index->format_version != format_version || index->generation != heap_header->generation)
+		return false;
+
+	if (!index->capacity || (index->capacity & (index->capacity - 1)))
+		return false;
+
+	if (idx_mapped_size < sizeof(MappedCacheIndexHeader) + (UINT64)index->capacity * sizeof(MappedCacheEntry))
+		return false;
+
+	if (index->count > index->capacity / 2)
+		return false;
+
+	if (index->heap_used < sizeof(MappedCacheHeapHeader) || index->heap_used > dat_mapped_size)
+		return false;
+
+	if (index->heap_dead > index->heap_used - sizeof(MappedCacheHeapHeader))
+		return false;
+
+	return true;
+}
+
+bool MappedCache::reset()
+{
+	MappedCacheHeapHeader *heap_header;
+	void *view;
+	UINT64 generation = GetTickCount64();
+
+	LogInfo("MappedCache: Creating new %S\n", idx_path);
+
+	view = index;
+	unmap(&idx_mapping, &view);
+	view = heap;
+	unmap(&dat_mapping, &view);
+	index = NULL;
+	entries = NULL;
+	heap = NULL;
+
+	if (!truncate_file(idx_file) || !truncate_file(dat_file))
+		return false;
+
+	if (!map_index(sizeof(MappedCacheIndexHeader) + MAPPED_CACHE_INITIAL_CAPACITY * sizeof(MappedCacheEntry)))
+		return false;
+	if (!map_heap(MAPPED_CACHE_INITIAL_HEAP))
+		return false;
+
+	heap_header = (MappedCacheHeapHeader*)heap;
+	memcpy(heap_header->magic, magic, sizeof(magic));
+	heap_header->generation = generation;
+
+	index->format_version = format_version;
+	index->generation = generation;
+	index->capacity = MAPPED_CACHE_INITIAL_CAPACITY;
+	index->count = 0;
+	index->heap_used = sizeof(MappedCacheHeapHeader);
+	index->heap_dead = 0;
+	// Magic goes last so a half initialised index is never considered valid:
+	memcpy(index->magic, magic, sizeof(magic));
+
+	return true;
+}
+
+bool MappedCache::open(const wchar_t *dir, const wchar_t *name)
+{
+	UINT64 idx_size, dat_size;
+
+	if (!lock_initialised) {
+		InitializeCriticalSectionPretty(&lock);
+		lock_initialised = true;
+	}
+
+	EnterCriticalSectionPretty(&lock);
+
+	if (index) {
+		LeaveCriticalSection(&lock);
+		return true;
+	}
+
+	swprintf_s(idx_path, MAX_PATH, L"%ls\\%ls.idx", dir, name);
+	swprintf_s(dat_path, MAX_PATH, L"%ls\\%ls.dat", dir, name);
+
+	// Not shared - if a second copy of the game is running at the same
+	// time it will just have to go without the cache:
+	idx_file = CreateFile(idx_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	dat_file = CreateFile(dat_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (idx_file == INVALID_HANDLE_VALUE || dat_file == INVALID_HANDLE_VALUE) {
+		LogInfo("MappedCache: Unable to open %S: %u\n", idx_path, GetLastError());
+		goto err;
+	}
+
+	idx_size = file_size(idx_file);
+	dat_size = file_size(dat_file);
+
+	if (idx_size < sizeof(MappedCacheIndexHeader) || dat_size < sizeof(MappedCacheHeapHeader)
+	 || !map_index(idx_size) || !map_heap(dat_size) || !validate()) {
+		if (!reset())
+			goto err;
+	}
+
+	LogInfo("MappedCache: Opened %S: %u entries, %llu bytes (%llu reclaimable)\n",
+			idx_path, index->count, index->heap_used, index->heap_dead);
+
+	if (index->heap_dead > MAPPED_CACHE_COMPACT_THRESHOLD && index->heap_dead > index->heap_used / 2) {
+		if (!compact() && !reset())
+			goto err;
+	}
+
+	LeaveCriticalSection(&lock);
+	return true;
+err:
+	LeaveCriticalSection(&lock);
+	close();
+	return false;
+}
+
+void MappedCache::close()
+{
+	void *view;
+
+	if (lock_initialised)
+		EnterCriticalSectionPretty(&lock);
+
+	view = index;
+	unmap(&idx_mapping, &view);
+	view = heap;
+	unmap(&dat_mapping, &view);
+	index = NULL;
+	entries = NULL;
+	heap = NULL;
+	idx_mapped_size = 0;
+	dat_mapped_size = 0;
+
+	if (idx_file != INVALID_HANDLE_VALUE)
+		CloseHandle(idx_file);
+	if (dat_file != INVALID_HANDLE_VALUE)
+		CloseHandle(dat_file);
+	idx_file = INVALID_HANDLE_VALUE;
+	dat_file = INVALID_HANDLE_VALUE;
+
+	if (lock_initialised)
+		LeaveCriticalSection(&lock);
+}
+
+bool MappedCache::is_open()
+{
+	return !!index;
+}
+
+// A slot that has never been used is all zeroes. A replaced entry leaves a
+// tombstone behind, which has the valid flag cleared but keeps its (always
+// non-zero) heap offset so that lookups know to keep probing past it.
+static bool slot_never_used(const MappedCacheEntry *entry)
+{
+	return !(entry->flags & MAPPED_CACHE_ENTRY_VALID) && !entry->offset;
+}
+
+// Returns the valid entry for key, or NULL if there is none:
+MappedCacheEntry* MappedCache::find_entry(const MappedCacheKey *key)
+{
+	uint32_t mask = index->capacity - 1;
+	uint32_t i = (uint32_t)key->hash & mask;
+	MappedCacheEntry *entry;
+
+	// Load factor including tombstones is kept at or below 1/2, so this
+	// always terminates:
+	for (;; i = (i + 1) & mask) {
+		entry = &entries[i];
+		if (slot_never_used(entry))
+			return NULL;
+		if ((entry->flags & MAPPED_CACHE_ENTRY_VALID) && entry->key == *key)
+			return entry;
+	}
+}
+
+// Returns the first unused slot or tombstone on the probe sequence for key:
+MappedCacheEntry* MappedCache::find_free_slot(const MappedCacheKey *key)
+{
+	uint32_t mask = index->capacity - 1;
+	uint32_t i = (uint32_t)key->hash & mask;
+
+	for (;; i = (i + 1) & mask) {
+		if (!(entries[i].flags & MAPPED_CACHE_ENTRY_VALID))
+			return &entries[i];
+	}
+}
+
+// Turns every valid entry for key other than keep into a tombstone. There is
+// normally at most one, but a crash part way through a replacement can leave
+// two behind:
+void MappedCache::retire_entries(const MappedCacheKey *key, MappedCacheEntry *keep)
+{
+	uint32_t mask = index->capacity - 1;
+	uint32_t i = (uint32_t)key->hash & mask;
+	MappedCacheEntry *entry;
+
+	for (;; i = (i + 1) & mask) {
+		entry = &entries[i];
+		if (slot_never_used(entry))
+			return;
+		if (entry != keep && (entry->flags & MAPPED_CACHE_ENTRY_VALID) && entry->key == *key) {
+			entry->flags = 0;
+			index->heap_dead += entry->size;
+		}
+	}
+}
+
+// Entries come straight from disk, so check they lie inside the heap before
+// touching the blob they point to:
+bool MappedCache::entry_in_heap(const MappedCacheEntry *entry)
+{
+	return entry->offset >= sizeof(MappedCacheHeapHeader) &&
+		entry->offset <= index->heap_used &&
+		entry->size <= index->heap_used - entry->offset;
+}
+
+bool MappedCache::grow_index()
+{
+	std::vector<MappedCacheEntry> old_entries;
+	MappedCacheIndexHeader header;
+	MappedCacheEntry *slot;
+	uint32_t i, capacity;
+
+	for (i = 0; i < index->capacity; i++) {
+		if (entries[i].flags & MAPPED_CACHE_ENTRY_VALID)
+			old_entries.push_back(entries[i]);
+	}
+	header = *index;
+	capacity = header.capacity;
+
+	// Rehashing drops the tombstones, so if most of the load was
+	// replaced entries there is no need to double the index:
+	if ((old_entries.size() + 1) * 4 > capacity)
+		capacity *= 2;
+
+	if (!map_index(sizeof(MappedCacheIndexHeader) + (UINT64)capacity * sizeof(MappedCacheEntry)))
+		return false;
+
+	*index = header;
+	index->capacity = capacity;
+	index->count = (uint32_t)old_entries.size();
+	memset(entries, 0, (size_t)capacity * sizeof(MappedCacheEntry));
+
+	for (MappedCacheEntry &entry : old_entries) {
+		slot = find_free_slot(&entry.key);
+		*slot = entry;
+	}
+
+	return true;
+}
+
+bool MappedCache::grow_heap(UINT64 needed)
+{
+	UINT64 size = dat_mapped_size * 2;
+
+	if (size < index->heap_used + needed)
+		size = (index->heap_used + needed + 0xffff) & ~0xffffULL;
+
+	return map_heap(size);
+}
+
+// Rewrites the heap with only the live blobs. The new heap is written under a
+// temporary name and gets a new generation number, so if we crash before the
+// index is updated to match the mismatched generation will cause the cache to
+// be discarded on the next launch rather than returning garbage.
+bool MappedCache::compact()
+{
+	MappedCacheHeapHeader *new_header;
+	std::vector<UINT64> new_offsets(index->capacity);
+	wchar_t tmp_path[MAX_PATH];
+	HANDLE tmp_file, tmp_mapping = NULL;
+	void *tmp_view = NULL;
+	UINT64 live = index->heap_used - index->heap_dead;
+	UINT64 pos = sizeof(MappedCacheHeapHeader);
+	UINT64 generation = index->generation + 1;
+	uint32_t i;
+
+	LogInfo("MappedCache: Compacting %S, reclaiming %llu bytes\n", dat_path, index->heap_dead);
+
+	swprintf_s(tmp_path, MAX_PATH, L"%ls.tmp", dat_path);
+	tmp_file = CreateFile(tmp_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (tmp_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (!map(tmp_file, &tmp_mapping, &tmp_view, live)) {
+		CloseHandle(tmp_file);
+		DeleteFile(tmp_path);
+		return false;
+	}
+
+	new_header = (MappedCacheHeapHeader*)tmp_view;
+	memcpy(new_header->magic, magic, sizeof(magic));
+	new_header->generation = generation;
+
+	for (i = 0; i < index->capacity; i++) {
+		MappedCacheEntry *entry = &entries[i];
+		if (!(entry->flags & MAPPED_CACHE_ENTRY_VALID))
+			continue;
+		if (!entry_in_heap(entry) || pos + entry->size > live) {
+			// Corrupt entry or accounting is off, give up and start over
+			unmap(&tmp_mapping, &tmp_view);
+			CloseHandle(tmp_file);
+			DeleteFile(tmp_path);
+			return false;
+		}
+		memcpy((byte*)tmp_view + pos, heap + entry->offset, entry->size);
+		new_offsets[i] = pos;
+		pos += entry->size;
+	}
+
+	unmap(&tmp_mapping, &tmp_view);
+	CloseHandle(tmp_file);
+
+	tmp_view = heap;
+	unmap(&dat_mapping, &tmp_view);
+	heap = NULL;
+	CloseHandle(dat_file);
+	dat_file = INVALID_HANDLE_VALUE;
+
+	if (!MoveFileEx(tmp_path, dat_path, MOVEFILE_REPLACE_EXISTING)) {
+		LogInfo("MappedCache: Unable to replace %S: %u\n", dat_path, GetLastError());
+		DeleteFile(tmp_path);
+	}
+
+	dat_file = CreateFile(dat_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (dat_file == INVALID_HANDLE_VALUE || !map_heap(max(file_size(dat_file), (UINT64)sizeof(MappedCacheHeapHeader))))
+		return false;
+
+	if (((MappedCacheHeapHeader*)heap)->generation != generation)
+		return false;
+
+	for (i = 0; i < index->capacity; i++) {
+		if (entries[i].flags & MAPPED_CACHE_ENTRY_VALID)
+			entries[i].offset = new_offsets[i];
+	}
+	index->heap_used = pos;
+	index->heap_dead = 0;
+	index->generation = generation;
+
+	return true;
+}
+
+bool MappedCache::lookup(const MappedCacheKey *key, std::vector<byte> *blob, uint32_t *flags)
+{
+	MappedCacheEntry *entry;
+	bool ret = false;
+
+	if (!lock_initialised)
+		return false;
+
+	EnterCriticalSectionPretty(&lock);
+
+	if (!index)
+		goto out;
+
+	entry = find_entry(key);
+	if (!entry || !entry_in_heap(entry))
+		goto out;
+
+	blob->assign(heap + entry->offset, heap + entry->offset + entry->size);
+	if (flags)
+		*flags = entry->flags & ~MAPPED_CACHE_ENTRY_VALID;
+	ret = true;
+out:
+	LeaveCriticalSection(&lock);
+	return ret;
+}
+
+bool MappedCache::store(const MappedCacheKey *key, const void *blob, uint32_t size, uint32_t flags)
+{
+	MappedCacheEntry *entry;
+	bool ret = false;
+
+	if (!lock_initialised)
+		return false;
+
+	EnterCriticalSectionPretty(&lock);
+
+	if (!index)
+		goto out;
+
+	// Tombstones count towards the load, so this is checked even when
+	// replacing an existing entry:
+	if ((index->count + 1) * 2 > index->capacity) {
+		if (!grow_index())
+			goto err;
+	}
+
+	if (index->heap_used + size > dat_mapped_size) {
+		if (!grow_heap(size))
+			goto err;
+	}
+
+	memcpy(heap + index->heap_used, blob, size);
+
+	// A replacement is written to a fresh slot rather than over the old
+	// one, and in both cases the slot is only marked valid once the rest
+	// of it has been filled in, so a crash can't leave a half written
+	// entry that looks real. If we crash before the old entry has been
+	// turned into a tombstone both are complete, and lookups get the old
+	// one until the key is stored again.
+	entry = find_free_slot(key);
+	if (slot_never_used(entry))
+		index->count++;
+	entry->key = *key;
+	entry->offset = index->heap_used;
+	entry->size = size;
+	entry->flags = flags | MAPPED_CACHE_ENTRY_VALID;
+	index->heap_used += size;
+
+	retire_entries(key, entry);
+
+	ret = true;
+	goto out;
+err:
+	// Failed to grow one of the mappings, which leaves us without a
+	// consistent view of the files. Drop the cache for this session:
+	LogInfo("MappedCache: Disabling %S\n", idx_path);
+	LeaveCriticalSection(&lock);
+	close();
+	return false;
+out:
+	LeaveCriticalSection(&lock);
+	return ret;
+}
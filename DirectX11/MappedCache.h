@@ -0,0 +1,110 @@
+#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <vector>
+
+// A persistent content addressed cache backed by two memory mapped files in
+// the ShaderCache directory: an open addressed hash index (.idx) and an
+// append-only blob heap (.dat). Once both files are mapped a lookup is a probe
+// of the index plus a copy out of the heap, so on a warm cache it costs at
+// most a couple of page faults rather than opening a file per shader.
+//
+// Entries are identified by three 64bit words. It is up to the user what goes
+// in them, but the first should be a well distributed hash since it is used
+// to pick the index slot, and anything else that would invalidate a cached
+// result (decompiler settings, ShaderRegex hash, etc) must be folded into the
+// others. The whole cache is thrown away if it was written by a different
+// format version, so bump that when the blob layout changes.
+//
+// Replacing an entry writes it to a new slot and leaves a tombstone in the
+// old one, and the old blob behind as dead space in the heap. Tombstones are
+// dropped when the index is rehashed, and when the dead space exceeds half of
+// the heap the cache is compacted the next time it is opened.
+
+struct MappedCacheKey
+{
+	UINT64 hash;
+	UINT64 qualifier1;
+	UINT64 qualifier2;
+
+	bool operator==(const MappedCacheKey &other) const
+	{
+		return hash == other.hash &&
+			qualifier1 == other.qualifier1 &&
+			qualifier2 == other.qualifier2;
+	}
+};
+
+// Users may store up to 31 bits of flags alongside each blob, the top bit is
+// used to mark a slot in the index as occupied:
+#define MAPPED_CACHE_ENTRY_VALID 0x80000000
+
+struct MappedCacheEntry
+{
+	MappedCacheKey key;
+	UINT64 offset;
+	uint32_t size;
+	uint32_t flags;
+};
+
+struct MappedCacheIndexHeader
+{
+	char magic[8];
+	UINT64 format_version;
+	UINT64 generation;	// Must match the .dat header, bumped on compaction
+	uint32_t capacity;	// Number of slots, always a power of two
+	uint32_t count;		// Number of occupied slots, including tombstones
+	UINT64 heap_used;	// Bytes appended to the .dat heap
+	UINT64 heap_dead;	// Bytes belonging to replaced entries
+};
+
+struct MappedCacheHeapHeader
+{
+	char magic[8];
+	UINT64 generation;
+};
+
+class MappedCache
+{
+public:
+	MappedCache(const char *magic, UINT64 format_version);
+	~MappedCache();
+
+	bool open(const wchar_t *dir, const wchar_t *name);
+	void close();
+	bool is_open();
+
+	bool lookup(const MappedCacheKey *key, std::vector<byte> *blob, uint32_t *flags);
+	bool store(const MappedCacheKey *key, const void *blob, uint32_t size, uint32_t flags);
+
+private:
+	char magic[8];
+	UINT64 format_version;
+	wchar_t idx_path[MAX_PATH];
+	wchar_t dat_path[MAX_PATH];
+	bool lock_initialised;
+	CRITICAL_SECTION lock;
+
+	HANDLE idx_file, idx_mapping;
+	HANDLE dat_file, dat_mapping;
+	MappedCacheIndexHeader *index;
+	MappedCacheEntry *entries;
+	byte *heap;
+	UINT64 idx_mapped_size;
+	UINT64 dat_mapped_size;
+
+	bool map(HANDLE file, HANDLE *mapping, void **view, UINT64 size);
+	void unmap(HANDLE *mapping, void **view);
+	bool map_index(UINT64 size);
+	bool map_heap(UINT64 size);
+	bool validate();
+	bool reset();
+	bool grow_index();
+	bool grow_heap(UINT64 needed);
+	bool compact();
+	MappedCacheEntry* find_entry(const MappedCacheKey *key);
+	MappedCacheEntry* find_free_slot(const MappedCacheKey *key);
+	void retire_entries(const MappedCacheKey *key, MappedCacheEntry *keep);
+	bool entry_in_heap(const MappedCacheEntry *entry);
+};
@@ -65,6 +65,7 @@ void Override::ParseIniSection(LPCWSTR section)
 			val = GetIniFloat(section, entry->first.c_str(), FLT_MAX, NULL);
 			if (val != FLT_MAX) {
 				mOverrideVars[var] = val;
+				var->overridden = true;
 			}
 		}
 	}
@@ -280,6 +281,7 @@ void KeyOverrideCycle::ParseIniSection(LPCWSTR section)
 			}
 
 			GetIniString(section, entry->first.c_str(), 0, &var_bufs[var].buf);
+			var->overridden = true;
 		}
 	}
 
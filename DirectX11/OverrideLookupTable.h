@@ -0,0 +1,271 @@
+#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+#include "ResourceHandleTable.h" // For EpochReclaimer
+
+// Lock free index over the ShaderOverride and TextureOverride maps, which are
+// looked up by hash several times on every draw call (once per bound shader
+// in BeforeDraw, and once per resource checked by checktextureoverride).
+// The maps themselves are node based, so each lookup was a few dependent
+// cache misses on a fix with a lot of overrides, and most lookups miss since
+// most shaders and textures don't have an override.
+//
+// The index is a flat open addressed array of key / value pointer pairs with
+// a blocked Bloom filter in front of it. The key is mixed once per lookup and
+// that hash picks both the filter word and the first slot, and the two filter
+// bits are in the same 64 bit word, so a miss usually costs a single memory
+// access without touching the array at all.
+//
+// The maps remain the owners of the values and are still what the ini parser
+// and everything else that walks them uses. The index holds pointers into
+// them, which stay valid as the map grows since the maps are node based. It
+// is built in one go after parsing the config, and ShaderRegex adds to it with
+// insert() as it creates a ShaderOverride for each matched shader.
+//
+// Lookups take no lock. Writers must be serialised by the caller (holding
+// G->mCriticalSection). insert() fills in a free slot of the live table and
+// only copies everything into a new one when the table would be more than
+// half full, doubling its size, so adding n keys one at a time is O(n) rather
+// than a rebuild each. A table replaced by build(), clear() or growth is
+// handed to the same epoch based reclaimer the resource handle table uses,
+// and freed as soon as no lookup could still be walking it. clear() is called
+// on config reload right before the maps destroy their values, which already
+// relies on no lookups being in flight at that point.
+
+template <class Key, class Value>
+class OverrideLookupTable
+{
+public:
+	typedef Key key_type;
+	typedef Value mapped_type;
+
+	OverrideLookupTable() :
+		gen(0)
+	{
+		table.store(new_table(0), std::memory_order_relaxed);
+	}
+
+	~OverrideLookupTable()
+	{
+		free_table(table.load(std::memory_order_relaxed));
+	}
+
+	// Lock free, safe to call from any thread at any time
+	Value* find(Key key)
+	{
+		UINT64 hash = mix(key);
+		UINT64 bits = filter_bits(hash);
+		Slot *slot;
+		Value *value;
+		size_t i;
+
+		EpochGuard guard(&reclaimer);
+		Table *t = table.load(std::memory_order_acquire);
+
+		if ((t->filter[(size_t)hash & t->filter_mask].load(std::memory_order_acquire) & bits) != bits)
+			return NULL;
+
+		for (i = (size_t)(hash >> t->shift); ; i = (i + 1) & t->mask) {
+			slot = &t->slots[i];
+			value = slot->value.load(std::memory_order_acquire);
+			if (!value)
+				return NULL;
+			if (slot->key == key)
+				return value;
+		}
+	}
+
+	// Writers only. Indexes every key in the map, replacing whatever was
+	// indexed before.
+	void build(std::unordered_map<Key, Value> *map)
+	{
+		Table *t = new_table(map->size());
+
+		for (auto &kv : *map)
+			add(t, kv.first, &kv.second);
+
+		replace(t);
+	}
+
+	// Writers only. Adds a single key, which is visible to lookups on other
+	// threads as soon as this returns. The value must already be filled in.
+	void insert(Key key, Value *value)
+	{
+		Table *t = table.load(std::memory_order_relaxed);
+		Table *grown;
+		size_t i;
+
+		if (t->count + 1 > max_count(t)) {
+			grown = new_table(t->count + 1);
+			for (i = 0; i <= t->mask; i++) {
+				if (t->slots[i].value.load(std::memory_order_relaxed))
+					add(grown, t->slots[i].key, t->slots[i].value.load(std::memory_order_relaxed));
+			}
+			add(grown, key, value);
+			replace(grown);
+			return;
+		}
+
+		add(t, key, value);
+		gen.fetch_add(1, std::memory_order_release);
+	}
+
+	// Writers only. Empties the index. See the comment at the top of the
+	// file for when it is safe to call this.
+	void clear()
+	{
+		replace(new_table(0));
+	}
+
+	// Changes whenever the index is rebuilt, added to or cleared, for
+	// anything that caches the result of a lookup to tell when it has
+	// gone stale. A lookup made after reading the generation is at least
+	// as new as it:
+	unsigned generation()
+	{
+		return gen.load(std::memory_order_acquire);
+	}
+
+	// For statistics
+	size_t size()
+	{
+		return table.load(std::memory_order_relaxed)->count;
+	}
+
+	size_t capacity()
+	{
+		return table.load(std::memory_order_relaxed)->mask + 1;
+	}
+
+	size_t pending_reclaim()
+	{
+		return reclaimer.pending();
+	}
+
+private:
+	// The value is published after the key, and NULL marks an empty slot:
+	struct Slot {
+		Key key;
+		std::atomic<Value*> value;
+	};
+
+	struct Table {
+		size_t count;
+		size_t mask;
+		int shift;
+		Slot *slots;
+
+		size_t filter_mask;
+		std::atomic<UINT64> *filter;
+	};
+
+	std::atomic<Table*> table;
+	std::atomic<unsigned> gen;
+	EpochReclaimer reclaimer;
+
+	// The shader and texture hashes are already fairly well distributed,
+	// but the filter and the slot index are taken from different parts of
+	// the hash, so run it through a full avalanche (splitmix64 finaliser):
+	static UINT64 mix(Key key)
+	{
+		UINT64 h = (UINT64)key;
+
+		h ^= h >> 30;
+		h *= 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 27;
+		h *= 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+		return h;
+	}
+
+	// The low bits of the hash pick the filter word and the top bits pick
+	// the slot, so the bits within the word are taken from the middle:
+	static UINT64 filter_bits(UINT64 hash)
+	{
+		return (1ULL << ((hash >> 20) & 63)) | (1ULL << ((hash >> 26) & 63));
+	}
+
+	// At most half full, and a filter with 16 bits per key, which gives a
+	// false positive rate of around 2% with two bits per key in a word:
+	static size_t max_count(Table *t)
+	{
+		return min((t->mask + 1) / 2, (t->filter_mask + 1) * 4);
+	}
+
+	static Table* new_table(size_t count)
+	{
+		Table *t = new Table();
+		size_t capacity = 16;
+		size_t filter_words = 1;
+		size_t i;
+
+		while (capacity < count * 2)
+			capacity *= 2;
+		while (filter_words * 4 < count)
+			filter_words *= 2;
+
+		t->count = 0;
+		t->mask = capacity - 1;
+		t->shift = 64;
+		for (i = capacity; i > 1; i >>= 1)
+			t->shift--;
+		t->slots = new Slot[capacity];
+		for (i = 0; i < capacity; i++)
+			t->slots[i].value.store(NULL, std::memory_order_relaxed);
+
+		t->filter_mask = filter_words - 1;
+		t->filter = new std::atomic<UINT64>[filter_words];
+		for (i = 0; i < filter_words; i++)
+			t->filter[i].store(0, std::memory_order_relaxed);
+
+		return t;
+	}
+
+	static void free_table(void *ptr)
+	{
+		Table *t = (Table*)ptr;
+
+		delete [] t->slots;
+		delete [] t->filter;
+		delete t;
+	}
+
+	// Adds a key to a table that has room for it, replacing the value if
+	// it is already there. The slot is published before the filter bits,
+	// so a lookup that passes the filter will find it:
+	static void add(Table *t, Key key, Value *value)
+	{
+		UINT64 hash = mix(key);
+		std::atomic<UINT64> *word = &t->filter[(size_t)hash & t->filter_mask];
+		Slot *slot;
+		size_t i;
+
+		for (i = (size_t)(hash >> t->shift); ; i = (i + 1) & t->mask) {
+			slot = &t->slots[i];
+			if (!slot->value.load(std::memory_order_relaxed)) {
+				slot->key = key;
+				t->count++;
+				break;
+			}
+			if (slot->key == key)
+				break;
+		}
+		slot->value.store(value, std::memory_order_release);
+
+		word->store(word->load(std::memory_order_relaxed) | filter_bits(hash), std::memory_order_release);
+	}
+
+	void replace(Table *t)
+	{
+		Table *old = table.load(std::memory_order_relaxed);
+
+		table.store(t, std::memory_order_release);
+		gen.fetch_add(1, std::memory_order_release);
+		reclaimer.retire(old, free_table);
+	}
+};
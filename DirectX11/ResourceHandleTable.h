@@ -0,0 +1,410 @@
+#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Deferred reclamation for data structures that are read without a lock.
+//
+// Readers hold an EpochGuard for as long as they are looking at anything that
+// a writer might unlink, which costs one interlocked increment and decrement
+// on a counter picked by thread ID. There are no per-thread records to
+// register or clean up, so it is safe to use from threads we never see start
+// or exit (the wrapper DLLs can't rely on thread_local or thread detach).
+//
+// Writers must be serialised by the owner of the data structure. They unlink
+// an object, then hand it to retire(), which frees it once every reader that
+// could still be looking at it has left. The counters are split by the parity
+// of the global epoch so that a steady stream of new readers cannot hold off
+// reclamation indefinitely - the epoch only advances once all readers that
+// entered under the previous parity have left, and an object retired in epoch
+// E is freed once the epoch reaches E+2. In the common case of no concurrent
+// readers that is immediately.
+//
+// Any reader that enters after the writer checked its counter is guaranteed
+// to see the unlink (both sides use sequentially consistent operations), so
+// it does not matter if a reader picks up a stale parity.
+
+#define EPOCH_READER_STRIPES 32
+
+class EpochReclaimer
+{
+public:
+	typedef void (*free_fn_t)(void *ptr);
+
+	EpochReclaimer() :
+		epoch(0)
+	{
+		for (int i = 0; i < EPOCH_READER_STRIPES; i++) {
+			stripes[i].readers[0].store(0, std::memory_order_relaxed);
+			stripes[i].readers[1].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	~EpochReclaimer()
+	{
+		// No readers can be left by the time we are destroyed:
+		for (Retired &r : retired)
+			r.free_fn(r.ptr);
+	}
+
+	std::atomic<long>* enter()
+	{
+		// Thread IDs are multiples of four on Windows:
+		Stripe *stripe = &stripes[(GetCurrentThreadId() >> 2) % EPOCH_READER_STRIPES];
+		std::atomic<long> *counter = &stripe->readers[epoch.load(std::memory_order_relaxed) & 1];
+
+		counter->fetch_add(1, std::memory_order_seq_cst);
+		return counter;
+	}
+
+	void leave(std::atomic<long> *counter)
+	{
+		counter->fetch_sub(1, std::memory_order_release);
+	}
+
+	// Writers only
+	void retire(void *ptr, free_fn_t free_fn)
+	{
+		Retired r = { ptr, free_fn, epoch.load(std::memory_order_relaxed) };
+
+		retired.push_back(r);
+		collect();
+	}
+
+	// Writers only
+	void collect()
+	{
+		UINT64 now;
+		size_t i, j;
+
+		if (retired.empty())
+			return;
+
+		if (try_advance())
+			try_advance();
+		now = epoch.load(std::memory_order_relaxed);
+
+		for (i = 0, j = 0; i < retired.size(); i++) {
+			if (retired[i].epoch + 2 <= now)
+				retired[i].free_fn(retired[i].ptr);
+			else
+				retired[j++] = retired[i];
+		}
+		retired.resize(j);
+	}
+
+	// Writers only, for statistics
+	size_t pending()
+	{
+		return retired.size();
+	}
+
+private:
+	// Padded so that readers on different stripes don't bounce a cache
+	// line between them. Not aligned, since the C++ version we build with
+	// won't honour alignas for heap allocated objects such as Globals:
+	struct Stripe {
+		std::atomic<long> readers[2];
+		char pad[64 - 2 * sizeof(std::atomic<long>)];
+	};
+
+	struct Retired {
+		void *ptr;
+		free_fn_t free_fn;
+		UINT64 epoch;
+	};
+
+	Stripe stripes[EPOCH_READER_STRIPES];
+	std::atomic<UINT64> epoch;
+	std::vector<Retired> retired;
+
+	bool try_advance()
+	{
+		UINT64 e = epoch.load(std::memory_order_relaxed);
+		int idx = (e + 1) & 1;
+		int i;
+
+		// Orders any unlinks the caller made before the counter reads:
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		// Parity of e + 1 is the same as e - 1:
+		for (i = 0; i < EPOCH_READER_STRIPES; i++) {
+			if (stripes[i].readers[idx].load(std::memory_order_seq_cst))
+				return false;
+		}
+
+		epoch.store(e + 1, std::memory_order_seq_cst);
+		return true;
+	}
+};
+
+class EpochGuard
+{
+public:
+	EpochGuard(EpochReclaimer *reclaimer) :
+		reclaimer(reclaimer),
+		counter(reclaimer->enter())
+	{}
+
+	~EpochGuard()
+	{
+		reclaimer->leave(counter);
+	}
+
+private:
+	EpochReclaimer *reclaimer;
+	std::atomic<long> *counter;
+};
+
+// Open addressed hash table keyed on a pointer, used to map resource handles
+// to their ResourceHandleInfo. This is looked up on practically every call
+// that binds, copies or updates a resource, from whatever thread the game
+// happens to use, while additions and removals are comparatively rare. Lookups
+// therefore take no lock at all, which is the whole point of this class.
+//
+// Additions and removals must be serialised by the caller holding a lock
+// (G->mResourcesLock for the resource table). Each value is allocated
+// separately so that pointers to it stay valid when the table is resized.
+// A value returned from find() remains valid until its key is erased, and
+// erased values are only freed once no lookups that might have found them
+// are still in flight, same as the old arrays when the table is resized. For
+// resources that is as long as the caller holds a reference.
+//
+// Erased keys leave a tombstone behind that is never reused, which is what
+// keeps lookups safe against a concurrent erase + insert landing in the same
+// slot. Tombstones are cleaned out whenever the table is rehashed.
+
+#define RESOURCE_HANDLE_TABLE_INITIAL_CAPACITY 4096
+
+template <class Key, class Value>
+class ResourceHandleTable
+{
+public:
+	typedef Key key_type;
+	typedef Value mapped_type;
+
+	ResourceHandleTable() :
+		count(0),
+		used(0)
+	{
+		table.store(new_table(RESOURCE_HANDLE_TABLE_INITIAL_CAPACITY), std::memory_order_relaxed);
+	}
+
+	~ResourceHandleTable()
+	{
+		Table *t = table.load(std::memory_order_relaxed);
+		Key key;
+		size_t i;
+
+		for (i = 0; i <= t->mask; i++) {
+			key = t->slots[i].key.load(std::memory_order_relaxed);
+			if (key && key != tombstone())
+				delete t->slots[i].value.load(std::memory_order_relaxed);
+		}
+		free_table(t);
+	}
+
+	// Lock free, safe to call from any thread at any time
+	Value* find(Key key)
+	{
+		Key slot_key;
+		size_t i;
+
+		// NULL marks an empty slot, and the tombstone an erased one. Neither
+		// is ever a real key, and the first empty slot may belong to an
+		// insert in progress that has stored its value but not its key yet:
+		if (!key || key == tombstone())
+			return NULL;
+
+		EpochGuard guard(&reclaimer);
+		Table *t = table.load(std::memory_order_acquire);
+
+		for (i = t->index(key); ; i = (i + 1) & t->mask) {
+			slot_key = t->slots[i].key.load(std::memory_order_acquire);
+			if (slot_key == key)
+				return t->slots[i].value.load(std::memory_order_acquire);
+			if (!slot_key)
+				return NULL;
+		}
+	}
+
+	// Writers only. Returns the existing value for the key if there is one,
+	// otherwise a default constructed value. The new value is visible to
+	// readers immediately, so fill it in before any other thread could have
+	// a reason to look for the key.
+	Value* insert(Key key, bool *inserted = NULL)
+	{
+		Table *t = table.load(std::memory_order_relaxed);
+		Slot *slot;
+		Value *value;
+
+		slot = writer_probe(t, key);
+		if (slot->key.load(std::memory_order_relaxed) == key) {
+			if (inserted)
+				*inserted = false;
+			return slot->value.load(std::memory_order_relaxed);
+		}
+
+		if ((used + 1) * 8 > (t->mask + 1) * 5) {
+			t = rehash(t);
+			slot = writer_probe(t, key);
+		}
+
+		value = new Value();
+		slot->value.store(value, std::memory_order_relaxed);
+		slot->key.store(key, std::memory_order_release);
+		count++;
+		used++;
+
+		if (inserted)
+			*inserted = true;
+		return value;
+	}
+
+	// Writers only
+	bool erase(Key key)
+	{
+		Table *t = table.load(std::memory_order_relaxed);
+		Slot *slot;
+
+		slot = writer_probe(t, key);
+		if (slot->key.load(std::memory_order_relaxed) != key)
+			return false;
+
+		slot->key.store(tombstone(), std::memory_order_release);
+		count--;
+		reclaimer.retire(slot->value.load(std::memory_order_relaxed), free_value);
+		return true;
+	}
+
+	// A lookup that may race with its key being erased can hold an
+	// EpochGuard on this to keep the value alive until it is done with it
+	EpochReclaimer* get_reclaimer()
+	{
+		return &reclaimer;
+	}
+
+	// Writers only, for statistics
+	size_t size()
+	{
+		return count;
+	}
+
+	size_t capacity()
+	{
+		return table.load(std::memory_order_relaxed)->mask + 1;
+	}
+
+	size_t pending_reclaim()
+	{
+		return reclaimer.pending();
+	}
+
+private:
+	struct Slot {
+		std::atomic<Key> key;
+		std::atomic<Value*> value;
+	};
+
+	struct Table {
+		size_t mask;
+		int shift;
+		Slot *slots;
+
+		// Fibonacci hashing - the low bits of a pointer are mostly
+		// alignment and the allocator tends to hand out runs of
+		// similar addresses, so use the top bits of the product:
+		size_t index(Key key)
+		{
+			return (size_t)(((UINT64)(uintptr_t)key * 0x9e3779b97f4a7c15ULL) >> shift);
+		}
+	};
+
+	std::atomic<Table*> table;
+	EpochReclaimer reclaimer;
+	size_t count; // Live keys, writers only
+	size_t used;  // Live keys + tombstones, writers only
+
+	static Key tombstone()
+	{
+		return (Key)(uintptr_t)1;
+	}
+
+	static Table* new_table(size_t capacity)
+	{
+		Table *t = new Table();
+		size_t i;
+
+		t->mask = capacity - 1;
+		t->shift = 64;
+		for (i = capacity; i > 1; i >>= 1)
+			t->shift--;
+		t->slots = new Slot[capacity];
+		for (i = 0; i < capacity; i++) {
+			t->slots[i].key.store(NULL, std::memory_order_relaxed);
+			t->slots[i].value.store(NULL, std::memory_order_relaxed);
+		}
+
+		return t;
+	}
+
+	static void free_table(void *ptr)
+	{
+		Table *t = (Table*)ptr;
+
+		delete [] t->slots;
+		delete t;
+	}
+
+	static void free_value(void *ptr)
+	{
+		delete (Value*)ptr;
+	}
+
+	// Returns the slot holding the key, or the empty slot that ends its
+	// probe sequence. Tombstones are skipped over and not reused.
+	Slot* writer_probe(Table *t, Key key)
+	{
+		Key slot_key;
+		size_t i;
+
+		for (i = t->index(key); ; i = (i + 1) & t->mask) {
+			slot_key = t->slots[i].key.load(std::memory_order_relaxed);
+			if (slot_key == key || !slot_key)
+				return &t->slots[i];
+		}
+	}
+
+	// Copies the live keys into a fresh table, doubling the capacity if
+	// they occupy half of it, otherwise just dropping the tombstones. The
+	// values themselves are shared with the old table, which is retired
+	// since lookups may still be walking it.
+	Table* rehash(Table *old)
+	{
+		size_t capacity = old->mask + 1;
+		Table *t;
+		Slot *slot;
+		Key key;
+		size_t i;
+
+		while ((count + 1) * 2 > capacity)
+			capacity *= 2;
+
+		t = new_table(capacity);
+		for (i = 0; i <= old->mask; i++) {
+			key = old->slots[i].key.load(std::memory_order_relaxed);
+			if (!key || key == tombstone())
+				continue;
+			slot = writer_probe(t, key);
+			slot->value.store(old->slots[i].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			slot->key.store(key, std::memory_order_relaxed);
+		}
+		used = count;
+
+		table.store(t, std::memory_order_release);
+		reclaimer.retire(old, free_table);
+		return t;
+	}
+};
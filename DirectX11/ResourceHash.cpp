@@ -668,30 +668,8 @@ static uint32_t hash_tex2d_data(uint32_t hash, const void *data, size_t length,
 
 	DirectX::LoaderHelpers::GetSurfaceInfo(pDesc->Width, pDesc->Height, pDesc->Format, &slice_pitch, &row_pitch, &row_count);
 
-	uint8_t *sptr = (uint8_t*)data;
-	size_t msize = min(row_pitch, mapped_row_pitch);
-
-	signed padding = (signed)mapped_row_pitch - (signed)row_pitch;
-	uint8_t *zeroes = NULL;
-	if (zero_padding && padding > 0) {
-		zeroes = new uint8_t[padding];
-		memset(zeroes, 0, padding);
-	}
-
-	signed remaining = (signed)length;
-	for (size_t h = 0; h < row_count && remaining > 0; h++) {
-		hash = crc32c_hw(hash, sptr, min(msize, (unsigned)remaining));
-		sptr += mapped_row_pitch;
-		remaining -= (signed)msize;
-
-		if (zeroes && remaining > 0) {
-			hash = crc32c_hw(hash, zeroes, min(padding, remaining));
-			remaining -= padding;
-		}
-	}
-
-	delete [] zeroes;
-	return hash;
+	return crc32c_hw_texture_rows(hash, data, length, row_pitch, row_count,
+			mapped_row_pitch, zero_padding);
 }
 
 uint32_t CalcTexture2DDataHash(
@@ -821,28 +799,154 @@ uint32_t CalcTexture2DDataHashAccurate(
 	return hash;
 }
 
-// Must be called with the critical section held to protect mResources against
-// simultaneous reads & modifications (hmm, tempted to implement a lock free
-// map given that it's add only, or use RCU). Is there anything on Windows like
-// lockdep to statically prove this is called with the lock held?
-ResourceHandleInfo* GetResourceHandleInfo(ID3D11Resource *resource)
+// Number of bytes of actual data in each row of the top level of a texture
+// (excluding any padding the driver adds when it is mapped), and the number
+// of rows - block compressed formats have one row per 4x4 block.
+HRESULT GetTextureSurfaceInfo(UINT width, UINT height, DXGI_FORMAT format,
+		size_t *row_bytes, size_t *row_count)
 {
-	std::unordered_map<ID3D11Resource *, ResourceHandleInfo>::iterator j;
-	ResourceHandleInfo* ret = NULL;
+	return DirectX::LoaderHelpers::GetSurfaceInfo(width, height, format, NULL, row_bytes, row_count);
+}
 
-	EnterCriticalSectionPretty(&G->mResourcesLock);
+// Optional ([Rendering] async_texture_hash) overlap of the Texture2D data hash
+// with the driver's own work in CreateTexture2D. The hash is handed to the
+// system thread pool before the original CreateTexture2D is called, and is
+// collected again once that returns. Both the game's buffers and pDesc are
+// only guaranteed to be valid until we return, so the hash is always complete
+// and the resource fully registered by then - nothing that binds it can ever
+// see a resource with a pending hash, and there is no cost to any lookup.
+//
+// Note that this does not take the hash off the creating thread entirely -
+// CreateTexture2D still waits for it if the driver was quicker. Deferring it
+// until the texture is first bound would mean copying the part of the game's
+// buffer that the hash reads before returning, and that copy is slower than
+// the hash itself (crc32c reads the buffer once, the copy reads and writes
+// it), so it would add to hitches rather than remove them.
+//
+// Whichever of the worker or the creating thread gets to the job first claims
+// it, so if the pool is busy the creating thread just hashes the texture
+// itself as it used to, and the worst case is no slower than the synchronous
+// path. If a worker has already started it, the creating thread sleeps until
+// it is done. A worker that turns up after the job was claimed just drops its
+// reference. The job is reference counted since that can happen well after
+// CreateTexture2D has returned.
+//
+// This only works if the hash has no say in how the texture is created, which
+// the ini parser works out in G->texture_hash_affects_creation.
 
-	j = lookup_resource_handle_info(resource);
-	if (j != G->mResources.end())
-		ret = &j->second;
+// Below this the hash is quicker than waking a worker:
+#define ASYNC_TEXTURE_HASH_MIN_SIZE (256 * 1024)
 
-	LeaveCriticalSection(&G->mResourcesLock);
+enum class AsyncTextureHashState {
+	QUEUED,
+	RUNNING,
+	DONE,
+};
 
-	return ret;
+// Shared by all jobs, since waiting is the exception and jobs are short:
+static SRWLOCK async_texture_hash_lock = SRWLOCK_INIT;
+static CONDITION_VARIABLE async_texture_hash_done = CONDITION_VARIABLE_INIT;
+
+struct AsyncTexture2DDataHash
+{
+	const D3D11_TEXTURE2D_DESC *desc;
+	const D3D11_SUBRESOURCE_DATA *initial_data;
+	std::atomic<AsyncTextureHashState> state;
+	std::atomic<long> refs;
+	uint32_t hash;
+};
+
+static void release_async_texture_hash(AsyncTexture2DDataHash *job)
+{
+	if (job->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		delete job;
+}
+
+static bool claim_async_texture_hash(AsyncTexture2DDataHash *job)
+{
+	AsyncTextureHashState expected = AsyncTextureHashState::QUEUED;
+
+	return job->state.compare_exchange_strong(expected, AsyncTextureHashState::RUNNING);
+}
+
+static void CALLBACK async_texture_hash_worker(PTP_CALLBACK_INSTANCE instance, void *context)
+{
+	AsyncTexture2DDataHash *job = (AsyncTexture2DDataHash*)context;
+
+	if (claim_async_texture_hash(job)) {
+		job->hash = CalcTexture2DDataHash(job->desc, job->initial_data);
+
+		AcquireSRWLockExclusive(&async_texture_hash_lock);
+		job->state.store(AsyncTextureHashState::DONE, std::memory_order_release);
+		ReleaseSRWLockExclusive(&async_texture_hash_lock);
+		WakeAllConditionVariable(&async_texture_hash_done);
+	}
+
+	release_async_texture_hash(job);
+}
+
+// Returns NULL if the hash should be calculated synchronously, otherwise the
+// caller must pass the result to FinishTexture2DDataHash before returning
+// from CreateTexture2D, whether the creation succeeded or not.
+AsyncTexture2DDataHash* BeginTexture2DDataHash(
+	const D3D11_TEXTURE2D_DESC *pDesc,
+	const D3D11_SUBRESOURCE_DATA *pInitialData)
+{
+	AsyncTexture2DDataHash *job;
+
+	if (!G->async_texture_hash || G->texture_hash_affects_creation)
+		return NULL;
+
+	if (!pDesc || !pInitialData || !pInitialData->pSysMem)
+		return NULL;
+
+	if (Texture2DLength(pDesc, &pInitialData[0], 0) < ASYNC_TEXTURE_HASH_MIN_SIZE)
+		return NULL;
+
+	job = new AsyncTexture2DDataHash();
+	job->desc = pDesc;
+	job->initial_data = pInitialData;
+	job->state.store(AsyncTextureHashState::QUEUED, std::memory_order_relaxed);
+	job->refs.store(2, std::memory_order_relaxed);
+	job->hash = 0;
+
+	if (!TrySubmitThreadpoolCallback(async_texture_hash_worker, job, NULL)) {
+		LogDebug("  TrySubmitThreadpoolCallback failed, hashing synchronously\n");
+		delete job;
+		return NULL;
+	}
+
+	return job;
+}
+
+uint32_t FinishTexture2DDataHash(AsyncTexture2DDataHash *job)
+{
+	uint32_t hash;
+
+	if (claim_async_texture_hash(job)) {
+		hash = CalcTexture2DDataHash(job->desc, job->initial_data);
+	} else {
+		// Worker is part way through it. Sleep rather than spin, so
+		// we aren't competing with it for a core:
+		AcquireSRWLockExclusive(&async_texture_hash_lock);
+		while (job->state.load(std::memory_order_acquire) != AsyncTextureHashState::DONE)
+			SleepConditionVariableSRW(&async_texture_hash_done, &async_texture_hash_lock, INFINITE, 0);
+		ReleaseSRWLockExclusive(&async_texture_hash_lock);
+		hash = job->hash;
+	}
+
+	release_async_texture_hash(job);
+	return hash;
+}
+
+// Lock free - mResources is only locked to add or remove a resource. The
+// returned pointer remains valid for as long as the caller holds a reference
+// on the resource.
+ResourceHandleInfo* GetResourceHandleInfo(ID3D11Resource *resource)
+{
+	return lookup_resource_handle_info(resource);
 }
 
-// Must be called with the critical section held to protect mResources against
-// simultaneous reads & modifications
 uint32_t GetOrigResourceHash(ID3D11Resource *resource)
 {
 	ResourceHandleInfo *handle_info = GetResourceHandleInfo(resource);
@@ -852,8 +956,6 @@ uint32_t GetOrigResourceHash(ID3D11Resource *resource)
 	return 0;
 }
 
-// Must be called with the critical section held to protect mResources against
-// simultaneous reads & modifications
 uint32_t GetResourceHash(ID3D11Resource *resource)
 {
 	ResourceHandleInfo *handle_info = GetResourceHandleInfo(resource);
@@ -1344,6 +1446,9 @@ ULONG STDMETHODCALLTYPE ResourceReleaseTracker::Release(void)
 		//                                                        //
 		////////////////////////////////////////////////////////////
 
+		// Lookups don't take this lock. The entry is unlinked now
+		// but only freed once no lookup that could have found it is
+		// still in progress, which may be at a later Release.
 		EnterCriticalSectionPretty(&G->mResourcesLock);
 		G->mResources.erase(resource);
 		LeaveCriticalSection(&G->mResourcesLock);
@@ -1656,14 +1761,14 @@ static bool matches_draw_info(TextureOverride *tex_override, DrawCallInfo *call_
 
 static void find_texture_override_for_hash(uint32_t hash, TextureOverrideMatches *matches, DrawCallInfo *call_info)
 {
-	TextureOverrideMap::iterator i;
+	TextureOverrideList *overrides;
 	TextureOverrideList::iterator j;
 
-	i = lookup_textureoverride(hash);
-	if (i == G->mTextureOverrideMap.end())
+	overrides = lookup_textureoverride(hash);
+	if (!overrides)
 		return;
 
-	for (j = i->second.begin(); j != i->second.end(); j++) {
+	for (j = overrides->begin(); j != overrides->end(); j++) {
 		if (matches_draw_info(&(*j), call_info))
 			matches->push_back(&(*j));
 	}
@@ -1689,7 +1794,7 @@ static void find_texture_override_for_resource_by_hash(ID3D11Resource *resource,
 }
 
 template <typename DescType>
-static void find_texture_overrides_for_desc(const DescType *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info)
+void find_texture_overrides_for_desc(const DescType *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info)
 {
 	FuzzyTextureOverrides::iterator i;
 
@@ -1717,6 +1822,10 @@ template void find_texture_overrides<D3D11_BUFFER_DESC>(uint32_t hash, const D3D
 template void find_texture_overrides<D3D11_TEXTURE1D_DESC>(uint32_t hash, const D3D11_TEXTURE1D_DESC *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info);
 template void find_texture_overrides<D3D11_TEXTURE2D_DESC>(uint32_t hash, const D3D11_TEXTURE2D_DESC *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info);
 template void find_texture_overrides<D3D11_TEXTURE3D_DESC>(uint32_t hash, const D3D11_TEXTURE3D_DESC *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info);
+template void find_texture_overrides_for_desc<D3D11_BUFFER_DESC>(const D3D11_BUFFER_DESC *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info);
+template void find_texture_overrides_for_desc<D3D11_TEXTURE1D_DESC>(const D3D11_TEXTURE1D_DESC *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info);
+template void find_texture_overrides_for_desc<D3D11_TEXTURE2D_DESC>(const D3D11_TEXTURE2D_DESC *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info);
+template void find_texture_overrides_for_desc<D3D11_TEXTURE3D_DESC>(const D3D11_TEXTURE3D_DESC *desc, TextureOverrideMatches *matches, DrawCallInfo *call_info);
 
 void find_texture_overrides_for_resource(ID3D11Resource *resource, TextureOverrideMatches *matches, DrawCallInfo *call_info)
 {
@@ -2,365 +2,29 @@
 #include "CommandList.h"
 #include "globals.h" // For ShaderOverride FIXME: This should be in a separate header
 #include "log.h"
-
-#include <algorithm>
-#include <iterator>
+#include "lock.h"
+#include "MappedCache.h"
+#include "Overlay.h"
 
 ShaderRegexGroups shader_regex_groups;
 std::vector<ShaderRegexGroup*> shader_regex_group_index;
+ShaderRegexRuleSet shader_regex_rules;
+ShaderRegexWorkers shader_regex_workers;
 uint32_t shader_regex_hash;
 
-static void log_pcre2_error_nonl(int err, char *fmt, ...)
-{
-	PCRE2_UCHAR buf[120]; // doco says "120 code units is ample"
-	va_list ap;
-
-	pcre2_get_error_message(err, buf, sizeof(buf));
-
-	va_start(ap, fmt);
-	vLogInfo(fmt, ap);
-	va_end(ap);
-
-	LogInfo(": %s\n", buf);
-}
-
-static bool get_shader_model(std::string *asm_text, std::string *shader_model)
-{
-	size_t shader_model_pos;
-
-	for (
-		shader_model_pos = asm_text->find("\n");
-		shader_model_pos != std::string::npos && (*asm_text)[shader_model_pos + 1] == '/';
-		shader_model_pos = asm_text->find("\n", shader_model_pos + 1)
-	) {}
-
-	if (shader_model_pos == std::string::npos)
-		return false;
-
-	*shader_model = asm_text->substr(shader_model_pos + 1, asm_text->find("\n", shader_model_pos + 1) - shader_model_pos - 1);
-	return true;
-}
-
-static bool find_dcl_end(std::string *asm_text, size_t *dcl_end_pos)
-{
-	// FIXME: Might be better to scan forwards
-
-	*dcl_end_pos = asm_text->rfind("\ndcl_");
-	*dcl_end_pos = asm_text->find("\n", *dcl_end_pos + 1);
-
-	if (*dcl_end_pos == std::string::npos) {
-		LogInfo("WARNING: Unable to locate end of shader declarations!\n");
-		return false;
-	}
-
-	return true;
-}
-
-static bool insert_declarations(std::string *asm_text, ShaderRegexDeclarations *declarations)
-{
-	ShaderRegexDeclarations::iterator i;
-	std::string insert_str;
-	size_t dcl_end;
-	bool patch = false;
-
-	if (!find_dcl_end(asm_text, &dcl_end))
-		return false;
-
-	for (i = declarations->begin(); i != declarations->end(); i++) {
-		insert_str = std::string("\n") + *i;
-
-		if (asm_text->find(insert_str + std::string("\n")) != std::string::npos)
-			continue;
-
-		asm_text->insert(dcl_end, insert_str);
-		dcl_end += insert_str.size();
-
-		patch = true;
-	}
-
-	return patch;
-}
-
-static bool find_dcl_temps(std::string *asm_text, size_t *dcl_temps_pos)
-{
-	// Could use regex for this as well, but given we only need to find a
-	// constant string it will be more efficient to just do this:
-	*dcl_temps_pos = asm_text->find("\ndcl_temps ", 0);
-
-	if (*dcl_temps_pos == std::string::npos)
-		return false;
-
-	return true;
-}
-
-static unsigned get_dcl_temps(std::string *asm_text)
-{
-	size_t dcl_temps;
-	unsigned tmp_regs = 0;
-
-	if (!find_dcl_temps(asm_text, &dcl_temps))
-		return 0;
-
-	tmp_regs = stoul(asm_text->substr(dcl_temps + 10, 4));
-	LogInfo("Found dcl_temps %d\n", tmp_regs);
-
-	return tmp_regs;
-}
-
-static bool update_dcl_temps(std::string *asm_text, size_t new_val)
-{
-	size_t dcl_temps, dcl_temps_end, dcl_end;
-	std::string insert_str;
-
-	if (find_dcl_temps(asm_text, &dcl_temps)) {
-		dcl_temps += 11;
-		dcl_temps_end = asm_text->find("\n", dcl_temps);
-		LogInfo("Updating dcl_temps %Iu\n", new_val);
-		asm_text->replace(dcl_temps, dcl_temps_end - dcl_temps, std::to_string(new_val));
-		return true;
-	}
-
-	if (!find_dcl_end(asm_text, &dcl_end))
-		return false;
-
-	insert_str = std::string("\ndcl_temps ") + std::to_string(new_val);
-	LogInfo("Inserting dcl_temps %Iu\n", new_val);
-	asm_text->insert(dcl_end, insert_str);
-	dcl_end += insert_str.size();
-
-	return true;
-}
-
-ShaderRegexPattern::ShaderRegexPattern() :
-	regex(NULL),
-	do_replace(false)
-{
-}
-
-ShaderRegexPattern::~ShaderRegexPattern()
-{
-	pcre2_code_free(regex);
-}
-
-bool ShaderRegexPattern::compile(std::string *pattern)
+static ShaderRegexMatchContext* get_shader_regex_match_context()
 {
-	uint32_t name_table_entry_size;
-	uint32_t name_table_count;
-	uint32_t i;
-	PCRE2_SPTR name_table;
-	PCRE2_SIZE err_off;
-	int err;
-
-	// CASELESS is for compatibility with d3dcompiler_46 & 47 without
-	// having to always remember to account for the dcl_constantbuffer
-	// differences:
-	regex = pcre2_compile((PCRE2_SPTR)pattern->c_str(),
-			pattern->length(), // or PCRE2_ZERO_TERMINATED
-			PCRE2_CASELESS | PCRE2_MULTILINE,
-			&err, &err_off, NULL);
-	if (!regex) {
-		log_pcre2_error_nonl(err, "  WARNING: PCRE2 regex compilation failed at offset %u", (unsigned)err_off);
-		return false;
-	}
-
-	// TODO: Use callback to confirm that JIT does actually get used, as in
-	// some cases pcre2 can fall back to using the slower interpreter
-	pcre2_jit_compile(regex, 0);
-
-	pcre2_pattern_info(regex, PCRE2_INFO_NAMECOUNT, &name_table_count);
-	pcre2_pattern_info(regex, PCRE2_INFO_NAMEENTRYSIZE, &name_table_entry_size);
-	pcre2_pattern_info(regex, PCRE2_INFO_NAMETABLE, &name_table);
-
-	static_assert(PCRE2_CODE_UNIT_WIDTH == 8, "Need to fix name table parsing for non-8bit pcre2");
-	for (i = 0; i < name_table_count; i++)
-		named_capture_groups.insert(std::string((char*)(name_table + name_table_entry_size*i + 2)));
-
-	return true;
-}
-
-bool ShaderRegexPattern::named_group_overlaps(ShaderRegexTemps &other_set)
-{
-	ShaderRegexTemps intersection;
-
-	// C++ why you be so verbose?
-	std::set_intersection(
-				named_capture_groups.begin(),
-				named_capture_groups.end(),
-				other_set.begin(),
-				other_set.end(),
-				std::inserter(intersection, intersection.begin()));
-
-	return intersection.size() != 0;
-}
-
-bool ShaderRegexPattern::matches(std::string *asm_text)
-{
-	pcre2_match_data *match_data = NULL;
-	bool match = false;
-	int rc;
-
-	// TODO: Assign per-thread JIT stack if the default 32K turns out to be
-	// insufficient. Can probably store this in the context, as that is
-	// supposed to be per-thread, or use thread local storage.
-
-	match_data = pcre2_match_data_create_from_pattern(regex, NULL);
-
-	// TODO: Consider using pcre2_jit_match - doco claims 10% faster, but
-	// has less sanity checks. TODO: Use callback to confirm JIT was used
-	rc = pcre2_match(regex, (PCRE2_SPTR)asm_text->c_str(), asm_text->length(), 0, 0, match_data, NULL);
-	if (rc == PCRE2_ERROR_NOMATCH)
-		goto out_free;
-	if (rc < 0) {
-		log_pcre2_error_nonl(rc, "  WARNING: regex match error");
-		goto out_free;
-	}
-
-	match = true;
-
-out_free:
-	pcre2_match_data_free(match_data);
-	return match;
-}
+	TLS *tls = get_tls();
 
-static void replacement_search_and_replace(std::string &str, std::string *search, std::string *replace)
-{
-	size_t pos;
-
-	for (pos = str.find(*search); pos != std::string::npos; pos = str.find(*search, pos + 1)) {
-		if (pos > 0 && (str[pos-1] == '$' || str[pos-1] == '\\'))
-			continue;
+	if (!tls->shader_regex_context)
+		tls->shader_regex_context = new ShaderRegexMatchContext();
 
-		str.replace(pos, search->length(), *replace);
-	}
+	return tls->shader_regex_context;
 }
 
-static void substitute_temp_regs(std::string &replacement, ShaderRegexTemps *temp_regs, unsigned dcl_temps)
+void free_shader_regex_match_context(ShaderRegexMatchContext *context)
 {
-	ShaderRegexTemps::iterator i;
-	unsigned tmp_reg = dcl_temps;
-	std::string search_str, repl_str;
-
-	for (i = temp_regs->begin(); i != temp_regs->end(); i++, tmp_reg++) {
-		repl_str = std::string("r") + std::to_string(tmp_reg);
-
-		search_str = std::string("$") + *i;
-		replacement_search_and_replace(replacement, &search_str, &repl_str);
-
-		search_str = std::string("${") + *i + std::string("}");
-		replacement_search_and_replace(replacement, &search_str, &repl_str);
-	}
-}
-
-bool ShaderRegexPattern::patch(std::string *asm_text, ShaderRegexTemps *temp_regs, unsigned dcl_temps)
-{
-	pcre2_match_data *match_data = NULL;
-	PCRE2_SIZE est_size, output_size;
-	std::string replace_copy;
-	PCRE2_UCHAR *buf = NULL;
-	bool patch = false;
-	uint32_t options;
-	int rc;
-
-	static_assert(PCRE2_CODE_UNIT_WIDTH == 8, "Need to fix output buffer allocation for non-8bit pcre2");
-
-	// We operate on a copy of the replace string so that future shaders
-	// don't get our temporary register numbers:
-	replace_copy = replace;
-	substitute_temp_regs(replace_copy, temp_regs, dcl_temps);
-
-	// TODO: Allow named capture groups from other patterns in the same
-	// regex group to be substituted in, and provide some simple arithmetic
-	// operators to e.g. allow a constant buffer byte offset to be divided
-	// by 16 to get the constant buffer index and vice versa
-
-	// At a minimum we want \n to be translated in the replace string,
-	// which needs extended substitution processing to be enabled:
-	options = PCRE2_SUBSTITUTE_EXTENDED;
-
-	match_data = pcre2_match_data_create_from_pattern(regex, NULL);
-
-	output_size = est_size = asm_text->length() + replace_copy.length() + 1024;
-	buf = new PCRE2_UCHAR[output_size];
-	rc = pcre2_substitute(regex,
-			(PCRE2_SPTR)asm_text->c_str(), asm_text->length(), 0,
-			options | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH,
-			match_data, NULL,
-			(PCRE2_SPTR)replace_copy.c_str(), replace_copy.length(),
-			buf, &output_size);
-
-	if (rc == PCRE2_ERROR_NOMEMORY) {
-		LogInfo("  NOTICE: regex replace requires a %u byte buffer\n", (unsigned)output_size);
-		LogInfo("  NOTICE: We underestimated by %u bytes and have to start over\n", (unsigned)(output_size - est_size));
-		LogInfo("  NOTICE: What kind of crazy are you doing to get down this code path?\n");
-		LogInfo("  NOTICE: You didn't inject a matrix inverse or two in assembly did you?\n");
-		LogInfo("  NOTICE: Once more, with passion!\n");
-
-		delete [] buf;
-		buf = new PCRE2_UCHAR[output_size];
-
-		rc = pcre2_substitute(regex,
-				(PCRE2_SPTR)asm_text->c_str(), asm_text->length(), 0,
-				options, // No PCRE2_SUBSTITUTE_OVERFLOW_LENGTH this time
-				match_data, NULL,
-				(PCRE2_SPTR)replace_copy.c_str(), replace_copy.length(),
-				buf, &output_size);
-	}
-
-	if (rc == 0)
-		goto out_free;
-	if (rc < 0) {
-		log_pcre2_error_nonl(rc, "  WARNING: regex replace error");
-		goto out_free;
-	}
-
-	*asm_text = (char*)buf;
-	patch = true;
-
-out_free:
-	pcre2_match_data_free(match_data);
-	delete [] buf;
-
-	return patch;
-}
-
-void ShaderRegexGroup::apply_regex_patterns(std::string *asm_text, bool *match, bool *patch)
-{
-	ShaderRegexPatterns::iterator i;
-	ShaderRegexPattern *pattern;
-	unsigned dcl_temps = 0;
-
-	// Match defaults to true so that if there are no patterns we can still
-	// apply the command list. Patch defaults to false because we don't
-	// want to waste time re-assembling the shader if we didn't change it.
-	*match = true;
-	*patch = false;
-
-	if (!temp_regs.empty())
-		dcl_temps = get_dcl_temps(asm_text);
-
-	for (i = patterns.begin(); i != patterns.end(); i++) {
-		pattern = &i->second;
-
-		if (pattern->do_replace)
-			*match = *patch = pattern->patch(asm_text, &temp_regs, dcl_temps);
-		else
-			*match = pattern->matches(asm_text);
-
-		if (!*match) {
-			*patch = false;
-			return;
-		}
-	}
-
-	// Only update dcl_temps if we are patching:
-	if (*patch && !temp_regs.empty())
-		*patch = update_dcl_temps(asm_text, dcl_temps + temp_regs.size());
-
-	// But we can update declarations even if we aren't doing a regex
-	// replace in some cases, so long as the patterns all matched (e.g.
-	// globally disable the driver stereo cb):
-	if (!declarations.empty())
-		*patch = insert_declarations(asm_text, &declarations) || *patch;
+	delete context;
 }
 
 void ShaderRegexGroup::link_command_lists_and_filter_index(UINT64 shader_hash)
@@ -368,6 +32,7 @@ void ShaderRegexGroup::link_command_lists_and_filter_index(UINT64 shader_hash)
 	ShaderOverride *shader_override = NULL;
 	wstring ini_section, ini_line;
 	CommandList::Commands::reverse_iterator i;
+	bool created;
 
 	// Only link the command lists if we have something in ours to link in,
 	// because this will create ShaderOverride sections for shaders that
@@ -376,6 +41,7 @@ void ShaderRegexGroup::link_command_lists_and_filter_index(UINT64 shader_hash)
 	if (command_list.commands.empty() && post_command_list.commands.empty() && filter_index == FLT_MAX)
 		return;
 
+	created = !G->mShaderOverrideMap.count(shader_hash);
 	shader_override = &G->mShaderOverrideMap[shader_hash];
 
 	// Initialise the ShaderOverride's command lists if they aren't already:
@@ -390,6 +56,10 @@ void ShaderRegexGroup::link_command_lists_and_filter_index(UINT64 shader_hash)
 	if (shader_override->filter_index == FLT_MAX)
 		shader_override->filter_index = filter_index;
 
+	// The draw calls won't find a new ShaderOverride until it's indexed:
+	if (created)
+		G->mShaderOverrideIndex.insert(shader_hash, shader_override);
+
 	// If we have previously linked a command list (on any matched shader)
 	// we will reuse the link command here, after checking that this
 	// matched shader has not already been linked. Avoids the command lists
@@ -401,8 +71,11 @@ void ShaderRegexGroup::link_command_lists_and_filter_index(UINT64 shader_hash)
 				return;
 		}
 		shader_override->command_list.commands.push_back(link);
-		if (post_link)
+		recompile_command_list(&shader_override->command_list);
+		if (post_link) {
 			shader_override->post_command_list.commands.push_back(post_link);
+			recompile_command_list(&shader_override->post_command_list);
+		}
 		return;
 	} else if (post_link) {
 		for (i = shader_override->post_command_list.commands.rbegin();
@@ -411,6 +84,7 @@ void ShaderRegexGroup::link_command_lists_and_filter_index(UINT64 shader_hash)
 				return;
 		}
 		shader_override->post_command_list.commands.push_back(post_link);
+		recompile_command_list(&shader_override->post_command_list);
 		return;
 	}
 
@@ -458,6 +132,11 @@ bool unlink_shader_regex_command_lists_and_filter_index(UINT64 shader_hash)
 		}
 	}
 
+	if (ret) {
+		recompile_command_list(&shader_override->command_list);
+		recompile_command_list(&shader_override->post_command_list);
+	}
+
 	if (shader_override->filter_index != shader_override->backup_filter_index) {
 		shader_override->filter_index = shader_override->backup_filter_index;
 		ret = true;
@@ -466,227 +145,492 @@ bool unlink_shader_regex_command_lists_and_filter_index(UINT64 shader_hash)
 	return ret;
 }
 
-#define SHADER_REGEX_CACHE_VERSION 1
+// Bump this if the layout of the cached blobs changes:
+#define SHADER_REGEX_CACHE_FORMAT 1
+
+// Blob flags:
+#define SHADER_REGEX_CACHE_PATCHED 0x1
+
+// Each blob is this header, the IDs of the matching groups, then the patched
+// bytecode if there is any:
 struct ShaderRegexCacheHeader {
-	uint32_t version;
 	uint32_t shader_regex_hash;
-	uint32_t patched;
 	uint32_t num_matches;
 };
 
-ShaderRegexCache load_shader_regex_cache(UINT64 hash, const wchar_t *shader_type, vector<byte> *bytecode, std::wstring *tagline)
+static MappedCache shader_regex_cache("3DMREGEX", SHADER_REGEX_CACHE_FORMAT);
+
+// Called after the ShaderRegex sections have been parsed, including on config
+// reload. The cache used to be a .dat and .bin file per shader in ShaderCache,
+// which meant opening tens of thousands of files on every launch.
+void configure_shader_regex_cache()
+{
+	if (!G->CACHE_SHADERS || !G->SHADER_CACHE_PATH[0] || shader_regex_groups.empty()) {
+		shader_regex_cache.close();
+		return;
+	}
+
+	shader_regex_cache.open(G->SHADER_CACHE_PATH, L"ShaderRegexCache");
+}
+
+static void shader_regex_cache_key(UINT64 hash, const wchar_t *shader_type, MappedCacheKey *key)
+{
+	size_t i;
+
+	// shader_regex_hash is deliberately not part of the key, but checked
+	// when loading instead. That way a shader cached under a previous
+	// hash is replaced when it is cached again rather than left taking up
+	// space forever, and compaction will reclaim the old blob:
+	key->hash = hash;
+	key->qualifier1 = 0;
+	key->qualifier2 = 0;
+	for (i = 0; i < 4 && shader_type[i]; i++)
+		key->qualifier1 |= (UINT64)(uint16_t)shader_type[i] << (i * 16);
+}
+
+// Only looks up the matching groups, since this is called from the workers -
+// linking their command lists is left to ShaderRegexJob::finish():
+static ShaderRegexCache load_shader_regex_cache(UINT64 hash, const wchar_t *shader_type,
+		vector<uint32_t> *match_ids, vector<byte> *bytecode, std::wstring *tagline)
 {
-	ShaderRegexCache ret = ShaderRegexCache::NO_CACHE;
-	HANDLE meta_f = INVALID_HANDLE_VALUE;
-	HANDLE bin_f = INVALID_HANDLE_VALUE;
 	ShaderRegexCacheHeader *header;
 	ShaderRegexGroup *group;
-	wchar_t path[MAX_PATH];
-	uint32_t *match_ids;
-	DWORD size, size2;
-	byte *buf = NULL;
-	size_t suffix;
+	std::vector<byte> blob;
+	MappedCacheKey key;
+	uint32_t *ids;
+	uint32_t flags;
+	size_t bytecode_offset;
 	uint32_t i;
 
-	suffix = swprintf_s(path, MAX_PATH, L"%ls\\%016llx-%ls_regex.", G->SHADER_CACHE_PATH, hash, shader_type);
-	wcscpy_s(path+suffix, MAX_PATH-suffix, L"dat");
-	meta_f = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-	if (meta_f == INVALID_HANDLE_VALUE)
-		return ret;
+	if (!shader_regex_cache.is_open())
+		return ShaderRegexCache::NO_CACHE;
+
+	shader_regex_cache_key(hash, shader_type, &key);
+	if (!shader_regex_cache.lookup(&key, &blob, &flags))
+		return ShaderRegexCache::NO_CACHE;
 
-	size = GetFileSize(meta_f, 0);
-	if (size < sizeof(ShaderRegexCacheHeader))
-		goto out;
+	if (blob.size() < sizeof(ShaderRegexCacheHeader))
+		return ShaderRegexCache::NO_CACHE;
 
-	buf = new byte[size];
+	header = (ShaderRegexCacheHeader*)blob.data();
+	ids = (uint32_t*)(blob.data() + sizeof(ShaderRegexCacheHeader));
 
-	if (!ReadFile(meta_f, buf, size, &size2, NULL) || size != size2)
-		goto out;
+	if (header->shader_regex_hash != shader_regex_hash)
+		return ShaderRegexCache::NO_CACHE;
 
-	header = (ShaderRegexCacheHeader*)buf;
-	match_ids = (uint32_t*)(buf + sizeof(ShaderRegexCacheHeader));
+	bytecode_offset = sizeof(ShaderRegexCacheHeader) + (size_t)header->num_matches * sizeof(uint32_t);
+	if (header->num_matches > blob.size() / sizeof(uint32_t) || bytecode_offset > blob.size())
+		return ShaderRegexCache::NO_CACHE;
 
-	if (header->version != SHADER_REGEX_CACHE_VERSION
-	 || header->shader_regex_hash != shader_regex_hash)
-		goto out;
+	// Patched entries are only saved once assembled, so one without any
+	// bytecode is not something we wrote:
+	if ((flags & SHADER_REGEX_CACHE_PATCHED) && bytecode_offset == blob.size())
+		return ShaderRegexCache::NO_CACHE;
 
-	if (size != sizeof(ShaderRegexCacheHeader) + header->num_matches * sizeof(uint32_t))
-		goto out;
+	for (i = 0; i < header->num_matches; i++) {
+		if (ids[i] >= shader_regex_group_index.size())
+			return ShaderRegexCache::NO_CACHE;
+	}
 
 	// num_matches may be 0, which means the ShaderRegex didn't match the
 	// shader, but we cache it anyway to skip processing the shader again.
 	// We don't really need any special handling for this case, since
 	// returning MATCH will already skip that handling in the caller, but
 	// we return a special value so the caller can log it appropriately.
-	if (header->num_matches == 0) {
-		ret = ShaderRegexCache::NO_MATCH;
-		goto out;
-	}
+	if (header->num_matches == 0)
+		return ShaderRegexCache::NO_MATCH;
 
 	for (i = 0; i < header->num_matches; i++) {
 		// The ShaderRegex groups are sorted and since the cached hash
 		// already matched the map should be identical to when the
 		// cache was made, so we can use that to find the matching
 		// groups without having to do an expensive lookup by name:
-		if (match_ids[i] >= shader_regex_group_index.size())
-			goto out;
-		group = shader_regex_group_index[match_ids[i]];
+		group = shader_regex_group_index[ids[i]];
 
 		LogInfo("ShaderRegexCache: %S %016I64x matches [%S]\n", shader_type, hash, group->ini_section.c_str());
 
-		if (header->patched && tagline)
+		if ((flags & SHADER_REGEX_CACHE_PATCHED) && tagline)
 			tagline->append(std::wstring(L"[") + group->ini_section + std::wstring(L"]"));
-
-		group->link_command_lists_and_filter_index(hash);
 	}
+	match_ids->assign(ids, ids + header->num_matches);
 
-	if (header->patched) {
-		wcscpy_s(path+suffix, MAX_PATH-suffix, L"bin");
-		bin_f = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-		if (bin_f == INVALID_HANDLE_VALUE)
-			goto out;
-		size = GetFileSize(bin_f, 0);
-		bytecode->resize(size);
-		if (!size || !ReadFile(bin_f, bytecode->data(), size, &size2, NULL) || size != size2)
-			goto out;
-		ret = ShaderRegexCache::PATCH;
-	} else
-		ret = ShaderRegexCache::MATCH;
-
-out:
-	if (buf)
-		delete [] buf;
-	if (bin_f != INVALID_HANDLE_VALUE)
-		CloseHandle(bin_f);
-	if (meta_f != INVALID_HANDLE_VALUE)
-		CloseHandle(meta_f);
-	return ret;
+	if (!(flags & SHADER_REGEX_CACHE_PATCHED))
+		return ShaderRegexCache::MATCH;
+
+	bytecode->assign(blob.begin() + bytecode_offset, blob.end());
+	return ShaderRegexCache::PATCH;
 }
 
-static void save_shader_regex_cache_meta(UINT64 hash, const wchar_t *shader_type, vector<uint32_t> *match_ids,
-		bool patched, std::string *asm_text, std::wstring *tagline)
+// Writes the whole entry in a single store, so a shader that is processed
+// twice at the same time just replaces one complete entry with another. The
+// bytecode is NULL if the ShaderRegex didn't patch the shader:
+static void save_shader_regex_cache(UINT64 hash, const wchar_t *shader_type,
+		vector<uint32_t> *match_ids, vector<byte> *bytecode)
 {
 	ShaderRegexCacheHeader header;
-	wchar_t path[MAX_PATH];
-	FILE *f = NULL;
-	size_t suffix;
+	MappedCacheKey key;
+	std::vector<byte> blob;
 
-	if (!G->SHADER_CACHE_PATH[0] || (!G->CACHE_SHADERS && !G->EXPORT_FIXED))
+	if (!shader_regex_cache.is_open())
 		return;
 
-	suffix = swprintf_s(path, MAX_PATH, L"%ls\\%016llx-%ls_regex.", G->SHADER_CACHE_PATH, hash, shader_type);
+	// TODO: When we have a condition field in ShaderRegex: The evaluations
+	// of *all* valid conditions (not just those matched) must qualify the
+	// cache, either by encoding them in the key or extending the
+	// metadata format.
+
+	header.shader_regex_hash = shader_regex_hash;
+	header.num_matches = (uint32_t)match_ids->size();
+	blob.insert(blob.end(), (byte*)&header, (byte*)(&header + 1));
+	blob.insert(blob.end(), (byte*)match_ids->data(), (byte*)(match_ids->data() + match_ids->size()));
+	if (bytecode)
+		blob.insert(blob.end(), bytecode->begin(), bytecode->end());
+
+	shader_regex_cache_key(hash, shader_type, &key);
+	shader_regex_cache.store(&key, blob.data(), (uint32_t)blob.size(),
+			bytecode ? SHADER_REGEX_CACHE_PATCHED : 0);
+}
 
-	if (G->CACHE_SHADERS) {
-		// TODO: When we have a condition field in ShaderRegex: The evaluations
-		// of *all* valid conditions (not just those matched) must qualify the
-		// cache, either by encoding them in the filename or extending the
-		// metadata format.
+static void export_shader_regex_asm(UINT64 hash, const wchar_t *shader_type,
+		bool patched, std::string *asm_text, std::wstring *tagline)
+{
+	wchar_t path[MAX_PATH];
+	FILE *f = NULL;
 
-		// Make sure there isn't an old stale .bin file *before* writing the
-		// new metadata to make sure it can't be loaded by mistake. If we can't
-		// remove it (e.g. another thread is currently reading it or permission
-		// issues) it's better not to update the cache at all:
-		wcscpy_s(path+suffix, MAX_PATH-suffix, L"bin");
-		if (!DeleteFile(path) && GetLastError() != ERROR_FILE_NOT_FOUND)
-			return;
+	if (!G->EXPORT_FIXED || !G->SHADER_CACHE_PATH[0])
+		return;
 
-		wcscpy_s(path+suffix, MAX_PATH-suffix, L"dat");
+	swprintf_s(path, MAX_PATH, L"%ls\\%016llx-%ls_regex.txt", G->SHADER_CACHE_PATH, hash, shader_type);
+	if (patched) {
 		wfopen_ensuring_access(&f, path, L"wb");
-		if (!f)
+		if (!f) {
+			LogInfo("  Error storing ShaderRegex assembly to %S\n", path);
 			return;
+		}
 
-		header.version = SHADER_REGEX_CACHE_VERSION;
-		header.shader_regex_hash = shader_regex_hash;
-		header.patched = patched;
-		header.num_matches = (uint32_t)match_ids->size();
-		fwrite(&header, 1, sizeof(ShaderRegexCacheHeader), f);
-		fwrite(match_ids->data(), sizeof(uint32_t), match_ids->size(), f);
+		fprintf_s(f, "%S\n", tagline->c_str());
+		fwrite(asm_text->c_str(), 1, asm_text->size(), f);
 
 		fclose(f);
+		LogInfo("  Storing ShaderRegex assembly to %S\n", path);
+	} else {
+		if (DeleteFile(path))
+			LogInfo("  Removed stale ShaderRegex assembly file %S\n", path);
 	}
+}
 
-	if (G->EXPORT_FIXED) {
-		wcscpy_s(path+suffix, MAX_PATH-suffix, L"txt");
-		if (patched) {
-			wfopen_ensuring_access(&f, path, L"wb");
-			if (!f) {
-				LogInfo("  Error storing ShaderRegex assembly to %S\n", path);
-				return;
-			}
+static void log_shader_regex_matches(UINT64 hash, std::string *shader_model,
+		std::vector<uint32_t> *match_ids, std::vector<uint32_t> *patch_ids, std::wstring *tagline)
+{
+	for (uint32_t id : *match_ids) {
+		LogInfo("ShaderRegex: %s %016I64x matches [%S]\n", shader_model->c_str(), hash,
+				shader_regex_group_index[id]->ini_section.c_str());
+	}
+
+	if (!tagline)
+		return;
+
+	for (uint32_t id : *patch_ids)
+		tagline->append(std::wstring(L"[") + shader_regex_group_index[id]->ini_section + std::wstring(L"]"));
+}
+
+// Used by hunting to reapply ShaderRegex to a shader on the render thread
+bool apply_shader_regex_groups(std::string *asm_text, const wchar_t *shader_type, std::string *shader_model, UINT64 hash, std::wstring *tagline)
+{
+	vector<uint32_t> match_ids, patch_ids;
+	bool patched;
+
+	patched = shader_regex_rules.apply(asm_text, shader_model, get_shader_regex_match_context(), &match_ids, &patch_ids);
+	log_shader_regex_matches(hash, shader_model, &match_ids, &patch_ids, tagline);
+
+	for (uint32_t id : match_ids)
+		shader_regex_group_index[id]->link_command_lists_and_filter_index(hash);
+
+	// The cache is left alone here, since the worker that first processed
+	// this shader has already saved a complete entry for it, and we
+	// don't assemble the result to complete a new one:
+	export_shader_regex_asm(hash, shader_type, patched, asm_text, tagline);
+
+	return patched;
+}
+
+ShaderRegexJob::ShaderRegexJob(UINT64 hash, const wchar_t *shader_type, const std::string *shader_model, ID3DBlob *bytecode) :
+	hash(hash),
+	shader_type(shader_type),
+	shader_model(*shader_model),
+	bytecode(bytecode),
+	state((LONG)ShaderRegexJobState::QUEUED),
+	result(ShaderRegexCache::NO_CACHE),
+	tagline(L"//")
+{
+	bytecode->AddRef();
+}
+
+ShaderRegexJob::~ShaderRegexJob()
+{
+	bytecode->Release();
+}
+
+void ShaderRegexJob::run()
+{
+	vector<AssemblerParseError> errors;
+	vector<uint32_t> patch_ids;
+	vector<char> asm_vector;
+	string asm_text;
+	bool patched = false;
+	HRESULT hr;
+
+	result = ShaderRegexCache::NO_MATCH;
+
+	// Cheaper than even checking the cache, since this doesn't touch the
+	// disk, and saves disassembling shaders no ShaderRegex applies to:
+	if (!shader_regex_rules.may_match(bytecode->GetBufferPointer(), bytecode->GetBufferSize(), &shader_model)) {
+		LogDebug("%S %016I64x skipped, no ShaderRegex for %s\n", shader_type.c_str(), hash, shader_model.c_str());
+		return;
+	}
+
+	result = load_shader_regex_cache(hash, shader_type.c_str(), &match_ids, &patched_bytecode, &tagline);
+	switch (result) {
+	case ShaderRegexCache::NO_MATCH:
+		LogInfo("%S %016I64x has cached ShaderRegex miss\n", shader_type.c_str(), hash);
+		return;
+	case ShaderRegexCache::MATCH:
+		LogInfo("Loaded %S %016I64x command list from ShaderRegex cache\n", shader_type.c_str(), hash);
+		return;
+	case ShaderRegexCache::PATCH:
+		LogInfo("Loaded %S %016I64x bytecode from ShaderRegex cache\n", shader_type.c_str(), hash);
+		return;
+	case ShaderRegexCache::NO_CACHE:
+		break;
+	}
+
+	LogInfo("Performing deferred shader analysis on %S %016I64x...\n", shader_type.c_str(), hash);
+	result = ShaderRegexCache::NO_MATCH;
+
+	asm_text = BinaryToAsmText(bytecode->GetBufferPointer(), bytecode->GetBufferSize(),
+			G->patch_cb_offsets, G->disassemble_undecipherable_custom_data);
+	if (asm_text.empty())
+		return;
+
+	try {
+		patched = shader_regex_rules.apply(&asm_text, &shader_model, get_shader_regex_match_context(), &match_ids, &patch_ids);
+	} catch (...) {
+		LogInfo("    *** Exception while patching shader\n");
+		match_ids.clear();
+		return;
+	}
+
+	log_shader_regex_matches(hash, &shader_model, &match_ids, &patch_ids, &tagline);
+	export_shader_regex_asm(hash, shader_type.c_str(), patched, &asm_text, &tagline);
 
-			fprintf_s(f, "%S\n", tagline->c_str());
-			fwrite(asm_text->c_str(), 1, asm_text->size(), f);
+	if (!match_ids.empty())
+		result = ShaderRegexCache::MATCH;
 
-			fclose(f);
-			LogInfo("  Storing ShaderRegex assembly to %S\n", path);
-		} else {
-			if (DeleteFile(path))
-				LogInfo("  Removed stale ShaderRegex assembly file %S\n", path);
+	if (!patched) {
+		// We cache the result even if we didn't match anything. That
+		// way we can skip checking for a match next time when we know
+		// there won't be any:
+		save_shader_regex_cache(hash, shader_type.c_str(), &match_ids, NULL);
+		LogInfo("Patch did not apply\n");
+		return;
+	}
+
+	asm_vector.assign(asm_text.begin(), asm_text.end());
+
+	try {
+		hr = AssembleFluganWithSignatureParsing(&asm_vector, &patched_bytecode, &errors);
+		if (FAILED(hr)) {
+			LogInfo("    *** Assembling patched shader failed\n");
+			patched_bytecode.clear();
+			return;
 		}
+		// Parse errors are currently being treated as non-fatal on
+		// creation time replacement and ShaderRegex for backwards
+		// compatibility (live shader reload is fatal). They are
+		// reported in finish(), since the overlay is not ours to
+		// touch from here:
+		for (auto &parse_error : errors)
+			parse_errors.push_back(parse_error.what());
+	} catch (const exception &e) {
+		assembler_error = e.what();
+		patched_bytecode.clear();
+		return;
 	}
+
+	// Nothing is cached if assembling failed, so we try again next time:
+	save_shader_regex_cache(hash, shader_type.c_str(), &match_ids, &patched_bytecode);
+	result = ShaderRegexCache::PATCH;
 }
 
-void save_shader_regex_cache_bin(UINT64 hash, const wchar_t *shader_type, vector<byte> *bytecode)
+bool ShaderRegexJob::finish()
 {
-	wchar_t path[MAX_PATH];
-	FILE *f = NULL;
+	for (uint32_t id : match_ids) {
+		// Jobs are requeued on config reload, so this is only a
+		// safety net in case one slipped through from before:
+		if (id < shader_regex_group_index.size())
+			shader_regex_group_index[id]->link_command_lists_and_filter_index(hash);
+	}
 
-	if (!G->CACHE_SHADERS || !G->SHADER_CACHE_PATH[0])
-		return;
+	for (std::string &parse_error : parse_errors)
+		LogOverlay(LOG_NOTICE, "%016I64x-%S %S: %s\n",
+				hash, shader_type.c_str(), tagline.c_str(), parse_error.c_str());
+
+	if (!assembler_error.empty())
+		LogOverlay(LOG_WARNING, "Error assembling ShaderRegex patched %016I64x-%S\n%S\n%s\n",
+				hash, shader_type.c_str(), tagline.c_str(), assembler_error.c_str());
 
-	swprintf_s(path, MAX_PATH, L"%ls\\%016llx-%ls_regex.bin", G->SHADER_CACHE_PATH, hash, shader_type);
+	return result == ShaderRegexCache::PATCH;
+}
+
+// Called with G->mCriticalSection held whenever a shader becomes a candidate
+// for ShaderRegex, so that it has hopefully been processed by the time it is
+// first drawn:
+void queue_shader_regex_job(OriginalShaderInfo *info)
+{
+	info->regex_job.reset();
 
-	wfopen_ensuring_access(&f, path, L"wb");
-	if (!f)
+	if (shader_regex_groups.empty() || G->shader_regex_threads <= 0 || !info->deferred_replacement_candidate)
 		return;
-	fwrite(bytecode->data(), 1, bytecode->size(), f);
-	fclose(f);
+
+	info->regex_job = std::make_shared<ShaderRegexJob>(info->hash, info->shaderType.c_str(), &info->shaderModel, info->byteCode);
+	shader_regex_workers.submit(info->regex_job);
 }
 
-bool apply_shader_regex_groups(std::string *asm_text, const wchar_t *shader_type, std::string *shader_model, UINT64 hash, std::wstring *tagline)
+ShaderRegexWorkers::ShaderRegexWorkers() :
+	pool(NULL),
+	pool_threads(0),
+	running_jobs(0),
+	paused(false)
 {
-	ShaderRegexGroups::iterator i;
-	ShaderRegexGroup *group;
-	bool patched = false;
-	bool match, patch;
-	vector<uint32_t> match_ids;
-	uint32_t j;
-
-	if (*shader_model == std::string("bin")) {
-		// This will update the data structure, because we may as well
-		// - it will save effort if we have to redo this again later.
-		if (!get_shader_model(asm_text, shader_model))
+}
+
+void ShaderRegexWorkers::init()
+{
+	InitializeCriticalSectionPretty(&lock);
+	InitializeConditionVariable(&cond);
+}
+
+static void CALLBACK shader_regex_callback(PTP_CALLBACK_INSTANCE instance, void *context)
+{
+	std::shared_ptr<ShaderRegexJob> *job = (std::shared_ptr<ShaderRegexJob>*)context;
+
+	shader_regex_workers.run_job(job->get());
+	delete job;
+}
+
+bool ShaderRegexWorkers::start_pool_locked()
+{
+	int threads = G->shader_regex_threads;
+
+	if (threads <= 0 || pool_threads < 0)
+		return false;
+
+	if (!pool) {
+		pool = CreateThreadpool(NULL);
+		if (!pool) {
+			LogInfo("ShaderRegex: Unable to create thread pool, processing shaders when first drawn: %u\n", GetLastError());
+			pool_threads = -1;
 			return false;
+		}
+		InitializeThreadpoolEnvironment(&env);
+		SetThreadpoolCallbackPool(&env, pool);
+		// Keeps us loaded until any callbacks still running are done:
+		SetThreadpoolCallbackLibrary(&env, migoto_handle);
 	}
 
-	for (i = shader_regex_groups.begin(), j = 0; i != shader_regex_groups.end(); i++, j++) {
-		group = &i->second;
+	// May have been changed by a config reload:
+	if (threads != pool_threads) {
+		SetThreadpoolThreadMaximum(pool, threads);
+		pool_threads = threads;
+	}
 
-		// FIXME: Don't even disassemble if the shader model isn't in
-		// any of the regex groups and we aren't applying any other
-		// forms of deferred patches
-		if (!group->shader_models.count(*shader_model))
-			continue;
+	return true;
+}
 
-		group->apply_regex_patterns(asm_text, &match, &patch);
-		if (!match)
-			continue;
+bool ShaderRegexWorkers::submit(std::shared_ptr<ShaderRegexJob> job)
+{
+	std::shared_ptr<ShaderRegexJob> *context;
+	bool queued = false;
+
+	EnterCriticalSectionPretty(&lock);
+
+	if (start_pool_locked()) {
+		// The callback holds its own reference, since the shader (and
+		// with it the job) may be released before a worker gets to it:
+		context = new std::shared_ptr<ShaderRegexJob>(job);
+		queued = !!TrySubmitThreadpoolCallback(shader_regex_callback, context, &env);
+		if (!queued)
+			delete context;
+	}
 
-		LogInfo("ShaderRegex: %s %016I64x matches [%S]\n", shader_model->c_str(), hash, group->ini_section.c_str());
-		patched = patched || patch;
-		match_ids.push_back(j);
+	LeaveCriticalSection(&lock);
 
-		if (patch && tagline)
-			tagline->append(std::wstring(L"[") + group->ini_section + std::wstring(L"]"));
+	return queued;
+}
 
-		group->link_command_lists_and_filter_index(hash);
+// Whoever gets to a queued job first runs it - a worker, or a render thread
+// that needs it before any worker has picked it up:
+static bool claim_job(ShaderRegexJob *job)
+{
+	return InterlockedCompareExchange(&job->state, (LONG)ShaderRegexJobState::RUNNING,
+			(LONG)ShaderRegexJobState::QUEUED) == (LONG)ShaderRegexJobState::QUEUED;
+}
+
+void ShaderRegexWorkers::run_job(ShaderRegexJob *job)
+{
+	EnterCriticalSectionPretty(&lock);
+
+	while (paused)
+		SleepConditionVariableCS(&cond, &lock, INFINITE);
+
+	if (!claim_job(job)) {
+		LeaveCriticalSection(&lock);
+		return;
 	}
+	running_jobs++;
 
-	// We save the cache metadata even if we didn't match anything. That
-	// way we can skip checking for a match next time when we know there
-	// won't be any. This only saves the metadata - the caller will use
-	// save_shader_regex_cache_bin to save the assembled binary.
-	save_shader_regex_cache_meta(hash, shader_type, &match_ids, patched, asm_text, tagline);
+	LeaveCriticalSection(&lock);
 
-	return patched;
+	job->run();
+
+	EnterCriticalSectionPretty(&lock);
+	running_jobs--;
+	job->state = (LONG)ShaderRegexJobState::DONE;
+	LeaveCriticalSection(&lock);
+
+	WakeAllConditionVariable(&cond);
+}
+
+void ShaderRegexWorkers::wait(ShaderRegexJob *job)
+{
+	// Config reload pauses the workers with G->mCriticalSection held,
+	// which our callers also hold, so we never run a job while paused:
+	if (claim_job(job)) {
+		job->run();
+		job->state = (LONG)ShaderRegexJobState::DONE;
+		return;
+	}
+
+	EnterCriticalSectionPretty(&lock);
+	while (job->state != (LONG)ShaderRegexJobState::DONE)
+		SleepConditionVariableCS(&cond, &lock, INFINITE);
+	LeaveCriticalSection(&lock);
+}
+
+void ShaderRegexWorkers::pause()
+{
+	EnterCriticalSectionPretty(&lock);
+	paused = true;
+	while (running_jobs)
+		SleepConditionVariableCS(&cond, &lock, INFINITE);
+	LeaveCriticalSection(&lock);
+}
+
+void ShaderRegexWorkers::resume()
+{
+	EnterCriticalSectionPretty(&lock);
+	paused = false;
+	LeaveCriticalSection(&lock);
+
+	WakeAllConditionVariable(&cond);
 }
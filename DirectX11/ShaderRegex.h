@@ -1,14 +1,13 @@
 #pragma once
 
 #include "CommandList.h"
+#include "ShaderRegexRules.h"
 
 #include <map>
-#include <set>
+#include <memory>
 #include <string>
 #include <vector>
 
-#include <pcre2.h>
-
 enum class ShaderRegexCache {
 	NO_CACHE,
 	NO_MATCH,
@@ -17,49 +16,16 @@ enum class ShaderRegexCache {
 };
 
 bool apply_shader_regex_groups(std::string *asm_text, const wchar_t *shader_type, std::string *shader_model, UINT64 hash, std::wstring *tagline);
-ShaderRegexCache load_shader_regex_cache(UINT64 hash, const wchar_t *shader_type, vector<byte> *bytecode, std::wstring *tagline);
-void save_shader_regex_cache_bin(UINT64 hash, const wchar_t *shader_type, vector<byte> *bytecode);
+void configure_shader_regex_cache();
 bool unlink_shader_regex_command_lists_and_filter_index(UINT64 shader_hash);
 
-typedef std::set<std::string> ShaderRegexTemps;
-typedef std::set<std::string> ShaderRegexModels;
-
-class ShaderRegexPattern {
-public:
-	pcre2_code *regex;
-	std::string replace;
-
-	bool do_replace;
-
-	// These will be used later when we implement our own advanced
-	// substitution to allow matches to be used between multiple patterns
-	// in the one regex group, and to apply some (very) simple arithmetic
-	// to convert byte offsets to constant buffer indexes and vice versa
-	std::set<std::string> named_capture_groups;
-
-	ShaderRegexPattern();
-	~ShaderRegexPattern();
-
-	bool compile(std::string *pattern);
-	bool named_group_overlaps(ShaderRegexTemps &other_set);
-	bool matches(std::string *asm_text);
-	bool patch(std::string *asm_text, ShaderRegexTemps *temp_regs, unsigned dcl_temps);
-};
-
-// These are sorted to make sure we get consistent results between runs
-// in case the user does something that winds up depending on the order:
-typedef std::map<std::wstring, ShaderRegexPattern> ShaderRegexPatterns;
-typedef std::vector<std::string> ShaderRegexDeclarations;
+struct OriginalShaderInfo;
+void queue_shader_regex_job(OriginalShaderInfo *info);
 
-class ShaderRegexGroup {
+class ShaderRegexGroup : public ShaderRegexRules {
 public:
 	std::wstring ini_section;
 
-	ShaderRegexPatterns patterns;
-
-	ShaderRegexDeclarations declarations;
-	ShaderRegexModels shader_models;
-	ShaderRegexTemps temp_regs;
 	float filter_index;
 
 	CommandList command_list;
@@ -67,7 +33,6 @@ public:
 	std::shared_ptr<RunLinkedCommandList> link;
 	std::shared_ptr<RunLinkedCommandList> post_link;
 
-	void apply_regex_patterns(std::string *asm_text, bool *match, bool *patch);
 	void link_command_lists_and_filter_index(UINT64 shader_hash);
 
 	ShaderRegexGroup() :
@@ -81,6 +46,98 @@ typedef std::map<std::wstring, ShaderRegexGroup> ShaderRegexGroups;
 extern ShaderRegexGroups shader_regex_groups;
 extern std::vector<ShaderRegexGroup*> shader_regex_group_index;
 
+// The rules of every group in shader_regex_groups, in the same order as
+// shader_regex_group_index:
+extern ShaderRegexRuleSet shader_regex_rules;
+
 // This hash is of all ShaderRegex sections and is used to determine if a
 // cached shader is still valid and to avoid discarding regex patched shaders:
 extern uint32_t shader_regex_hash;
+
+// ShaderRegex used to run on the render thread the first time each shader was
+// drawn, disassembling, patching and reassembling it while holding
+// G->mCriticalSection, so a game streaming in a few hundred shaders at once
+// would hitch, and every other thread after the lock would stall with it.
+// Shaders are now queued as jobs on a private thread pool as they are created
+// (shader_regex_threads in the d3dx.ini), and by the time one is drawn the
+// render thread only has to link its command lists and create the patched
+// shader. A job only touches its own state, the ShaderRegex rules and the
+// cache, and the rules are only changed on config reload with the workers
+// paused, so the result is the same whichever thread runs it and in whatever
+// order. A job that hasn't started by the time it is needed is run inline
+// rather than waited on.
+//
+// With shader_regex_threads = 0 nothing is queued and each shader is
+// processed inline when it is first drawn, which is the old behaviour.
+
+enum class ShaderRegexJobState {
+	QUEUED,
+	RUNNING,
+	DONE,
+};
+
+class ShaderRegexJob {
+public:
+	ShaderRegexJob(UINT64 hash, const wchar_t *shader_type, const std::string *shader_model, ID3DBlob *bytecode);
+	~ShaderRegexJob();
+
+	// Called on a worker, or inline from ShaderRegexWorkers::wait()
+	void run();
+
+	// Called once the job is done, with G->mCriticalSection held, to link
+	// the command lists of the groups that matched and report any problems
+	// assembling the patched shader. Returns true if patched_bytecode
+	// holds the replacement shader:
+	bool finish();
+
+	UINT64 hash;
+	std::wstring shader_type;
+	std::string shader_model; // Filled in by run() if it was "bin"
+	ID3DBlob *bytecode;
+
+	volatile LONG state; // ShaderRegexJobState
+
+	ShaderRegexCache result;
+	std::vector<uint32_t> match_ids;
+	std::wstring tagline; // Patched groups, for the OSD and _regex.txt
+	std::vector<byte> patched_bytecode;
+	std::vector<std::string> parse_errors;
+	std::string assembler_error;
+};
+
+class ShaderRegexWorkers {
+public:
+	ShaderRegexWorkers();
+
+	void init();
+
+	// Returns false if the job could not be queued, in which case it will
+	// be run by whoever waits for it:
+	bool submit(std::shared_ptr<ShaderRegexJob> job);
+
+	// Blocks until the job is done, running it on this thread if no
+	// worker has picked it up yet:
+	void wait(ShaderRegexJob *job);
+
+	// Used around config reload - waits for any running jobs to finish and
+	// holds off starting any more until resumed:
+	void pause();
+	void resume();
+
+	// From the thread pool callback:
+	void run_job(ShaderRegexJob *job);
+
+private:
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE cond; // Job done or workers resumed
+
+	PTP_POOL pool;
+	TP_CALLBACK_ENVIRON env;
+	int pool_threads;
+
+	unsigned running_jobs;
+	bool paused;
+
+	bool start_pool_locked();
+};
+extern ShaderRegexWorkers shader_regex_workers;
@@ -0,0 +1,905 @@
+#include "ShaderRegexRules.h"
+
+#include <windows.h>
+#include <stdio.h>
+#include <algorithm>
+#include <iterator>
+
+#include "log.h"
+
+// Literals shorter than this are found in practically every shader, so they
+// would only slow the prefilter down without rejecting anything:
+#define SHADER_REGEX_MIN_LITERAL 3
+
+static void log_pcre2_error_nonl(int err, char *fmt, ...)
+{
+	PCRE2_UCHAR buf[120]; // doco says "120 code units is ample"
+	va_list ap;
+
+	pcre2_get_error_message(err, buf, sizeof(buf));
+
+	va_start(ap, fmt);
+	vLogInfo(fmt, ap);
+	va_end(ap);
+
+	LogInfo(": %s\n", buf);
+}
+
+// Reads the shader model from the version token of the SHDR/SHEX chunk, which
+// is a lot cheaper than disassembling the shader to find it. Returns false for
+// anything we aren't sure the disassembler would describe the same way:
+bool get_bytecode_shader_model(const void *bytecode, size_t bytecode_len, std::string *shader_model)
+{
+	static const char *program_types[] = {"ps", "vs", "gs", "hs", "ds", "cs"};
+	const uint8_t *buf = (const uint8_t*)bytecode;
+	uint32_t num_chunks, offset, version, type;
+	bool found = false;
+	char model[16];
+	uint32_t i;
+
+	if (bytecode_len < 32 || memcmp(buf, "DXBC", 4))
+		return false;
+
+	memcpy(&num_chunks, buf + 28, 4);
+	if (num_chunks > (bytecode_len - 32) / 4)
+		return false;
+
+	for (i = 0; i < num_chunks; i++) {
+		memcpy(&offset, buf + 32 + i * 4, 4);
+		if (offset > bytecode_len - 12)
+			return false;
+
+		// Feature level 9 shaders disassemble as e.g. vs_4_0_level_9_1
+		if (!memcmp(buf + offset, "Aon9", 4))
+			return false;
+
+		if (!memcmp(buf + offset, "SHDR", 4) || !memcmp(buf + offset, "SHEX", 4)) {
+			memcpy(&version, buf + offset + 8, 4);
+			found = true;
+		}
+	}
+
+	if (!found)
+		return false;
+
+	type = version >> 16;
+	if (type >= ARRAYSIZE(program_types))
+		return false;
+
+	sprintf_s(model, ARRAYSIZE(model), "%s_%u_%u", program_types[type], (version >> 4) & 0xf, version & 0xf);
+	*shader_model = model;
+	return true;
+}
+
+bool get_asm_shader_model(std::string *asm_text, std::string *shader_model)
+{
+	size_t shader_model_pos;
+
+	for (
+		shader_model_pos = asm_text->find("\n");
+		shader_model_pos != std::string::npos && (*asm_text)[shader_model_pos + 1] == '/';
+		shader_model_pos = asm_text->find("\n", shader_model_pos + 1)
+	) {}
+
+	if (shader_model_pos == std::string::npos)
+		return false;
+
+	*shader_model = asm_text->substr(shader_model_pos + 1, asm_text->find("\n", shader_model_pos + 1) - shader_model_pos - 1);
+	return true;
+}
+
+static bool find_dcl_end(std::string *asm_text, size_t *dcl_end_pos)
+{
+	// FIXME: Might be better to scan forwards
+
+	*dcl_end_pos = asm_text->rfind("\ndcl_");
+	*dcl_end_pos = asm_text->find("\n", *dcl_end_pos + 1);
+
+	if (*dcl_end_pos == std::string::npos) {
+		LogInfo("WARNING: Unable to locate end of shader declarations!\n");
+		return false;
+	}
+
+	return true;
+}
+
+static bool insert_declarations(std::string *asm_text, ShaderRegexDeclarations *declarations)
+{
+	ShaderRegexDeclarations::iterator i;
+	std::string insert_str;
+	size_t dcl_end;
+	bool patch = false;
+
+	if (!find_dcl_end(asm_text, &dcl_end))
+		return false;
+
+	for (i = declarations->begin(); i != declarations->end(); i++) {
+		insert_str = std::string("\n") + *i;
+
+		if (asm_text->find(insert_str + std::string("\n")) != std::string::npos)
+			continue;
+
+		asm_text->insert(dcl_end, insert_str);
+		dcl_end += insert_str.size();
+
+		patch = true;
+	}
+
+	return patch;
+}
+
+static bool find_dcl_temps(std::string *asm_text, size_t *dcl_temps_pos)
+{
+	// Could use regex for this as well, but given we only need to find a
+	// constant string it will be more efficient to just do this:
+	*dcl_temps_pos = asm_text->find("\ndcl_temps ", 0);
+
+	if (*dcl_temps_pos == std::string::npos)
+		return false;
+
+	return true;
+}
+
+static unsigned get_dcl_temps(std::string *asm_text)
+{
+	size_t dcl_temps;
+	unsigned tmp_regs = 0;
+
+	if (!find_dcl_temps(asm_text, &dcl_temps))
+		return 0;
+
+	tmp_regs = stoul(asm_text->substr(dcl_temps + 10, 4));
+	LogInfo("Found dcl_temps %d\n", tmp_regs);
+
+	return tmp_regs;
+}
+
+static bool update_dcl_temps(std::string *asm_text, size_t new_val)
+{
+	size_t dcl_temps, dcl_temps_end, dcl_end;
+	std::string insert_str;
+
+	if (find_dcl_temps(asm_text, &dcl_temps)) {
+		dcl_temps += 11;
+		dcl_temps_end = asm_text->find("\n", dcl_temps);
+		LogInfo("Updating dcl_temps %Iu\n", new_val);
+		asm_text->replace(dcl_temps, dcl_temps_end - dcl_temps, std::to_string(new_val));
+		return true;
+	}
+
+	if (!find_dcl_end(asm_text, &dcl_end))
+		return false;
+
+	insert_str = std::string("\ndcl_temps ") + std::to_string(new_val);
+	LogInfo("Inserting dcl_temps %Iu\n", new_val);
+	asm_text->insert(dcl_end, insert_str);
+	dcl_end += insert_str.size();
+
+	return true;
+}
+
+ShaderRegexMatchContext::ShaderRegexMatchContext() :
+	match_data(NULL),
+	match_data_pairs(0)
+{
+	mcontext = pcre2_match_context_create(NULL);
+
+	// The default 32K JIT stack on the machine stack is not a lot for the
+	// patterns people write to match entire blocks of assembly:
+	jit_stack = pcre2_jit_stack_create(32 * 1024, 1024 * 1024, NULL);
+	if (mcontext && jit_stack)
+		pcre2_jit_stack_assign(mcontext, NULL, jit_stack);
+}
+
+ShaderRegexMatchContext::~ShaderRegexMatchContext()
+{
+	pcre2_match_data_free(match_data);
+	pcre2_jit_stack_free(jit_stack);
+	pcre2_match_context_free(mcontext);
+}
+
+pcre2_match_data* ShaderRegexMatchContext::get_match_data(uint32_t capture_count)
+{
+	// Shared between every pattern, so sized for the one with the most
+	// capture groups we have seen so far:
+	if (capture_count + 1 > match_data_pairs) {
+		pcre2_match_data_free(match_data);
+		match_data = pcre2_match_data_create(capture_count + 1, NULL);
+		match_data_pairs = match_data ? capture_count + 1 : 0;
+	}
+
+	return match_data;
+}
+
+// Works out which literal substrings any text matching a pattern must contain.
+// This only has to be conservative, not complete - we stop at anything that
+// could mean a substring is not required (top level alternation, optional
+// quantifiers) and skip over groups, classes and anything else that isn't a
+// plain character, so we miss some literals but never report one that is not
+// actually required. Where the syntax gets too exotic we give up on the entire
+// pattern, which just means its group always has to run the regex.
+
+static bool parse_quantifier(std::string *pattern, size_t *pos, unsigned *min_repeats)
+{
+	size_t i = *pos;
+	size_t len = pattern->length();
+
+	if (i >= len)
+		return false;
+
+	switch ((*pattern)[i]) {
+		case '*':
+		case '?':
+			*min_repeats = 0;
+			i++;
+			break;
+		case '+':
+			*min_repeats = 1;
+			i++;
+			break;
+		case '{':
+			// {n}, {n,}, {n,m} and {,m}. Anything else is a literal
+			// brace, which we treat as not being a literal anyway:
+			*min_repeats = 0;
+			for (i++; i < len && isdigit((unsigned char)(*pattern)[i]); i++)
+				*min_repeats = min(*min_repeats * 10 + ((*pattern)[i] - '0'), 1000u);
+			for (; i < len && (*pattern)[i] != '}'; i++) {
+				if (!isdigit((unsigned char)(*pattern)[i]) && !strchr(", ", (*pattern)[i]))
+					return false;
+			}
+			if (i == len)
+				return false;
+			i++;
+			break;
+		default:
+			return false;
+	}
+
+	// Lazy and possessive modifiers:
+	if (i < len && ((*pattern)[i] == '?' || (*pattern)[i] == '+'))
+		i++;
+
+	*pos = i;
+	return true;
+}
+
+static void skip_character_class(std::string *pattern, size_t *pos)
+{
+	size_t i = *pos + 1;
+	size_t len = pattern->length();
+
+	if (i < len && (*pattern)[i] == '^')
+		i++;
+	if (i < len && (*pattern)[i] == ']')
+		i++;
+
+	while (i < len && (*pattern)[i] != ']') {
+		if ((*pattern)[i] == '\\')
+			i += 2;
+		else if ((*pattern)[i] == '[' && i + 1 < len && strchr(":.=", (*pattern)[i + 1]))
+			i = min(pattern->find(":]", i + 2), len - 1) + 2;
+		else
+			i++;
+	}
+
+	*pos = min(i + 1, len);
+}
+
+static bool skip_group(std::string *pattern, size_t *pos)
+{
+	size_t i = *pos + 1;
+	size_t len = pattern->length();
+	unsigned depth = 1;
+
+	// (*VERB) and (?i) style option settings can change how the rest of
+	// the pattern is interpreted, so we don't try to understand them:
+	if (i < len && (*pattern)[i] == '*')
+		return false;
+	if (i < len && (*pattern)[i] == '?') {
+		for (i++; i < len && (isalpha((unsigned char)(*pattern)[i]) || strchr("-^", (*pattern)[i])); i++) {}
+		if (i < len && (*pattern)[i] == ')')
+			return false;
+		i = *pos + 1;
+	}
+
+	while (i < len && depth) {
+		switch ((*pattern)[i]) {
+			case '\\':
+				i += 2;
+				continue;
+			case '[':
+				skip_character_class(pattern, &i);
+				continue;
+			case '(':
+				depth++;
+				break;
+			case ')':
+				depth--;
+				break;
+		}
+		i++;
+	}
+
+	if (depth)
+		return false;
+
+	*pos = i;
+	return true;
+}
+
+// Returns the character matched by an escape sequence, -1 if it does not
+// match a single literal character, or -2 if we should give up:
+static int parse_escape(std::string *pattern, size_t *pos)
+{
+	size_t i = *pos + 1;
+	unsigned char c;
+
+	if (i >= pattern->length())
+		return -2;
+
+	c = (*pattern)[i];
+	*pos = i + 1;
+
+	if (c >= 0x80)
+		return -1;
+	if (!isalnum(c))
+		return c;
+
+	switch (c) {
+		case 'n': return '\n';
+		case 't': return '\t';
+		case 'r': return '\r';
+		case 'f': return '\f';
+		case 'a': return '\a';
+		case 'e': return '\x1b';
+
+		// These take arguments of varying forms, or (\Q) change how
+		// the following characters are interpreted:
+		case 'Q': case 'x': case 'o': case 'c': case 'p': case 'P':
+		case 'g': case 'k': case 'N':
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+			return -2;
+	}
+
+	// \d, \s, \w, \b, etc:
+	return -1;
+}
+
+static void extract_required_literals(std::string *pattern, std::vector<std::string> *literals)
+{
+	std::vector<std::string> found;
+	std::string run;
+	size_t i = 0, len = pattern->length();
+	unsigned min_repeats;
+	bool quantified;
+	int c;
+
+	while (i < len) {
+		c = -1;
+
+		switch ((*pattern)[i]) {
+			case '|':
+				// Top level alternation - nothing is required
+				return;
+			case '(':
+				if (!skip_group(pattern, &i))
+					return;
+				break;
+			case '[':
+				skip_character_class(pattern, &i);
+				break;
+			case '\\':
+				c = parse_escape(pattern, &i);
+				if (c == -2)
+					return;
+				break;
+			case '.': case '^': case '$': case ')':
+			case '*': case '+': case '?': case '{':
+				i++;
+				break;
+			default:
+				c = (unsigned char)(*pattern)[i++];
+				if (c >= 0x80)
+					c = -1;
+		}
+
+		quantified = parse_quantifier(pattern, &i, &min_repeats);
+
+		if (c != -1 && !(quantified && min_repeats == 0))
+			run.push_back((char)tolower(c));
+
+		// A repeated character still has to be there, but whatever
+		// follows it isn't necessarily right after the first one:
+		if (c == -1 || quantified) {
+			if (run.length() >= SHADER_REGEX_MIN_LITERAL)
+				found.push_back(run);
+			run.clear();
+		}
+	}
+
+	if (run.length() >= SHADER_REGEX_MIN_LITERAL)
+		found.push_back(run);
+
+	literals->swap(found);
+}
+
+ShaderRegexPattern::ShaderRegexPattern() :
+	regex(NULL),
+	do_replace(false),
+	jit(false),
+	capture_count(0)
+{
+}
+
+ShaderRegexPattern::~ShaderRegexPattern()
+{
+	pcre2_code_free(regex);
+}
+
+bool ShaderRegexPattern::compile(std::string *pattern)
+{
+	uint32_t name_table_entry_size;
+	uint32_t name_table_count;
+	uint32_t i;
+	PCRE2_SPTR name_table;
+	PCRE2_SIZE err_off;
+	size_t jit_size;
+	int err;
+
+	// CASELESS is for compatibility with d3dcompiler_46 & 47 without
+	// having to always remember to account for the dcl_constantbuffer
+	// differences:
+	regex = pcre2_compile((PCRE2_SPTR)pattern->c_str(),
+			pattern->length(), // or PCRE2_ZERO_TERMINATED
+			PCRE2_CASELESS | PCRE2_MULTILINE,
+			&err, &err_off, NULL);
+	if (!regex) {
+		log_pcre2_error_nonl(err, "  WARNING: PCRE2 regex compilation failed at offset %u", (unsigned)err_off);
+		return false;
+	}
+
+	// pcre2 can fall back to the interpreter if JIT compilation fails, in
+	// which case we must not use pcre2_jit_match:
+	pcre2_jit_compile(regex, PCRE2_JIT_COMPLETE);
+	pcre2_pattern_info(regex, PCRE2_INFO_JITSIZE, &jit_size);
+	jit = !!jit_size;
+	if (!jit)
+		LogInfo("  NOTICE: PCRE2 JIT compilation failed, this pattern will be slow to match\n");
+
+	pcre2_pattern_info(regex, PCRE2_INFO_CAPTURECOUNT, &capture_count);
+
+	extract_required_literals(pattern, &required_literals);
+	for (i = 0; i < required_literals.size(); i++)
+		LogInfo("  Prefilter literal: \"%s\"\n", required_literals[i].c_str());
+
+	pcre2_pattern_info(regex, PCRE2_INFO_NAMECOUNT, &name_table_count);
+	pcre2_pattern_info(regex, PCRE2_INFO_NAMEENTRYSIZE, &name_table_entry_size);
+	pcre2_pattern_info(regex, PCRE2_INFO_NAMETABLE, &name_table);
+
+	static_assert(PCRE2_CODE_UNIT_WIDTH == 8, "Need to fix name table parsing for non-8bit pcre2");
+	for (i = 0; i < name_table_count; i++)
+		named_capture_groups.insert(std::string((char*)(name_table + name_table_entry_size*i + 2)));
+
+	return true;
+}
+
+bool ShaderRegexPattern::named_group_overlaps(ShaderRegexTemps &other_set)
+{
+	ShaderRegexTemps intersection;
+
+	// C++ why you be so verbose?
+	std::set_intersection(
+				named_capture_groups.begin(),
+				named_capture_groups.end(),
+				other_set.begin(),
+				other_set.end(),
+				std::inserter(intersection, intersection.begin()));
+
+	return intersection.size() != 0;
+}
+
+bool ShaderRegexPattern::matches(std::string *asm_text, ShaderRegexMatchContext *context)
+{
+	pcre2_match_data *match_data = context->get_match_data(capture_count);
+	int rc;
+
+	if (!match_data)
+		return false;
+
+	// pcre2_jit_match goes straight to the JIT compiled code, skipping
+	// the option and argument checks that pcre2_match would do each time:
+	if (jit)
+		rc = pcre2_jit_match(regex, (PCRE2_SPTR)asm_text->c_str(), asm_text->length(), 0, 0, match_data, context->mcontext);
+	else
+		rc = pcre2_match(regex, (PCRE2_SPTR)asm_text->c_str(), asm_text->length(), 0, 0, match_data, context->mcontext);
+	if (rc == PCRE2_ERROR_NOMATCH)
+		return false;
+	if (rc < 0) {
+		log_pcre2_error_nonl(rc, "  WARNING: regex match error");
+		return false;
+	}
+
+	return true;
+}
+
+static void replacement_search_and_replace(std::string &str, std::string *search, std::string *replace)
+{
+	size_t pos;
+
+	for (pos = str.find(*search); pos != std::string::npos; pos = str.find(*search, pos + 1)) {
+		if (pos > 0 && (str[pos-1] == '$' || str[pos-1] == '\\'))
+			continue;
+
+		str.replace(pos, search->length(), *replace);
+	}
+}
+
+static void substitute_temp_regs(std::string &replacement, ShaderRegexTemps *temp_regs, unsigned dcl_temps)
+{
+	ShaderRegexTemps::iterator i;
+	unsigned tmp_reg = dcl_temps;
+	std::string search_str, repl_str;
+
+	for (i = temp_regs->begin(); i != temp_regs->end(); i++, tmp_reg++) {
+		repl_str = std::string("r") + std::to_string(tmp_reg);
+
+		search_str = std::string("$") + *i;
+		replacement_search_and_replace(replacement, &search_str, &repl_str);
+
+		search_str = std::string("${") + *i + std::string("}");
+		replacement_search_and_replace(replacement, &search_str, &repl_str);
+	}
+}
+
+bool ShaderRegexPattern::patch(std::string *asm_text, ShaderRegexTemps *temp_regs, unsigned dcl_temps, ShaderRegexMatchContext *context)
+{
+	pcre2_match_data *match_data;
+	PCRE2_SIZE est_size, output_size;
+	std::string replace_copy;
+	PCRE2_UCHAR *buf = NULL;
+	bool patch = false;
+	uint32_t options;
+	int rc;
+
+	static_assert(PCRE2_CODE_UNIT_WIDTH == 8, "Need to fix output buffer allocation for non-8bit pcre2");
+
+	// We operate on a copy of the replace string so that future shaders
+	// don't get our temporary register numbers:
+	replace_copy = replace;
+	substitute_temp_regs(replace_copy, temp_regs, dcl_temps);
+
+	// TODO: Allow named capture groups from other patterns in the same
+	// regex group to be substituted in, and provide some simple arithmetic
+	// operators to e.g. allow a constant buffer byte offset to be divided
+	// by 16 to get the constant buffer index and vice versa
+
+	// At a minimum we want \n to be translated in the replace string,
+	// which needs extended substitution processing to be enabled:
+	options = PCRE2_SUBSTITUTE_EXTENDED;
+
+	match_data = context->get_match_data(capture_count);
+	if (!match_data)
+		return false;
+
+	output_size = est_size = asm_text->length() + replace_copy.length() + 1024;
+	buf = new PCRE2_UCHAR[output_size];
+	rc = pcre2_substitute(regex,
+			(PCRE2_SPTR)asm_text->c_str(), asm_text->length(), 0,
+			options | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH,
+			match_data, context->mcontext,
+			(PCRE2_SPTR)replace_copy.c_str(), replace_copy.length(),
+			buf, &output_size);
+
+	if (rc == PCRE2_ERROR_NOMEMORY) {
+		LogInfo("  NOTICE: regex replace requires a %u byte buffer\n", (unsigned)output_size);
+		LogInfo("  NOTICE: We underestimated by %u bytes and have to start over\n", (unsigned)(output_size - est_size));
+		LogInfo("  NOTICE: What kind of crazy are you doing to get down this code path?\n");
+		LogInfo("  NOTICE: You didn't inject a matrix inverse or two in assembly did you?\n");
+		LogInfo("  NOTICE: Once more, with passion!\n");
+
+		delete [] buf;
+		buf = new PCRE2_UCHAR[output_size];
+
+		rc = pcre2_substitute(regex,
+				(PCRE2_SPTR)asm_text->c_str(), asm_text->length(), 0,
+				options, // No PCRE2_SUBSTITUTE_OVERFLOW_LENGTH this time
+				match_data, context->mcontext,
+				(PCRE2_SPTR)replace_copy.c_str(), replace_copy.length(),
+				buf, &output_size);
+	}
+
+	if (rc == 0)
+		goto out_free;
+	if (rc < 0) {
+		log_pcre2_error_nonl(rc, "  WARNING: regex replace error");
+		goto out_free;
+	}
+
+	*asm_text = (char*)buf;
+	patch = true;
+
+out_free:
+	delete [] buf;
+
+	return patch;
+}
+
+bool ShaderRegexRules::prefilter_may_match(const std::vector<bool> *found_literals)
+{
+	for (unsigned id : prefilter_literals) {
+		if (!(*found_literals)[id])
+			return false;
+	}
+
+	return true;
+}
+
+bool ShaderRegexRules::has_replace_pattern()
+{
+	ShaderRegexPatterns::iterator i;
+
+	for (i = patterns.begin(); i != patterns.end(); i++) {
+		if (i->second.do_replace)
+			return true;
+	}
+
+	return false;
+}
+
+void ShaderRegexRules::apply_regex_patterns(std::string *asm_text, ShaderRegexMatchContext *context, bool *match, bool *patch)
+{
+	ShaderRegexPatterns::iterator i;
+	ShaderRegexPattern *pattern;
+	unsigned dcl_temps = 0;
+
+	// Match defaults to true so that if there are no patterns we can still
+	// apply the command list. Patch defaults to false because we don't
+	// want to waste time re-assembling the shader if we didn't change it.
+	*match = true;
+	*patch = false;
+
+	if (!temp_regs.empty())
+		dcl_temps = get_dcl_temps(asm_text);
+
+	for (i = patterns.begin(); i != patterns.end(); i++) {
+		pattern = &i->second;
+
+		if (pattern->do_replace)
+			*match = *patch = pattern->patch(asm_text, &temp_regs, dcl_temps, context);
+		else
+			*match = pattern->matches(asm_text, context);
+
+		if (!*match) {
+			*patch = false;
+			return;
+		}
+	}
+
+	// Only update dcl_temps if we are patching:
+	if (*patch && !temp_regs.empty())
+		*patch = update_dcl_temps(asm_text, dcl_temps + temp_regs.size());
+
+	// But we can update declarations even if we aren't doing a regex
+	// replace in some cases, so long as the patterns all matched (e.g.
+	// globally disable the driver stereo cb):
+	if (!declarations.empty())
+		*patch = insert_declarations(asm_text, &declarations) || *patch;
+}
+
+void ShaderRegexPrefilter::clear()
+{
+	literals.clear();
+	transitions.clear();
+	output_start.clear();
+	outputs.clear();
+	num_classes = 0;
+}
+
+unsigned ShaderRegexPrefilter::add_literal(const std::string *literal)
+{
+	// Identical literals from different patterns share an ID:
+	return literals.emplace(*literal, (unsigned)literals.size()).first->second;
+}
+
+void ShaderRegexPrefilter::compile()
+{
+	std::vector<std::vector<uint32_t>> state_outputs;
+	std::vector<uint32_t> fail, queue;
+	std::map<std::string, unsigned>::iterator i;
+	uint32_t state, next, c;
+	size_t pos;
+
+	transitions.clear();
+	output_start.clear();
+	outputs.clear();
+
+	// Only the characters that appear in the literals need their own
+	// column in the transition table, everything else shares column 0.
+	// The literals are already lower case, so upper case letters go in
+	// the same column as their lower case equivalents:
+	memset(byte_class, 0, sizeof(byte_class));
+	num_classes = 1;
+	for (i = literals.begin(); i != literals.end(); i++) {
+		for (char ch : i->first) {
+			if (!byte_class[(uint8_t)ch])
+				byte_class[(uint8_t)ch] = num_classes++;
+		}
+	}
+	for (c = 'A'; c <= 'Z'; c++)
+		byte_class[c] = byte_class[tolower(c)];
+
+	// Build the trie, with UINT32_MAX marking missing transitions:
+	transitions.assign(num_classes, UINT32_MAX);
+	state_outputs.resize(1);
+	for (i = literals.begin(); i != literals.end(); i++) {
+		state = 0;
+		for (char ch : i->first) {
+			c = byte_class[(uint8_t)ch];
+			if (transitions[state * num_classes + c] == UINT32_MAX) {
+				transitions[state * num_classes + c] = (uint32_t)state_outputs.size();
+				transitions.resize(transitions.size() + num_classes, UINT32_MAX);
+				state_outputs.resize(state_outputs.size() + 1);
+			}
+			state = transitions[state * num_classes + c];
+		}
+		state_outputs[state].push_back(i->second);
+	}
+
+	// Breadth first, so that the failure link of each state has already
+	// been resolved by the time we get to it. Missing transitions are
+	// replaced with those of the failure link to make a full DFA, and
+	// each state inherits the outputs of its failure link (i.e. literals
+	// that are a suffix of the text matched to reach the state):
+	fail.assign(state_outputs.size(), 0);
+	for (c = 0; c < num_classes; c++) {
+		next = transitions[c];
+		if (next == UINT32_MAX)
+			transitions[c] = 0;
+		else
+			queue.push_back(next);
+	}
+	for (pos = 0; pos < queue.size(); pos++) {
+		state = queue[pos];
+		for (c = 0; c < num_classes; c++) {
+			next = transitions[state * num_classes + c];
+			if (next == UINT32_MAX) {
+				transitions[state * num_classes + c] = transitions[fail[state] * num_classes + c];
+				continue;
+			}
+			fail[next] = transitions[fail[state] * num_classes + c];
+			state_outputs[next].insert(state_outputs[next].end(),
+					state_outputs[fail[next]].begin(),
+					state_outputs[fail[next]].end());
+			queue.push_back(next);
+		}
+	}
+
+	for (state = 0; state < state_outputs.size(); state++) {
+		output_start.push_back((uint32_t)outputs.size());
+		outputs.insert(outputs.end(), state_outputs[state].begin(), state_outputs[state].end());
+	}
+	output_start.push_back((uint32_t)outputs.size());
+}
+
+void ShaderRegexPrefilter::scan(const std::string *text, std::vector<bool> *found_literals)
+{
+	const uint8_t *ptr = (const uint8_t*)text->data();
+	const uint8_t *end = ptr + text->size();
+	uint32_t state = 0;
+	uint32_t j;
+
+	found_literals->assign(literals.size(), false);
+	if (literals.empty())
+		return;
+
+	for (; ptr < end; ptr++) {
+		state = transitions[state * num_classes + byte_class[*ptr]];
+		for (j = output_start[state]; j < output_start[state + 1]; j++)
+			(*found_literals)[outputs[j]] = true;
+	}
+}
+
+void ShaderRegexRuleSet::clear()
+{
+	rules.clear();
+	prefilter.clear();
+}
+
+// Called once all ShaderRegex sections have been parsed:
+void ShaderRegexRuleSet::compile()
+{
+	ShaderRegexPatterns::iterator j;
+	unsigned filtered = 0;
+
+	prefilter.clear();
+
+	for (ShaderRegexRules *group : rules) {
+		group->prefilter_literals.clear();
+
+		for (j = group->patterns.begin(); j != group->patterns.end(); j++) {
+			for (std::string &literal : j->second.required_literals)
+				group->prefilter_literals.push_back(prefilter.add_literal(&literal));
+
+			// Patterns after a replacement are matched against the
+			// patched text, which the literals may only be in now:
+			if (j->second.do_replace)
+				break;
+		}
+
+		if (!group->prefilter_literals.empty())
+			filtered++;
+	}
+
+	prefilter.compile();
+
+	LogInfo("ShaderRegex prefilter: %Iu literals, %u of %Iu groups can be prefiltered\n",
+			prefilter.num_literals(), filtered, rules.size());
+}
+
+bool ShaderRegexRuleSet::may_match(const void *bytecode, size_t bytecode_len, std::string *shader_model)
+{
+	if (*shader_model == std::string("bin")) {
+		// Can't tell without disassembling it:
+		if (!get_bytecode_shader_model(bytecode, bytecode_len, shader_model))
+			return true;
+	}
+
+	for (ShaderRegexRules *group : rules) {
+		if (group->shader_models.count(*shader_model))
+			return true;
+	}
+
+	return false;
+}
+
+bool ShaderRegexRuleSet::apply(std::string *asm_text, std::string *shader_model, ShaderRegexMatchContext *context,
+		std::vector<uint32_t> *match_ids, std::vector<uint32_t> *patch_ids)
+{
+	ShaderRegexRules *group;
+	bool patched = false;
+	bool rescan = true;
+	bool match, patch;
+	std::vector<bool> found_literals;
+	uint32_t j;
+
+	if (*shader_model == std::string("bin")) {
+		// This will update the data structure, because we may as well
+		// - it will save effort if we have to redo this again later.
+		if (!get_asm_shader_model(asm_text, shader_model))
+			return false;
+	}
+
+	for (j = 0; j < rules.size(); j++) {
+		group = rules[j];
+
+		// Callers use may_match() to avoid disassembling the shader if
+		// none of the groups apply to it
+		if (!group->shader_models.count(*shader_model))
+			continue;
+
+		// A single pass to find every literal, redone only if an
+		// earlier group has patched the text:
+		if (rescan) {
+			prefilter.scan(asm_text, &found_literals);
+			rescan = false;
+		}
+		if (!group->prefilter_may_match(&found_literals))
+			continue;
+
+		group->apply_regex_patterns(asm_text, context, &match, &patch);
+
+		// Even if the group didn't match, one of its patterns may have
+		// replaced something before a later pattern failed to match:
+		rescan = patch || group->has_replace_pattern();
+		if (!match)
+			continue;
+
+		match_ids->push_back(j);
+		if (patch)
+			patch_ids->push_back(j);
+		patched = patched || patch;
+	}
+
+	return patched;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <pcre2.h>
+
+// The parts of ShaderRegex that decide whether a shader matches and patch its
+// assembly. Nothing in here touches the globals, command lists or the cache,
+// and once the rules have been compiled they are only ever read, so any
+// number of threads may apply them at the same time so long as each has its
+// own ShaderRegexMatchContext. This is what lets the DLL run ShaderRegex on a
+// worker pool as shaders are created, and what cmd_DirectX11Tests
+// --stress-shader-regex exercises.
+
+typedef std::set<std::string> ShaderRegexTemps;
+typedef std::set<std::string> ShaderRegexModels;
+
+// pcre2 state that can't be shared between threads matching at the same time:
+class ShaderRegexMatchContext {
+public:
+	pcre2_match_context *mcontext;
+	pcre2_jit_stack *jit_stack;
+	pcre2_match_data *match_data;
+	uint32_t match_data_pairs;
+
+	ShaderRegexMatchContext();
+	~ShaderRegexMatchContext();
+
+	pcre2_match_data* get_match_data(uint32_t capture_count);
+};
+
+class ShaderRegexPattern {
+public:
+	pcre2_code *regex;
+	std::string replace;
+
+	bool do_replace;
+	bool jit;
+	uint32_t capture_count;
+
+	// Substrings (folded to lower case) that any text this pattern matches
+	// must contain, for the prefilter. Empty if we couldn't work any out:
+	std::vector<std::string> required_literals;
+
+	// These will be used later when we implement our own advanced
+	// substitution to allow matches to be used between multiple patterns
+	// in the one regex group, and to apply some (very) simple arithmetic
+	// to convert byte offsets to constant buffer indexes and vice versa
+	std::set<std::string> named_capture_groups;
+
+	ShaderRegexPattern();
+	~ShaderRegexPattern();
+
+	bool compile(std::string *pattern);
+	bool named_group_overlaps(ShaderRegexTemps &other_set);
+	bool matches(std::string *asm_text, ShaderRegexMatchContext *context);
+	bool patch(std::string *asm_text, ShaderRegexTemps *temp_regs, unsigned dcl_temps, ShaderRegexMatchContext *context);
+};
+
+// These are sorted to make sure we get consistent results between runs
+// in case the user does something that winds up depending on the order:
+typedef std::map<std::wstring, ShaderRegexPattern> ShaderRegexPatterns;
+typedef std::vector<std::string> ShaderRegexDeclarations;
+
+// Everything in a ShaderRegex group that affects the assembly:
+class ShaderRegexRules {
+public:
+	ShaderRegexPatterns patterns;
+
+	ShaderRegexDeclarations declarations;
+	ShaderRegexModels shader_models;
+	ShaderRegexTemps temp_regs;
+
+	// Prefilter literal IDs that must all be found for the group to match:
+	std::vector<unsigned> prefilter_literals;
+
+	bool prefilter_may_match(const std::vector<bool> *found_literals);
+	bool has_replace_pattern();
+	void apply_regex_patterns(std::string *asm_text, ShaderRegexMatchContext *context, bool *match, bool *patch);
+};
+
+// Aho-Corasick automaton over the required literals of every pattern, so that
+// a single pass over the disassembly tells us which groups could possibly
+// match before running any of their regular expressions. Matching is case
+// insensitive, since the patterns are compiled with PCRE2_CASELESS.
+class ShaderRegexPrefilter {
+public:
+	void clear();
+	unsigned add_literal(const std::string *literal);
+	void compile();
+	void scan(const std::string *text, std::vector<bool> *found_literals);
+
+	size_t num_literals() { return literals.size(); }
+
+private:
+	std::map<std::string, unsigned> literals;
+	uint8_t byte_class[256];
+	unsigned num_classes;
+
+	// Full DFA - failure links are already folded in to the transitions:
+	std::vector<uint32_t> transitions; // [state * num_classes + class]
+	std::vector<uint32_t> output_start; // [state] .. [state + 1] in outputs
+	std::vector<uint32_t> outputs; // Literal IDs found on reaching a state
+};
+
+// Every group in the order they are applied in. Match IDs are indexes into
+// rules, which is what the ShaderRegex cache stores.
+class ShaderRegexRuleSet {
+public:
+	std::vector<ShaderRegexRules*> rules;
+
+	void clear();
+	void compile();
+
+	// Whether any group applies to the shader model. If the shader model
+	// is still unknown ("bin") it is filled in from the bytecode if
+	// possible, otherwise we can't tell without disassembling it:
+	bool may_match(const void *bytecode, size_t bytecode_len, std::string *shader_model);
+
+	// Applies every group to the assembly in order and returns true if
+	// any of them patched it. match_ids receives every group that matched,
+	// patch_ids those that also patched. If the shader model is "bin" it
+	// is filled in from the assembly.
+	bool apply(std::string *asm_text, std::string *shader_model, ShaderRegexMatchContext *context,
+			std::vector<uint32_t> *match_ids, std::vector<uint32_t> *patch_ids);
+
+private:
+	ShaderRegexPrefilter prefilter;
+};
+
+bool get_bytecode_shader_model(const void *bytecode, size_t bytecode_len, std::string *shader_model);
+bool get_asm_shader_model(std::string *asm_text, std::string *shader_model);
@@ -0,0 +1,196 @@
+#include "ShaderUsage.h"
+
+#include <set>
+
+#include "globals.h"
+#include "lock.h"
+
+// Every ring that may have records in it, protected by G->mCriticalSection:
+static std::set<ShaderUsageRing*> shader_usage_rings;
+
+ShaderUsageRing::ShaderUsageRing() :
+	head(0),
+	tail(0)
+{
+	memset(last_shaders, 0, sizeof(last_shaders));
+	memset(consumer_shaders, 0, sizeof(consumer_shaders));
+}
+
+ShaderUsageRecord* ShaderUsageRing::reserve()
+{
+	uint32_t h = head.load(std::memory_order_relaxed);
+
+	if (h - tail.load(std::memory_order_acquire) == SHADER_USAGE_RING_SIZE) {
+		// Full. Rather than drop anything or wait for present we
+		// drain it ourselves, which is what every draw call used to
+		// pay for - now it's once per few thousand records:
+		EnterCriticalSectionPretty(&G->mCriticalSection);
+			consolidate();
+		LeaveCriticalSection(&G->mCriticalSection);
+	}
+
+	return &records[h % SHADER_USAGE_RING_SIZE];
+}
+
+void ShaderUsageRing::commit()
+{
+	head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void ShaderUsageRing::record_shaders(const UINT64 shaders[(int)ShaderUsageStage::COUNT])
+{
+	ShaderUsageRecord *record;
+
+	if (!memcmp(shaders, last_shaders, sizeof(last_shaders)))
+		return;
+	memcpy(last_shaders, shaders, sizeof(last_shaders));
+
+	record = reserve();
+	record->type = ShaderUsageRecordType::SHADERS;
+	memcpy(record->shaders, shaders, sizeof(record->shaders));
+	commit();
+}
+
+void ShaderUsageRing::record_resource(ShaderUsageRecordType type, ShaderUsageStage stage,
+		UINT slot, ID3D11Resource *resource)
+{
+	ShaderUsageRecord *record;
+	ResourceHandleInfo *info;
+
+	record = reserve();
+	record->type = type;
+	record->stage = stage;
+	record->slot = (uint16_t)slot;
+	record->resource.handle = resource;
+	record->resource.hash = 0;
+	record->resource.orig_hash = 0;
+
+	// Resource handle lookups are lock free:
+	info = GetResourceHandleInfo(resource);
+	if (info) {
+		record->resource.hash = info->hash;
+		record->resource.orig_hash = info->orig_hash;
+	}
+	commit();
+}
+
+static std::map<UINT64, ShaderInfoData>* shader_info_map(ShaderUsageStage stage)
+{
+	switch (stage) {
+		case ShaderUsageStage::VS: return &G->mVertexShaderInfo;
+		case ShaderUsageStage::HS: return &G->mHullShaderInfo;
+		case ShaderUsageStage::DS: return &G->mDomainShaderInfo;
+		case ShaderUsageStage::GS: return &G->mGeometryShaderInfo;
+		case ShaderUsageStage::PS: return &G->mPixelShaderInfo;
+		case ShaderUsageStage::CS: return &G->mComputeShaderInfo;
+	}
+	return NULL;
+}
+
+void ShaderUsageRing::consolidate_record(ShaderUsageRecord *record)
+{
+	ShaderInfoData *info;
+	int i, j;
+
+	switch (record->type) {
+		case ShaderUsageRecordType::SHADERS:
+			memcpy(consumer_shaders, record->shaders, sizeof(consumer_shaders));
+
+			for (i = 0; i < (int)ShaderUsageStage::COUNT; i++) {
+				if (!consumer_shaders[i])
+					continue;
+				info = &(*shader_info_map((ShaderUsageStage)i))[consumer_shaders[i]];
+
+				// Compute shaders don't have peers:
+				if (i == (int)ShaderUsageStage::CS)
+					continue;
+				for (j = 0; j < (int)ShaderUsageStage::CS; j++) {
+					if (consumer_shaders[j] && consumer_shaders[j] != consumer_shaders[i])
+						info->PeerShaders.insert(consumer_shaders[j]);
+				}
+			}
+			return;
+
+		case ShaderUsageRecordType::VISITED_RENDER_TARGET:
+			G->mVisitedRenderTargets.insert(record->resource.handle);
+			G->mRenderTargetInfo.insert(record->resource.orig_hash);
+			return;
+
+		case ShaderUsageRecordType::VISITED_DEPTH_TARGET:
+			G->mDepthTargetInfo.insert(record->resource.orig_hash);
+			return;
+	}
+
+	// The rest belong to the shader bound to the record's stage:
+	if (!consumer_shaders[(int)record->stage])
+		return;
+	info = &(*shader_info_map(record->stage))[consumer_shaders[(int)record->stage]];
+
+	ResourceSnapshot snapshot(record->resource.handle, record->resource.hash, record->resource.orig_hash);
+
+	switch (record->type) {
+		case ShaderUsageRecordType::REGISTER:
+			if (snapshot.orig_hash)
+				G->mShaderResourceInfo.insert(snapshot.orig_hash);
+			info->ResourceRegisters[record->slot].insert(snapshot);
+			break;
+
+		case ShaderUsageRecordType::RENDER_TARGET:
+			if (record->slot >= info->RenderTargets.size())
+				info->RenderTargets.resize(record->slot + 1);
+			info->RenderTargets[record->slot].insert(snapshot);
+			break;
+
+		case ShaderUsageRecordType::DEPTH_TARGET:
+			info->DepthTargets.insert(snapshot);
+			break;
+
+		case ShaderUsageRecordType::UAV:
+			if (snapshot.orig_hash)
+				G->mUnorderedAccessInfo.insert(snapshot.orig_hash);
+			info->UAVs[record->slot].insert(snapshot);
+			break;
+	}
+}
+
+void ShaderUsageRing::consolidate()
+{
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	uint32_t h = head.load(std::memory_order_acquire);
+
+	for (; t != h; t++)
+		consolidate_record(&records[t % SHADER_USAGE_RING_SIZE]);
+
+	tail.store(t, std::memory_order_release);
+}
+
+ShaderUsageRing* NewShaderUsageRing()
+{
+	ShaderUsageRing *ring = new ShaderUsageRing();
+
+	EnterCriticalSectionPretty(&G->mCriticalSection);
+		shader_usage_rings.insert(ring);
+	LeaveCriticalSection(&G->mCriticalSection);
+
+	return ring;
+}
+
+// Called when the context is released, by which point nothing can be
+// recording into the ring any more:
+void FreeShaderUsageRing(ShaderUsageRing *ring)
+{
+	EnterCriticalSectionPretty(&G->mCriticalSection);
+		ring->consolidate();
+		shader_usage_rings.erase(ring);
+	LeaveCriticalSection(&G->mCriticalSection);
+
+	delete ring;
+}
+
+void FlushShaderUsage()
+{
+	EnterCriticalSectionPretty(&G->mCriticalSection);
+		for (ShaderUsageRing *ring : shader_usage_rings)
+			ring->consolidate();
+	LeaveCriticalSection(&G->mCriticalSection);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <stdint.h>
+#include <atomic>
+
+// With hunting and dump_usage enabled every draw call records which shaders
+// were bound together and which resources they used, for ShaderUsage.txt and
+// the marking actions. This used to go straight into the std::map / std::set
+// in Globals with G->mCriticalSection held, several times per draw call, so
+// games that render from multiple threads would serialise on the lock and
+// become unplayable while hunting.
+//
+// Each HackerContext now writes what it sees into its own ring of records
+// without taking any lock - a context is only ever used by one thread at a
+// time, so each ring has a single producer. FlushShaderUsage() folds the
+// records from every ring into the same maps and sets as before. It is
+// called once a frame on present, before dumping ShaderUsage.txt and before
+// the marking actions read the peer shaders, and by the producer itself in
+// the rare case that its ring fills up before then. Consumers are serialised
+// by G->mCriticalSection.
+
+enum class ShaderUsageStage : uint8_t {
+	VS,
+	HS,
+	DS,
+	GS,
+	PS,
+	CS,
+	COUNT,
+};
+
+enum class ShaderUsageRecordType : uint8_t {
+	SHADERS,            // The shaders the following records apply to
+	REGISTER,           // Shader resource view bound to the stage
+	RENDER_TARGET,      // Render target bound while the pixel shader was used
+	DEPTH_TARGET,       // Depth target bound while the pixel shader was used
+	UAV,                // UAV bound to the pixel or compute shader
+	VISITED_RENDER_TARGET,
+	VISITED_DEPTH_TARGET,
+};
+
+struct ShaderUsageRecord {
+	ShaderUsageRecordType type;
+	ShaderUsageStage stage;
+	uint16_t slot;
+	union {
+		UINT64 shaders[(int)ShaderUsageStage::COUNT];
+		struct {
+			ID3D11Resource *handle;
+			uint32_t hash;
+			uint32_t orig_hash;
+		} resource;
+	};
+};
+
+#define SHADER_USAGE_RING_SIZE 4096
+
+class ShaderUsageRing
+{
+public:
+	ShaderUsageRing();
+
+	// Producer only. Records the shaders bound for a draw or dispatch call,
+	// which the records that follow are attributed to. Skipped if they are
+	// the same as last time.
+	void record_shaders(const UINT64 shaders[(int)ShaderUsageStage::COUNT]);
+
+	// Producer only. Looks up the hashes of the resource (which need not
+	// hold a reference) and records it:
+	void record_resource(ShaderUsageRecordType type, ShaderUsageStage stage,
+			UINT slot, ID3D11Resource *resource);
+
+	// With G->mCriticalSection held
+	void consolidate();
+
+private:
+	ShaderUsageRecord records[SHADER_USAGE_RING_SIZE];
+
+	// Free running counters, the ring index is the low bits:
+	std::atomic<uint32_t> head; // Written by the producer
+	std::atomic<uint32_t> tail; // Written by the consumer
+
+	UINT64 last_shaders[(int)ShaderUsageStage::COUNT];  // Producer only
+	UINT64 consumer_shaders[(int)ShaderUsageStage::COUNT]; // Consumer only
+
+	ShaderUsageRecord* reserve();
+	void commit();
+	void consolidate_record(ShaderUsageRecord *record);
+};
+
+ShaderUsageRing* NewShaderUsageRing();
+void FreeShaderUsageRing(ShaderUsageRing *ring);
+void FlushShaderUsage();
@@ -0,0 +1,639 @@
+#include "VertexBufferText.h"
+
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+
+#include "util.h"
+
+// When writing to a file, text is written out in chunks of about this size:
+#define VB_TEXT_FLUSH_SIZE (4 * 1024 * 1024)
+
+// Vertices decoded at a time. Small enough that the decoded values for every
+// element of a batch stay in the cache until they have been formatted:
+#define VB_TEXT_BATCH 64
+
+static const char vb_text_stride_warning[] =
+	"# WARNING: Offset exceeded stride, vertex buffer may be decoded incorrectly\n";
+
+static UINT dxgi_format_alignment(DXGI_FORMAT format)
+{
+	// I'm not positive what the alignment constraints actually are - MSDN
+	// mentions they exist, but I don't think they go so far as being
+	// aligned to the size of the full format (I'm seeing vertex buffers
+	// that clearly are not). For now I'm going with the assumption that
+	// the alignment must match the individual components, and skipping
+	// those with variable sized components or unusual formats.
+	switch (format) {
+		case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		case DXGI_FORMAT_R32G32B32A32_UINT:
+		case DXGI_FORMAT_R32G32B32A32_SINT:
+		case DXGI_FORMAT_R32G32B32_TYPELESS:
+		case DXGI_FORMAT_R32G32B32_FLOAT:
+		case DXGI_FORMAT_R32G32B32_UINT:
+		case DXGI_FORMAT_R32G32B32_SINT:
+		case DXGI_FORMAT_R32G32_TYPELESS:
+		case DXGI_FORMAT_R32G32_FLOAT:
+		case DXGI_FORMAT_R32G32_UINT:
+		case DXGI_FORMAT_R32G32_SINT:
+		case DXGI_FORMAT_R32_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT:
+		case DXGI_FORMAT_R32_FLOAT:
+		case DXGI_FORMAT_R32_UINT:
+		case DXGI_FORMAT_R32_SINT:
+			return 4;
+		case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R16G16B16A16_UNORM:
+		case DXGI_FORMAT_R16G16B16A16_UINT:
+		case DXGI_FORMAT_R16G16B16A16_SNORM:
+		case DXGI_FORMAT_R16G16B16A16_SINT:
+		case DXGI_FORMAT_R16G16_TYPELESS:
+		case DXGI_FORMAT_R16G16_FLOAT:
+		case DXGI_FORMAT_R16G16_UNORM:
+		case DXGI_FORMAT_R16G16_UINT:
+		case DXGI_FORMAT_R16G16_SNORM:
+		case DXGI_FORMAT_R16G16_SINT:
+		case DXGI_FORMAT_R16_TYPELESS:
+		case DXGI_FORMAT_R16_FLOAT:
+		case DXGI_FORMAT_D16_UNORM:
+		case DXGI_FORMAT_R16_UNORM:
+		case DXGI_FORMAT_R16_UINT:
+		case DXGI_FORMAT_R16_SNORM:
+		case DXGI_FORMAT_R16_SINT:
+			return 2;
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		case DXGI_FORMAT_R8G8B8A8_UINT:
+		case DXGI_FORMAT_R8G8B8A8_SNORM:
+		case DXGI_FORMAT_R8G8B8A8_SINT:
+		case DXGI_FORMAT_R8G8_TYPELESS:
+		case DXGI_FORMAT_R8G8_UNORM:
+		case DXGI_FORMAT_R8G8_UINT:
+		case DXGI_FORMAT_R8G8_SNORM:
+		case DXGI_FORMAT_R8G8_SINT:
+		case DXGI_FORMAT_R8_TYPELESS:
+		case DXGI_FORMAT_R8_UNORM:
+		case DXGI_FORMAT_R8_UINT:
+		case DXGI_FORMAT_R8_SNORM:
+		case DXGI_FORMAT_R8_SINT:
+		case DXGI_FORMAT_A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+			return 1;
+	}
+	return 0;
+}
+
+// Maps each format to how its components are decoded and printed. This has to
+// match the old fprintf based formatter exactly, quirks and all:
+static bool vb_text_component_type(DXGI_FORMAT format, VBTextComponent *type, UINT *components)
+{
+	switch (format) {
+		// --- 32-bit ---
+		case DXGI_FORMAT_R32G32B32A32_TYPELESS: *type = VBTextComponent::HEX32; *components = 4; return true;
+		case DXGI_FORMAT_R32G32B32_TYPELESS:    *type = VBTextComponent::HEX32; *components = 3; return true;
+		case DXGI_FORMAT_R32G32_TYPELESS:       *type = VBTextComponent::HEX32; *components = 2; return true;
+		case DXGI_FORMAT_R32_TYPELESS:          *type = VBTextComponent::HEX32; *components = 1; return true;
+
+		case DXGI_FORMAT_R32G32B32A32_FLOAT: *type = VBTextComponent::FLOAT32; *components = 4; return true;
+		case DXGI_FORMAT_R32G32B32_FLOAT:    *type = VBTextComponent::FLOAT32; *components = 3; return true;
+		case DXGI_FORMAT_R32G32_FLOAT:       *type = VBTextComponent::FLOAT32; *components = 2; return true;
+		case DXGI_FORMAT_D32_FLOAT:
+		case DXGI_FORMAT_R32_FLOAT:          *type = VBTextComponent::FLOAT32; *components = 1; return true;
+
+		case DXGI_FORMAT_R32G32B32A32_UINT: *type = VBTextComponent::UINT32; *components = 4; return true;
+		case DXGI_FORMAT_R32G32B32_UINT:    *type = VBTextComponent::UINT32; *components = 3; return true;
+		case DXGI_FORMAT_R32G32_UINT:       *type = VBTextComponent::UINT32; *components = 2; return true;
+		case DXGI_FORMAT_R32_UINT:          *type = VBTextComponent::UINT32; *components = 1; return true;
+
+		case DXGI_FORMAT_R32G32B32A32_SINT: *type = VBTextComponent::SINT32; *components = 4; return true;
+		case DXGI_FORMAT_R32G32B32_SINT:    *type = VBTextComponent::SINT32; *components = 3; return true;
+		case DXGI_FORMAT_R32G32_SINT:       *type = VBTextComponent::SINT32; *components = 2; return true;
+		case DXGI_FORMAT_R32_SINT:          *type = VBTextComponent::SINT32; *components = 1; return true;
+
+		// --- 16-bit ---
+		case DXGI_FORMAT_R16G16B16A16_TYPELESS: *type = VBTextComponent::HEX16; *components = 4; return true;
+		case DXGI_FORMAT_R16G16_TYPELESS:       *type = VBTextComponent::HEX16; *components = 2; return true;
+		case DXGI_FORMAT_R16_TYPELESS:          *type = VBTextComponent::HEX16; *components = 1; return true;
+
+		case DXGI_FORMAT_R16G16B16A16_FLOAT: *type = VBTextComponent::FLOAT16; *components = 4; return true;
+		case DXGI_FORMAT_R16G16_FLOAT:       *type = VBTextComponent::FLOAT16; *components = 2; return true;
+		case DXGI_FORMAT_R16_FLOAT:          *type = VBTextComponent::FLOAT16; *components = 1; return true;
+
+		case DXGI_FORMAT_R16G16B16A16_UNORM: *type = VBTextComponent::UNORM16; *components = 4; return true;
+		case DXGI_FORMAT_R16G16_UNORM:       *type = VBTextComponent::UNORM16; *components = 2; return true;
+		case DXGI_FORMAT_D16_UNORM:
+		case DXGI_FORMAT_R16_UNORM:          *type = VBTextComponent::UNORM16; *components = 1; return true;
+
+		case DXGI_FORMAT_R16G16B16A16_SNORM: *type = VBTextComponent::SNORM16; *components = 4; return true;
+		case DXGI_FORMAT_R16G16_SNORM:       *type = VBTextComponent::SNORM16; *components = 2; return true;
+		case DXGI_FORMAT_R16_SNORM:          *type = VBTextComponent::SNORM16; *components = 1; return true;
+
+		case DXGI_FORMAT_R16G16B16A16_UINT: *type = VBTextComponent::UINT16; *components = 4; return true;
+		case DXGI_FORMAT_R16G16_UINT:       *type = VBTextComponent::UINT16; *components = 2; return true;
+		case DXGI_FORMAT_R16_UINT:          *type = VBTextComponent::UINT16; *components = 1; return true;
+
+		case DXGI_FORMAT_R16G16B16A16_SINT: *type = VBTextComponent::SINT16; *components = 4; return true;
+		case DXGI_FORMAT_R16G16_SINT:       *type = VBTextComponent::SINT16; *components = 2; return true;
+		case DXGI_FORMAT_R16_SINT:          *type = VBTextComponent::SINT16; *components = 1; return true;
+
+		// --- 8-bit ---
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8A8_TYPELESS: *type = VBTextComponent::HEX8; *components = 4; return true;
+		case DXGI_FORMAT_B8G8R8X8_TYPELESS: *type = VBTextComponent::HEX8; *components = 3; return true;
+		case DXGI_FORMAT_R8G8_TYPELESS:     *type = VBTextComponent::HEX8; *components = 2; return true;
+		case DXGI_FORMAT_R8_TYPELESS:       *type = VBTextComponent::HEX8; *components = 1; return true;
+
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
+		case DXGI_FORMAT_R8G8_B8G8_UNORM:
+		case DXGI_FORMAT_G8R8_G8B8_UNORM: *type = VBTextComponent::UNORM8; *components = 4; return true;
+		case DXGI_FORMAT_R8G8_UNORM:      *type = VBTextComponent::UNORM8; *components = 2; return true;
+		case DXGI_FORMAT_R8_UNORM:        *type = VBTextComponent::UNORM8; *components = 1; return true;
+
+		case DXGI_FORMAT_R8G8B8A8_SNORM: *type = VBTextComponent::SNORM8; *components = 4; return true;
+		case DXGI_FORMAT_R8G8_SNORM:     *type = VBTextComponent::SNORM8; *components = 2; return true;
+		case DXGI_FORMAT_R8_SNORM:
+		case DXGI_FORMAT_A8_UNORM:       *type = VBTextComponent::SNORM8; *components = 1; return true;
+
+		case DXGI_FORMAT_R8G8B8A8_UINT: *type = VBTextComponent::UINT8; *components = 4; return true;
+		case DXGI_FORMAT_R8G8_UINT:     *type = VBTextComponent::UINT8; *components = 2; return true;
+		case DXGI_FORMAT_R8_UINT:       *type = VBTextComponent::UINT8; *components = 1; return true;
+
+		case DXGI_FORMAT_R8G8B8A8_SINT: *type = VBTextComponent::SINT8; *components = 4; return true;
+		case DXGI_FORMAT_R8G8_SINT:     *type = VBTextComponent::SINT8; *components = 2; return true;
+		case DXGI_FORMAT_R8_SINT:       *type = VBTextComponent::SINT8; *components = 1; return true;
+
+		case DXGI_FORMAT_R32G8X24_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+		case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+			*type = VBTextComponent::DEPTH32_STENCIL8; *components = 2; return true;
+
+		case DXGI_FORMAT_R24G8_TYPELESS:
+		case DXGI_FORMAT_D24_UNORM_S8_UINT:
+		case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+		case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+			*type = VBTextComponent::DEPTH24_STENCIL8; *components = 2; return true;
+
+		// TODO: Unusual field sizes:
+		// case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+		// case DXGI_FORMAT_R10G10B10A2_UNORM:
+		// case DXGI_FORMAT_R10G10B10A2_UINT:
+		// case DXGI_FORMAT_R11G11B10_FLOAT:
+		// case DXGI_FORMAT_R1_UNORM:
+		// case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+		// case DXGI_FORMAT_B5G6R5_UNORM:
+		// case DXGI_FORMAT_B5G5R5A1_UNORM:
+		// case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+	}
+	return false;
+}
+
+VertexBufferTextFormatter::VertexBufferTextFormatter(D3D11_INPUT_ELEMENT_DESC *layout_desc,
+		size_t layout_elements, int slot, D3D11_INPUT_CLASSIFICATION slot_class) :
+	per_instance(slot_class == D3D11_INPUT_PER_INSTANCE_DATA)
+{
+	D3D11_INPUT_ELEMENT_DESC *desc;
+	char buf[32];
+	size_t i;
+
+	sprintf_s(buf, ARRAYSIZE(buf), "vb%i[", slot);
+	prefix = buf;
+
+	for (i = 0; i < layout_elements; i++) {
+		desc = &layout_desc[i];
+		if (desc->InputSlotClass != slot_class || desc->InputSlot != slot)
+			continue;
+
+		Element elem = {};
+
+		// XXX: An appended element is decoded from the start of the
+		// vertex, not after the previous element. That has always been
+		// the case, and is kept so the dumps don't change:
+		if (desc->AlignedByteOffset != D3D11_APPEND_ALIGNED_ELEMENT)
+			elem.offset = desc->AlignedByteOffset;
+		else if (!dxgi_format_alignment(desc->Format))
+			elem.warnings_before = "# WARNING: Unknown format alignment, vertex buffer may be decoded incorrectly\n";
+
+		sprintf_s(buf, ARRAYSIZE(buf), "]+%03u ", elem.offset);
+		elem.label = buf;
+		elem.label += desc->SemanticName;
+		if (desc->SemanticIndex) {
+			sprintf_s(buf, ARRAYSIZE(buf), "%u", desc->SemanticIndex);
+			elem.label += buf;
+		}
+		elem.label += ": ";
+
+		elem.size = dxgi_format_size(desc->Format);
+		if (!elem.size)
+			elem.warnings_after = "# WARNING: Unknown format size, vertex buffer may be decoded incorrectly\n";
+
+		if (!vb_text_component_type(desc->Format, &elem.type, &elem.components)) {
+			elem.type = VBTextComponent::RAW;
+			elem.components = elem.size;
+		}
+
+		elem.step_rate = per_instance ? desc->InstanceDataStepRate : 0;
+
+		elements.push_back(elem);
+	}
+}
+
+// Same bit manipulation as the scalar conversion this replaced, including
+// treating denormals as if they had an exponent of -127:
+static inline __m128i float16_to_float32_x4(__m128i h)
+{
+	__m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+	__m128i mantissa = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x3ff)), 13);
+	__m128i exponent = _mm_and_si128(h, _mm_set1_epi32(0x7c00));
+	__m128i zero = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+	__m128i special = _mm_cmpeq_epi32(exponent, _mm_set1_epi32(0x7c00));
+	__m128i rebiased = _mm_add_epi32(_mm_slli_epi32(exponent, 13), _mm_set1_epi32((127 - 15) << 23));
+
+	rebiased = _mm_andnot_si128(zero, rebiased);
+	rebiased = _mm_or_si128(_mm_andnot_si128(special, rebiased),
+			_mm_and_si128(special, _mm_set1_epi32(0x7f800000)));
+
+	return _mm_or_si128(_mm_or_si128(sign, mantissa), rebiased);
+}
+
+// Must divide rather than multiply by the reciprocal - the latter is off by
+// one ulp for some values, which shows up in the %.9g output:
+static inline __m128i normalise_x4(__m128i val, float max)
+{
+	return _mm_castps_si128(_mm_div_ps(_mm_cvtepi32_ps(val), _mm_set1_ps(max)));
+}
+
+static inline __m128i zero_extend_16_x4(__m128i val)
+{
+	return _mm_unpacklo_epi16(val, _mm_setzero_si128());
+}
+
+static inline __m128i sign_extend_16_x4(__m128i val)
+{
+	return _mm_srai_epi32(_mm_unpacklo_epi16(val, val), 16);
+}
+
+static inline __m128i zero_extend_8_x4(__m128i val)
+{
+	return zero_extend_16_x4(_mm_unpacklo_epi8(val, _mm_setzero_si128()));
+}
+
+static inline __m128i sign_extend_8_x4(__m128i val)
+{
+	val = _mm_unpacklo_epi8(val, val);
+	return _mm_srai_epi32(_mm_unpacklo_epi16(val, val), 24);
+}
+
+// Decodes one element from each of n rows into four 32-bit values per row -
+// floats for any normalised or floating point types, integers otherwise:
+void VertexBufferTextFormatter::decode(const Element *elem, const uint8_t *const *rows,
+		UINT n, const uint8_t *end, uint32_t *values)
+{
+	__m128i raw, val;
+	uint8_t bytes[16];
+	const uint8_t *src;
+	size_t avail;
+	float depth;
+	UINT i;
+
+	for (i = 0; i < n; i++, values += 4) {
+		// Copying is the simplest way to load just the bytes of this
+		// element. It also stops us from reading past the end of the
+		// buffer if the element overruns the stride on the last vertex:
+		memset(bytes, 0, sizeof(bytes));
+		src = rows[i] + elem->offset;
+		avail = src < end ? end - src : 0;
+		memcpy(bytes, src, min((size_t)elem->size, min(avail, sizeof(bytes))));
+		raw = _mm_loadu_si128((__m128i*)bytes);
+
+		switch (elem->type) {
+			case VBTextComponent::HEX16:
+			case VBTextComponent::UINT16:
+				val = zero_extend_16_x4(raw);
+				break;
+			case VBTextComponent::SINT16:
+				val = sign_extend_16_x4(raw);
+				break;
+			case VBTextComponent::FLOAT16:
+				val = float16_to_float32_x4(zero_extend_16_x4(raw));
+				break;
+			case VBTextComponent::UNORM16:
+				val = normalise_x4(zero_extend_16_x4(raw), (float)0xffff);
+				break;
+			case VBTextComponent::SNORM16:
+				val = normalise_x4(sign_extend_16_x4(raw), (float)0x7fff);
+				break;
+			case VBTextComponent::HEX8:
+			case VBTextComponent::UINT8:
+				val = zero_extend_8_x4(raw);
+				break;
+			case VBTextComponent::SINT8:
+				val = sign_extend_8_x4(raw);
+				break;
+			case VBTextComponent::UNORM8:
+				val = normalise_x4(zero_extend_8_x4(raw), (float)0xff);
+				break;
+			case VBTextComponent::SNORM8:
+				val = normalise_x4(sign_extend_8_x4(raw), (float)0x7f);
+				break;
+			case VBTextComponent::DEPTH32_STENCIL8:
+				val = _mm_setr_epi32(*(int*)&bytes[0], bytes[4], 0, 0);
+				break;
+			case VBTextComponent::DEPTH24_STENCIL8:
+				depth = (float)(*(uint32_t*)&bytes[0] & 0xffffff) / (float)0xffffff;
+				val = _mm_setr_epi32(*(int*)&depth, bytes[3], 0, 0);
+				break;
+			default: // 32-bit types and RAW are used as is
+				val = raw;
+				break;
+		}
+
+		_mm_storeu_si128((__m128i*)values, val);
+	}
+}
+
+static const char vb_text_digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static char* format_uint(char *buf, uint32_t val)
+{
+	char tmp[10];
+	char *pos = tmp + sizeof(tmp);
+	size_t len;
+
+	while (val >= 100) {
+		pos -= 2;
+		memcpy(pos, &vb_text_digit_pairs[(val % 100) * 2], 2);
+		val /= 100;
+	}
+	if (val >= 10) {
+		pos -= 2;
+		memcpy(pos, &vb_text_digit_pairs[val * 2], 2);
+	} else {
+		*--pos = (char)('0' + val);
+	}
+
+	len = tmp + sizeof(tmp) - pos;
+	memcpy(buf, pos, len);
+	return buf + len;
+}
+
+static char* format_int(char *buf, int32_t val)
+{
+	if (val < 0) {
+		*buf++ = '-';
+		return format_uint(buf, 0u - (uint32_t)val);
+	}
+	return format_uint(buf, (uint32_t)val);
+}
+
+static char* format_hex(char *buf, uint32_t val, int digits)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+
+	for (i = digits - 1; i >= 0; i--, val >>= 4)
+		buf[i] = hex[val & 0xf];
+	return buf + digits;
+}
+
+// Exact powers of ten that fit in a double:
+static const double vb_text_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static double scale_pow10(double val, int exp10)
+{
+	for (; exp10 > 22; exp10 -= 22)
+		val *= 1e22;
+	for (; exp10 < -22; exp10 += 22)
+		val /= 1e22;
+	if (exp10 >= 0)
+		return val * vb_text_pow10[exp10];
+	return val / vb_text_pow10[-exp10];
+}
+
+// Equivalent to sprintf("%.9g", val) for a float. Any float scaled to nine
+// significant digits in a double is within a handful of ulps of the exact
+// value, which is plenty to round correctly unless the exact value is very
+// close to halfway between two nine digit numbers. Those are rare, and are
+// handed to the CRT along with infinities and NaNs, so that halfway cases
+// come out the same as they would from its printf (older Windows CRTs round
+// them differently to newer ones).
+int format_float_g9(char *buf, float val)
+{
+	double d = val, scaled, frac;
+	char digits[9], *pos = buf;
+	uint32_t n;
+	int exp2, exp10, i, last;
+
+	if (!_finite(d))
+		return sprintf_s(buf, 32, "%.9g", d);
+
+	if (d == 0) {
+		if (_copysign(1.0, d) < 0)
+			*pos++ = '-';
+		*pos++ = '0';
+		return (int)(pos - buf);
+	}
+
+	if (d < 0) {
+		*pos++ = '-';
+		d = -d;
+	}
+
+	// Estimate the decimal exponent from the binary one, then correct it:
+	frexp(d, &exp2);
+	exp10 = (int)floor((exp2 - 1) * 0.30102999566398120);
+	scaled = scale_pow10(d, 8 - exp10);
+	while (scaled >= 1e9) {
+		exp10++;
+		scaled = scale_pow10(d, 8 - exp10);
+	}
+	while (scaled < 1e8) {
+		exp10--;
+		scaled = scale_pow10(d, 8 - exp10);
+	}
+
+	n = (uint32_t)scaled;
+	frac = scaled - n;
+	if (fabs(frac - 0.5) < 1e-5)
+		return sprintf_s(buf, 32, "%.9g", (double)val);
+	if (frac > 0.5 && ++n == 1000000000) {
+		n = 100000000;
+		exp10++;
+	}
+
+	for (i = 8; i >= 0; i--, n /= 10)
+		digits[i] = (char)('0' + n % 10);
+	for (last = 8; last > 0 && digits[last] == '0'; last--);
+
+	if (exp10 < -4 || exp10 >= 9) {
+		*pos++ = digits[0];
+		if (last > 0) {
+			*pos++ = '.';
+			memcpy(pos, digits + 1, last);
+			pos += last;
+		}
+		*pos++ = 'e';
+		*pos++ = exp10 < 0 ? '-' : '+';
+		exp10 = abs(exp10);
+		memcpy(pos, &vb_text_digit_pairs[exp10 * 2], 2);
+		pos += 2;
+	} else if (exp10 >= 0) {
+		memcpy(pos, digits, exp10 + 1);
+		pos += exp10 + 1;
+		if (last > exp10) {
+			*pos++ = '.';
+			memcpy(pos, digits + exp10 + 1, last - exp10);
+			pos += last - exp10;
+		}
+	} else {
+		*pos++ = '0';
+		*pos++ = '.';
+		for (i = exp10 + 1; i < 0; i++)
+			*pos++ = '0';
+		memcpy(pos, digits, last + 1);
+		pos += last + 1;
+	}
+
+	return (int)(pos - buf);
+}
+
+static char* format_components(char *pos, VBTextComponent type, UINT components,
+		const uint32_t *values)
+{
+	UINT i;
+
+	switch (type) {
+		case VBTextComponent::RAW:
+			for (i = 0; i < components; i++)
+				pos = format_hex(pos, ((uint8_t*)values)[i], 2);
+			return pos;
+		case VBTextComponent::DEPTH32_STENCIL8:
+		case VBTextComponent::DEPTH24_STENCIL8:
+			pos += format_float_g9(pos, *(float*)&values[0]);
+			*pos++ = ',';
+			*pos++ = ' ';
+			return format_int(pos, (int32_t)values[1]);
+	}
+
+	for (i = 0; i < components; i++) {
+		if (i) {
+			*pos++ = ',';
+			*pos++ = ' ';
+		}
+		switch (type) {
+			case VBTextComponent::HEX32:
+				pos = format_hex(pos, values[i], 8);
+				break;
+			case VBTextComponent::HEX16:
+				pos = format_hex(pos, values[i], 4);
+				break;
+			case VBTextComponent::HEX8:
+				pos = format_hex(pos, values[i], 2);
+				break;
+			case VBTextComponent::UINT32:
+			case VBTextComponent::UINT16:
+			case VBTextComponent::UINT8:
+				pos = format_uint(pos, values[i]);
+				break;
+			case VBTextComponent::SINT32:
+			case VBTextComponent::SINT16:
+			case VBTextComponent::SINT8:
+				pos = format_int(pos, (int32_t)values[i]);
+				break;
+			default:
+				pos += format_float_g9(pos, *(float*)&values[i]);
+				break;
+		}
+	}
+
+	return pos;
+}
+
+void VertexBufferTextFormatter::format(std::string *out, FILE *fd, const uint8_t *data,
+		UINT size, UINT offset, UINT first, UINT count, UINT stride)
+{
+	std::vector<uint32_t> values(elements.size() * VB_TEXT_BATCH * 4);
+	std::vector<UINT> indices(elements.size() * VB_TEXT_BATCH);
+	const uint8_t *rows[VB_TEXT_BATCH];
+	const uint8_t *end = data + size;
+	const Element *elem;
+	UINT start, stop, batch, n, i, e, idx;
+	char line[128], *pos;
+
+	if (!stride)
+		return;
+
+	start = offset / stride + first;
+	stop = size / stride;
+	if (count)
+		stop = min(stop, start + count);
+
+	for (batch = start; batch < stop; batch += n) {
+		n = min(stop - batch, (UINT)VB_TEXT_BATCH);
+
+		// Decode each element for the whole batch. Instanced elements
+		// advance at their own step rate, so each has its own rows:
+		for (e = 0; e < elements.size(); e++) {
+			elem = &elements[e];
+			for (i = 0; i < n; i++) {
+				idx = batch + i;
+				if (elem->step_rate)
+					idx = (idx - start) / elem->step_rate + start;
+				indices[e * VB_TEXT_BATCH + i] = idx - start;
+				rows[i] = data + stride * idx;
+			}
+			decode(elem, rows, n, end, &values[e * VB_TEXT_BATCH * 4]);
+		}
+
+		for (i = 0; i < n; i++) {
+			out->push_back('\n');
+			for (e = 0; e < elements.size(); e++) {
+				elem = &elements[e];
+
+				out->append(elem->warnings_before);
+				out->append(prefix);
+				pos = format_uint(line, indices[e * VB_TEXT_BATCH + i]);
+				out->append(line, pos - line);
+				out->append(elem->label);
+
+				pos = format_components(line, elem->type, elem->components,
+						&values[(e * VB_TEXT_BATCH + i) * 4]);
+				*pos++ = '\n';
+				out->append(line, pos - line);
+
+				out->append(elem->warnings_after);
+				if (elem->offset + elem->size > stride)
+					out->append(vb_text_stride_warning, sizeof(vb_text_stride_warning) - 1);
+			}
+		}
+
+		if (fd && out->size() >= VB_TEXT_FLUSH_SIZE) {
+			fwrite(out->data(), 1, out->size(), fd);
+			out->clear();
+		}
+	}
+
+	if (fd && !out->empty()) {
+		fwrite(out->data(), 1, out->size(), fd);
+		out->clear();
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Formats vertex buffers as text for frame analysis (the vertex-data and
+// instance-data sections of the vb*.txt files). Dumping the vertex buffers of
+// a mesh heavy scene can produce hundreds of MB of text, and going through a
+// switch and a few fprintf calls for every element was entirely CPU bound, so
+// the input layout is now compiled into a plan once per dump:
+//
+// - Each element that applies to the slot is reduced to a component type and
+//   count, with its label ("]+012 TEXCOORD1: ") and any warnings preformatted.
+// - Vertices are processed in batches. Each element is decoded for the whole
+//   batch at once, with the float16 / unorm / snorm conversions done four
+//   components at a time with SSE2.
+// - Numbers are formatted straight into a large output buffer without going
+//   through printf.
+//
+// The output is byte for byte the same as the printf based formatter this
+// replaced. In particular floats are still printed as %.9g, not as the
+// shortest string that would round trip, since existing scripts parse these
+// files. cmd_DirectX11Tests --benchmark-vb-text compares the two.
+
+enum class VBTextComponent {
+	HEX32,
+	FLOAT32,
+	UINT32,
+	SINT32,
+	HEX16,
+	FLOAT16,
+	UNORM16,
+	SNORM16,
+	UINT16,
+	SINT16,
+	HEX8,
+	UNORM8,
+	SNORM8,
+	UINT8,
+	SINT8,
+	DEPTH32_STENCIL8,
+	DEPTH24_STENCIL8,
+	RAW, // Unsupported format, hexdump of each byte
+};
+
+class VertexBufferTextFormatter
+{
+public:
+	// Compiles the plan for the elements of layout_desc that read from
+	// slot with the given classification:
+	VertexBufferTextFormatter(D3D11_INPUT_ELEMENT_DESC *layout_desc,
+			size_t layout_elements, int slot,
+			D3D11_INPUT_CLASSIFICATION slot_class);
+
+	// Appends the text for each vertex / instance in the range to *out. If
+	// fd is not NULL the text is written out whenever a few MB have built
+	// up and once more at the end, leaving *out empty.
+	void format(std::string *out, FILE *fd, const uint8_t *data, UINT size,
+			UINT offset, UINT first, UINT count, UINT stride);
+
+private:
+	struct Element {
+		VBTextComponent type;
+		UINT components; // Or bytes for RAW
+		UINT offset;
+		UINT size;
+		UINT step_rate;
+		std::string warnings_before;
+		std::string label;
+		std::string warnings_after;
+	};
+
+	std::vector<Element> elements;
+	std::string prefix;
+	bool per_instance;
+
+	void decode(const Element *elem, const uint8_t *const *rows,
+			UINT n, const uint8_t *end, uint32_t *values);
+};
+
+// Exposed for the benchmark. Returns the length written to buf, which must
+// have room for at least 32 characters:
+int format_float_g9(char *buf, float val);
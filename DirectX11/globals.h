@@ -15,7 +15,11 @@
 #include "DecompileHLSL.h"
 
 #include "ResourceHash.h"
+#include "ResourceHandleTable.h"
+#include "OverrideLookupTable.h"
 #include "CommandList.h"
+#include "FrameAnalysisArchive.h"
+#include "FrameAnalysisWriter.h"
 #include "profiling.h"
 #include "lock.h"
 
@@ -25,6 +29,7 @@ extern HINSTANCE migoto_handle;
 // CommandList.h -> HackerContext.h -> Globals.h
 class CommandListCommand;
 class CommandList;
+class ShaderRegexJob;
 
 
 enum HuntingMode {
@@ -81,11 +86,13 @@ enum class ShaderHashType {
 	FNV,
 	EMBEDDED,
 	BYTECODE,
+	XXHASH64,
 };
 static EnumName_t<const wchar_t *, ShaderHashType> ShaderHashNames[] = {
 	{L"3dmigoto", ShaderHashType::FNV},
 	{L"embedded", ShaderHashType::EMBEDDED},
 	{L"bytecode", ShaderHashType::BYTECODE},
+	{L"xxhash64", ShaderHashType::XXHASH64},
 	{NULL, ShaderHashType::INVALID} // End of list marker
 };
 
@@ -118,6 +125,7 @@ struct OriginalShaderInfo
 	bool found;
 	bool deferred_replacement_candidate;
 	bool deferred_replacement_processed;
+	std::shared_ptr<ShaderRegexJob> regex_job; // Queued at creation
 	std::wstring infoText;
 };
 
@@ -185,6 +193,7 @@ enum class FrameAnalysisOptions {
 	DEFRD_CTX_DELAY = 0x00800000,
 	DEFRD_CTX_MASK  = 0x00c00000,
 	SYMLINK         = 0x01000000,
+	ARCHIVE         = 0x02000000,
 	DEPRECATED      = (signed)0x80000000,
 };
 SENSIBLE_ENUM(FrameAnalysisOptions);
@@ -227,6 +236,7 @@ static EnumName_t<wchar_t *, FrameAnalysisOptions> FrameAnalysisOptionNames[] =
 	{L"deferred_ctx_accurate", FrameAnalysisOptions::DEFRD_CTX_DELAY},
 	{L"share_dupes", FrameAnalysisOptions::SHARE_DEDUPED},
 	{L"symlink", FrameAnalysisOptions::SYMLINK},
+	{L"archive", FrameAnalysisOptions::ARCHIVE},
 
 	// Legacy combo options:
 	{L"dump_rt_jps", FrameAnalysisOptions::DUMP_RT_JPS},
@@ -277,6 +287,7 @@ struct ShaderOverride {
 	}
 };
 typedef std::unordered_map<UINT64, struct ShaderOverride> ShaderOverrideMap;
+typedef OverrideLookupTable<UINT64, struct ShaderOverride> ShaderOverrideIndex;
 
 struct TextureOverride {
 	std::wstring ini_section;
@@ -321,7 +332,7 @@ struct TextureOverride {
 	{}
 };
 
-typedef std::unordered_map<ID3D11Resource *, ResourceHandleInfo> ResourceMap;
+typedef ResourceHandleTable<ID3D11Resource *, ResourceHandleInfo> ResourceMap;
 
 // The TextureOverrideList will be sorted because we want multiple
 // [TextureOverrides] that share the same hash (differentiated by draw context
@@ -331,6 +342,7 @@ typedef std::unordered_map<ID3D11Resource *, ResourceHandleInfo> ResourceMap;
 // will sort it in the ini parser when we create the list.
 typedef std::vector<struct TextureOverride> TextureOverrideList;
 typedef std::unordered_map<uint32_t, TextureOverrideList> TextureOverrideMap;
+typedef OverrideLookupTable<uint32_t, TextureOverrideList> TextureOverrideIndex;
 
 // We use this when collecting resource info for ShaderUsage.txt to take a
 // snapshot of the resource handle, hash and original hash. We used to just
@@ -458,18 +470,26 @@ struct Globals
 	wchar_t ANALYSIS_PATH[MAX_PATH];
 	FrameAnalysisOptions def_analyse_options, cur_analyse_options;
 	std::unordered_set<void*> frame_analysis_seen_rts;
+	FrameAnalysisArchive frame_analysis_archive;
+	FrameAnalysisWriter frame_analysis_writer;
+	int analyse_writer_threads;
+	int analyse_writer_memory; // MB
 
 	ShaderHashType shader_hash_type;
 	int texture_hash_version;
+	bool async_texture_hash;
+	bool texture_hash_affects_creation;
 	int EXPORT_HLSL;		// 0=off, 1=HLSL only, 2=HLSL+OriginalASM, 3= HLSL+OriginalASM+recompiledASM
 	bool EXPORT_SHADERS, EXPORT_FIXED, EXPORT_BINARY, CACHE_SHADERS, SCISSOR_DISABLE;
 	int track_texture_updates;
 	bool assemble_signature_comments;
 	bool disassemble_undecipherable_custom_data;
 	bool patch_cb_offsets;
+	int shader_regex_threads;
 	int recursive_include;
 	uint32_t ZBufferHashToInject;
 	DecompilerSettings decompiler_settings;
+	bool decompiler_cache;
 	bool DumpUsage;
 	bool ENABLE_TUNE;
 	float gTuneValue[4], gTuneStep;
@@ -548,6 +568,8 @@ struct Globals
 
 	ShaderOverrideMap mShaderOverrideMap;
 	TextureOverrideMap mTextureOverrideMap;
+	ShaderOverrideIndex mShaderOverrideIndex;				// What the draw calls look up - build() or insert() after adding to the map
+	TextureOverrideIndex mTextureOverrideIndex;
 	FuzzyTextureOverrides mFuzzyTextureOverrides;
 
 	// Statistics
@@ -557,7 +579,8 @@ struct Globals
 	//                  < AB-BA TYPE DEADLOCK WARNING! >                 //
 	//                  <==============================>                 //
 	//                                                                   //
-	// mResources is now protected by its own lock.                      //
+	// mResources is now protected by its own lock. Lookups are lock     //
+	// free and don't need it, but adding or removing a resource does.   //
 	//                                                                   //
 	// Never call into DirectX while holding g->mResourcesLock. DirectX  //
 	// can take a lock of it's own, introducing a locking dependency. At //
@@ -640,14 +663,19 @@ struct Globals
 		analyse_frame_no(0),
 		def_analyse_options(FrameAnalysisOptions::INVALID),
 		cur_analyse_options(FrameAnalysisOptions::INVALID),
+		analyse_writer_threads(2),
+		analyse_writer_memory(512),
 
 		shader_hash_type(ShaderHashType::FNV),
 		texture_hash_version(0),
+		async_texture_hash(false),
+		texture_hash_affects_creation(true),
 		EXPORT_SHADERS(false),
 		EXPORT_HLSL(0),
 		EXPORT_FIXED(false),
 		EXPORT_BINARY(false),
 		CACHE_SHADERS(false),
+		decompiler_cache(true),
 		DumpUsage(false),
 		ENABLE_TUNE(false),
 		gTuneStep(0.001f),
@@ -714,6 +742,9 @@ struct Globals
 	}
 };
 
+class ShaderRegexMatchContext;
+void free_shader_regex_match_context(ShaderRegexMatchContext *context);
+
 // Everything in this struct has a unique copy per thread. It would be vastly
 // simpler to just use the "thread_local" keyword, but MSDN warns that it can
 // interfere with delay loading DLLs (without any detail as to what it means by
@@ -745,9 +776,18 @@ struct TLS
 
 	LockStack locks_held;
 
+	// pcre2 match data and JIT stack for ShaderRegex, created on demand:
+	ShaderRegexMatchContext *shader_regex_context;
+
 	TLS() :
-		hooking_quirk_protection(false)
+		hooking_quirk_protection(false),
+		shader_regex_context(NULL)
 	{}
+
+	~TLS()
+	{
+		free_shader_regex_match_context(shader_regex_context);
+	}
 };
 
 extern DWORD tls_idx;
@@ -781,17 +821,17 @@ static inline ShaderReplacementMap::iterator lookup_original_shader(ID3D11Device
 	return Profiling::lookup_map(G->mOriginalShaders, shader, &Profiling::shader_original_lookup_overhead);
 }
 
-static inline ShaderOverrideMap::iterator lookup_shaderoverride(UINT64 hash)
+static inline ShaderOverride* lookup_shaderoverride(UINT64 hash)
 {
-	return Profiling::lookup_map(G->mShaderOverrideMap, hash, &Profiling::shaderoverride_lookup_overhead);
+	return Profiling::lookup_table(G->mShaderOverrideIndex, hash, &Profiling::shaderoverride_lookup_overhead);
 }
 
-static inline ResourceMap::iterator lookup_resource_handle_info(ID3D11Resource *resource)
+static inline ResourceHandleInfo* lookup_resource_handle_info(ID3D11Resource *resource)
 {
-	return Profiling::lookup_map(G->mResources, resource, &Profiling::texture_handle_info_lookup_overhead);
+	return Profiling::lookup_table(G->mResources, resource, &Profiling::texture_handle_info_lookup_overhead);
 }
 
-static inline TextureOverrideMap::iterator lookup_textureoverride(uint32_t hash)
+static inline TextureOverrideList* lookup_textureoverride(uint32_t hash)
 {
-	return Profiling::lookup_map(G->mTextureOverrideMap, hash, &Profiling::textureoverride_lookup_overhead);
+	return Profiling::lookup_table(G->mTextureOverrideIndex, hash, &Profiling::textureoverride_lookup_overhead);
 }
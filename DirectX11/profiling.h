@@ -58,6 +58,25 @@ namespace Profiling {
 		return ret;
 	}
 
+	// Same again for the tables that return a pointer to the value, or NULL
+	template<class T>
+	static inline typename T::mapped_type* lookup_table(T &table, typename T::key_type key, Profiling::Overhead *overhead)
+	{
+		Profiling::State state;
+
+		if (Profiling::mode == Profiling::Mode::SUMMARY) {
+			overhead->count++;
+			Profiling::start(&state);
+		}
+		auto ret = table.find(key);
+		if (Profiling::mode == Profiling::Mode::SUMMARY) {
+			Profiling::end(&state, overhead);
+			if (ret)
+				overhead->hits++;
+		}
+		return ret;
+	}
+
 	void update_txt();
 	void update_cto_warning(bool warn);
 	void clear();
@@ -1072,6 +1072,11 @@ static UINT64 hash_shader(const void *pShaderBytecode, SIZE_T BytecodeLength)
 			goto fnv;
 		LogInfo("  Bytecode hash = %016I64x\n", hash);
 		break;
+
+	case ShaderHashType::XXHASH64:
+		hash = xxhash64_buf(pShaderBytecode, BytecodeLength);
+		LogInfo("  XXH64 hash = %016I64x\n", hash);
+		break;
 	}
 
 	return hash;
@@ -93,11 +93,13 @@ enum class ShaderHashType {
 	FNV,
 	EMBEDDED,
 	BYTECODE,
+	XXHASH64,
 };
 static EnumName_t<const wchar_t *, ShaderHashType> ShaderHashNames[] = {
 	{ L"3dmigoto", ShaderHashType::FNV },
 	{ L"embedded", ShaderHashType::EMBEDDED },
 	{ L"bytecode", ShaderHashType::BYTECODE },
+	{ L"xxhash64", ShaderHashType::XXHASH64 },
 	{ NULL, ShaderHashType::INVALID } // End of list marker
 };
 
@@ -451,30 +451,8 @@ static uint32_t hash_tex2d_data(uint32_t hash, const void *data, size_t length,
 
 	GetSurfaceInfo(pDesc->Width, pDesc->Height, pDesc->Format, &slice_pitch, &row_pitch, &row_count);
 
-	uint8_t *sptr = (uint8_t*)data;
-	size_t msize = min(row_pitch, mapped_row_pitch);
-
-	signed padding = (signed)mapped_row_pitch - (signed)row_pitch;
-	uint8_t *zeroes = NULL;
-	if (zero_padding && padding > 0) {
-		zeroes = new uint8_t[padding];
-		memset(zeroes, 0, padding);
-	}
-
-	signed remaining = (signed)length;
-	for (size_t h = 0; h < row_count && remaining > 0; h++) {
-		hash = crc32c_hw(hash, sptr, min(msize, (unsigned)remaining));
-		sptr += mapped_row_pitch;
-		remaining -= (signed)msize;
-
-		if (zeroes && remaining > 0) {
-			hash = crc32c_hw(hash, zeroes, min(padding, remaining));
-			remaining -= padding;
-		}
-	}
-
-	delete[] zeroes;
-	return hash;
+	return crc32c_hw_texture_rows(hash, data, length, row_pitch, row_count,
+			mapped_row_pitch, zero_padding);
 }
 
 uint32_t Calc2DDataHash(const D3D2DTEXTURE_DESC *pDesc, const ::D3DLOCKED_BOX *pLockedBox)
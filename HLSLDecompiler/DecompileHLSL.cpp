@@ -25,6 +25,7 @@
 #include <algorithm>
 
 #include "DecompileHLSL.h"
+#include "DecompilerSymbols.h"
 
 #include "BinaryDecompiler\internal_includes\structs.h"
 #include "BinaryDecompiler\internal_includes\decode.h"
@@ -138,25 +139,19 @@ public:
 	// Resources.
 	map<string, int> mCBufferNames;
 
-	map<int, string> mSamplerNames;
-	map<int, int>    mSamplerNamesArraySize;
-	map<int, string> mSamplerComparisonNames;
-	map<int, int>    mSamplerComparisonNamesArraySize;
-
-	map<int, string> mTextureNames;
-	map<int, int>    mTextureNamesArraySize;
-	map<int, string> mTextureType;
-
-	map<int, string> mUAVNames;
-	map<int, int>    mUAVNamesArraySize;
-	map<int, string> mUAVType;
+	// Per-register tables, see DecompilerSymbols.h. These belong to a
+	// DecompilerSymbols that may be reused for other shaders in a batch:
+	RegisterTable *mSamplers;
+	RegisterTable *mSamplerComparisons;
+	RegisterTable *mTextures;
+	RegisterTable *mUAVs;
 
 	map<string, string> mStructuredBufferTypes;
 	set<string> mStructuredBufferUsedNames;
 
 	//dx9
-	map<int, string> mUniformNames;
-	map<int, string> mBoolUniformNames;
+	RegisterTable *mUniforms;
+	RegisterTable *mBoolUniforms;
 	map<int, ConstantValue> mConstantValues;
 	map<int, string> mInputNames;
 	//dx9
@@ -168,11 +163,13 @@ public:
 	string mSV_Position;
 	bool mUsesProjection;
 	Instruction *mLastStatement;
+	bool mDecodedOperands;		// Source operands can be formatted from the Instruction (not DX9)
 	string mMulOperand, mMulOperand2, mMulTarget;
 	StringStringMap mCorrectedIndexRegisters;
 	StringStringMap mRemappedOutputRegisters;
 	vector<pair<string, string> > mRemappedInputRegisters;
-	set<string> mBooleanRegisters;
+	set<string> mBooleanRegisters;		// Anything other than rN.[xyzw]
+	RegisterMaskTable *mBooleanTemps;
 
 	DecompilerSettings *G;
 
@@ -188,10 +185,22 @@ public:
 
 	Decompiler()
 		: mLastStatement(0),
+		mDecodedOperands(false),
 		uuidVar(0),
 		nestCount(0)
 	{}
 
+	void UseSymbols(DecompilerSymbols *symbols)
+	{
+		mSamplers = &symbols->Samplers;
+		mSamplerComparisons = &symbols->SamplerComparisons;
+		mTextures = &symbols->Textures;
+		mUAVs = &symbols->UAVs;
+		mUniforms = &symbols->Uniforms;
+		mBoolUniforms = &symbols->BoolUniforms;
+		mBooleanTemps = &symbols->BooleanTemps;
+	}
+
 	void logDecompileError(const string &err)
 	{
 		mErrorOccurred = true;
@@ -253,9 +262,14 @@ public:
 	// Make this bump to new line slightly more clear by making it a convenience routine.
 	static void NextLine(const char *c, size_t &pos, size_t max)
 	{
-		while (c[pos] != 0x0a && pos < max) 
-			pos++; 
-		pos++;
+		const char *eol;
+
+		if (pos >= max) {
+			pos++;
+			return;
+		}
+		eol = (const char*)memchr(c + pos, 0x0a, max - pos);
+		pos = (eol ? eol - c : max) + 1;
 	}
 
 	// Just take the current input line, and copy it to the output.
@@ -298,7 +312,7 @@ public:
 	// This does also unfortunately create warnings for the TEXCOORD outputs, but
 	// I was unable to find any other way to avoid the fxc packing optimization.
 
-	bool SkipPacking(const char *c, map<string, DataType> inUse)
+	bool SkipPacking(const char *c, const map<string, DataType> &inUse)
 	{
 		char name[256], mask[16], sysvalue[16], format[16];
 		int index, reg1, reg2; format[0] = 0; mask[0] = 0;
@@ -364,7 +378,7 @@ public:
 	{
 		string interpolation = "";
 
-		for each(Declaration declaration in shader->asPhase[MAIN_PHASE].ppsDecl[0])
+		for (const Declaration &declaration : shader->asPhase[MAIN_PHASE].ppsDecl[0])
 		{
 			if (declaration.eOpcode == OPCODE_DCL_INPUT_PS)
 			{
@@ -753,12 +767,9 @@ public:
 	void ReadResourceBindingsDX9(const char *c, size_t size)
 	{
 		mCBufferNames.clear();
-		mSamplerNames.clear();
-		mSamplerNamesArraySize.clear();
-		mSamplerComparisonNames.clear();
-		mSamplerComparisonNamesArraySize.clear();
-		mTextureNames.clear();
-		mTextureNamesArraySize.clear();
+		mSamplers->Clear();
+		mSamplerComparisons->Clear();
+		mTextures->Clear();
 
 		size_t pos = 0;
 		bool parseParameters = false;
@@ -823,19 +834,19 @@ public:
 				if (result[2].c_str()[0] == 's')
 				{
 					int slot = atoi(&result[2].c_str()[1]);
-					mTextureNames[slot] = result[1];
-					mTextureNamesArraySize[slot] = 1;
-					mTextureType[slot] = "Texture2D<float4>";
+					mTextures->SetName(slot, result[1]);
+					mTextures->SetArraySize(slot, 1);
+					mTextures->SetType(slot, "Texture2D<float4>");
 				}
 				else if (result[2].c_str()[0] == 'c')
 				{
 					int index = atoi(&result[2].c_str()[1]);
-					mUniformNames[index] = result[1];
+					mUniforms->SetName(index, result[1]);
 				}
 				if (result[2].c_str()[0] == 'b')
 				{
 					int index = atoi(&result[2].c_str()[1]);
-					mBoolUniformNames[index] = result[2];
+					mBoolUniforms->SetName(index, result[2]);
 				}
 			}
 		}
@@ -845,14 +856,10 @@ public:
 	void ReadResourceBindings(const char *c, size_t size)
 	{
 		mCBufferNames.clear();
-		mSamplerNames.clear();
-		mSamplerNamesArraySize.clear();
-		mSamplerComparisonNames.clear();
-		mSamplerComparisonNamesArraySize.clear();
-		mTextureNames.clear();
-		mTextureNamesArraySize.clear();
-		mUAVNames.clear();
-		mUAVNamesArraySize.clear();
+		mSamplers->Clear();
+		mSamplerComparisons->Clear();
+		mTextures->Clear();
+		mUAVs->Clear();
 		// Read until header.
 		const char *headerid = "// Resource Bindings:";
 		size_t pos = 0;
@@ -899,13 +906,13 @@ public:
 				char *escapePos = strchr(name, '['); if (escapePos) *escapePos = '_';
 				escapePos = strchr(name, ']'); if (escapePos) *escapePos = '_';
 				string baseName = string(name) + "_s";
-				mSamplerNames[slot] = baseName;
-				mSamplerNamesArraySize[slot] = arraySize;
+				mSamplers->SetName(slot, baseName);
+				mSamplers->SetArraySize(slot, arraySize);
 				if (arraySize > 1)
 					for (int i = 0; i < arraySize; ++i)
 					{
 					sprintf(name, "%s[%d]", baseName.c_str(), i);
-					mSamplerNames[slot + i] = name;
+					mSamplers->SetName(slot + i, name);
 					}
 			}
 			else if (!strcmp(type, "sampler_c"))
@@ -913,13 +920,13 @@ public:
 				char *escapePos = strchr(name, '['); if (escapePos) *escapePos = '_';
 				escapePos = strchr(name, ']'); if (escapePos) *escapePos = '_';
 				string baseName = string(name) + "_s";
-				mSamplerComparisonNames[slot] = baseName;
-				mSamplerComparisonNamesArraySize[slot] = arraySize;
+				mSamplerComparisons->SetName(slot, baseName);
+				mSamplerComparisons->SetArraySize(slot, arraySize);
 				if (arraySize > 1)
 					for (int i = 0; i < arraySize; ++i)
 					{
 					sprintf(name, "%s[%d]", baseName.c_str(), i);
-					mSamplerComparisonNames[slot + i] = name;
+					mSamplerComparisons->SetName(slot + i, name);
 					}
 			}
 			else if (!strcmp(type, "texture") || !strcmp(type, "UAV"))
@@ -927,38 +934,34 @@ public:
 				char *escapePos = strchr(name, '['); if (escapePos) *escapePos = '_';
 				escapePos = strchr(name, ']'); if (escapePos) *escapePos = '_';
 				string baseName = string(name);
-				map<int, string> *mNames = &mTextureNames;
-				map<int, int>    *mNamesArraySize = &mTextureNamesArraySize;
-				map<int, string> *mType = &mTextureType;
+				RegisterTable *mTable = mTextures;
 				std::string rw;
 
 				if (!strcmp(type, "UAV")) {
-					mNames = &mUAVNames;
-					mNamesArraySize = &mUAVNamesArraySize;
-					mType = &mUAVType;
+					mTable = mUAVs;
 					rw = "RW";
 				}
 
-				(*mNames)[slot] = baseName;
-				(*mNamesArraySize)[slot] = arraySize;
+				mTable->SetName(slot, baseName);
+				mTable->SetArraySize(slot, arraySize);
 				if (arraySize > 1)
 					for (int i = 0; i < arraySize; ++i)
 					{
 					sprintf(name, "%s[%d]", baseName.c_str(), i);
-					(*mNames)[slot + i] = name;
+					mTable->SetName(slot + i, name);
 					}
 				if (!strcmp(dim, "1d"))
-					(*mType)[slot] = rw + "Texture1D<" + string(format) + ">";
+					mTable->SetType(slot, rw + "Texture1D<" + string(format) + ">");
 				else if(!strcmp(dim, "2d"))
-					(*mType)[slot] = rw + "Texture2D<" + string(format) + ">";
+					mTable->SetType(slot, rw + "Texture2D<" + string(format) + ">");
 				else if (!strcmp(dim, "2darray"))
-					(*mType)[slot] = rw + "Texture2DArray<" + string(format) + ">";
+					mTable->SetType(slot, rw + "Texture2DArray<" + string(format) + ">");
 				else if (!strcmp(dim, "3d"))
-					(*mType)[slot] = rw + "Texture3D<" + string(format) + ">";
+					mTable->SetType(slot, rw + "Texture3D<" + string(format) + ">");
 				else if (!strcmp(dim, "cube"))
-					(*mType)[slot] = rw + "TextureCube<" + string(format) + ">";
+					mTable->SetType(slot, rw + "TextureCube<" + string(format) + ">");
 				else if (!strcmp(dim, "cubearray"))
-					(*mType)[slot] = rw + "TextureCubeArray<" + string(format) + ">";
+					mTable->SetType(slot, rw + "TextureCubeArray<" + string(format) + ">");
 				else if (!strncmp(dim, "2dMS", 4))
 				{
 					// The documentation says it's not legal, but we see Texture 2DMS with no ending size in WatchDogs. 
@@ -974,15 +977,15 @@ public:
 						sprintf(buffer, "Texture2DMS<%s,%d>", format, msnumber);
 					else
 						sprintf(buffer, "Texture2DMS<%s>", format);
-					(*mType)[slot] = rw + buffer;
+					mTable->SetType(slot, rw + buffer);
 				}
 				// Two new ones for Mordor.
 				else if (!strcmp(dim, "buf"))
-					(*mType)[slot] = rw + "Buffer<" + string(format) + ">";
+					mTable->SetType(slot, rw + "Buffer<" + string(format) + ">");
 				else if (!strcmp(format, "struct"))
-					(*mType)[slot] = rw + "StructuredBuffer<" + mStructuredBufferTypes[name] + ">";
+					mTable->SetType(slot, rw + "StructuredBuffer<" + mStructuredBufferTypes[name] + ">");
 				else if (!strcmp(format, "byte"))
-					(*mType)[slot] = rw + "ByteAddressBuffer";
+					mTable->SetType(slot, rw + "ByteAddressBuffer");
 				else
 					logDecompileError("Unknown " + string(type) + " dimension: " + string(dim));
 			}
@@ -1001,11 +1004,14 @@ public:
 		_snprintf_s(buffer, 256, 256, "\n");
 		mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 
-		for (map<int, string>::iterator i = mSamplerNames.begin(); i != mSamplerNames.end(); ++i)
+		for (int i = 0; i < mSamplers->End(); ++i)
 		{
-			if (mSamplerNamesArraySize[i->first] == 1)
+			if (!mSamplers->Has(i))
+				continue;
+			const string &name = mSamplers->Name(i);
+			if (mSamplers->ArraySize(i) == 1)
 			{
-				sprintf(buffer, "SamplerState %s : register(s%d);\n", i->second.c_str(), i->first);
+				sprintf(buffer, "SamplerState %s : register(s%d);\n", name.c_str(), i);
 				/*
 				sprintf(buffer, "SamplerState %s : register(s%d)\n"
 				"{\n"
@@ -1016,22 +1022,25 @@ public:
 				"  MinLOD = 0;\n"
 				"  MaxLOD = 0;\n"
 				"  MipLODBias = -100;\n"
-				"};\n", i->second.c_str(), i->first+5);
+				"};\n", name.c_str(), i+5);
 				*/
 				mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 			}
-			else if (mSamplerNamesArraySize[i->first] > 1)
+			else if (mSamplers->ArraySize(i) > 1)
 			{
-				string baseName = i->second.substr(0, i->second.find('['));
-				sprintf(buffer, "SamplerState %s[%d] : register(s%d);\n", baseName.c_str(), mSamplerNamesArraySize[i->first], i->first);
+				string baseName = name.substr(0, name.find('['));
+				sprintf(buffer, "SamplerState %s[%d] : register(s%d);\n", baseName.c_str(), mSamplers->ArraySize(i), i);
 				mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 			}
 		}
-		for (map<int, string>::iterator i = mSamplerComparisonNames.begin(); i != mSamplerComparisonNames.end(); ++i)
+		for (int i = 0; i < mSamplerComparisons->End(); ++i)
 		{
-			if (mSamplerComparisonNamesArraySize[i->first] == 1)
+			if (!mSamplerComparisons->Has(i))
+				continue;
+			const string &name = mSamplerComparisons->Name(i);
+			if (mSamplerComparisons->ArraySize(i) == 1)
 			{
-				sprintf(buffer, "SamplerComparisonState %s : register(s%d);\n", i->second.c_str(), i->first);
+				sprintf(buffer, "SamplerComparisonState %s : register(s%d);\n", name.c_str(), i);
 				/*
 				sprintf(buffer, "SamplerComparisonState %s : register(s%d)\n"
 				"{\n"
@@ -1042,42 +1051,48 @@ public:
 				"  MinLOD = 0;\n"
 				"  MaxLOD = 0;\n"
 				"  MipLODBias = -100;\n"
-				"};\n", i->second.c_str(), i->first+5);
+				"};\n", name.c_str(), i+5);
 				*/
 				mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 			}
-			else if (mSamplerComparisonNamesArraySize[i->first] > 1)
+			else if (mSamplerComparisons->ArraySize(i) > 1)
 			{
-				string baseName = i->second.substr(0, i->second.find('['));
-				sprintf(buffer, "SamplerComparisonState %s[%d] : register(s%d);\n", baseName.c_str(), mSamplerComparisonNamesArraySize[i->first], i->first);
+				string baseName = name.substr(0, name.find('['));
+				sprintf(buffer, "SamplerComparisonState %s[%d] : register(s%d);\n", baseName.c_str(), mSamplerComparisons->ArraySize(i), i);
 				mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 			}
 		}
-		for (map<int, string>::iterator i = mTextureNames.begin(); i != mTextureNames.end(); ++i)
+		for (int i = 0; i < mTextures->End(); ++i)
 		{
-			if (mTextureNamesArraySize[i->first] == 1)
+			if (!mTextures->Has(i))
+				continue;
+			const string &name = mTextures->Name(i);
+			if (mTextures->ArraySize(i) == 1)
 			{
-				sprintf(buffer, "%s %s : register(t%d);\n", mTextureType[i->first].c_str(), i->second.c_str(), i->first);
+				sprintf(buffer, "%s %s : register(t%d);\n", mTextures->Type(i).c_str(), name.c_str(), i);
 				mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 			}
-			else if (mTextureNamesArraySize[i->first] > 1)
+			else if (mTextures->ArraySize(i) > 1)
 			{
-				string baseName = i->second.substr(0, i->second.find('['));
-				sprintf(buffer, "%s %s[%d] : register(t%d);\n", mTextureType[i->first].c_str(), baseName.c_str(), mTextureNamesArraySize[i->first], i->first);
+				string baseName = name.substr(0, name.find('['));
+				sprintf(buffer, "%s %s[%d] : register(t%d);\n", mTextures->Type(i).c_str(), baseName.c_str(), mTextures->ArraySize(i), i);
 				mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 			}
 		}
-		for (map<int, string>::iterator i = mUAVNames.begin(); i != mUAVNames.end(); ++i)
+		for (int i = 0; i < mUAVs->End(); ++i)
 		{
-			if (mUAVNamesArraySize[i->first] == 1)
+			if (!mUAVs->Has(i))
+				continue;
+			const string &name = mUAVs->Name(i);
+			if (mUAVs->ArraySize(i) == 1)
 			{
-				sprintf(buffer, "%s %s : register(u%d);\n", mUAVType[i->first].c_str(), i->second.c_str(), i->first);
+				sprintf(buffer, "%s %s : register(u%d);\n", mUAVs->Type(i).c_str(), name.c_str(), i);
 				mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 			}
-			else if (mUAVNamesArraySize[i->first] > 1)
+			else if (mUAVs->ArraySize(i) > 1)
 			{
-				string baseName = i->second.substr(0, i->second.find('['));
-				sprintf(buffer, "%s %s[%d] : register(u%d);\n", mUAVType[i->first].c_str(), baseName.c_str(), mUAVNamesArraySize[i->first], i->first);
+				string baseName = name.substr(0, name.find('['));
+				sprintf(buffer, "%s %s[%d] : register(u%d);\n", mUAVs->Type(i).c_str(), baseName.c_str(), mUAVs->ArraySize(i), i);
 				mOutput.insert(mOutput.end(), buffer, buffer + strlen(buffer));
 			}
 		}
@@ -1793,8 +1808,20 @@ public:
 		{
 			char *endPos = strchr(beginPos, ',');
 			if (endPos) *endPos = 0;
-			sscanf_s(beginPos, "%f", args + i);
-			is_hex[i] = (sscanf_s(beginPos, " 0x%x", hex_args + i) == 1);
+			// strtof/strtoul rather than sscanf_s, since this runs
+			// for every component of every literal in the shader:
+			char *numEnd;
+			float value = strtof(beginPos, &numEnd);
+			if (numEnd != beginPos)
+				args[i] = value;
+			while (*beginPos == ' ')
+				beginPos++;
+			is_hex[i] = false;
+			if (beginPos[0] == '0' && beginPos[1] == 'x')
+			{
+				hex_args[i] = (unsigned)strtoul(beginPos + 2, &numEnd, 16);
+				is_hex[i] = (numEnd != beginPos + 2);
+			}
 			beginPos = endPos + 1;
 		}
 		if (pos == 1)
@@ -1830,6 +1857,22 @@ public:
 		}
 	}
 
+	// Matches the plain cb1[29] form of a constant buffer reference. This
+	// gives up on anything with a '+' in it so that it can never take an
+	// operand the cb%d[%[^+]+%d] variant in applySwizzle would have matched.
+	static bool ParseConstantBufferOffset(const char *strPos, int *bufIndex, int *bufOffset)
+	{
+		char *end;
+
+		if (strchr(strPos, '+') || strncmp(strPos, "cb", 2) || !isdigit((unsigned char)strPos[2]))
+			return false;
+		*bufIndex = strtol(strPos + 2, &end, 10);
+		if (end[0] != '[' || !isdigit((unsigned char)end[1]))
+			return false;
+		*bufOffset = strtol(end + 1, &end, 10);
+		return end[0] == ']';
+	}
+
 	void applySwizzle(const char *left, char *right, bool useInt = false)
 	{
 		char right2[opcodeSize];
@@ -1937,11 +1980,10 @@ public:
 
 			int index = atoi(&buff[1]);
 
-			std::map<int, string>::iterator it = mUniformNames.find(index);
-			if (it != mUniformNames.end())
+			if (mUniforms->Has(index))
 			{
 				string temp = right;
-				temp.replace(0, strlen(buff), it->second);
+				temp.replace(0, strlen(buff), mUniforms->Name(index));
 				strcpy_s(buff, opcodeSize, temp.c_str());
 			}
 
@@ -2032,8 +2074,14 @@ public:
 				// We use the unusual format of [^+] for the string lookup because ReadStatement has already 
 				// crushed the spaces out of the input.
 
+				// Like: cb1[29].xyzx  Checked first without sscanf_s since this is
+				// by far the most common and the scans below are comparatively slow.
+				if (ParseConstantBufferOffset(strPos, &bufIndex, &bufOffset))
+				{
+					regAndSwiz[0] = 0;
+				}
 				// Like: -cb2[r12.w+63].xyzx  as : -cb(bufIndex)[(regAndSwiz)+(bufOffset)]
-				if (sscanf_s(strPos, "cb%d[%[^+]+%d]", &bufIndex, regAndSwiz, UCOUNTOF(regAndSwiz), &bufOffset) == 3)
+				else if (sscanf_s(strPos, "cb%d[%[^+]+%d]", &bufIndex, regAndSwiz, UCOUNTOF(regAndSwiz), &bufOffset) == 3)
 				{
 					// Some constant buffers no longer have variable names, giving us generic names like cb0[23].
 					// The syntax doesn't work to use those names, so in this scenario, we want to just use the strPos name, unchanged.
@@ -2271,23 +2319,160 @@ public:
 			strcpy_s(right, opcodeSize, right2);		// All input params are 128 char arrays, like op1, op2, op3
 	}
 
+	// 3DMIGOTO ADDITION: Formats a source operand from the decoded instruction
+	// rather than the disassembly text, selecting the components in idx the
+	// same way applySwizzle() does. Only plain temp, input, output and
+	// resource registers are handled here, which is the bulk of the ALU, mov
+	// and sample operands. Returns false without touching right for anything
+	// else (literals, constant buffers, relative indexing, DX9...), which has
+	// to go through the text.
+	bool applyDecodedSwizzle(const Operand &src, const char idx[4], size_t count, char *right)
+	{
+		static const char components[] = "xyzw";
+		const char *reg, *format;
+		char swizzle[5];
+		size_t n = 0;
+
+		if (!mDecodedOperands || src.iNumComponents != 4 ||
+			src.iIndexDims != 1 || src.eIndexRep[0] != OPERAND_INDEX_IMMEDIATE32)
+			return false;
+
+		switch (src.eType)
+		{
+			case OPERAND_TYPE_TEMP: reg = "r"; break;
+			case OPERAND_TYPE_INPUT: reg = "v"; break;
+			case OPERAND_TYPE_OUTPUT: reg = "o"; break;
+			case OPERAND_TYPE_RESOURCE: reg = "t"; break;
+			case OPERAND_TYPE_UNORDERED_ACCESS_VIEW: reg = "u"; break;
+			default: return false;
+		}
+
+		switch (src.eModifier)
+		{
+			case OPERAND_MODIFIER_NONE: format = "%s%u.%s"; break;
+			case OPERAND_MODIFIER_NEG: format = "-%s%u.%s"; break;
+			case OPERAND_MODIFIER_ABS: format = "abs(%s%u.%s)"; break;
+			case OPERAND_MODIFIER_ABSNEG: format = "-abs(%s%u.%s)"; break;
+			default: return false;
+		}
+
+		// A single selected component is used as is, whatever the mask:
+		if (src.eSelMode == OPERAND_4_COMPONENT_SELECT_1_MODE)
+			swizzle[n++] = components[src.aui32Swizzle[0] & 3];
+		else if (src.eSelMode == OPERAND_4_COMPONENT_SWIZZLE_MODE)
+		{
+			for (; n < count; n++)
+				swizzle[n] = components[src.aui32Swizzle[idx[n]] & 3];
+		}
+		else
+			return false;
+		swizzle[n] = 0;
+
+		sprintf_s(right, opcodeSize, format, reg, src.ui32RegisterNumber, swizzle);
+		return true;
+	}
+
+	// applySwizzle() for a source operand of the current instruction, with a
+	// fixed mask on the left, like ".xyzw" for texture coordinates.
+	void applySwizzle(const char *left, char *right, const Operand &src, bool useInt = false)
+	{
+		const char *strPos = strrchr(left, '.');
+		char idx[4];
+		size_t count = 0;
+
+		strPos = strPos ? strPos + 1 : "x";
+		for (; *strPos && count < 4; strPos++)
+		{
+			if (*strPos < 'w' || *strPos > 'z')
+				break;
+			idx[count++] = (*strPos - 'x') & 3;
+		}
+
+		if ((*strPos && count < 4) || !count || !applyDecodedSwizzle(src, idx, count, right))
+			applySwizzle(left, right, useInt);
+	}
+
+	// applySwizzle() for a source operand of the current instruction, masked
+	// by the write mask of its decoded destination operand. Destinations that
+	// have no mask use the text, the same as before.
+	void applySwizzle(const char *left, const Operand &dst, char *right, const Operand &src, bool useInt = false)
+	{
+		char idx[4];
+		size_t count = 0;
+
+		if (dst.iNumComponents != 4 || dst.eSelMode != OPERAND_4_COMPONENT_MASK_MODE || !dst.ui32CompMask)
+		{
+			applySwizzle(left, right, src, useInt);
+			return;
+		}
+
+		for (char i = 0; i < 4; i++)
+		{
+			if (dst.ui32CompMask & (1 << i))
+				idx[count++] = i;
+		}
+
+		if (!applyDecodedSwizzle(src, idx, count, right))
+			applySwizzle(left, right, useInt);
+	}
+
 
 	char statement[128],
 		op1[opcodeSize], op2[opcodeSize], op3[opcodeSize], op4[opcodeSize], op5[opcodeSize], op6[opcodeSize], op7[opcodeSize], op8[opcodeSize],
 		op9[opcodeSize], op10[opcodeSize], op11[opcodeSize], op12[opcodeSize], op13[opcodeSize], op14[opcodeSize], op15[opcodeSize];
+
+	static bool IsStatementSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	static bool IsStatementWordChar(char c)
+	{
+		return (unsigned char)c > ' ' || (c && c != '\n' && !IsStatementSpace(c));
+	}
+
+	// Splits one line of the disassembly into the whitespace separated
+	// statement and operand words. This was a sscanf_s of sixteen %s, which
+	// dominated the parse time, so copy the words out in a single pass
+	// instead. Same rules: at most 255 characters of the line are
+	// considered, a word too long for its buffer ends the scan with that
+	// buffer empty, and the return value is the number of words read.
+	int SplitStatement(const char *pos)
+	{
+		char *words[16] = { statement, op1, op2, op3, op4, op5, op6, op7, op8, op9, op10, op11, op12, op13, op14, op15 };
+		const char *end = pos + 255;
+		int numRead = 0;
+
+		for (int i = 1; i < 16; i++)
+			words[i][0] = 0;
+
+		while (numRead < 16)
+		{
+			while (pos < end && IsStatementSpace(*pos))
+				pos++;
+			if (pos == end || !IsStatementWordChar(*pos))
+				break;
+
+			char *word = words[numRead];
+			char *wordEnd = word + opcodeSize - 1;
+			while (pos < end && word < wordEnd && IsStatementWordChar(*pos))
+				*word++ = *pos++;
+			*word = 0;
+
+			if (pos < end && IsStatementWordChar(*pos))
+			{
+				words[numRead][0] = 0;
+				break;
+			}
+			numRead++;
+		}
+
+		return numRead;
+	}
+
 	int ReadStatement(const char *pos)
 	{
-		// Kill newline.
-		char lineBuffer[256];
-		strncpy(lineBuffer, pos, 255); lineBuffer[255] = 0;
-		char *newlinePos = strchr(lineBuffer, '\n'); if (newlinePos) *newlinePos = 0;
-		op1[0] = 0; op2[0] = 0; op3[0] = 0; op4[0] = 0; op5[0] = 0; op6[0] = 0; op7[0] = 0; op8[0] = 0;
-		op9[0] = 0; op10[0] = 0; op11[0] = 0; op12[0] = 0; op13[0] = 0; op14[0] = 0; op15[0] = 0;
-
-		int numRead = sscanf_s(lineBuffer, "%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s",
-			statement, UCOUNTOF(statement),
-			op1, opcodeSize, op2, opcodeSize, op3, opcodeSize, op4, opcodeSize, op5, opcodeSize, op6, opcodeSize, op7, opcodeSize, op8, opcodeSize,
-			op9, opcodeSize, op10, opcodeSize, op11, opcodeSize, op12, opcodeSize, op13, opcodeSize, op14, opcodeSize, op15, opcodeSize);
+		int numRead = SplitStatement(pos);
 
 		// Cull the [precise] from any instruction using it by moving down all opcodes to recreate
 		// the instruction, minus the 'precise'.  ToDo: add 'precise' keyword to output variable.
@@ -2772,44 +2957,79 @@ public:
 	//  is intended to fix the problems we see where the assembly is using the -1 numerically
 	//  and not as a boolean.  The helper is now just a macro "#define cmp -" to negate.
 
+	// Temporaries are tracked per component in mBooleanTemps, indexed by
+	// register number, which saves building a string for every component
+	// of every operand we check. Anything else (outputs, indexable temps,
+	// operands with no swizzle) goes in mBooleanRegisters as before.
+
+	// Register number of a plain temporary like "r12", or -1:
+	static int booleanTempIndex(const char *reg, size_t len)
+	{
+		if (len < 2 || len > 6 || reg[0] != 'r' || (reg[1] == '0' && len > 2))
+			return -1;
+		int index = 0;
+		for (size_t i = 1; i < len; i++)
+		{
+			if (reg[i] < '0' || reg[i] > '9')
+				return -1;
+			index = index * 10 + reg[i] - '0';
+		}
+		return index;
+	}
+
+	static unsigned booleanComponentMask(char component)
+	{
+		switch (component)
+		{
+			case 'x': return 1;
+			case 'y': return 2;
+			case 'z': return 4;
+			case 'w': return 8;
+		}
+		return 0;
+	}
+
 	void addBoolean(char *arg)
 	{
-		string op = (arg[0] == '-') ? arg + 1 : arg;
-		size_t dotspot = op.find('.');
-		if (dotspot == string::npos)
+		const char *op = (arg[0] == '-') ? arg + 1 : arg;
+		const char *dotspot = strchr(op, '.');
+		if (!dotspot)
 		{
 			mBooleanRegisters.insert(op);
 			return;
 		}
 
-		string reg = op.substr(0, dotspot);
-		for (size_t i = dotspot + 1; i < op.length(); i++)
+		int temp = booleanTempIndex(op, dotspot - op);
+		for (const char *i = dotspot + 1; *i; i++)
 		{
-			mBooleanRegisters.insert(reg + '.' + op[i]);
+			unsigned mask = booleanComponentMask(*i);
+			if (temp >= 0 && mask)
+				mBooleanTemps->Set(temp, mask);
+			else
+				mBooleanRegisters.insert(string(op, dotspot - op) + '.' + *i);
 		}
 	}
 
 	bool isBoolean(char *arg)
 	{
-		if (mBooleanRegisters.empty())
-			return false;
-
-		string op = (arg[0] == '-') ? arg + 1 : arg;
-		size_t dotspot = op.find('.');
-		string operand;
+		const char *op = (arg[0] == '-') ? arg + 1 : arg;
+		const char *dotspot = strchr(op, '.');
 
-		if (dotspot == string::npos)
-		{
-			set<string>::iterator i = mBooleanRegisters.find(op);
-			return i != mBooleanRegisters.end();
-		}
+		if (!dotspot)
+			return !mBooleanRegisters.empty() && mBooleanRegisters.find(op) != mBooleanRegisters.end();
 
-		string reg = op.substr(0, dotspot);
-		for (size_t i = dotspot + 1; i < op.length(); i++)
+		int temp = booleanTempIndex(op, dotspot - op);
+		for (const char *i = dotspot + 1; *i; i++)
 		{
-			set<string>::iterator j = mBooleanRegisters.find(reg + '.' + op[i]);
-			if (j != mBooleanRegisters.end())
-				return true;									// Any single component found qualifies
+			unsigned mask = booleanComponentMask(*i);
+			if (temp >= 0 && mask)
+			{
+				if (mBooleanTemps->Any(temp, mask))
+					return true;							// Any single component found qualifies
+			}
+			else if (!mBooleanRegisters.empty() &&
+				mBooleanRegisters.find(string(op, dotspot - op) + '.' + *i) != mBooleanRegisters.end())
+				return true;
 		}
 
 		return false;
@@ -2817,21 +3037,23 @@ public:
 
 	void removeBoolean(char *arg)
 	{
-		if (mBooleanRegisters.empty())
-			return;
-
-		string op = arg[0] == '-' ? arg + 1 : arg;
-		size_t dotspot = op.find('.');
-		if (dotspot == string::npos)
+		const char *op = (arg[0] == '-') ? arg + 1 : arg;
+		const char *dotspot = strchr(op, '.');
+		if (!dotspot)
 		{
-			mBooleanRegisters.erase(op);
+			if (!mBooleanRegisters.empty())
+				mBooleanRegisters.erase(op);
 			return;
 		}
 
-		string reg = op.substr(0, dotspot);
-		for (size_t i = dotspot + 1; i < op.length(); i++)
+		int temp = booleanTempIndex(op, dotspot - op);
+		for (const char *i = dotspot + 1; *i; i++)
 		{
-			mBooleanRegisters.erase(reg + '.' + op[i]);
+			unsigned mask = booleanComponentMask(*i);
+			if (temp >= 0 && mask)
+				mBooleanTemps->Unset(temp, mask);
+			else if (!mBooleanRegisters.empty())
+				mBooleanRegisters.erase(string(op, dotspot - op) + '.' + *i);
 		}
 	}
 
@@ -2842,7 +3064,8 @@ public:
 		if (o.eType == OPERAND_TYPE_IMMEDIATE32)
 		{
 			float oldValue;
-			sscanf_s(op, "l(%e", &oldValue);
+			if (!strncmp(op, "l(", 2))
+				oldValue = strtof(op + 2, NULL);
 			if (!strncmp(op, "l(1.#INF00", strlen("l(1.#INF00")) || abs(oldValue - o.afImmediates[0]) < 0.1)
 			{
 				if (o.iNumComponents == 4)
@@ -3000,13 +3223,8 @@ public:
 		{
 			// Search for depth texture.
 			bool wposAvailable = false;
-			map<int, string>::iterator depthTexture;
-			for (depthTexture = mTextureNames.begin(); depthTexture != mTextureNames.end(); ++depthTexture)
-			{
-				if (depthTexture->second == G->ZRepair_DepthTexture1)
-					break;
-			}
-			if (depthTexture != mTextureNames.end())
+			int depthTexture = mTextures->Find(G->ZRepair_DepthTexture1);
+			if (depthTexture >= 0)
 			{
 				long found = 0;
 				for (CBufferData::iterator i = mCBufferData.begin(); i != mCBufferData.end(); ++i)
@@ -3078,12 +3296,8 @@ public:
 			}
 			if (!wposAvailable)
 			{
-				for (depthTexture = mTextureNames.begin(); depthTexture != mTextureNames.end(); ++depthTexture)
-				{
-					if (depthTexture->second == G->ZRepair_DepthTexture2)
-						break;
-				}
-				if (depthTexture != mTextureNames.end())
+				depthTexture = mTextures->Find(G->ZRepair_DepthTexture2);
+				if (depthTexture >= 0)
 				{
 					long found = 0;
 					for (CBufferData::iterator i = mCBufferData.begin(); i != mCBufferData.end(); ++i)
@@ -3156,13 +3370,8 @@ public:
 			// Search for position texture.
 			if (!wposAvailable)
 			{
-				map<int, string>::iterator positionTexture;
-				for (positionTexture = mTextureNames.begin(); positionTexture != mTextureNames.end(); ++positionTexture)
-				{
-					if (positionTexture->second == G->ZRepair_PositionTexture)
-						break;
-				}
-				if (positionTexture != mTextureNames.end())
+				int positionTexture = mTextures->Find(G->ZRepair_PositionTexture);
+				if (positionTexture >= 0)
 				{
 					mOutput.push_back(0);
 					// Search position texture usage.
@@ -3478,13 +3687,13 @@ public:
 		char format[16];
 
 		sprintf(buffer, "t%d", bufIndex);
-		mTextureNames[bufIndex] = buffer;
+		mTextures->SetName(bufIndex, buffer);
 
 		sscanf_s(op1, "(%[^,]", format, 16);	// Match first xx of (xx,xx,xx,xx)
 		string form4 = string(format) + "4";	// Grim. Known to fail sometimes.
-		mTextureType[bufIndex] = texType + "<" + form4 + ">";
+		mTextures->SetType(bufIndex, texType + "<" + form4 + ">");
 
-		sprintf(buffer, "%s t%d : register(t%d);\n\n", mTextureType[bufIndex].c_str(), bufIndex, bufIndex);
+		sprintf(buffer, "%s t%d : register(t%d);\n\n", mTextures->Type(bufIndex).c_str(), bufIndex, bufIndex);
 		mOutput.insert(mOutput.begin(), buffer, buffer + strlen(buffer));
 		mCodeStartPos += strlen(buffer);
 	}
@@ -4055,10 +4264,30 @@ public:
 	}
 	//dx9
 
+	static bool UsesMinPrecision(const Instruction *instr)
+	{
+		for (uint32_t i = 0; i < instr->ui32NumOperands && i < UCOUNTOF(instr->asOperands); i++)
+		{
+			if (instr->asOperands[i].eMinPrecision != OPERAND_MIN_PRECISION_DEFAULT)
+				return true;
+		}
+		return false;
+	}
+
+	// 3DMIGOTO ADDITION: Note that this is still driven by the disassembly
+	// text - every line goes through ReadStatement, and the opcode and
+	// operand strings it splits out are what the translation rules work
+	// on. The decoded Instruction walked alongside is only used for the
+	// texture and sampler slots, and for formatting plain register source
+	// operands (with the destination write mask) in applyDecodedSwizzle().
+	// Literals, constant buffers, the icb, relative indexing, minimum
+	// precision and DX9 all still come from the text, as does the
+	// destination written on the left hand side.
 	void ParseCode(Shader *shader, const char *c, size_t size)
 	{
 		mOutputRegisterValues.clear();
 		mBooleanRegisters.clear();
+		mBooleanTemps->Clear();
 		mCodeStartPos = mOutput.size();
 
 		char buffer[512];
@@ -4066,13 +4295,19 @@ public:
 		unsigned int iNr = 0;
 		bool skip_shader = false;
 
-		vector<Instruction> *instructions = &shader->asPhase[MAIN_PHASE].ppsInst[0];
+		InstructionList *instructions = &shader->asPhase[MAIN_PHASE].ppsInst[0];
 		size_t inst_count = instructions->size();
 
 		while (pos < size && iNr < inst_count)
 		{
 			Instruction *instr = &(*instructions)[iNr];
 
+			// Minimum precision operands are followed by a {min16f} tag in
+			// the disassembly, which shifts the operand text along, so
+			// those instructions keep using the text to format their
+			// operands to produce the same output as before:
+			mDecodedOperands = !shader->dx9Shader && !UsesMinPrecision(instr);
+
 			// Now ignore '#line' or 'undecipherable' debug info (DefenseGrid2)
 			if (!strncmp(c + pos, "#line", 5) ||
 				!strncmp(c + pos, "undecipherable", 14))
@@ -4293,24 +4528,22 @@ public:
 					}
 					if (!strcmp(op2, "mode_default"))
 					{
-						map<int, string>::iterator i = mSamplerNames.find(bufIndex);
-						if (i == mSamplerNames.end())
+						if (!mSamplers->Has(bufIndex))
 						{
 							sprintf(buffer, "s%d_s", bufIndex);
-							mSamplerNames[bufIndex] = buffer;
-							sprintf(buffer, "SamplerState %s : register(s%d);\n\n", mSamplerNames[bufIndex].c_str(), bufIndex);
+							mSamplers->SetName(bufIndex, buffer);
+							sprintf(buffer, "SamplerState %s : register(s%d);\n\n", mSamplers->Name(bufIndex).c_str(), bufIndex);
 							mOutput.insert(mOutput.begin(), buffer, buffer + strlen(buffer));
 							mCodeStartPos += strlen(buffer);
 						}
 					}
 					else if (!strcmp(op2, "mode_comparison"))
 					{
-						map<int, string>::iterator i = mSamplerComparisonNames.find(bufIndex);
-						if (i == mSamplerComparisonNames.end())
+						if (!mSamplerComparisons->Has(bufIndex))
 						{
 							sprintf(buffer, "s%d_s", bufIndex);
-							mSamplerComparisonNames[bufIndex] = buffer;
-							sprintf(buffer, "SamplerComparisonState %s : register(s%d);\n\n", mSamplerComparisonNames[bufIndex].c_str(), bufIndex);
+							mSamplerComparisons->SetName(bufIndex, buffer);
+							sprintf(buffer, "SamplerComparisonState %s : register(s%d);\n\n", mSamplerComparisons->Name(bufIndex).c_str(), bufIndex);
 							mOutput.insert(mOutput.begin(), buffer, buffer + strlen(buffer));
 							mCodeStartPos += strlen(buffer);
 						}
@@ -4341,8 +4574,7 @@ public:
 						return;
 					}
 					// Create if not existing.  e.g. if no ResourceBinding section in ASM.
-					map<int, string>::iterator i = mTextureNames.find(bufIndex);
-					if (i == mTextureNames.end())
+					if (!mTextures->Has(bufIndex))
 					{
 						CreateRawFormat("Texture2D", bufIndex);
 					}
@@ -4359,8 +4591,7 @@ public:
 						return;
 					}
 					// Create if not existing.   e.g. if no ResourceBinding section in ASM.
-					map<int, string>::iterator i = mTextureNames.find(bufIndex);
-					if (i == mTextureNames.end())
+					if (!mTextures->Has(bufIndex))
 					{
 						CreateRawFormat("Texture2DArray", bufIndex);
 					}
@@ -4383,16 +4614,15 @@ public:
 						return;
 					}
 					// Create if not existing.   e.g. if no ResourceBinding section in ASM.  Might need <f,x> variant for texturetype.
-					map<int, string>::iterator i = mTextureNames.find(bufIndex);
-					if (i == mTextureNames.end())
+					if (!mTextures->Has(bufIndex))
 					{
 						sprintf(buffer, "t%d", bufIndex);
-						mTextureNames[bufIndex] = buffer;
+						mTextures->SetName(bufIndex, buffer);
 
 						char format[16];
 						sscanf_s(op1, "(%[^,]", format, 16);	// Match first xx of (xx,xx,xx,xx)
 						string form4 = string(format) + "4";
-						mTextureType[bufIndex] = "Texture2DMS<" + form4 + ">";
+						mTextures->SetType(bufIndex, "Texture2DMS<" + form4 + ">");
 
 						if (dim == 0)
 							sprintf(buffer, "Texture2DMS<%s> t%d : register(t%d);\n\n", form4.c_str(), bufIndex, bufIndex);
@@ -4414,8 +4644,7 @@ public:
 						return;
 					}
 					// Create if not existing.  e.g. if no ResourceBinding section in ASM.
-					map<int, string>::iterator i = mTextureNames.find(bufIndex);
-					if (i == mTextureNames.end())
+					if (!mTextures->Has(bufIndex))
 					{
 						CreateRawFormat("Texture3D", bufIndex);
 					}
@@ -4432,8 +4661,7 @@ public:
 						return;
 					}
 					// Create if not existing.  e.g. if no ResourceBinding section in ASM.
-					map<int, string>::iterator i = mTextureNames.find(bufIndex);
-					if (i == mTextureNames.end())
+					if (!mTextures->Has(bufIndex))
 					{
 						CreateRawFormat("TextureCube", bufIndex);
 					}
@@ -4450,8 +4678,7 @@ public:
 						return;
 					}
 					// Create if not existing.  e.g. if no ResourceBinding section in ASM.
-					map<int, string>::iterator i = mTextureNames.find(bufIndex);
-					if (i == mTextureNames.end())
+					if (!mTextures->Has(bufIndex))
 					{
 						CreateRawFormat("TextureCubeArray", bufIndex);
 					}
@@ -4468,8 +4695,7 @@ public:
 						return;
 					}
 					// Create if not existing.  e.g. if no ResourceBinding section in ASM.
-					map<int, string>::iterator i = mTextureNames.find(bufIndex);
-					if (i == mTextureNames.end())
+					if (!mTextures->Has(bufIndex))
 					{
 						CreateRawFormat("Buffer", bufIndex);
 					}
@@ -4593,14 +4819,14 @@ public:
 
 					case OPCODE_ITOF:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
 						sprintf(buffer, "  %s = %s;\n", writeTarget(op1), ci(convertToInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_UTOF:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
 						sprintf(buffer, "  %s = %s;\n", writeTarget(op1), ci(convertToUInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4608,7 +4834,7 @@ public:
 
 					case OPCODE_MOV:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = %s;\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -4625,7 +4851,7 @@ public:
 
 					case OPCODE_RCP:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = rcp(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -4635,14 +4861,14 @@ public:
 
 					case OPCODE_NOT:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = ~%s;\n", writeTarget(op1), ci(convertToInt(op2)).c_str());
 						appendOutput(buffer);
 						break;
 
 					case OPCODE_INEG:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
 						sprintf(buffer, "  %s = -%s;\n", writeTarget(op1), ci(convertToInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4650,7 +4876,7 @@ public:
 
 					case OPCODE_F32TOF16:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = f32tof16(%s);\n", writeTarget(op1), ci(op2).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4658,7 +4884,7 @@ public:
 
 					case OPCODE_F16TOF32:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = f16tof32(%s);\n", writeTarget(op1), ci(op2).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4666,7 +4892,7 @@ public:
 
 					case OPCODE_FRC:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = frac(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -4677,8 +4903,8 @@ public:
 
 					case OPCODE_MUL:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						mMulOperand = op3; mMulOperand2 = op2; mMulTarget = op1;
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = %s * %s;\n", writeTarget(op1), ci(op3).c_str(), ci(op2).c_str());
@@ -4690,8 +4916,8 @@ public:
 
 					case OPCODE_IMUL:
 						remapTarget(op2);
-						applySwizzle(op2, op3, true);
-						applySwizzle(op2, op4, true);
+						applySwizzle(op2, instr->asOperands[1], op3, instr->asOperands[2], true);
+						applySwizzle(op2, instr->asOperands[1], op4, instr->asOperands[3], true);
 						mMulOperand = strncmp(op3, "int", 3) ? op3 : op4;
 						sprintf(buffer, "  %s = %s * %s;\n", writeTarget(op2), ci(convertToInt(op3)).c_str(), ci(convertToInt(op4)).c_str());
 						appendOutput(buffer);
@@ -4700,8 +4926,8 @@ public:
 
 					case OPCODE_DIV:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = %s / %s;\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 						else
@@ -4738,8 +4964,8 @@ public:
 						if (instr->asOperands[0].eType != OPERAND_TYPE_NULL)
 						{
 							applySwizzle(divSwiz, divOut, true);
-							applySwizzle(divSwiz, fixImm(op13, instr->asOperands[2]), true);
-							applySwizzle(divSwiz, fixImm(op14, instr->asOperands[3]), true);
+							applySwizzle(divSwiz, instr->asOperands[0], fixImm(op13, instr->asOperands[2]), instr->asOperands[2], true);
+							applySwizzle(divSwiz, instr->asOperands[0], fixImm(op14, instr->asOperands[3]), instr->asOperands[3], true);
 							convertToUInt(op13);
 							convertToUInt(op14);
 
@@ -4748,8 +4974,8 @@ public:
 						}
 						if (instr->asOperands[1].eType != OPERAND_TYPE_NULL)
 						{
-							applySwizzle(remSwiz, fixImm(op3, instr->asOperands[2]), true);
-							applySwizzle(remSwiz, fixImm(op4, instr->asOperands[3]), true);
+							applySwizzle(remSwiz, instr->asOperands[1], fixImm(op3, instr->asOperands[2]), instr->asOperands[2], true);
+							applySwizzle(remSwiz, instr->asOperands[1], fixImm(op4, instr->asOperands[3]), instr->asOperands[3], true);
 							convertToUInt(op3);
 							convertToUInt(op4);
 
@@ -4778,8 +5004,8 @@ public:
 						}
 
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						if (!instr->bSaturate) {
 							// Reverting the DX9 port changes and going back to
 							// the original opcode order here, since they
@@ -4807,8 +5033,8 @@ public:
 						//  mul r0.xyz, r0.xxxx, r1.xzwx
 					case OPCODE_IADD:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = %s + %s;\n", writeTarget(op1), ci(convertToInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4828,8 +5054,8 @@ public:
 						remapTarget(op1);
 						strcpy(op12, op2);
 						strcpy(op13, op3);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						if (isBoolean(op2) || isBoolean(op3))
 						{
 							convertHexToFloat(op12);
@@ -4850,16 +5076,16 @@ public:
 
 					case OPCODE_OR:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
 						sprintf(buffer, "  %s = %s | %s;\n", writeTarget(op1), ci(convertToInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						break;
 
 					case OPCODE_XOR:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
 						sprintf(buffer, "  %s = %s ^ %s;\n", writeTarget(op1), ci(convertToInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						break;
@@ -4871,8 +5097,8 @@ public:
 						// So, we need op2 as the Shift-Expression, op3 as the # of bits to shift.
 					case OPCODE_ISHR:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = %s >> %s;\n", writeTarget(op1), ci(convertToUInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4880,8 +5106,8 @@ public:
 
 					case OPCODE_ISHL:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = %s << %s;\n", writeTarget(op1), ci(convertToUInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4891,8 +5117,8 @@ public:
 						// But this code was still backwards.
 					case OPCODE_USHR:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = %s >> %s;\n", writeTarget(op1), ci(convertToUInt(op2)).c_str(), ci(convertToUInt(op3)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4901,7 +5127,7 @@ public:
 						// Newly found in CS for Prey
 					case OPCODE_COUNTBITS:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
 						sprintf(buffer, "  %s = countbits(%s);\n", writeTarget(op1), ci(convertToUInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4911,21 +5137,21 @@ public:
 						// firstbit{_hi|_lo|_shi} dest[.mask], src0[.swizzle]
 					case OPCODE_FIRSTBIT_HI:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
 						sprintf(buffer, "  %s = firstbithigh(%s);\n", writeTarget(op1), ci(convertToUInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_FIRSTBIT_LO:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
 						sprintf(buffer, "  %s = firstbitlow(%s);\n", writeTarget(op1), ci(convertToUInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_FIRSTBIT_SHI:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
 						sprintf(buffer, "  %s = firstbithigh(%s);\n", writeTarget(op1), ci(convertToInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4940,9 +5166,9 @@ public:
 					{
 						remapTarget(op1);
 						removeBoolean(op1);
-						applySwizzle(op1, op2);	// width
-						applySwizzle(op1, op3); // offset
-						applySwizzle(op1, op4);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);	// width
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]); // offset
+						applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3]);
 						int idx = 0;
 						char *pop1 = strrchr(op1, '.'); *pop1 = 0;
 						while (*++pop1)
@@ -4968,9 +5194,9 @@ public:
 							// ibfe r0.xyzw, l(24, 24, 24, 24), l(0, 0, 0, 0), cb0[12].xyzw
 							remapTarget(op1);
 							removeBoolean(op1);
-							applySwizzle(op1, op2, true);
-							applySwizzle(op1, op3, true);
-							applySwizzle(op1, op4);
+							applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+							applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
+							applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3]);
 							sprintf(buffer, "  %s = (%s == 0 ? 0 : ("
 										"%s + %s < 32 ? ("
 											"((int%s)%s << (32 - %s - %s)) >> (32 - %s)"
@@ -4989,7 +5215,7 @@ public:
 
 					case OPCODE_BFREV:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = reversebits(%s);\n", writeTarget(op1), ci(convertToUInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -4997,7 +5223,7 @@ public:
 
 					case OPCODE_EXP:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = exp2(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -5059,7 +5285,7 @@ public:
 						}
 
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = log2(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -5078,7 +5304,7 @@ public:
 						// James-Jones opcode parser as the primary parser.
 					case OPCODE_SQRT:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = sqrt(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -5091,8 +5317,8 @@ public:
 						// recompile comes out identical.
 					case OPCODE_MIN:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = min(%s, %s);\n", writeTarget(op1), ci(op3).c_str(), ci(op2).c_str());
 						else
@@ -5104,8 +5330,8 @@ public:
 						// Missing opcode for UMin, used in Dragon Age
 					case OPCODE_UMIN:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						sprintf(buffer, "  %s = min(%s, %s);\n", writeTarget(op1), ci(convertToUInt(op3)).c_str(), ci(convertToUInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -5114,8 +5340,8 @@ public:
 						// Missing opcode for UMax, used in Witcher3
 					case OPCODE_UMAX:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						sprintf(buffer, "  %s = max(%s, %s);\n", writeTarget(op1), ci(convertToUInt(op3)).c_str(), ci(convertToUInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -5357,8 +5583,8 @@ public:
 						}
 
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = max(%s, %s);\n", writeTarget(op1), ci(op3).c_str(), ci(op2).c_str());
 						else
@@ -5369,8 +5595,8 @@ public:
 					}
 					case OPCODE_IMIN:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]), true);
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]), true);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2], true);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = min(%s, %s);\n", writeTarget(op1), ci(convertToInt(op3)).c_str(), ci(convertToInt(op2)).c_str());
 						else
@@ -5380,8 +5606,8 @@ public:
 						break;
 					case OPCODE_IMAX:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]), true);
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]), true);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2], true);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = max(%s, %s);\n", writeTarget(op1), ci(convertToInt(op3)).c_str(), ci(convertToInt(op2)).c_str());
 						else
@@ -5392,9 +5618,9 @@ public:
 
 					case OPCODE_MAD:
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
-						applySwizzle(op1, fixImm(op4, instr->asOperands[3]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op4, instr->asOperands[3]), instr->asOperands[3]);
 						// Check for operation reorder.
 						/*
 						if (mLastStatement && mLastStatement->eOpcode == OPCODE_MUL && strstr(op4, mMulTarget.c_str()) &&
@@ -5412,18 +5638,18 @@ public:
 
 					case OPCODE_IMAD:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
-						applySwizzle(op1, op4, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
+						applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3], true);
 						sprintf(buffer, "  %s = mad(%s, %s, %s);\n", writeTarget(op1), ci(convertToInt(op2)).c_str(), ci(convertToInt(op3)).c_str(), ci(convertToInt(op4)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_UMAD:
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
-						applySwizzle(op1, op4, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
+						applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3], true);
 						sprintf(buffer, "  %s = mad(%s, %s, %s);\n", writeTarget(op1), ci(convertToUInt(op2)).c_str(), ci(convertToUInt(op3)).c_str(), ci(convertToUInt(op4)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -5431,8 +5657,8 @@ public:
 
 					case OPCODE_DP2:
 						remapTarget(op1);
-						applySwizzle(".xy", fixImm(op2, instr->asOperands[1]));
-						applySwizzle(".xy", fixImm(op3, instr->asOperands[2]));
+						applySwizzle(".xy", fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(".xy", fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = dot(%s, %s);\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 						else
@@ -5489,8 +5715,8 @@ public:
 						}
 
 						remapTarget(op1);
-						applySwizzle(".xyz", fixImm(op2, instr->asOperands[1]));
-						applySwizzle(".xyz", fixImm(op3, instr->asOperands[2]));
+						applySwizzle(".xyz", fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(".xyz", fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = dot(%s, %s);\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 						else
@@ -5540,8 +5766,8 @@ public:
 						{
 							// XXX NOTE Duplicated code above!!!
 							remapTarget(op1);
-							applySwizzle(".xyzw", fixImm(op2, instr->asOperands[1]));
-							applySwizzle(".xyzw", fixImm(op3, instr->asOperands[2]));
+							applySwizzle(".xyzw", fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+							applySwizzle(".xyzw", fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 							if (!instr->bSaturate)
 								sprintf(buffer, "  %s = dot(%s, %s);\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 							else
@@ -5554,9 +5780,9 @@ public:
 					}
 					case OPCODE_DP2ADD:
 						remapTarget(op1);
-						applySwizzle(".xy", op2);
-						applySwizzle(".xy", op3);
-						applySwizzle(".xy", op4);
+						applySwizzle(".xy", op2, instr->asOperands[1]);
+						applySwizzle(".xy", op3, instr->asOperands[2]);
+						applySwizzle(".xy", op4, instr->asOperands[3]);
 						sprintf(buffer, "  %s = dot2(%s, %s) + %s;\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str(), ci(op4).c_str());
 						appendOutput(buffer);
 
@@ -5566,9 +5792,9 @@ public:
 						//dx9
 					case OPCODE_LRP:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
-						applySwizzle(op1, op4);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3]);
 						sprintf(buffer, "  %s = lerp(%s, %s, %s);\n", writeTarget(op1), ci(op4).c_str(), ci(op3).c_str(), ci(op2).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -5576,8 +5802,8 @@ public:
 
 					case OPCODE_POW:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
 						sprintf(buffer, "  %s = pow(%s, %s);\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 						appendOutput(buffer);
 						break;
@@ -5585,7 +5811,7 @@ public:
 					case OPCODE_RSQ:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate) {
 							// The DX9 port switched this to 1/sqrt(), however
 							// it is unclear why that was necessary - rsqrt
@@ -5612,7 +5838,7 @@ public:
 					case OPCODE_ROUND_NI:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = floor(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -5624,7 +5850,7 @@ public:
 					case OPCODE_ROUND_PI:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = ceil(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -5640,7 +5866,7 @@ public:
 					case OPCODE_ROUND_Z:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = trunc(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -5656,7 +5882,7 @@ public:
 					case OPCODE_ROUND_NE:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = round(%s);\n", writeTarget(op1), ci(op2).c_str());
 						else
@@ -5667,7 +5893,7 @@ public:
 					}
 					case OPCODE_FTOI:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = %s;\n", writeTarget(op1), ci(castToInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -5675,7 +5901,7 @@ public:
 
 					case OPCODE_FTOU:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = %s;\n", writeTarget(op1), ci(castToUInt(op2)).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -5685,9 +5911,9 @@ public:
 						remapTarget(op1);
 						remapTarget(op2);
 						if (!strncmp(op1, "null", 4))
-							applySwizzle(op2, op3);
+							applySwizzle(op2, instr->asOperands[1], op3, instr->asOperands[2]);
 						else
-							applySwizzle(op1, op3);
+							applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
 						if (!strncmp(op1, "null", 4))
 							sprintf(buffer, "  %s = cos(%s);\n", writeTarget(op2), ci(op3).c_str());
 						else if (!strncmp(op2, "null", 4))
@@ -5711,9 +5937,9 @@ public:
 					case OPCODE_MOVC:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
-						applySwizzle(op1, fixImm(op4, instr->asOperands[3]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op4, instr->asOperands[3]), instr->asOperands[3]);
 						if (!instr->bSaturate)
 							sprintf(buffer, "  %s = %s ? %s : %s;\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str(), ci(op4).c_str());
 						else
@@ -5744,8 +5970,8 @@ public:
 					case OPCODE_NE:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
 						sprintf(buffer, "  %s = cmp(%s != %s);\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5754,8 +5980,8 @@ public:
 					case OPCODE_INE:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = cmp(%s != %s);\n", writeTarget(op1), ci(convertToInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5764,8 +5990,8 @@ public:
 					case OPCODE_EQ:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
 						sprintf(buffer, "  %s = cmp(%s == %s);\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5774,8 +6000,8 @@ public:
 					case OPCODE_IEQ: 
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = cmp(%s == %s);\n", writeTarget(op1), ci(convertToInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5784,8 +6010,8 @@ public:
 					case OPCODE_LT:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						sprintf(buffer, "  %s = cmp(%s < %s);\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5794,8 +6020,8 @@ public:
 					case OPCODE_ILT:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = cmp(%s < %s);\n", writeTarget(op1), ci(convertToInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5804,8 +6030,8 @@ public:
 					case OPCODE_ULT:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = cmp(%s < %s);\n", writeTarget(op1), ci(convertToUInt(op2)).c_str(), ci(convertToUInt(op3)).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5814,8 +6040,8 @@ public:
 					case OPCODE_GE:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, fixImm(op2, instr->asOperands[1]));
-						applySwizzle(op1, fixImm(op3, instr->asOperands[2]));
+						applySwizzle(op1, instr->asOperands[0], fixImm(op2, instr->asOperands[1]), instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op3, instr->asOperands[2]), instr->asOperands[2]);
 						sprintf(buffer, "  %s = cmp(%s >= %s);\n", writeTarget(op1), ci(op2).c_str(), ci(op3).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5824,8 +6050,8 @@ public:
 					case OPCODE_IGE:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = cmp(%s >= %s);\n", writeTarget(op1), ci(convertToInt(op2)).c_str(), ci(convertToInt(op3)).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5834,8 +6060,8 @@ public:
 					case OPCODE_UGE:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2, true);
-						applySwizzle(op1, op3, true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1], true);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2], true);
 						sprintf(buffer, "  %s = cmp(%s >= %s);\n", writeTarget(op1), ci(convertToUInt(op2)).c_str(), ci(convertToUInt(op3)).c_str());
 						appendOutput(buffer);
 						addBoolean(op1);
@@ -5861,7 +6087,7 @@ public:
 						break;
 
 					case OPCODE_IF:
-						applySwizzle(".x", op1);
+						applySwizzle(".x", op1, instr->asOperands[0]);
 						if (instr->eBooleanTestType == INSTRUCTION_TEST_ZERO)
 							sprintf(buffer, "  if (%s == 0) {\n", ci(op1).c_str());
 						else
@@ -5886,7 +6112,7 @@ public:
 						appendOutput(buffer);
 						break;
 					case OPCODE_BREAKC:
-						applySwizzle(".x", op1);
+						applySwizzle(".x", op1, instr->asOperands[0]);
 						if (instr->eBooleanTestType == INSTRUCTION_TEST_ZERO)
 							sprintf(buffer, "  if (%s == 0) break;\n", ci(op1).c_str());
 						else
@@ -5898,7 +6124,7 @@ public:
 						appendOutput(buffer);
 						break;
 					case OPCODE_CONTINUEC:
-						applySwizzle(".x", op1);
+						applySwizzle(".x", op1, instr->asOperands[0]);
 						if (instr->eBooleanTestType == INSTRUCTION_TEST_ZERO)
 							sprintf(buffer, "  if (%s == 0) continue;\n", ci(op1).c_str());
 						else
@@ -5925,9 +6151,9 @@ public:
 						remapTarget(op2);
 						removeBoolean(op1);		// The code damages the op1, op2 below.
 						removeBoolean(op2);
-						applySwizzle(op1, op3);
-						applySwizzle(op1, op4);
-						applySwizzle(op1, op5);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3]);
+						applySwizzle(op1, instr->asOperands[0], op5, instr->asOperands[4]);
 						int idx = 0;
 						char *pop1 = strrchr(op1, '.'); *pop1 = 0;
 						char *pop2 = strrchr(op2, '.'); if (pop2) *pop2 = 0;
@@ -5956,10 +6182,10 @@ public:
 					{
 						remapTarget(op1);
 						removeBoolean(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
-						applySwizzle(op1, op4);
-						applySwizzle(op1, op5);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3]);
+						applySwizzle(op1, instr->asOperands[0], op5, instr->asOperands[4]);
 						int idx = 0;
 						char *pop1 = strrchr(op1, '.'); *pop1 = 0;
 						while (*++pop1)
@@ -5989,7 +6215,7 @@ public:
 
 							int textureId = atoi(&op3[1]);
 							sprintf(buffer, "  %s = %s.Sample(%s);\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), ci(op2).c_str());
+								mTextures->Name(textureId).c_str(), ci(op2).c_str());
 
 							appendOutput(buffer);
 						}
@@ -5997,23 +6223,22 @@ public:
 						{
 							//	else if (!strncmp(statement, "sample_indexable", strlen("sample_indexable")))
 							remapTarget(op1);
-							applySwizzle(".xyzw", op2);
-							applySwizzle(op1, op3);
-							int textureId, samplerId;
-							sscanf_s(op3, "t%d.", &textureId);
-							sscanf_s(op4, "s%d", &samplerId);
-							truncateTexturePos(op2, mTextureType[textureId].c_str());
-							truncateTextureSwiz(op1, mTextureType[textureId].c_str());
-							truncateTextureSwiz(op3, mTextureType[textureId].c_str());
+							applySwizzle(".xyzw", op2, instr->asOperands[1]);
+							applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+							int textureId = instr->asOperands[2].ui32RegisterNumber;
+							int samplerId = instr->asOperands[3].ui32RegisterNumber;
+							truncateTexturePos(op2, mTextures->Type(textureId).c_str());
+							truncateTextureSwiz(op1, mTextures->Type(textureId).c_str());
+							truncateTextureSwiz(op3, mTextures->Type(textureId).c_str());
 							if (!instr->bAddressOffset)
 								sprintf(buffer, "  %s = %s.Sample(%s, %s)%s;\n", writeTarget(op1),
-									mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(), strrchr(op3, '.'));
+									mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), strrchr(op3, '.'));
 							else
 							{
 								int offsetx = 0, offsety = 0, offsetz = 0;
 								sscanf_s(statement, "sample_aoffimmi(%d,%d,%d", &offsetx, &offsety, &offsetz);
 								sprintf(buffer, "  %s = %s.Sample(%s, %s, int2(%d, %d))%s;\n", writeTarget(op1),
-									mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(),
+									mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(),
 									offsetx, offsety, strrchr(op3, '.'));
 							}
 							appendOutput(buffer);
@@ -6027,24 +6252,23 @@ public:
 					case OPCODE_SAMPLE_B:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						applySwizzle(".x", fixImm(op5, instr->asOperands[4]));
-						int textureId, samplerId;
-						sscanf_s(op3, "t%d.", &textureId);
-						sscanf_s(op4, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op1, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op3, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(".x", fixImm(op5, instr->asOperands[4]), instr->asOperands[4]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						int samplerId = instr->asOperands[3].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op1, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op3, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
 							sprintf(buffer, "  %s = %s.SampleBias(%s, %s, %s)%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
 						else
 						{
 							int offsetx = 0, offsety = 0, offsetz = 0;
 							sscanf_s(statement, "sample_b_aoffimmi_indexable(%d,%d,%d", &offsetx, &offsety, &offsetz);
 							sprintf(buffer, "  %s = %s.SampleBias(%s, %s, %s, int2(%d, %d))%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(),
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(),
 								offsetx, offsety, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6054,24 +6278,23 @@ public:
 					case OPCODE_SAMPLE_L:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						applySwizzle(".x", fixImm(op5, instr->asOperands[4]));
-						int textureId, samplerId;
-						sscanf_s(op3, "t%d.", &textureId);
-						sscanf_s(op4, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op1, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op3, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(".x", fixImm(op5, instr->asOperands[4]), instr->asOperands[4]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						int samplerId = instr->asOperands[3].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op1, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op3, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
 							sprintf(buffer, "  %s = %s.SampleLevel(%s, %s, %s)%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
 						else
 						{
 							int offsetx = 0, offsety = 0, offsetz = 0;
 							sscanf_s(statement, "sample_l_aoffimmi_indexable(%d,%d,%d", &offsetx, &offsety, &offsetz);
 							sprintf(buffer, "  %s = %s.SampleLevel(%s, %s, %s, int2(%d, %d))%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(),
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(),
 								offsetx, offsety, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6081,25 +6304,24 @@ public:
 					case OPCODE_SAMPLE_D:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						applySwizzle(op1, fixImm(op5, instr->asOperands[4]));
-						applySwizzle(op1, fixImm(op6, instr->asOperands[5]));
-						int textureId, samplerId;
-						sscanf_s(op3, "t%d.", &textureId);
-						sscanf_s(op4, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op1, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op3, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op5, instr->asOperands[4]), instr->asOperands[4]);
+						applySwizzle(op1, instr->asOperands[0], fixImm(op6, instr->asOperands[5]), instr->asOperands[5]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						int samplerId = instr->asOperands[3].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op1, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op3, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
 							sprintf(buffer, "  %s = %s.SampleGrad(%s, %s, %s, %s)%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(), ci(op6).c_str(), strrchr(op3, '.'));
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(), ci(op6).c_str(), strrchr(op3, '.'));
 						else
 						{
 							int offsetx = 0, offsety = 0, offsetz = 0;
 							sscanf_s(statement, "sample_d_aoffimmi_indexable(%d,%d,%d", &offsetx, &offsety, &offsetz);
 							sprintf(buffer, "  %s = %s.SampleGrad(%s, %s, %s, %s, int2(%d, %d))%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(), ci(op6).c_str(),
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(), ci(op6).c_str(),
 								offsetx, offsety, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6109,24 +6331,23 @@ public:
 					case OPCODE_SAMPLE_C:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						applySwizzle(".x", fixImm(op5, instr->asOperands[4]));
-						int textureId, samplerId;
-						sscanf_s(op3, "t%d.", &textureId);
-						sscanf_s(op4, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op1, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op3, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(".x", fixImm(op5, instr->asOperands[4]), instr->asOperands[4]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						int samplerId = instr->asOperands[3].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op1, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op3, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
 							sprintf(buffer, "  %s = %s.SampleCmp(%s, %s, %s)%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerComparisonNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
+								mTextures->Name(textureId).c_str(), mSamplerComparisons->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
 						else
 						{
 							int offsetx = 0, offsety = 0, offsetz = 0;
 							sscanf_s(statement, "sample_c_aoffimmi_indexable(%d,%d,%d", &offsetx, &offsety, &offsetz);
 							sprintf(buffer, "  %s = %s.SampleCmp(%s, %s, %s, int2(%d, %d))%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerComparisonNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(),
+								mTextures->Name(textureId).c_str(), mSamplerComparisons->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(),
 								offsetx, offsety, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6137,24 +6358,23 @@ public:
 					case OPCODE_SAMPLE_C_LZ:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						applySwizzle(".x", fixImm(op5, instr->asOperands[4]));
-						int textureId, samplerId;
-						sscanf_s(op3, "t%d.", &textureId);
-						sscanf_s(op4, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op1, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op3, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(".x", fixImm(op5, instr->asOperands[4]), instr->asOperands[4]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						int samplerId = instr->asOperands[3].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op1, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op3, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
 							sprintf(buffer, "  %s = %s.SampleCmpLevelZero(%s, %s, %s)%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerComparisonNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
+								mTextures->Name(textureId).c_str(), mSamplerComparisons->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
 						else
 						{
 							int offsetx = 0, offsety = 0, offsetz = 0;
 							sscanf_s(statement, "sample_c_lz_aoffimmi_indexable(%d,%d,%d", &offsetx, &offsety, &offsetz);
 							sprintf(buffer, "  %s = %s.SampleCmpLevelZero(%s, %s, %s, int2(%d, %d))%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerComparisonNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(),
+								mTextures->Name(textureId).c_str(), mSamplerComparisons->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(),
 								offsetx, offsety, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6166,12 +6386,11 @@ public:
 					case OPCODE_SAMPLE_POS:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
-						int textureId;
-						sscanf_s(op2, "t%d.", &textureId);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						int textureId = instr->asOperands[1].ui32RegisterNumber;
 						sprintf(buffer, "  %s = %s.GetSamplePosition(%s);\n", writeTarget(op1),
-							mTextureNames[textureId].c_str(), ci(op3).c_str());
+							mTextures->Name(textureId).c_str(), ci(op3).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
@@ -6186,19 +6405,18 @@ public:
 					case OPCODE_LOD:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						int textureId, samplerId;
-						sscanf_s(op3, "t%d.", &textureId);
-						sscanf_s(op4, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						int samplerId = instr->asOperands[3].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
 						char *clamped = strrchr(op3, '.') + 1;
 						if (*clamped == 'x')
 							sprintf(buffer, "  %s = %s.CalculateLevelOfDetail(%s, %s);\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str());
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str());
 						else
 							sprintf(buffer, "  %s = %s.CalculateLevelOfDetailUnclamped(%s, %s);\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str());
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str());
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
@@ -6207,21 +6425,20 @@ public:
 					case OPCODE_GATHER4:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						int textureId, samplerId;
-						sscanf_s(op3, "t%d.", &textureId);
-						sscanf_s(op4, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						int samplerId = instr->asOperands[3].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
 							sprintf(buffer, "  %s = %s.Gather(%s, %s)%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(), strrchr(op3, '.'));
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), strrchr(op3, '.'));
 						else
 						{
 							int offsetx = 0, offsety = 0, offsetz = 0;
 							sscanf_s(statement, "gather4_aoffimmi_indexable(%d,%d,%d", &offsetx, &offsety, &offsetz);
 							sprintf(buffer, "  %s = %s.Gather(%s, %s, int2(%d, %d))%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerNames[samplerId].c_str(), ci(op2).c_str(),
+								mTextures->Name(textureId).c_str(), mSamplers->Name(samplerId).c_str(), ci(op2).c_str(),
 								offsetx, offsety, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6232,21 +6449,20 @@ public:
 					case OPCODE_GATHER4_C:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						int textureId, samplerId;
-						sscanf_s(op3, "t%d.", &textureId);
-						sscanf_s(op4, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						int samplerId = instr->asOperands[3].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
 							sprintf(buffer, "  %s = %s.GatherCmp(%s, %s, %s)%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerComparisonNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
+								mTextures->Name(textureId).c_str(), mSamplerComparisons->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(), strrchr(op3, '.'));
 						else
 						{
 							int offsetx = 0, offsety = 0, offsetz = 0;
 							sscanf_s(statement, "gather4_c_aoffimmi_indexable(%d,%d,%d", &offsetx, &offsety, &offsetz);
 							sprintf(buffer, "  %s = %s.GatherCmp(%s, %s, %s, int2(%d,%d))%s;\n", writeTarget(op1),
-								mTextureNames[textureId].c_str(), mSamplerComparisonNames[samplerId].c_str(), ci(op2).c_str(), ci(op5).c_str(),
+								mTextures->Name(textureId).c_str(), mSamplerComparisons->Name(samplerId).c_str(), ci(op2).c_str(), ci(op5).c_str(),
 								offsetx, offsety, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6260,15 +6476,14 @@ public:
 					case OPCODE_GATHER4_PO:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
-						applySwizzle(op1, op4);
-						int textureId, samplerId;
-						sscanf_s(op4, "t%d.", &textureId);
-						sscanf_s(op5, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
-						sprintf(buffer, "  %s = %s.Gather(%s, %s, %s)%s;\n", writeTarget(op1), mTextureNames[textureId].c_str(), 
-							mSamplerNames[samplerId].c_str(), ci(op2).c_str(), ci(op3).c_str(), strrchr(op4, '.'));
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3]);
+						int textureId = instr->asOperands[3].ui32RegisterNumber;
+						int samplerId = instr->asOperands[4].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
+						sprintf(buffer, "  %s = %s.Gather(%s, %s, %s)%s;\n", writeTarget(op1), mTextures->Name(textureId).c_str(), 
+							mSamplers->Name(samplerId).c_str(), ci(op2).c_str(), ci(op3).c_str(), strrchr(op4, '.'));
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
@@ -6278,15 +6493,14 @@ public:
 					case OPCODE_GATHER4_PO_C:
 					{
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(op1, op3);
-						applySwizzle(op1, op4);
-						int textureId, samplerId;
-						sscanf_s(op4, "t%d.", &textureId);
-						sscanf_s(op5, "s%d", &samplerId);
-						truncateTexturePos(op2, mTextureType[textureId].c_str());
-						sprintf(buffer, "  %s = %s.GatherCmp(%s, %s, %s, %s)%s;\n", writeTarget(op1), mTextureNames[textureId].c_str(), 
-							mSamplerComparisonNames[samplerId].c_str(), ci(op2).c_str(), ci(op6).c_str(), ci(op3).c_str(), strrchr(op4, '.'));
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(op1, instr->asOperands[0], op4, instr->asOperands[3]);
+						int textureId = instr->asOperands[3].ui32RegisterNumber;
+						int samplerId = instr->asOperands[4].ui32RegisterNumber;
+						truncateTexturePos(op2, mTextures->Type(textureId).c_str());
+						sprintf(buffer, "  %s = %s.GatherCmp(%s, %s, %s, %s)%s;\n", writeTarget(op1), mTextures->Name(textureId).c_str(), 
+							mSamplerComparisons->Name(samplerId).c_str(), ci(op2).c_str(), ci(op6).c_str(), ci(op3).c_str(), strrchr(op4, '.'));
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
@@ -6300,19 +6514,18 @@ public:
 					case OPCODE_LD:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						int textureId;
-						sscanf_s(op3, "t%d.", &textureId);
-						truncateTextureLoadPos(op2, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op1, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op3, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						truncateTextureLoadPos(op2, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op1, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op3, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
-							sprintf(buffer, "  %s = %s.Load(%s)%s;\n", writeTarget(op1), mTextureNames[textureId].c_str(), ci(op2).c_str(), strrchr(op3, '.'));
+							sprintf(buffer, "  %s = %s.Load(%s)%s;\n", writeTarget(op1), mTextures->Name(textureId).c_str(), ci(op2).c_str(), strrchr(op3, '.'));
 						else {
 							int offsetU = 0, offsetV = 0, offsetW = 0;
 							sscanf_s(statement, "ld_aoffimmi(%d,%d,%d", &offsetU, &offsetV, &offsetW);
-							sprintf(buffer, "  %s = %s.Load(%s, int3(%d, %d, %d))%s;\n", writeTarget(op1), mTextureNames[textureId].c_str(), ci(op2).c_str(),
+							sprintf(buffer, "  %s = %s.Load(%s, int3(%d, %d, %d))%s;\n", writeTarget(op1), mTextures->Name(textureId).c_str(), ci(op2).c_str(),
 								offsetU, offsetV, offsetW, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6322,20 +6535,19 @@ public:
 					case OPCODE_LD_MS:
 					{
 						remapTarget(op1);
-						applySwizzle(".xyzw", op2);
-						applySwizzle(op1, op3);
-						applySwizzle(".x", fixImm(op4, instr->asOperands[3]), true);
-						int textureId;
-						sscanf_s(op3, "t%d.", &textureId);
-						truncateTextureLoadPos(op2, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op1, mTextureType[textureId].c_str());
-						truncateTextureSwiz(op3, mTextureType[textureId].c_str());
+						applySwizzle(".xyzw", op2, instr->asOperands[1]);
+						applySwizzle(op1, instr->asOperands[0], op3, instr->asOperands[2]);
+						applySwizzle(".x", fixImm(op4, instr->asOperands[3]), instr->asOperands[3], true);
+						int textureId = instr->asOperands[2].ui32RegisterNumber;
+						truncateTextureLoadPos(op2, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op1, mTextures->Type(textureId).c_str());
+						truncateTextureSwiz(op3, mTextures->Type(textureId).c_str());
 						if (!instr->bAddressOffset)
-							sprintf(buffer, "  %s = %s.Load(%s, %s)%s;\n", writeTarget(op1), mTextureNames[textureId].c_str(), ci(op2).c_str(), ci(op4).c_str(), strrchr(op3, '.'));
+							sprintf(buffer, "  %s = %s.Load(%s, %s)%s;\n", writeTarget(op1), mTextures->Name(textureId).c_str(), ci(op2).c_str(), ci(op4).c_str(), strrchr(op3, '.'));
 						else{
 							int offsetU = 0, offsetV = 0, offsetW = 0;
 							sscanf_s(statement, "ld_aoffimmi(%d,%d,%d", &offsetU, &offsetV, &offsetW);
-							sprintf(buffer, "  %s = %s.Load(%s, %s, int3(%d, %d, %d))%s;\n", writeTarget(op1), mTextureNames[textureId].c_str(), ci(op2).c_str(), ci(op4).c_str(),
+							sprintf(buffer, "  %s = %s.Load(%s, %s, int3(%d, %d, %d))%s;\n", writeTarget(op1), mTextures->Name(textureId).c_str(), ci(op2).c_str(), ci(op4).c_str(),
 								offsetU, offsetV, offsetW, strrchr(op3, '.'));
 						}
 						appendOutput(buffer);
@@ -6370,7 +6582,7 @@ public:
 					}
 
 					case OPCODE_DISCARD:
-						applySwizzle(".x", op1);
+						applySwizzle(".x", op1, instr->asOperands[0]);
 						if (instr->eBooleanTestType == INSTRUCTION_TEST_ZERO)
 							sprintf(buffer, "  if (%s == 0) discard;\n", ci(op1).c_str());
 						else
@@ -6560,63 +6772,63 @@ public:
 
 					case OPCODE_EVAL_SAMPLE_INDEX:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(".x", fixImm(op3, instr->asOperands[2]), true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(".x", fixImm(op3, instr->asOperands[2]), instr->asOperands[2], true);
 						sprintf(buffer, "  %s = EvaluateAttributeAtSample(%s, %s);\n", writeTarget(op1), op2, op3);
 						appendOutput(buffer);
 						break;
 					case OPCODE_EVAL_CENTROID:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = EvaluateAttributeCentroid(%s);\n", writeTarget(op1), op2);
 						appendOutput(buffer);
 						break;
 					case OPCODE_EVAL_SNAPPED:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
-						applySwizzle(".xy", fixImm(op3, instr->asOperands[2]), true);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
+						applySwizzle(".xy", fixImm(op3, instr->asOperands[2]), instr->asOperands[2], true);
 						sprintf(buffer, "  %s = EvaluateAttributeSnapped(%s, %s);\n", writeTarget(op1), op2, op3);
 						appendOutput(buffer);
 						break;
 
 					case OPCODE_DERIV_RTX_COARSE:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = ddx_coarse(%s);\n", writeTarget(op1), op2);
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_DERIV_RTX_FINE:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = ddx_fine(%s);\n", writeTarget(op1), op2);
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_DERIV_RTY_COARSE:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = ddy_coarse(%s);\n", writeTarget(op1), op2);
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_DERIV_RTY_FINE:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = ddy_fine(%s);\n", writeTarget(op1), op2);
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_DERIV_RTX:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = ddx(%s);\n", writeTarget(op1), op2);
 						appendOutput(buffer);
 						removeBoolean(op1);
 						break;
 					case OPCODE_DERIV_RTY:
 						remapTarget(op1);
-						applySwizzle(op1, op2);
+						applySwizzle(op1, instr->asOperands[0], op2, instr->asOperands[1]);
 						sprintf(buffer, "  %s = ddy(%s);\n", writeTarget(op1), op2);
 						appendOutput(buffer);
 						removeBoolean(op1);
@@ -6629,7 +6841,7 @@ public:
 
 						// Missing opcode needed for WatchDogs. Used as "retc_nz r0.x"
 					case OPCODE_RETC:
-						applySwizzle(".x", op1);
+						applySwizzle(".x", op1, instr->asOperands[0]);
 						if (instr->eBooleanTestType == INSTRUCTION_TEST_ZERO)
 							sprintf(buffer, "  if (%s == 0) return;\n", ci(op1).c_str());
 						else
@@ -6680,6 +6892,7 @@ public:
 	{
 		mOutputRegisterValues.clear();
 		mBooleanRegisters.clear();
+		mBooleanTemps->Clear();
 		mCodeStartPos = mOutput.size();
 
 		size_t pos = 0;
@@ -6782,6 +6995,19 @@ const string DecompileBinaryHLSL(ParseParameters &params, bool &patched, std::st
 	d.mPatched = false;
 	d.G = params.G;
 
+	// Anything left in a reused arena belongs to a previous shader that
+	// has already been deleted (or leaked by an exception below):
+	DecodeArena local_arena;
+	DecodeArena *arena = params.arena ? params.arena : &local_arena;
+	arena->Reset();
+
+	// Same for the symbol tables, which just keep their capacity and
+	// interned names from one shader to the next:
+	DecompilerSymbols local_symbols;
+	DecompilerSymbols *symbols = params.symbols ? params.symbols : &local_symbols;
+	symbols->Reset();
+	d.UseSymbols(symbols);
+
 	// Decompile binary.
 
 	// This can crash, because of unknown or unseen syntax, so we wrap it in try/catch
@@ -6794,7 +7020,7 @@ const string DecompileBinaryHLSL(ParseParameters &params, bool &patched, std::st
 	// The termination handler approach does not catch those errors either.
 	try
 	{
-		Shader *shader = DecodeDXBC((uint32_t*)params.bytecode);
+		Shader *shader = DecodeDXBC((uint32_t*)params.bytecode, arena);
 		if (!shader) return string();
 
 		if (shader->dx9Shader)
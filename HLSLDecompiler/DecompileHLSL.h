@@ -12,6 +12,13 @@
 const int opcodeSize = 128;
 const int stringSize = 256;
 
+// Version of the HLSL the decompiler produces. The DX11 decompiler cache is
+// keyed on this, so bump it with any change to the decompiler, the binary
+// decoder or the disassembler that could alter the output for some shader -
+// the 3DMigoto version alone is not enough, since it stays the same across
+// dev builds and fix pack test builds.
+#define DECOMPILER_CACHE_VERSION 2
+
 struct DecompilerSettings
 {
 	int StereoParamsReg;
@@ -42,6 +49,9 @@ struct DecompilerSettings
 	{}
 };
 
+class DecodeArena;
+class DecompilerSymbols;
+
 struct ParseParameters
 {
 	const void *bytecode;
@@ -55,6 +65,16 @@ struct ParseParameters
 	//dx9
 
 	DecompilerSettings *G;
+
+	// Optional arena for the binary decoder. Callers decompiling many
+	// shaders can keep one around (one per thread) so the decoder stops
+	// allocating once it has warmed up. If NULL a temporary one is used.
+	DecodeArena *arena = NULL;
+
+	// Optional symbol tables for the decompiler (see DecompilerSymbols.h),
+	// which can likewise be kept around and reused for a batch of shaders.
+	// If NULL a temporary one is used.
+	DecompilerSymbols *symbols = NULL;
 };
 
 const std::string DecompileBinaryHLSL(ParseParameters &params, bool &patched, std::string &shaderModel, bool &errorOccurred);
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Symbol tables for the HLSL decompiler. Resources and DX9 constants are
+// referred to by small, dense register numbers (t0-t127, s0-s15, u0-u63,
+// c0-c255...), and the decompiler looks one of them up for nearly every
+// texture instruction and constant operand it translates. Keeping them in
+// flat arrays indexed by register number avoids walking a std::map for each
+// lookup, and interning the names means the strings themselves are only
+// stored (and allocated) once.
+//
+// A DecompilerSymbols can be passed in via ParseParameters and reused for a
+// whole batch of shaders (one per thread, like the DecodeArena), in which
+// case Reset() keeps the capacity of all the tables and the names that have
+// already been interned, so the common ones ("Texture2D<float4>", etc) stop
+// being allocated after the first few shaders.
+
+// Maps strings to small integer IDs and back. ID 0 is always the empty
+// string, so zero initialised table entries read back as "".
+class SymbolInterner
+{
+public:
+	SymbolInterner()
+	{
+		Clear();
+	}
+
+	int Intern(const std::string &str)
+	{
+		std::unordered_map<std::string, int>::iterator i = mIds.find(str);
+		if (i != mIds.end())
+			return i->second;
+
+		i = mIds.insert(std::make_pair(str, (int)mStrings.size())).first;
+		mStrings.push_back(&i->first);
+		return i->second;
+	}
+
+	const std::string& String(int id) const
+	{
+		return *mStrings[id];
+	}
+
+	size_t Size() const
+	{
+		return mStrings.size();
+	}
+
+	void Clear()
+	{
+		mIds.clear();
+		mStrings.clear();
+		Intern(std::string());
+	}
+
+private:
+	// Keys of an unordered_map don't move on rehash, so we can point at them:
+	std::unordered_map<std::string, int> mIds;
+	std::vector<const std::string*> mStrings;
+};
+
+// Name, type and array size of each register of one resource type, indexed
+// by register number.
+//
+// Name() marks the register as used the same way std::map::operator[] did,
+// since a few of the patching passes search the names of every register that
+// has been referenced, not just those that were declared. Registers outside
+// the range the hardware supports are not stored - they read back as empty
+// and writes to them are ignored.
+class RegisterTable
+{
+public:
+	static const int MaxRegister = 65536;
+
+	explicit RegisterTable(SymbolInterner *interner)
+		: mInterner(interner)
+	{}
+
+	// Registers are in use from 0 to End() - 1 when Has() says so:
+	int End() const
+	{
+		return (int)mSlots.size();
+	}
+
+	bool Has(int reg) const
+	{
+		return reg >= 0 && reg < (int)mSlots.size() && mSlots[reg].used;
+	}
+
+	const std::string& Name(int reg)
+	{
+		Slot *slot = At(reg);
+		if (!slot)
+			return mInterner->String(0);
+		slot->used = true;
+		return mInterner->String(slot->name);
+	}
+
+	void SetName(int reg, const std::string &name)
+	{
+		Slot *slot = At(reg);
+		if (!slot)
+			return;
+		slot->name = mInterner->Intern(name);
+		slot->used = true;
+	}
+
+	const std::string& Type(int reg) const
+	{
+		if (reg < 0 || reg >= (int)mSlots.size())
+			return mInterner->String(0);
+		return mInterner->String(mSlots[reg].type);
+	}
+
+	void SetType(int reg, const std::string &type)
+	{
+		Slot *slot = At(reg);
+		if (slot)
+			slot->type = mInterner->Intern(type);
+	}
+
+	int ArraySize(int reg) const
+	{
+		if (reg < 0 || reg >= (int)mSlots.size())
+			return 0;
+		return mSlots[reg].arraySize;
+	}
+
+	void SetArraySize(int reg, int size)
+	{
+		Slot *slot = At(reg);
+		if (slot)
+			slot->arraySize = size;
+	}
+
+	// Lowest register in use with this name, or -1:
+	int Find(const std::string &name) const
+	{
+		for (size_t i = 0; i < mSlots.size(); i++)
+			if (mSlots[i].used && mInterner->String(mSlots[i].name) == name)
+				return (int)i;
+		return -1;
+	}
+
+	void Clear()
+	{
+		mSlots.clear();
+	}
+
+private:
+	struct Slot
+	{
+		int name;
+		int type;
+		int arraySize;
+		bool used;
+	};
+
+	Slot* At(int reg)
+	{
+		if (reg < 0 || reg >= MaxRegister)
+			return NULL;
+		if (reg >= (int)mSlots.size())
+			mSlots.resize(reg + 1, Slot());
+		return &mSlots[reg];
+	}
+
+	SymbolInterner *mInterner;
+	std::vector<Slot> mSlots;
+};
+
+// One bit per component (x = 1, y = 2, z = 4, w = 8) of each register,
+// indexed by register number. Used to track which temporary register
+// components currently hold a boolean.
+class RegisterMaskTable
+{
+public:
+	static const int MaxRegister = 65536;
+
+	bool Any(int reg, unsigned mask) const
+	{
+		return reg >= 0 && reg < (int)mMasks.size() && (mMasks[reg] & mask);
+	}
+
+	void Set(int reg, unsigned mask)
+	{
+		if (reg < 0 || reg >= MaxRegister)
+			return;
+		if (reg >= (int)mMasks.size())
+			mMasks.resize(reg + 1, 0);
+		mMasks[reg] |= (uint8_t)mask;
+	}
+
+	void Unset(int reg, unsigned mask)
+	{
+		if (reg >= 0 && reg < (int)mMasks.size())
+			mMasks[reg] &= (uint8_t)~mask;
+	}
+
+	void Clear()
+	{
+		mMasks.clear();
+	}
+
+private:
+	std::vector<uint8_t> mMasks;
+};
+
+class DecompilerSymbols
+{
+public:
+	// Past this many distinct names Reset() starts the interner over, so
+	// that a long batch doesn't keep every name it has ever seen:
+	static const size_t MaxInternedStrings = 16384;
+
+	DecompilerSymbols()
+		: Samplers(&Strings),
+		SamplerComparisons(&Strings),
+		Textures(&Strings),
+		UAVs(&Strings),
+		Uniforms(&Strings),
+		BoolUniforms(&Strings)
+	{}
+
+	void Reset()
+	{
+		Samplers.Clear();
+		SamplerComparisons.Clear();
+		Textures.Clear();
+		UAVs.Clear();
+		Uniforms.Clear();
+		BoolUniforms.Clear();
+		BooleanTemps.Clear();
+		if (Strings.Size() > MaxInternedStrings)
+			Strings.Clear();
+	}
+
+	SymbolInterner Strings;
+
+	RegisterTable Samplers;
+	RegisterTable SamplerComparisons;
+	RegisterTable Textures;
+	RegisterTable UAVs;
+
+	//dx9
+	RegisterTable Uniforms;
+	RegisterTable BoolUniforms;
+	//dx9
+
+	RegisterMaskTable BooleanTemps;
+
+private:
+	// Not copyable - the tables hold a pointer to our interner:
+	DecompilerSymbols(const DecompilerSymbols&);
+	DecompilerSymbols& operator=(const DecompilerSymbols&);
+};
@@ -4,9 +4,20 @@
 #include "stdafx.h"
 
 #include <iostream>     // console output
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <io.h>
 
 #include <D3Dcompiler.h>
 #include "DecompileHLSL.h"
+#include "DecompilerSymbols.h"
+#include "BinaryDecompiler\internal_includes\structs.h"
+#include "BinaryDecompiler\internal_includes\decode.h"
+#include "BinaryDecompiler\internal_includes\disassemble.h"
 #include "version.h"
 #include "log.h"
 #define MIGOTO_DX 11 // Selects the DX11 disassembler in util.h - the DX9 dis/assembler is not very
@@ -20,10 +31,16 @@ using namespace std;
 FILE *LogFile = stderr; // Log to stderr by default
 bool gLogDebug = false;
 
+#define DEFAULT_BINARY_PATTERN "*.bin;*.o;*.cso"
+#define DEFAULT_ASM_PATTERN "*.asm;*.txt"
+
 static void PrintHelp(int argc, char *argv[])
 {
 	LogInfo("usage: %s [OPTION] FILE...\n\n", argv[0]);
 
+	LogInfo("FILE may also be a directory, which is searched recursively for files\n");
+	LogInfo("matching --pattern, or contain * and ? wildcards in the filename.\n\n");
+
 	LogInfo("  -D, --decompile\n");
 	LogInfo("\t\t\tDecompile binary shaders with 3DMigoto's decompiler\n");
 
@@ -40,6 +57,9 @@ static void PrintHelp(int argc, char *argv[])
 	LogInfo("  --disassemble-ms\n");
 	LogInfo("\t\t\tDisassemble binary shaders with Microsoft's disassembler\n");
 
+	LogInfo("  --disassemble-native\n");
+	LogInfo("\t\t\tDisassemble binary shaders with 3DMigoto's fxc compatible disassembler\n");
+
 	// Only applicable to the vs2017 branch / d3dcompiler_47 version:
 	LogInfo("  -6, --disassemble-46\n");
 	LogInfo("\t\t\tApply backwards compatibility formatting patch to disassembler output\n");
@@ -68,6 +88,36 @@ static void PrintHelp(int argc, char *argv[])
 	LogInfo("  -S, --stop-on-failure\n");
 	LogInfo("\t\t\tStop processing files if an error occurs\n");
 
+	LogInfo("  -j, --jobs N\n");
+	LogInfo("\t\t\tProcess files on N threads (0 = one per CPU). The log of each file is\n");
+	LogInfo("\t\t\tstill printed in order. Cannot be combined with the --benchmark-* options.\n");
+	LogInfo("\t\t\tA summary is printed at the end whenever more than one file is processed.\n");
+
+	LogInfo("  --pattern PATTERNS\n");
+	LogInfo("\t\t\tSemicolon separated wildcards of files to process when searching\n");
+	LogInfo("\t\t\tdirectories (default: " DEFAULT_BINARY_PATTERN ", or " DEFAULT_ASM_PATTERN "\n");
+	LogInfo("\t\t\twhen assembling)\n");
+
+	LogInfo("  --benchmark-hash\n");
+	LogInfo("\t\t\tTime the shader hash functions over the input files and check the\n");
+	LogInfo("\t\t\tunrolled FNV-1 matches the original byte at a time implementation\n");
+
+	LogInfo("  --benchmark-decode\n");
+	LogInfo("\t\t\tTime the binary decoder over the input files with and without\n");
+	LogInfo("\t\t\ta reused arena allocator\n");
+
+	LogInfo("  --benchmark-assemble\n");
+	LogInfo("\t\t\tTime reassembling the disassembly of the input files and count the\n");
+	LogInfo("\t\t\tallocations it makes\n");
+
+	LogInfo("  --benchmark-disassemble\n");
+	LogInfo("\t\t\tTime the native disassembler against Microsoft's over the input files\n");
+	LogInfo("\t\t\tand check both produce the same text\n");
+
+	LogInfo("  --benchmark-decompile\n");
+	LogInfo("\t\t\tTime the HLSL decompiler over the input files, starting from the same\n");
+	LogInfo("\t\t\tdisassembly that -D gives it, with new and with reused symbol tables\n");
+
 	LogInfo("  -v, --verbose\n");
 	LogInfo("\t\t\tVerbose debugging output\n");
 
@@ -86,6 +136,7 @@ static struct {
 	bool decompile;
 	bool compile;
 	bool disassemble_ms;
+	bool disassemble_native;
 	bool disassemble_flugan;
 	int disassemble_hexdump;
 	bool disassemble_46;
@@ -96,6 +147,13 @@ static struct {
 	bool validate;
 	bool lenient;
 	bool stop;
+	bool benchmark_hash;
+	bool benchmark_decode;
+	bool benchmark_assemble;
+	bool benchmark_disassemble;
+	bool benchmark_decompile;
+	int jobs = 1;
+	std::string pattern;
 } args;
 
 void parse_args(int argc, char *argv[])
@@ -160,6 +218,10 @@ void parse_args(int argc, char *argv[])
 				args.disassemble_ms = true;
 				continue;
 			}
+			if (!strcmp(arg, "--disassemble-native")) {
+				args.disassemble_native = true;
+				continue;
+			}
 			if (!strcmp(arg, "-a") || !strcmp(arg, "--assemble")) {
 				args.assemble = true;
 				continue;
@@ -180,6 +242,40 @@ void parse_args(int argc, char *argv[])
 				args.stop = true;
 				continue;
 			}
+			if (!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) {
+				if (++i >= argc)
+					PrintHelp(argc, argv);
+				args.jobs = atoi(argv[i]);
+				if (args.jobs <= 0)
+					args.jobs = max(1u, std::thread::hardware_concurrency());
+				continue;
+			}
+			if (!strcmp(arg, "--pattern")) {
+				if (++i >= argc)
+					PrintHelp(argc, argv);
+				args.pattern = argv[i];
+				continue;
+			}
+			if (!strcmp(arg, "--benchmark-hash")) {
+				args.benchmark_hash = true;
+				continue;
+			}
+			if (!strcmp(arg, "--benchmark-decode")) {
+				args.benchmark_decode = true;
+				continue;
+			}
+			if (!strcmp(arg, "--benchmark-assemble")) {
+				args.benchmark_assemble = true;
+				continue;
+			}
+			if (!strcmp(arg, "--benchmark-disassemble")) {
+				args.benchmark_disassemble = true;
+				continue;
+			}
+			if (!strcmp(arg, "--benchmark-decompile")) {
+				args.benchmark_decompile = true;
+				continue;
+			}
 			if (!strcmp(arg, "-v") || !strcmp(arg, "--verbose")) {
 				gLogDebug = true;
 				continue;
@@ -192,14 +288,31 @@ void parse_args(int argc, char *argv[])
 
 	if (args.decompile + args.compile
 			+ args.disassemble_ms
+			+ args.disassemble_native
 			+ args.disassemble_flugan
 			+ args.disassemble_hexdump
 			+ args.disassemble_46
-			+ args.assemble < 1) {
+			+ args.assemble
+			+ args.benchmark_hash
+			+ args.benchmark_decode
+			+ args.benchmark_assemble
+			+ args.benchmark_disassemble
+			+ args.benchmark_decompile < 1) {
 		LogInfo("No action specified\n");
 		PrintHelp(argc, argv); // Does not return
 	}
 
+	if (args.pattern.empty())
+		args.pattern = args.assemble ? DEFAULT_ASM_PATTERN : DEFAULT_BINARY_PATTERN;
+
+	// The per-file benchmarks add up their timings in globals, and would
+	// be measuring contention between the workers if run in parallel:
+	if ((args.benchmark_hash || args.benchmark_decode || args.benchmark_assemble || args.benchmark_disassemble ||
+	     args.benchmark_decompile) && args.jobs > 1) {
+		LogInfo("The --benchmark-* options run single threaded and cannot be combined with --jobs\n");
+		PrintHelp(argc, argv); // Does not return
+	}
+
 }
 
 // Old version directly using D3DDisassemble, suffers from precision issues due
@@ -227,6 +340,18 @@ static HRESULT DisassembleMS(const void *pShaderBytecode, size_t BytecodeLength,
 	return S_OK;
 }
 
+static HRESULT DisassembleNative(const void *pShaderBytecode, size_t BytecodeLength, string *asmText)
+{
+	string comments = "//   using 3Dmigoto command line v" + string(VER_FILE_VERSION_STR) + " on " + LogTime() + "//\n";
+
+	if (!DisassembleDXBC(pShaderBytecode, BytecodeLength, comments.c_str(), asmText)) {
+		LogInfo("  native disassembly failed\n");
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
+
 static HRESULT DisassembleFlugan(const void *pShaderBytecode, size_t BytecodeLength, string *asmText,
 		int hexdump, bool d3dcompiler_46_compat)
 {
@@ -395,6 +520,11 @@ static int validate_assembly(string *assembly, vector<char> *old_shader)
 }
 
 
+// One per batch mode worker, so after the first few shaders the decoder no
+// longer needs to touch the heap:
+static thread_local DecodeArena decode_arena;
+static thread_local DecompilerSymbols decompiler_symbols;
+
 static HRESULT Decompile(const void *pShaderBytecode, size_t BytecodeLength, string *hlslText, string *shaderModel)
 {
 	// Set all to zero, so we only init the ones we are using here:
@@ -415,6 +545,8 @@ static HRESULT Decompile(const void *pShaderBytecode, size_t BytecodeLength, str
 	p.decompiled = disassembly.c_str(); // XXX: Why do we call this "decompiled" when it's actually disassembled?
 	p.decompiledSize = disassembly.size();
 	p.G = &d;
+	p.arena = &decode_arena;
+	p.symbols = &decompiler_symbols;
 
 	// Disable IniParams and StereoParams registers. This avoids inserting
 	// these in a shader that already has them, such as some of our test
@@ -449,11 +581,11 @@ static int validate_hlsl(string *hlsl, string *shaderModel)
 	if (ppBytecode)
 		ppBytecode->Release();
 
-	if (pErrorMsgs && LogFile) { // Check LogFile so the fwrite doesn't crash
+	if (pErrorMsgs && CurrentLogFile()) { // Check LogFile so the fwrite doesn't crash
 		LPVOID errMsg = pErrorMsgs->GetBufferPointer();
 		SIZE_T errSize = pErrorMsgs->GetBufferSize();
 		LogInfo("--------------------------------------------- BEGIN ---------------------------------------------\n");
-		fwrite(errMsg, 1, errSize - 1, LogFile);
+		fwrite(errMsg, 1, errSize - 1, CurrentLogFile());
 		LogInfo("---------------------------------------------- END ----------------------------------------------\n");
 		pErrorMsgs->Release();
 	}
@@ -526,6 +658,505 @@ static int WriteOutput(string const *in_filename, char const *extension, string
 	return EXIT_SUCCESS;
 }
 
+// Each hash is repeated this many times per file so that the timings of the
+// smaller shaders in the corpus are not lost in the timer resolution:
+#define HASH_BENCHMARK_ITERATIONS 100
+
+static struct {
+	LARGE_INTEGER fnv_reference;
+	LARGE_INTEGER fnv;
+	LARGE_INTEGER xxhash64;
+	UINT64 bytes;
+	unsigned files;
+	unsigned mismatches;
+} hash_benchmark;
+
+// The original byte at a time FNV-1 loop that fnv_64_buf must match, kept
+// here as the reference that existing ShaderFixes were hashed with:
+static UINT64 fnv_64_buf_reference(const void *buf, size_t len)
+{
+	UINT64 hval = 0;
+	unsigned const char *bp = (unsigned const char *)buf;
+	unsigned const char *be = bp + len;
+
+	while (bp < be) {
+		hval *= FNV_64_PRIME;
+		hval ^= (UINT64)*bp++;
+	}
+	return hval;
+}
+
+template <UINT64 (*hash_fn)(const void *buf, size_t len)>
+static UINT64 time_hash(vector<char> *srcData, LARGE_INTEGER *total)
+{
+	LARGE_INTEGER start, end;
+	UINT64 hash = 0;
+	int i;
+
+	QueryPerformanceCounter(&start);
+	for (i = 0; i < HASH_BENCHMARK_ITERATIONS; i++)
+		hash = hash_fn(srcData->data(), srcData->size());
+	QueryPerformanceCounter(&end);
+
+	total->QuadPart += end.QuadPart - start.QuadPart;
+	return hash;
+}
+
+static int benchmark_hash(string const *filename, vector<char> *srcData)
+{
+	UINT64 reference, fnv, xxh64;
+
+	reference = time_hash<fnv_64_buf_reference>(srcData, &hash_benchmark.fnv_reference);
+	fnv = time_hash<fnv_64_buf>(srcData, &hash_benchmark.fnv);
+	xxh64 = time_hash<xxhash64_buf>(srcData, &hash_benchmark.xxhash64);
+
+	hash_benchmark.bytes += srcData->size();
+	hash_benchmark.files++;
+
+	LogDebug("%016llx %016llx %016llx %s\n", reference, fnv, xxh64, filename->c_str());
+
+	if (fnv != reference) {
+		LogInfo("\n*** FNV hash mismatch in %s: expected %016llx, found %016llx\n",
+				filename->c_str(), reference, fnv);
+		hash_benchmark.mismatches++;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static void log_hash_benchmark_rate(const char *name, LARGE_INTEGER *total, LARGE_INTEGER *freq)
+{
+	double seconds = (double)total->QuadPart / freq->QuadPart;
+	double mb = (double)hash_benchmark.bytes * HASH_BENCHMARK_ITERATIONS / (1024 * 1024);
+
+	LogInfo("  %-16s %10.3f ms %10.1f MB/s\n", name, seconds * 1000.0, seconds ? mb / seconds : 0.0);
+}
+
+static void log_hash_benchmark()
+{
+	LARGE_INTEGER freq;
+
+	QueryPerformanceFrequency(&freq);
+
+	LogInfo("Hashed %u files, %llu bytes, %u iterations each:\n",
+			hash_benchmark.files, hash_benchmark.bytes, HASH_BENCHMARK_ITERATIONS);
+	log_hash_benchmark_rate("FNV-1 reference", &hash_benchmark.fnv_reference, &freq);
+	log_hash_benchmark_rate("FNV-1 unrolled", &hash_benchmark.fnv, &freq);
+	log_hash_benchmark_rate("XXH64", &hash_benchmark.xxhash64, &freq);
+	if (hash_benchmark.mismatches)
+		LogInfo("*** %u files produced a different FNV-1 hash ***\n", hash_benchmark.mismatches);
+}
+
+// Decoding is much cheaper than hashing is expensive, so fewer iterations are
+// needed to get a stable number:
+#define DECODE_BENCHMARK_ITERATIONS 20
+
+static struct {
+	LARGE_INTEGER heap;
+	LARGE_INTEGER arena;
+	DecodeArena arena_allocator;
+	unsigned instructions;
+	unsigned files;
+	unsigned failures;
+} decode_benchmark;
+
+static bool decode_once(vector<char> *srcData, DecodeArena *arena, unsigned *instructions)
+{
+	Shader *shader;
+	int i;
+
+	if (arena)
+		arena->Reset();
+
+	shader = DecodeDXBC((uint32_t*)srcData->data(), arena);
+	if (!shader)
+		return false;
+
+	*instructions = 0;
+	for (i = 0; i < NUM_PHASES; i++) {
+		for (InstructionList &list : shader->asPhase[i].ppsInst)
+			*instructions += (unsigned)list.size();
+	}
+
+	FreeShaderInfo(shader->sInfo);
+	delete shader;
+	return true;
+}
+
+static int benchmark_decode(string const *filename, vector<char> *srcData)
+{
+	LARGE_INTEGER start, end;
+	unsigned heap_instructions = 0, arena_instructions = 0;
+	int i;
+
+	// The decoder signals malformed shaders by throwing, same as in
+	// DecompileBinaryHLSL. Doesn't matter for the benchmark, skip them:
+	try {
+		QueryPerformanceCounter(&start);
+		for (i = 0; i < DECODE_BENCHMARK_ITERATIONS; i++) {
+			if (!decode_once(srcData, NULL, &heap_instructions))
+				goto fail;
+		}
+		QueryPerformanceCounter(&end);
+		decode_benchmark.heap.QuadPart += end.QuadPart - start.QuadPart;
+
+		QueryPerformanceCounter(&start);
+		for (i = 0; i < DECODE_BENCHMARK_ITERATIONS; i++) {
+			if (!decode_once(srcData, &decode_benchmark.arena_allocator, &arena_instructions))
+				goto fail;
+		}
+		QueryPerformanceCounter(&end);
+		decode_benchmark.arena.QuadPart += end.QuadPart - start.QuadPart;
+	} catch (...) {
+		goto fail;
+	}
+
+	LogDebug("%6u instructions %s\n", arena_instructions, filename->c_str());
+
+	if (heap_instructions != arena_instructions) {
+		LogInfo("\n*** Decoder mismatch in %s: %u instructions on the heap, %u in the arena\n",
+				filename->c_str(), heap_instructions, arena_instructions);
+		decode_benchmark.failures++;
+		return EXIT_FAILURE;
+	}
+
+	decode_benchmark.instructions += arena_instructions;
+	decode_benchmark.files++;
+	return EXIT_SUCCESS;
+fail:
+	LogInfo("Unable to decode %s\n", filename->c_str());
+	decode_benchmark.failures++;
+	return EXIT_FAILURE;
+}
+
+static void log_decode_benchmark_rate(const char *name, LARGE_INTEGER *total, LARGE_INTEGER *freq)
+{
+	double seconds = (double)total->QuadPart / freq->QuadPart;
+	double shaders = (double)decode_benchmark.files * DECODE_BENCHMARK_ITERATIONS;
+
+	LogInfo("  %-16s %10.3f ms %10.1f shaders/s\n", name, seconds * 1000.0, seconds ? shaders / seconds : 0.0);
+}
+
+static void log_decode_benchmark()
+{
+	LARGE_INTEGER freq;
+
+	QueryPerformanceFrequency(&freq);
+
+	LogInfo("Decoded %u files, %u instructions, %u iterations each:\n",
+			decode_benchmark.files, decode_benchmark.instructions, DECODE_BENCHMARK_ITERATIONS);
+	log_decode_benchmark_rate("Heap", &decode_benchmark.heap, &freq);
+	log_decode_benchmark_rate("Reused arena", &decode_benchmark.arena, &freq);
+	LogInfo("  Arena made %llu chunk allocations in total, largest shader used %Iu bytes\n",
+			decode_benchmark.arena_allocator.ui64ChunkAllocations,
+			decode_benchmark.arena_allocator.uHighWaterMark);
+	if (decode_benchmark.failures)
+		LogInfo("*** %u files failed to decode ***\n", decode_benchmark.failures);
+}
+
+// Counts every allocation made with operator new in this process, so that
+// the benchmarks can report how many allocations the code under test makes.
+// The containers used by the assembler all go through here:
+static atomic<uint64_t> operator_new_count;
+
+void* operator new(size_t size)
+{
+	void *p;
+
+	operator_new_count.fetch_add(1, memory_order_relaxed);
+	p = malloc(size ? size : 1);
+	if (!p)
+		throw bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+#define ASSEMBLE_BENCHMARK_ITERATIONS 10
+
+static struct {
+	LARGE_INTEGER total;
+	uint64_t allocations;
+	size_t lines;
+	unsigned files;
+	unsigned failures;
+} assemble_benchmark;
+
+// Times the assembler on the text that the disassembler produces for each
+// input file, which includes the signature parsing that the assembler uses
+// to rebuild the shader, same as when ShaderRegex or a shader fix does:
+static int benchmark_assemble(string const *filename, vector<char> *srcData)
+{
+	LARGE_INTEGER start, end;
+	uint64_t allocations;
+	vector<byte> new_bytecode;
+	vector<char> asm_vector;
+	string disassembly;
+	int i;
+
+	if (FAILED(DisassembleFlugan(srcData->data(), srcData->size(), &disassembly, 0, false)))
+		goto fail;
+	asm_vector.assign(disassembly.begin(), disassembly.end());
+
+	try {
+		allocations = operator_new_count.load(memory_order_relaxed);
+		QueryPerformanceCounter(&start);
+		for (i = 0; i < ASSEMBLE_BENCHMARK_ITERATIONS; i++) {
+			if (FAILED(AssembleFluganWithSignatureParsing(&asm_vector, &new_bytecode)))
+				goto fail;
+		}
+		QueryPerformanceCounter(&end);
+		allocations = operator_new_count.load(memory_order_relaxed) - allocations;
+	} catch (...) {
+		goto fail;
+	}
+	assemble_benchmark.total.QuadPart += end.QuadPart - start.QuadPart;
+	assemble_benchmark.allocations += allocations;
+
+	assemble_benchmark.lines += count(disassembly.begin(), disassembly.end(), '\n');
+	assemble_benchmark.files++;
+	return EXIT_SUCCESS;
+fail:
+	LogInfo("Unable to reassemble %s\n", filename->c_str());
+	assemble_benchmark.failures++;
+	return EXIT_FAILURE;
+}
+
+static void log_assemble_benchmark()
+{
+	LARGE_INTEGER freq;
+	double seconds;
+
+	QueryPerformanceFrequency(&freq);
+	seconds = (double)assemble_benchmark.total.QuadPart / freq.QuadPart;
+
+	LogInfo("Assembled %u files, %Iu lines, %u iterations each:\n",
+			assemble_benchmark.files, assemble_benchmark.lines, ASSEMBLE_BENCHMARK_ITERATIONS);
+	LogInfo("  %-16s %10.3f ms %10.1f shaders/s %10.1f lines/s\n", "Assembler", seconds * 1000.0,
+			seconds ? (double)assemble_benchmark.files * ASSEMBLE_BENCHMARK_ITERATIONS / seconds : 0.0,
+			seconds ? (double)assemble_benchmark.lines * ASSEMBLE_BENCHMARK_ITERATIONS / seconds : 0.0);
+	LogInfo("  %.1f allocations per shader\n", assemble_benchmark.files ?
+			(double)assemble_benchmark.allocations / assemble_benchmark.files / ASSEMBLE_BENCHMARK_ITERATIONS : 0.0);
+	if (assemble_benchmark.failures)
+		LogInfo("*** %u files failed to reassemble ***\n", assemble_benchmark.failures);
+}
+
+#define DISASSEMBLE_BENCHMARK_ITERATIONS 10
+
+static struct {
+	LARGE_INTEGER ms;
+	LARGE_INTEGER native;
+	size_t lines;
+	unsigned files;
+	unsigned mismatches;
+	unsigned failures;
+} disassemble_benchmark;
+
+// Times D3DDisassemble against the native disassembler with the same flags
+// and comment, and checks they agree. Files the native disassembler declines
+// (DX9, class linkage) are skipped since the assembler falls back to
+// D3DDisassemble for those anyway:
+static int benchmark_disassemble(string const *filename, vector<char> *srcData)
+{
+	LARGE_INTEGER start, end;
+	ID3DBlob *disassembly = NULL;
+	string ms, native;
+	int i;
+
+	if (!DisassembleDXBC(srcData->data(), srcData->size(), NULL, &native)) {
+		LogInfo("Skipping %s: not supported by native disassembler\n", filename->c_str());
+		return EXIT_SUCCESS;
+	}
+
+	QueryPerformanceCounter(&start);
+	for (i = 0; i < DISASSEMBLE_BENCHMARK_ITERATIONS; i++) {
+		if (disassembly)
+			disassembly->Release();
+		disassembly = NULL;
+		if (FAILED(D3DDisassemble(srcData->data(), srcData->size(),
+				D3D_DISASM_ENABLE_DEFAULT_VALUE_PRINTS, NULL, &disassembly)))
+			goto fail;
+		ms = (char*)disassembly->GetBufferPointer();
+	}
+	QueryPerformanceCounter(&end);
+	disassembly->Release();
+	disassemble_benchmark.ms.QuadPart += end.QuadPart - start.QuadPart;
+
+	QueryPerformanceCounter(&start);
+	for (i = 0; i < DISASSEMBLE_BENCHMARK_ITERATIONS; i++) {
+		if (!DisassembleDXBC(srcData->data(), srcData->size(), NULL, &native))
+			goto fail;
+	}
+	QueryPerformanceCounter(&end);
+	disassemble_benchmark.native.QuadPart += end.QuadPart - start.QuadPart;
+
+	// The native disassembler prints floats that %f would round with
+	// more digits, so only count it as a mismatch if the assembler
+	// thinks the two are different:
+	if (ms != native) {
+		vector<char> ms_vec(ms.begin(), ms.end()), native_vec(native.begin(), native.end());
+		vector<byte> ms_bytecode, native_bytecode;
+		try {
+			AssembleFluganWithSignatureParsing(&ms_vec, &ms_bytecode);
+			AssembleFluganWithSignatureParsing(&native_vec, &native_bytecode);
+		} catch (...) {
+		}
+		if (ms_bytecode.empty() || ms_bytecode != native_bytecode) {
+			LogInfo("Native disassembly of %s does not match D3DDisassemble\n", filename->c_str());
+			disassemble_benchmark.mismatches++;
+		}
+	}
+
+	disassemble_benchmark.lines += count(native.begin(), native.end(), '\n');
+	disassemble_benchmark.files++;
+	return EXIT_SUCCESS;
+fail:
+	if (disassembly)
+		disassembly->Release();
+	LogInfo("Unable to disassemble %s\n", filename->c_str());
+	disassemble_benchmark.failures++;
+	return EXIT_FAILURE;
+}
+
+static void log_disassemble_benchmark_rate(const char *name, LARGE_INTEGER *total, LARGE_INTEGER *freq)
+{
+	double seconds = (double)total->QuadPart / freq->QuadPart;
+	double shaders = (double)disassemble_benchmark.files * DISASSEMBLE_BENCHMARK_ITERATIONS;
+	double lines = (double)disassemble_benchmark.lines * DISASSEMBLE_BENCHMARK_ITERATIONS;
+
+	LogInfo("  %-16s %10.3f ms %10.1f shaders/s %10.1f lines/s\n", name, seconds * 1000.0,
+			seconds ? shaders / seconds : 0.0, seconds ? lines / seconds : 0.0);
+}
+
+static void log_disassemble_benchmark()
+{
+	LARGE_INTEGER freq;
+
+	QueryPerformanceFrequency(&freq);
+
+	LogInfo("Disassembled %u files, %Iu lines, %u iterations each:\n",
+			disassemble_benchmark.files, disassemble_benchmark.lines, DISASSEMBLE_BENCHMARK_ITERATIONS);
+	log_disassemble_benchmark_rate("D3DDisassemble", &disassemble_benchmark.ms, &freq);
+	log_disassemble_benchmark_rate("Native", &disassemble_benchmark.native, &freq);
+	if (disassemble_benchmark.mismatches)
+		LogInfo("*** %u files disassembled differently ***\n", disassemble_benchmark.mismatches);
+	if (disassemble_benchmark.failures)
+		LogInfo("*** %u files failed to disassemble ***\n", disassemble_benchmark.failures);
+}
+
+#define DECOMPILE_BENCHMARK_ITERATIONS 10
+
+static struct {
+	LARGE_INTEGER fresh;
+	LARGE_INTEGER reused;
+	size_t instructions;
+	unsigned files;
+	unsigned errors;
+	unsigned failures;
+} decompile_benchmark;
+
+static bool time_decompile(ParseParameters *p, DecompilerSymbols *symbols, LARGE_INTEGER *total,
+		bool *errorOccurred)
+{
+	LARGE_INTEGER start, end;
+	bool patched = false;
+	string hlsl, model;
+	int i;
+
+	p->symbols = symbols;
+
+	QueryPerformanceCounter(&start);
+	for (i = 0; i < DECOMPILE_BENCHMARK_ITERATIONS; i++) {
+		hlsl = DecompileBinaryHLSL(*p, patched, model, *errorOccurred);
+		if (hlsl.empty())
+			return false;
+	}
+	QueryPerformanceCounter(&end);
+	total->QuadPart += end.QuadPart - start.QuadPart;
+	return true;
+}
+
+// Times DecompileBinaryHLSL with the same settings and input as Decompile(),
+// i.e. as -D would run it, both with a new set of symbol tables for every
+// shader and with the per-thread tables -D reuses across a batch. Shaders
+// that decompile with errors are still timed, since they make it most of
+// the way through the decompiler:
+static int benchmark_decompile(string const *filename, vector<char> *srcData)
+{
+	ParseParameters p = {0};
+	DecompilerSettings d;
+	bool errorOccurred = false;
+	string disassembly;
+	unsigned instructions = 0;
+
+	if (FAILED(DisassembleMS(srcData->data(), srcData->size(), &disassembly)))
+		goto fail;
+
+	p.bytecode = srcData->data();
+	p.decompiled = disassembly.c_str();
+	p.decompiledSize = disassembly.size();
+	p.G = &d;
+	p.arena = &decode_arena;
+	d.IniParamsReg = -1;
+	d.StereoParamsReg = -1;
+
+	if (!time_decompile(&p, NULL, &decompile_benchmark.fresh, &errorOccurred))
+		goto fail;
+	if (!time_decompile(&p, &decompiler_symbols, &decompile_benchmark.reused, &errorOccurred))
+		goto fail;
+
+	if (errorOccurred)
+		decompile_benchmark.errors++;
+
+	// DecompileBinaryHLSL has already shown this will not throw:
+	decode_once(srcData, &decode_arena, &instructions);
+	decompile_benchmark.instructions += instructions;
+	decompile_benchmark.files++;
+	return EXIT_SUCCESS;
+fail:
+	LogInfo("Unable to decompile %s\n", filename->c_str());
+	decompile_benchmark.failures++;
+	return EXIT_FAILURE;
+}
+
+static void log_decompile_benchmark_rate(const char *name, LARGE_INTEGER *total, LARGE_INTEGER *freq)
+{
+	double seconds = (double)total->QuadPart / freq->QuadPart;
+	double shaders = (double)decompile_benchmark.files * DECOMPILE_BENCHMARK_ITERATIONS;
+	double instructions = (double)decompile_benchmark.instructions * DECOMPILE_BENCHMARK_ITERATIONS;
+
+	LogInfo("  %-16s %10.3f ms %10.1f shaders/s %10.1f instructions/s\n", name, seconds * 1000.0,
+			seconds ? shaders / seconds : 0.0, seconds ? instructions / seconds : 0.0);
+}
+
+static void log_decompile_benchmark()
+{
+	LARGE_INTEGER freq;
+
+	QueryPerformanceFrequency(&freq);
+
+	LogInfo("Decompiled %u files, %Iu instructions, %u iterations each:\n",
+			decompile_benchmark.files, decompile_benchmark.instructions, DECOMPILE_BENCHMARK_ITERATIONS);
+	log_decompile_benchmark_rate("Fresh symbols", &decompile_benchmark.fresh, &freq);
+	log_decompile_benchmark_rate("Reused symbols", &decompile_benchmark.reused, &freq);
+	if (decompile_benchmark.errors)
+		LogInfo("  %u files decompiled with errors\n", decompile_benchmark.errors);
+	if (decompile_benchmark.failures)
+		LogInfo("*** %u files failed to decompile ***\n", decompile_benchmark.failures);
+}
+
+// Details of why the current file failed for the batch mode summary. Thread
+// local since batch mode runs process() on several threads at once:
+static thread_local struct {
+	bool assembly_validation_failed;
+	bool hlsl_validation_failed;
+	size_t input_size;
+} file_status;
+
 static int process(string const *filename)
 {
 	HRESULT hret;
@@ -535,6 +1166,32 @@ static int process(string const *filename)
 
 	if (ReadInput(&srcData, filename))
 		return EXIT_FAILURE;
+	file_status.input_size = srcData.size();
+
+	if (args.benchmark_hash) {
+		if (benchmark_hash(filename, &srcData))
+			return EXIT_FAILURE;
+	}
+
+	if (args.benchmark_decode) {
+		if (benchmark_decode(filename, &srcData))
+			return EXIT_FAILURE;
+	}
+
+	if (args.benchmark_assemble) {
+		if (benchmark_assemble(filename, &srcData))
+			return EXIT_FAILURE;
+	}
+
+	if (args.benchmark_disassemble) {
+		if (benchmark_disassemble(filename, &srcData))
+			return EXIT_FAILURE;
+	}
+
+	if (args.benchmark_decompile) {
+		if (benchmark_decompile(filename, &srcData))
+			return EXIT_FAILURE;
+	}
 
 	if (args.disassemble_ms) {
 		LogInfo("Disassembling (MS) %s...\n", filename->c_str());
@@ -543,14 +1200,33 @@ static int process(string const *filename)
 			return EXIT_FAILURE;
 
 		if (args.validate) {
-			if (validate_assembly(&output, &srcData))
+			if (validate_assembly(&output, &srcData)) {
+				file_status.assembly_validation_failed = true;
 				return EXIT_FAILURE;
+			}
 		}
 
 		if (WriteOutput(filename, ".msasm", &output))
 			return EXIT_FAILURE;
 	}
 
+	if (args.disassemble_native) {
+		LogInfo("Disassembling (native) %s...\n", filename->c_str());
+		hret = DisassembleNative(srcData.data(), srcData.size(), &output);
+		if (FAILED(hret))
+			return EXIT_FAILURE;
+
+		if (args.validate) {
+			if (validate_assembly(&output, &srcData)) {
+				file_status.assembly_validation_failed = true;
+				return EXIT_FAILURE;
+			}
+		}
+
+		if (WriteOutput(filename, ".nasm", &output))
+			return EXIT_FAILURE;
+	}
+
 	if (args.disassemble_flugan || args.disassemble_hexdump || args.disassemble_46) {
 		LogInfo("Disassembling (Flugan) %s...\n", filename->c_str());
 		hret = DisassembleFlugan(srcData.data(), srcData.size(), &output, args.disassemble_hexdump, args.disassemble_46);
@@ -558,8 +1234,10 @@ static int process(string const *filename)
 			return EXIT_FAILURE;
 
 		if (args.validate) {
-			if (validate_assembly(&output, &srcData))
+			if (validate_assembly(&output, &srcData)) {
+				file_status.assembly_validation_failed = true;
 				return EXIT_FAILURE;
+			}
 			// TODO: Validate signature parsing instead of binary identical files
 		}
 
@@ -599,8 +1277,10 @@ static int process(string const *filename)
 			return EXIT_FAILURE;
 
 		if (args.validate) {
-			if (validate_hlsl(&output, &model))
+			if (validate_hlsl(&output, &model)) {
+				file_status.hlsl_validation_failed = true;
 				return EXIT_FAILURE;
+			}
 		}
 
 		if (WriteOutput(filename, ".hlsl", &output))
@@ -612,25 +1292,372 @@ static int process(string const *filename)
 }
 
 
+// Simple case insensitive wildcard match supporting * and ?, used to filter
+// files when searching directories:
+static bool wildcard_match(const char *pattern, const char *name)
+{
+	for (; *pattern; pattern++, name++) {
+		if (*pattern == '*') {
+			while (*pattern == '*')
+				pattern++;
+			if (!*pattern)
+				return true;
+			for (; *name; name++) {
+				if (wildcard_match(pattern, name))
+					return true;
+			}
+			return false;
+		}
+		if (!*name)
+			return false;
+		if (*pattern != '?' && tolower((unsigned char)*pattern) != tolower((unsigned char)*name))
+			return false;
+	}
+	return !*name;
+}
+
+static bool matches_pattern(const char *name)
+{
+	size_t start = 0, end;
+
+	do {
+		end = args.pattern.find(';', start);
+		string pattern = args.pattern.substr(start, end - start);
+		if (!pattern.empty() && wildcard_match(pattern.c_str(), name))
+			return true;
+		start = end + 1;
+	} while (end != string::npos);
+
+	return false;
+}
+
+// Expands directories and wildcards passed on the command line into a list of
+// files. Each directory is listed in sorted order so that the order files are
+// processed (and logged) in does not depend on the filesystem.
+static void expand_input(string const &path, vector<string> *files, bool recursive)
+{
+	WIN32_FIND_DATAA find_data;
+	vector<string> names, dirs;
+	string dir, search;
+	HANDLE hFind;
+	size_t sep;
+
+	if (path.find_first_of("*?") == string::npos) {
+		DWORD attrs = GetFileAttributesA(path.c_str());
+		if (attrs == INVALID_FILE_ATTRIBUTES || !(attrs & FILE_ATTRIBUTE_DIRECTORY)) {
+			// Let ReadInput report any missing files
+			files->push_back(path);
+			return;
+		}
+		dir = path + "\\";
+		search = dir + "*";
+		recursive = true;
+	} else {
+		sep = path.find_last_of("\\/");
+		dir = sep == string::npos ? "" : path.substr(0, sep + 1);
+		search = path;
+	}
+
+	hFind = FindFirstFileA(search.c_str(), &find_data);
+	if (hFind == INVALID_HANDLE_VALUE) {
+		LogInfo("No files found matching %s\n", path.c_str());
+		return;
+	}
+	do {
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			if (recursive && strcmp(find_data.cFileName, ".") && strcmp(find_data.cFileName, ".."))
+				dirs.push_back(dir + find_data.cFileName);
+		} else if (!recursive || matches_pattern(find_data.cFileName)) {
+			names.push_back(dir + find_data.cFileName);
+		}
+	} while (FindNextFileA(hFind, &find_data));
+	FindClose(hFind);
+
+	sort(names.begin(), names.end());
+	sort(dirs.begin(), dirs.end());
+	files->insert(files->end(), names.begin(), names.end());
+	for (string const &subdir : dirs)
+		expand_input(subdir, files, true);
+}
+
+static int process_file(string const *filename)
+{
+	int rc;
+
+	try {
+		rc = process(filename);
+	} catch (const exception & e) {
+		LogInfo("\n*** UNHANDLED EXCEPTION: %s\n", e.what());
+		rc = EXIT_FAILURE;
+	}
+
+	return rc;
+}
+
+// Totals for the summary printed after processing more than one file, either
+// one after the other or in batch mode:
+struct run_summary {
+	vector<string const *> failed;
+	unsigned assembly_mismatches;
+	unsigned hlsl_mismatches;
+	UINT64 bytes;
+	size_t processed;
+	LARGE_INTEGER start;
+
+	run_summary() : assembly_mismatches(0), hlsl_mismatches(0), bytes(0), processed(0)
+	{
+		QueryPerformanceCounter(&start);
+	}
+
+	void add(string const *filename, int rc, bool assembly_validation_failed,
+			bool hlsl_validation_failed, size_t input_size)
+	{
+		processed++;
+		bytes += input_size;
+		if (rc) {
+			failed.push_back(filename);
+			assembly_mismatches += assembly_validation_failed;
+			hlsl_mismatches += hlsl_validation_failed;
+		}
+	}
+};
+
+static void log_run_summary(run_summary *summary, unsigned jobs)
+{
+	LARGE_INTEGER end, freq;
+	double seconds;
+
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&freq);
+	seconds = (double)(end.QuadPart - summary->start.QuadPart) / freq.QuadPart;
+
+	LogInfo("\n==== Batch summary ====\n");
+	LogInfo("Processed %Iu of %Iu files on %u threads, %Iu failed\n",
+			summary->processed, args.files.size(), jobs, summary->failed.size());
+	if (args.validate) {
+		LogInfo("  Assembly validation mismatches: %u\n", summary->assembly_mismatches);
+		LogInfo("  HLSL validation failures: %u\n", summary->hlsl_mismatches);
+	}
+	for (string const *filename : summary->failed)
+		LogInfo("  FAILED: %s\n", filename->c_str());
+	LogInfo("Elapsed %.3f s, %.1f files/s, %.2f MB/s\n", seconds,
+			seconds ? summary->processed / seconds : 0.0,
+			seconds ? summary->bytes / (1024.0 * 1024.0) / seconds : 0.0);
+}
+
+// Processes the files one at a time on this thread. This is used whenever
+// --jobs is not given so the benchmarks don't share the process with any
+// worker threads, but still prints the summary if there is more than one:
+static int process_sequential()
+{
+	run_summary summary;
+	int rc = EXIT_SUCCESS, file_rc;
+
+	for (string const &filename : args.files) {
+		file_status = {};
+		file_rc = process_file(&filename);
+		summary.add(&filename, file_rc, file_status.assembly_validation_failed,
+				file_status.hlsl_validation_failed, file_status.input_size);
+		if (file_rc) {
+			rc = EXIT_FAILURE;
+			if (args.stop)
+				break;
+		}
+	}
+
+	if (args.files.size() > 1)
+		log_run_summary(&summary, 1);
+
+	return rc;
+}
+
 //-----------------------------------------------------------------------------
-// Console App Entry-Point.
+// Batch mode. Files are handed out to a pool of worker threads, each of which
+// owns a queue of files it works through from the front. A worker that runs
+// out of work steals from the back of another worker's queue, so a few slow
+// shaders (large compute shaders, validation failures dumping hexdumps) don't
+// leave the other threads idle. Each worker logs to a private temporary file
+// that is captured after every shader, and the main thread streams those logs
+// out in the original order so the output matches a single threaded run.
 //-----------------------------------------------------------------------------
-int main(int argc, char *argv[])
+
+struct batch_result {
+	string log;
+	int rc;
+	bool done;
+	bool assembly_validation_failed;
+	bool hlsl_validation_failed;
+	size_t input_size;
+};
+
+struct batch_queue {
+	std::mutex lock;
+	std::deque<size_t> files;
+};
+
+static struct {
+	vector<batch_queue> queues;
+	vector<batch_result> results;
+	std::mutex results_lock;
+	std::condition_variable result_ready;
+	std::atomic<bool> stop;
+} batch;
+
+static bool batch_next_file(unsigned worker, size_t *idx)
 {
+	unsigned i, victim;
+
+	{
+		batch_queue &own = batch.queues[worker];
+		std::lock_guard<std::mutex> lock(own.lock);
+		if (!own.files.empty()) {
+			*idx = own.files.front();
+			own.files.pop_front();
+			return true;
+		}
+	}
+
+	for (i = 1; i < batch.queues.size() && !batch.stop; i++) {
+		victim = (worker + i) % batch.queues.size();
+		batch_queue &other = batch.queues[victim];
+		std::lock_guard<std::mutex> lock(other.lock);
+		if (!other.files.empty()) {
+			*idx = other.files.back();
+			other.files.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static string read_thread_log(FILE *fp)
+{
+	string log;
+	long size;
+
+	fflush(fp);
+	size = ftell(fp);
+	if (size > 0) {
+		log.resize(size);
+		rewind(fp);
+		log.resize(fread(&log[0], 1, size, fp));
+	}
+	rewind(fp);
+	_chsize_s(_fileno(fp), 0);
+
+	return log;
+}
+
+static void batch_worker(unsigned worker)
+{
+	FILE *thread_log = NULL;
+	size_t idx;
+	int rc;
+
+	if (tmpfile_s(&thread_log)) {
+		LogInfo("Unable to create temporary log file for worker %u\n", worker);
+		thread_log = NULL;
+	}
+	ThreadLogFile() = thread_log;
+
+	while (!batch.stop && batch_next_file(worker, &idx)) {
+		file_status = {};
+		rc = process_file(&args.files[idx]);
+
+		std::lock_guard<std::mutex> lock(batch.results_lock);
+		batch_result &result = batch.results[idx];
+		if (thread_log)
+			result.log = read_thread_log(thread_log);
+		result.rc = rc;
+		result.assembly_validation_failed = file_status.assembly_validation_failed;
+		result.hlsl_validation_failed = file_status.hlsl_validation_failed;
+		result.input_size = file_status.input_size;
+		result.done = true;
+		batch.result_ready.notify_one();
+	}
+
+	ThreadLogFile() = NULL;
+	if (thread_log)
+		fclose(thread_log);
+}
+
+static int process_batch()
+{
+	vector<std::thread> workers;
+	run_summary summary;
+	size_t idx;
+	unsigned i, jobs;
 	int rc = EXIT_SUCCESS;
 
-	parse_args(argc, argv);
+	jobs = (unsigned)min((size_t)args.jobs, max((size_t)1, args.files.size()));
+	batch.queues = vector<batch_queue>(jobs);
+	batch.results = vector<batch_result>(args.files.size());
+	batch.stop = false;
 
-	for (string const &filename : args.files) {
-		try {
-			rc = process(&filename) || rc;
-		} catch (const exception & e) {
-			LogInfo("\n*** UNHANDLED EXCEPTION: %s\n", e.what());
+	// Deal the files out round robin so that the results needed next by
+	// the in-order printer tend to be the ones being worked on:
+	for (idx = 0; idx < args.files.size(); idx++)
+		batch.queues[idx % jobs].files.push_back(idx);
+
+	for (i = 0; i < jobs; i++)
+		workers.emplace_back(batch_worker, i);
+
+	for (idx = 0; idx < args.files.size(); idx++) {
+		std::unique_lock<std::mutex> lock(batch.results_lock);
+		batch.result_ready.wait(lock, [idx] { return batch.results[idx].done; });
+
+		batch_result &result = batch.results[idx];
+		fwrite(result.log.data(), 1, result.log.size(), LogFile);
+		string().swap(result.log);
+		summary.add(&args.files[idx], result.rc, result.assembly_validation_failed,
+				result.hlsl_validation_failed, result.input_size);
+
+		if (result.rc) {
 			rc = EXIT_FAILURE;
+			if (args.stop)
+				break;
 		}
+	}
+
+	batch.stop = true;
+	for (std::thread &worker : workers)
+		worker.join();
+
+	log_run_summary(&summary, jobs);
+
+	return rc;
+}
 
-		if (rc && args.stop)
-			return rc;
+//-----------------------------------------------------------------------------
+// Console App Entry-Point.
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	int rc = EXIT_SUCCESS;
+
+	parse_args(argc, argv);
+
+	vector<string> inputs;
+	inputs.swap(args.files);
+	for (string const &input : inputs)
+		expand_input(input, &args.files, false);
+
+	if (args.jobs > 1) {
+		rc = process_batch() || rc;
+	} else {
+		rc = process_sequential() || rc;
+
+		if (args.benchmark_hash)
+			log_hash_benchmark();
+		if (args.benchmark_decode)
+			log_decode_benchmark();
+		if (args.benchmark_assemble)
+			log_assemble_benchmark();
+		if (args.benchmark_disassemble)
+			log_disassemble_benchmark();
+		if (args.benchmark_decompile)
+			log_decompile_benchmark();
 	}
 
 	if (rc)
@@ -638,4 +1665,3 @@ int main(int argc, char *argv[])
 
 	return rc;
 }
-
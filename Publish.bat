@@ -138,6 +138,10 @@ MKDIR ".\Zip Release\cmd_Decompiler\"
 MOVE ".\builds\x32\Zip Release\cmd_Decompiler.exe"  ".\Zip Release\cmd_Decompiler\"
 COPY ".\builds\Zip Release\x32\d3dcompiler_47.dll"  ".\Zip Release\cmd_Decompiler\"
 
+echo(
+MKDIR ".\Zip Release\cmd_FrameAnalysisArchive\"
+MOVE ".\builds\x32\Zip Release\cmd_FrameAnalysisArchive.exe"  ".\Zip Release\cmd_FrameAnalysisArchive\"
+
 REM -----------------------------------------------------------------------------
 REM Write new version to a file that we can use in Action script too.
 
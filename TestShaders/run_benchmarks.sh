@@ -0,0 +1,57 @@
+#!/bin/bash
+# Micro-benchmarks for the hot paths in 3DMigoto's shader tools, run over the
+# binary shaders in this corpus. Unlike the test suites these do not need fxc,
+# only cmd_Decompiler and cmd_DirectX11Tests:
+# $ export CMD_DECOMPILER=~/"3DMigoto/x64/Zip Release/cmd_Decompiler.exe"
+# $ export CMD_DIRECTX11_TESTS=~/"3DMigoto/x64/Zip Release/cmd_DirectX11Tests.exe"
+# $ ./run_benchmarks.sh
+
+if [ -z "$CMD_DECOMPILER" ]; then
+	CMD_DECOMPILER=cmd_Decompiler.exe
+fi
+
+if [ ! -x "$CMD_DECOMPILER" ]; then
+	echo Please set CMD_DECOMPILER environment variable
+	exit 1
+fi
+
+if [ -z "$CMD_DIRECTX11_TESTS" ]; then
+	CMD_DIRECTX11_TESTS=cmd_DirectX11Tests.exe
+fi
+
+if [ ! -x "$CMD_DIRECTX11_TESTS" ]; then
+	echo Please set CMD_DIRECTX11_TESTS environment variable
+	exit 1
+fi
+
+CORPUS=$(find BinaryDecompiler GameExamples -name '*.o' -o -name '*.bin' -o -name '*.shdr' | sort)
+
+echo "==== Shader hash ===="
+"$CMD_DECOMPILER" --benchmark-hash $CORPUS </dev/null
+
+echo "==== Binary decoder ===="
+"$CMD_DECOMPILER" --benchmark-decode $CORPUS </dev/null
+
+echo "==== Assembler ===="
+"$CMD_DECOMPILER" --benchmark-assemble $CORPUS </dev/null
+
+echo "==== Disassembler ===="
+"$CMD_DECOMPILER" --benchmark-disassemble $CORPUS </dev/null
+
+echo "==== HLSL decompiler ===="
+"$CMD_DECOMPILER" --benchmark-decompile $CORPUS </dev/null
+
+echo "==== ShaderRegex ===="
+"$CMD_DIRECTX11_TESTS" --stress-shader-regex $CORPUS </dev/null
+
+echo "==== Command list expressions ===="
+"$CMD_DIRECTX11_TESTS" --verify-command-list-expressions </dev/null
+
+echo "==== Resource handle table ===="
+"$CMD_DIRECTX11_TESTS" --stress-resource-table </dev/null
+
+echo "==== Texture hash ===="
+"$CMD_DIRECTX11_TESTS" --benchmark-texture-hash </dev/null
+
+echo "==== Vertex buffer text ===="
+"$CMD_DIRECTX11_TESTS" --benchmark-vb-text </dev/null
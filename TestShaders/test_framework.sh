@@ -194,6 +194,43 @@ run_bin_asm_test()
 	cd "$test_dir"
 }
 
+normalise_disassembly_header()
+{
+	# Skip the leading comment lines naming the disassembler and the tool
+	# that invoked it, and spaces at the end of lines, which are the only
+	# differences expected between d3dcompiler_47 and the native disassembler
+	sed 's/\s\+$//' | awk 'body || !/^\/\/( Generated by .*|   using 3Dmigoto .*)?$/ { body=1; print }'
+}
+
+# Runs the native disassembler over a binary shader and compares the result
+# to the disassembly Microsoft's disassembler produced for the same shader
+run_disassembler_golden_test()
+{
+	local compiled="$1"
+	local golden="$2"
+	local dst="$(echo "$compiled" | sed -r 's/\.[^.]+$//')"
+	local disassembled="${dst}.nasm"
+	local disassemble_log="${dst}_nasm.log"
+	local fail=0
+
+	echo -n "....: ${compiled} (native)..."
+
+	rm "$disassembled" "$disassemble_log" 2>/dev/null
+	"$CMD_DECOMPILER" --disassemble-native "$compiled" </dev/null > "$disassemble_log" 2>&1 # produces "$disassembled"
+	if [ $? -ne 0 ]; then
+		echo -n " Native disassembly failed."
+		fail=1
+	else
+		normalise_disassembly_header < "$disassembled" > "${disassembled}.stripped"
+		if ! normalise_disassembly_header < "$golden" | cmp - "${disassembled}.stripped" > /dev/null; then
+			echo -n " Does not match $golden"
+			fail=1
+		fi
+	fi
+
+	pass_fail $fail
+}
+
 run_hlsl_asm_test()
 {
 	local src="$1"
@@ -213,6 +250,7 @@ run_hlsl_asm_test()
 		local test_dir="$PWD"
 		cd "$ASM_OUTPUT_DIR"
 			run_assembler_test "$compiled"
+			run_disassembler_golden_test "$compiled" "$ms_assembled"
 		cd "$test_dir"
 	done
 }
@@ -272,6 +310,8 @@ run_asm_asm_test()
 
 	[ $fail -eq 0 ] && check_assembler_result "$src" "$ASM_OUTPUT_DIR/$src" || fail=1
 	pass_fail $fail
+
+	[ $fail -eq 0 ] && run_disassembler_golden_test "$ASM_OUTPUT_DIR/$assembled" "$src"
 }
 
 cmd_decompiler_copy_reflection_check()
@@ -0,0 +1,1802 @@
+// cmd_DirectX11Tests.cpp : Stress tests and micro-benchmarks for the parts of
+// the DirectX11 wrapper that can be exercised without a game or a device.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <D3Dcompiler.h>
+#include "version.h"
+#include "log.h"
+#define MIGOTO_DX 11 // Selects the DX11 disassembler in util.h for the ShaderRegex test
+#include "util.h"
+#include "DirectX11\ResourceHandleTable.h"
+#include "DirectX11\OverrideLookupTable.h"
+#include "DirectX11\CommandListOperators.h"
+#include "DirectX11\VertexBufferText.h"
+#include "DirectX11\ShaderRegexRules.h"
+
+using namespace std;
+
+FILE *LogFile = stderr; // Log to stderr by default
+bool gLogDebug = false;
+
+static void PrintHelp(int argc, char *argv[])
+{
+	LogInfo("usage: %s [OPTION]... [FILE...]\n\n", argv[0]);
+
+	LogInfo("Runs the selected tests in the order listed below. FILEs are binary\n");
+	LogInfo("shaders for the tests that need some to work on.\n\n");
+
+	LogInfo("  --benchmark-texture-hash\n");
+	LogInfo("\t\t\tCheck the texture row hashing against the original row at a time\n");
+	LogInfo("\t\t\tloop over many random layouts, then time both on typical textures\n");
+
+	LogInfo("  --benchmark-vb-text\n");
+	LogInfo("\t\t\tCheck the frame analysis vertex buffer text formatter produces the same\n");
+	LogInfo("\t\t\toutput as the original fprintf version, then time both on synthetic buffers\n");
+
+	LogInfo("  --stress-resource-table\n");
+	LogInfo("\t\t\tHammer the lock free resource handle table from many threads, check\n");
+	LogInfo("\t\t\tit for consistency and compare it to a locked map, then check lookups\n");
+	LogInfo("\t\t\tin the override index while it is being added to\n");
+
+	LogInfo("  --verify-command-list-expressions\n");
+	LogInfo("\t\t\tCheck the command list expression compiler gives the same results\n");
+	LogInfo("\t\t\tas the expression tree for many random expressions and inputs\n");
+
+	LogInfo("  --stress-shader-regex\n");
+	LogInfo("\t\t\tApply a set of ShaderRegex groups to the FILEs from many threads\n");
+	LogInfo("\t\t\tat once and check every thread gets the same result as a single thread\n");
+
+	LogInfo("  -v, --verbose\n");
+	LogInfo("\t\t\tVerbose debugging output\n");
+
+	exit(EXIT_FAILURE);
+}
+
+static void PrintVersion()
+{
+	LogInfo("3DMigoto cmd_DirectX11Tests version %s\n", VER_FILE_VERSION_STR);
+
+	exit(EXIT_SUCCESS);
+}
+
+static struct {
+	std::vector<std::string> files;
+	bool benchmark_texture_hash;
+	bool benchmark_vb_text;
+	bool stress_resource_table;
+	bool verify_command_list_expressions;
+	bool stress_shader_regex;
+} args;
+
+static void parse_args(int argc, char *argv[])
+{
+	bool terminated = false;
+	char *arg;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+		if (!terminated && !strncmp(arg, "-", 1)) {
+			if (!strcmp(arg, "--help") || !strcmp(arg, "--usage")) {
+				PrintHelp(argc, argv); // Does not return
+			}
+			if (!strcmp(arg, "--version")) {
+				PrintVersion(); // Does not return
+			}
+			if (!strcmp(arg, "--")) {
+				terminated = true;
+				continue;
+			}
+			if (!strcmp(arg, "--benchmark-texture-hash")) {
+				args.benchmark_texture_hash = true;
+				continue;
+			}
+			if (!strcmp(arg, "--benchmark-vb-text")) {
+				args.benchmark_vb_text = true;
+				continue;
+			}
+			if (!strcmp(arg, "--stress-resource-table")) {
+				args.stress_resource_table = true;
+				continue;
+			}
+			if (!strcmp(arg, "--verify-command-list-expressions")) {
+				args.verify_command_list_expressions = true;
+				continue;
+			}
+			if (!strcmp(arg, "--stress-shader-regex")) {
+				args.stress_shader_regex = true;
+				continue;
+			}
+			if (!strcmp(arg, "-v") || !strcmp(arg, "--verbose")) {
+				gLogDebug = true;
+				continue;
+			}
+			LogInfo("Unrecognised argument: %s\n", arg);
+			PrintHelp(argc, argv); // Does not return
+		}
+		args.files.push_back(arg);
+	}
+
+	if (args.benchmark_texture_hash
+			+ args.benchmark_vb_text
+			+ args.stress_resource_table
+			+ args.verify_command_list_expressions
+			+ args.stress_shader_regex < 1) {
+		LogInfo("No test specified\n");
+		PrintHelp(argc, argv); // Does not return
+	}
+}
+
+static int ReadInput(vector<char> *srcData, string const *filename)
+{
+	DWORD srcDataSize;
+	DWORD readSize;
+	BOOL bret;
+	HANDLE fp;
+
+	fp = CreateFileA(filename->c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fp == INVALID_HANDLE_VALUE) {
+		LogInfo("    Shader not found: %s\n", filename->c_str());
+		return EXIT_FAILURE;
+	}
+
+	srcDataSize = GetFileSize(fp, 0);
+	srcData->resize(srcDataSize);
+
+	bret = ReadFile(fp, srcData->data(), srcDataSize, &readSize, 0);
+	CloseHandle(fp);
+	if (!bret || srcDataSize != readSize) {
+		LogInfo("    Error reading input file\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// The loop hash_tex2d_data used before crc32c_hw_texture_rows, which existing
+// texture hashes with zero_padding / skip_padding depend on:
+static uint32_t texture_rows_reference(uint32_t hash, const void *data, size_t length,
+		size_t row_pitch, size_t row_count, UINT mapped_row_pitch, bool zero_padding)
+{
+	uint8_t *sptr = (uint8_t*)data;
+	size_t msize = min(row_pitch, (size_t)mapped_row_pitch);
+
+	signed padding = (signed)mapped_row_pitch - (signed)row_pitch;
+	uint8_t *zeroes = NULL;
+	if (zero_padding && padding > 0) {
+		zeroes = new uint8_t[padding];
+		memset(zeroes, 0, padding);
+	}
+
+	signed remaining = (signed)length;
+	for (size_t h = 0; h < row_count && remaining > 0; h++) {
+		hash = crc32c_hw(hash, sptr, min(msize, (size_t)(unsigned)remaining));
+		sptr += mapped_row_pitch;
+		remaining -= (signed)msize;
+
+		if (zeroes && remaining > 0) {
+			hash = crc32c_hw(hash, zeroes, min(padding, remaining));
+			remaining -= padding;
+		}
+	}
+
+	delete [] zeroes;
+	return hash;
+}
+
+// Randomised layouts checked against the reference, covering rows narrower
+// and wider than the point crc32c switches strategy, padding either side of
+// the point where zeroes stop being fed through the crc32 instruction,
+// mapped pitches smaller than the row, and lengths that cut off a row or
+// its padding part way through:
+#define TEXTURE_HASH_TEST_CASES 20000
+
+static unsigned test_texture_hash(vector<uint8_t> *buf, UINT64 *rng)
+{
+	static const size_t row_sizes[] = { 1, 3, 4, 7, 8, 64, 250, 256, 767, 768, 769, 1000, 4096, 16384 };
+	static const int paddings[] = { -17, -1, 0, 0, 0, 1, 4, 7, 16, 48, 96, 255, 256, 257, 1000, 4096 };
+	size_t row_pitch, row_count, full_length, length;
+	UINT mapped_row_pitch;
+	uint32_t expected, found, seed;
+	unsigned failures = 0;
+	bool zero_padding;
+	int i, padding;
+
+	for (i = 0; i < TEXTURE_HASH_TEST_CASES; i++) {
+		*rng ^= *rng << 13;
+		*rng ^= *rng >> 7;
+		*rng ^= *rng << 17;
+
+		row_pitch = row_sizes[*rng % _countof(row_sizes)];
+		padding = paddings[(*rng >> 8) % _countof(paddings)];
+		if (padding < 0 && (size_t)-padding >= row_pitch)
+			padding = 0;
+		mapped_row_pitch = (UINT)(row_pitch + padding);
+		row_count = 1 + (*rng >> 16) % (row_pitch > 1024 ? 16 : 200);
+		zero_padding = !!((*rng >> 32) & 1);
+		seed = (uint32_t)(*rng >> 33);
+
+		full_length = row_count * (row_pitch + max(padding, 0));
+		switch ((*rng >> 40) % 4) {
+		case 0:
+			length = INT_MAX;
+			break;
+		case 1:
+			length = full_length;
+			break;
+		default:
+			length = (size_t)(*rng >> 44) % (full_length + 1);
+			break;
+		}
+
+		buf->resize(row_count * mapped_row_pitch + row_pitch);
+		for (size_t j = 0; j < buf->size(); j++)
+			(*buf)[j] = (uint8_t)((j * 0x9e3779b1u + i) >> 7);
+
+		expected = texture_rows_reference(seed, buf->data(), length, row_pitch, row_count, mapped_row_pitch, zero_padding);
+		found = crc32c_hw_texture_rows(seed, buf->data(), length, row_pitch, row_count, mapped_row_pitch, zero_padding);
+		if (found != expected) {
+			LogInfo("*** Texture hash mismatch: row_pitch=%Iu mapped_row_pitch=%u rows=%Iu length=%Iu zero_padding=%i: expected %08x, found %08x\n",
+					row_pitch, mapped_row_pitch, row_count, length, zero_padding, expected, found);
+			failures++;
+		}
+	}
+
+	return failures;
+}
+
+#define TEXTURE_HASH_BENCHMARK_BYTES (1024 * 1024 * 1024)
+
+static unsigned benchmark_texture_hash_layout(const char *name, vector<uint8_t> *buf,
+		size_t row_pitch, size_t row_count, UINT mapped_row_pitch, bool zero_padding)
+{
+	size_t length = row_count * (zero_padding ? max(row_pitch, (size_t)mapped_row_pitch) : row_pitch);
+	size_t iterations = max((size_t)1, TEXTURE_HASH_BENCHMARK_BYTES / length);
+	LARGE_INTEGER start, mid, end, freq;
+	uint32_t expected = 0, found = 0;
+	double reference, rows;
+	size_t i;
+
+	buf->resize(row_count * mapped_row_pitch);
+	for (i = 0; i < buf->size(); i++)
+		(*buf)[i] = (uint8_t)(i * 0x9e3779b1u >> 11);
+
+	QueryPerformanceCounter(&start);
+	for (i = 0; i < iterations; i++)
+		expected = texture_rows_reference(expected, buf->data(), length, row_pitch, row_count, mapped_row_pitch, zero_padding);
+	QueryPerformanceCounter(&mid);
+	for (i = 0; i < iterations; i++)
+		found = crc32c_hw_texture_rows(found, buf->data(), length, row_pitch, row_count, mapped_row_pitch, zero_padding);
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&freq);
+
+	reference = (double)(mid.QuadPart - start.QuadPart) / freq.QuadPart;
+	rows = (double)(end.QuadPart - mid.QuadPart) / freq.QuadPart;
+
+	LogInfo("  %-28s %8.1f MB/s %8.1f MB/s %6.2fx\n", name,
+			reference ? iterations * length / reference / (1024 * 1024) : 0.0,
+			rows ? iterations * length / rows / (1024 * 1024) : 0.0,
+			rows ? reference / rows : 0.0);
+
+	if (found != expected) {
+		LogInfo("*** %s: expected %08x, found %08x\n", name, expected, found);
+		return 1;
+	}
+	return 0;
+}
+
+static int benchmark_texture_hash()
+{
+	vector<uint8_t> buf;
+	UINT64 rng = 0x2545f4914f6cdd1dULL;
+	unsigned failures;
+
+	failures = test_texture_hash(&buf, &rng);
+	LogInfo("Texture hash: %u random layouts checked against the reference, %u mismatches\n",
+			TEXTURE_HASH_TEST_CASES, failures);
+
+	LogInfo("  %-28s %13s %13s\n", "Layout", "Per row", "Rows");
+	failures += benchmark_texture_hash_layout("4096x4096 RGBA8, no padding", &buf, 16384, 4096, 16384, true);
+	failures += benchmark_texture_hash_layout("1000x1000 RGBA8, zero pad", &buf, 4000, 1000, 4096, true);
+	failures += benchmark_texture_hash_layout("1000x1000 RGBA8, skip pad", &buf, 4000, 1000, 4096, false);
+	failures += benchmark_texture_hash_layout("250x4096 R8, zero pad", &buf, 250, 4096, 256, true);
+	failures += benchmark_texture_hash_layout("100x2048 RGBA8, zero pad", &buf, 400, 2048, 512, true);
+	failures += benchmark_texture_hash_layout("64x64 RGBA8, zero pad", &buf, 256, 64, 512, true);
+	failures += benchmark_texture_hash_layout("BC1 2048x2048, no padding", &buf, 4096, 512, 4096, true);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// The fprintf based vertex buffer formatter frame analysis used before
+// VertexBufferTextFormatter, kept as is to check the output is unchanged:
+namespace vb_text_reference {
+
+static UINT dxgi_format_alignment(DXGI_FORMAT format)
+{
+	// I'm not positive what the alignment constraints actually are - MSDN
+	// mentions they exist, but I don't think they go so far as being
+	// aligned to the size of the full format (I'm seeing vertex buffers
+	// that clearly are not). For now I'm going with the assumption that
+	// the alignment must match the individual components, and skipping
+	// those with variable sized components or unusual formats.
+	switch (format) {
+		case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		case DXGI_FORMAT_R32G32B32A32_UINT:
+		case DXGI_FORMAT_R32G32B32A32_SINT:
+		case DXGI_FORMAT_R32G32B32_TYPELESS:
+		case DXGI_FORMAT_R32G32B32_FLOAT:
+		case DXGI_FORMAT_R32G32B32_UINT:
+		case DXGI_FORMAT_R32G32B32_SINT:
+		case DXGI_FORMAT_R32G32_TYPELESS:
+		case DXGI_FORMAT_R32G32_FLOAT:
+		case DXGI_FORMAT_R32G32_UINT:
+		case DXGI_FORMAT_R32G32_SINT:
+		case DXGI_FORMAT_R32_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT:
+		case DXGI_FORMAT_R32_FLOAT:
+		case DXGI_FORMAT_R32_UINT:
+		case DXGI_FORMAT_R32_SINT:
+			return 4;
+		case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R16G16B16A16_UNORM:
+		case DXGI_FORMAT_R16G16B16A16_UINT:
+		case DXGI_FORMAT_R16G16B16A16_SNORM:
+		case DXGI_FORMAT_R16G16B16A16_SINT:
+		case DXGI_FORMAT_R16G16_TYPELESS:
+		case DXGI_FORMAT_R16G16_FLOAT:
+		case DXGI_FORMAT_R16G16_UNORM:
+		case DXGI_FORMAT_R16G16_UINT:
+		case DXGI_FORMAT_R16G16_SNORM:
+		case DXGI_FORMAT_R16G16_SINT:
+		case DXGI_FORMAT_R16_TYPELESS:
+		case DXGI_FORMAT_R16_FLOAT:
+		case DXGI_FORMAT_D16_UNORM:
+		case DXGI_FORMAT_R16_UNORM:
+		case DXGI_FORMAT_R16_UINT:
+		case DXGI_FORMAT_R16_SNORM:
+		case DXGI_FORMAT_R16_SINT:
+			return 2;
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		case DXGI_FORMAT_R8G8B8A8_UINT:
+		case DXGI_FORMAT_R8G8B8A8_SNORM:
+		case DXGI_FORMAT_R8G8B8A8_SINT:
+		case DXGI_FORMAT_R8G8_TYPELESS:
+		case DXGI_FORMAT_R8G8_UNORM:
+		case DXGI_FORMAT_R8G8_UINT:
+		case DXGI_FORMAT_R8G8_SNORM:
+		case DXGI_FORMAT_R8G8_SINT:
+		case DXGI_FORMAT_R8_TYPELESS:
+		case DXGI_FORMAT_R8_UNORM:
+		case DXGI_FORMAT_R8_UINT:
+		case DXGI_FORMAT_R8_SNORM:
+		case DXGI_FORMAT_R8_SINT:
+		case DXGI_FORMAT_A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+			return 1;
+	}
+	return 0;
+}
+
+static float float16(uint16_t f16)
+{
+	// Shift sign and mantissa to new positions:
+	uint32_t f32 = ((f16 & 0x8000) << 16) | ((f16 & 0x3ff) << 13);
+	// Need to check special cases of the biased exponent:
+	int biased_exponent = (f16 & 0x7c00) >> 10;
+
+	if (biased_exponent == 0) {
+		// Zero / subnormal: New biased exponent remains zero
+	} else if (biased_exponent == 0x1f) {
+		// Infinity / NaN: New biased exponent is filled with 1s
+		f32 |= 0x7f800000;
+	} else {
+		// Normal number: Adjust the exponent bias:
+		biased_exponent = biased_exponent - 15 + 127;
+		f32 |= biased_exponent << 23;
+	}
+
+	return *(float*)&f32;
+}
+
+static float unorm24(uint32_t val)
+{
+	return (float)val / (float)0xffffff;
+}
+
+static float unorm16(uint16_t val)
+{
+	return (float)val / (float)0xffff;
+}
+
+static float snorm16(int16_t val)
+{
+	return (float)val / (float)0x7fff;
+}
+
+static float unorm8(uint8_t val)
+{
+	return (float)val / (float)0xff;
+}
+
+static float snorm8(int8_t val)
+{
+	return (float)val / (float)0x7f;
+}
+
+static int fprint_dxgi_format(FILE *fd, DXGI_FORMAT format, uint8_t *buf)
+{
+	float *f = (float*)buf;
+	uint32_t *u32 = (uint32_t*)buf;
+	int32_t *s32 = (int32_t*)buf;
+	uint16_t *u16 = (uint16_t*)buf;
+	int16_t *s16 = (int16_t*)buf;
+	uint8_t *u8 = (uint8_t*)buf;
+	int8_t *s8 = (int8_t*)buf;
+	unsigned i;
+
+	switch (format) {
+		// --- 32-bit ---
+		case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+			return fprintf(fd, "%08x, %08x, %08x, %08x", u32[0], u32[1], u32[2], u32[3]);
+		case DXGI_FORMAT_R32G32B32_TYPELESS:
+			return fprintf(fd, "%08x, %08x, %08x", u32[0], u32[1], u32[2]);
+		case DXGI_FORMAT_R32G32_TYPELESS:
+			return fprintf(fd, "%08x, %08x", u32[0], u32[1]);
+		case DXGI_FORMAT_R32_TYPELESS:
+			return fprintf(fd, "%08x", u32[0]);
+
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", f[0], f[1], f[2], f[3]);
+		case DXGI_FORMAT_R32G32B32_FLOAT:
+			return fprintf(fd, "%.9g, %.9g, %.9g", f[0], f[1], f[2]);
+		case DXGI_FORMAT_R32G32_FLOAT:
+			return fprintf(fd, "%.9g, %.9g", f[0], f[1]);
+		case DXGI_FORMAT_D32_FLOAT:
+		case DXGI_FORMAT_R32_FLOAT:
+			return fprintf(fd, "%.9g", f[0]);
+
+		case DXGI_FORMAT_R32G32B32A32_UINT:
+			return fprintf(fd, "%u, %u, %u, %u", u32[0], u32[1], u32[2], u32[3]);
+		case DXGI_FORMAT_R32G32B32_UINT:
+			return fprintf(fd, "%u, %u, %u", u32[0], u32[1], u32[2]);
+		case DXGI_FORMAT_R32G32_UINT:
+			return fprintf(fd, "%u, %u", u32[0], u32[1]);
+		case DXGI_FORMAT_R32_UINT:
+			return fprintf(fd, "%u", u32[0]);
+
+		case DXGI_FORMAT_R32G32B32A32_SINT:
+			return fprintf(fd, "%d, %d, %d, %d", s32[0], s32[1], s32[2], s32[3]);
+		case DXGI_FORMAT_R32G32B32_SINT:
+			return fprintf(fd, "%d, %d, %d", s32[0], s32[1], s32[2]);
+		case DXGI_FORMAT_R32G32_SINT:
+			return fprintf(fd, "%d, %d", s32[0], s32[1]);
+		case DXGI_FORMAT_R32_SINT:
+			return fprintf(fd, "%d", s32[0]);
+
+		// --- 16-bit ---
+		case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+			return fprintf(fd, "%04x, %04x, %04x, %04x", u16[0], u16[1], u16[2], u16[3]);
+		case DXGI_FORMAT_R16G16_TYPELESS:
+			return fprintf(fd, "%04x, %04x", u16[0], u16[1]);
+		case DXGI_FORMAT_R16_TYPELESS:
+			return fprintf(fd, "%04x", u16[0]);
+
+		// %.9g is probably excessive, but I haven't calculated or
+		// verified the actual decimal precision needed to ensure
+		// 16-bit floats can be reproduced exactly, and I know that
+		// %.9g is enough for 32-bit floats so it is safer for now:
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", float16(u16[0]), float16(u16[1]), float16(u16[2]), float16(u16[3]));
+		case DXGI_FORMAT_R16G16_FLOAT:
+			return fprintf(fd, "%.9g, %.9g", float16(u16[0]), float16(u16[1]));
+		case DXGI_FORMAT_R16_FLOAT:
+			return fprintf(fd, "%.9g", float16(u16[0]));
+
+		// And of course, if we were to work out a better decimal
+		// precision value, remember that a 16-bit UNORM has 16 bits of
+		// precision, while a 16-bit FLOAT only has 11.
+		case DXGI_FORMAT_R16G16B16A16_UNORM:
+			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", unorm16(u16[0]), unorm16(u16[1]), unorm16(u16[2]), unorm16(u16[3]));
+		case DXGI_FORMAT_R16G16_UNORM:
+			return fprintf(fd, "%.9g, %.9g", unorm16(u16[0]), unorm16(u16[1]));
+		case DXGI_FORMAT_D16_UNORM:
+		case DXGI_FORMAT_R16_UNORM:
+			return fprintf(fd, "%.9g", unorm16(u16[0]));
+
+		case DXGI_FORMAT_R16G16B16A16_SNORM:
+			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", snorm16(s16[0]), snorm16(s16[1]), snorm16(s16[2]), snorm16(s16[3]));
+		case DXGI_FORMAT_R16G16_SNORM:
+			return fprintf(fd, "%.9g, %.9g", snorm16(s16[0]), snorm16(s16[1]));
+		case DXGI_FORMAT_R16_SNORM:
+			return fprintf(fd, "%.9g", snorm16(s16[0]));
+
+		case DXGI_FORMAT_R16G16B16A16_UINT:
+			return fprintf(fd, "%u, %u, %u, %u", u16[0], u16[1], u16[2], u16[3]);
+		case DXGI_FORMAT_R16G16_UINT:
+			return fprintf(fd, "%u, %u", u16[0], u16[1]);
+		case DXGI_FORMAT_R16_UINT:
+			return fprintf(fd, "%u", u16[0]);
+
+		case DXGI_FORMAT_R16G16B16A16_SINT:
+			return fprintf(fd, "%d, %d, %d, %d", s16[0], s16[1], s16[2], s16[3]);
+		case DXGI_FORMAT_R16G16_SINT:
+			return fprintf(fd, "%d, %d", s16[0], s16[1]);
+		case DXGI_FORMAT_R16_SINT:
+			return fprintf(fd, "%d", s16[0]);
+
+		// --- 8-bit ---
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+			return fprintf(fd, "%02x, %02x, %02x, %02x", u8[0], u8[1], u8[2], u8[3]);
+		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+			return fprintf(fd, "%02x, %02x, %02x", u8[0], u8[1], u8[2]);
+		case DXGI_FORMAT_R8G8_TYPELESS:
+			return fprintf(fd, "%02x, %02x", u8[0], u8[1]);
+		case DXGI_FORMAT_R8_TYPELESS:
+			return fprintf(fd, "%02x", u8[0]);
+
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB: // XXX: Should we apply the SRGB formula?
+		case DXGI_FORMAT_R8G8_B8G8_UNORM:
+		case DXGI_FORMAT_G8R8_G8B8_UNORM:
+			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", unorm8(u8[0]), unorm8(u8[1]), unorm8(u8[2]), unorm8(u8[3]));
+		case DXGI_FORMAT_R8G8_UNORM:
+			return fprintf(fd, "%.9g, %.9g", unorm8(u8[0]), unorm8(u8[1]));
+		case DXGI_FORMAT_R8_UNORM:
+			return fprintf(fd, "%.9g", unorm8(u8[0]));
+
+		case DXGI_FORMAT_R8G8B8A8_SNORM:
+			return fprintf(fd, "%.9g, %.9g, %.9g, %.9g", snorm8(s8[0]), snorm8(s8[1]), snorm8(s8[2]), snorm8(s8[3]));
+		case DXGI_FORMAT_R8G8_SNORM:
+			return fprintf(fd, "%.9g, %.9g", snorm8(s8[0]), snorm8(s8[1]));
+		case DXGI_FORMAT_R8_SNORM:
+		case DXGI_FORMAT_A8_UNORM:
+			return fprintf(fd, "%.9g", snorm8(s8[0]));
+
+		case DXGI_FORMAT_R8G8B8A8_UINT:
+			return fprintf(fd, "%u, %u, %u, %u", u8[0], u8[1], u8[2], u8[3]);
+		case DXGI_FORMAT_R8G8_UINT:
+			return fprintf(fd, "%u, %u", u8[0], u8[1]);
+		case DXGI_FORMAT_R8_UINT:
+			return fprintf(fd, "%u", u8[0]);
+
+		case DXGI_FORMAT_R8G8B8A8_SINT:
+			return fprintf(fd, "%d, %d, %d, %d", s8[0], s8[1], s8[2], s8[3]);
+		case DXGI_FORMAT_R8G8_SINT:
+			return fprintf(fd, "%d, %d", s8[0], s8[1]);
+		case DXGI_FORMAT_R8_SINT:
+			return fprintf(fd, "%d", s8[0]);
+
+		case DXGI_FORMAT_R32G8X24_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+		case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+			return fprintf(fd, "%.9g, %d", f[0], u8[4]);
+
+		case DXGI_FORMAT_R24G8_TYPELESS:
+		case DXGI_FORMAT_D24_UNORM_S8_UINT:
+		case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+		case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+			return fprintf(fd, "%.9g, %d", unorm24(u32[0] & 0xffffff), u8[3]);
+
+		// TODO: Unusual field sizes:
+		// case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+		// case DXGI_FORMAT_R10G10B10A2_UNORM:
+		// case DXGI_FORMAT_R10G10B10A2_UINT:
+		// case DXGI_FORMAT_R11G11B10_FLOAT:
+		// case DXGI_FORMAT_R1_UNORM:
+		// case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+		// case DXGI_FORMAT_B5G6R5_UNORM:
+		// case DXGI_FORMAT_B5G5R5A1_UNORM:
+		// case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+	}
+
+	for (i = 0; i < dxgi_format_size(format); i++)
+		fprintf(fd, "%02x", buf[i]);
+	return i * 2;
+}
+
+
+static void dump_vb_elem(FILE *fd, uint8_t *buf,
+		D3D11_INPUT_ELEMENT_DESC *layout_desc, size_t layout_elements,
+		int slot, UINT vb_idx, UINT elem, UINT stride)
+{
+	UINT offset = 0, alignment, size;
+
+	if (layout_desc[elem].InputSlot != slot)
+		return;
+
+	if (layout_desc[elem].AlignedByteOffset != D3D11_APPEND_ALIGNED_ELEMENT) {
+		offset = layout_desc[elem].AlignedByteOffset;
+	} else {
+		alignment = dxgi_format_alignment(layout_desc[elem].Format);
+		if (!alignment) {
+			fprintf(fd, "# WARNING: Unknown format alignment, vertex buffer may be decoded incorrectly\n");
+		} else if (offset % alignment) {
+			fprintf(fd, "# WARNING: Untested alignment code in use, please report incorrectly decoded vertex buffers\n");
+			// XXX: Also, what if the entire vertex is misaligned in the buffer?
+			offset += alignment - (offset % alignment);
+		}
+	}
+
+	fprintf(fd, "vb%i[%u]+%03u %s", slot, vb_idx, offset, layout_desc[elem].SemanticName);
+	if (layout_desc[elem].SemanticIndex)
+		fprintf(fd, "%u", layout_desc[elem].SemanticIndex);
+	fprintf(fd, ": ");
+
+	fprint_dxgi_format(fd, layout_desc[elem].Format, buf + offset);
+	fprintf(fd, "\n");
+
+	size = dxgi_format_size(layout_desc[elem].Format);
+	if (!size)
+		fprintf(fd, "# WARNING: Unknown format size, vertex buffer may be decoded incorrectly\n");
+	offset += size;
+	if (offset > stride)
+		fprintf(fd, "# WARNING: Offset exceeded stride, vertex buffer may be decoded incorrectly\n");
+}
+
+static void dump_vb_known_layout(FILE *fd, D3D11_MAPPED_SUBRESOURCE *map,
+		D3D11_INPUT_ELEMENT_DESC *layout_desc, size_t layout_elements,
+		UINT size, int slot, UINT offset, UINT first, UINT count, UINT stride)
+{
+	UINT vertex, elem, start, end;
+
+	start = offset / stride + first;
+	end = size / stride;
+	if (count)
+		end = min(end, start + count);
+
+	for (vertex = start; vertex < end; vertex++) {
+		fprintf(fd, "\n");
+		for (elem = 0; elem < layout_elements; elem++) {
+			if (layout_desc[elem].InputSlotClass != D3D11_INPUT_PER_VERTEX_DATA)
+				continue;
+
+			dump_vb_elem(fd, (uint8_t*)map->pData + stride*vertex,
+					layout_desc, layout_elements, slot,
+					vertex - start, elem, stride);
+		}
+	}
+}
+
+static void dump_vb_instance_data(FILE *fd, D3D11_MAPPED_SUBRESOURCE *map,
+		D3D11_INPUT_ELEMENT_DESC *layout_desc, size_t layout_elements,
+		UINT size, int slot, UINT offset, UINT first, UINT count, UINT stride)
+{
+	UINT instance, idx, elem, start, end;
+
+	start = offset / stride + first;
+	end = size / stride;
+	if (count)
+		end = min(end, start + count);
+
+	for (instance = start; instance < end; instance++) {
+		fprintf(fd, "\n");
+		for (elem = 0; elem < layout_elements; elem++) {
+			if (layout_desc[elem].InputSlotClass != D3D11_INPUT_PER_INSTANCE_DATA)
+				continue;
+
+			if (layout_desc[elem].InstanceDataStepRate)
+				idx = (instance-start) / layout_desc[elem].InstanceDataStepRate + start;
+			else
+				idx = instance;
+
+			dump_vb_elem(fd, (uint8_t*)map->pData + stride*idx,
+					layout_desc, layout_elements, slot,
+					idx - start, elem, stride);
+		}
+	}
+}
+
+}
+
+static FILE* open_vb_text_temp_file()
+{
+	wchar_t dir[MAX_PATH], path[MAX_PATH];
+	FILE *fp = NULL;
+
+	if (!GetTempPathW(MAX_PATH, dir) || !GetTempFileNameW(dir, L"vbt", 0, path))
+		return NULL;
+
+	// Binary so the text is compared before any newline translation, and
+	// deleted once closed:
+	_wfopen_s(&fp, path, L"w+bD");
+	return fp;
+}
+
+static void vb_text_reference_dump(FILE *fp, D3D11_INPUT_ELEMENT_DESC *desc, size_t elements,
+		D3D11_INPUT_CLASSIFICATION slot_class, vector<uint8_t> *data, UINT size,
+		int slot, UINT offset, UINT first, UINT count, UINT stride)
+{
+	D3D11_MAPPED_SUBRESOURCE map = {};
+
+	map.pData = data->data();
+	if (slot_class == D3D11_INPUT_PER_VERTEX_DATA)
+		vb_text_reference::dump_vb_known_layout(fp, &map, desc, elements, size, slot, offset, first, count, stride);
+	else
+		vb_text_reference::dump_vb_instance_data(fp, &map, desc, elements, size, slot, offset, first, count, stride);
+}
+
+#define VB_TEXT_FLOAT_TEST_CASES 10000000
+
+static unsigned test_vb_text_floats(UINT64 *rng)
+{
+	char expected[64], found[64];
+	unsigned failures = 0;
+	uint32_t bits, i;
+	float vals[5];
+	int j;
+
+	// Random bit patterns to cover every exponent, NaNs and denormals:
+	for (i = 0; i < VB_TEXT_FLOAT_TEST_CASES; i++) {
+		*rng ^= *rng << 13;
+		*rng ^= *rng >> 7;
+		*rng ^= *rng << 17;
+		bits = (uint32_t)*rng;
+
+		sprintf_s(expected, "%.9g", *(float*)&bits);
+		found[format_float_g9(found, *(float*)&bits)] = '\0';
+		if (strcmp(expected, found)) {
+			if (failures++ < 10)
+				LogInfo("*** %%.9g mismatch for %08x: expected %s, found %s\n", bits, expected, found);
+		}
+	}
+
+	// And every value the 8 and 16 bit types can produce:
+	for (i = 0; i < 0x10000; i++) {
+		vals[0] = vb_text_reference::float16((uint16_t)i);
+		vals[1] = vb_text_reference::unorm16((uint16_t)i);
+		vals[2] = vb_text_reference::snorm16((int16_t)i);
+		vals[3] = vb_text_reference::unorm8((uint8_t)i);
+		vals[4] = vb_text_reference::snorm8((int8_t)i);
+		for (j = 0; j < 5; j++) {
+			sprintf_s(expected, "%.9g", vals[j]);
+			found[format_float_g9(found, vals[j])] = '\0';
+			if (strcmp(expected, found)) {
+				if (failures++ < 10)
+					LogInfo("*** %%.9g mismatch for %04x: expected %s, found %s\n", i, expected, found);
+			}
+		}
+	}
+
+	return failures;
+}
+
+// Randomised layouts checked against the reference, mixing every format
+// (including ones it can only hexdump or doesn't know the size of), appended
+// and explicit offsets that may overrun the stride, instance step rates, and
+// offset / first / count combinations:
+#define VB_TEXT_TEST_CASES 3000
+
+static unsigned test_vb_text_layouts(UINT64 *rng)
+{
+	static const char *semantics[] = { "POSITION", "NORMAL", "TEXCOORD", "COLOR", "BLENDINDICES" };
+	D3D11_INPUT_ELEMENT_DESC desc[8];
+	D3D11_INPUT_CLASSIFICATION slot_class;
+	UINT size, stride, offset, first, count;
+	unsigned failures = 0;
+	vector<uint8_t> data;
+	string expected, found;
+	size_t elements, i;
+	int test, slot;
+	long len;
+	FILE *fp;
+
+#define VB_TEXT_RAND() (*rng ^= *rng << 13, *rng ^= *rng >> 7, *rng ^= *rng << 17, *rng)
+
+	for (test = 0; test < VB_TEXT_TEST_CASES; test++) {
+		elements = 1 + VB_TEXT_RAND() % _countof(desc);
+		for (i = 0; i < elements; i++) {
+			desc[i].SemanticName = semantics[VB_TEXT_RAND() % _countof(semantics)];
+			desc[i].SemanticIndex = VB_TEXT_RAND() % 3;
+			desc[i].Format = (DXGI_FORMAT)(VB_TEXT_RAND() % (DXGI_FORMAT_B8G8R8X8_UNORM_SRGB + 1));
+			desc[i].InputSlot = VB_TEXT_RAND() % 2;
+			desc[i].AlignedByteOffset = VB_TEXT_RAND() % 4 ? VB_TEXT_RAND() % 40 : D3D11_APPEND_ALIGNED_ELEMENT;
+			desc[i].InputSlotClass = VB_TEXT_RAND() % 3 ? D3D11_INPUT_PER_VERTEX_DATA : D3D11_INPUT_PER_INSTANCE_DATA;
+			desc[i].InstanceDataStepRate = VB_TEXT_RAND() % 3;
+		}
+		slot = VB_TEXT_RAND() % 2;
+		slot_class = VB_TEXT_RAND() % 2 ? D3D11_INPUT_PER_VERTEX_DATA : D3D11_INPUT_PER_INSTANCE_DATA;
+		stride = 1 + VB_TEXT_RAND() % 48;
+		size = VB_TEXT_RAND() % 3000;
+		offset = VB_TEXT_RAND() % 4 ? 0 : VB_TEXT_RAND() % 200;
+		first = VB_TEXT_RAND() % 4 ? 0 : VB_TEXT_RAND() % 10;
+		count = VB_TEXT_RAND() % 3 ? 0 : VB_TEXT_RAND() % 100;
+
+		// The reference reads past the end of the buffer if the last
+		// element overruns the stride, where the new formatter uses
+		// zeroes. Pad it with zeroes so they agree:
+		data.assign(size + 64, 0);
+		for (i = 0; i < size; i++)
+			data[i] = (uint8_t)VB_TEXT_RAND();
+
+		fp = open_vb_text_temp_file();
+		if (!fp) {
+			LogInfo("*** Unable to create temporary file\n");
+			return failures + 1;
+		}
+		vb_text_reference_dump(fp, desc, elements, slot_class, &data, size, slot, offset, first, count, stride);
+		len = ftell(fp);
+		expected.resize(len);
+		rewind(fp);
+		if (len)
+			fread(&expected[0], 1, len, fp);
+		fclose(fp);
+
+		found.clear();
+		VertexBufferTextFormatter(desc, elements, slot, slot_class).format(
+				&found, NULL, data.data(), size, offset, first, count, stride);
+
+		if (found != expected) {
+			if (failures++ < 3) {
+				for (i = 0; i < found.size() && i < expected.size() && found[i] == expected[i]; i++);
+				LogInfo("*** Vertex buffer text mismatch in test %i at offset %Iu:\n", test, i);
+				i = i > 80 ? i - 80 : 0;
+				LogInfo("Expected:\n%.160s\nFound:\n%.160s\n",
+						i < expected.size() ? expected.c_str() + i : "",
+						i < found.size() ? found.c_str() + i : "");
+			}
+		}
+	}
+
+#undef VB_TEXT_RAND
+
+	return failures;
+}
+
+#define VB_TEXT_BENCHMARK_VERTICES 200000
+
+static unsigned benchmark_vb_text_layout(const char *name, D3D11_INPUT_ELEMENT_DESC *desc,
+		size_t elements, D3D11_INPUT_CLASSIFICATION slot_class, UINT stride)
+{
+	UINT size = stride * VB_TEXT_BENCHMARK_VERTICES;
+	LARGE_INTEGER reference_start, reference_end, plan_start, plan_end, freq;
+	double reference, plan;
+	long reference_len, plan_len;
+	vector<uint8_t> data(size);
+	string text;
+	FILE *fp;
+	UINT i;
+
+	for (i = 0; i < size; i++)
+		data[i] = (uint8_t)(i * 0x9e3779b1u >> 13);
+
+	// Both write to a file, the same as when dumping:
+	fp = open_vb_text_temp_file();
+	if (!fp)
+		return 1;
+	QueryPerformanceCounter(&reference_start);
+	vb_text_reference_dump(fp, desc, elements, slot_class, &data, size, 0, 0, 0, 0, stride);
+	fflush(fp);
+	QueryPerformanceCounter(&reference_end);
+	reference_len = ftell(fp);
+	fclose(fp);
+
+	fp = open_vb_text_temp_file();
+	if (!fp)
+		return 1;
+	QueryPerformanceCounter(&plan_start);
+	VertexBufferTextFormatter(desc, elements, 0, slot_class).format(
+			&text, fp, data.data(), size, 0, 0, 0, stride);
+	fflush(fp);
+	QueryPerformanceCounter(&plan_end);
+	plan_len = ftell(fp);
+	fclose(fp);
+
+	QueryPerformanceFrequency(&freq);
+	reference = (double)(reference_end.QuadPart - reference_start.QuadPart) / freq.QuadPart;
+	plan = (double)(plan_end.QuadPart - plan_start.QuadPart) / freq.QuadPart;
+
+	LogInfo("  %-28s %8.1f MB/s %8.1f MB/s %6.2fx\n", name,
+			reference ? reference_len / reference / (1024 * 1024) : 0.0,
+			plan ? plan_len / plan / (1024 * 1024) : 0.0,
+			plan ? reference / plan : 0.0);
+
+	if (plan_len != reference_len) {
+		LogInfo("*** %s: expected %li bytes, found %li\n", name, reference_len, plan_len);
+		return 1;
+	}
+	return 0;
+}
+
+static int benchmark_vb_text()
+{
+	D3D11_INPUT_ELEMENT_DESC mesh[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 20, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "BLENDINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 28, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	D3D11_INPUT_ELEMENT_DESC position[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	D3D11_INPUT_ELEMENT_DESC packed[] = {
+		{ "NORMAL", 0, DXGI_FORMAT_R8G8B8A8_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R8G8B8A8_SNORM, 0, 4, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_UNORM, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	D3D11_INPUT_ELEMENT_DESC instance[] = {
+		{ "TEXCOORD", 4, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "TEXCOORD", 5, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "TEXCOORD", 6, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "COLOR", 1, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+	UINT64 rng = 0x2545f4914f6cdd1dULL;
+	unsigned failures, layout_failures;
+
+	failures = test_vb_text_floats(&rng);
+	LogInfo("Vertex buffer text: %u floats checked against %%.9g, %u mismatches\n",
+			VB_TEXT_FLOAT_TEST_CASES + 0x10000 * 5, failures);
+
+	layout_failures = test_vb_text_layouts(&rng);
+	LogInfo("Vertex buffer text: %u random layouts checked against the reference, %u mismatches\n",
+			VB_TEXT_TEST_CASES, layout_failures);
+	failures += layout_failures;
+
+	LogInfo("  %-28s %13s %13s\n", "Layout", "fprintf", "Plan");
+	failures += benchmark_vb_text_layout("Mesh, 32 byte stride", mesh, _countof(mesh), D3D11_INPUT_PER_VERTEX_DATA, 32);
+	failures += benchmark_vb_text_layout("Positions only", position, _countof(position), D3D11_INPUT_PER_VERTEX_DATA, 12);
+	failures += benchmark_vb_text_layout("Packed snorm/unorm/half", packed, _countof(packed), D3D11_INPUT_PER_VERTEX_DATA, 16);
+	failures += benchmark_vb_text_layout("Instanced 3x float4 + color", instance, _countof(instance), D3D11_INPUT_PER_INSTANCE_DATA, 52);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Check for the DX11 wrapper's command list expression compiler. Random
+// expressions using every operator are compiled into postfix bytecode with the
+// same compile_command_list_expression() the wrapper uses, run through the same
+// operator cases as its interpreter, and the result compared to evaluating the
+// tree the way CommandListOperator::evaluate() does. Each expression is run
+// with many combinations of inputs picked to hit the edge cases of the
+// operators - signed zeros for ===, NAN and infinity for the comparisons and
+// logical operators, and fractions for // and %. This used to be done by the
+// wrapper itself for every expression in the d3dx.ini as it was loaded.
+#define VERIFY_EXPRESSION_TREES 20000
+#define VERIFY_EXPRESSION_TRIALS 64
+#define VERIFY_EXPRESSION_INPUTS 4
+#define VERIFY_EXPRESSION_MAX_DEPTH 8
+
+static const float verify_expression_samples[] = {
+	0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -2.5f, 3.0f, 1e30f,
+	std::numeric_limits<float>::infinity(),
+	std::numeric_limits<float>::quiet_NaN(),
+};
+
+// Constants and variables stand in for every operand type - the wrapper
+// pushes the value of any other operand the same way:
+struct verify_expression_node {
+	CommandListOpcode op; // PUSH_CONSTANT, PUSH_VARIABLE or an operator
+	float val;
+	int input;
+	verify_expression_node *lhs;
+	verify_expression_node *rhs;
+};
+
+struct verify_expression_instruction {
+	CommandListOpcode op;
+	float val;
+	int input;
+};
+typedef vector<verify_expression_instruction> verify_expression_program;
+
+struct verify_expression_traits {
+	static bool push(verify_expression_node *node, verify_expression_program *program)
+	{
+		if (node->op != CommandListOpcode::PUSH_CONSTANT && node->op != CommandListOpcode::PUSH_VARIABLE)
+			return false;
+		program->push_back({node->op, node->val, node->input});
+		return true;
+	}
+
+	static bool split(verify_expression_node *node, verify_expression_node **lhs,
+			CommandListOpcode *op, verify_expression_node **rhs)
+	{
+		if (!command_list_operator_fn(node->op))
+			return false;
+		*lhs = node->lhs;
+		*op = node->op;
+		*rhs = node->rhs;
+		return true;
+	}
+
+	static void emit(CommandListOpcode op, verify_expression_program *program)
+	{
+		program->push_back({op, 0.0f, 0});
+	}
+};
+
+static verify_expression_node* verify_expression_tree(deque<verify_expression_node> *nodes, UINT64 *rng, int depth)
+{
+	verify_expression_node node = {};
+	unsigned operators = (unsigned)CommandListOpcode::OR - (unsigned)CommandListOpcode::NOT + 1;
+
+	*rng ^= *rng << 13;
+	*rng ^= *rng >> 7;
+	*rng ^= *rng << 17;
+
+	if (depth <= 0 || !(*rng & 3)) {
+		if (*rng & 4) {
+			node.op = CommandListOpcode::PUSH_CONSTANT;
+			node.val = verify_expression_samples[(*rng >> 8) % _countof(verify_expression_samples)];
+		} else {
+			node.op = CommandListOpcode::PUSH_VARIABLE;
+			node.input = (int)((*rng >> 8) % VERIFY_EXPRESSION_INPUTS);
+		}
+	} else {
+		node.op = (CommandListOpcode)((unsigned)CommandListOpcode::NOT + (*rng >> 16) % operators);
+		// === and !== see the sign and payload of a NAN, which the
+		// compiler is free to pick from either side of a commutative
+		// operation (NAN * -NAN), and may do differently where it
+		// inlines the same operator twice. Only give them plain
+		// operands, which still covers signed zeros and NAN inputs:
+		if (node.op == CommandListOpcode::IDENTICAL || node.op == CommandListOpcode::NOT_IDENTICAL)
+			depth = 0;
+		if (node.op >= CommandListOpcode::EXPONENT)
+			node.lhs = verify_expression_tree(nodes, rng, depth - 1);
+		node.rhs = verify_expression_tree(nodes, rng, depth - 1);
+	}
+
+	// deque never moves existing elements on push_back:
+	nodes->push_back(node);
+	return &nodes->back();
+}
+
+// A chain of additions nested down the right hand side, which needs one stack
+// slot per operand, or down the left, which never needs more than two:
+static verify_expression_node* verify_expression_chain(deque<verify_expression_node> *nodes, int operands, bool right)
+{
+	verify_expression_node node = {};
+	verify_expression_node *ret = NULL;
+	int i;
+
+	for (i = 0; i < operands; i++) {
+		node.op = CommandListOpcode::PUSH_VARIABLE;
+		node.input = i % VERIFY_EXPRESSION_INPUTS;
+		nodes->push_back(node);
+		if (!ret) {
+			ret = &nodes->back();
+			continue;
+		}
+		node.op = CommandListOpcode::ADD;
+		node.lhs = right ? &nodes->back() : ret;
+		node.rhs = right ? ret : &nodes->back();
+		nodes->push_back(node);
+		ret = &nodes->back();
+		node = {};
+	}
+
+	return ret;
+}
+
+static float verify_expression_evaluate(verify_expression_node *node, const float *inputs)
+{
+	float lhs = std::numeric_limits<float>::quiet_NaN();
+
+	switch (node->op) {
+		case CommandListOpcode::PUSH_CONSTANT:
+			return node->val;
+		case CommandListOpcode::PUSH_VARIABLE:
+			return inputs[node->input];
+	}
+
+	if (node->lhs)
+		lhs = verify_expression_evaluate(node->lhs, inputs);
+	return command_list_operator_fn(node->op)(lhs, verify_expression_evaluate(node->rhs, inputs));
+}
+
+// Runs a program the way the wrapper's run_command_list_program() does, with a
+// stack big enough for anything so we can see how deep it actually went:
+static bool verify_expression_run(verify_expression_program *program, const float *inputs,
+		float *result, int *max_depth)
+{
+	vector<float> stack(program->size() + 1);
+	float *sp = stack.data();
+
+	*max_depth = 0;
+	for (verify_expression_instruction &inst : *program) {
+		switch (inst.op) {
+		case CommandListOpcode::PUSH_CONSTANT:
+			*sp++ = inst.val;
+			break;
+		case CommandListOpcode::PUSH_VARIABLE:
+			*sp++ = inputs[inst.input];
+			break;
+
+		COMMAND_LIST_OPERATOR_CASES
+
+		default:
+			return false;
+		}
+		*max_depth = max(*max_depth, (int)(sp - stack.data()));
+	}
+
+	if (sp != stack.data() + 1)
+		return false;
+	*result = sp[-1];
+	return true;
+}
+
+static bool verify_expression_results_match(float a, float b)
+{
+	if (isnan(a) && isnan(b))
+		return true;
+	return *(uint32_t*)&a == *(uint32_t*)&b;
+}
+
+// Returns true if the expression compiled, and counts any way it disagrees
+// with the tree in failures:
+static bool verify_expression(verify_expression_node *tree, UINT64 *rng, unsigned *failures)
+{
+	verify_expression_program program;
+	float inputs[VERIFY_EXPRESSION_INPUTS];
+	float tree_result, program_result = 0;
+	int depth = 0, max_depth = 0, run_depth = 0;
+	int trial, i;
+
+	if (!compile_command_list_expression<verify_expression_traits>(tree, &program, &depth, &max_depth)
+			|| depth != 1) {
+		(*failures)++;
+		return false;
+	}
+	if (max_depth > COMMAND_LIST_STACK_SIZE)
+		return false;
+
+	for (trial = 0; trial < VERIFY_EXPRESSION_TRIALS; trial++) {
+		for (i = 0; i < VERIFY_EXPRESSION_INPUTS; i++) {
+			*rng ^= *rng << 13;
+			*rng ^= *rng >> 7;
+			*rng ^= *rng << 17;
+			inputs[i] = verify_expression_samples[*rng % _countof(verify_expression_samples)];
+		}
+
+		tree_result = verify_expression_evaluate(tree, inputs);
+		if (!verify_expression_run(&program, inputs, &program_result, &run_depth)
+				|| run_depth != max_depth
+				|| !verify_expression_results_match(tree_result, program_result)) {
+			if ((*failures)++ < 10) {
+				LogInfo("*** Compiled expression mismatch: tree=%g program=%g stack=%i/%i inputs=[%g %g %g %g] ***\n",
+						tree_result, program_result, run_depth, max_depth,
+						inputs[0], inputs[1], inputs[2], inputs[3]);
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+static int verify_command_list_expressions()
+{
+	UINT64 rng = 0x2545f4914f6cdd1dULL;
+	deque<verify_expression_node> nodes;
+	unsigned failures = 0, i;
+
+	LogInfo("Command list expressions, %u random expressions, %u inputs each\n",
+			VERIFY_EXPRESSION_TREES, VERIFY_EXPRESSION_TRIALS);
+
+	// None of these are deep enough to need more than the stack we have,
+	// so they must all compile:
+	for (i = 0; i < VERIFY_EXPRESSION_TREES; i++) {
+		nodes.clear();
+		if (!verify_expression(verify_expression_tree(&nodes, &rng, VERIFY_EXPRESSION_MAX_DEPTH), &rng, &failures))
+			failures++;
+	}
+
+	// Anything that fits in the stack must compile, and anything that
+	// doesn't must be left as a tree:
+	nodes.clear();
+	if (!verify_expression(verify_expression_chain(&nodes, COMMAND_LIST_STACK_SIZE, true), &rng, &failures))
+		failures++;
+	nodes.clear();
+	if (verify_expression(verify_expression_chain(&nodes, COMMAND_LIST_STACK_SIZE + 1, true), &rng, &failures))
+		failures++;
+	nodes.clear();
+	if (!verify_expression(verify_expression_chain(&nodes, COMMAND_LIST_STACK_SIZE * 4, false), &rng, &failures))
+		failures++;
+
+	if (failures)
+		LogInfo("*** %u compiled expressions did not match the tree ***\n", failures);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Stress test for the lock free resource handle table used by the DX11 wrapper.
+// Every thread adds, removes and looks up a set of keys of its own, checking
+// that lookups agree exactly with what it has added, and in between looks up
+// keys belonging to the other threads, which may be removed or replaced at any
+// moment. A value that has been freed while a lookup could still be using it
+// shows up as a bad magic number (or crashes). The same workload is then run against an
+// unordered_map under a critical section, which is what the table replaced.
+#define STRESS_TABLE_KEYS_PER_THREAD 4096
+#define STRESS_TABLE_OPERATIONS 2000000
+#define STRESS_VALUE_LIVE 0x4c495645
+#define STRESS_VALUE_DEAD 0xdeaddead
+
+struct stress_value {
+	void *key;
+	volatile unsigned magic;
+
+	stress_value() : key(NULL), magic(STRESS_VALUE_LIVE) {}
+	~stress_value() { magic = STRESS_VALUE_DEAD; }
+};
+
+class stress_locked_map
+{
+public:
+	stress_locked_map() { InitializeCriticalSection(&lock); }
+	~stress_locked_map()
+	{
+		for (auto &i : map)
+			delete i.second;
+		DeleteCriticalSection(&lock);
+	}
+
+	stress_value* find(void *key)
+	{
+		stress_value *ret = NULL;
+
+		EnterCriticalSection(&lock);
+		auto i = map.find(key);
+		if (i != map.end())
+			ret = i->second;
+		LeaveCriticalSection(&lock);
+		return ret;
+	}
+
+	stress_value* insert(void *key)
+	{
+		stress_value *&value = map[key];
+		if (!value)
+			value = new stress_value();
+		return value;
+	}
+
+	bool erase(void *key)
+	{
+		auto i = map.find(key);
+		if (i == map.end())
+			return false;
+		delete i->second;
+		map.erase(i);
+		return true;
+	}
+
+	size_t size() { return map.size(); }
+
+	CRITICAL_SECTION lock;
+	std::unordered_map<void*, stress_value*> map;
+};
+
+class stress_lock_free_table : public ResourceHandleTable<void*, stress_value>
+{
+public:
+	stress_lock_free_table() { InitializeCriticalSection(&lock); }
+	~stress_lock_free_table() { DeleteCriticalSection(&lock); }
+
+	CRITICAL_SECTION lock;
+};
+
+static void* stress_table_key(unsigned thread, unsigned idx)
+{
+	// Something that looks like a heap pointer so that the hash sees
+	// realistic alignment in the low bits:
+	return (void*)(((uintptr_t)(thread + 1) << 20) | ((uintptr_t)idx << 4));
+}
+
+static bool stress_value_ok(stress_value *value, void *key)
+{
+	// The key is filled in after the value is published:
+	return !value || ((!value->key || value->key == key) && value->magic == STRESS_VALUE_LIVE);
+}
+
+// Another thread may remove the key while we look at its value, so these need
+// to hold off the value being freed the same way the DX11 wrapper would have
+// to if it ever looked up a resource it did not hold a reference on:
+static bool stress_check_other(stress_lock_free_table *table, void *key)
+{
+	EpochGuard guard(table->get_reclaimer());
+	return stress_value_ok(table->find(key), key);
+}
+
+static bool stress_check_other(stress_locked_map *table, void *key)
+{
+	bool ret;
+
+	EnterCriticalSection(&table->lock);
+	ret = stress_value_ok(table->find(key), key);
+	LeaveCriticalSection(&table->lock);
+	return ret;
+}
+
+template <class T>
+static unsigned stress_table_thread(T *table, unsigned thread, unsigned threads, size_t *live)
+{
+	std::vector<bool> present(STRESS_TABLE_KEYS_PER_THREAD);
+	unsigned failures = 0;
+	UINT64 rng = 0x2545f4914f6cdd1dULL * (thread + 1);
+	stress_value *value;
+	unsigned i, idx, other;
+	void *key;
+
+	for (i = 0; i < STRESS_TABLE_OPERATIONS; i++) {
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		idx = (unsigned)(rng >> 8) % STRESS_TABLE_KEYS_PER_THREAD;
+
+		switch (rng & 7) {
+		case 0: // Add or remove one of our own keys
+			key = stress_table_key(thread, idx);
+			EnterCriticalSection(&table->lock);
+			if (present[idx]) {
+				if (!table->erase(key))
+					failures++;
+			} else {
+				value = table->insert(key);
+				value->key = key;
+			}
+			LeaveCriticalSection(&table->lock);
+			present[idx] = !present[idx];
+			break;
+		case 1: case 2: case 3: // Look up one of our own keys
+			key = stress_table_key(thread, idx);
+			value = table->find(key);
+			if (!!value != present[idx] || (value && value->key != key) || !stress_value_ok(value, key))
+				failures++;
+			// NULL is never a key, not even while another thread
+			// is part way through inserting into an empty slot:
+			if (table->find(NULL))
+				failures++;
+			break;
+		default: // Look up a key another thread may be changing
+			other = (unsigned)(rng >> 40) % threads;
+			if (!stress_check_other(table, stress_table_key(other, idx)))
+				failures++;
+			break;
+		}
+	}
+
+	for (idx = 0; idx < STRESS_TABLE_KEYS_PER_THREAD; idx++)
+		*live += present[idx];
+
+	return failures;
+}
+
+template <class T>
+static unsigned stress_table(const char *name, T *table, unsigned threads)
+{
+	std::vector<std::thread> workers;
+	std::vector<unsigned> failures(threads);
+	std::vector<size_t> live(threads);
+	LARGE_INTEGER start, end, freq;
+	unsigned total_failures = 0;
+	size_t total_live = 0;
+	double seconds;
+	unsigned i;
+
+	QueryPerformanceCounter(&start);
+	for (i = 0; i < threads; i++) {
+		workers.emplace_back([table, i, threads, &failures, &live] {
+			failures[i] = stress_table_thread(table, i, threads, &live[i]);
+		});
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&freq);
+	seconds = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+
+	for (i = 0; i < threads; i++) {
+		total_failures += failures[i];
+		total_live += live[i];
+	}
+	if (table->size() != total_live)
+		total_failures++;
+
+	LogInfo("  %-24s %10.3f ms %10.1f Mops/s, %Iu keys\n", name, seconds * 1000.0,
+			seconds ? (double)threads * STRESS_TABLE_OPERATIONS / seconds / 1000000.0 : 0.0,
+			table->size());
+	if (total_failures)
+		LogInfo("*** %s: %u inconsistent results, %Iu keys in table, expected %Iu ***\n",
+				name, total_failures, table->size(), total_live);
+
+	return total_failures;
+}
+
+// The override index gets the same treatment: one thread adds keys one at a
+// time the way ShaderRegex does as it matches shaders, while the others look
+// up keys that have and haven't been added yet. Every key a reader knows has
+// been added must be found with the right value, no key that hasn't been
+// added may be, and the tables the index has grown out of must not pile up.
+#define STRESS_INDEX_KEYS 200000
+#define STRESS_INDEX_LOOKUPS 4000000
+
+static UINT64 stress_index_key(unsigned idx)
+{
+	return 0x9e3779b97f4a7c15ULL * (idx + 1);
+}
+
+static unsigned stress_index_reader(OverrideLookupTable<UINT64, unsigned> *index,
+		std::vector<unsigned> *values, std::atomic<unsigned> *added, unsigned thread)
+{
+	UINT64 rng = 0x2545f4914f6cdd1dULL * (thread + 1);
+	unsigned failures = 0;
+	unsigned i, idx, n;
+	unsigned *value;
+
+	for (i = 0; i < STRESS_INDEX_LOOKUPS; i++) {
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+
+		n = added->load(std::memory_order_acquire);
+		idx = (unsigned)(rng >> 8) % STRESS_INDEX_KEYS;
+		value = index->find(stress_index_key(idx));
+		if (idx < n && value != &(*values)[idx])
+			failures++;
+		if (value && value != &(*values)[idx])
+			failures++;
+		if (index->find(stress_index_key(STRESS_INDEX_KEYS + idx)))
+			failures++;
+	}
+
+	return failures;
+}
+
+static unsigned stress_override_index(unsigned threads)
+{
+	OverrideLookupTable<UINT64, unsigned> *index = new OverrideLookupTable<UINT64, unsigned>();
+	std::vector<unsigned> values(STRESS_INDEX_KEYS);
+	std::vector<std::thread> workers;
+	std::vector<unsigned> failures(threads);
+	std::atomic<unsigned> added(0);
+	LARGE_INTEGER start, end, freq;
+	unsigned total_failures = 0;
+	size_t max_pending = 0;
+	unsigned i;
+
+	LogInfo("Override index, %u keys added during %u lookups on each of %u threads:\n",
+			STRESS_INDEX_KEYS, STRESS_INDEX_LOOKUPS, threads);
+
+	QueryPerformanceCounter(&start);
+	for (i = 0; i < threads; i++) {
+		workers.emplace_back([index, &values, &added, &failures, i] {
+			failures[i] = stress_index_reader(index, &values, &added, i);
+		});
+	}
+	for (i = 0; i < STRESS_INDEX_KEYS; i++) {
+		values[i] = i;
+		index->insert(stress_index_key(i), &values[i]);
+		added.store(i + 1, std::memory_order_release);
+		max_pending = max(max_pending, index->pending_reclaim());
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&freq);
+
+	for (i = 0; i < threads; i++)
+		total_failures += failures[i];
+	for (i = 0; i < STRESS_INDEX_KEYS; i++) {
+		if (index->find(stress_index_key(i)) != &values[i])
+			total_failures++;
+	}
+	if (index->size() != STRESS_INDEX_KEYS)
+		total_failures++;
+
+	LogInfo("  %-24s %10.3f ms, %Iu keys in %Iu slots, at most %Iu tables awaiting reclamation\n",
+			"Lock free index", (double)(end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart,
+			index->size(), index->capacity(), max_pending);
+	if (total_failures)
+		LogInfo("*** Override index: %u inconsistent results ***\n", total_failures);
+
+	delete index;
+	return total_failures;
+}
+
+static int stress_resource_table()
+{
+	unsigned threads = max(4u, std::thread::hardware_concurrency() * 2);
+	stress_lock_free_table *lock_free = new stress_lock_free_table();
+	stress_locked_map *locked = new stress_locked_map();
+	unsigned failures = 0;
+
+	LogInfo("Resource handle table, %u threads, %u operations each:\n",
+			threads, STRESS_TABLE_OPERATIONS);
+
+	failures += stress_table("Lock free table", lock_free, threads);
+	LogInfo("  %Iu slots, %Iu objects awaiting reclamation\n",
+			lock_free->capacity(), lock_free->pending_reclaim());
+	failures += stress_table("Locked unordered_map", locked, threads);
+
+	failures += stress_override_index(threads);
+
+	delete lock_free;
+	delete locked;
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Stress test for ShaderRegex, which the DX11 wrapper now runs from a pool of
+// worker threads as the game creates shaders. A handful of groups like the
+// ones people write are applied to every input file, disassembling, patching
+// and reassembling it exactly as a worker would, first on a single thread for
+// a reference and then from many threads at once, each going through the
+// files in a different order with its own match context. Every thread must
+// get the same matches, patched assembly and bytecode as the reference.
+#define STRESS_REGEX_PASSES 8
+
+struct stress_regex_result {
+	bool disassembled;
+	vector<uint32_t> match_ids;
+	vector<uint32_t> patch_ids;
+	string asm_text;
+	vector<byte> bytecode;
+
+	bool operator==(const stress_regex_result &other) const
+	{
+		return disassembled == other.disassembled
+			&& match_ids == other.match_ids
+			&& patch_ids == other.patch_ids
+			&& asm_text == other.asm_text
+			&& bytecode == other.bytecode;
+	}
+};
+
+static bool stress_regex_add_pattern(ShaderRegexRules *group, const wchar_t *name,
+		const char *pattern, const char *replace)
+{
+	ShaderRegexPattern *regex_pattern = &group->patterns[name];
+	string pattern_str(pattern);
+
+	if (!regex_pattern->compile(&pattern_str))
+		return false;
+
+	if (replace) {
+		regex_pattern->replace = replace;
+		regex_pattern->do_replace = true;
+	}
+
+	return true;
+}
+
+static bool stress_regex_groups(vector<ShaderRegexRules> *groups)
+{
+	static const char *shader_models[] = {
+		"vs_4_0", "vs_4_1", "vs_5_0", "hs_5_0", "ds_5_0", "gs_4_0",
+		"gs_4_1", "gs_5_0", "ps_4_0", "ps_4_1", "ps_5_0", "cs_4_0",
+		"cs_4_1", "cs_5_0",
+	};
+	bool ok = true;
+
+	groups->resize(5);
+	for (ShaderRegexRules &group : *groups)
+		group.shader_models.insert(shader_models, shader_models + _countof(shader_models));
+
+	// Replacement using a temporary register, which has to update dcl_temps:
+	(*groups)[0].temp_regs.insert("stereo");
+	ok = stress_regex_add_pattern(&(*groups)[0], L"pattern",
+			"^(\\s*)(mul|mad) (r\\d+)\\.(\\w+), ",
+			"$1mov ${stereo}.xyzw, l(0, 0, 0, 0)\\n$0") && ok;
+
+	// Match only, but with extra declarations:
+	(*groups)[1].declarations.push_back("dcl_constantbuffer cb13[1], immediateIndexed");
+	ok = stress_regex_add_pattern(&(*groups)[1], L"pattern",
+			"dcl_output_siv o0\\.xyzw, position", NULL) && ok;
+
+	// Match only, just for the command lists:
+	ok = stress_regex_add_pattern(&(*groups)[2], L"pattern",
+			"sample_indexable\\(texture2d\\)", NULL) && ok;
+
+	// Top level alternation, which the prefilter can't help with:
+	ok = stress_regex_add_pattern(&(*groups)[3], L"pattern",
+			"^\\s*dp4 r\\d+|^\\s*discard_nz", "$0") && ok;
+
+	// Two patterns, the second matched against the patched text:
+	ok = stress_regex_add_pattern(&(*groups)[4], L"pattern1",
+			"^(\\s*)ret\\s*$", "$1mov o0.xyzw, o0.xyzw\\n$0") && ok;
+	ok = stress_regex_add_pattern(&(*groups)[4], L"pattern2",
+			"mov o0\\.xyzw, o0\\.xyzw", NULL) && ok;
+
+	return ok;
+}
+
+static void stress_regex_process(ShaderRegexRuleSet *rules, vector<char> *shader,
+		ShaderRegexMatchContext *context, stress_regex_result *result)
+{
+	string shader_model("bin");
+	vector<char> asm_vector;
+	size_t pos;
+
+	result->disassembled = false;
+
+	if (!rules->may_match(shader->data(), shader->size(), &shader_model))
+		return;
+
+	result->asm_text = BinaryToAsmText(shader->data(), shader->size(), false);
+	if (result->asm_text.empty())
+		return;
+	result->disassembled = true;
+
+	// The disassembler stamps the time in a comment, which would make
+	// otherwise identical results differ:
+	pos = result->asm_text.find("//   using 3Dmigoto");
+	if (pos != string::npos)
+		result->asm_text.erase(pos, result->asm_text.find('\n', pos) + 1 - pos);
+
+	if (!rules->apply(&result->asm_text, &shader_model, context, &result->match_ids, &result->patch_ids))
+		return;
+
+	asm_vector.assign(result->asm_text.begin(), result->asm_text.end());
+	try {
+		if (FAILED(AssembleFluganWithSignatureParsing(&asm_vector, &result->bytecode)))
+			result->bytecode.clear();
+	} catch (...) {
+		result->bytecode.clear();
+	}
+}
+
+static unsigned stress_regex_thread(ShaderRegexRuleSet *rules, vector<vector<char>> *shaders,
+		vector<stress_regex_result> *reference, unsigned thread)
+{
+	ShaderRegexMatchContext context;
+	vector<size_t> order(shaders->size());
+	UINT64 rng = 0x2545f4914f6cdd1dULL * (thread + 1);
+	unsigned failures = 0;
+	size_t i, j;
+	unsigned pass;
+
+	for (i = 0; i < order.size(); i++)
+		order[i] = i;
+
+	for (pass = 0; pass < STRESS_REGEX_PASSES; pass++) {
+		for (i = order.size(); i > 1; i--) {
+			rng ^= rng << 13;
+			rng ^= rng >> 7;
+			rng ^= rng << 17;
+			j = (size_t)(rng >> 8) % i;
+			std::swap(order[i - 1], order[j]);
+		}
+
+		for (size_t idx : order) {
+			stress_regex_result result;
+
+			stress_regex_process(rules, &(*shaders)[idx], &context, &result);
+			if (!(result == (*reference)[idx]))
+				failures++;
+		}
+	}
+
+	return failures;
+}
+
+static int stress_shader_regex()
+{
+	unsigned threads = max(4u, std::thread::hardware_concurrency() * 2);
+	vector<ShaderRegexRules> groups;
+	ShaderRegexRuleSet rules;
+	vector<vector<char>> shaders;
+	vector<stress_regex_result> reference;
+	std::vector<std::thread> workers;
+	std::vector<unsigned> failures(threads);
+	LARGE_INTEGER start, end, freq;
+	unsigned total_failures = 0;
+	unsigned matched = 0, patched = 0, assemble_failed = 0;
+	double single_seconds, seconds;
+	FILE *log_file = LogFile;
+	size_t i;
+
+	if (!stress_regex_groups(&groups))
+		return EXIT_FAILURE;
+	for (ShaderRegexRules &group : groups)
+		rules.rules.push_back(&group);
+	rules.compile();
+
+	shaders.resize(args.files.size());
+	for (i = 0; i < args.files.size(); i++) {
+		if (ReadInput(&shaders[i], &args.files[i]))
+			return EXIT_FAILURE;
+	}
+	if (shaders.empty()) {
+		LogInfo("ShaderRegex stress test needs some shaders to work on\n");
+		return EXIT_FAILURE;
+	}
+
+	// The patterns log every dcl_temps they update, which is not what we
+	// want to be timing:
+	LogFile = NULL;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&start);
+	{
+		ShaderRegexMatchContext context;
+
+		reference.resize(shaders.size());
+		for (i = 0; i < shaders.size(); i++)
+			stress_regex_process(&rules, &shaders[i], &context, &reference[i]);
+	}
+	QueryPerformanceCounter(&end);
+	single_seconds = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+
+	QueryPerformanceCounter(&start);
+	for (unsigned t = 0; t < threads; t++) {
+		workers.emplace_back([&rules, &shaders, &reference, &failures, t] {
+			failures[t] = stress_regex_thread(&rules, &shaders, &reference, t);
+		});
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+	QueryPerformanceCounter(&end);
+	seconds = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+
+	LogFile = log_file;
+
+	for (stress_regex_result &result : reference) {
+		matched += !result.match_ids.empty();
+		patched += !result.patch_ids.empty();
+		assemble_failed += !result.patch_ids.empty() && result.bytecode.empty();
+	}
+	for (unsigned t = 0; t < threads; t++)
+		total_failures += failures[t];
+
+	LogInfo("ShaderRegex: %Iu shaders, %u matched, %u patched, %u failed to reassemble\n",
+			shaders.size(), matched, patched, assemble_failed);
+	LogInfo("  %-24s %10.3f ms %10.1f shaders/s\n", "1 thread", single_seconds * 1000.0,
+			single_seconds ? shaders.size() / single_seconds : 0.0);
+	LogInfo("  %2u threads x %u passes     %10.3f ms %10.1f shaders/s\n", threads, STRESS_REGEX_PASSES,
+			seconds * 1000.0, seconds ? (double)shaders.size() * threads * STRESS_REGEX_PASSES / seconds : 0.0);
+	if (total_failures)
+		LogInfo("*** ShaderRegex: %u results differed from the single threaded reference ***\n", total_failures);
+
+	return total_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+// Console App Entry-Point.
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	int rc = EXIT_SUCCESS;
+
+	parse_args(argc, argv);
+
+	if (args.benchmark_texture_hash)
+		rc = benchmark_texture_hash() || rc;
+	if (args.benchmark_vb_text)
+		rc = benchmark_vb_text() || rc;
+	if (args.stress_resource_table)
+		rc = stress_resource_table() || rc;
+	if (args.verify_command_list_expressions)
+		rc = verify_command_list_expressions() || rc;
+	if (args.stress_shader_regex)
+		rc = stress_shader_regex() || rc;
+
+	if (rc)
+		LogInfo("\n*** At least one test failed ***\n");
+
+	return rc;
+}
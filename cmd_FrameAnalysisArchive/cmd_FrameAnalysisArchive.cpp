@@ -0,0 +1,357 @@
+// cmd_FrameAnalysisArchive.cpp : Lists and extracts frame analysis dumps that
+// were saved with analyse_options = archive.
+//
+
+#include <windows.h>
+#include <shlobj.h>
+#include <Shlwapi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DirectX11\FrameAnalysisArchive.h"
+#include "version.h"
+
+using namespace std;
+
+struct ArchiveEntry {
+	FrameAnalysisArchiveRecordType type;
+	UINT64 offset;
+	uint32_t size;
+	wstring name;
+};
+
+static struct {
+	bool list;
+	bool extract;
+	bool blobs;
+	bool copy;
+	wstring archive_dir;
+	wstring output_dir;
+	vector<wstring> patterns;
+} args;
+
+static void PrintHelp(int argc, wchar_t *argv[])
+{
+	wprintf(L"usage: %s [OPTION] FRAME_ANALYSIS_DIR [PATTERN...]\n\n", argv[0]);
+
+	wprintf(L"Lists or extracts a frame analysis dump saved with analyse_options=archive.\n");
+	wprintf(L"If any PATTERNs are given (e.g. \"000123-*\" or \"*-vb0=*\") only filenames\n");
+	wprintf(L"matching one of them are processed.\n\n");
+
+	wprintf(L"  -l, --list\n");
+	wprintf(L"\t\t\tList the filenames in the archive (default)\n");
+
+	wprintf(L"  -x, --extract\n");
+	wprintf(L"\t\t\tRecreate the traditional frame analysis layout, with each unique\n");
+	wprintf(L"\t\t\tfile in the deduped directory hard linked to the names it was\n");
+	wprintf(L"\t\t\tdumped under\n");
+
+	wprintf(L"  -o, --output DIR\n");
+	wprintf(L"\t\t\tExtract to DIR instead of the frame analysis directory\n");
+
+	wprintf(L"  -c, --copy\n");
+	wprintf(L"\t\t\tExtract separate copies instead of hard linking\n");
+
+	wprintf(L"  -b, --blobs\n");
+	wprintf(L"\t\t\tOperate on the unique deduped files instead of the traditional names\n");
+
+	exit(EXIT_FAILURE);
+}
+
+static void PrintVersion()
+{
+	wprintf(L"3DMigoto cmd_FrameAnalysisArchive version %S\n", VER_FILE_VERSION_STR);
+
+	exit(EXIT_SUCCESS);
+}
+
+static void parse_args(int argc, wchar_t *argv[])
+{
+	bool terminated = false;
+	wchar_t *arg;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+		if (!terminated && !wcsncmp(arg, L"-", 1)) {
+			if (!wcscmp(arg, L"--help") || !wcscmp(arg, L"--usage")) {
+				PrintHelp(argc, argv); // Does not return
+			}
+			if (!wcscmp(arg, L"--version")) {
+				PrintVersion(); // Does not return
+			}
+			if (!wcscmp(arg, L"--")) {
+				terminated = true;
+				continue;
+			}
+			if (!wcscmp(arg, L"-l") || !wcscmp(arg, L"--list")) {
+				args.list = true;
+				continue;
+			}
+			if (!wcscmp(arg, L"-x") || !wcscmp(arg, L"--extract")) {
+				args.extract = true;
+				continue;
+			}
+			if (!wcscmp(arg, L"-o") || !wcscmp(arg, L"--output")) {
+				if (++i >= argc)
+					PrintHelp(argc, argv);
+				args.output_dir = argv[i];
+				continue;
+			}
+			if (!wcscmp(arg, L"-c") || !wcscmp(arg, L"--copy")) {
+				args.copy = true;
+				continue;
+			}
+			if (!wcscmp(arg, L"-b") || !wcscmp(arg, L"--blobs")) {
+				args.blobs = true;
+				continue;
+			}
+			wprintf(L"Unrecognised argument: %s\n", arg);
+			PrintHelp(argc, argv); // Does not return
+		}
+		if (args.archive_dir.empty())
+			args.archive_dir = arg;
+		else
+			args.patterns.push_back(arg);
+	}
+
+	if (args.archive_dir.empty())
+		PrintHelp(argc, argv); // Does not return
+
+	if (!args.list && !args.extract)
+		args.list = true;
+
+	if (args.output_dir.empty())
+		args.output_dir = args.archive_dir;
+}
+
+static FILE* open_archive_file(const wchar_t *name, const char *magic)
+{
+	FrameAnalysisArchiveHeader header;
+	wstring path = args.archive_dir + L"\\" + name;
+	FILE *fp;
+
+	if (_wfopen_s(&fp, path.c_str(), L"rb") || !fp) {
+		wprintf(L"Unable to open %s\n", path.c_str());
+		return NULL;
+	}
+
+	if (fread(&header, sizeof(header), 1, fp) != 1
+	 || memcmp(header.magic, magic, sizeof(header.magic))
+	 || header.version != FA_ARCHIVE_VERSION) {
+		wprintf(L"%s is not a supported frame analysis archive\n", path.c_str());
+		fclose(fp);
+		return NULL;
+	}
+
+	return fp;
+}
+
+static bool read_index(vector<ArchiveEntry> *entries)
+{
+	FrameAnalysisArchiveRecord record;
+	ArchiveEntry entry;
+	FILE *fp;
+
+	fp = open_archive_file(FA_ARCHIVE_INDEX_NAME, FA_ARCHIVE_INDEX_MAGIC);
+	if (!fp)
+		return false;
+
+	// The index may be truncated if the game crashed partway through
+	// the dump, in which case we use everything up to that point:
+	while (fread(&record, sizeof(record), 1, fp) == 1) {
+		if (record.type != (uint16_t)FrameAnalysisArchiveRecordType::BLOB
+		 && record.type != (uint16_t)FrameAnalysisArchiveRecordType::LINK) {
+			wprintf(L"Corrupt record in index, stopping here\n");
+			break;
+		}
+
+		entry.type = (FrameAnalysisArchiveRecordType)record.type;
+		entry.offset = record.offset;
+		entry.size = record.size;
+		entry.name.resize(record.name_len);
+		if (record.name_len && fread(&entry.name[0], sizeof(wchar_t), record.name_len, fp) != record.name_len)
+			break;
+
+		entries->push_back(entry);
+	}
+
+	fclose(fp);
+	return true;
+}
+
+static bool matches_patterns(const wstring &name)
+{
+	if (args.patterns.empty())
+		return true;
+
+	for (const wstring &pattern : args.patterns) {
+		if (PathMatchSpecW(name.c_str(), pattern.c_str()))
+			return true;
+	}
+
+	return false;
+}
+
+static bool selected(const ArchiveEntry &entry)
+{
+	if (args.blobs != (entry.type == FrameAnalysisArchiveRecordType::BLOB))
+		return false;
+
+	return matches_patterns(entry.name);
+}
+
+static void list(vector<ArchiveEntry> &entries)
+{
+	for (ArchiveEntry &entry : entries) {
+		if (selected(entry))
+			wprintf(L"%12llu %10u %s\n", entry.offset, entry.size, entry.name.c_str());
+	}
+}
+
+static bool ensure_parent_directory(const wstring &path)
+{
+	size_t pos = path.find_last_of(L'\\');
+	wstring dir;
+	int err;
+
+	if (pos == wstring::npos)
+		return true;
+
+	dir = path.substr(0, pos);
+	err = SHCreateDirectoryExW(NULL, dir.c_str(), NULL);
+	return err == ERROR_SUCCESS || err == ERROR_ALREADY_EXISTS || err == ERROR_FILE_EXISTS;
+}
+
+static bool write_blob(FILE *pack, const ArchiveEntry &entry, const wstring &path)
+{
+	char buf[64 * 1024];
+	uint32_t remaining = entry.size;
+	size_t chunk;
+	FILE *fp;
+	bool ret = true;
+
+	if (!ensure_parent_directory(path) || _wfopen_s(&fp, path.c_str(), L"wb") || !fp) {
+		wprintf(L"Unable to create %s\n", path.c_str());
+		return false;
+	}
+
+	if (_fseeki64(pack, entry.offset, SEEK_SET)) {
+		ret = false;
+		remaining = 0;
+	}
+
+	while (remaining) {
+		chunk = min(sizeof(buf), (size_t)remaining);
+		if (fread(buf, 1, chunk, pack) != chunk || fwrite(buf, 1, chunk, fp) != chunk) {
+			ret = false;
+			break;
+		}
+		remaining -= (uint32_t)chunk;
+	}
+
+	fclose(fp);
+
+	if (!ret) {
+		wprintf(L"Error extracting %s\n", path.c_str());
+		DeleteFileW(path.c_str());
+	}
+	return ret;
+}
+
+static int extract(vector<ArchiveEntry> &entries)
+{
+	unordered_map<UINT64, wstring> blob_names;
+	unordered_map<UINT64, wstring>::iterator blob;
+	unordered_set<UINT64> extracted;
+	wstring path, blob_path;
+	unsigned files = 0, failed = 0;
+	FILE *pack;
+
+	pack = open_archive_file(FA_ARCHIVE_PACK_NAME, FA_ARCHIVE_PACK_MAGIC);
+	if (!pack)
+		return EXIT_FAILURE;
+
+	// Links refer to blobs by offset, so remember the name of each blob
+	// to find the deduped file to link to:
+	for (ArchiveEntry &entry : entries) {
+		if (entry.type == FrameAnalysisArchiveRecordType::BLOB)
+			blob_names.emplace(entry.offset, entry.name);
+	}
+
+	for (ArchiveEntry &entry : entries) {
+		if (!selected(entry))
+			continue;
+
+		path = args.output_dir + L"\\" + entry.name;
+		if (GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES)
+			continue;
+
+		if (entry.type == FrameAnalysisArchiveRecordType::BLOB || args.copy) {
+			if (write_blob(pack, entry, path))
+				files++;
+			else
+				failed++;
+			continue;
+		}
+
+		// Extract the deduped file on demand the first time a name
+		// referring to it is selected, then hard link to it the same
+		// as frame analysis would have done:
+		blob_path.clear();
+		blob = blob_names.find(entry.offset);
+		if (blob != blob_names.end())
+			blob_path = args.output_dir + L"\\" + blob->second;
+
+		if (!blob_path.empty() && !extracted.count(entry.offset)
+		 && GetFileAttributesW(blob_path.c_str()) == INVALID_FILE_ATTRIBUTES) {
+			if (write_blob(pack, entry, blob_path))
+				extracted.insert(entry.offset);
+		}
+
+		if (!blob_path.empty() && blob_path != path && ensure_parent_directory(path)
+		 && CreateHardLinkW(path.c_str(), blob_path.c_str(), NULL)) {
+			files++;
+			continue;
+		}
+
+		// No blob record (e.g. truncated index), or the hard link
+		// failed - too many links, FAT32, etc. Just write a copy:
+		if (write_blob(pack, entry, path))
+			files++;
+		else
+			failed++;
+	}
+
+	fclose(pack);
+
+	wprintf(L"Extracted %u files to %s", files, args.output_dir.c_str());
+	if (failed)
+		wprintf(L", %u failed", failed);
+	wprintf(L"\n");
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int wmain(int argc, wchar_t *argv[])
+{
+	vector<ArchiveEntry> entries;
+	int ret = EXIT_SUCCESS;
+
+	parse_args(argc, argv);
+
+	if (!read_index(&entries))
+		return EXIT_FAILURE;
+
+	if (args.list)
+		list(entries);
+
+	if (args.extract)
+		ret = extract(entries);
+
+	return ret;
+}
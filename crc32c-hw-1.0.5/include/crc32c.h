@@ -24,6 +24,27 @@ extern "C" CRC32C_API uint32_t crc32c_append(
     const uint8_t *input,       // data to be put through the CRC algorithm
     size_t length);             // length of the data in the input buffer
 
+/*
+    3DMigoto addition: Same as appending length zero bytes with crc32c_append,
+    but without needing a buffer of zeroes.
+*/
+extern "C" CRC32C_API uint32_t crc32c_append_zeroes(
+    uint32_t crc,
+    size_t length);
+
+/*
+    3DMigoto addition: Same as calling crc32c_append on row_length bytes at the
+    start of each of the rows, row_pitch bytes apart, each followed by
+    crc32c_append_zeroes of zero_padding bytes.
+*/
+extern "C" CRC32C_API uint32_t crc32c_append_rows(
+    uint32_t crc,
+    const uint8_t *input,
+    size_t row_length,
+    size_t row_pitch,
+    size_t rows,
+    size_t zero_padding);
+
 extern "C" CRC32C_API void crc32c_unittest();
 uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32 = 0);
 #endif
@@ -331,6 +331,262 @@ extern "C" CRC32C_API uint32_t crc32c_append(uint32_t crc, buffer input, size_t
         return append_table(crc, input, length);
 }
 
+/* 3DMigoto addition: Appending runs of zeroes and hashing the strided rows of
+   a texture. Texture hashes with zero_padding used to be computed by feeding a
+   buffer of real zeroes through the CRC after every row, and with one call per
+   row and per padding chunk - a texture with a narrow row pitch spent most of
+   its time on call overhead and the three cycle latency of the crc32
+   instruction rather than on the data. */
+
+/* Multiply a by b modulo the polynomial, in the reflected bit order of the crc
+   register (the x^0 coefficient is the top bit). a must not be zero. */
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t p = 0;
+
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+    }
+    return p;
+}
+
+/* x2n_table[k] = x^(2^k) modulo the polynomial */
+static uint32_t x2n_table[32];
+
+static bool make_x2n_table()
+{
+    uint32_t p = (uint32_t)1 << 30; /* x^1 */
+
+    x2n_table[0] = p;
+    for (int k = 1; k < 32; k++)
+        x2n_table[k] = p = multmodp(p, p);
+    return true;
+}
+
+static bool x2n_table_ready = make_x2n_table();
+
+/* x^(n * 2^k) modulo the polynomial. With k = 3 this is the operator that
+   appends n zero bytes to a crc register. */
+static uint32_t x2nmodp(uint64_t n, unsigned k)
+{
+    uint32_t p = (uint32_t)1 << 31; /* x^0 == 1 */
+
+    while (n)
+    {
+        if (n & 1)
+            p = multmodp(x2n_table[k & 31], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+/* Build a table for shift_crc() that applies the operator op, the same as
+   the pre-generated long_shifts and short_shifts do for their lengths. Only
+   the eight single bit entries of each byte need a multiplication, the rest
+   follow by linearity. */
+static void make_shift_table(uint32_t shift_table[][256], uint32_t op)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        shift_table[k][0] = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            uint32_t bit = 1u << i;
+            uint32_t v = multmodp(op, bit << (8 * k));
+            for (uint32_t b = 0; b < bit; b++)
+                shift_table[k][bit | b] = shift_table[k][b] ^ v;
+        }
+    }
+}
+
+/* Below this many zeroes it is cheaper to run them through the crc32
+   instruction (from a register, not memory) than to build a shift table */
+#define ZERO_FEED_MAX 256
+
+static inline uint32_t feed_zeroes_hw(uint32_t crc, size_t len)
+{
+#ifdef _M_X64
+    uint64_t crc0 = crc;
+
+    for (; len >= 8; len -= 8)
+        crc0 = _mm_crc32_u64(crc0, 0);
+#else
+    uint32_t crc0 = crc;
+
+    for (; len >= 4; len -= 4)
+        crc0 = _mm_crc32_u32(crc0, 0);
+#endif
+    for (; len; len--)
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), 0);
+    return static_cast<uint32_t>(crc0);
+}
+
+/* Appends the padding after each row. Works on the raw crc register, i.e.
+   without the pre and post inversion. */
+struct row_padding
+{
+    size_t len;
+    uint32_t op;
+    uint32_t shifts[4][256];
+
+    row_padding(size_t len, bool hw) :
+        len(len),
+        op(0)
+    {
+        if (len && (!hw || len >= ZERO_FEED_MAX))
+            op = x2nmodp(len, 3);
+        if (op && hw)
+            make_shift_table(shifts, op);
+    }
+
+    inline uint32_t apply_hw(uint32_t crc)
+    {
+        if (!len)
+            return crc;
+        if (!op)
+            return feed_zeroes_hw(crc, len);
+        return shift_crc(shifts, crc);
+    }
+
+    inline uint32_t apply_sw(uint32_t crc)
+    {
+        if (!len)
+            return crc;
+        return multmodp(op, crc);
+    }
+};
+
+/* Three rows of the same length from different parts of the texture at once,
+   each in its own crc register, so the crc32 instructions don't have to wait
+   on each other. Raw crc registers. */
+static inline void rows3_hw(uint32_t *crc, buffer row0, buffer row1, buffer row2, size_t len)
+{
+#ifdef _M_X64
+    uint64_t crc0 = crc[0], crc1 = crc[1], crc2 = crc[2];
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        crc0 = _mm_crc32_u64(crc0, *reinterpret_cast<const uint64_t *>(row0 + i));
+        crc1 = _mm_crc32_u64(crc1, *reinterpret_cast<const uint64_t *>(row1 + i));
+        crc2 = _mm_crc32_u64(crc2, *reinterpret_cast<const uint64_t *>(row2 + i));
+    }
+#else
+    uint32_t crc0 = crc[0], crc1 = crc[1], crc2 = crc[2];
+    size_t i;
+
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        crc0 = _mm_crc32_u32(crc0, *reinterpret_cast<const uint32_t *>(row0 + i));
+        crc1 = _mm_crc32_u32(crc1, *reinterpret_cast<const uint32_t *>(row1 + i));
+        crc2 = _mm_crc32_u32(crc2, *reinterpret_cast<const uint32_t *>(row2 + i));
+    }
+#endif
+    for (; i < len; i++)
+    {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), row0[i]);
+        crc1 = _mm_crc32_u8(static_cast<uint32_t>(crc1), row1[i]);
+        crc2 = _mm_crc32_u8(static_cast<uint32_t>(crc2), row2[i]);
+    }
+
+    crc[0] = static_cast<uint32_t>(crc0);
+    crc[1] = static_cast<uint32_t>(crc1);
+    crc[2] = static_cast<uint32_t>(crc2);
+}
+
+static uint32_t append_rows_hw(uint32_t crc, buffer input, size_t row_length,
+        size_t row_pitch, size_t rows, size_t zero_padding)
+{
+    row_padding padding(zero_padding, true);
+    uint32_t crc0 = crc ^ 0xffffffff;
+    uint32_t band_crc[3];
+    size_t band_rows, r;
+    uint32_t op;
+
+    /* append_hw already runs three streams over rows this long: */
+    if (row_length < 3 * SHORT_SHIFT && rows >= 3)
+    {
+        /* Split the rows into three bands hashed side by side, the
+           second and third starting from a zero register, then shift
+           each band past the next and combine them: */
+        band_rows = rows / 3;
+        band_crc[0] = crc0;
+        band_crc[1] = 0;
+        band_crc[2] = 0;
+        for (r = 0; r < band_rows; r++)
+        {
+            rows3_hw(band_crc,
+                input + r * row_pitch,
+                input + (band_rows + r) * row_pitch,
+                input + (2 * band_rows + r) * row_pitch,
+                row_length);
+            band_crc[0] = padding.apply_hw(band_crc[0]);
+            band_crc[1] = padding.apply_hw(band_crc[1]);
+            band_crc[2] = padding.apply_hw(band_crc[2]);
+        }
+
+        op = x2nmodp((uint64_t)band_rows * (row_length + zero_padding), 3);
+        crc0 = multmodp(op, band_crc[0]) ^ band_crc[1];
+        crc0 = multmodp(op, crc0) ^ band_crc[2];
+
+        input += 3 * band_rows * row_pitch;
+        rows -= 3 * band_rows;
+    }
+
+    for (r = 0; r < rows; r++, input += row_pitch)
+    {
+        crc0 = append_hw(crc0 ^ 0xffffffff, input, row_length) ^ 0xffffffff;
+        crc0 = padding.apply_hw(crc0);
+    }
+
+    return crc0 ^ 0xffffffff;
+}
+
+static uint32_t append_rows_sw(uint32_t crc, buffer input, size_t row_length,
+        size_t row_pitch, size_t rows, size_t zero_padding)
+{
+    row_padding padding(zero_padding, false);
+    uint32_t crc0 = crc ^ 0xffffffff;
+
+    for (size_t r = 0; r < rows; r++, input += row_pitch)
+    {
+        crc0 = append_table(crc0 ^ 0xffffffff, input, row_length) ^ 0xffffffff;
+        crc0 = padding.apply_sw(crc0);
+    }
+
+    return crc0 ^ 0xffffffff;
+}
+
+extern "C" CRC32C_API uint32_t crc32c_append_zeroes(uint32_t crc, size_t length)
+{
+    if (!length)
+        return crc;
+
+    if (hw_available && length < ZERO_FEED_MAX)
+        return feed_zeroes_hw(crc ^ 0xffffffff, length) ^ 0xffffffff;
+
+    return multmodp(x2nmodp(length, 3), crc ^ 0xffffffff) ^ 0xffffffff;
+}
+
+extern "C" CRC32C_API uint32_t crc32c_append_rows(uint32_t crc, const uint8_t *input,
+        size_t row_length, size_t row_pitch, size_t rows, size_t zero_padding)
+{
+    if (hw_available)
+        return append_rows_hw(crc, input, row_length, row_pitch, rows, zero_padding);
+    else
+        return append_rows_sw(crc, input, row_length, row_pitch, rows, zero_padding);
+}
+
 #define TEST_BUFFER 65536
 #define TEST_SLICES 1000000
 
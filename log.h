@@ -16,14 +16,43 @@ extern bool gLogDebug;
 // probably not worth doing so unless we were switching to use a central
 // logging framework.
 
+// Tools that process several shaders in parallel (cmd_Decompiler's batch
+// mode) can define MIGOTO_LOG_PER_THREAD and point ThreadLogFile() at a
+// per-thread stream so that the log of each file stays together instead of
+// interleaving with other threads. This is opt-in since it relies on the
+// thread_local keyword, which we avoid in the wrapper DLLs (see the comment
+// above struct TLS in DirectX11/globals.h). ThreadLogFile() is inline with
+// external linkage so that every translation unit shares one instance
+// without having to define it alongside LogFile.
+#ifdef MIGOTO_LOG_PER_THREAD
+inline FILE *&ThreadLogFile()
+{
+	static thread_local FILE *thread_log_file = NULL;
+	return thread_log_file;
+}
+
+static inline FILE *CurrentLogFile()
+{
+	FILE *thread_log_file;
+
+	if (!LogFile)
+		return NULL;
+
+	thread_log_file = ThreadLogFile();
+	return thread_log_file ? thread_log_file : LogFile;
+}
+#else
+#define CurrentLogFile() LogFile
+#endif
+
 #define LogInfo(fmt, ...) \
-	do { if (LogFile) fprintf(LogFile, fmt, __VA_ARGS__); } while (0)
+	do { if (CurrentLogFile()) fprintf(CurrentLogFile(), fmt, __VA_ARGS__); } while (0)
 #define vLogInfo(fmt, va_args) \
-	do { if (LogFile) vfprintf(LogFile, fmt, va_args); } while (0)
+	do { if (CurrentLogFile()) vfprintf(CurrentLogFile(), fmt, va_args); } while (0)
 #define LogInfoW(fmt, ...) \
-	do { if (LogFile) fwprintf(LogFile, fmt, __VA_ARGS__); } while (0)
+	do { if (CurrentLogFile()) fwprintf(CurrentLogFile(), fmt, __VA_ARGS__); } while (0)
 #define vLogInfoW(fmt, va_args) \
-	do { if (LogFile) vfwprintf(LogFile, fmt, va_args); } while (0)
+	do { if (CurrentLogFile()) vfwprintf(CurrentLogFile(), fmt, va_args); } while (0)
 
 #define LogDebug(fmt, ...) \
 	do { if (gLogDebug) LogInfo(fmt, __VA_ARGS__); } while (0)
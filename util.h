@@ -105,27 +105,197 @@ static uint32_t crc32c_hw(uint32_t seed, const void *buffer, size_t length)
 	}
 }
 
+// Hashes the rows of a texture as they are laid out in memory, with either
+// the padding at the end of each row skipped, or replaced by zeroes. length
+// caps the number of bytes that are hashed, counting the replacement zeroes,
+// and may cut off the last row or its padding part way through.
+//
+// This used to make a call to crc32c_hw for every row plus another for every
+// chunk of padding, from a buffer of zeroes allocated on every call. The
+// results are bit for bit identical, but rows that are not cut off by length
+// are now hashed in one call that interleaves several rows at once and
+// appends the padding zeroes without reading any memory.
+static uint32_t crc32c_hw_texture_rows(uint32_t hash, const void *data, size_t length,
+		size_t row_pitch, size_t row_count, UINT mapped_row_pitch, bool zero_padding)
+{
+	const uint8_t *sptr = (const uint8_t*)data;
+	size_t msize = min(row_pitch, (size_t)mapped_row_pitch);
+	signed padding = (signed)mapped_row_pitch - (signed)row_pitch;
+	size_t zeroes = (zero_padding && padding > 0) ? padding : 0;
+	size_t stride = msize + zeroes;
+	signed remaining = (signed)length;
+	size_t h = 0;
+
+	try {
+		if (stride && remaining > 0) {
+			h = min(row_count, (size_t)remaining / stride);
+			hash = crc32c_append_rows(hash, sptr, msize, mapped_row_pitch, h, zeroes);
+			sptr += h * mapped_row_pitch;
+			remaining -= (signed)(h * stride);
+		}
+
+		// Whatever is left of the row that length cuts off:
+		for (; h < row_count && remaining > 0; h++) {
+			hash = crc32c_append(hash, sptr, min(msize, (size_t)remaining));
+			sptr += mapped_row_pitch;
+			remaining -= (signed)msize;
+
+			if (zeroes && remaining > 0) {
+				hash = crc32c_append_zeroes(hash, min(zeroes, (size_t)remaining));
+				remaining -= (signed)zeroes;
+			}
+		}
+	}
+	catch (...)
+	{
+		// Fatal error, but catch it and return null for hash.
+		LogInfo("   ******* Exception caught while calculating crc32c_hw hash ******\n");
+		return 0;
+	}
+
+	return hash;
+}
+
 
 // -----------------------------------------------------------------------------------------------
 
 // Primary hash calculation for all shader file names.
+//
+// FNV-1 is a strict serial chain (multiply, then xor in the next octet), and
+// since the xor does not distribute over the multiply there is no way to split
+// the buffer over independent lanes and fold them back together while still
+// producing the same value - the chain length of one 64bit multiply per byte
+// is the floor. What we can do is get everything else out of the way of that
+// chain: load eight bytes at a time and unroll the loop so that the only work
+// left per octet is the multiply + xor. Values are bit for bit identical to
+// the original byte at a time loop, so existing ShaderFixes remain valid.
+//
+// If you are starting a new fix and want faster hashing use shader_hash =
+// xxhash64 instead, which does not have this limitation.
 
 // 64 bit magic FNV-0 and FNV-1 prime
 #define FNV_64_PRIME ((UINT64)0x100000001b3ULL)
+#define FNV_64_STEP(hval, octet) (((hval) * FNV_64_PRIME) ^ (UINT64)(octet))
 static UINT64 fnv_64_buf(const void *buf, size_t len)
 {
 	UINT64 hval = 0;
+	UINT64 octets;
 	unsigned const char *bp = (unsigned const char *)buf;	/* start of buffer */
 	unsigned const char *be = bp + len;		/* beyond end of buffer */
 
-	// FNV-1 hash each octet of the buffer
+	// FNV-1 hash eight octets per iteration, lowest address first
+	while (be - bp >= 8) {
+		memcpy(&octets, bp, 8);
+		hval = FNV_64_STEP(hval, octets       & 0xff);
+		hval = FNV_64_STEP(hval, octets >>  8 & 0xff);
+		hval = FNV_64_STEP(hval, octets >> 16 & 0xff);
+		hval = FNV_64_STEP(hval, octets >> 24 & 0xff);
+		hval = FNV_64_STEP(hval, octets >> 32 & 0xff);
+		hval = FNV_64_STEP(hval, octets >> 40 & 0xff);
+		hval = FNV_64_STEP(hval, octets >> 48 & 0xff);
+		hval = FNV_64_STEP(hval, octets >> 56);
+		bp += 8;
+	}
+
+	// FNV-1 hash each remaining octet of the buffer
 	while (bp < be)
-	{
-		// multiply by the 64 bit FNV magic prime mod 2^64 */
-		hval *= FNV_64_PRIME;
-		// xor the bottom with the current octet
-		hval ^= (UINT64)*bp++;
+		hval = FNV_64_STEP(hval, *bp++);
+
+	return hval;
+}
+
+// Opt-in fast shader hash (shader_hash = xxhash64). This is a straight
+// implementation of XXH64 with a zero seed so that modders can reproduce the
+// hash of a shader with any of the standard xxhsum tools. It consumes 32 bytes
+// per iteration across four independent accumulators, so unlike FNV-1 the CPU
+// can overlap the multiplies and it runs close to memory bandwidth.
+#define XXH64_PRIME_1 0x9E3779B185EBCA87ULL
+#define XXH64_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define XXH64_PRIME_3 0x165667B19E3779F9ULL
+#define XXH64_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define XXH64_PRIME_5 0x27D4EB2F165667C5ULL
+
+static inline UINT64 xxh64_read64(const unsigned char *p)
+{
+	UINT64 val;
+	memcpy(&val, p, 8);
+	return val;
+}
+
+static inline UINT32 xxh64_read32(const unsigned char *p)
+{
+	UINT32 val;
+	memcpy(&val, p, 4);
+	return val;
+}
+
+static inline UINT64 xxh64_round(UINT64 acc, UINT64 input)
+{
+	acc += input * XXH64_PRIME_2;
+	acc = _rotl64(acc, 31);
+	return acc * XXH64_PRIME_1;
+}
+
+static inline UINT64 xxh64_merge_round(UINT64 acc, UINT64 val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * XXH64_PRIME_1 + XXH64_PRIME_4;
+}
+
+static UINT64 xxhash64_buf(const void *buf, size_t len)
+{
+	unsigned const char *bp = (unsigned const char *)buf;
+	unsigned const char *be = bp + len;
+	UINT64 hval;
+
+	if (len >= 32) {
+		UINT64 v1 = XXH64_PRIME_1 + XXH64_PRIME_2;
+		UINT64 v2 = XXH64_PRIME_2;
+		UINT64 v3 = 0;
+		UINT64 v4 = 0 - XXH64_PRIME_1;
+
+		do {
+			v1 = xxh64_round(v1, xxh64_read64(bp));
+			v2 = xxh64_round(v2, xxh64_read64(bp + 8));
+			v3 = xxh64_round(v3, xxh64_read64(bp + 16));
+			v4 = xxh64_round(v4, xxh64_read64(bp + 24));
+			bp += 32;
+		} while (be - bp >= 32);
+
+		hval = _rotl64(v1, 1) + _rotl64(v2, 7) + _rotl64(v3, 12) + _rotl64(v4, 18);
+		hval = xxh64_merge_round(hval, v1);
+		hval = xxh64_merge_round(hval, v2);
+		hval = xxh64_merge_round(hval, v3);
+		hval = xxh64_merge_round(hval, v4);
+	} else {
+		hval = XXH64_PRIME_5;
+	}
+
+	hval += (UINT64)len;
+
+	while (be - bp >= 8) {
+		hval ^= xxh64_round(0, xxh64_read64(bp));
+		hval = _rotl64(hval, 27) * XXH64_PRIME_1 + XXH64_PRIME_4;
+		bp += 8;
 	}
+
+	if (be - bp >= 4) {
+		hval ^= (UINT64)xxh64_read32(bp) * XXH64_PRIME_1;
+		hval = _rotl64(hval, 23) * XXH64_PRIME_2 + XXH64_PRIME_3;
+		bp += 4;
+	}
+
+	while (bp < be) {
+		hval ^= (UINT64)*bp++ * XXH64_PRIME_5;
+		hval = _rotl64(hval, 11) * XXH64_PRIME_1;
+	}
+
+	hval ^= hval >> 33;
+	hval *= XXH64_PRIME_2;
+	hval ^= hval >> 29;
+	hval *= XXH64_PRIME_3;
+	hval ^= hval >> 32;
+
 	return hval;
 }
 
@@ -403,6 +573,100 @@ static T2 parse_enum_option_string_prefix(struct EnumName_t<T1, T2> *enum_names,
 	return ret;
 }
 
+// Is there already a utility function that does this? Outside of the
+// MIGOTO_DX block as cmd_DirectX11Tests also uses it for the vertex buffer
+// text formatter benchmark.
+static UINT dxgi_format_size(DXGI_FORMAT format)
+{
+	switch (format) {
+		case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		case DXGI_FORMAT_R32G32B32A32_UINT:
+		case DXGI_FORMAT_R32G32B32A32_SINT:
+			return 16;
+		case DXGI_FORMAT_R32G32B32_TYPELESS:
+		case DXGI_FORMAT_R32G32B32_FLOAT:
+		case DXGI_FORMAT_R32G32B32_UINT:
+		case DXGI_FORMAT_R32G32B32_SINT:
+			return 12;
+		case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R16G16B16A16_UNORM:
+		case DXGI_FORMAT_R16G16B16A16_UINT:
+		case DXGI_FORMAT_R16G16B16A16_SNORM:
+		case DXGI_FORMAT_R16G16B16A16_SINT:
+		case DXGI_FORMAT_R32G32_TYPELESS:
+		case DXGI_FORMAT_R32G32_FLOAT:
+		case DXGI_FORMAT_R32G32_UINT:
+		case DXGI_FORMAT_R32G32_SINT:
+		case DXGI_FORMAT_R32G8X24_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+		case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+			return 8;
+		case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+		case DXGI_FORMAT_R10G10B10A2_UNORM:
+		case DXGI_FORMAT_R10G10B10A2_UINT:
+		case DXGI_FORMAT_R11G11B10_FLOAT:
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		case DXGI_FORMAT_R8G8B8A8_UINT:
+		case DXGI_FORMAT_R8G8B8A8_SNORM:
+		case DXGI_FORMAT_R8G8B8A8_SINT:
+		case DXGI_FORMAT_R16G16_TYPELESS:
+		case DXGI_FORMAT_R16G16_FLOAT:
+		case DXGI_FORMAT_R16G16_UNORM:
+		case DXGI_FORMAT_R16G16_UINT:
+		case DXGI_FORMAT_R16G16_SNORM:
+		case DXGI_FORMAT_R16G16_SINT:
+		case DXGI_FORMAT_R32_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT:
+		case DXGI_FORMAT_R32_FLOAT:
+		case DXGI_FORMAT_R32_UINT:
+		case DXGI_FORMAT_R32_SINT:
+		case DXGI_FORMAT_R24G8_TYPELESS:
+		case DXGI_FORMAT_D24_UNORM_S8_UINT:
+		case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+		case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+		case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+		case DXGI_FORMAT_R8G8_B8G8_UNORM:
+		case DXGI_FORMAT_G8R8_G8B8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+			return 4;
+		case DXGI_FORMAT_R8G8_TYPELESS:
+		case DXGI_FORMAT_R8G8_UNORM:
+		case DXGI_FORMAT_R8G8_UINT:
+		case DXGI_FORMAT_R8G8_SNORM:
+		case DXGI_FORMAT_R8G8_SINT:
+		case DXGI_FORMAT_R16_TYPELESS:
+		case DXGI_FORMAT_R16_FLOAT:
+		case DXGI_FORMAT_D16_UNORM:
+		case DXGI_FORMAT_R16_UNORM:
+		case DXGI_FORMAT_R16_UINT:
+		case DXGI_FORMAT_R16_SNORM:
+		case DXGI_FORMAT_R16_SINT:
+		case DXGI_FORMAT_B5G6R5_UNORM:
+		case DXGI_FORMAT_B5G5R5A1_UNORM:
+			return 2;
+		case DXGI_FORMAT_R8_TYPELESS:
+		case DXGI_FORMAT_R8_UNORM:
+		case DXGI_FORMAT_R8_UINT:
+		case DXGI_FORMAT_R8_SNORM:
+		case DXGI_FORMAT_R8_SINT:
+		case DXGI_FORMAT_A8_UNORM:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
 #if MIGOTO_DX == 11
 // http://msdn.microsoft.com/en-us/library/windows/desktop/bb173059(v=vs.85).aspx
 static char *DXGIFormats[] = {
@@ -602,98 +866,6 @@ static DXGI_FORMAT EnsureNotTypeless( DXGI_FORMAT fmt )
     }
 }
 
-// Is there already a utility function that does this?
-static UINT dxgi_format_size(DXGI_FORMAT format)
-{
-	switch (format) {
-		case DXGI_FORMAT_R32G32B32A32_TYPELESS:
-		case DXGI_FORMAT_R32G32B32A32_FLOAT:
-		case DXGI_FORMAT_R32G32B32A32_UINT:
-		case DXGI_FORMAT_R32G32B32A32_SINT:
-			return 16;
-		case DXGI_FORMAT_R32G32B32_TYPELESS:
-		case DXGI_FORMAT_R32G32B32_FLOAT:
-		case DXGI_FORMAT_R32G32B32_UINT:
-		case DXGI_FORMAT_R32G32B32_SINT:
-			return 12;
-		case DXGI_FORMAT_R16G16B16A16_TYPELESS:
-		case DXGI_FORMAT_R16G16B16A16_FLOAT:
-		case DXGI_FORMAT_R16G16B16A16_UNORM:
-		case DXGI_FORMAT_R16G16B16A16_UINT:
-		case DXGI_FORMAT_R16G16B16A16_SNORM:
-		case DXGI_FORMAT_R16G16B16A16_SINT:
-		case DXGI_FORMAT_R32G32_TYPELESS:
-		case DXGI_FORMAT_R32G32_FLOAT:
-		case DXGI_FORMAT_R32G32_UINT:
-		case DXGI_FORMAT_R32G32_SINT:
-		case DXGI_FORMAT_R32G8X24_TYPELESS:
-		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
-		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
-		case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
-			return 8;
-		case DXGI_FORMAT_R10G10B10A2_TYPELESS:
-		case DXGI_FORMAT_R10G10B10A2_UNORM:
-		case DXGI_FORMAT_R10G10B10A2_UINT:
-		case DXGI_FORMAT_R11G11B10_FLOAT:
-		case DXGI_FORMAT_R8G8B8A8_TYPELESS:
-		case DXGI_FORMAT_R8G8B8A8_UNORM:
-		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
-		case DXGI_FORMAT_R8G8B8A8_UINT:
-		case DXGI_FORMAT_R8G8B8A8_SNORM:
-		case DXGI_FORMAT_R8G8B8A8_SINT:
-		case DXGI_FORMAT_R16G16_TYPELESS:
-		case DXGI_FORMAT_R16G16_FLOAT:
-		case DXGI_FORMAT_R16G16_UNORM:
-		case DXGI_FORMAT_R16G16_UINT:
-		case DXGI_FORMAT_R16G16_SNORM:
-		case DXGI_FORMAT_R16G16_SINT:
-		case DXGI_FORMAT_R32_TYPELESS:
-		case DXGI_FORMAT_D32_FLOAT:
-		case DXGI_FORMAT_R32_FLOAT:
-		case DXGI_FORMAT_R32_UINT:
-		case DXGI_FORMAT_R32_SINT:
-		case DXGI_FORMAT_R24G8_TYPELESS:
-		case DXGI_FORMAT_D24_UNORM_S8_UINT:
-		case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
-		case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
-		case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
-		case DXGI_FORMAT_R8G8_B8G8_UNORM:
-		case DXGI_FORMAT_G8R8_G8B8_UNORM:
-		case DXGI_FORMAT_B8G8R8A8_UNORM:
-		case DXGI_FORMAT_B8G8R8X8_UNORM:
-		case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
-		case DXGI_FORMAT_B8G8R8A8_TYPELESS:
-		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
-		case DXGI_FORMAT_B8G8R8X8_TYPELESS:
-		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
-			return 4;
-		case DXGI_FORMAT_R8G8_TYPELESS:
-		case DXGI_FORMAT_R8G8_UNORM:
-		case DXGI_FORMAT_R8G8_UINT:
-		case DXGI_FORMAT_R8G8_SNORM:
-		case DXGI_FORMAT_R8G8_SINT:
-		case DXGI_FORMAT_R16_TYPELESS:
-		case DXGI_FORMAT_R16_FLOAT:
-		case DXGI_FORMAT_D16_UNORM:
-		case DXGI_FORMAT_R16_UNORM:
-		case DXGI_FORMAT_R16_UINT:
-		case DXGI_FORMAT_R16_SNORM:
-		case DXGI_FORMAT_R16_SINT:
-		case DXGI_FORMAT_B5G6R5_UNORM:
-		case DXGI_FORMAT_B5G5R5A1_UNORM:
-			return 2;
-		case DXGI_FORMAT_R8_TYPELESS:
-		case DXGI_FORMAT_R8_UNORM:
-		case DXGI_FORMAT_R8_UINT:
-		case DXGI_FORMAT_R8_SNORM:
-		case DXGI_FORMAT_R8_SINT:
-		case DXGI_FORMAT_A8_UNORM:
-			return 1;
-		default:
-			return 0;
-	}
-}
-
 
 static const char* type_name(IUnknown *object)
 {